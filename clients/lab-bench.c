@@ -0,0 +1,925 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * lab-bench - synthetic clients for benchmarking the compositor
+ *
+ * Meant to run as session client of labwc on the headless backend, see
+ * scripts/bench/run-bench.sh. It adds virtual outputs, maps a number of
+ * xdg-shell windows which commit frames and change their titles at a
+ * given rate, and then drives a fixed sequence of phases through the
+ * control socket: map storm, steady state, window cycling, workspace
+ * switches, tiling toggles, moves and unmapping.
+ *
+ * For every phase, it reports as JSON the frame times and configure
+ * latencies seen by the windows, the CPU time used by compositor and
+ * clients, and the output, configure and action statistics of the
+ * compositor.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <cairo.h>
+#include <getopt.h>
+#include <glib.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "common/buf.h"
+#include "common/macros.h"
+#include "common/mem.h"
+#include "common/time-helpers.h"
+#include "ipc.h"
+#include "pool-buffer.h"
+#include "xdg-shell-client-protocol.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+/* Longest wait for all windows to map */
+#define MAP_TIMEOUT_MSEC 10000
+/* Time given to the compositor to settle after each action */
+#define ACTION_SETTLE_MSEC 100
+
+struct conf {
+	int nr_windows;
+	int width, height;
+	/* Per window and second, 0 to only commit on configure */
+	double commit_rate;
+	double title_rate;
+	int rounds;
+	int steady_msec;
+	int nr_outputs;
+	const char *output_mode;
+	const char *output_file;
+};
+
+struct bench;
+
+struct window {
+	struct bench *bench;
+	int id;
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *toplevel;
+	struct wl_callback *frame_callback;
+	struct pool_buffer buffers[2];
+
+	int width, height;
+	int pending_width, pending_height;
+	bool configured;
+	bool mapped;
+	/* A configure is waiting to be answered by a new buffer */
+	bool dirty;
+	unsigned int nr_frames;
+	unsigned int nr_titles;
+
+	uint64_t created_nsec;
+	uint64_t commit_nsec;
+	uint64_t next_commit_nsec;
+	uint64_t next_title_nsec;
+	/* The last action a configure of this window was attributed to */
+	uint32_t action_serial;
+
+	struct wl_list link;
+};
+
+struct bench {
+	struct conf conf;
+	struct wl_display *display;
+	struct wl_compositor *compositor;
+	struct wl_shm *shm;
+	struct xdg_wm_base *wm_base;
+	struct wl_list windows;
+	int nr_created;
+	int nr_mapped;
+
+	/* Bumped by every action, to attribute configures to it */
+	uint32_t action_serial;
+	uint64_t action_nsec;
+
+	/* Samples of the current phase, in nanoseconds */
+	struct wl_array frame_times;
+	struct wl_array configure_latencies;
+	uint64_t phase_nsec;
+	double phase_compositor_cpu_ms;
+	double phase_client_cpu_ms;
+
+	pid_t compositor_pid;
+	struct buf json;
+	int nr_phases;
+};
+
+static void
+add_sample(struct wl_array *samples, uint64_t nsec)
+{
+	uint64_t *sample = wl_array_add(samples, sizeof(*sample));
+	if (sample) {
+		*sample = nsec;
+	}
+}
+
+/* CPU time of @pid from /proc, or -1 if unavailable */
+static double
+get_process_cpu_ms(pid_t pid)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%ld/stat", (long)pid);
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return -1;
+	}
+	char line[1024];
+	bool ok = fgets(line, sizeof(line), f) != NULL;
+	fclose(f);
+	/* The command name may contain spaces, so skip past it */
+	char *p = ok ? strrchr(line, ')') : NULL;
+	unsigned long utime, stime;
+	if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+			" %lu %lu", &utime, &stime) != 2) {
+		return -1;
+	}
+	return (utime + stime) * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+static double
+get_own_cpu_ms(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0
+		+ usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+/* JSON output */
+
+static void
+add_json_string(struct buf *json, const char *str, size_t len)
+{
+	buf_add_char(json, '"');
+	for (size_t i = 0; i < len; i++) {
+		unsigned char ch = str[i];
+		if (ch == '"' || ch == '\\') {
+			buf_add_char(json, '\\');
+			buf_add_char(json, ch);
+		} else if (ch < 0x20) {
+			buf_add_fmt(json, "\\u%04x", ch);
+		} else {
+			buf_add_char(json, ch);
+		}
+	}
+	buf_add_char(json, '"');
+}
+
+static bool
+is_number(const char *str, size_t len)
+{
+	char *end;
+	if (!len || strspn(str, "0123456789.-") < len) {
+		return false;
+	}
+	strtod(str, &end);
+	return (size_t)(end - str) == len;
+}
+
+/*
+ * Values are numbers, strings or lists of "<key> <number>" pairs such as
+ * "count 3 total_us 120", which become objects
+ */
+static void
+add_json_value(struct buf *json, const char *value, size_t len)
+{
+	if (is_number(value, len)) {
+		buf_add_n(json, value, len);
+		return;
+	}
+
+	gchar *copy = g_strndup(value, len);
+	gchar **tokens = g_strsplit(copy, " ", -1);
+	guint nr_tokens = g_strv_length(tokens);
+	bool pairs = nr_tokens && !(nr_tokens % 2);
+	for (guint i = 1; pairs && i < nr_tokens; i += 2) {
+		pairs = is_number(tokens[i], strlen(tokens[i]));
+	}
+	if (pairs) {
+		buf_add_char(json, '{');
+		for (guint i = 0; i < nr_tokens; i += 2) {
+			add_json_string(json, tokens[i], strlen(tokens[i]));
+			buf_add_fmt(json, ": %s%s", tokens[i + 1],
+				i + 2 < nr_tokens ? ", " : "");
+		}
+		buf_add_char(json, '}');
+	} else {
+		add_json_string(json, value, len);
+	}
+	g_strfreev(tokens);
+	g_free(copy);
+}
+
+/*
+ * Convert the statistics printed by the compositor, which consist of
+ * unindented section lines followed by indented "<key>: <value>" lines,
+ * into an array of objects with the section line as "name"
+ */
+static void
+add_stats_json(struct buf *json, const char *text)
+{
+	bool in_section = false;
+	buf_add_char(json, '[');
+	while (*text) {
+		size_t len = strcspn(text, "\n");
+		const char *line = text;
+		text += len + !!text[len];
+		if (!len) {
+			continue;
+		}
+		if (line[0] != ' ') {
+			buf_add(json, in_section ? "}, {\"name\": " : "{\"name\": ");
+			add_json_string(json, line, len);
+			in_section = true;
+			continue;
+		}
+		const char *colon = memchr(line, ':', len);
+		if (!in_section || !colon) {
+			continue;
+		}
+		size_t indent = strspn(line, " ");
+		const char *value = colon + 1 + strspn(colon + 1, " ");
+		buf_add(json, ", ");
+		add_json_string(json, line + indent, colon - line - indent);
+		buf_add(json, ": ");
+		add_json_value(json, value, line + len - value);
+	}
+	buf_add(json, in_section ? "}]" : "]");
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void
+add_samples_json(struct buf *json, struct wl_array *samples)
+{
+	size_t count = samples->size / sizeof(uint64_t);
+	if (!count) {
+		buf_add(json, "{\"samples\": 0}");
+		return;
+	}
+	uint64_t *data = samples->data;
+	qsort(data, count, sizeof(*data), compare_samples);
+	uint64_t total = 0;
+	for (size_t i = 0; i < count; i++) {
+		total += data[i];
+	}
+	buf_add_fmt(json, "{\"samples\": %zu, \"avg\": %.1f, \"p50\": %.1f, "
+		"\"p99\": %.1f, \"max\": %.1f}", count, total / 1000.0 / count,
+		data[count / 2] / 1000.0, data[count * 99 / 100] / 1000.0,
+		data[count - 1] / 1000.0);
+}
+
+/* Control socket */
+
+static bool
+request(const char *request, struct buf *reply)
+{
+	struct buf tmp = BUF_INIT;
+	bool ok = ipc_client_request(request, reply ? reply : &tmp);
+	if (!ok) {
+		fprintf(stderr, "lab-bench: '%s' failed: %s\n", request,
+			reply ? reply->data : tmp.data);
+	}
+	buf_reset(&tmp);
+	return ok;
+}
+
+static void
+add_request_json(struct buf *json, const char *key, const char *stats_request)
+{
+	struct buf reply = BUF_INIT;
+	buf_add_fmt(json, ", \"%s\": ", key);
+	if (request(stats_request, &reply)) {
+		add_stats_json(json, reply.data);
+	} else {
+		buf_add(json, "null");
+	}
+	buf_reset(&reply);
+}
+
+/* Windows */
+
+static void handle_frame_done(void *data, struct wl_callback *callback,
+	uint32_t time);
+
+static const struct wl_callback_listener frame_listener = {
+	.done = handle_frame_done,
+};
+
+static void
+window_draw(struct window *window)
+{
+	struct bench *bench = window->bench;
+	struct pool_buffer *buffer = get_next_buffer(bench->shm,
+		window->buffers, window->width, window->height);
+	if (!buffer) {
+		/* Both buffers are still in use, try again later */
+		window->dirty = true;
+		return;
+	}
+	window->dirty = false;
+
+	/* Change the color every frame, so that there is always damage */
+	double shade = (window->nr_frames++ % 64) / 64.0;
+	cairo_set_source_rgb(buffer->cairo, shade, 0.2 + 0.15 * (window->id % 5),
+		1.0 - shade);
+	cairo_paint(buffer->cairo);
+	cairo_surface_flush(buffer->surface);
+
+	wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+	wl_surface_damage_buffer(window->surface, 0, 0, INT32_MAX, INT32_MAX);
+	if (!window->frame_callback) {
+		window->frame_callback = wl_surface_frame(window->surface);
+		wl_callback_add_listener(window->frame_callback,
+			&frame_listener, window);
+		window->commit_nsec = time_now_nsec();
+	}
+	wl_surface_commit(window->surface);
+
+	if (!window->mapped) {
+		window->mapped = true;
+		bench->nr_mapped++;
+	}
+}
+
+/* Frame time is the time from a commit until the next frame may follow */
+static void
+handle_frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct window *window = data;
+	wl_callback_destroy(callback);
+	window->frame_callback = NULL;
+	add_sample(&window->bench->frame_times,
+		time_now_nsec() - window->commit_nsec);
+}
+
+static void
+handle_xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
+		uint32_t serial)
+{
+	struct window *window = data;
+	struct bench *bench = window->bench;
+	uint64_t now = time_now_nsec();
+
+	/*
+	 * The first configure answers the initial commit, later ones are
+	 * attributed to the most recent action
+	 */
+	if (!window->configured) {
+		add_sample(&bench->configure_latencies,
+			now - window->created_nsec);
+	} else if (window->action_serial != bench->action_serial) {
+		add_sample(&bench->configure_latencies,
+			now - bench->action_nsec);
+	}
+	window->action_serial = bench->action_serial;
+	window->configured = true;
+
+	xdg_surface_ack_configure(xdg_surface, serial);
+	window->width = window->pending_width > 0
+		? window->pending_width : bench->conf.width;
+	window->height = window->pending_height > 0
+		? window->pending_height : bench->conf.height;
+	window_draw(window);
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = handle_xdg_surface_configure,
+};
+
+static void
+handle_toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+		int32_t width, int32_t height, struct wl_array *states)
+{
+	struct window *window = data;
+	window->pending_width = width;
+	window->pending_height = height;
+}
+
+static void
+handle_toplevel_close(void *data, struct xdg_toplevel *toplevel)
+{
+	/* The benchmark decides when windows go away */
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+	.configure = handle_toplevel_configure,
+	.close = handle_toplevel_close,
+};
+
+static void
+window_set_title(struct window *window)
+{
+	char title[64];
+	snprintf(title, sizeof(title), "lab-bench %d (%u)", window->id,
+		window->nr_titles++);
+	xdg_toplevel_set_title(window->toplevel, title);
+}
+
+static void
+window_create(struct bench *bench)
+{
+	struct window *window = znew(*window);
+	window->bench = bench;
+	window->id = ++bench->nr_created;
+	window->surface = wl_compositor_create_surface(bench->compositor);
+	window->xdg_surface = xdg_wm_base_get_xdg_surface(bench->wm_base,
+		window->surface);
+	xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener,
+		window);
+	window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+	xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+	xdg_toplevel_set_app_id(window->toplevel, "lab-bench");
+	window_set_title(window);
+
+	window->action_serial = bench->action_serial;
+	window->created_nsec = time_now_nsec();
+	wl_surface_commit(window->surface);
+	wl_list_insert(bench->windows.prev, &window->link);
+}
+
+static void
+window_destroy(struct window *window)
+{
+	if (window->frame_callback) {
+		wl_callback_destroy(window->frame_callback);
+	}
+	xdg_toplevel_destroy(window->toplevel);
+	xdg_surface_destroy(window->xdg_surface);
+	wl_surface_destroy(window->surface);
+	destroy_buffer(&window->buffers[0]);
+	destroy_buffer(&window->buffers[1]);
+	if (window->mapped) {
+		window->bench->nr_mapped--;
+	}
+	wl_list_remove(&window->link);
+	free(window);
+}
+
+/* Event loop */
+
+static uint64_t
+period_nsec(double rate)
+{
+	return rate > 0 ? 1e9 / rate : UINT64_MAX;
+}
+
+static void
+advance(uint64_t *due, uint64_t period, uint64_t now)
+{
+	/* Don't try to catch up after a stall */
+	*due = *due + period > now ? *due + period : now + period;
+}
+
+/* Commit frames and change titles, returns the next time this is due */
+static uint64_t
+update_windows(struct bench *bench, uint64_t now)
+{
+	uint64_t commit_period = period_nsec(bench->conf.commit_rate);
+	uint64_t title_period = period_nsec(bench->conf.title_rate);
+	uint64_t next = UINT64_MAX;
+
+	struct window *window;
+	wl_list_for_each(window, &bench->windows, link) {
+		if (!window->configured) {
+			continue;
+		}
+		if (window->dirty) {
+			window_draw(window);
+		} else if (bench->conf.commit_rate > 0 && !window->frame_callback
+				&& now >= window->next_commit_nsec) {
+			window_draw(window);
+			advance(&window->next_commit_nsec, commit_period, now);
+		}
+		if (bench->conf.title_rate > 0 && now >= window->next_title_nsec) {
+			window_set_title(window);
+			advance(&window->next_title_nsec, title_period, now);
+		}
+		if (bench->conf.commit_rate > 0 && !window->frame_callback) {
+			next = MIN(next, window->next_commit_nsec);
+		}
+		if (bench->conf.title_rate > 0) {
+			next = MIN(next, window->next_title_nsec);
+		}
+	}
+	return next;
+}
+
+/* Process events and commit frames until @deadline */
+static void
+pump(struct bench *bench, uint64_t deadline)
+{
+	do {
+		uint64_t now = time_now_nsec();
+		uint64_t next = MIN(update_windows(bench, now), deadline);
+		int timeout = next > now
+			? (int)((next - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC)
+			: 0;
+
+		while (wl_display_prepare_read(bench->display) != 0) {
+			wl_display_dispatch_pending(bench->display);
+		}
+		wl_display_flush(bench->display);
+		struct pollfd pollfd = {
+			.fd = wl_display_get_fd(bench->display),
+			.events = POLLIN,
+		};
+		if (poll(&pollfd, 1, timeout) > 0) {
+			wl_display_read_events(bench->display);
+		} else {
+			wl_display_cancel_read(bench->display);
+		}
+		if (wl_display_dispatch_pending(bench->display) < 0) {
+			fprintf(stderr, "lab-bench: lost connection to compositor\n");
+			exit(EXIT_FAILURE);
+		}
+	} while (time_now_nsec() < deadline);
+}
+
+static void
+run_for(struct bench *bench, int msec)
+{
+	pump(bench, time_now_nsec() + msec * NSEC_PER_MSEC);
+}
+
+static void
+run_action(struct bench *bench, const char *action)
+{
+	bench->action_serial++;
+	bench->action_nsec = time_now_nsec();
+	request(action, NULL);
+}
+
+/* Phases */
+
+static void
+phase_begin(struct bench *bench)
+{
+	request("output reset-stats", NULL);
+	request("configure reset-stats", NULL);
+	request("action reset-stats", NULL);
+	bench->frame_times.size = 0;
+	bench->configure_latencies.size = 0;
+	bench->phase_compositor_cpu_ms =
+		get_process_cpu_ms(bench->compositor_pid);
+	bench->phase_client_cpu_ms = get_own_cpu_ms();
+	bench->phase_nsec = time_now_nsec();
+}
+
+static void
+add_cpu_json(struct buf *json, const char *key, double start, double end)
+{
+	if (start < 0 || end < 0) {
+		buf_add_fmt(json, ", \"%s\": null", key);
+	} else {
+		buf_add_fmt(json, ", \"%s\": %.1f", key, end - start);
+	}
+}
+
+static void
+phase_end(struct bench *bench, const char *name)
+{
+	uint64_t wall_nsec = time_now_nsec() - bench->phase_nsec;
+	struct buf *json = &bench->json;
+
+	buf_add(json, bench->nr_phases++ ? ",\n    " : "\n    ");
+	buf_add_fmt(json, "{\"name\": \"%s\", \"wall_ms\": %.1f", name,
+		wall_nsec / 1e6);
+	add_cpu_json(json, "compositor_cpu_ms", bench->phase_compositor_cpu_ms,
+		get_process_cpu_ms(bench->compositor_pid));
+	add_cpu_json(json, "client_cpu_ms", bench->phase_client_cpu_ms,
+		get_own_cpu_ms());
+	buf_add(json, ", \"frame_time_us\": ");
+	add_samples_json(json, &bench->frame_times);
+	buf_add(json, ", \"configure_latency_us\": ");
+	add_samples_json(json, &bench->configure_latencies);
+	add_request_json(json, "outputs", "output stats");
+	add_request_json(json, "configure_stats", "configure stats");
+	add_request_json(json, "action_stats", "action stats");
+	buf_add_char(json, '}');
+}
+
+static void
+phase_map(struct bench *bench)
+{
+	phase_begin(bench);
+	for (int i = 0; i < bench->conf.nr_windows; i++) {
+		window_create(bench);
+	}
+	uint64_t deadline = time_now_nsec() + MAP_TIMEOUT_MSEC * NSEC_PER_MSEC;
+	while (bench->nr_mapped < bench->conf.nr_windows
+			&& time_now_nsec() < deadline) {
+		pump(bench, time_now_nsec() + NSEC_PER_MSEC);
+	}
+	/* Wait until the compositor has processed the first buffers */
+	wl_display_roundtrip(bench->display);
+	phase_end(bench, "map");
+}
+
+static void
+phase_steady(struct bench *bench)
+{
+	phase_begin(bench);
+	run_for(bench, bench->conf.steady_msec);
+	phase_end(bench, "steady");
+}
+
+static void
+phase_cycle(struct bench *bench)
+{
+	phase_begin(bench);
+	for (int i = 0; i < bench->conf.rounds; i++) {
+		run_action(bench, "action run NextWindow");
+		run_for(bench, ACTION_SETTLE_MSEC / 2);
+		run_action(bench, "action run NextWindow");
+		run_for(bench, ACTION_SETTLE_MSEC / 2);
+		run_action(bench, "action finish-cycle");
+		run_for(bench, ACTION_SETTLE_MSEC);
+	}
+	phase_end(bench, "cycle");
+}
+
+static void
+phase_workspaces(struct bench *bench)
+{
+	phase_begin(bench);
+	for (int i = 0; i < bench->conf.rounds; i++) {
+		run_action(bench, i % 2 ? "workspace prev" : "workspace next");
+		run_for(bench, ACTION_SETTLE_MSEC);
+	}
+	/* Return to the first workspace after an odd number of rounds */
+	if (bench->conf.rounds % 2) {
+		run_action(bench, "workspace prev");
+		run_for(bench, ACTION_SETTLE_MSEC);
+	}
+	phase_end(bench, "workspaces");
+}
+
+static void
+phase_tiling(struct bench *bench)
+{
+	phase_begin(bench);
+	for (int i = 0; i < bench->conf.rounds * 2; i++) {
+		run_action(bench, "tiling toggle");
+		run_for(bench, ACTION_SETTLE_MSEC);
+	}
+	phase_end(bench, "tiling");
+}
+
+static void
+phase_move(struct bench *bench)
+{
+	phase_begin(bench);
+	for (int i = 0; i < bench->conf.rounds * 20; i++) {
+		run_action(bench, (i / 10) % 2
+			? "action run MoveRelative x=-10 y=-5"
+			: "action run MoveRelative x=10 y=5");
+		run_for(bench, 16);
+	}
+	phase_end(bench, "move");
+}
+
+static void
+phase_unmap(struct bench *bench)
+{
+	phase_begin(bench);
+	struct window *window, *tmp;
+	wl_list_for_each_safe(window, tmp, &bench->windows, link) {
+		window_destroy(window);
+	}
+	wl_display_roundtrip(bench->display);
+	phase_end(bench, "unmap");
+}
+
+/* Setup */
+
+static void
+handle_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = handle_ping,
+};
+
+static void
+handle_global(void *data, struct wl_registry *registry, uint32_t name,
+		const char *interface, uint32_t version)
+{
+	struct bench *bench = data;
+	if (!strcmp(interface, wl_compositor_interface.name)) {
+		bench->compositor = wl_registry_bind(registry, name,
+			&wl_compositor_interface, 4);
+	} else if (!strcmp(interface, wl_shm_interface.name)) {
+		bench->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	} else if (!strcmp(interface, xdg_wm_base_interface.name)) {
+		bench->wm_base = wl_registry_bind(registry, name,
+			&xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(bench->wm_base, &wm_base_listener, bench);
+	}
+}
+
+static void
+handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+	/* nop */
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_global,
+	.global_remove = handle_global_remove,
+};
+
+static void
+add_outputs(struct bench *bench)
+{
+	for (int i = 0; i < bench->conf.nr_outputs; i++) {
+		char req[128];
+		snprintf(req, sizeof(req), "virtual-output add lab-bench-%d:%s",
+			i + 1, bench->conf.output_mode);
+		request(req, NULL);
+	}
+	/* Let the outputs get configured and announced */
+	run_for(bench, ACTION_SETTLE_MSEC);
+}
+
+static void
+add_conf_json(struct bench *bench)
+{
+	struct conf *conf = &bench->conf;
+	buf_add_fmt(&bench->json, "{\n  \"config\": {\"windows\": %d, "
+		"\"width\": %d, \"height\": %d, \"commit_rate\": %g, "
+		"\"title_rate\": %g, \"rounds\": %d, \"steady_ms\": %d, "
+		"\"outputs\": %d, \"output_mode\": ", conf->nr_windows,
+		conf->width, conf->height, conf->commit_rate, conf->title_rate,
+		conf->rounds, conf->steady_msec, conf->nr_outputs);
+	add_json_string(&bench->json, conf->output_mode,
+		strlen(conf->output_mode));
+	buf_add(&bench->json, "},\n  \"phases\": [");
+}
+
+static const struct option long_options[] = {
+	{"windows", required_argument, NULL, 'n'},
+	{"size", required_argument, NULL, 's'},
+	{"commit-rate", required_argument, NULL, 'c'},
+	{"title-rate", required_argument, NULL, 't'},
+	{"rounds", required_argument, NULL, 'r'},
+	{"steady", required_argument, NULL, 'd'},
+	{"outputs", required_argument, NULL, 'o'},
+	{"output-mode", required_argument, NULL, 'm'},
+	{"file", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{0, 0, 0, 0}
+};
+
+static const char usage[] =
+"Usage: lab-bench [options...]\n"
+"  -n, --windows <n>         Number of windows (default 20)\n"
+"  -s, --size <w>x<h>        Initial window size (default 800x600)\n"
+"  -c, --commit-rate <hz>    Frames per window and second, 0 to only\n"
+"                            commit on configure (default 60)\n"
+"  -t, --title-rate <hz>     Title changes per window and second (default 0)\n"
+"  -r, --rounds <n>          Repetitions of each action (default 10)\n"
+"  -d, --steady <ms>         Duration of the steady phase (default 2000)\n"
+"  -o, --outputs <n>         Number of virtual outputs (default 1)\n"
+"  -m, --output-mode <mode>  Virtual output mode (default 1920x1080@60)\n"
+"  -f, --file <path>         Write the JSON report to a file, not stdout\n"
+"  -h, --help                Show help message and quit\n";
+
+int
+main(int argc, char **argv)
+{
+	struct bench bench = {
+		.conf = {
+			.nr_windows = 20,
+			.width = 800,
+			.height = 600,
+			.commit_rate = 60,
+			.rounds = 10,
+			.steady_msec = 2000,
+			.nr_outputs = 1,
+			.output_mode = "1920x1080@60",
+		},
+		.json = BUF_INIT,
+	};
+	struct conf *conf = &bench.conf;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:s:c:t:r:d:o:m:f:h",
+			long_options, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			conf->nr_windows = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &conf->width,
+					&conf->height) != 2) {
+				fprintf(stderr, "lab-bench: invalid size '%s'\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'c':
+			conf->commit_rate = atof(optarg);
+			break;
+		case 't':
+			conf->title_rate = atof(optarg);
+			break;
+		case 'r':
+			conf->rounds = atoi(optarg);
+			break;
+		case 'd':
+			conf->steady_msec = atoi(optarg);
+			break;
+		case 'o':
+			conf->nr_outputs = atoi(optarg);
+			break;
+		case 'm':
+			conf->output_mode = optarg;
+			break;
+		case 'f':
+			conf->output_file = optarg;
+			break;
+		case 'h':
+			printf("%s", usage);
+			exit(EXIT_SUCCESS);
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (conf->nr_windows < 1 || conf->width < 1 || conf->height < 1
+			|| conf->rounds < 0 || conf->steady_msec < 0) {
+		fprintf(stderr, "%s", usage);
+		exit(EXIT_FAILURE);
+	}
+
+	const char *pid = getenv("LABWC_PID");
+	bench.compositor_pid = pid ? atoi(pid) : 0;
+	if (!bench.compositor_pid || !getenv("LABWC_SOCK")) {
+		fprintf(stderr, "lab-bench: must be started by labwc\n");
+		exit(EXIT_FAILURE);
+	}
+
+	bench.display = wl_display_connect(NULL);
+	if (!bench.display) {
+		fprintf(stderr, "lab-bench: cannot connect to compositor\n");
+		exit(EXIT_FAILURE);
+	}
+	wl_list_init(&bench.windows);
+	wl_array_init(&bench.frame_times);
+	wl_array_init(&bench.configure_latencies);
+	struct wl_registry *registry = wl_display_get_registry(bench.display);
+	wl_registry_add_listener(registry, &registry_listener, &bench);
+	wl_display_roundtrip(bench.display);
+	if (!bench.compositor || !bench.shm || !bench.wm_base) {
+		fprintf(stderr, "lab-bench: missing required globals\n");
+		exit(EXIT_FAILURE);
+	}
+
+	request("action profile on", NULL);
+	add_outputs(&bench);
+
+	add_conf_json(&bench);
+	phase_map(&bench);
+	phase_steady(&bench);
+	phase_cycle(&bench);
+	phase_workspaces(&bench);
+	phase_tiling(&bench);
+	phase_move(&bench);
+	phase_unmap(&bench);
+	buf_add(&bench.json, "\n  ]\n}\n");
+
+	FILE *out = conf->output_file ? fopen(conf->output_file, "w") : stdout;
+	if (!out) {
+		perror("lab-bench: cannot open report file");
+		exit(EXIT_FAILURE);
+	}
+	fputs(bench.json.data, out);
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	buf_reset(&bench.json);
+	wl_array_release(&bench.frame_times);
+	wl_array_release(&bench.configure_latencies);
+	xdg_wm_base_destroy(bench.wm_base);
+	wl_shm_destroy(bench.shm);
+	wl_compositor_destroy(bench.compositor);
+	wl_registry_destroy(registry);
+	wl_display_disconnect(bench.display);
+	return 0;
+}
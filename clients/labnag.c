@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef __FreeBSD__
 #include <sys/event.h> /* For signalfd() */
 #endif
@@ -106,6 +107,11 @@ struct button {
 	bool expand;
 	bool dismiss;
 	struct wl_list link;
+
+	/* Cached, see get_button_layout() */
+	PangoLayout *layout;
+	int text_width;
+	int text_height;
 };
 
 enum {
@@ -137,6 +143,11 @@ struct nag {
 	struct pool_buffer buffers[2];
 	struct pool_buffer *current_buffer;
 
+	/* Text layouts are kept until the scale changes */
+	int32_t layout_scale;
+	PangoLayout *message_layout;
+	int message_height;
+
 	struct conf *conf;
 	char *message;
 	struct wl_list buttons;
@@ -226,27 +237,51 @@ get_text_size(cairo_t *cairo, const PangoFontDescription *desc, int *width, int
 }
 
 static void
-render_text(cairo_t *cairo, const PangoFontDescription *desc, double scale,
-		bool markup, const char *fmt, ...)
+show_layout(cairo_t *cairo, PangoLayout *layout)
 {
-	va_list args;
-	va_start(args, fmt);
-	gchar *buf = g_strdup_vprintf(fmt, args);
-	va_end(args);
-	if (!buf) {
-		return;
-	}
-
-	PangoLayout *layout = get_pango_layout(cairo, desc, buf, scale, markup);
 	cairo_font_options_t *fo = cairo_font_options_create();
 	cairo_get_font_options(cairo, fo);
 	pango_cairo_context_set_font_options(pango_layout_get_context(layout), fo);
 	cairo_font_options_destroy(fo);
 	pango_cairo_update_layout(cairo, layout);
 	pango_cairo_show_layout(cairo, layout);
-	g_object_unref(layout);
+}
 
-	g_free(buf);
+static PangoLayout *
+get_button_layout(cairo_t *cairo, struct nag *nag, struct button *button)
+{
+	if (!button->layout) {
+		button->layout = get_pango_layout(cairo,
+			nag->conf->font_description, button->text, 1, true);
+		pango_cairo_update_layout(cairo, button->layout);
+		pango_layout_get_pixel_size(button->layout,
+			&button->text_width, &button->text_height);
+	}
+	return button->layout;
+}
+
+static void
+clear_button_layout(struct button *button)
+{
+	if (button->layout) {
+		g_object_unref(button->layout);
+		button->layout = NULL;
+	}
+}
+
+static void
+clear_layouts(struct nag *nag)
+{
+	struct button *button;
+	wl_list_for_each(button, &nag->buttons, link) {
+		clear_button_layout(button);
+	}
+	clear_button_layout(&nag->details.button_up);
+	clear_button_layout(&nag->details.button_down);
+	if (nag->message_layout) {
+		g_object_unref(nag->message_layout);
+		nag->message_layout = NULL;
+	}
 }
 
 static void
@@ -262,9 +297,14 @@ cairo_set_source_u32(cairo_t *cairo, uint32_t color)
 static uint32_t
 render_message(cairo_t *cairo, struct nag *nag)
 {
-	int text_width, text_height;
-	get_text_size(cairo, nag->conf->font_description, &text_width,
-		&text_height, NULL, 1, true, "%s", nag->message);
+	if (!nag->message_layout) {
+		int text_width;
+		get_text_size(cairo, nag->conf->font_description, &text_width,
+			&nag->message_height, NULL, 1, true, "%s", nag->message);
+		nag->message_layout = get_pango_layout(cairo,
+			nag->conf->font_description, nag->message, 1, false);
+	}
+	int text_height = nag->message_height;
 
 	int padding = nag->conf->message_padding;
 
@@ -276,8 +316,7 @@ render_message(cairo_t *cairo, struct nag *nag)
 
 	cairo_set_source_u32(cairo, nag->conf->text);
 	cairo_move_to(cairo, padding, (int)(ideal_height - text_height) / 2);
-	render_text(cairo, nag->conf->font_description, 1, false,
-			"%s", nag->message);
+	show_layout(cairo, nag->message_layout);
 
 	return ideal_surface_height;
 }
@@ -286,9 +325,8 @@ static void
 render_details_scroll_button(cairo_t *cairo, struct nag *nag,
 		struct button *button)
 {
-	int text_width, text_height;
-	get_text_size(cairo, nag->conf->font_description, &text_width,
-		&text_height, NULL, 1, true, "%s", button->text);
+	PangoLayout *layout = get_button_layout(cairo, nag, button);
+	int text_height = button->text_height;
 
 	int border = nag->conf->button_border_thickness;
 	int padding = nag->conf->button_padding;
@@ -307,18 +345,16 @@ render_details_scroll_button(cairo_t *cairo, struct nag *nag,
 	cairo_set_source_u32(cairo, nag->conf->button_text);
 	cairo_move_to(cairo, button->x + border + padding,
 			button->y + border + (button->height - text_height) / 2);
-	render_text(cairo, nag->conf->font_description, 1, true,
-			"%s", button->text);
+	show_layout(cairo, layout);
 }
 
 static int
 get_detailed_scroll_button_width(cairo_t *cairo, struct nag *nag)
 {
-	int up_width, down_width, temp_height;
-	get_text_size(cairo, nag->conf->font_description, &up_width, &temp_height,
-		NULL, 1, true, "%s", nag->details.button_up.text);
-	get_text_size(cairo, nag->conf->font_description, &down_width, &temp_height,
-		NULL, 1, true, "%s", nag->details.button_down.text);
+	get_button_layout(cairo, nag, &nag->details.button_up);
+	get_button_layout(cairo, nag, &nag->details.button_down);
+	int up_width = nag->details.button_up.text_width;
+	int down_width = nag->details.button_down.text_width;
 
 	int text_width =  up_width > down_width ? up_width : down_width;
 	int border = nag->conf->button_border_thickness;
@@ -419,28 +455,14 @@ render_detailed(cairo_t *cairo, struct nag *nag, uint32_t y)
 	return ideal_height;
 }
 
-static uint32_t
-render_button(cairo_t *cairo, struct nag *nag, struct button *button,
-		bool selected, int *x)
+/* Draw @button at the position found by render_button() */
+static void
+draw_button(cairo_t *cairo, struct nag *nag, struct button *button,
+		bool selected)
 {
-	int text_width, text_height;
-	get_text_size(cairo, nag->conf->font_description, &text_width,
-		&text_height, NULL, 1, true, "%s", button->text);
-
 	int border = nag->conf->button_border_thickness;
 	int padding = nag->conf->button_padding;
 
-	uint32_t ideal_height = text_height + padding * 2 + border * 2;
-	uint32_t ideal_surface_height = ideal_height;
-	if (nag->height < ideal_surface_height) {
-		return ideal_surface_height;
-	}
-
-	button->x = *x - border - text_width - padding * 2 + 1;
-	button->y = (int)(ideal_height - text_height) / 2 - padding + 1;
-	button->width = text_width + padding * 2;
-	button->height = text_height + padding * 2;
-
 	cairo_set_source_u32(cairo, nag->conf->button_border);
 	cairo_rectangle(cairo, button->x - border, button->y - border,
 			button->width + border * 2, button->height + border * 2);
@@ -461,8 +483,32 @@ render_button(cairo_t *cairo, struct nag *nag, struct button *button,
 
 	cairo_set_source_u32(cairo, nag->conf->button_text);
 	cairo_move_to(cairo, button->x + padding, button->y + padding);
-	render_text(cairo, nag->conf->font_description, 1, true,
-			"%s", button->text);
+	show_layout(cairo, get_button_layout(cairo, nag, button));
+}
+
+static uint32_t
+render_button(cairo_t *cairo, struct nag *nag, struct button *button,
+		bool selected, int *x)
+{
+	get_button_layout(cairo, nag, button);
+	int text_width = button->text_width;
+	int text_height = button->text_height;
+
+	int border = nag->conf->button_border_thickness;
+	int padding = nag->conf->button_padding;
+
+	uint32_t ideal_height = text_height + padding * 2 + border * 2;
+	uint32_t ideal_surface_height = ideal_height;
+	if (nag->height < ideal_surface_height) {
+		return ideal_surface_height;
+	}
+
+	button->x = *x - border - text_width - padding * 2 + 1;
+	button->y = (int)(ideal_height - text_height) / 2 - padding + 1;
+	button->width = text_width + padding * 2;
+	button->height = text_height + padding * 2;
+
+	draw_button(cairo, nag, button, selected);
 
 	*x = button->x - border;
 
@@ -518,6 +564,10 @@ render_frame(struct nag *nag)
 	if (!nag->run_display) {
 		return;
 	}
+	if (nag->layout_scale != nag->scale) {
+		clear_layouts(nag);
+		nag->layout_scale = nag->scale;
+	}
 
 	cairo_surface_t *recorder = cairo_recording_surface_create(
 			CAIRO_CONTENT_COLOR_ALPHA, NULL);
@@ -568,6 +618,75 @@ cleanup:
 	cairo_destroy(cairo);
 }
 
+static struct button *
+get_button(struct nag *nag, int index)
+{
+	int idx = 0;
+	struct button *button;
+	wl_list_for_each(button, &nag->buttons, link) {
+		if (idx++ == index) {
+			return button;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Redraw only the buttons whose selection state changed from
+ * @old_selected to nag->selected_button, on top of a copy of the last
+ * frame, and fall back to render_frame() if there is none
+ */
+static void
+render_selection_change(struct nag *nag, int old_selected)
+{
+	struct pool_buffer *last = nag->current_buffer;
+	uint32_t width = nag->width * nag->scale;
+	uint32_t height = nag->height * nag->scale;
+	if (!nag->run_display || !last || last->width != width
+			|| last->height != height || nag->layout_scale != nag->scale) {
+		render_frame(nag);
+		return;
+	}
+
+	struct pool_buffer *buffer =
+		get_next_buffer(nag->shm, nag->buffers, width, height);
+	if (!buffer) {
+		wlr_log(WLR_DEBUG, "Failed to get buffer. Skipping frame.");
+		return;
+	}
+	if (buffer != last) {
+		cairo_surface_flush(buffer->surface);
+		memcpy(buffer->data, last->data, buffer->size);
+		cairo_surface_mark_dirty(buffer->surface);
+	}
+	nag->current_buffer = buffer;
+
+	cairo_t *cairo = buffer->cairo;
+	cairo_save(cairo);
+	cairo_scale(cairo, nag->scale, nag->scale);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	wl_surface_set_buffer_scale(nag->surface, nag->scale);
+	wl_surface_attach(nag->surface, buffer->buffer, 0, 0);
+
+	int border = nag->conf->button_border_thickness;
+	int indices[] = { old_selected, nag->selected_button };
+	for (size_t i = 0; i < sizeof(indices) / sizeof(indices[0]); i++) {
+		struct button *button = get_button(nag, indices[i]);
+		if (!button) {
+			continue;
+		}
+		draw_button(cairo, nag, button, indices[i] == nag->selected_button);
+		wl_surface_damage(nag->surface, button->x - border,
+			button->y - border, button->width + border * 2,
+			button->height + border * 2);
+	}
+	cairo_restore(cairo);
+	cairo_surface_flush(buffer->surface);
+
+	wl_surface_commit(nag->surface);
+	wl_display_roundtrip(nag->display);
+}
+
 static void
 seat_destroy(struct seat *seat)
 {
@@ -596,6 +715,7 @@ nag_destroy(struct nag *nag)
 {
 	nag->run_display = false;
 
+	clear_layouts(nag);
 	struct button *button, *next;
 	wl_list_for_each_safe(button, next, &nag->buttons, link) {
 		wl_list_remove(&button->link);
@@ -1067,9 +1187,10 @@ wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
 		} else {
 			direction = -1;
 		}
+		int old_selected = nag->selected_button;
 		nag->selected_button += nr_buttons + direction;
 		nag->selected_button %= nr_buttons;
-		render_frame(nag);
+		render_selection_change(nag, old_selected);
 		close_pollfd(&nag->pollfds[FD_TIMER]);
 		break;
 	}
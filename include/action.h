@@ -3,12 +3,14 @@
 #define LABWC_ACTION_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <wayland-util.h>
 
 struct view;
 struct server;
 struct cursor_context;
+struct action_arg;
 
 struct action {
 	struct wl_list link; /*
@@ -19,12 +21,20 @@ struct action {
 
 	uint32_t type;        /* enum action_type */
 	struct wl_list args;  /* struct action_arg.link */
+	/* args indexed by their key, allocated when the first is added */
+	struct action_arg **arg_slots;
+
+	/*
+	 * For Execute, the split command. It depends on the environment
+	 * if the command contains ~, in which case argv_serial is the
+	 * session_environment_serial() it was built for, and 0 otherwise.
+	 */
+	char **argv;
+	uint64_t argv_serial;
 };
 
 struct action *action_create(const char *action_name);
 
-const char *action_get_str(struct action *action, const char *key,
-	const char *default_value);
 bool action_is_valid(struct action *action);
 bool action_is_show_menu(struct action *action);
 
@@ -50,6 +60,17 @@ bool actions_contain_toggle_keybinds(struct wl_list *action_list);
 void actions_run(struct view *activator, struct server *server,
 	struct wl_list *actions, struct cursor_context *ctx);
 
+/*
+ * Optional profiling of actions_run(): per action type counts and
+ * cumulative/maximum run time, plus time spent matching queries and
+ * spawning processes. Disabled by default, in which case it costs one
+ * branch per action.
+ */
+void action_stats_enable(bool enable);
+bool action_stats_enabled(void);
+void action_stats_reset(void);
+void action_stats_print(FILE *stream);
+
 void action_prompts_destroy(void);
 bool action_check_prompt_result(pid_t pid, int exit_code);
 
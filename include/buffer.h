@@ -27,8 +27,23 @@
 #define LABWC_BUFFER_H
 
 #include <cairo.h>
+#include <stdio.h>
+#include <sys/types.h>
 #include <wlr/types/wlr_buffer.h>
 
+/* What a buffer is used for, to attribute the memory of all buffers */
+enum buffer_category {
+	BUFFER_OTHER = 0,
+	BUFFER_TITLE,
+	BUFFER_MENU,
+	BUFFER_ICON,
+	BUFFER_BUTTON,
+	BUFFER_SHADOW,
+	BUFFER_OSD,
+	BUFFER_THUMBNAIL,
+	BUFFER_NR_CATEGORIES,
+};
+
 struct lab_data_buffer {
 	struct wlr_buffer base;
 
@@ -43,6 +58,17 @@ struct lab_data_buffer {
 	 */
 	uint32_t logical_width;
 	uint32_t logical_height;
+	/*
+	 * Set by the creator if every pixel is fully opaque, so the scene
+	 * can skip blending and whatever is underneath, see
+	 * lab_wlr_scene_buffer_update_opaque_region()
+	 */
+	bool opaque;
+	/* Lazily created copy at half the size, see buffer_resize() */
+	struct lab_data_buffer *half;
+	/* Private, see buffer_set_category() */
+	enum buffer_category category;
+	size_t bytes;
 };
 
 /*
@@ -77,9 +103,44 @@ struct lab_data_buffer *buffer_create_from_data(void *pixel_data, uint32_t width
 struct lab_data_buffer *buffer_create_from_wlr_buffer(
 	struct wlr_buffer *wlr_buffer);
 
+/*
+ * Attribute the memory of @buffer (and its half-size copies) to @category.
+ * Buffers start out as BUFFER_OTHER and only the first category set
+ * sticks, so a buffer shared by several users keeps that of its creator.
+ */
+void buffer_set_category(struct lab_data_buffer *buffer,
+	enum buffer_category category);
+
+/*
+ * Account a buffer of @bytes allocated for @category outside of
+ * lab_data_buffers, such as rendered thumbnails, or its release with
+ * -@bytes.
+ */
+void buffer_account(enum buffer_category category, ssize_t bytes);
+
+/* Print the live and peak bytes of each category */
+void buffer_stats_print(FILE *stream);
+
+/* Get the live bytes of each category */
+void buffer_stats_get_bytes(size_t bytes[BUFFER_NR_CATEGORIES]);
+const char *buffer_category_name(enum buffer_category category);
+
+/* Register the live bytes and buffers of each category, see metrics.h */
+void buffer_add_metrics(void);
+
+/* Restart the peaks from the current values */
+void buffer_stats_reset_peaks(void);
+
+/* Return the lab_data_buffer behind @buffer, or NULL if it is another type */
+struct lab_data_buffer *buffer_try_from_wlr_buffer(struct wlr_buffer *buffer);
+
 /*
  * Resize a buffer to the given size. The source buffer is rendered at the
  * center of the output buffer and shrunk if it overflows from the output buffer.
+ *
+ * Large reductions start from a box-filtered mipmap level of the source
+ * within a factor of two of the output size, as cairo's filters alias
+ * badly beyond that. The levels are kept along with the source buffer.
  */
 struct lab_data_buffer *buffer_resize(struct lab_data_buffer *src_buffer,
 	int width, int height, double scale);
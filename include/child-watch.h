@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_CHILD_WATCH_H
+#define LABWC_CHILD_WATCH_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct wl_event_loop;
+
+/*
+ * Exit notification for spawned children
+ *
+ * Where the kernel supports pidfds, every child started through
+ * common/spawn.c gets one registered on the event loop, so that its exit
+ * is handled as soon as it happens, independently of other children and
+ * of SIGCHLD coalescing. Children without a pidfd are still reaped by the
+ * SIGCHLD handler of the server.
+ *
+ * Exits are passed to @child_exited with the si_code and si_status of the
+ * waitid() result.
+ */
+void child_watch_init(struct wl_event_loop *loop,
+	void (*child_exited)(pid_t pid, int code, int status, void *data),
+	void *data);
+void child_watch_finish(void);
+
+/* Watch @pid; does nothing without pidfd support */
+void child_watch_add(pid_t pid);
+
+/*
+ * Reap @pid if it is watched, for when SIGCHLD arrives before the pidfd
+ * is dispatched. Returns false if @pid is not watched.
+ */
+bool child_watch_reap(pid_t pid);
+
+#endif /* LABWC_CHILD_WATCH_H */
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_ARENA_H
+#define LABWC_ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk;
+
+/*
+ * Bump allocator for objects which are all freed at the same time, such
+ * as those created when reading a configuration. Objects are laid out
+ * back to back in large chunks, and there is no way to free one of them.
+ *
+ * A zero-initialized struct arena is empty and ready to use.
+ */
+struct arena {
+	struct arena_chunk *chunks;
+};
+
+/*
+ * Allocates zero-filled memory suitably aligned for any object; calls
+ * exit() on error. Returns NULL only if (size == 0).
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/* Like znew() and znew_n() from mem.h, but allocated from @arena */
+#define arena_new(arena, expr) \
+	((__typeof__(expr) *)arena_alloc((arena), sizeof(expr)))
+#define arena_new_n(arena, expr, n) \
+	((__typeof__(expr) *)arena_alloc((arena), (n) * sizeof(expr)))
+
+/* Allocates a copy of <str>, which must not be NULL */
+char *arena_strdup(struct arena *arena, const char *str);
+
+/* Free all objects allocated from @arena, which is then empty again */
+void arena_finish(struct arena *arena);
+
+#endif /* LABWC_ARENA_H */
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_BITSET_H
+#define LABWC_BITSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Set of small integers such as evdev keycodes, which are all below
+ * KEY_CNT (0x300). Larger values are ignored.
+ */
+#define LAB_BITSET_MAX_VALUE 1023
+#define LAB_BITSET_WORDS ((LAB_BITSET_MAX_VALUE + 64) / 64)
+
+struct lab_bitset {
+	uint64_t words[LAB_BITSET_WORDS];
+};
+
+bool lab_bitset_contains(const struct lab_bitset *set, uint32_t value);
+void lab_bitset_add(struct lab_bitset *set, uint32_t value);
+void lab_bitset_remove(struct lab_bitset *set, uint32_t value);
+
+/* Number of values in @set */
+int lab_bitset_count(const struct lab_bitset *set);
+
+/* @dst = @a without the values in @b; @dst may be @a */
+void lab_bitset_subtract(struct lab_bitset *dst, const struct lab_bitset *a,
+	const struct lab_bitset *b);
+
+/*
+ * Store the values in @set in increasing order into @values, which has
+ * room for @max of them. Returns the number stored.
+ */
+int lab_bitset_to_array(const struct lab_bitset *set, uint32_t *values,
+	int max);
+
+#endif /* LABWC_BITSET_H */
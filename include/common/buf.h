@@ -8,6 +8,8 @@
 #ifndef LABWC_BUF_H
 #define LABWC_BUF_H
 
+#include <stddef.h>
+
 struct buf {
 	/**
 	 * Pointer to underlying string buffer. If alloc != 0, then
@@ -16,15 +18,16 @@ struct buf {
 	char *data;
 	/**
 	 * Allocated length of buf. If zero, data was not allocated
-	 * (either NULL or literal empty string).
+	 * (either NULL or literal empty string). Grows at least by a factor
+	 * of two, so that appending is amortized linear.
 	 */
-	int alloc;
+	size_t alloc;
 	/**
 	 * Length of string contents (not including terminating NUL).
 	 * Currently this must be zero if alloc is zero (i.e. non-empty
 	 * literal strings are not allowed).
 	 */
-	int len;
+	size_t len;
 };
 
 /** Value used to initialize a struct buf to an empty string */
@@ -68,6 +71,14 @@ void buf_add_hex_color(struct buf *s, float color[4]);
  */
 void buf_add(struct buf *s, const char *data);
 
+/**
+ * buf_add_n - add data of known length to C string buffer
+ * @s: buffer
+ * @data: data to be added, need not be NUL-terminated
+ * @len: number of bytes to add
+ */
+void buf_add_n(struct buf *s, const char *data, size_t len);
+
 /**
  * buf_add_char - add single char to C string buffer
  * @s: buffer
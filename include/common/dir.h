@@ -2,6 +2,9 @@
 #ifndef LABWC_DIR_H
 #define LABWC_DIR_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
 struct path {
@@ -15,6 +18,25 @@ struct wl_list *paths_get_next(struct wl_list *elm);
 void paths_config_create(struct wl_list *paths, const char *filename);
 void paths_theme_create(struct wl_list *paths, const char *theme_name,
 	const char *filename);
+
+/* List <data-dir>/@filename for $XDG_DATA_HOME and $XDG_DATA_DIRS */
+void paths_data_create(struct wl_list *paths, const char *filename);
 void paths_destroy(struct wl_list *paths);
 
+/*
+ * paths_hash() - hash the size and modification time of the files in
+ * @paths, and with @with_dirs also of their directories, so that a changed
+ * hash means that the files or their siblings (e.g. theme button images)
+ * may have changed
+ */
+uint64_t paths_hash(struct wl_list *paths, bool with_dirs);
+
+/**
+ * cache_dir_get() - get $XDG_CACHE_HOME/labwc[/@subdir]
+ * Falls back to ~/.cache if $XDG_CACHE_HOME is not set. The directories are
+ * created if @create is set. Returns false if they could not be created or
+ * if the path does not fit into @len.
+ */
+bool cache_dir_get(char *path, size_t len, const char *subdir, bool create);
+
 #endif /* LABWC_DIR_H */
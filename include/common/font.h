@@ -48,9 +48,22 @@ void font_buffer_create(struct lab_data_buffer **buffer, int max_width,
 	int height, const char *text, struct font *font, const float *color,
 	cairo_pattern_t *bg_pattern, double scale);
 
+/**
+ * font_buffer_draw - font_buffer_create() with the size already computed
+ * @width: buffer width, as returned by font_get_buffer_size()
+ * @height: buffer height
+ * @text_height: text height, as returned by font_get_buffer_size()
+ *
+ * Unlike the other font functions, this does not use the cached font
+ * metrics and may be called from other threads.
+ */
+void font_buffer_draw(struct lab_data_buffer **buffer, int width, int height,
+	int text_height, const char *text, struct font *font,
+	const float *color, cairo_pattern_t *bg_pattern, double scale);
+
 /**
  * font_finish - free some font related resources
- * Note: use on exit
+ * This includes the cached font metrics. Use on exit and reconfigure.
  */
 void font_finish(void);
 
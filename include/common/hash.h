@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_HASH_H
+#define LABWC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_INIT 0xcbf29ce484222325ull
+
+/**
+ * hash_add() - mix @size bytes at @data into @hash (FNV-1a)
+ * Start with HASH_INIT. The result is not suitable for cryptography.
+ */
+static inline uint64_t
+hash_add(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/* Mix string @str, which may be NULL, into @hash */
+static inline uint64_t
+hash_add_str(uint64_t hash, const char *str)
+{
+	/* Include the terminating NUL so that "ab" + "c" != "a" + "bc" */
+	return str ? hash_add(hash, str, strlen(str) + 1) : hash;
+}
+
+#endif /* LABWC_HASH_H */
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_INTERN_H
+#define LABWC_INTERN_H
+
+#include <stdbool.h>
+
+/*
+ * Interned strings
+ *
+ * Equal strings share a single reference-counted copy, so identifiers
+ * common to many views (like the app_id of a dozen terminals) are stored
+ * once and compared by pointer. Each interned string also refers to its
+ * interned ASCII lower-case version, which makes case-insensitive
+ * equality (as with strcasecmp() on ASCII) a pointer comparison too.
+ */
+
+/**
+ * lab_intern() - get the interned copy of @str and take a reference
+ * Returns NULL if @str is NULL.
+ */
+const char *lab_intern(const char *str);
+
+/* Drop a reference to interned @str, which may be NULL */
+void lab_intern_unref(const char *str);
+
+/**
+ * lab_intern_folded() - get the interned lower-case version of interned
+ * @str, without taking a reference. Returns NULL if @str is NULL.
+ */
+const char *lab_intern_folded(const char *str);
+
+/* Case-insensitive equality of interned strings */
+static inline bool
+lab_intern_equal_nocase(const char *a, const char *b)
+{
+	return lab_intern_folded(a) == lab_intern_folded(b);
+}
+
+#endif /* LABWC_INTERN_H */
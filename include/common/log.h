@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_LOG_H
+#define LABWC_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wlr/util/log.h>
+
+struct buf;
+
+/*
+ * Debug categories
+ *
+ * Diagnostics which would be too chatty at the info level, for example
+ * several lines per key press, are logged with lab_log() under the
+ * category of their subsystem. Categories are switched at runtime with
+ * LABWC_DEBUG or the "debug categories" IPC request. While a category is
+ * off, lab_log() only tests a bit in a global and doesn't even evaluate
+ * its arguments.
+ */
+enum lab_log_category {
+	LAB_LOG_KEYBOARD = 1 << 0,
+	LAB_LOG_CURSOR = 1 << 1,
+	LAB_LOG_TILING = 1 << 2,
+	LAB_LOG_IPC = 1 << 3,
+	LAB_LOG_MENU = 1 << 4,
+
+	LAB_LOG_ALL = (1 << 5) - 1,
+};
+
+extern uint32_t lab_log_categories;
+
+#define lab_log(category, fmt, ...) \
+	do { \
+		if (lab_log_categories & (category)) { \
+			wlr_log(WLR_INFO, fmt, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+/**
+ * lab_log_parse_categories() - parse a list of debug categories
+ * @list: category names separated by commas or spaces, "all" or "none"
+ * @categories: set to the bitmask of the categories on success
+ *
+ * Return: false if @list contains an unknown name
+ */
+bool lab_log_parse_categories(const char *list, uint32_t *categories);
+
+/* Append the names of @categories to @buf, comma separated, or "none" */
+void lab_log_print_categories(struct buf *buf, uint32_t categories);
+
+#endif /* LABWC_LOG_H */
@@ -3,6 +3,7 @@
 #define LABWC_MATCH_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * match_glob() - Pattern match using shell wildcard rules (see glob(7))
@@ -12,4 +13,51 @@
  */
 bool match_glob(const char *pattern, const char *string);
 
+enum match_kind {
+	MATCH_ANY = 0,  /* "*" */
+	MATCH_EXACT,    /* "foo" */
+	MATCH_PREFIX,   /* "foo*" */
+	MATCH_SUFFIX,   /* "*foo" */
+	MATCH_CONTAINS, /* "*foo*" */
+	MATCH_GLOB,     /* anything else, passed to fnmatch() */
+};
+
+/*
+ * A glob pattern classified when it is set, so that the common cases of
+ * literals and simple prefix/suffix globs can be matched without
+ * fnmatch(). Zero-initialized, it has no pattern and matches everything.
+ */
+struct match_pattern {
+	char *pattern;
+	enum match_kind kind;
+	/*
+	 * The literal part of the pattern in lower case, without any '*'.
+	 * Interned, see common/intern.h.
+	 */
+	const char *literal;
+	size_t len;
+};
+
+/**
+ * match_pattern_set() - Replace the pattern of @match by a copy of @pattern
+ * @pattern: glob pattern, or NULL to match everything.
+ */
+void match_pattern_set(struct match_pattern *match, const char *pattern);
+
+void match_pattern_finish(struct match_pattern *match);
+
+/**
+ * match_pattern_matches() - Match @string like match_glob() would
+ * Note: a NULL @string only matches if @match has no pattern.
+ */
+bool match_pattern_matches(const struct match_pattern *match, const char *string);
+
+/**
+ * match_pattern_matches_interned() - Like match_pattern_matches(), but
+ * compares literal patterns by pointer
+ * @string: interned string, see common/intern.h
+ */
+bool match_pattern_matches_interned(const struct match_pattern *match,
+	const char *string);
+
 #endif /* LABWC_MATCH_H */
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_OVERLAP_GRID_H
+#define LABWC_OVERLAP_GRID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wlr/util/box.h>
+
+/*
+ * An irregular grid that divides a usable area by extending the edges of a
+ * set of boxes to infinity, used to place windows with minimal overlap.
+ *
+ * Every interval of the grid is either completely covered by a box or not
+ * at all, so the number of boxes covering a point is constant within an
+ * interval. The grid stores a summed-area table of those counts weighted
+ * by area, from which the overlap of any rectangle within the usable area
+ * can be computed in constant time (plus two binary searches).
+ */
+struct overlap_grid {
+	int nr_rows;
+	int nr_cols;
+	int *rows;
+	int *cols;
+	/* Number of boxes covering each of the (nr_rows - 1) x (nr_cols - 1) intervals */
+	int *counts;
+	/*
+	 * sat[i * nr_cols + j] is the overlap of the rectangle from
+	 * (cols[0], rows[0]) to (cols[j], rows[i])
+	 */
+	int64_t *sat;
+};
+
+/*
+ * Build a grid over @usable for @nr_boxes boxes. The grid stays empty
+ * if there are no boxes.
+ */
+void overlap_grid_build(struct overlap_grid *grid, struct wlr_box usable,
+	const struct wlr_box *boxes, int nr_boxes);
+
+void overlap_grid_finish(struct overlap_grid *grid);
+
+/*
+ * Return the overlap of @box with the boxes the grid was built from, that
+ * is the sum of the areas of the intersections with each box. Returns
+ * INT64_MAX if @box extends beyond the usable area.
+ */
+int64_t overlap_grid_get_overlap(const struct overlap_grid *grid,
+	const struct wlr_box *box);
+
+/*
+ * Find the position of a @width x @height rectangle with the least overlap
+ * and store its top-left corner in @x and @y. Returns false, leaving @x and
+ * @y unchanged, if the grid is empty (so any position is free of overlap)
+ * or if the rectangle does not fit into the usable area.
+ */
+bool overlap_grid_find_best(const struct overlap_grid *grid, int width,
+	int height, int *x, int *y);
+
+#endif /* LABWC_OVERLAP_GRID_H */
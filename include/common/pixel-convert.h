@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_PIXEL_CONVERT_H
+#define LABWC_PIXEL_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Conversions of 32-bit pixels in native byte order, as used for icons
+ * provided by clients. SSE2 and NEON are used where the compiler targets
+ * them, with a scalar fallback otherwise. @dst and @src may be the same
+ * buffer, but must not overlap otherwise.
+ */
+
+/*
+ * Convert straight alpha ARGB to premultiplied ARGB as used by cairo,
+ * rounding each color channel down.
+ */
+void pixel_premultiply(uint32_t *dst, const uint32_t *src, size_t count);
+
+/* Swap the red and blue channels, converting between ABGR and ARGB */
+void pixel_swap_red_blue(uint32_t *dst, const uint32_t *src, size_t count);
+
+/* Set the alpha channel to opaque, converting XRGB to ARGB */
+void pixel_set_opaque(uint32_t *dst, const uint32_t *src, size_t count);
+
+/*
+ * Shrink premultiplied pixels to half the size in both directions, each
+ * destination pixel being the average of a 2x2 block. The destination is
+ * MAX(src_width / 2, 1) x MAX(src_height / 2, 1) pixels; a last odd row
+ * or column is dropped. Strides are in bytes. Unlike the conversions
+ * above, this does not use SIMD intrinsics.
+ */
+void pixel_downscale_half(uint32_t *dst, size_t dst_stride,
+	const uint32_t *src, size_t src_stride, int src_width, int src_height);
+
+#endif /* LABWC_PIXEL_CONVERT_H */
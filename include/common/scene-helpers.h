@@ -4,6 +4,7 @@
 
 #include <stdbool.h>
 
+struct wlr_scene_buffer;
 struct wlr_scene_node;
 struct wlr_surface;
 struct wlr_scene_output;
@@ -18,6 +19,15 @@ struct wlr_surface *lab_wlr_surface_from_node(struct wlr_scene_node *node);
  */
 struct wlr_scene_node *lab_wlr_scene_get_prev_node(struct wlr_scene_node *node);
 
+/*
+ * Set the opaque region of @scene_buffer to cover it entirely if it shows
+ * a lab_data_buffer marked opaque, or clear it otherwise. The buffers are
+ * ARGB, so wlroots can't tell on its own. Call again whenever the buffer
+ * or the destination size changes.
+ */
+void lab_wlr_scene_buffer_update_opaque_region(
+	struct wlr_scene_buffer *scene_buffer);
+
 /* A variant of wlr_scene_output_commit() that respects wlr_output->pending */
 bool lab_wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 	struct wlr_output_state *state);
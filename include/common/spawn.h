@@ -16,6 +16,38 @@ pid_t spawn_primary_client(const char *command);
  */
 void spawn_async_no_shell(char const *command);
 
+/**
+ * spawn_parse_argv - split @command into arguments like a shell would,
+ * without expanding anything
+ *
+ * Returns NULL if @command cannot be parsed. Free with g_strfreev().
+ */
+char **spawn_parse_argv(const char *command);
+
+/**
+ * spawn_argv_async_no_shell - like spawn_async_no_shell(), but for a
+ * command already split by spawn_parse_argv()
+ * @argv: NULL-terminated arguments, not modified
+ */
+void spawn_argv_async_no_shell(char *const argv[]);
+
+/**
+ * spawn_async_no_shell_tracked - like spawn_async_no_shell(), but never
+ * through the spawn helper, so that the exit of the child is reported to
+ * the compositor under the returned pid
+ * @command: command to be executed
+ *
+ * Returns -1 if the command could not be executed.
+ */
+pid_t spawn_async_no_shell_tracked(const char *command);
+
+/**
+ * spawn_argv_async_no_shell_tracked - like spawn_async_no_shell_tracked(),
+ * but for a command already split into arguments
+ * @argv: NULL-terminated arguments, not modified
+ */
+pid_t spawn_argv_async_no_shell_tracked(char *const argv[]);
+
 /**
  * spawn_piped - execute asynchronously
  * @command: command to be executed
@@ -30,6 +62,17 @@ void spawn_async_no_shell(char const *command);
  */
 pid_t spawn_piped(const char *command, int *pipe_fd);
 
+/**
+ * spawn_piped_rw - execute asynchronously with stdin and stdout piped
+ * @command: command to be executed
+ * @read_fd: set to the read end of a pipe connected to stdout of the command
+ * @write_fd: set to the write end of a pipe connected to stdin of the command
+ *
+ * Both descriptors are non-blocking. Clean up with spawn_piped_close()
+ * on @read_fd and close() on @write_fd.
+ */
+pid_t spawn_piped_rw(const char *command, int *read_fd, int *write_fd);
+
 /**
  * spawn_piped_close - clean up a previous
  *                     spawn_piped() process
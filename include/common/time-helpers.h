@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_TIME_HELPERS_H
+#define LABWC_TIME_HELPERS_H
+
+#include <stdint.h>
+
+struct timespec;
+
+/**
+ * timespec_to_nsec() - convert a timespec to nanoseconds
+ * @ts: timespec to convert
+ */
+uint64_t timespec_to_nsec(const struct timespec *ts);
+
+/**
+ * time_now_nsec() - current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t time_now_nsec(void);
+
+#endif /* LABWC_TIME_HELPERS_H */
@@ -5,6 +5,8 @@
 #include <libxml/tree.h>
 #include <stdbool.h>
 
+struct wl_array;
+
 /*
  * Converts dotted attributes into nested nodes.
  * For example, the following node:
@@ -27,6 +29,9 @@
  */
 void lab_xml_expand_dotted_attributes(xmlNode *parent);
 
+/* Free the xmlDoc pointers in @docs and release the array */
+void lab_xml_docs_release(struct wl_array *docs);
+
 /* Returns true if the node only contains a string or is empty */
 bool lab_xml_node_is_leaf(xmlNode *node);
 
@@ -21,6 +21,22 @@ struct keybind_device_whitelist {
 	struct wl_list link; /* struct keybind.device_whitelist */
 };
 
+/* Events which invalidate cached condition results, see conditionCacheReset */
+enum keybind_condition_event {
+	KEYBIND_CONDITION_EVENT_FOCUS = 1 << 0,
+	KEYBIND_CONDITION_EVENT_WORKSPACE = 1 << 1,
+};
+
+struct keybind_condition_cache {
+	bool valid;
+	bool matched;
+	uint64_t stored_ns;       /* CLOCK_MONOTONIC */
+	uint64_t focus_serial;
+	uint64_t workspace_serial;
+	uint64_t hits;
+	uint64_t misses;
+};
+
 struct keybind {
 	uint32_t modifiers;
 	xkb_keysym_t *keysyms;
@@ -41,6 +57,10 @@ struct keybind {
 	char *condition_command; /* command to run for conditional execution */
 	char **condition_values; /* array of expected output values */
 	size_t condition_values_len; /* number of expected values */
+	bool condition_use_helper; /* condition_command is a helper query */
+	int condition_cache_ms;  /* 0 = condition results are not cached */
+	uint32_t condition_cache_reset; /* enum keybind_condition_event mask */
+	struct keybind_condition_cache condition_cache;
 };
 
 /**
@@ -49,6 +69,10 @@ struct keybind {
  */
 struct keybind *keybind_create(const char *keybind);
 
+/*
+ * keybind_destroy - forget a keybind removed from rc.keybinds
+ * Its memory belongs to rc.arena and is only released by rcxml_finish().
+ */
 void keybind_destroy(struct keybind *keybind);
 
 /**
@@ -63,8 +87,22 @@ bool keybind_the_same(struct keybind *a, struct keybind *b);
 bool keybind_contains_keycode(struct keybind *keybind, xkb_keycode_t keycode);
 bool keybind_contains_keysym(struct keybind *keybind, xkb_keysym_t keysym);
 
+/* Also rebuilds the index used by keybind_index_lookup() */
 void keybind_update_keycodes(struct server *server);
 
+/**
+ * keybind_index_lookup - get all keybinds with exactly @modifiers
+ * containing @sym, or @keycode if @sym is XKB_KEY_NoSymbol
+ * @nr_keybinds: set to the number of returned keybinds
+ *
+ * The keybinds are returned in rc.keybinds order. Whether they are
+ * enabled or apply to the input device must be checked by the caller.
+ * The returned array is only valid until rc.keybinds or the keycodes
+ * change.
+ */
+struct keybind **keybind_index_lookup(uint32_t modifiers, xkb_keysym_t sym,
+	xkb_keycode_t keycode, size_t *nr_keybinds);
+
 /**
  * keybind_find_by_id - find a keybind by its id
  * @id: keybind identifier
@@ -78,4 +116,25 @@ struct keybind *keybind_find_by_id(const char *id);
  * Returns true if condition is met (or no condition), false otherwise
  */
 bool keybind_check_condition_sync(struct keybind *keybind);
+
+/**
+ * keybind_condition_matches - check output of the condition command
+ * against the expected values
+ * @output: command output with trailing whitespace removed
+ */
+bool keybind_condition_matches(struct keybind *keybind, const char *output);
+
+/**
+ * keybind_condition_cache_lookup - get a cached condition result
+ * @matched: set to the cached result on success
+ * Returns true on a cache hit
+ */
+bool keybind_condition_cache_lookup(struct keybind *keybind, bool *matched);
+void keybind_condition_cache_store(struct keybind *keybind, bool matched);
+
+/* Invalidate cached condition results depending on @event */
+void keybind_condition_cache_notify(enum keybind_condition_event event);
+
+/* Log cache hit/miss counters of all keybinds using the cache */
+void keybind_condition_cache_report(void);
 #endif /* LABWC_KEYBIND_H */
@@ -3,6 +3,7 @@
 #define LABWC_LIBINPUT_H
 
 #include <libinput.h>
+#include <stdbool.h>
 #include <string.h>
 #include <wayland-server-core.h>
 
@@ -42,4 +43,11 @@ const char *libinput_device_type_name(enum lab_libinput_device_type type);
 struct libinput_category *libinput_category_create(void);
 struct libinput_category *libinput_category_get_default(void);
 
+/*
+ * Returns true if @a and @b configure a device the same way, ignoring
+ * which devices they match (type, name) and their list links.
+ */
+bool libinput_category_settings_equal(const struct libinput_category *a,
+	const struct libinput_category *b);
+
 #endif /* LABWC_LIBINPUT_H */
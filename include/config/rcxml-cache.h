@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_RCXML_CACHE_H
+#define LABWC_RCXML_CACHE_H
+
+#include <libxml/tree.h>
+
+struct buf;
+
+/*
+ * Cache of preprocessed config files, enabled by --config-cache
+ *
+ * After XInclude processing and lab_xml_expand_dotted_attributes(), the
+ * element tree of rc.xml is stored in a compact binary form in
+ * $XDG_CACHE_HOME/labwc/config/, keyed by a hash of the file content and
+ * the size and mtime of every XIncluded file. Loading it takes a single
+ * mmap() and skips the XML parser altogether.
+ *
+ * Bump RCXML_CACHE_VERSION whenever the preprocessing changes.
+ */
+#define RCXML_CACHE_VERSION 1
+
+/*
+ * rcxml_cache_load() - get the preprocessed document for @filename
+ * with content @b, or NULL if there is no up-to-date cache entry
+ */
+xmlDoc *rcxml_cache_load(const char *filename, const struct buf *b);
+
+/* Store the preprocessed @doc parsed from @filename with content @b */
+void rcxml_cache_store(const char *filename, const struct buf *b, xmlDoc *doc);
+
+#endif /* LABWC_RCXML_CACHE_H */
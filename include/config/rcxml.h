@@ -3,10 +3,12 @@
 #define LABWC_RCXML_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/util/box.h>
 #include <libxml/tree.h>
 
+#include "common/arena.h"
 #include "common/border.h"
 #include "common/font.h"
 #include "common/node-type.h"
@@ -45,6 +47,7 @@ enum tiling_events_mode {
 };
 
 struct buf;
+struct cycle_osd_format;
 
 struct button_map_entry {
 	uint32_t from;
@@ -57,11 +60,45 @@ struct usable_area_override {
 	struct wl_list link; /* struct rcxml.usable_area_overrides */
 };
 
+/* Values for render_delay_config.max_render_time other than milliseconds */
+#define LAB_MAX_RENDER_TIME_OFF (0)
+#define LAB_MAX_RENDER_TIME_AUTO (-1)
+
+/* Values for rcxml.motion_coalescing other than milliseconds */
+#define LAB_MOTION_COALESCING_OFF (0)
+#define LAB_MOTION_COALESCING_FRAME (-1)
+
+/*
+ * Top-level elements of rc.xml whose content is hashed, so that
+ * reconfigure can skip rebuilding what doesn't depend on changed ones
+ */
+enum rc_section {
+	RC_SECTION_CORE,
+	RC_SECTION_THEME,
+	RC_SECTION_RESIZE,
+	RC_SECTION_KEYBOARD,
+	RC_SECTION_MOUSE,
+	RC_SECTION_WINDOW_RULES,
+	RC_SECTION_MENU,
+	RC_SECTION_LIBINPUT,
+	RC_SECTION_DESKTOPS,
+	RC_SECTION_REGIONS,
+	RC_SECTION_OTHER,
+	RC_SECTION_COUNT
+};
+
+struct render_delay_config {
+	int max_render_time; /* in ms, or LAB_MAX_RENDER_TIME_{OFF,AUTO} */
+	char *output;
+	struct wl_list link; /* struct rcxml.render_delay_configs */
+};
+
 struct rcxml {
 	/* from command line */
 	char *config_dir;
 	char *config_file;
 	bool merge_config;
+	bool config_cache;
 
 	/* core */
 	bool xdg_shell_server_side_deco;
@@ -72,8 +109,26 @@ struct rcxml {
 	bool auto_enable_outputs;
 	bool reuse_output_mode;
 	bool xwayland_persistence;
+	int xwayland_prestart; /* s of idle time, 0 to start on demand */
+	int xwayland_idle_shutdown; /* s without X11 clients, 0 for never */
+	bool spawn_helper;
 	bool primary_selection;
 	char *prompt_command;
+	bool native_prompt;
+	unsigned int scaled_buffer_cache_size; /* MiB */
+	bool prerender_scales;
+	bool async_text_rendering;
+	bool async_icon_loading;
+	bool deferred_startup;
+	unsigned int title_update_interval; /* ms, 0 to apply all changes */
+	unsigned int memory_pressure_threshold; /* ms per second, 0 to disable */
+	unsigned int hidden_frame_rate; /* Hz, 0 for no frame callbacks */
+	unsigned int idle_notify_interval; /* ms, 0 to notify on every event */
+	bool hide_overlays_on_fullscreen;
+	unsigned int virtual_output_max_frame_rate; /* Hz, 0 for no limit */
+	unsigned int output_release_delay; /* s, 0 to keep buffers */
+	unsigned int session_script_timeout; /* ms, 0 for no limit */
+	unsigned int metrics_interval; /* s, 0 to not write the file */
 
 	/* placement */
 	enum lab_placement_policy placement_policy;
@@ -113,16 +168,22 @@ struct rcxml {
 	/* <margin top="" bottom="" left="" right="" output="" /> */
 	struct wl_list usable_area_overrides;
 
+	/* <renderDelay maxRenderTime="" output="" /> */
+	struct wl_list render_delay_configs;
+
 	/* keyboard */
 	int repeat_rate;
 	int repeat_delay;
 	enum lab_tristate kb_numlock_enable;
 	bool kb_layout_per_window;
+	char *kb_condition_helper; /* command, see input/condition-helper.h */
 	struct wl_list keybinds;   /* struct keybind.link */
 	struct wl_list keyboard_blacklist_devices; /* struct keyboard_blacklist_device.link */
 
 	/* mouse */
 	long doubleclick_time;     /* in ms */
+	int motion_coalescing;     /* in ms, or LAB_MOTION_COALESCING_{OFF,FRAME} */
+	unsigned int hardware_cursor_max_size; /* in pixels, 0 for no limit */
 	struct wl_list mousebinds; /* struct mousebind.link */
 
 	/* touch tablet */
@@ -140,6 +201,7 @@ struct rcxml {
 	struct tablet_tool_config {
 		enum lab_motion motion;
 		double relative_motion_sensitivity;
+		bool motion_coalescing;
 	} tablet_tool;
 
 	/* libinput */
@@ -161,14 +223,21 @@ struct rcxml {
 	bool snap_top_maximize;
 	enum tiling_events_mode snap_tiling_events_mode;
 
+	/* automatic tiling */
+	enum lab_tiling_layout tiling_layout;
+	double tiling_master_ratio;
+
 	enum resize_indicator_mode resize_indicator;
 	bool resize_draw_contents;
+	bool resize_client_paced;
+	bool resize_snapshot;
 	int resize_corner_range;
 	int resize_minimum_area;
 
 	struct {
 		int popuptime;
 		int min_nr_workspaces;
+		int swipe_fingers; /* 0 to disable */
 		char *prefix;
 		struct wl_list workspaces;  /* struct workspace.link */
 	} workspace_config;
@@ -187,6 +256,8 @@ struct rcxml {
 		enum cycle_osd_style style;
 		enum cycle_osd_output_criteria output_criteria;
 		char *thumbnail_label_format;
+		/* Compiled from thumbnail_label_format after loading */
+		struct cycle_osd_format *thumbnail_label;
 		enum window_switcher_order order;
 	} window_switcher;
 
@@ -195,6 +266,7 @@ struct rcxml {
 	/* Menu */
 	unsigned int menu_ignore_button_release_period;
 	bool menu_show_icons;
+	unsigned int menu_idle_timeout; /* seconds, 0 to keep scenes */
 
 	/* Magnifier */
 	int mag_width;
@@ -202,13 +274,41 @@ struct rcxml {
 	float mag_scale;
 	float mag_increment;
 	bool mag_filter;
+
+	/* Optional protocol globals, only created at launch */
+	bool protocol_screencopy;
+	bool protocol_data_control;
+	bool protocol_foreign_toplevel;
+	bool protocol_drm_lease;
+	bool protocol_tearing_control;
+
+	/* Hashes of the config file content, indexed by enum rc_section */
+	uint64_t section_hashes[RC_SECTION_COUNT];
+
+	/*
+	 * Memory of keybinds and mousebinds, released at once by
+	 * rcxml_finish()
+	 */
+	struct arena arena;
 };
 
 extern struct rcxml rc;
 
+/* Read the config files into rc, see also below */
 void rcxml_read(const char *filename);
 void rcxml_finish(void);
 
+/*
+ * The steps of rcxml_read(), so that the files can be parsed on a worker
+ * thread. rcxml_get_paths() lists the candidate files of @filename (if
+ * given) or rc.xml. rcxml_load() reads and parses them into @docs, a
+ * wl_array of xmlDoc pointers, without touching rc other than reading
+ * the command line options. rcxml_read_docs() applies and releases @docs.
+ */
+void rcxml_get_paths(struct wl_list *paths, const char *filename);
+void rcxml_load(struct wl_list *paths, struct wl_array *docs);
+void rcxml_read_docs(struct wl_array *docs);
+
 /*
  * Parse the child <action> nodes and append them to the list.
  * FIXME: move this function to somewhere else.
@@ -2,14 +2,29 @@
 #ifndef LABWC_SESSION_H
 #define LABWC_SESSION_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
 struct server;
 
 /**
  * session_run_script - run a named session script (or, in merge-config mode,
- * all named session scripts) from the XDG path.
+ * all named session scripts) from the XDG path, together with the scripts
+ * in the directory of the same name with a .d suffix, in parallel.
+ *
+ * A script that is still running from the last time is terminated first.
+ * reconfigure and shutdown scripts are terminated after
+ * <core><sessionScriptTimeout>.
  */
 void session_run_script(const char *script);
 
+/**
+ * session_check_script_result - handle the exit of a session script
+ * Returns false if @pid is not a session script.
+ */
+bool session_check_script_result(pid_t pid, int exit_code);
+
 /**
  * session_environment_init - set environment variables based on <key>=<value>
  * pairs in `${XDG_CONFIG_DIRS:-/etc/xdg}/labwc/environment` with user override
@@ -17,15 +32,41 @@ void session_run_script(const char *script);
  */
 void session_environment_init(void);
 
+/**
+ * session_environment_serial - incremented by every
+ * session_environment_init(), so that values derived from the
+ * environment can tell whether they are outdated
+ */
+uint64_t session_environment_serial(void);
+
 /**
  * session_autostart_init - run autostart file as shell script
  * Note: Same as `sh ~/.config/labwc/autostart` (or equivalent XDG config dir)
+ *
+ * When the dbus and systemd activation environment is updated, autostart
+ * is run once the update has finished, or after one second at the latest.
  */
 void session_autostart_init(struct server *server);
 
+/**
+ * session_update_activation_env - export the activation environment
+ * again after reconfigure, if any of the exported variables changed
+ */
+void session_update_activation_env(struct server *server);
+
+/**
+ * session_check_activation_result - handle the exit of a child which
+ * updates the activation environment
+ * Returns false if @pid is not such a child.
+ */
+bool session_check_activation_result(pid_t pid, int exit_code);
+
 /**
  * session_shutdown - run session shutdown file as shell script
  * Note: Same as `sh ~/.config/labwc/shutdown` (or equivalent XDG config dir)
+ *
+ * With <core><sessionScriptTimeout>, the event loop keeps running until
+ * the shutdown scripts have exited or timed out.
  */
 void session_shutdown(struct server *server);
 
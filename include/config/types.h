@@ -107,6 +107,13 @@ enum lab_window_type {
 	LAB_WINDOW_TYPE_LEN
 };
 
+enum lab_tiling_layout {
+	LAB_TILING_LAYOUT_INVALID = -1,
+	LAB_TILING_LAYOUT_GRID = 0,
+	LAB_TILING_LAYOUT_MASTER_STACK,
+	LAB_TILING_LAYOUT_BSP,
+};
+
 enum window_switcher_order {
 	WINDOW_SWITCHER_ORDER_FOCUS,
 	WINDOW_SWITCHER_ORDER_AGE,
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_CONFIGURE_STATS_H
+#define LABWC_CONFIGURE_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct view;
+
+/*
+ * Configure latency statistics, kept per app_id
+ *
+ * For xdg-shell views, the time from sending a configure request until
+ * the client acks it and until it commits the acked state is recorded.
+ * While a client is still catching up with an earlier request, further
+ * requests extend the same measurement, so a sample is the time it took
+ * the client to catch up. Configure requests which time out count as
+ * CONFIGURE_TIMEOUT_MS.
+ *
+ * A client is considered slow once the average over its most recent
+ * samples exceeds CONFIGURE_STATS_SLOW_MS. Slow clients do not hold back
+ * layout transactions, see layout-transaction.h.
+ */
+#define CONFIGURE_STATS_WINDOW 16
+#define CONFIGURE_STATS_MIN_SAMPLES 4
+#define CONFIGURE_STATS_SLOW_MS 50
+
+/* Called when a configure request is sent to @view */
+void configure_stats_sent(struct view *view);
+
+/* Called when @view acks its latest configure request */
+void configure_stats_acked(struct view *view);
+
+/* Called when @view commits its latest acked configure or times out */
+void configure_stats_done(struct view *view, bool timed_out);
+
+/* Returns true if the client of @view has been slow to catch up lately */
+bool configure_stats_view_is_slow(struct view *view);
+
+/* Dump the statistics for all app_ids in plain text */
+void configure_stats_print(FILE *stream);
+
+void configure_stats_reset(void);
+void configure_stats_finish(void);
+
+#endif /* LABWC_CONFIGURE_STATS_H */
@@ -3,6 +3,7 @@
 #define LABWC_CYCLE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
 struct output;
@@ -35,10 +36,14 @@ enum cycle_osd_field_content {
 	LAB_FIELD_COUNT
 };
 
+/* A custom format parsed once, see cycle_osd_format_compile() */
+struct cycle_osd_format;
+
 struct cycle_osd_field {
 	enum cycle_osd_field_content content;
 	int width;
 	char *format;
+	struct cycle_osd_format *compiled; /* format */
 	struct wl_list link; /* struct rcxml.window_switcher.fields */
 };
 
@@ -62,6 +67,21 @@ void cycle_reinitialize(struct server *server);
 /* Focus the clicked window and close OSD */
 void cycle_on_cursor_release(struct server *server, struct wlr_scene_node *node);
 
+/*
+ * Drop the thumbnails and textures kept by the thumbnail window switcher,
+ * which belong to the current renderer
+ */
+void cycle_osd_thumbnail_reset(void);
+
+/*
+ * Drop the OSD items kept between window switcher sessions, e.g. because
+ * the theme or config changed
+ */
+void cycle_osd_reset_cache(struct server *server);
+void cycle_osd_drop_cached_items(struct output *output);
+/* Drop the cached items which show @view */
+void cycle_osd_forget_view(struct view *view);
+
 /* Used by osd.c internally to render window switcher fields */
 void cycle_osd_field_get_content(struct cycle_osd_field *field,
 	struct buf *buf, struct view *view);
@@ -69,6 +89,17 @@ void cycle_osd_field_get_content(struct cycle_osd_field *field,
 void cycle_osd_field_set_custom(struct buf *buf, struct view *view,
 	const char *format);
 
+/*
+ * Parse a custom format like "%-10b %t" into literals and conversions,
+ * so that applying it to each window is a single pass. Returns NULL and
+ * logs an error if @format is NULL.
+ */
+struct cycle_osd_format *cycle_osd_format_compile(const char *format);
+/* Append the fields of @view according to @format to @buf */
+void cycle_osd_format_apply(struct cycle_osd_format *format,
+	struct buf *buf, struct view *view);
+void cycle_osd_format_destroy(struct cycle_osd_format *format);
+
 /* Used by rcxml.c when parsing the config */
 void cycle_osd_field_arg_from_xml_node(struct cycle_osd_field *field,
 	const char *nodename, const char *content);
@@ -79,9 +110,35 @@ void cycle_osd_field_free(struct cycle_osd_field *field);
 struct cycle_osd_item {
 	struct view *view;
 	struct wlr_scene_tree *tree;
+	/* Of everything shown by the item, see cycle_osd_reuse_item() */
+	uint64_t hash;
 	struct wl_list link;
 };
 
+/*
+ * Get the item kept from the previous window switcher session for @view,
+ * if its @hash matches. It is moved to @parent and appended to
+ * output->cycle_osd.items. The item tree is positioned by the caller.
+ */
+struct cycle_osd_item *cycle_osd_reuse_item(struct output *output,
+	struct view *view, uint64_t hash, struct wlr_scene_tree *parent);
+
+/* Move the items of output->cycle_osd.items to the hidden cache */
+void cycle_osd_cache_items(struct output *output);
+
+/*
+ * Update output->cycle_osd.first_item so that the selected view is shown.
+ * Returns true if it changed, and the items need to be placed again.
+ */
+bool cycle_osd_scroll_to_selection(struct output *output);
+
+/*
+ * Create or update output->cycle_osd.scrollbar in a box of @width and
+ * @height at @x, @y, or remove it if all items are shown
+ */
+void cycle_osd_update_scrollbar(struct output *output, int x, int y,
+	int width, int height);
+
 struct cycle_osd_impl {
 	/*
 	 * Create a scene-tree of OSD for an output.
@@ -2,8 +2,18 @@
 #ifndef LABWC_DEBUG_H
 #define LABWC_DEBUG_H
 
+#include <stdio.h>
+
 struct server;
 
 void debug_dump_scene(struct server *server);
 
+/*
+ * Write statistics of the scene graph to @stream as a JSON object: node
+ * counts by type and by owning subsystem, the memory of the buffers of
+ * each subsystem, the number of distinct and shared lab_data_buffers and
+ * the deepest paths.
+ */
+void debug_scene_stats(struct server *server, FILE *stream);
+
 #endif /* LABWC_DEBUG_H */
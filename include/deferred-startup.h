@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_DEFERRED_STARTUP_H
+#define LABWC_DEFERRED_STARTUP_H
+
+struct server;
+
+/*
+ * Deferred startup ("first frame first")
+ *
+ * With <core><deferredStartup>, server_init() and main() leave out what
+ * the first frame doesn't need: the foreign-toplevel managers, desktop
+ * entries and the icon theme, and the menus. Once an output has committed
+ * its first frame, or after a timeout if none does, these are initialized
+ * one per event loop iteration in that order, so that input and frames
+ * are handled between them. @ready is called after the last step; that
+ * is when the session is considered ready and autostart is run.
+ *
+ * Without the option, deferred_startup_start() calls @ready right away.
+ */
+void deferred_startup_start(struct server *server, void (*ready)(void *data),
+	void *data);
+
+/* Called for every committed output frame */
+void deferred_startup_frame_committed(void);
+
+/* Run the remaining steps now, for example before a reconfigure */
+void deferred_startup_flush(void);
+
+/* Drop the remaining steps without running them */
+void deferred_startup_finish(void);
+
+#endif /* LABWC_DEFERRED_STARTUP_H */
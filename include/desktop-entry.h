@@ -3,6 +3,8 @@
 #define LABWC_DESKTOP_ENTRY_H
 #include "config.h"
 #if HAVE_LIBSFDO
+#include <stdbool.h>
+#include "img/img.h"
 
 struct server;
 
@@ -15,6 +17,23 @@ struct lab_img *desktop_entry_load_icon_from_app_id(
 struct lab_img *desktop_entry_load_icon(
 	struct server *server, const char *icon_name, int size, float scale);
 
+/**
+ * desktop_entry_find_icon() - resolve an icon file without loading it
+ * @path: set to the file, which the caller must free()
+ * @type: set to the format of the file
+ *
+ * Returns false if there is no such icon. Together with
+ * desktop_entry_find_icon_from_app_id(), which uses the same cache of
+ * resolved icon paths as desktop_entry_load_icon_from_app_id(), this
+ * allows loading the file on a worker thread.
+ */
+bool desktop_entry_find_icon(struct server *server, const char *icon_name,
+	int size, float scale, char **path, enum lab_img_type *type);
+
+bool desktop_entry_find_icon_from_app_id(struct server *server,
+	const char *app_id, int size, float scale, char **path,
+	enum lab_img_type *type);
+
 /**
  * desktop_entry_name_lookup() - return the application name
  * from the sfdo desktop entry database based on app_id
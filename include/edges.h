@@ -105,6 +105,25 @@ void edges_find_neighbors(struct border *nearest_edges, struct view *view,
 	struct wlr_box origin, struct wlr_box target,
 	struct output *output, edge_validator_t validator, bool ignore_hidden);
 
+/*
+ * Same as edges_find_neighbors() with ignore_hidden and no output, but
+ * only passes edges to @validator that are within @distance of the moving
+ * edges' motion, which the validator must ignore anyway. The edges of the
+ * other views are indexed by position on first use, and the index is kept
+ * until edges_index_invalidate() is called, so this is meant for the
+ * repeated queries of an interactive move or resize.
+ */
+void edges_find_neighbors_near(struct border *nearest_edges, struct view *view,
+	struct wlr_box origin, struct wlr_box target, int distance,
+	edge_validator_t validator);
+
+/*
+ * Drop the edge index. This is done by edges_visibility_invalidate(), which
+ * must be called whenever views are mapped, unmapped, restacked, moved
+ * (other than the one being moved) or destroyed.
+ */
+void edges_index_invalidate(void);
+
 void edges_find_outputs(struct border *nearest_edges, struct view *view,
 	struct wlr_box origin, struct wlr_box target,
 	struct output *output, edge_validator_t validator);
@@ -117,6 +136,21 @@ void edges_adjust_resize_geom(struct view *view, struct border edges,
 
 bool edges_traverse_edge(struct edge current, struct edge target, struct edge edge);
 
+/*
+ * Update view->edges_visible of all views, leaving out @ignored_view which
+ * is considered to not cover anything. The views visible on each output
+ * are kept in output->visible_views and only computed again for outputs
+ * marked by edges_visibility_invalidate(), so a view whose edges_visible
+ * is LAB_EDGE_NONE afterwards is completely covered or not shown at all.
+ */
 void edges_calculate_visibility(struct server *server, struct view *ignored_view);
 
+/*
+ * Mark the outputs on which the visibility may have changed because @view
+ * was mapped, unmapped, moved, resized or destroyed, or all outputs if
+ * @view is NULL (for restacking, workspace switches and layout changes).
+ * Also drops the edge index.
+ */
+void edges_visibility_invalidate(struct server *server, struct view *view);
+
 #endif /* LABWC_EDGES_H */
@@ -7,6 +7,8 @@
 struct ext_foreign_toplevel {
 	struct view *view;
 	struct wlr_ext_foreign_toplevel_handle_v1 *handle;
+	/* Sends title and app_id changes once the event loop is idle */
+	struct wl_event_source *idle_source;
 
 	/* Client side events */
 	struct {
@@ -22,6 +24,8 @@ struct ext_foreign_toplevel {
 
 void ext_foreign_toplevel_init(struct ext_foreign_toplevel *ext_toplevel,
 	struct view *view);
+/* Create the handle, or send the changes made while no client was bound */
+void ext_foreign_toplevel_sync(struct ext_foreign_toplevel *ext_toplevel);
 void ext_foreign_toplevel_finish(struct ext_foreign_toplevel *ext_toplevel);
 
 #endif /* LABWC_EXT_FOREIGN_TOPLEVEL_H */
@@ -2,9 +2,23 @@
 #ifndef LABWC_FOREIGN_TOPLEVEL_H
 #define LABWC_FOREIGN_TOPLEVEL_H
 
+#include <stdbool.h>
+
+struct server;
 struct view;
 struct foreign_toplevel;
 
+/*
+ * Handles are created lazily once a client binds the wlr or ext manager.
+ * Call after creating the managers.
+ */
+void foreign_toplevel_watch_binds(struct server *server);
+
+/* Whether a client has bound the manager, for the implementations */
+bool foreign_toplevel_wlr_bound(void);
+bool foreign_toplevel_ext_bound(void);
+
+
 struct foreign_toplevel *foreign_toplevel_create(struct view *view);
 void foreign_toplevel_set_parent(struct foreign_toplevel *toplevel,
 	struct foreign_toplevel *parent);
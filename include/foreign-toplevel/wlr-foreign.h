@@ -2,12 +2,30 @@
 #ifndef LABWC_WLR_FOREIGN_TOPLEVEL_H
 #define LABWC_WLR_FOREIGN_TOPLEVEL_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
+enum wlr_foreign_pending {
+	WLR_FOREIGN_PENDING_APP_ID = 1 << 0,
+	WLR_FOREIGN_PENDING_TITLE = 1 << 1,
+	WLR_FOREIGN_PENDING_OUTPUTS = 1 << 2,
+	WLR_FOREIGN_PENDING_MAXIMIZED = 1 << 3,
+	WLR_FOREIGN_PENDING_MINIMIZED = 1 << 4,
+	WLR_FOREIGN_PENDING_FULLSCREEN = 1 << 5,
+	WLR_FOREIGN_PENDING_ACTIVATED = 1 << 6,
+	WLR_FOREIGN_PENDING_ALL = (1 << 7) - 1,
+};
+
 struct wlr_foreign_toplevel {
 	struct view *view;
 	struct wlr_foreign_toplevel_handle_v1 *handle;
 
+	/* enum wlr_foreign_pending, flushed from idle_source */
+	uint32_t pending;
+	bool activated;
+	struct wl_event_source *idle_source;
+
 	/* Client side events */
 	struct {
 		struct wl_listener request_maximize;
@@ -32,6 +50,8 @@ struct wlr_foreign_toplevel {
 
 void wlr_foreign_toplevel_init(struct wlr_foreign_toplevel *wlr_toplevel,
 	struct view *view);
+/* Create the handle, or send the changes made while no client was bound */
+void wlr_foreign_toplevel_sync(struct wlr_foreign_toplevel *wlr_toplevel);
 void wlr_foreign_toplevel_set_parent(struct wlr_foreign_toplevel *wlr_toplevel,
 	struct wlr_foreign_toplevel *parent);
 void wlr_foreign_toplevel_finish(struct wlr_foreign_toplevel *wlr_toplevel);
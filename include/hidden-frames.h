@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_HIDDEN_FRAMES_H
+#define LABWC_HIDDEN_FRAMES_H
+
+struct server;
+
+/*
+ * Frame callbacks for hidden windows
+ *
+ * The scene only sends frame callbacks to surfaces which are visible on an
+ * output, so windows that are minimized, on another workspace, off-screen
+ * or completely covered by opaque windows stop rendering. Some clients
+ * misbehave without any frame callbacks, and screen recorders may need
+ * hidden windows to keep rendering, so a timer sends frame callbacks to
+ * hidden windows at <core><hiddenFrameRate>, or at the refresh rate of
+ * their output for windows with a throttleWhenHidden="no" window rule.
+ */
+void hidden_frames_init(struct server *server);
+
+/* Call after rc.xml has been (re-)loaded */
+void hidden_frames_reconfigure(void);
+
+void hidden_frames_finish(void);
+
+#endif /* LABWC_HIDDEN_FRAMES_H */
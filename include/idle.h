@@ -2,10 +2,17 @@
 #ifndef LABWC_IDLE_H
 #define LABWC_IDLE_H
 
+#include <stdint.h>
+
 struct wl_display;
 struct wlr_seat;
 
 void idle_manager_create(struct wl_display *display);
 void idle_manager_notify_activity(struct wlr_seat *seat);
+/*
+ * Time of the last user activity, up to <core><idleNotifyInterval> early,
+ * or 0 if there has been none yet
+ */
+uint64_t idle_manager_get_last_activity(void);
 
 #endif /* LABWC_IDLE_H */
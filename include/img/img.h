@@ -4,6 +4,7 @@
 
 #include <cairo.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-util.h>
 
 enum lab_img_type {
@@ -18,6 +19,16 @@ struct lab_img {
 	struct lab_img_data *data;
 };
 
+/**
+ * lab_img_load() - load an image file
+ * @type: image format
+ * @path: path of the image file
+ * @xbm_color: color of XBM images
+ *
+ * SVG files are only checked to be readable here and are parsed by the
+ * first lab_img_render(), which returns NULL if the file turns out to be
+ * invalid.
+ */
 struct lab_img *lab_img_load(enum lab_img_type type, const char *path,
 	float *xbm_color);
 
@@ -69,9 +80,17 @@ struct lab_data_buffer *lab_img_render(struct lab_img *img,
  */
 void lab_img_destroy(struct lab_img *img);
 
+/* Free the decoded image files which are not used, regardless of age */
+void lab_img_cache_trim(void);
+
 /**
  * lab_img_equal() - Returns true if two images draw the same content
  */
 bool lab_img_equal(struct lab_img *img_a, struct lab_img *img_b);
 
+/**
+ * lab_img_hash() - Returns a hash which is the same for equal images
+ */
+uint64_t lab_img_hash(struct lab_img *img);
+
 #endif /* LABWC_IMG_H */
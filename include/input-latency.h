@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_INPUT_LATENCY_H
+#define LABWC_INPUT_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct output;
+struct view;
+struct wlr_output_event_present;
+struct wlr_surface;
+
+/*
+ * Input-to-photon latency, kept per app_id
+ *
+ * While enabled, a key, button or motion event delivered to a window
+ * starts a sample unless one is already in flight for that window. The
+ * sample is split into the time the compositor took from the kernel
+ * timestamp of the event until delivering it, the time the client took
+ * until its next commit, and the time until the output presented the
+ * first frame composited after that commit. Samples which haven't been
+ * presented within INPUT_LATENCY_TIMEOUT_MS are dropped once the next
+ * event arrives.
+ *
+ * Each part and the total go into histograms with power of two buckets
+ * in milliseconds. While disabled, each hook costs one branch.
+ */
+#define INPUT_LATENCY_TIMEOUT_MS 1000
+#define INPUT_LATENCY_BUCKETS 9 /* <1, <2, <4 ... <128 ms and more */
+
+extern bool input_latency_enabled;
+
+void input_latency_enable(bool enable);
+
+/* Called after an input event was sent to @surface, which may be NULL */
+void input_latency_record_input(struct wlr_surface *surface,
+	uint32_t time_msec);
+/* Called on every commit of the main surface of @view */
+void input_latency_record_commit(struct view *view);
+/* Called when a frame composited at @start_nsec was committed */
+void input_latency_record_output_commit(struct output *output,
+	uint64_t start_nsec);
+void input_latency_record_present(struct output *output,
+	const struct wlr_output_event_present *event);
+/* Called when @output is destroyed */
+void input_latency_forget_output(struct output *output);
+
+static inline void
+input_latency_input(struct wlr_surface *surface, uint32_t time_msec)
+{
+	if (input_latency_enabled) {
+		input_latency_record_input(surface, time_msec);
+	}
+}
+
+static inline void
+input_latency_commit(struct view *view)
+{
+	if (input_latency_enabled) {
+		input_latency_record_commit(view);
+	}
+}
+
+/* Dump the histograms for all app_ids in plain text */
+void input_latency_print(FILE *stream);
+
+void input_latency_reset(void);
+void input_latency_finish(void);
+
+#endif /* LABWC_INPUT_LATENCY_H */
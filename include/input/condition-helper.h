@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_CONDITION_HELPER_H
+#define LABWC_CONDITION_HELPER_H
+
+#include <stdbool.h>
+
+struct server;
+
+/*
+ * Persistent helper process answering keybind condition queries.
+ *
+ * The helper configured by <keyboard><conditionHelper> is started on the
+ * first query and then kept running. Each query is written to its stdin
+ * as a single line and answered by exactly one line on its stdout, in
+ * order. If the helper exits or does not answer in time, all pending
+ * queries fail and the helper is restarted on the next query.
+ */
+
+/**
+ * condition_helper_answer_func_t - called once per query
+ * @answer: the answer line without trailing newline, or NULL if the
+ *          query failed or timed out
+ */
+typedef void (*condition_helper_answer_func_t)(const char *answer, void *data);
+
+/**
+ * condition_helper_query() - send a query to the helper
+ * @timeout_ms: time to wait for the answer
+ * Returns false if the query could not be sent. @answer is not called
+ * in that case.
+ */
+bool condition_helper_query(struct server *server, const char *query,
+	int timeout_ms, condition_helper_answer_func_t answer, void *data);
+
+/* Stop the helper, failing all pending queries */
+void condition_helper_stop(void);
+
+#endif /* LABWC_CONDITION_HELPER_H */
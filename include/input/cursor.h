@@ -44,6 +44,8 @@ struct cursor_context_saved {
 	struct wl_listener view_destroy;
 	struct wl_listener node_destroy;
 	struct wl_listener surface_destroy;
+	/* scene_index generation at the time the context was resolved */
+	uint64_t scene_generation;
 };
 
 /**
@@ -64,6 +66,15 @@ struct cursor_context_saved {
  */
 struct cursor_context get_cursor_context(struct server *server);
 
+/**
+ * get_cursor_context_cached - like get_cursor_context(), but reuses the
+ * context stored in @saved_ctx if the scene hasn't changed since and the
+ * cursor is still on the same client surface of a view. Otherwise the
+ * cursor context is resolved again and stored in @saved_ctx.
+ */
+struct cursor_context get_cursor_context_cached(struct server *server,
+	struct cursor_context_saved *saved_ctx);
+
 /**
  * cursor_set - set cursor icon
  * @seat - current seat
@@ -73,6 +84,34 @@ void cursor_set(struct seat *seat, enum lab_cursors cursor);
 
 void cursor_set_visible(struct seat *seat, bool visible);
 
+/**
+ * cursor_preload_scales - load the cursor theme for the scales of all
+ * enabled outputs, so that changing the cursor image does not need to
+ * read theme files. Called whenever the output layout changes.
+ */
+void cursor_preload_scales(struct seat *seat);
+
+/**
+ * cursor_flush_resize - apply pointer motion held back by
+ * <resize><clientPaced> during an interactive resize of @view, once the
+ * client has acked the previous configure request (or failed to do so
+ * in time), or right away if @force is set
+ */
+void cursor_flush_resize(struct view *view, bool force);
+
+/**
+ * cursor_flush_move - apply the latest pointer position to the view
+ * being moved interactively. Pointer motion during a move is applied
+ * once per output frame, from handle_output_frame().
+ */
+void cursor_flush_move(struct server *server);
+
+/**
+ * cursor_flush_motion - process pointer motion delayed by
+ * <mouse><motionCoalescing>, if any
+ */
+void cursor_flush_motion(struct seat *seat);
+
 /*
  * Safely store a cursor context to saved_ctx. saved_ctx is cleared when either
  * of its node, surface and view is destroyed.
@@ -4,6 +4,7 @@
 #define LABWC_IME_H
 
 #include <wayland-server-core.h>
+#include <wlr/util/box.h>
 
 struct keyboard;
 struct wlr_keyboard_key_event;
@@ -21,6 +22,20 @@ struct input_method_relay {
 	struct wlr_input_method_v2 *input_method;
 	struct wlr_surface *focused_surface;
 
+	/*
+	 * Where popups are anchored for focused_surface, resolved on first
+	 * use and kept until the focus changes or
+	 * input_method_relay_invalidate() is called
+	 */
+	struct {
+		bool valid;
+		/* False if focused_surface has no cursor rectangle support */
+		bool supported;
+		struct wlr_xdg_surface *xdg_surface;
+		/* Layout coordinates of the surface tree */
+		int lx, ly;
+	} anchor;
+
 	/*
 	 * Text-input which is enabled by the client and communicating with
 	 * input-method.
@@ -50,6 +65,11 @@ struct input_method_popup {
 	struct input_method_relay *relay;
 	struct wl_list link; /* input_method_relay.popups */
 
+	/* The cursor rectangle and size the popup was last positioned for */
+	bool positioned;
+	struct wlr_box cursor_rect;
+	int width, height;
+
 	struct wl_listener destroy;
 	struct wl_listener commit;
 };
@@ -88,4 +108,10 @@ void input_method_relay_finish(struct input_method_relay *relay);
 void input_method_relay_set_focus(struct input_method_relay *relay,
 	struct wlr_surface *surface);
 
+/*
+ * Forget the cached popup anchor, to be called when surfaces or outputs
+ * may have moved in the layout
+ */
+void input_method_relay_invalidate(struct input_method_relay *relay);
+
 #endif
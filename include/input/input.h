@@ -2,13 +2,18 @@
 #ifndef LABWC_INPUT_H
 #define LABWC_INPUT_H
 
+#include <stdbool.h>
 #include <wayland-server-core.h>
+#include "config/libinput.h"
 
 struct input {
 	struct wlr_input_device *wlr_input_device;
 	struct seat *seat;
 	/* Set for pointer/touch devices */
 	double scroll_factor;
+	/* The settings last applied to a libinput device, if any */
+	struct libinput_category applied_config;
+	bool has_applied_config;
 	struct wl_listener destroy;
 	struct wl_list link; /* seat.inputs */
 };
@@ -6,6 +6,9 @@
 #include <xkbcommon/xkbcommon.h>
 #include "input/input.h"
 
+struct view;
+struct wlr_surface;
+
 /*
  * Virtual keyboards should not belong to seat->keyboard_group. As a result we
  * need to be able to ascertain which wlr_keyboard key/modifier events come from
@@ -21,7 +24,7 @@ struct keyboard {
 	/* key repeat for compositor keybinds */
 	uint32_t keybind_repeat_keycode;
 	int32_t keybind_repeat_rate;
-	struct wl_event_source *keybind_repeat;
+	struct lab_timer *keybind_repeat;
 };
 
 void keyboard_reset_current_keybind(void);
@@ -34,9 +37,23 @@ void keyboard_group_finish(struct seat *seat);
 void keyboard_setup_handlers(struct keyboard *keyboard);
 void keyboard_set_numlock(struct wlr_keyboard *keyboard);
 void keyboard_update_layout(struct seat *seat, xkb_layout_index_t layout);
+
+/*
+ * Layouts stored per window with <keyboard><layoutScope>window. They are
+ * forgotten when the keymap changes, and read as the first layout then.
+ */
+void keyboard_store_view_layout(struct view *view, xkb_layout_index_t layout);
+xkb_layout_index_t keyboard_get_view_layout(struct view *view);
 void keyboard_cancel_keybind_repeat(struct keyboard *keyboard);
 void keyboard_cancel_all_keybind_repeats(struct seat *seat);
 
 uint32_t keyboard_get_all_modifiers(struct seat *seat);
 
+/*
+ * Send the current modifiers to the client of @surface, which has just
+ * got pointer focus, unless it has keyboard focus anyway.
+ */
+void keyboard_send_modifiers_on_pointer_enter(struct seat *seat,
+	struct wlr_surface *surface);
+
 #endif /* LABWC_KEYBOARD_H */
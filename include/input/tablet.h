@@ -28,6 +28,22 @@ struct drawing_tablet_tool {
 	double rotation;
 	double slider;
 	double wheel_delta;
+
+	/*
+	 * Layout position of the surface that receives tablet events,
+	 * as of the last processed cursor motion
+	 */
+	bool has_surface_origin;
+	double surface_origin_x, surface_origin_y;
+
+	/* Cursor motion waiting for the next output frame */
+	struct {
+		bool pending;
+		struct drawing_tablet *tablet;
+		double x, y;
+		uint32_t time_msec;
+	} coalesced_motion;
+
 	struct {
 		struct wl_listener set_cursor;
 		struct wl_listener destroy;
@@ -51,4 +67,10 @@ void tablet_finish(struct seat *seat);
 void tablet_create(struct seat *seat, struct wlr_input_device *wlr_input_device);
 bool tablet_tool_has_focused_surface(struct seat *seat);
 
+/*
+ * tablet_flush_motion - move the cursor to the tablet tool positions
+ * merged by <tabletTool motionCoalescing>, if any
+ */
+void tablet_flush_motion(struct seat *seat);
+
 #endif /* LABWC_TABLET_H */
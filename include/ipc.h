@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_IPC_H
+#define LABWC_IPC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct buf;
+struct server;
+
+/*
+ * Control socket
+ *
+ * The compositor listens on a Unix stream socket, by default
+ * $XDG_RUNTIME_DIR/labwc.$WAYLAND_DISPLAY.sock, and exports its path as
+ * LABWC_SOCK to child processes.
+ *
+ * Messages in both directions consist of a struct ipc_header holding the
+ * payload length in host byte order, followed by that many bytes of text
+ * (no terminating NUL). Clients may send any number of requests over one
+ * connection; every request gets exactly one reply, in order.
+ *
+ * A request is a command line of the form
+ *
+ *   <domain> <command> [argument]
+ *
+ * where domain is one of keybind, workspace, tiling, virtual-output,
+ * output, action, buffer-cache, configure, trace, scene, worker, timer,
+ * windows, latency, debug or metrics, and the argument extends to the end of
+ * the payload. A
+ * reply starts with "ok" or "error", optionally followed by a newline and
+ * further text, such as the result of a query or the error message.
+ *
+ * "windows list" returns the same snapshot of all windows as the windows
+ * event below, in one reply.
+ *
+ * "metrics dump" returns all registered counters and gauges in the
+ * OpenMetrics text format, see metrics.h.
+ *
+ * The request "events subscribe <event>..." (or "all") makes the
+ * compositor push messages "event <name>\n<state>" for the given events,
+ * starting with the current state. Events describe the complete new state
+ * rather than a delta, so all changes within one event loop iteration are
+ * coalesced into one message, and a subscriber which does not keep up
+ * only gets the latest state once its pending messages are sent.
+ *
+ *   tiling     the tiling mode, as reported by "tiling status"
+ *   workspace  the name of the current workspace
+ *   focus      app_id and title of the active window on two lines, or
+ *              nothing if no window is active
+ *   keybind    one "<id> enabled|disabled" line per toggleable keybind
+ *   output     one "<name> <x> <y> <width> <height> <scale>" line per
+ *              usable output, in layout coordinates
+ *   occupancy  one "<views> <name>" line per workspace, with the number of
+ *              mapped views on it that are neither omnipresent nor
+ *              always-on-top
+ *   windows    "generation <n>", then one line per mapped view from front
+ *              to back with the tab-separated fields id, x, y, width,
+ *              height, output, workspace, states, app_id and title. The
+ *              generation is bumped on every change of the window list,
+ *              so a snapshot can be ordered against windows events.
+ *
+ * "events unsubscribe <event>..." stops the given events.
+ */
+/* Large enough for the window list */
+#define IPC_MAX_PAYLOAD (1024 * 1024)
+
+enum ipc_event {
+	IPC_EVENT_TILING = 1 << 0,
+	IPC_EVENT_WORKSPACE = 1 << 1,
+	IPC_EVENT_FOCUS = 1 << 2,
+	IPC_EVENT_KEYBIND = 1 << 3,
+	IPC_EVENT_OUTPUT = 1 << 4,
+	IPC_EVENT_OCCUPANCY = 1 << 5,
+	IPC_EVENT_WINDOWS = 1 << 6,
+};
+
+struct ipc_header {
+	uint32_t length;
+};
+
+void ipc_init(struct server *server, const char *wayland_socket);
+void ipc_finish(void);
+
+/* Notify subscribers that the state behind @event changed */
+void ipc_emit(enum ipc_event event);
+
+/*
+ * Implemented by the compositor: run one request. Returns false and an
+ * error message in @reply on failure, or true and any result in @reply.
+ */
+bool server_run_command(struct server *server, const char *domain,
+	const char *command, const char *arg, struct buf *reply);
+
+/*
+ * Client side: send @request to the running compositor and wait for the
+ * reply, which is stored in @reply without the leading "ok" or "error".
+ * Returns true if the request succeeded.
+ */
+bool ipc_client_request(const char *request, struct buf *reply);
+
+#endif /* LABWC_IPC_H */
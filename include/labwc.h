@@ -5,8 +5,10 @@
 #include <wlr/util/box.h>
 #include <wlr/util/log.h>
 #include "common/set.h"
+#include "config/types.h"
 #include "input/cursor.h"
 #include "overlay.h"
+#include "scene-index.h"
 
 #define XCURSOR_DEFAULT "left_ptr"
 #define XCURSOR_SIZE 24
@@ -56,7 +58,7 @@ struct seat {
 	struct wlr_pointer_constraint_v1 *current_constraint;
 
 	/* Used to hide the workspace OSD after switching workspaces */
-	struct wl_event_source *workspace_osd_timer;
+	struct lab_timer *workspace_osd_timer;
 	bool workspace_osd_shown_by_modifier;
 
 	/* if set, views cannot receive focus */
@@ -81,6 +83,20 @@ struct seat {
 	/* Cursor context of the last cursor motion */
 	struct cursor_context_saved last_cursor_ctx;
 
+	/*
+	 * Result of the last hit-test on cursor motion, which may be
+	 * reused while the scene doesn't change. See
+	 * get_cursor_context_cached().
+	 */
+	struct cursor_context_saved motion_ctx;
+
+	/* Pointer motion waiting to be processed, see rc.motion_coalescing */
+	struct {
+		bool pending;
+		uint32_t time_msec;
+		struct wl_event_source *timer;
+	} coalesced_motion;
+
 	struct lab_set bound_buttons;
 
 	struct {
@@ -100,6 +116,7 @@ struct seat {
 	struct wl_list inputs;
 	struct wl_listener new_input;
 	struct wl_listener focus_change;
+	struct wl_listener pointer_focus_change;
 
 	struct {
 		struct wl_listener motion;
@@ -189,6 +206,8 @@ struct server {
 	struct wl_listener xdg_toplevel_icon_set_icon;
 
 	struct wl_list views;
+	/* The same views in the order of creation_id, oldest first */
+	struct wl_list views_by_age; /* struct view.age_link */
 	uint64_t next_view_creation_id;
 	struct wl_list unmanaged_surfaces;
 
@@ -205,6 +224,10 @@ struct server {
 	/* View geometry when interactive move/resize is requested */
 	struct wlr_box grab_box;
 	enum lab_edge resize_edges;
+	/* Pointer moved while a client-paced resize awaited a configure ack */
+	bool resize_deferred;
+	/* Pointer moved during an interactive move, see cursor_flush_move() */
+	bool move_deferred;
 
 	/*
 	 * 'active_view' is generally the view with keyboard-focus, updated with
@@ -234,6 +257,7 @@ struct server {
 	/* Tree for all non-layer xdg/xwayland-shell surfaces with always-on-top/below */
 	struct wlr_scene_tree *view_tree_always_on_top;
 	struct wlr_scene_tree *view_tree_always_on_bottom;
+	struct wl_list always_on_top_views; /* struct view.workspace_link */
 #if HAVE_XWAYLAND
 	/* Tree for unmanaged xsurfaces without initialized view (usually popups) */
 	struct wlr_scene_tree *unmanaged_tree;
@@ -241,6 +265,9 @@ struct server {
 	/* Tree for built in menu */
 	struct wlr_scene_tree *menu_tree;
 
+	/* Spatial index of the view trees for cursor hit-testing */
+	struct scene_index scene_index;
+
 	/* Workspaces */
 	struct {
 		struct wl_list all;  /* struct workspace.link */
@@ -250,6 +277,12 @@ struct server {
 		struct lab_cosmic_workspace_group *cosmic_group;
 		struct lab_ext_workspace_manager *ext_manager;
 		struct lab_ext_workspace_group *ext_group;
+		/* Views with visible_on_all_workspaces set */
+		int nr_omnipresent_views;
+		/* Writes labwc-workspace-current once per event loop iteration */
+		struct wl_event_source *status_file_idle;
+		/* Touchpad swipe or its animation in progress, if any */
+		struct workspace_swipe *swipe;
 		struct {
 			struct wl_listener layout_output_added;
 		} on;
@@ -294,6 +327,7 @@ struct server {
 	struct wl_listener new_constraint;
 
 	struct wlr_tearing_control_manager_v1 *tearing_control;
+	struct wlr_screencopy_manager_v1 *screencopy_manager;
 	struct wl_listener tearing_new_object;
 
 	struct wlr_input_method_manager_v2 *input_method_manager;
@@ -317,6 +351,8 @@ struct server {
 
 	struct menu *menu_current;
 	struct wl_list menus;
+	/* menu_files_hash() when the menus were loaded */
+	uint64_t menu_files_hash;
 
 	struct sfdo *sfdo;
 
@@ -330,8 +366,19 @@ struct server {
 	/* Track manually resized window to preserve its size during rearrangement */
 	struct view *resized_view;
 	struct wlr_box resized_view_geometry;
-	/* Timer for proactive tiling recalculation in smart resize mode */
-	struct wl_event_source *tiling_recalculate_timer;
+	/* Pending desktop_arrange_tiled() call, see desktop_schedule_arrange_tiled() */
+	struct wl_event_source *tiling_arrange_idle;
+	/* Armed by desktop_schedule_arrange_all_views() */
+	struct lab_timer *arrange_all_views_timer;
+	/* Set while desktop_arrange_all_views() adjusts every view */
+	bool arranging_views;
+	bool top_layer_visibility_pending;
+	/* Layout used in tiling mode and the trees of the tree based ones */
+	enum lab_tiling_layout tiling_layout;
+	struct wl_list tiling_trees; /* struct tiling_tree.link */
+	uint64_t tiling_generation;
+	/* Bumped whenever a usable area or the output layout changes */
+	uint64_t usable_area_generation;
 };
 
 void xdg_popup_create(struct view *view, struct wlr_xdg_popup *wlr_popup);
@@ -373,8 +420,24 @@ void desktop_focus_view_or_surface(struct seat *seat, struct view *view,
 
 void desktop_arrange_all_views(struct server *server);
 void desktop_arrange_tiled(struct server *server);
+
+/**
+ * desktop_schedule_arrange_all_views() - call desktop_arrange_all_views()
+ * once no further call has been made for LAYOUT_CHANGE_SETTLE_MS. Bursts
+ * of output layout changes, e.g. when docking a laptop, result in a single
+ * arrangement for the final layout.
+ */
+#define LAYOUT_CHANGE_SETTLE_MS 100
+void desktop_schedule_arrange_all_views(struct server *server);
+
+/**
+ * desktop_schedule_arrange_tiled() - re-arrange tiled windows once the
+ * event loop is idle. Several layout changes in one event loop iteration
+ * (e.g. a workspace switch unmapping and mapping views) are coalesced
+ * into a single arrangement.
+ */
+void desktop_schedule_arrange_tiled(struct server *server);
 void desktop_focus_output(struct output *output);
-void tiling_timer_update(struct server *server);
 
 /**
  * Toggles the (output local) visibility of the layershell top layer
@@ -383,9 +446,10 @@ void tiling_timer_update(struct server *server);
 void desktop_update_top_layer_visibility(struct server *server);
 
 /**
- * desktop_focus_topmost_view() - focus the topmost view on the current
- * workspace, skipping views that claim not to want focus (those can
- * still be focused by explicit request, e.g. by clicking in them).
+ * desktop_focus_topmost_view() - focus the most recently focused view on
+ * the current workspace, or else the topmost one, skipping views that
+ * claim not to want focus (those can still be focused by explicit
+ * request, e.g. by clicking in them).
  *
  * This function is typically called when the focused view is hidden
  * (closes, is minimized, etc.) to focus the "next" view underneath.
@@ -452,6 +516,8 @@ void handle_tearing_new_object(struct wl_listener *listener, void *data);
 
 void server_init(struct server *server);
 void server_start(struct server *server);
+/* Create the foreign-toplevel managers, deferred with <deferredStartup> */
+void server_init_foreign_toplevel(struct server *server);
 void server_finish(struct server *server);
 
 void create_constraint(struct wl_listener *listener, void *data);
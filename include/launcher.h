@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_LAUNCHER_H
+#define LABWC_LAUNCHER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct wl_event_loop;
+
+/*
+ * Spawn helper for <core><spawnHelper>
+ *
+ * A small process forked at startup, before the compositor has set up
+ * its renderer and grown its address space, which launches detached
+ * commands on the compositor's behalf. Requests carry argv and the
+ * current environment of the compositor over a socketpair. The helper
+ * reports the exit status of its children back, so that they are handled
+ * like direct children of the compositor.
+ */
+
+/* Fork the helper if enabled in rc.xml; call before server_init() */
+void launcher_init(void);
+
+/*
+ * Start reading exit reports, which are passed to @child_exited with the
+ * si_code and si_status of the waitid() result
+ */
+void launcher_attach(struct wl_event_loop *loop,
+	void (*child_exited)(pid_t pid, int code, int status, void *data),
+	void *data);
+
+/* Close the connection, which makes the helper exit */
+void launcher_finish(void);
+
+/*
+ * Run @argv in a new session through the helper. Returns false if the
+ * helper is not available, in which case the caller should spawn the
+ * command itself.
+ */
+bool launcher_spawn(char *const argv[]);
+
+#endif /* LABWC_LAUNCHER_H */
@@ -18,6 +18,16 @@ struct lab_layer_surface {
 	/* true only inside handle_unmap() */
 	bool being_unmapped;
 
+	/* State the output was last arranged for, see handle_surface_commit() */
+	struct {
+		uint32_t anchor;
+		int32_t exclusive_zone;
+		uint32_t exclusive_edge;
+		uint32_t desired_width, desired_height;
+		int32_t margin_top, margin_right, margin_bottom, margin_left;
+		uint32_t layer;
+	} arranged;
+
 	struct wl_listener map;
 	struct wl_listener unmap;
 	struct wl_listener surface_commit;
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_LAYOUT_TRANSACTION_H
+#define LABWC_LAYOUT_TRANSACTION_H
+
+#include <stdbool.h>
+
+struct server;
+struct view;
+
+/*
+ * Layout transactions make re-arranging several views at once appear
+ * atomic. All configure requests sent between begin() and commit() are
+ * collected, and output commits are held back until every participating
+ * view has acked its configure (or its configure request timed out, see
+ * CONFIGURE_TIMEOUT_MS). The result is presented in a single frame.
+ * Clients known to be slow (see configure-stats.h) are not waited for.
+ *
+ * Transactions may be nested; only the outermost commit() counts.
+ */
+void layout_transaction_begin(struct server *server);
+void layout_transaction_commit(struct server *server);
+
+/* Called by the view implementations when a configure request is sent */
+void layout_transaction_add_view(struct view *view);
+
+/* Called when a view acks its configure, times out or is destroyed */
+void layout_transaction_view_done(struct view *view);
+
+/* Returns true while output commits should be held back */
+bool layout_transaction_blocks_output(void);
+
+#endif /* LABWC_LAYOUT_TRANSACTION_H */
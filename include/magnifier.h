@@ -2,12 +2,12 @@
 #ifndef LABWC_MAGNIFIER_H
 #define LABWC_MAGNIFIER_H
 
+#include <pixman.h>
 #include <stdbool.h>
 
 struct server;
 struct output;
 struct wlr_buffer;
-struct wlr_box;
 
 enum magnify_dir {
 	MAGNIFY_INCREASE,
@@ -16,9 +16,20 @@ enum magnify_dir {
 
 void magnifier_toggle(struct server *server);
 void magnifier_set_scale(struct server *server, enum magnify_dir dir);
-bool output_wants_magnification(struct output *output);
-void magnifier_draw(struct output *output, struct wlr_buffer *output_buffer,
-	struct wlr_box *damage);
+
+/*
+ * Called before deciding whether the output needs a new frame.
+ * Adds the regions which have to be re-rendered due to the magnifier
+ * being moved, changed or switched off to @damage. @pending_damage
+ * is the scene damage of the upcoming frame.
+ */
+void magnifier_prepare(struct output *output,
+	const pixman_region32_t *pending_damage, pixman_region32_t *damage);
+void magnifier_draw(struct output *output, struct wlr_buffer *output_buffer);
+void magnifier_handle_cursor_motion(struct server *server);
+void magnifier_output_destroyed(struct output *output);
+/* Drop the buffers held for @output, which has been powered off */
+void magnifier_output_released(struct output *output);
 bool magnifier_is_enabled(void);
 void magnifier_reset(void);
 
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_MEMORY_PRESSURE_H
+#define LABWC_MEMORY_PRESSURE_H
+
+struct server;
+
+/*
+ * Shrinking caches under memory pressure
+ *
+ * With <core><memoryPressureThreshold>, a PSI trigger on
+ * /proc/pressure/memory fires when tasks have been stalled on memory for
+ * more than that many milliseconds within one second. The compositor then
+ * frees what it can rebuild on demand: the hidden titlebars of the other
+ * active state, pooled decorations, cached buffers for other scales,
+ * closed menus, window switcher thumbnails and unused decoded images.
+ * The freed bytes are logged per buffer category.
+ */
+void memory_pressure_init(struct server *server);
+void memory_pressure_finish(void);
+
+/* Shrink the caches now */
+void memory_pressure_shrink(struct server *server);
+
+#endif /* LABWC_MEMORY_PRESSURE_H */
@@ -2,6 +2,7 @@
 #ifndef LABWC_MENU_H
 #define LABWC_MENU_H
 
+#include <stdint.h>
 #include <wayland-server.h>
 
 /* forward declare arguments */
@@ -11,6 +12,8 @@ struct wl_list;
 struct wlr_scene_tree;
 struct wlr_scene_node;
 struct scaled_font_buffer;
+struct lab_scene_rect;
+struct _xmlDoc;
 
 enum menuitem_type {
 	LAB_MENU_ITEM = 0,
@@ -27,7 +30,11 @@ struct menuitem {
 	struct menu *submenu;
 	bool selectable;
 	enum menuitem_type type;
-	int native_width;
+	int native_width; /* -1 until measured */
+	/* Position within the menu, whether or not the item has a scene */
+	int y;
+	int height;
+	/* NULL while scrolled out of view */
 	struct wlr_scene_tree *tree;
 	struct wlr_scene_tree *normal_tree;
 	struct wlr_scene_tree *selected_tree;
@@ -44,6 +51,18 @@ struct menu {
 	struct menu *parent;
 	struct menu_pipe_context *pipe_ctx;
 
+	/*
+	 * Parsed output of the pipemenu command. Without cache="" it is only
+	 * kept until the menu closes, so that prefetched output can be shown.
+	 */
+	struct {
+		uint32_t ttl_ms; /* 0 if caching is disabled */
+		struct _xmlDoc *doc;
+		uint64_t stored_ns;
+		/* Prefetch or refresh of a stale cache */
+		struct menu_pipe_context *background_ctx;
+	} cache;
+
 	struct {
 		int width;
 		int height;
@@ -54,8 +73,23 @@ struct menu {
 		struct menu *menu;
 		struct menuitem *item;
 	} selection;
+	/* Created when opened, freed after <menu><idleTimeout> */
 	struct wlr_scene_tree *scene_tree;
+	struct wlr_scene_tree *items_tree;
+	struct lab_scene_rect *bg_rect;
+	uint64_t closed_ns;
+
+	/*
+	 * Menus taller than the output are scrolled. Only items within the
+	 * visible part and a small margin around it get scene nodes.
+	 */
+	struct {
+		int content_height; /* height of all items including borders */
+		int offset;
+	} scroll;
 	bool is_pipemenu_child;
+	/* Internal menu to be synced with the windows or workspaces */
+	bool needs_update;
 	bool align_left;
 	bool has_icons;
 
@@ -64,6 +98,22 @@ struct menu {
 	struct wl_list link; /* server.menus */
 };
 
+typedef void (*menu_prompt_done_fn)(int exit_code, void *data);
+
+/*
+ * menu_open_prompt - ask a yes/no question with a menu in the middle of
+ * the output under the cursor, for <core><nativePrompt>
+ *
+ * @done is called with LAB_EXIT_SUCCESS for yes, LAB_EXIT_FAILURE for no
+ * or LAB_EXIT_CANCELLED if the menu is closed otherwise. Returns false if
+ * no menu can be opened at the moment.
+ */
+bool menu_open_prompt(struct server *server, const char *message,
+	menu_prompt_done_fn done, void *data);
+
+/* Close the prompt opened with @data without calling its done() */
+void menu_close_prompt(struct server *server, void *data);
+
 /* For keyboard support */
 void menu_item_select_next(struct server *server);
 void menu_item_select_previous(struct server *server);
@@ -72,9 +122,32 @@ void menu_submenu_leave(struct server *server);
 bool menu_call_selected_actions(struct server *server);
 
 void menu_init(struct server *server);
+
+/*
+ * menu_load() - read and parse the menu files in @paths, as returned by
+ * paths_config_create(), into @docs, a wl_array of xmlDoc pointers. It
+ * doesn't touch the menus, so it may run on a worker thread.
+ */
+void menu_load(struct wl_list *paths, struct wl_array *docs);
+
+/* Changes when menu.xml is modified */
+uint64_t menu_files_hash(void);
 void menu_finish(struct server *server);
+
+/* Free the scenes of all closed menus, as for <menu><idleTimeout> */
+void menu_free_closed_scenes(struct server *server);
 void menu_on_view_destroy(struct view *view);
 
+/*
+ * Update client-list-combined-menu the next time it is opened, after a
+ * view was (un)mapped, renamed, restacked, focused, (un)minimized or moved
+ * to another workspace.
+ */
+void menu_on_window_list_changed(struct server *server);
+
+/* Update the internal menus listing workspaces the next time they open */
+void menu_on_workspaces_changed(struct server *server);
+
 /**
  * menu_get_by_id - get menu by id
  *
@@ -100,6 +173,14 @@ void menu_open_root(struct menu *menu, int x, int y);
  */
 void menu_process_cursor_motion(struct wlr_scene_node *node);
 
+/**
+ * menu_process_cursor_axis - scroll the menu of an item
+ *
+ * @node: scene node of the item under the cursor
+ * @steps: number of items to scroll by, negative to scroll up
+ */
+void menu_process_cursor_axis(struct wlr_scene_node *node, int steps);
+
 /**
  *  menu_close_root- close root menu
  *
@@ -110,7 +191,10 @@ void menu_process_cursor_motion(struct wlr_scene_node *node);
  */
 void menu_close_root(struct server *server);
 
-/* menu_reconfigure - reload theme and content */
-void menu_reconfigure(struct server *server);
+/*
+ * menu_reconfigure - reload theme and content, taking the content from
+ * and releasing @docs from menu_load() unless NULL
+ */
+void menu_reconfigure(struct server *server, struct wl_array *docs);
 
 #endif /* LABWC_MENU_H */
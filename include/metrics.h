@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_METRICS_H
+#define LABWC_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct server;
+
+/*
+ * Registry of counters and gauges
+ *
+ * Subsystems register the fields of their existing statistics once, at
+ * init, so updating a metric is still just incrementing a field. Values
+ * are only read when the metrics are exported, with "metrics dump" on the
+ * IPC socket and, with <core><metricsInterval>, periodically to
+ * $XDG_RUNTIME_DIR/labwc.$WAYLAND_DISPLAY.metrics, both in the OpenMetrics
+ * text format.
+ *
+ * @name is the metric family without the labwc_ prefix and, for counters,
+ * without the _total suffix. @name and @help must be string literals or
+ * otherwise outlive the registration; @labels, such as output="DP-1", is
+ * copied and may be NULL. Metrics registered with an @owner are removed
+ * together by metrics_remove(), which must happen before the values they
+ * point to go away.
+ */
+enum metric_type {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+};
+
+void metrics_add_u64(const char *name, const char *labels, const char *help,
+	enum metric_type type, const uint64_t *value, const void *owner);
+void metrics_add_size(const char *name, const char *labels, const char *help,
+	enum metric_type type, const size_t *value, const void *owner);
+void metrics_add_int(const char *name, const char *labels, const char *help,
+	enum metric_type type, const int *value, const void *owner);
+/* For values that are computed when read */
+void metrics_add_fn(const char *name, const char *labels, const char *help,
+	enum metric_type type, uint64_t (*read)(void *data), void *data,
+	const void *owner);
+
+void metrics_remove(const void *owner);
+
+/* Write all metrics in the OpenMetrics text format */
+void metrics_print(FILE *stream);
+
+void metrics_init(struct server *server, const char *wayland_socket);
+/* Apply a changed <core><metricsInterval> */
+void metrics_reconfigure(void);
+void metrics_finish(void);
+
+#endif /* LABWC_METRICS_H */
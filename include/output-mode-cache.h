@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_OUTPUT_MODE_CACHE_H
+#define LABWC_OUTPUT_MODE_CACHE_H
+
+#include <stdbool.h>
+
+struct wlr_output;
+struct wlr_output_mode;
+
+/*
+ * Persistent cache of the mode that last passed the test of each output
+ *
+ * Entries are stored in $XDG_CACHE_HOME/labwc/modes/, keyed by the make,
+ * model and serial number of the monitor and the name of the connector.
+ * An entry also records the preferred mode of the monitor at that time,
+ * and is ignored once that changes.
+ */
+
+/*
+ * output_mode_cache_lookup() - get the mode of @wlr_output that passed
+ * the test last time, or NULL if there is no matching entry
+ */
+struct wlr_output_mode *output_mode_cache_lookup(struct wlr_output *wlr_output);
+
+/* Remember that @mode of @wlr_output passed the test */
+void output_mode_cache_store(struct wlr_output *wlr_output,
+	struct wlr_output_mode *mode);
+
+#endif /* LABWC_OUTPUT_MODE_CACHE_H */
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_OUTPUT_STATS_H
+#define LABWC_OUTPUT_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct output;
+struct server;
+struct wlr_output_event_present;
+struct wlr_output_state;
+
+/* Number of recent frames kept for the rolling latency histogram */
+#define OUTPUT_STATS_WINDOW 256
+
+/*
+ * Whether a committed frame was the buffer of a fullscreen client scanned
+ * out directly or, if not, what kept it from being so
+ */
+enum output_scanout {
+	OUTPUT_SCANOUT_NO_FULLSCREEN = 0,
+	OUTPUT_SCANOUT_DIRECT,
+	/* Composited while a fullscreen view was on top, because of */
+	OUTPUT_SCANOUT_BLOCKED_MAGNIFIER,
+	OUTPUT_SCANOUT_BLOCKED_SSD,
+	OUTPUT_SCANOUT_BLOCKED_OVERLAY,     /* OSD, menu or snap overlay */
+	OUTPUT_SCANOUT_BLOCKED_LAYER_SURFACE,
+	OUTPUT_SCANOUT_BLOCKED_LETTERBOX,   /* view smaller than the output */
+	/* Nothing covers the view, but its buffer was not usable */
+	OUTPUT_SCANOUT_BLOCKED_BUFFER,
+};
+
+/*
+ * How the cursor was shown in a committed frame. wlroots falls back to
+ * drawing it into the frame if the cursor plane can't be used, which
+ * damages the output on every pointer motion.
+ */
+enum output_cursor {
+	OUTPUT_CURSOR_NONE = 0,
+	OUTPUT_CURSOR_HARDWARE,
+	/* Drawn in software, because */
+	OUTPUT_CURSOR_SOFTWARE_LOCKED,      /* software cursors were forced */
+	OUTPUT_CURSOR_SOFTWARE_UNSUPPORTED, /* backend has no cursor plane */
+	OUTPUT_CURSOR_SOFTWARE_SIZE,        /* <hardwareCursorMaxSize> exceeded */
+	/* The plane refused the image, e.g. too large or wrong format */
+	OUTPUT_CURSOR_SOFTWARE_REJECTED,
+};
+
+struct output_frame_sample {
+	uint32_t commit_us;  /* wall time spent in the output commit */
+	uint32_t present_us; /* commit start to presentation, 0 if unknown */
+};
+
+struct output_stats {
+	uint64_t frames;          /* frame events handled */
+	uint64_t commits;         /* frames that resulted in an output commit */
+	uint64_t empty_damage;    /* frames skipped because nothing was damaged */
+	uint64_t commit_failures;
+	uint64_t missed_vblanks;
+
+	uint64_t commit_ns_total;
+	uint64_t commit_ns_max;
+
+	/* Time spent drawing the magnifier, part of the commit time */
+	uint64_t magnifier_passes;
+	uint64_t magnifier_ns_total;
+	uint64_t magnifier_ns_max;
+
+	/* Commits with a fullscreen view on top, and those scanned out */
+	uint64_t fullscreen_commits;
+	uint64_t scanout_commits;
+	enum output_scanout last_scanout;
+
+	/* Commits showing a cursor, by whether it used the cursor plane */
+	uint64_t hardware_cursor_commits;
+	uint64_t software_cursor_commits;
+	/* Switches from the cursor plane to a software cursor */
+	uint64_t software_cursor_fallbacks;
+	enum output_cursor last_cursor;
+
+	/* Changes of the tearing and adaptive sync state by policy */
+	uint64_t tearing_switches;
+	uint64_t adaptive_sync_switches;
+
+	/* Screen captures served by commits, see output_stats_count_captures() */
+	uint64_t capture_copies;
+	uint64_t capture_bytes;
+	/* Frame events with a capture waiting but nothing to render */
+	uint64_t capture_skipped;
+
+	/* Start of the most recent commit which has not been presented yet */
+	uint64_t pending_commit_start;
+	/* Index of the sample belonging to pending_commit_start */
+	uint32_t pending_sample;
+
+	/* Most recent presentation feedback, used to predict the next vblank */
+	uint64_t last_present_ns;
+	uint64_t refresh_ns;
+
+	struct output_frame_sample samples[OUTPUT_STATS_WINDOW];
+	uint32_t nr_samples;
+	uint32_t next_sample;
+};
+
+void output_stats_reset(struct output_stats *stats);
+
+/* Register the counters of @output, removed by metrics_remove(output) */
+void output_stats_add_metrics(struct output *output);
+
+/**
+ * output_stats_record_commit() - account for one handled frame event
+ * @output: output the frame was handled for
+ * @start_ns: CLOCK_MONOTONIC time before the commit was started
+ * @end_ns: CLOCK_MONOTONIC time after the commit returned
+ * @committed: whether a new buffer was committed to the output
+ * @failed: whether the commit was attempted but failed
+ */
+void output_stats_record_commit(struct output *output, uint64_t start_ns,
+	uint64_t end_ns, bool committed, bool failed);
+
+/* Account for one pass of magnifier_draw() taking @duration_ns */
+void output_stats_record_magnifier(struct output *output, uint64_t duration_ns);
+
+/* Account for the direct scanout status of one committed frame */
+void output_stats_record_scanout(struct output *output,
+	enum output_scanout scanout);
+
+/* Account for how the cursor was shown in one committed frame */
+void output_stats_record_cursor(struct output *output);
+
+/*
+ * Screencopy frames waiting on an output, and those which a commit with
+ * the given damage would serve
+ */
+struct output_captures {
+	uint32_t pending;
+	uint32_t copies;
+	uint64_t bytes;
+};
+
+/**
+ * output_stats_count_captures() - look at the screencopy frames waiting on
+ * @output before committing @state, which may be NULL to only count them.
+ * Frames copied with damage are only served if @state damages them.
+ */
+void output_stats_count_captures(struct output *output,
+	const struct wlr_output_state *state, struct output_captures *captures);
+
+/* Account for @captures served by a commit, or skipped if !@committed */
+void output_stats_record_captures(struct output *output,
+	const struct output_captures *captures, bool committed);
+
+void output_stats_record_present(struct output *output,
+	const struct wlr_output_event_present *event);
+
+/**
+ * output_stats_predict_commit_ns() - estimate how long the next commit
+ * will take, based on the slowest of the most recent @nr_frames commits.
+ * Returns 0 if no commits have been measured yet.
+ */
+uint64_t output_stats_predict_commit_ns(const struct output_stats *stats,
+	uint32_t nr_frames);
+
+/* Dump the statistics for all outputs in plain text */
+void output_stats_print(struct server *server, FILE *stream);
+
+#endif /* LABWC_OUTPUT_STATS_H */
@@ -4,9 +4,13 @@
 
 #include <wlr/types/wlr_output.h>
 #include "common/edge.h"
+#include "output-stats.h"
+#include "regions.h"
 
 #define LAB_NR_LAYERS (4)
 
+struct wlr_buffer;
+
 struct output {
 	struct wl_list link; /* server.outputs */
 	struct server *server;
@@ -22,17 +26,69 @@ struct output {
 	struct cycle_osd_scene {
 		struct wl_list items; /* struct cycle_osd_item */
 		struct wlr_scene_tree *tree;
+		/* Items of the last session, hidden, see cycle_osd_reuse_item() */
+		struct wl_list cached_items; /* struct cycle_osd_item */
+		struct wlr_scene_tree *cache_tree;
+		/*
+		 * Lists too long for the output only get items for the
+		 * nr_shown views from first_item, scrolled by row_length
+		 */
+		int first_item;
+		int nr_shown;
+		int row_length;
+		struct wlr_scene_rect *scrollbar;
 	} cycle_osd;
 
 	/* In output-relative scene coordinates */
 	struct wlr_box usable_area;
+	/* usable_area before subtracting X11 struts, see layers_arrange() */
+	struct wlr_box layers_usable_area;
+
+	/*
+	 * Edge snap boxes in layout coordinates without SSD margins, indexed
+	 * by the edges of each side, half and quarter. Only valid if valid is
+	 * set, generation is server->usable_area_generation and gap is rc.gap.
+	 */
+	struct {
+		struct wlr_box boxes[LAB_EDGES_ALL + 1];
+		uint64_t generation;
+		int gap;
+		bool valid;
+	} edge_snap;
 
 	struct wl_list regions;  /* struct region.link */
+	struct region_index region_index;
+
+	/*
+	 * Views at least partially visible on this output, topmost first,
+	 * see edges_calculate_visibility()
+	 */
+	struct wl_array visible_views; /* struct visible_view */
+	bool visibility_dirty;
 
 	struct wl_listener destroy;
 	struct wl_listener frame;
+	struct wl_listener present;
 	struct wl_listener request_state;
 
+	/* Frame time instrumentation, see output-stats.c */
+	struct output_stats stats;
+
+	/*
+	 * Defers rendering to shortly before the next vblank, or until a
+	 * virtual output may commit again, if enabled
+	 */
+	struct wl_event_source *render_delay_timer;
+	/* Start of the most recent commit of a new buffer */
+	uint64_t last_commit_nsec;
+
+	/* Composited on the primary GPU and copied to another one */
+	bool cross_gpu;
+
+	/* Frees the buffers of a powered off output, see output.c */
+	struct wl_event_source *release_timer;
+	bool released;
+
 	/*
 	 * Unique power-of-two ID used in bitsets such as view->outputs.
 	 * (This assumes there are never more than 64 outputs connected
@@ -46,10 +102,31 @@ struct output {
 	uint64_t id_bit;
 
 	bool gamma_lut_changed;
+	/* See output_add_gamma() */
+	uint64_t gamma_applied_nsec;
+	struct lab_timer *gamma_timer;
+
+	/* See output_set_has_fullscreen_view() */
+	bool has_fullscreen_view;
+	/*
+	 * Fullscreen views on this output, on any workspace and whether
+	 * minimized or not. Top layers of outputs without any are always
+	 * shown, see desktop_update_top_layer_visibility().
+	 */
+	int nr_fullscreen_views;
+	/* Adaptive sync was last set by a window rule */
+	bool adaptive_sync_by_rule;
+	/* Last output_get_tearing_allowance(), to count changes */
+	bool tearing_allowed;
 };
 
 #undef LAB_NR_LAYERS
 
+struct visible_view {
+	struct view *view;
+	enum lab_edge edges_visible;
+};
+
 void output_init(struct server *server);
 void output_finish(struct server *server);
 struct output *output_from_wlr_output(struct server *server,
@@ -75,12 +152,42 @@ struct output *output_get_adjacent(struct output *output,
 bool output_is_usable(struct output *output);
 void output_update_usable_area(struct output *output);
 void output_update_all_usable_areas(struct server *server, bool layout_changed);
+/*
+ * Re-apply X11 struts after they changed, keeping the layer-shell
+ * arrangement of all outputs
+ */
+void output_update_struts(struct server *server);
 bool output_get_tearing_allowance(struct output *output);
+
+/*
+ * Remove the gamma LUT from @state after a failed test, so that the frame
+ * can still be committed. The gamma control is only failed if the frame
+ * passes the test without the LUT.
+ */
+void output_drop_gamma(struct output *output, struct wlr_output_state *state);
 struct wlr_box output_usable_area_in_layout_coords(struct output *output);
+
+/*
+ * output_edge_snap_box() - the box a view snapped to @edge fills, without
+ * SSD margins, from boxes computed for all edges at once and kept until
+ * the usable areas, the layout or the gap change.
+ * output_update_edge_snap_boxes() recomputes them if they are outdated.
+ */
+struct wlr_box output_edge_snap_box(struct output *output, enum lab_edge edge);
+void output_update_edge_snap_boxes(struct output *output);
 void handle_output_power_manager_set_mode(struct wl_listener *listener,
 	void *data);
 void output_enable_adaptive_sync(struct output *output, bool enabled);
 
+/**
+ * Enables or disables adaptive sync on @output according to the
+ * adaptiveSync window rule of the focused view, or <core><adaptiveSync>
+ * if no rule applies. Call when the focus or fullscreen state changes.
+ *
+ * Does nothing if output is NULL or disabled.
+ */
+void output_update_adaptive_sync(struct output *output);
+
 /**
  * Notifies whether a fullscreen view is displayed on the given output.
  * Depending on user config, this may enable/disable adaptive sync.
@@ -90,4 +197,24 @@ void output_enable_adaptive_sync(struct output *output, bool enabled);
 void output_set_has_fullscreen_view(struct output *output,
 	bool has_fullscreen_view);
 
+/**
+ * output_get_scanout() - classify a frame committed to @output
+ * @buffer: the buffer of the committed state
+ *
+ * Returns whether the frame was a fullscreen client buffer scanned out
+ * directly, or the most likely reason why the scene composited it.
+ */
+enum output_scanout output_get_scanout(struct output *output,
+	struct wlr_buffer *buffer);
+
+/**
+ * output_hides_overlays() - whether compositor-owned overlays such as the
+ * workspace OSD are kept off @output, so that its focused fullscreen view
+ * can be scanned out. See <core><hideOverlaysOnFullscreen>.
+ */
+bool output_hides_overlays(struct output *output);
+
+/* Hide the overlays already shown where output_hides_overlays() applies */
+void output_update_overlays(struct server *server);
+
 #endif // LABWC_OUTPUT_H
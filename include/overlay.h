@@ -2,12 +2,22 @@
 #ifndef LABWC_OVERLAY_H
 #define LABWC_OVERLAY_H
 
+#include <wayland-server-core.h>
 #include "common/edge.h"
 
 struct seat;
 
+/* Kept hidden while not shown, to avoid rebuilding it on every snap target */
+struct overlay_rect {
+	struct lab_scene_rect *rect;
+	struct overlay *overlay;
+	struct wl_listener destroy;
+};
+
 struct overlay {
+	/* The rect currently shown, or NULL */
 	struct lab_scene_rect *rect;
+	struct overlay_rect region_rect, edge_rect;
 
 	/* Represents currently shown or delayed overlay */
 	struct {
@@ -29,7 +39,10 @@ struct overlay {
  */
 void overlay_update(struct seat *seat);
 
-/* Destroys the overlay if it exists */
+/* Hides the overlay if it is shown */
 void overlay_finish(struct seat *seat);
 
+/* Destroys the overlay rects, e.g. because the theme changed */
+void overlay_reset(struct seat *seat);
+
 #endif
@@ -13,6 +13,8 @@ struct lab_cosmic_workspace_manager {
 	uint32_t caps;
 	struct wl_event_source *idle_source;
 	struct wl_event_loop *event_loop;
+	/* Events other than workspace states were sent since the last done */
+	bool dirty;
 
 	struct {
 		struct wl_listener display_destroy;
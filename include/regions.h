@@ -18,6 +18,8 @@ struct region {
 	struct output *output;
 	char *name;
 	struct wlr_box geo;
+	/* geo adjusted for rc.gap, see view_get_region_snap_box() */
+	struct wlr_box snap_box;
 	struct wlr_box percentage;
 	struct {
 		int x;
@@ -25,6 +27,25 @@ struct region {
 	} center;
 };
 
+/*
+ * Grid of all region edges of an output, so that the regions under a
+ * point are found by two binary searches. Each cell of the grid is either
+ * completely covered by a region or not at all.
+ */
+struct region_index {
+	int nr_cols;
+	int nr_rows;
+	int *cols;
+	int *rows;
+	/*
+	 * The regions covering cell (i, j) are
+	 * candidates[starts[n]] to candidates[starts[n + 1] - 1]
+	 * with n = i * (nr_cols - 1) + j
+	 */
+	int *starts;
+	struct region **candidates;
+};
+
 /* Returns true if we should show the region overlay or snap to region */
 bool regions_should_snap(struct server *server);
 
@@ -39,9 +60,12 @@ bool regions_should_snap(struct server *server);
 void regions_reconfigure(struct server *server);
 void regions_reconfigure_output(struct output *output);
 
-/* re-calculate the geometry based on usable area */
+/* re-calculate the geometry and the region index based on usable area */
 void regions_update_geometry(struct output *output);
 
+/* Free the region index of @output */
+void regions_index_finish(struct output *output);
+
 /**
  * Mark all views which are currently region-tiled to the given output as
  * evacuated. This means that the view->tiled_region pointer is reset to
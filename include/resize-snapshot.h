@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_RESIZE_SNAPSHOT_H
+#define LABWC_RESIZE_SNAPSHOT_H
+
+struct view;
+
+/*
+ * Stretched snapshots for <resize><snapshot>
+ *
+ * While an xdg-shell view has not yet committed a buffer for the size of
+ * its latest configure request, its surfaces are hidden and a copy of the
+ * last committed buffers is shown instead, scaled to the requested
+ * geometry. The snapshot is discarded once the client catches up or its
+ * configure request times out. Server side decorations keep following
+ * the committed geometry.
+ */
+
+/* (Re-)create the snapshot of @view for its pending geometry */
+void resize_snapshot_update(struct view *view);
+
+/* Discard the snapshot of @view, if any, and show its surfaces again */
+void resize_snapshot_finish(struct view *view);
+
+#endif /* LABWC_RESIZE_SNAPSHOT_H */
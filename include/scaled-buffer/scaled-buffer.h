@@ -2,9 +2,10 @@
 #ifndef LABWC_SCALED_BUFFER_H
 #define LABWC_SCALED_BUFFER_H
 
+#include <stdint.h>
+#include <stdio.h>
 #include <wayland-server-core.h>
-
-#define LAB_SCALED_BUFFER_MAX_CACHE 2
+#include "buffer.h"
 
 struct wlr_buffer;
 struct wlr_scene_tree;
@@ -20,6 +21,12 @@ struct scaled_buffer_impl {
 	/* Returns true if the two buffers are visually the same */
 	bool (*equal)(struct scaled_buffer *scaled_buffer_a,
 		struct scaled_buffer *scaled_buffer_b);
+	/*
+	 * Might be NULL. Returns a hash of everything equal() compares, so
+	 * that buffers to share can be looked up without comparing against
+	 * all other scaled_buffers.
+	 */
+	uint64_t (*hash)(struct scaled_buffer *scaled_buffer);
 };
 
 struct scaled_buffer {
@@ -27,9 +34,13 @@ struct scaled_buffer {
 	int width;   /* unscaled, read only */
 	int height;  /* unscaled, read only */
 	void *data;  /* opaque user data */
+	/* Memory accounting of the rendered buffers, may be set by the user */
+	enum buffer_category category;
 
 	/* Private */
 	bool drop_buffer;
+	bool pending; /* set by scaled_buffer_mark_pending() */
+	int crop_width; /* set by scaled_buffer_set_crop_width(), or 0 */
 	double active_scale;
 	/* cached wlr_buffers for each scale */
 	struct wl_list cache;  /* struct scaled_buffer_cache_entry.link */
@@ -37,6 +48,7 @@ struct scaled_buffer {
 	struct wl_listener outputs_update;
 	const struct scaled_buffer_impl *impl;
 	struct wl_list link; /* all_scaled_buffers */
+	struct wl_list prerender_link; /* queued for other scales, may be empty */
 };
 
 /*
@@ -48,7 +60,7 @@ struct scaled_buffer {
  *    .-----------------------------|----------------|-----------.
  *    |                             v                |           |
  *    |  .---------------.    .-------------------------.        |
- *    |  | scaled_buffer |----| wlr_buffer LRU cache(2) |<---,   |
+ *    |  | scaled_buffer |----| wlr_buffer global LRU   |<---,   |
  *    |  ´---------------`    ´-------------------------`    |   |
  *    |           |                       |                  |   |
  *    |        .------.       .--------------------------.   |   |
@@ -74,9 +86,10 @@ struct scaled_buffer {
  * implementation->create_buffer(self, scale) to get a new lab_data_buffer
  * optimized for the new scale.
  *
- * Up to LAB_SCALED_BUFFER_MAX_CACHE (2) buffers are cached in an LRU fashion
- * to handle the majority of use cases where a view is moved between no more
- * than two different scales.
+ * One buffer per scale is cached. The cache entries of all scaled_buffers
+ * share one LRU list, and the least recently used ones are evicted while
+ * the buffers rendered for them exceed <core><bufferCacheSize>. Buffers
+ * that are currently shown are never evicted.
  *
  * scaled_buffer will clean up automatically once the internal
  * wlr_scene_buffer is being destroyed. If implementation->destroy is set
@@ -86,12 +99,14 @@ struct scaled_buffer {
  * Besides caching buffers for each scale per scaled_buffer, we also
  * store all the scaled_buffers from all the implementers in a list
  * in order to reuse backing buffers for visually duplicated
- * scaled_buffers found via impl->equal().
+ * scaled_buffers found via impl->equal(). If impl->hash() is set, the
+ * cached buffers are additionally indexed by (impl, hash, scale) in a
+ * hash table, so only scaled_buffers with the same hash are compared.
  *
  * All requested lab_data_buffers via impl->create_buffer() will be locked
  * during the lifetime of the buffer in the internal cache and unlocked
- * when being evacuated from the cache (due to LAB_SCALED_BUFFER_MAX_CACHE
- * or the internal wlr_scene_buffer being destroyed).
+ * when being evacuated from the cache (due to the cache budget or the
+ * internal wlr_scene_buffer being destroyed).
  *
  * If drop_buffer was set during creation of the scaled_buffer, the
  * backing wlr_buffer behind a lab_data_buffer will also get dropped
@@ -128,19 +143,93 @@ struct scaled_buffer *scaled_buffer_create(
 void scaled_buffer_request_update(struct scaled_buffer *self,
 	int width, int height);
 
+/**
+ * scaled_buffer_mark_pending - render asynchronously
+ *
+ * May be called by impl->create_buffer(), which must then return NULL and
+ * later pass the buffer for the requested scale to
+ * scaled_buffer_set_pending_buffer(). Until then, the previously shown
+ * buffer (if any) stays visible and nothing is shared with other
+ * scaled_buffers.
+ */
+void scaled_buffer_mark_pending(struct scaled_buffer *self);
+
+/**
+ * scaled_buffer_set_pending_buffer - complete scaled_buffer_mark_pending()
+ * @buffer: the rendered buffer or NULL on error
+ *
+ * Takes ownership of @buffer. It is dropped if @self has been updated with
+ * scaled_buffer_request_update() in the meantime or no longer needs a
+ * buffer for @scale.
+ */
+void scaled_buffer_set_pending_buffer(struct scaled_buffer *self,
+	double scale, struct lab_data_buffer *buffer);
+
+/**
+ * scaled_buffer_set_crop_width - show only part of the buffer
+ * @width: the width to show from the left edge, in scene coordinates,
+ * or 0 to show all of it
+ *
+ * This crops the rendered buffers via the source box of the scene buffer
+ * instead of rendering new ones. It is reset by
+ * scaled_buffer_request_update().
+ */
+void scaled_buffer_set_crop_width(struct scaled_buffer *self, int width);
+
 /**
  * scaled_buffer_invalidate_sharing - clear the list of entire cached
- * scaled_buffers used to share visually dupliated buffers. This should
+ * scaled_buffers used to share visually dupliated buffers, including the
+ * hash table of buffers from impls with hash(). This should
  * be called on Reconfigure to force updates of newly created
  * scaled_buffers rather than reusing ones created before Reconfigure.
  */
 void scaled_buffer_invalidate_sharing(void);
 
+/*
+ * scaled_buffer_cache_shrink - evict all cached buffers which are not
+ * shown, such as those rendered for the scale of another output, as if
+ * the budget was zero
+ */
+void scaled_buffer_cache_shrink(void);
+
+/*
+ * scaled_buffer_set_output_scales - set the scales of all enabled outputs
+ *
+ * With <core><prerenderScales>, every shown scaled_buffer also renders
+ * buffers for the other scales in the background, a few per event loop
+ * wakeup, so that moving it to an output with another scale doesn't have
+ * to render anything in that frame. Pre-rendered buffers are the first
+ * to be evicted and are only rendered while the cache is below its budget.
+ */
+void scaled_buffer_set_output_scales(const double *scales, int nr_scales);
+
+/* Stop pre-rendering, once all scaled_buffers have been destroyed */
+void scaled_buffer_finish(void);
+
+struct scaled_buffer_stats {
+	size_t bytes;       /* resident in buffers rendered for the cache */
+	uint64_t hits;      /* buffers reused from the cache */
+	uint64_t misses;    /* buffers rendered via impl->create_buffer() */
+	uint64_t evictions; /* entries evicted to stay within the budget */
+	uint64_t prerendered; /* buffers rendered for scales not shown yet */
+};
+
+void scaled_buffer_stats_reset(void);
+/* Register the cache statistics, see metrics.h */
+void scaled_buffer_add_metrics(void);
+void scaled_buffer_stats_print(FILE *stream);
+
 /* Private */
 struct scaled_buffer_cache_entry {
 	struct wl_list link;   /* struct scaled_buffer.cache */
 	struct wlr_buffer *buffer;
 	double scale;
+	struct scaled_buffer *owner;
+	uint64_t hash;          /* impl->hash() of owner when created */
+	struct wl_list shared_link; /* hash table bucket, may be empty */
+	struct wl_list lru_link; /* global LRU list */
+	size_t bytes;           /* 0 if the buffer is shared from another */
+	bool pending;           /* waiting for scaled_buffer_set_pending_buffer() */
 };
 
 #endif /* LABWC_SCALED_BUFFER_H */
@@ -4,6 +4,8 @@
 
 #include "common/font.h"
 
+#include <stdint.h>
+
 struct wlr_scene_tree;
 struct wlr_scene_buffer;
 struct scaled_buffer;
@@ -15,6 +17,8 @@ struct scaled_font_buffer {
 
 	/* Private */
 	char *text;
+	int text_height;
+	uint64_t generation; /* incremented on each update */
 	int max_width;
 	float color[4];
 	float bg_color[4];
@@ -32,6 +36,14 @@ struct scaled_font_buffer {
 	cairo_pattern_t *bg_pattern; /* overrides bg_color if set */
 };
 
+/**
+ * With <core><asyncTextRendering>, text is rendered on the worker threads
+ * of worker-pool.h. While a text is rendered, the previous one stays
+ * visible. scaled_font_buffer_finish() cancels the running jobs and must
+ * be called before worker_pool_finish().
+ */
+void scaled_font_buffer_finish(void);
+
 /**
  * Create an auto scaling font buffer, providing a wlr_scene_buffer node for
  * display. It gets destroyed automatically when the backing scaled_buffer
@@ -73,4 +85,10 @@ void scaled_font_buffer_update(struct scaled_font_buffer *self, const char *text
 	int max_width, struct font *font, const float *color,
 	const float *bg_color);
 
+/**
+ * Show only the left @width of the rendered text (or all of it if @width
+ * is 0) without rendering it again, until the next update.
+ */
+void scaled_font_buffer_crop(struct scaled_font_buffer *self, int width);
+
 #endif /* LABWC_SCALED_FONT_BUFFER_H */
@@ -3,6 +3,7 @@
 #define LABWC_SCALED_ICON_BUFFER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
 struct wlr_scene_tree;
@@ -30,6 +31,11 @@ struct scaled_icon_buffer {
 
 	int width;
 	int height;
+
+	/* Icon database the buffer was last rendered from */
+	unsigned int generation;
+	uint64_t updates; /* incremented on each update */
+	struct wl_list link; /* all_icon_buffers */
 };
 
 /*
@@ -48,4 +54,18 @@ void scaled_icon_buffer_set_view(struct scaled_icon_buffer *self,
 void scaled_icon_buffer_set_icon_name(struct scaled_icon_buffer *self,
 	const char *icon_name);
 
+/*
+ * Re-render all icon buffers, for example when the icon theme has been
+ * loaded in the background
+ */
+void scaled_icon_buffer_reload_all(void);
+
+/*
+ * With <core><asyncIconLoading>, icon files are resolved on the main
+ * thread and loaded and rendered by the worker pool, leaving the icon
+ * blank until then. scaled_icon_buffer_finish() cancels the running jobs
+ * and must be called before worker_pool_finish().
+ */
+void scaled_icon_buffer_finish(void);
+
 #endif /* LABWC_SCALED_ICON_BUFFER_H */
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_SCENE_INDEX_H
+#define LABWC_SCENE_INDEX_H
+
+#include <stdbool.h>
+#include <wayland-server-core.h>
+#include <wlr/util/box.h>
+
+struct server;
+struct wlr_scene_node;
+
+/*
+ * Spatial index of the top-level nodes (i.e. views) in the view trees,
+ * used to avoid traversing every scene node of every window on each
+ * pointer motion event.
+ *
+ * For each top-level node, the bounding box of all its enabled
+ * descendants is cached and the boxes are sorted into a uniform grid.
+ * A hit-test then only descends into the few nodes whose bounding box
+ * contains the cursor, in stacking order. The bounding box includes the
+ * invisible resize area of the decoration, which is hit-tested without
+ * scene nodes by ssd_extents_node_at(). All other scene trees (layer
+ * surfaces, popups, menus, OSDs...) still use wlr_scene_node_at().
+ *
+ * Restacking, moving, reparenting and (un)mapping of top-level nodes is
+ * detected automatically when the index is used. Changes of content
+ * size (surface commits, SSD updates) must be reported by calling
+ * scene_index_invalidate().
+ */
+struct scene_index {
+	bool dirty;
+	/* Bumped whenever the index is invalidated */
+	uint64_t generation;
+	struct wl_array entries; /* struct scene_index_entry, top to bottom */
+
+	/* Grid covering the union of all entries, in layout coordinates */
+	struct wlr_box extent;
+	int cell_size;
+	int cols, rows;
+	struct wl_array *cells; /* uint32_t entry indices, top to bottom */
+};
+
+void scene_index_init(struct server *server);
+void scene_index_finish(struct server *server);
+
+/* Mark the index for rebuild on the next lookup */
+void scene_index_invalidate(struct server *server);
+
+/**
+ * scene_index_get_generation() - get a counter which changes whenever
+ * the view trees change in a way that may affect hit-testing
+ */
+uint64_t scene_index_get_generation(struct server *server);
+
+/**
+ * scene_index_node_exposed_at() - check that no scene tree outside of
+ * the view trees blocks @node at @lx,@ly
+ *
+ * @node must be a descendant of one of the view trees. Whether other
+ * views are on top of @node must be checked by comparing generations.
+ */
+bool scene_index_node_exposed_at(struct server *server,
+	struct wlr_scene_node *node, double lx, double ly);
+
+/**
+ * scene_index_node_at() - equivalent of wlr_scene_node_at() on the root
+ * of the scene, except that drag icons are ignored
+ * @lx, @ly: layout coordinates
+ * @sx, @sy: set to node coordinates of the returned node
+ */
+struct wlr_scene_node *scene_index_node_at(struct server *server,
+	double lx, double ly, double *sx, double *sy);
+
+#endif /* LABWC_SCENE_INDEX_H */
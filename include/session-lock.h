@@ -2,6 +2,7 @@
 #ifndef LABWC_SESSION_LOCK_H
 #define LABWC_SESSION_LOCK_H
 
+#include <stdint.h>
 #include <wayland-server-core.h>
 
 struct output;
@@ -20,6 +21,8 @@ struct session_lock_manager {
 	 */
 	struct wlr_session_lock_v1 *lock;
 	bool locked;
+	/* When the current lock started, until all outputs are blanked */
+	uint64_t lock_start_nsec;
 
 	struct wl_list lock_outputs;
 
@@ -7,9 +7,23 @@
 #include "theme.h"
 #include "view.h"
 
+/* Parts of a decoration to update, see ssd_update_geometry() */
+enum ssd_dirty {
+	/* The size changed; this also covers the title and visible buttons */
+	SSD_DIRTY_GEOMETRY = 1 << 0,
+	/* Corners are (un)rounded on (un)maximize or (un)tiling */
+	SSD_DIRTY_CORNERS = 1 << 1,
+	/* Toggled icons of the maximize, shade and omnipresent buttons */
+	SSD_DIRTY_BUTTON_STATE = 1 << 2,
+
+	SSD_DIRTY_ALL = (1 << 3) - 1,
+};
+
 struct ssd_state_title_width {
 	int width;
 	bool truncated;
+	/* Rendered untruncated during an interactive resize, and cropped */
+	bool cropped;
 };
 
 /*
@@ -47,13 +61,12 @@ struct ssd_state_title_width {
  * |  +--active
  * |     +--top
  * |     +--...
- * +--extents
- *    +--top
- *    +--...
  */
 struct ssd {
 	struct view *view;
 	struct wlr_scene_tree *tree;
+	/* Theme generation this was built from, see ssd_pool_flush() */
+	unsigned int generation;
 
 	/*
 	 * Cache for current values.
@@ -88,12 +101,6 @@ struct ssd {
 		} title;
 	} state;
 
-	/* An invisible area around the view which allows resizing */
-	struct ssd_extents_scene {
-		struct wlr_scene_tree *tree;
-		struct wlr_scene_rect *top, *bottom, *left, *right;
-	} extents;
-
 	/* The top of the view, containing buttons, title, .. */
 	struct ssd_titlebar_scene {
 		int height;
@@ -107,6 +114,12 @@ struct ssd {
 			struct wl_list buttons_left; /* ssd_button.link */
 			struct wl_list buttons_right; /* ssd_button.link */
 		} subtrees[2]; /* indexed by enum ssd_active_state */
+		/*
+		 * The subtree of the other state is created on demand and
+		 * released by this timer once it has been hidden for a while,
+		 * so its tree can be NULL.
+		 */
+		struct wl_event_source *release_timer;
 	} titlebar;
 
 	/* Borders allow resizing as well */
@@ -169,20 +182,19 @@ struct ssd_button *attach_ssd_button(struct wl_list *button_parts,
 	struct view *view);
 
 /* SSD internal */
-void ssd_titlebar_create(struct ssd *ssd);
-void ssd_titlebar_update(struct ssd *ssd);
+void ssd_titlebar_create(struct ssd *ssd, bool active);
+void ssd_titlebar_set_active(struct ssd *ssd, bool active);
+void ssd_titlebar_update(struct ssd *ssd, enum ssd_dirty dirty);
 void ssd_titlebar_destroy(struct ssd *ssd);
+void ssd_titlebar_release_hidden(struct ssd *ssd);
 bool ssd_should_be_squared(struct ssd *ssd);
 
 void ssd_border_create(struct ssd *ssd);
 void ssd_border_update(struct ssd *ssd);
 void ssd_border_destroy(struct ssd *ssd);
 
-void ssd_extents_create(struct ssd *ssd);
-void ssd_extents_update(struct ssd *ssd);
-void ssd_extents_destroy(struct ssd *ssd);
-
-void ssd_shadow_create(struct ssd *ssd);
+void ssd_shadow_create(struct ssd *ssd, bool active);
+void ssd_shadow_set_active(struct ssd *ssd, bool active);
 void ssd_shadow_update(struct ssd *ssd);
 void ssd_shadow_destroy(struct ssd *ssd);
 
@@ -26,6 +26,7 @@ struct server;
 struct ssd;
 struct ssd_button;
 struct view;
+struct wlr_box;
 struct wlr_scene;
 struct wlr_scene_node;
 
@@ -46,6 +47,17 @@ void ssd_set_active(struct ssd *ssd, bool active);
 void ssd_update_title(struct ssd *ssd);
 void ssd_update_geometry(struct ssd *ssd);
 void ssd_destroy(struct ssd *ssd);
+
+/*
+ * Destroyed decorations are pooled for reuse by the next ssd_create().
+ * ssd_pool_flush() drops them and must be called whenever the theme
+ * changes; ssd_pool_finish() also frees the pool itself on shutdown.
+ */
+void ssd_pool_flush(void);
+void ssd_pool_finish(void);
+
+/* Free the hidden titlebar of the other active state, if any */
+void ssd_release_hidden(struct ssd *ssd);
 void ssd_set_titlebar(struct ssd *ssd, bool enabled);
 
 void ssd_enable_keybind_inhibit_indicator(struct ssd *ssd, bool enable);
@@ -66,12 +78,26 @@ enum lab_node_type ssd_get_resizing_type(const struct ssd *ssd,
 	struct wlr_cursor *cursor);
 enum lab_ssd_mode ssd_mode_parse(const char *mode);
 
+/*
+ * Get the outline of the invisible resize area around the borders, in
+ * layout coordinates. Returns false if there is none.
+ */
+bool ssd_get_extents_box(const struct ssd *ssd, struct wlr_box *box);
+
+/*
+ * Returns the root node of the decoration if @lx,@ly is in its invisible
+ * resize area, with @sx,@sy set relative to it, or NULL otherwise
+ */
+struct wlr_scene_node *ssd_extents_node_at(const struct ssd *ssd,
+	double lx, double ly, double *sx, double *sy);
+
 /* TODO: clean up / update */
 struct border ssd_thickness(struct view *view);
 struct wlr_box ssd_max_extents(struct view *view);
 
 /* SSD debug helpers */
 bool ssd_debug_is_root_node(const struct ssd *ssd, struct wlr_scene_node *node);
+bool ssd_debug_is_shadow_node(const struct ssd *ssd, struct wlr_scene_node *node);
 const char *ssd_debug_get_node_name(const struct ssd *ssd,
 	struct wlr_scene_node *node);
 
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_STARTUP_PROFILE_H
+#define LABWC_STARTUP_PROFILE_H
+
+/*
+ * Startup phase profiler
+ *
+ * Phases between startup_profile_begin() and startup_profile_end() get
+ * CLOCK_MONOTONIC timestamps. Phases may nest, for example the renderer
+ * creation within server_init(). startup_profile_finish() logs the
+ * durations on one line and, if LABWC_STARTUP_TRACE names a file, writes
+ * them there in the Chrome trace event format, which can be viewed with
+ * about:tracing or https://ui.perfetto.dev.
+ *
+ * @name must be a string literal or otherwise outlive the profile.
+ */
+void startup_profile_begin(const char *name);
+void startup_profile_end(void);
+
+/* Call once startup is complete; later phases are ignored */
+void startup_profile_finish(void);
+
+#endif /* LABWC_STARTUP_PROFILE_H */
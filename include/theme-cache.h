@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_THEME_CACHE_H
+#define LABWC_THEME_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/hash.h"
+
+struct lab_data_buffer;
+
+/*
+ * Persistent cache of pre-rendered theme buffers
+ *
+ * Window corners, titlebar fills and drop-shadows only depend on a few
+ * theme and rc settings, so their ARGB8888 pixels are stored in
+ * $XDG_CACHE_HOME/labwc/theme/<name> together with a hash of everything
+ * they were rendered from. On startup and reconfigure, buffers with a
+ * matching key are memory-mapped and copied instead of being rendered.
+ *
+ * The most recent buffer of each name is also kept in memory, where it
+ * survives theme_finish(). A reconfigure that doesn't change a buffer then
+ * reuses it without reading the file.
+ *
+ * Bump THEME_CACHE_VERSION whenever the rendering of any cached buffer
+ * changes.
+ */
+#define THEME_CACHE_VERSION 1
+#define THEME_CACHE_KEY_INIT HASH_INIT
+
+/* Mix @size bytes at @data into @key */
+uint64_t theme_cache_key_add(uint64_t key, const void *data, size_t size);
+
+/*
+ * theme_cache_load() - get the buffer stored as @name, locked for the
+ * caller, who must neither modify nor drop it but call wlr_buffer_unlock()
+ * Returns NULL if there is none or if it was rendered for another @key.
+ */
+struct lab_data_buffer *theme_cache_load(const char *name, uint64_t key);
+
+/*
+ * Store @buffer, which must have a scale of 1 to be written to disk, as
+ * @name. The cache takes over the reference of the caller, which is left
+ * with a lock as if @buffer had been returned by theme_cache_load().
+ */
+void theme_cache_store(const char *name, uint64_t key,
+	struct lab_data_buffer *buffer);
+
+/* Drop the buffers kept in memory */
+void theme_cache_finish(void);
+
+#endif /* LABWC_THEME_CACHE_H */
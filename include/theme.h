@@ -10,6 +10,7 @@
 
 #include <cairo.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "common/node-type.h"
 
 struct lab_img;
@@ -210,6 +211,9 @@ struct theme {
 	/* magnifier */
 	float mag_border_color[4];
 	int mag_border_width;
+
+	/* See theme_files_hash() */
+	uint64_t files_hash;
 };
 
 struct server;
@@ -223,6 +227,12 @@ struct server;
  */
 void theme_init(struct theme *theme, struct server *server, const char *theme_name);
 
+/**
+ * theme_files_hash - hash of the files read by theme_init()
+ * Changes when themerc, themerc-override or a button image is modified.
+ */
+uint64_t theme_files_hash(const char *theme_name);
+
 /**
  * theme_finish - free button textures
  * @theme: theme data
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_TILING_H
+#define LABWC_TILING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-util.h>
+#include <wlr/util/box.h>
+#include "config/types.h"
+
+struct output;
+struct server;
+struct view;
+struct workspace;
+
+/*
+ * Tree based tiling layouts
+ *
+ * The master-stack and BSP layouts keep one persistent binary tree per
+ * workspace and output. Leaves hold views, inner nodes split their box
+ * between two children by a ratio. On every arrangement the trees are
+ * reconciled with the set of tiling candidates, so that mapping or
+ * unmapping a view only inserts or removes a single leaf, and only views
+ * whose box actually changed get configured.
+ *
+ * The grid layout is stateless and implemented by desktop_arrange_tiled().
+ */
+
+enum tiling_split {
+	TILING_SPLIT_HORIZONTAL, /* children side by side */
+	TILING_SPLIT_VERTICAL,   /* children on top of each other */
+};
+
+struct tiling_tree;
+
+struct tiling_node {
+	struct tiling_tree *tree;
+	struct tiling_node *parent;
+
+	/* Leaf */
+	struct view *view;
+	uint64_t seen; /* last arrangement the view was a tiling candidate */
+
+	/* Inner node */
+	struct tiling_node *children[2];
+	enum tiling_split split;
+	double ratio; /* share of children[0] */
+
+	/* Layout coordinates from the last arrangement */
+	struct wlr_box box;
+};
+
+struct tiling_tree {
+	struct workspace *workspace;
+	struct output *output;
+	struct tiling_node *root;
+	struct wl_list link; /* struct server.tiling_trees */
+};
+
+struct tiling_layout_impl {
+	const char *name;
+	/*
+	 * Insert @leaf into @tree. @focus is the leaf of the active view if
+	 * it is part of @tree, or NULL.
+	 */
+	void (*insert)(struct tiling_tree *tree, struct tiling_node *leaf,
+		struct tiling_node *focus);
+	/* Unlink and free @leaf */
+	void (*remove)(struct tiling_tree *tree, struct tiling_node *leaf);
+};
+
+enum lab_tiling_layout tiling_layout_parse(const char *name);
+const char *tiling_layout_name(enum lab_tiling_layout layout);
+
+/* Current tiling mode: stacking, grid, smart or the name of a tree layout */
+const char *tiling_status(struct server *server);
+
+/* Whether @view takes part in tiling, according to its state and window rules */
+bool view_is_tiling_candidate(struct view *view);
+
+/* Arrange the current workspace with a tree based layout */
+void tiling_arrange(struct server *server);
+
+/* Switch layouts, discarding all trees */
+void tiling_set_layout(struct server *server, enum lab_tiling_layout layout);
+
+/*
+ * Adopt the geometry of an interactively resized view by adjusting the
+ * ratios of the splits it borders.
+ */
+void tiling_view_resized(struct view *view);
+
+void tiling_view_destroyed(struct view *view);
+void tiling_output_destroyed(struct output *output);
+void tiling_workspace_destroyed(struct workspace *workspace);
+void tiling_finish(struct server *server);
+
+#endif /* LABWC_TILING_H */
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_TIMER_H
+#define LABWC_TIMER_H
+
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct lab_timer;
+
+/*
+ * Timers sharing a single event loop timer
+ *
+ * Each timer may fire up to @slack_ms later than requested. The shared
+ * timer is armed for the earliest time by which one of the timers must
+ * have fired, and then fires every timer that is due, so that timers with
+ * slack are batched onto the wakeups of others instead of waking the CPU
+ * on their own. Timeouts for clients and helpers and delays for on-screen
+ * displays can take a good amount of slack, whereas key repeat should
+ * take none.
+ *
+ * @func is called like a wl_event_loop timer callback and may update or
+ * destroy any timer, including its own.
+ */
+void lab_timers_init(struct wl_event_loop *loop);
+void lab_timers_finish(void);
+
+struct lab_timer *lab_timer_create(wl_event_loop_timer_func_t func,
+	void *data, int slack_ms);
+void lab_timer_destroy(struct lab_timer *timer);
+
+/* Fire in @ms milliseconds, or disarm if @ms is 0 */
+void lab_timer_update(struct lab_timer *timer, int ms);
+
+/* Wakeups and fired timers, in total and per second */
+void lab_timer_stats_print(FILE *stream);
+void lab_timer_stats_reset(void);
+
+#endif /* LABWC_TIMER_H */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_TRACE_H
+#define LABWC_TRACE_H
+
+#include <stdbool.h>
+
+/*
+ * Tracing of spans in hot paths
+ *
+ * trace_begin() and trace_end() mark the start and end of a span, which
+ * must nest properly. While tracing is off, each costs one predictable
+ * branch, so they can stay in the hottest paths.
+ *
+ * In TRACE_MARKER mode, spans go to the ftrace trace_marker file in the
+ * "B|<pid>|<name>" and "E|<pid>" format which Perfetto and systrace
+ * understand. In TRACE_RING mode, the most recent TRACE_RING_SIZE events
+ * are kept in memory and written out on trace_dump() in the Chrome trace
+ * event format, which can be viewed with https://ui.perfetto.dev.
+ *
+ * @name must be a string literal or otherwise outlive the trace.
+ */
+#define TRACE_RING_SIZE (64 * 1024)
+
+enum trace_mode {
+	TRACE_OFF = 0,
+	TRACE_MARKER,
+	TRACE_RING,
+};
+
+extern enum trace_mode trace_mode;
+
+void trace_record(const char *name, bool begin);
+
+static inline void
+trace_begin(const char *name)
+{
+	if (trace_mode) {
+		trace_record(name, true);
+	}
+}
+
+static inline void
+trace_end(const char *name)
+{
+	if (trace_mode) {
+		trace_record(name, false);
+	}
+}
+
+/* Parse "off", "marker" or "ring" and switch to it, false on failure */
+bool trace_set_mode(const char *mode);
+
+/* Write the ring buffer to @path, or a default path in XDG_RUNTIME_DIR */
+bool trace_dump(const char *path);
+
+void trace_finish(void);
+
+#endif /* LABWC_TRACE_H */
@@ -9,7 +9,9 @@
 #include <xkbcommon/xkbcommon.h>
 #include "common/edge.h"
 #include "config.h"
+#include "common/match.h"
 #include "config/types.h"
+#include "window-rules.h"
 
 /*
  * Default minimal window size. Clients can explicitly set smaller values via
@@ -28,6 +30,9 @@
 #define VIEW_FALLBACK_WIDTH  640
 #define VIEW_FALLBACK_HEIGHT 480
 
+/* Time to wait for a client to ack a configure request */
+#define CONFIGURE_TIMEOUT_MS 100
+
 /*
  * In labwc, a view is a container for surfaces which can be moved around by
  * the user. In practice this means XDG toplevel and XWayland windows.
@@ -85,6 +90,7 @@ enum view_wants_focus {
 struct view;
 struct wlr_surface;
 struct foreign_toplevel;
+struct tiling_node;
 
 /* Common to struct view and struct xwayland_unmanaged */
 struct mappable {
@@ -134,8 +140,28 @@ struct view {
 	const struct view_impl *impl;
 	struct wl_list link;
 
+	/*
+	 * The view is also in workspace->views, server.always_on_top_views
+	 * or (if always-on-bottom) no list, depending on its scene tree.
+	 * These lists are in the order of server.views, which is the order
+	 * of decreasing stack_seq.
+	 */
+	struct wl_list workspace_link;
+	struct wl_list *workspace_list; /* the list it is in, or NULL */
+	int64_t stack_seq;
+	/*
+	 * Mapped, unminimized views which have had keyboard focus are also
+	 * in workspace->focus_views, in the order of decreasing focus_seq,
+	 * so most recently focused first.
+	 */
+	struct wl_list focus_link;
+	int64_t focus_seq;
+	/* The workspace counting this view in nr_views, or NULL */
+	struct workspace *occupied_workspace;
+
 	/* This is cleared when the view is not in the cycle list */
 	struct wl_list cycle_link;
+	struct wl_list age_link; /* server.views_by_age */
 
 	/*
 	 * The primary output that the view is displayed on. Specifically:
@@ -170,7 +196,19 @@ struct view {
 
 	/* These are never NULL and an empty string is set instead. */
 	char *title;
-	char *app_id; /* WM_CLASS for xwayland windows */
+	/* WM_CLASS for xwayland windows, interned (see common/intern.h) */
+	const char *app_id;
+
+	/* Title coalescing, see <core><titleUpdateInterval> */
+	char *pending_title; /* NULL if none */
+	uint64_t title_applied_nsec;
+	struct wl_event_source *title_timer;
+
+	/* Bumped on every commit of the main surface */
+	uint64_t content_serial;
+
+	/* Last frame callback sent while hidden, see hidden-frames.h */
+	uint64_t hidden_frame_nsec;
 
 	bool mapped;
 	bool been_mapped;
@@ -187,7 +225,20 @@ struct view {
 	enum lab_edge tiled;
 	enum lab_edge edges_visible;
 	bool inhibits_keybinds; /* also inhibits mousebinds */
+	/* Only valid if keyboard_layout_generation is current */
 	xkb_layout_index_t keyboard_layout;
+	uint32_t keyboard_layout_generation;
+
+	/*
+	 * Output last used to constrain xdg-popups, in layout coordinates.
+	 * Only valid if generation is server->usable_area_generation.
+	 */
+	struct {
+		struct output *output;
+		struct wlr_box output_box;
+		struct wlr_box usable;
+		uint64_t generation;
+	} popup_constraint;
 
 	/* Pointer to an output owned struct region, may be NULL */
 	struct region *tiled_region;
@@ -223,7 +274,25 @@ struct view {
 
 	/* used by xdg-shell views */
 	uint32_t pending_configure_serial;
-	struct wl_event_source *pending_configure_timeout;
+	struct lab_timer *pending_configure_timeout;
+	/* waiting for a configure ack, see layout-transaction.h */
+	bool in_layout_transaction;
+	/* start of the current configure measurement, see configure-stats.h */
+	uint64_t configure_sent_ns;
+	uint64_t configure_acked_ns;
+	/* input latency sample in flight, see input-latency.h */
+	struct {
+		uint64_t input_ns;     /* 0 if there is none */
+		uint64_t delivered_ns;
+		uint64_t commit_ns;    /* 0 until the client commits */
+		uint64_t frame_ns;     /* 0 until composited */
+		struct output *output; /* composited on, awaiting presentation */
+	} latency;
+	/* shown instead of content_tree, see resize-snapshot.h */
+	struct wlr_scene_tree *resize_snapshot;
+	/* leaf in a tree based tiling layout, see tiling.h */
+	struct tiling_node *tiling_node;
+	struct window_rules_cache window_rules_cache;
 
 	struct ssd *ssd;
 	struct resize_indicator {
@@ -231,7 +300,7 @@ struct view {
 		struct wlr_scene_tree *tree;
 		struct wlr_scene_rect *border;
 		struct wlr_scene_rect *background;
-		struct scaled_font_buffer *text;
+		struct resize_indicator_text *text;
 	} resize_indicator;
 	struct resize_outlines {
 		struct wlr_box view_geo;
@@ -276,18 +345,18 @@ struct view {
 
 struct view_query {
 	struct wl_list link;
-	char *identifier;
-	char *title;
+	struct match_pattern identifier;
+	struct match_pattern title;
 	enum lab_window_type window_type;
-	char *sandbox_engine;
-	char *sandbox_app_id;
+	struct match_pattern sandbox_engine;
+	struct match_pattern sandbox_app_id;
 	enum lab_tristate shaded;
 	enum view_axis maximized;
 	enum lab_tristate iconified;
 	enum lab_tristate focused;
 	enum lab_tristate omnipresent;
 	enum lab_edge tiled;
-	char *tiled_region;
+	struct match_pattern tiled_region;
 	char *desktop;
 	enum lab_ssd_mode decoration;
 	char *monitor;
@@ -300,10 +369,14 @@ struct xdg_toplevel_view {
 	/* Optional black background fill behind fullscreen view */
 	struct wlr_scene_rect *fullscreen_bg;
 
+	/* Window type at the last commit, see window_rules_invalidate() */
+	bool is_dialog;
+
 	/* Events unique to xdg-toplevel views */
 	struct wl_listener set_app_id;
 	struct wl_listener request_show_window_menu;
 	struct wl_listener new_popup;
+	struct wl_listener ack_configure;
 };
 
 /**
@@ -369,7 +442,10 @@ bool view_matches_query(struct view *view, struct view_query *query);
 
 /**
  * view_next() - Get next view which matches criteria.
- * @head: Head of list to iterate over.
+ * @head: Head of list to iterate over. With LAB_VIEW_CRITERIA_CURRENT_WORKSPACE
+ *	  or LAB_VIEW_CRITERIA_ALWAYS_ON_TOP, this must be &server->views and
+ *	  only the views of the current workspace or the always-on-top views
+ *	  are visited.
  * @view: Current view from which to find the next one. If NULL is provided as
  *	  the view argument, the start of the list will be used.
  * @criteria: Criteria to match against.
@@ -381,7 +457,7 @@ struct view *view_next(struct wl_list *head, struct view *view,
 
 /**
  * view_prev() - Get previous view which matches criteria.
- * @head: Head of list to iterate over.
+ * @head: Head of list to iterate over, see view_next().
  * @view: Current view from which to find the previous one. If NULL is provided
  *        as the view argument, the end of the list will be used.
  * @criteria: Criteria to match against.
@@ -391,6 +467,19 @@ struct view *view_next(struct wl_list *head, struct view *view,
 struct view *view_prev(struct wl_list *head, struct view *view,
 	enum lab_view_criteria criteria);
 
+/* Check if @view matches the criteria of view_next() and for_each_view() */
+bool view_matches_view_criteria(struct view *view,
+	enum lab_view_criteria criteria);
+
+/* Add a newly created @view to the front of server->views */
+void view_add_to_views(struct view *view);
+
+/*
+ * Count @view in the nr_views of its workspace if it is mapped and neither
+ * omnipresent nor always-on-top. Call whenever one of these changes.
+ */
+void view_update_occupancy(struct view *view);
+
 /**
  * view_array_append() - Append views that match criteria to array
  * @server: server context
@@ -417,6 +506,12 @@ struct view *view_prev(struct wl_list *head, struct view *view,
 void view_array_append(struct server *server, struct wl_array *views,
 	enum lab_view_criteria criteria);
 
+/*
+ * Recompute the outputs of all views in one pass. desktop_arrange_all_views()
+ * calls this once, instead of updating each view as it is moved.
+ */
+void view_update_all_outputs(struct server *server);
+
 enum view_wants_focus view_wants_focus(struct view *view);
 
 /* If view is NULL, the size of SSD is not considered */
@@ -530,6 +625,9 @@ bool view_is_tiled(struct view *view);
 bool view_is_tiled_and_notify_tiled(struct view *view);
 bool view_is_floating(struct view *view);
 void view_move_to_workspace(struct view *view, struct workspace *workspace);
+
+/* Put @view first in the focus order of its workspace, on keyboard focus */
+void view_note_focus(struct view *view);
 bool view_titlebar_visible(struct view *view);
 void view_set_ssd_mode(struct view *view, enum lab_ssd_mode mode);
 void view_set_decorations(struct view *view, enum lab_ssd_mode mode, bool force_ssd);
@@ -564,6 +662,12 @@ bool view_on_output(struct view *view, struct output *output);
  */
 bool view_has_strut_partial(struct view *view);
 
+/**
+ * view_set_title() - set the title shown by decorations, OSDs, menus and
+ * taskbars. With <core><titleUpdateInterval>, later changes within the
+ * interval are coalesced and only the latest title is applied when it
+ * expires or when the view is (de)activated.
+ */
 void view_set_title(struct view *view, const char *title);
 void view_set_app_id(struct view *view, const char *app_id);
 void view_reload_ssd(struct view *view);
@@ -581,6 +685,15 @@ void view_evacuate_region(struct view *view);
 void view_on_output_destroy(struct view *view);
 void view_update_visibility(struct view *view);
 
+/*
+ * Show or hide several views at once. Between begin() and end(),
+ * view_update_visibility() only shows or hides the views. Focus, the top
+ * layer and the struts of XWayland panels are updated once by end().
+ * Batches may be nested; only the outermost end() counts.
+ */
+void view_visibility_batch_begin(void);
+void view_visibility_batch_end(struct server *server);
+
 void view_init(struct view *view);
 void view_destroy(struct view *view);
 
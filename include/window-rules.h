@@ -3,11 +3,15 @@
 #define LABWC_WINDOW_RULES_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-util.h>
+#include "common/match.h"
 #include "config/types.h"
 
 enum window_rule_event {
 	LAB_WINDOW_RULE_EVENT_ON_FIRST_MAP = 0,
+
+	LAB_WINDOW_RULE_EVENT_COUNT
 };
 
 enum property {
@@ -17,38 +21,93 @@ enum property {
 	LAB_PROP_TRUE,
 };
 
+enum window_rule_prop {
+	WINDOW_RULE_PROP_SERVER_DECORATION = 0,
+	WINDOW_RULE_PROP_SKIP_TASKBAR,
+	WINDOW_RULE_PROP_SKIP_WINDOW_SWITCHER,
+	WINDOW_RULE_PROP_IGNORE_FOCUS_REQUEST,
+	WINDOW_RULE_PROP_IGNORE_CONFIGURE_REQUEST,
+	WINDOW_RULE_PROP_FIXED_POSITION,
+	WINDOW_RULE_PROP_ICON_PREFER_CLIENT,
+	/* FALSE=frame callbacks at the refresh rate while hidden */
+	WINDOW_RULE_PROP_THROTTLE_WHEN_HIDDEN,
+	/* TRUE=always tile, FALSE=never tile, UNSET=default */
+	WINDOW_RULE_PROP_TILE,
+	/* TRUE=vertical, FALSE=horizontal, UNSET=auto */
+	WINDOW_RULE_PROP_TILE_DIRECTION,
+	/* Override <core><allowTearing> while the window is focused */
+	WINDOW_RULE_PROP_ALLOW_TEARING,
+	/* Override <core><adaptiveSync> while the window is focused */
+	WINDOW_RULE_PROP_ADAPTIVE_SYNC,
+	/* TRUE=get modifier changes while neither keyboard nor pointer focused */
+	WINDOW_RULE_PROP_RECEIVE_MODIFIERS,
+
+	WINDOW_RULE_PROP_COUNT
+};
+
 /*
  * 'identifier' represents:
  *   - 'app_id' for native Wayland windows
  *   - 'WM_CLASS' for XWayland clients
  */
 struct window_rule {
-	char *identifier;
-	char *title;
+	struct match_pattern identifier;
+	struct match_pattern title;
 	enum lab_window_type window_type;
-	char *sandbox_engine;
-	char *sandbox_app_id;
+	struct match_pattern sandbox_engine;
+	struct match_pattern sandbox_app_id;
 	bool match_once;
 
 	enum window_rule_event event;
 	struct wl_list actions;
 
-	enum property server_decoration;
-	enum property skip_taskbar;
-	enum property skip_window_switcher;
-	enum property ignore_focus_request;
-	enum property ignore_configure_request;
-	enum property fixed_position;
-	enum property icon_prefer_client;
-	enum property tile; /* Controls tiling behavior: TRUE=always tile, FALSE=never tile, UNSET=default */
-	enum property tile_direction; /* Controls tiling direction: TRUE=vertical, FALSE=horizontal, UNSET=auto */
+	enum property properties[WINDOW_RULE_PROP_COUNT];
+
+	/* Slot of a literal identifier in the compiled rules, or -1 */
+	int id_slot;
+
+	/* Views matching the criteria, counted for matchOnce rules */
+	int nr_instances;
+	uint32_t instances_generation;
 
 	struct wl_list link; /* struct rcxml.window_rules */
 };
 
+/*
+ * Properties resolved for one view, see window_rules_get_property().
+ * The cache is valid while generation matches the one of the compiled
+ * rules.
+ */
+struct window_rules_cache {
+	uint32_t generation;
+	enum property properties[WINDOW_RULE_PROP_COUNT];
+};
+
 struct view;
 
 void window_rules_apply(struct view *view, enum window_rule_event event);
-enum property window_rules_get_property(struct view *view, const char *property);
+
+/*
+ * Returns the property set by the highest priority rule matching @view.
+ * All properties of a view are resolved at once on the first lookup and
+ * cached until window_rules_invalidate() is called.
+ */
+enum property window_rules_get_property(struct view *view,
+	enum window_rule_prop property);
+
+/*
+ * Returns true if any rule sets @property, so that callers can avoid
+ * walking all views for rarely used properties.
+ */
+bool window_rules_sets_property(enum window_rule_prop property);
+
+/* Call after rc.window_rules has been (re-)loaded */
+void window_rules_compile(void);
+
+/* Call when the title, app_id, window type or workspace of @view changed */
+void window_rules_invalidate(struct view *view);
+
+/* Call when a view is mapped or unmapped, which may affect matchOnce rules */
+void window_rules_views_changed(void);
 
 #endif /* LABWC_WINDOW_RULES_H */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_WORKER_POOL_H
+#define LABWC_WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct wl_event_loop;
+struct worker_job;
+
+/*
+ * Worker threads for expensive but self-contained work, such as
+ * rasterizing text or parsing config files
+ *
+ * run() is called on one of a fixed number of threads and must only
+ * touch the data it is given, never the compositor state or wlroots.
+ * done() is then called on the main thread from the event loop, where
+ * the result can be applied. Jobs run in no particular order.
+ *
+ * A cancelled job is skipped if it hasn't started yet, and run() may call
+ * worker_job_is_cancelled() to stop early. done() is called in any case,
+ * with @cancelled set, so that it can release @data. The job is freed
+ * after done() returns.
+ */
+typedef void (*worker_run_fn)(struct worker_job *job, void *data);
+typedef void (*worker_done_fn)(void *data, bool cancelled);
+
+void worker_pool_init(struct wl_event_loop *loop);
+
+/* Wait for all jobs and call their done() callbacks */
+void worker_pool_finish(void);
+
+/*
+ * worker_pool_submit() - queue a job
+ * Returns NULL if there are no worker threads, in which case the caller
+ * should do the work synchronously.
+ */
+struct worker_job *worker_pool_submit(worker_run_fn run, worker_done_fn done,
+	void *data);
+
+/* Must not be called after done() of @job has returned */
+void worker_job_cancel(struct worker_job *job);
+
+/* May be called from run() */
+bool worker_job_is_cancelled(struct worker_job *job);
+
+/* Queue depth, queueing and run time of the jobs */
+void worker_pool_stats_print(FILE *stream);
+void worker_pool_stats_reset(void);
+
+#endif /* LABWC_WORKER_POOL_H */
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_WORKSPACE_SWIPE_H
+#define LABWC_WORKSPACE_SWIPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct server;
+
+/*
+ * Switching workspaces with touchpad swipes
+ *
+ * While a swipe with <desktops><swipeFingers> fingers is in progress, the
+ * scene trees of the current and the adjacent workspace are moved along
+ * with the fingers. On release, a spring animation stepped from the output
+ * frame handler moves them to the final position before the actual switch
+ * happens, so views are neither re-arranged nor re-rendered by clients.
+ *
+ * The swipe functions return true if the gesture event was consumed and
+ * must not be forwarded to clients.
+ */
+bool workspace_swipe_begin(struct server *server, uint32_t fingers);
+bool workspace_swipe_update(struct server *server, uint32_t time_msec,
+	double dx);
+bool workspace_swipe_end(struct server *server, bool cancelled);
+
+/* Advance the animation, called on every output frame */
+void workspace_swipe_frame(struct server *server);
+
+/* Stop any gesture or animation and restore the workspace trees */
+void workspace_swipe_cancel(struct server *server);
+
+#endif /* LABWC_WORKSPACE_SWIPE_H */
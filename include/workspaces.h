@@ -20,6 +20,10 @@ struct workspace {
 
 	char *name;
 	struct wlr_scene_tree *tree;
+	struct wl_list views; /* struct view.workspace_link */
+	struct wl_list focus_views; /* struct view.focus_link */
+	/* Mapped views that occupy this workspace, see view_update_occupancy() */
+	int nr_views;
 
 	struct lab_cosmic_workspace *cosmic_workspace;
 	struct {
@@ -41,6 +45,8 @@ void workspaces_init(struct server *server);
 void workspaces_switch_to(struct workspace *target, bool update_focus);
 void workspaces_destroy(struct server *server);
 void workspaces_osd_hide(struct seat *seat);
+/* Drop the rendered OSDs, e.g. after a theme change */
+void workspaces_osd_reconfigure(struct server *server);
 struct workspace *workspaces_find(struct workspace *anchor, const char *name,
 	bool wrap);
 void workspaces_reconfigure(struct server *server);
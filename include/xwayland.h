@@ -40,6 +40,26 @@ struct xwayland_view {
 	struct view base;
 	struct wlr_xwayland_surface *xwayland_surface;
 	bool focused_before_map;
+	/* Sends the latest pending geometry, see xwayland_view_configure() */
+	bool configure_pending;
+	struct wl_list configure_link; /* pending_configures */
+	/* Sequence number of the _NET_WM_ICON request in flight, or 0 */
+	unsigned int icon_request;
+	struct wl_list icon_request_link; /* pending_icon_requests */
+	/* Hash of the last _NET_WM_ICON value, to skip unchanged icons */
+	uint64_t icon_hash;
+	/* The _NET_WM_STRUT_PARTIAL last applied to the usable areas */
+	xcb_ewmh_wm_strut_partial_t strut;
+	bool has_strut;
+	/*
+	 * _NET_WM_WINDOW_TYPE as a bitmask of 1 << lab_window_type, and
+	 * the result of xwayland_view_wants_focus(), decoded on first use
+	 * and again after the properties they depend on have changed.
+	 */
+	uint32_t window_types;
+	bool window_types_valid;
+	enum view_wants_focus wants_focus;
+	bool wants_focus_valid;
 
 	/* Events unique to XWayland views */
 	struct wl_listener associate;
@@ -51,12 +71,12 @@ struct xwayland_view {
 	struct wl_listener set_override_redirect;
 	struct wl_listener set_strut_partial;
 	struct wl_listener set_window_type;
+	struct wl_listener set_hints;
 	struct wl_listener focus_in;
 	struct wl_listener map_request;
 
 	/* Not (yet) implemented */
 /*	struct wl_listener set_role; */
-/*	struct wl_listener set_hints; */
 };
 
 void xwayland_unmanaged_create(struct server *server,
@@ -69,6 +89,12 @@ void xwayland_server_init(struct server *server,
 	struct wlr_compositor *compositor);
 void xwayland_server_finish(struct server *server);
 
+/* Start Xwayland ahead of time, see <core><xwaylandPrestart> */
+void xwayland_prestart_init(struct server *server);
+/* Count X11 views and unmanaged surfaces being created or destroyed */
+void xwayland_prestart_surfaces_changed(int delta);
+void xwayland_prestart_finish(void);
+
 void xwayland_adjust_usable_area(struct view *view,
 	struct wlr_output_layout *layout, struct wlr_output *output,
 	struct wlr_box *usable);
@@ -77,6 +103,10 @@ void xwayland_update_workarea(struct server *server);
 
 void xwayland_reset_cursor(struct server *server);
 
+/*
+ * Flush the XWM connection once the event loop is idle, after all views
+ * configured in this event loop iteration have been sent their geometry
+ */
 void xwayland_flush(struct server *server);
 
 #endif /* HAVE_XWAYLAND */
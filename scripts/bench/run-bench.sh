@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+#
+# Benchmark the compositor on the headless backend with synthetic clients
+#
+# Usage: run-bench.sh <compositor> <lab-bench> [lab-bench options...]
+#
+# Usually run through "meson compile -C build bench". Options for lab-bench
+# can also be given in LAB_BENCH_ARGS, see "lab-bench --help". The JSON
+# report goes to stdout, or to the file named by LAB_BENCH_OUTPUT.
+# WLR_RENDERER may be set to compare renderers, e.g. to pixman.
+
+if test $# -lt 2 || ! test -x "$1" || ! test -x "$2"; then
+	echo "Usage: $0 <compositor> <lab-bench> [lab-bench options...]" >&2
+	exit 1
+fi
+
+compositor="$1"
+bench="$2"
+shift 2
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+export XDG_RUNTIME_DIR="$tmp"
+export WLR_BACKENDS=headless
+# lab-bench adds the virtual outputs itself
+export WLR_HEADLESS_OUTPUTS=0
+
+report="${LAB_BENCH_OUTPUT:-$tmp/report.json}"
+session=$(printf '%q ' "$bench" --file "$report" $LAB_BENCH_ARGS "$@")
+
+"$compositor" -C "$(dirname "$0")" -S "$session" 2>"$tmp/labwc.log"
+ret=$?
+
+if ! test -s "$report"; then
+	echo "No benchmark report, compositor exited with $ret:" >&2
+	tail -n 50 "$tmp/labwc.log" >&2
+	exit 1
+fi
+if test -z "$LAB_BENCH_OUTPUT"; then
+	cat "$report"
+fi
@@ -2,6 +2,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "action.h"
 #include <assert.h>
+#include <glib.h>
 #include <signal.h>
 #include <string.h>
 #include <strings.h>
@@ -17,12 +18,16 @@
 #include "common/parse-bool.h"
 #include "common/spawn.h"
 #include "common/string-helpers.h"
+#include "common/time-helpers.h"
 #include "config/keybind.h"
 #include "config/rcxml.h"
+#include "config/session.h"
 #include "cycle.h"
 #include "debug.h"
 #include "input/keyboard.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "layout-transaction.h"
 #include "magnifier.h"
 #include "menu/menu.h"
 #include "output.h"
@@ -30,6 +35,7 @@
 #include "regions.h"
 #include "ssd.h"
 #include "theme.h"
+#include "trace.h"
 #include "translate.h"
 #include "view.h"
 #include "workspaces.h"
@@ -42,6 +48,82 @@ enum action_arg_type {
 	LAB_ACTION_ARG_ACTION_LIST,
 };
 
+/*
+ * Argument keys are resolved when an argument is added, so that running
+ * an action only indexes struct action.arg_slots.
+ */
+enum action_arg_key {
+	ACTION_KEY_COMMAND = 0,
+	ACTION_KEY_DIRECTION,
+	ACTION_KEY_SNAP_WINDOWS,
+	ACTION_KEY_COMBINE,
+	ACTION_KEY_MENU,
+	ACTION_KEY_AT_CURSOR,
+	ACTION_KEY_X_POSITION,
+	ACTION_KEY_Y_POSITION,
+	ACTION_KEY_DECORATIONS,
+	ACTION_KEY_FORCE_SSD,
+	ACTION_KEY_LEFT,
+	ACTION_KEY_RIGHT,
+	ACTION_KEY_TOP,
+	ACTION_KEY_BOTTOM,
+	ACTION_KEY_X,
+	ACTION_KEY_Y,
+	ACTION_KEY_WIDTH,
+	ACTION_KEY_HEIGHT,
+	ACTION_KEY_FOLLOW,
+	ACTION_KEY_TO,
+	ACTION_KEY_WRAP,
+	ACTION_KEY_TOGGLE,
+	ACTION_KEY_REGION,
+	ACTION_KEY_OUTPUT,
+	ACTION_KEY_OUTPUT_NAME,
+	ACTION_KEY_POLICY,
+	ACTION_KEY_MESSAGE_PROMPT,
+	ACTION_KEY_ID,
+	ACTION_KEY_QUERY,
+	ACTION_KEY_THEN,
+	ACTION_KEY_ELSE,
+	ACTION_KEY_NONE,
+
+	ACTION_KEY_COUNT
+};
+
+static const char *const action_arg_keys[ACTION_KEY_COUNT] = {
+	[ACTION_KEY_COMMAND] = "command",
+	[ACTION_KEY_DIRECTION] = "direction",
+	[ACTION_KEY_SNAP_WINDOWS] = "snapWindows",
+	[ACTION_KEY_COMBINE] = "combine",
+	[ACTION_KEY_MENU] = "menu",
+	[ACTION_KEY_AT_CURSOR] = "atCursor",
+	[ACTION_KEY_X_POSITION] = "x.position",
+	[ACTION_KEY_Y_POSITION] = "y.position",
+	[ACTION_KEY_DECORATIONS] = "decorations",
+	[ACTION_KEY_FORCE_SSD] = "forceSSD",
+	[ACTION_KEY_LEFT] = "left",
+	[ACTION_KEY_RIGHT] = "right",
+	[ACTION_KEY_TOP] = "top",
+	[ACTION_KEY_BOTTOM] = "bottom",
+	[ACTION_KEY_X] = "x",
+	[ACTION_KEY_Y] = "y",
+	[ACTION_KEY_WIDTH] = "width",
+	[ACTION_KEY_HEIGHT] = "height",
+	[ACTION_KEY_FOLLOW] = "follow",
+	[ACTION_KEY_TO] = "to",
+	[ACTION_KEY_WRAP] = "wrap",
+	[ACTION_KEY_TOGGLE] = "toggle",
+	[ACTION_KEY_REGION] = "region",
+	[ACTION_KEY_OUTPUT] = "output",
+	[ACTION_KEY_OUTPUT_NAME] = "output_name",
+	[ACTION_KEY_POLICY] = "policy",
+	[ACTION_KEY_MESSAGE_PROMPT] = "message.prompt",
+	[ACTION_KEY_ID] = "id",
+	[ACTION_KEY_QUERY] = "query",
+	[ACTION_KEY_THEN] = "then",
+	[ACTION_KEY_ELSE] = "else",
+	[ACTION_KEY_NONE] = "none",
+};
+
 struct action_arg {
 	struct wl_list link;        /* struct action.args */
 
@@ -214,6 +296,122 @@ const char *action_names[] = {
 	NULL
 };
 
+struct action_timing {
+	uint64_t count;
+	uint64_t ns_total;
+	uint64_t ns_max;
+};
+
+/*
+ * Run time instrumentation, see action_stats_enable(). Times of If and
+ * ForEach include their nested actions and query matching.
+ */
+static struct {
+	bool enabled;
+	struct action_timing actions[ARRAY_SIZE(action_names) - 1];
+	struct action_timing queries;
+	struct action_timing spawns;
+} stats;
+
+static uint64_t
+stats_start(void)
+{
+	return stats.enabled ? time_now_nsec() : 0;
+}
+
+static void
+stats_record(struct action_timing *timing, uint64_t start_ns)
+{
+	if (!stats.enabled || !start_ns) {
+		return;
+	}
+	uint64_t now = time_now_nsec();
+	uint64_t duration = now > start_ns ? now - start_ns : 0;
+	timing->count++;
+	timing->ns_total += duration;
+	timing->ns_max = MAX(timing->ns_max, duration);
+}
+
+void
+action_stats_enable(bool enable)
+{
+	stats.enabled = enable;
+	wlr_log(WLR_INFO, "Action profiling %s", enable ? "enabled" : "disabled");
+}
+
+bool
+action_stats_enabled(void)
+{
+	return stats.enabled;
+}
+
+void
+action_stats_reset(void)
+{
+	bool enabled = stats.enabled;
+	memset(&stats, 0, sizeof(stats));
+	stats.enabled = enabled;
+}
+
+static void
+print_timing(FILE *stream, const char *name, struct action_timing *timing)
+{
+	fprintf(stream, "  %s: count %lu total_us %lu avg_us %lu max_us %lu\n",
+		name, (unsigned long)timing->count,
+		(unsigned long)(timing->ns_total / 1000),
+		(unsigned long)(timing->ns_total / timing->count / 1000),
+		(unsigned long)(timing->ns_max / 1000));
+}
+
+void
+action_stats_print(FILE *stream)
+{
+	fprintf(stream, "actions (profiling %s)\n",
+		stats.enabled ? "enabled" : "disabled");
+	for (size_t i = 0; i < ARRAY_SIZE(stats.actions); i++) {
+		if (stats.actions[i].count) {
+			print_timing(stream, action_names[i], &stats.actions[i]);
+		}
+	}
+	if (stats.queries.count) {
+		print_timing(stream, "(match queries)", &stats.queries);
+	}
+	if (stats.spawns.count) {
+		print_timing(stream, "(spawn)", &stats.spawns);
+	}
+}
+
+static int
+action_arg_key_from_str(const char *key)
+{
+	for (int i = 0; i < ACTION_KEY_COUNT; i++) {
+		if (!strcasecmp(key, action_arg_keys[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+action_arg_append(struct action *action, struct action_arg *arg)
+{
+	wl_list_append(&action->args, &arg->link);
+
+	int key = action_arg_key_from_str(arg->key);
+	if (key < 0) {
+		wlr_log(WLR_ERROR, "Unknown argument '%s' for action %s",
+			arg->key, action_names[action->type]);
+		return;
+	}
+	if (!action->arg_slots) {
+		action->arg_slots = znew_n(*action->arg_slots, ACTION_KEY_COUNT);
+	}
+	/* Like a lookup in the argument list, the first one wins */
+	if (!action->arg_slots[key]) {
+		action->arg_slots[key] = arg;
+	}
+}
+
 void
 action_arg_add_str(struct action *action, const char *key, const char *value)
 {
@@ -224,7 +422,7 @@ action_arg_add_str(struct action *action, const char *key, const char *value)
 	arg->base.type = LAB_ACTION_ARG_STR;
 	arg->base.key = xstrdup(key);
 	arg->value = xstrdup(value);
-	wl_list_append(&action->args, &arg->base.link);
+	action_arg_append(action, &arg->base);
 }
 
 static void
@@ -236,7 +434,7 @@ action_arg_add_bool(struct action *action, const char *key, bool value)
 	arg->base.type = LAB_ACTION_ARG_BOOL;
 	arg->base.key = xstrdup(key);
 	arg->value = value;
-	wl_list_append(&action->args, &arg->base.link);
+	action_arg_append(action, &arg->base);
 }
 
 static void
@@ -248,7 +446,7 @@ action_arg_add_int(struct action *action, const char *key, int value)
 	arg->base.type = LAB_ACTION_ARG_INT;
 	arg->base.key = xstrdup(key);
 	arg->value = value;
-	wl_list_append(&action->args, &arg->base.link);
+	action_arg_append(action, &arg->base);
 }
 
 static void
@@ -260,7 +458,7 @@ action_arg_add_list(struct action *action, const char *key, enum action_arg_type
 	arg->base.type = type;
 	arg->base.key = xstrdup(key);
 	wl_list_init(&arg->value);
-	wl_list_append(&action->args, &arg->base.link);
+	action_arg_append(action, &arg->base);
 }
 
 void
@@ -276,52 +474,99 @@ action_arg_add_actionlist(struct action *action, const char *key)
 }
 
 static void *
-action_get_arg(struct action *action, const char *key, enum action_arg_type type)
+action_get_arg(struct action *action, enum action_arg_key key,
+		enum action_arg_type type)
 {
 	assert(action);
-	assert(key);
-	struct action_arg *arg;
-	wl_list_for_each(arg, &action->args, link) {
-		if (!strcasecmp(key, arg->key) && arg->type == type) {
-			return arg;
-		}
+	assert(key < ACTION_KEY_COUNT);
+	if (!action->arg_slots) {
+		return NULL;
 	}
-	return NULL;
+	struct action_arg *arg = action->arg_slots[key];
+	return arg && arg->type == type ? arg : NULL;
 }
 
-const char *
-action_get_str(struct action *action, const char *key, const char *default_value)
+static const char *
+action_get_str(struct action *action, enum action_arg_key key,
+		const char *default_value)
 {
 	struct action_arg_str *arg = action_get_arg(action, key, LAB_ACTION_ARG_STR);
 	return arg ? arg->value : default_value;
 }
 
 static bool
-action_get_bool(struct action *action, const char *key, bool default_value)
+action_get_bool(struct action *action, enum action_arg_key key,
+		bool default_value)
 {
 	struct action_arg_bool *arg = action_get_arg(action, key, LAB_ACTION_ARG_BOOL);
 	return arg ? arg->value : default_value;
 }
 
 static int
-action_get_int(struct action *action, const char *key, int default_value)
+action_get_int(struct action *action, enum action_arg_key key,
+		int default_value)
 {
 	struct action_arg_int *arg = action_get_arg(action, key, LAB_ACTION_ARG_INT);
 	return arg ? arg->value : default_value;
 }
 
+static struct wl_list *
+action_get_list(struct action *action, enum action_arg_key key,
+		enum action_arg_type type)
+{
+	struct action_arg_list *arg = action_get_arg(action, key, type);
+	return arg ? &arg->value : NULL;
+}
+
+/* Actions of the then, else or none branch of an If or ForEach action */
+static struct wl_list *
+action_get_branch(struct action *action, enum action_arg_key key)
+{
+	return action_get_list(action, key, LAB_ACTION_ARG_ACTION_LIST);
+}
+
 struct wl_list *
 action_get_querylist(struct action *action, const char *key)
 {
-	struct action_arg_list *arg = action_get_arg(action, key, LAB_ACTION_ARG_QUERY_LIST);
-	return arg ? &arg->value : NULL;
+	int k = action_arg_key_from_str(key);
+	return k < 0 ? NULL
+		: action_get_list(action, k, LAB_ACTION_ARG_QUERY_LIST);
 }
 
 struct wl_list *
 action_get_actionlist(struct action *action, const char *key)
 {
-	struct action_arg_list *arg = action_get_arg(action, key, LAB_ACTION_ARG_ACTION_LIST);
-	return arg ? &arg->value : NULL;
+	int k = action_arg_key_from_str(key);
+	return k < 0 ? NULL
+		: action_get_list(action, k, LAB_ACTION_ARG_ACTION_LIST);
+}
+
+/*
+ * The command of an Execute action split into arguments, cached until the
+ * environment changes if it depends on it (only through ~ for $HOME)
+ */
+static char **
+get_execute_argv(struct action *action)
+{
+	if (action->argv && (!action->argv_serial
+			|| action->argv_serial == session_environment_serial())) {
+		return action->argv;
+	}
+	g_strfreev(action->argv);
+	action->argv = NULL;
+
+	const char *command = action_get_str(action, ACTION_KEY_COMMAND, NULL);
+	if (!command) {
+		return NULL;
+	}
+	struct buf cmd = BUF_INIT;
+	buf_add(&cmd, command);
+	buf_expand_tilde(&cmd);
+	action->argv = spawn_parse_argv(cmd.data);
+	action->argv_serial =
+		strchr(command, '~') ? session_environment_serial() : 0;
+	buf_reset(&cmd);
+	return action->argv;
 }
 
 void
@@ -341,6 +586,10 @@ action_arg_from_xml_node(struct action *action, const char *nodename, const char
 		 */
 		if (!strcmp(argument, "command") || !strcmp(argument, "execute")) {
 			action_arg_add_str(action, "command", content);
+			/* Split it now rather than on every invocation */
+			g_strfreev(action->argv);
+			action->argv = NULL;
+			get_execute_argv(action);
 			goto cleanup;
 		}
 		break;
@@ -536,6 +785,14 @@ action_arg_from_xml_node(struct action *action, const char *nodename, const char
 			action_arg_add_str(action, "message.prompt", content);
 		}
 		goto cleanup;
+	case ACTION_TYPE_ENABLE_KEYBIND:
+	case ACTION_TYPE_DISABLE_KEYBIND:
+	case ACTION_TYPE_TOGGLE_KEYBIND:
+		if (!strcmp(argument, "id")) {
+			action_arg_add_str(action, argument, content);
+			goto cleanup;
+		}
+		break;
 	}
 
 	wlr_log(WLR_ERROR, "Invalid argument for action %s: '%s'",
@@ -605,13 +862,15 @@ action_list_is_valid(struct wl_list *actions)
 static bool
 action_branches_are_valid(struct action *action)
 {
-	static const char * const branches[] = { "then", "else", "none" };
+	static const enum action_arg_key branches[] = {
+		ACTION_KEY_THEN, ACTION_KEY_ELSE, ACTION_KEY_NONE,
+	};
 	for (size_t i = 0; i < ARRAY_SIZE(branches); i++) {
-		struct wl_list *children =
-			action_get_actionlist(action, branches[i]);
+		struct wl_list *children = action_get_branch(action, branches[i]);
 		if (children && !action_list_is_valid(children)) {
 			wlr_log(WLR_ERROR, "Invalid action in %s '%s' branch",
-				action_names[action->type], branches[i]);
+				action_names[action->type],
+				action_arg_keys[branches[i]]);
 			return false;
 		}
 	}
@@ -622,31 +881,36 @@ action_branches_are_valid(struct action *action)
 bool
 action_is_valid(struct action *action)
 {
-	const char *arg_name = NULL;
+	enum action_arg_key key;
 	enum action_arg_type arg_type = LAB_ACTION_ARG_STR;
 
 	switch (action->type) {
 	case ACTION_TYPE_EXECUTE:
-		arg_name = "command";
+		key = ACTION_KEY_COMMAND;
 		break;
 	case ACTION_TYPE_MOVE_TO_EDGE:
 	case ACTION_TYPE_TOGGLE_SNAP_TO_EDGE:
 	case ACTION_TYPE_SNAP_TO_EDGE:
 	case ACTION_TYPE_GROW_TO_EDGE:
 	case ACTION_TYPE_SHRINK_TO_EDGE:
-		arg_name = "direction";
+		key = ACTION_KEY_DIRECTION;
 		arg_type = LAB_ACTION_ARG_INT;
 		break;
 	case ACTION_TYPE_SHOW_MENU:
-		arg_name = "menu";
+		key = ACTION_KEY_MENU;
 		break;
 	case ACTION_TYPE_GO_TO_DESKTOP:
 	case ACTION_TYPE_SEND_TO_DESKTOP:
-		arg_name = "to";
+		key = ACTION_KEY_TO;
 		break;
 	case ACTION_TYPE_TOGGLE_SNAP_TO_REGION:
 	case ACTION_TYPE_SNAP_TO_REGION:
-		arg_name = "region";
+		key = ACTION_KEY_REGION;
+		break;
+	case ACTION_TYPE_ENABLE_KEYBIND:
+	case ACTION_TYPE_DISABLE_KEYBIND:
+	case ACTION_TYPE_TOGGLE_KEYBIND:
+		key = ACTION_KEY_ID;
 		break;
 	case ACTION_TYPE_IF:
 	case ACTION_TYPE_FOR_EACH:
@@ -656,12 +920,12 @@ action_is_valid(struct action *action)
 		return true;
 	}
 
-	if (action_get_arg(action, arg_name, arg_type)) {
+	if (action_get_arg(action, key, arg_type)) {
 		return true;
 	}
 
 	wlr_log(WLR_ERROR, "Missing required argument for %s: %s",
-		action_names[action->type], arg_name);
+		action_names[action->type], action_arg_keys[key]);
 	return false;
 }
 
@@ -694,6 +958,8 @@ action_free(struct action *action)
 		}
 		zfree(arg);
 	}
+	zfree(action->arg_slots);
+	g_strfreev(action->argv);
 	zfree(action);
 }
 
@@ -824,7 +1090,7 @@ struct action_prompt {
 	struct action *action;
 	struct view *view;
 
-	/* Set when executed */
+	/* Set when executed, -1 for <core><nativePrompt> */
 	pid_t pid;
 
 	struct {
@@ -838,6 +1104,9 @@ static struct wl_list prompts = WL_LIST_INIT(&prompts);
 static void
 action_prompt_destroy(struct action_prompt *prompt)
 {
+	if (prompt->pid < 0) {
+		menu_close_prompt(prompt->server, prompt);
+	}
 	wl_list_remove(&prompt->on_view.destroy.link);
 	wl_list_remove(&prompt->link);
 	free(prompt);
@@ -874,7 +1143,7 @@ print_prompt_command(struct buf *buf, const char *format,
 		switch (*p) {
 		case 'm':
 			buf_add(buf, action_get_str(action,
-					"message.prompt", "Choose wisely"));
+					ACTION_KEY_MESSAGE_PROMPT, "Choose wisely"));
 			break;
 		case 'n':
 			buf_add(buf, _("No"));
@@ -896,16 +1165,89 @@ print_prompt_command(struct buf *buf, const char *format,
 	}
 }
 
+static struct action_prompt *
+add_prompt(struct view *view, struct server *server, struct action *action,
+		pid_t pid)
+{
+	struct action_prompt *prompt = znew(*prompt);
+	prompt->server = server;
+	prompt->action = action;
+	prompt->view = view;
+	prompt->pid = pid;
+	if (view) {
+		prompt->on_view.destroy.notify = handle_view_destroy;
+		wl_signal_add(&view->events.destroy, &prompt->on_view.destroy);
+	} else {
+		/* Allows removing during destroy */
+		wl_list_init(&prompt->on_view.destroy.link);
+	}
+
+	wl_list_insert(&prompts, &prompt->link);
+	return prompt;
+}
+
+/* Destroys @prompt before running the actions, which may reconfigure */
+static void
+run_prompt_result(struct action_prompt *prompt, int exit_code)
+{
+	struct view *view = prompt->view;
+	struct server *server = prompt->server;
+	struct action *action = prompt->action;
+	action_prompt_destroy(prompt);
+
+	struct wl_list *actions = NULL;
+	if (exit_code == LAB_EXIT_SUCCESS) {
+		wlr_log(WLR_INFO, "Selected the 'then' branch");
+		actions = action_get_branch(action, ACTION_KEY_THEN);
+	} else if (exit_code == LAB_EXIT_CANCELLED) {
+		/* no-op */
+	} else {
+		wlr_log(WLR_INFO, "Selected the 'else' branch");
+		actions = action_get_branch(action, ACTION_KEY_ELSE);
+	}
+	if (actions) {
+		wlr_log(WLR_INFO, "Running actions");
+		actions_run(view, server, actions, /*cursor_ctx*/ NULL);
+	} else {
+		wlr_log(WLR_INFO, "No actions for selected branch");
+	}
+}
+
+static void
+handle_native_prompt_done(int exit_code, void *data)
+{
+	run_prompt_result(data, exit_code);
+}
+
 static void
 action_prompt_create(struct view *view, struct server *server, struct action *action)
 {
+	if (rc.native_prompt) {
+		/*
+		 * Shown by the compositor itself, which saves spawning
+		 * a client that has to connect and load fonts first
+		 */
+		struct action_prompt *prompt =
+			add_prompt(view, server, action, /*pid*/ -1);
+		const char *message = action_get_str(action,
+			ACTION_KEY_MESSAGE_PROMPT, "Choose wisely");
+		if (menu_open_prompt(server, message,
+				handle_native_prompt_done, prompt)) {
+			return;
+		}
+		/* Another menu or the window switcher is open */
+		action_prompt_destroy(prompt);
+	}
+
 	struct buf command = BUF_INIT;
 	print_prompt_command(&command, rc.prompt_command, action, rc.theme);
 
 	wlr_log(WLR_INFO, "prompt command: '%s'", command.data);
 
 	int pipe_fd;
+	uint64_t start = stats_start();
 	pid_t prompt_pid = spawn_piped(command.data, &pipe_fd);
+	stats_record(&stats.spawns, start);
 	if (prompt_pid < 0) {
 		wlr_log(WLR_ERROR, "Failed to create action prompt");
 		goto cleanup;
@@ -913,20 +1255,7 @@ action_prompt_create(struct view *view, struct server *server, struct action *ac
 	/* FIXME: closing stdout might confuse clients */
 	close(pipe_fd);
 
-	struct action_prompt *prompt = znew(*prompt);
-	prompt->server = server;
-	prompt->action = action;
-	prompt->view = view;
-	prompt->pid = prompt_pid;
-	if (view) {
-		prompt->on_view.destroy.notify = handle_view_destroy;
-		wl_signal_add(&view->events.destroy, &prompt->on_view.destroy);
-	} else {
-		/* Allows removing during destroy */
-		wl_list_init(&prompt->on_view.destroy.link);
-	}
-
-	wl_list_insert(&prompts, &prompt->link);
+	add_prompt(view, server, action, prompt_pid);
 
 cleanup:
 	buf_reset(&command);
@@ -951,24 +1280,7 @@ action_check_prompt_result(pid_t pid, int exit_code)
 		}
 
 		wlr_log(WLR_INFO, "Found pending prompt for exit code %d", exit_code);
-		struct wl_list *actions = NULL;
-		if (exit_code == LAB_EXIT_SUCCESS) {
-			wlr_log(WLR_INFO, "Selected the 'then' branch");
-			actions = action_get_actionlist(prompt->action, "then");
-		} else if (exit_code == LAB_EXIT_CANCELLED) {
-			/* no-op */
-		} else {
-			wlr_log(WLR_INFO, "Selected the 'else' branch");
-			actions = action_get_actionlist(prompt->action, "else");
-		}
-		if (actions) {
-			wlr_log(WLR_INFO, "Running actions");
-			actions_run(prompt->view, prompt->server,
-				actions, /*cursor_ctx*/ NULL);
-		} else {
-			wlr_log(WLR_INFO, "No actions for selected branch");
-		}
-		action_prompt_destroy(prompt);
+		run_prompt_result(prompt, exit_code);
 		return true;
 	}
 	return false;
@@ -979,34 +1291,39 @@ match_queries(struct view *view, struct action *action)
 {
 	assert(view);
 
-	struct wl_list *queries = action_get_querylist(action, "query");
+	struct wl_list *queries = action_get_list(action, ACTION_KEY_QUERY,
+		LAB_ACTION_ARG_QUERY_LIST);
 	if (!queries) {
 		return true;
 	}
 
 	/* All queries are OR'ed */
+	uint64_t start = stats_start();
+	bool matches = false;
 	struct view_query *query;
 	wl_list_for_each(query, queries, link) {
 		if (view_matches_query(view, query)) {
-			return true;
+			matches = true;
+			break;
 		}
 	}
-	return false;
+	stats_record(&stats.queries, start);
+	return matches;
 }
 
 static struct output *
 get_target_output(struct output *output, struct server *server,
 	struct action *action)
 {
-	const char *output_name = action_get_str(action, "output", NULL);
+	const char *output_name = action_get_str(action, ACTION_KEY_OUTPUT, NULL);
 	struct output *target = NULL;
 
 	if (output_name) {
 		target = output_from_name(server, output_name);
 	} else {
 		enum lab_edge edge =
-			action_get_int(action, "direction", LAB_EDGE_NONE);
-		bool wrap = action_get_bool(action, "wrap", false);
+			action_get_int(action, ACTION_KEY_DIRECTION, LAB_EDGE_NONE);
+		bool wrap = action_get_bool(action, ACTION_KEY_WRAP, false);
 		target = output_get_adjacent(output, edge, wrap);
 	}
 
@@ -1079,13 +1396,17 @@ run_action(struct view *view, struct server *server, struct action *action,
 		break;
 	case ACTION_TYPE_DEBUG:
 		debug_dump_scene(server);
+		if (stats.enabled) {
+			action_stats_print(stdout);
+		}
 		break;
 	case ACTION_TYPE_EXECUTE: {
-		struct buf cmd = BUF_INIT;
-		buf_add(&cmd, action_get_str(action, "command", NULL));
-		buf_expand_tilde(&cmd);
-		spawn_async_no_shell(cmd.data);
-		buf_reset(&cmd);
+		char **argv = get_execute_argv(action);
+		if (argv) {
+			uint64_t start = stats_start();
+			spawn_argv_async_no_shell(argv);
+			stats_record(&stats.spawns, start);
+		}
 		break;
 	}
 	case ACTION_TYPE_EXIT:
@@ -1094,8 +1415,8 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_MOVE_TO_EDGE:
 		if (view) {
 			/* Config parsing makes sure that direction is a valid direction */
-			enum lab_edge edge = action_get_int(action, "direction", 0);
-			bool snap_to_windows = action_get_bool(action, "snapWindows", true);
+			enum lab_edge edge = action_get_int(action, ACTION_KEY_DIRECTION, 0);
+			bool snap_to_windows = action_get_bool(action, ACTION_KEY_SNAP_WINDOWS, true);
 			view_move_to_edge(view, edge, snap_to_windows);
 		}
 		break;
@@ -1103,7 +1424,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_SNAP_TO_EDGE:
 		if (view) {
 			/* Config parsing makes sure that direction is a valid direction */
-			enum lab_edge edge = action_get_int(action, "direction", 0);
+			enum lab_edge edge = action_get_int(action, ACTION_KEY_DIRECTION, 0);
 			if (action->type == ACTION_TYPE_TOGGLE_SNAP_TO_EDGE
 					&& view->maximized == VIEW_AXIS_NONE
 					&& !view->fullscreen
@@ -1113,7 +1434,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 				view_apply_natural_geometry(view);
 				break;
 			}
-			bool combine = action_get_bool(action, "combine", false);
+			bool combine = action_get_bool(action, ACTION_KEY_COMBINE, false);
 			view_snap_to_edge(view, edge, /*across_outputs*/ true,
 				combine, /*store_natural_geometry*/ true);
 		}
@@ -1121,14 +1442,14 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_GROW_TO_EDGE:
 		if (view) {
 			/* Config parsing makes sure that direction is a valid direction */
-			enum lab_edge edge = action_get_int(action, "direction", 0);
+			enum lab_edge edge = action_get_int(action, ACTION_KEY_DIRECTION, 0);
 			view_grow_to_edge(view, edge);
 		}
 		break;
 	case ACTION_TYPE_SHRINK_TO_EDGE:
 		if (view) {
 			/* Config parsing makes sure that direction is a valid direction */
-			enum lab_edge edge = action_get_int(action, "direction", 0);
+			enum lab_edge edge = action_get_int(action, ACTION_KEY_DIRECTION, 0);
 			view_shrink_to_edge(view, edge);
 		}
 		break;
@@ -1151,22 +1472,22 @@ run_action(struct view *view, struct server *server, struct action *action,
 		break;
 	case ACTION_TYPE_SHOW_MENU:
 		show_menu(server, view, ctx,
-			action_get_str(action, "menu", NULL),
-			action_get_bool(action, "atCursor", true),
-			action_get_str(action, "x.position", NULL),
-			action_get_str(action, "y.position", NULL));
+			action_get_str(action, ACTION_KEY_MENU, NULL),
+			action_get_bool(action, ACTION_KEY_AT_CURSOR, true),
+			action_get_str(action, ACTION_KEY_X_POSITION, NULL),
+			action_get_str(action, ACTION_KEY_Y_POSITION, NULL));
 		break;
 	case ACTION_TYPE_TOGGLE_MAXIMIZE:
 		if (view) {
 			enum view_axis axis = action_get_int(action,
-				"direction", VIEW_AXIS_BOTH);
+				ACTION_KEY_DIRECTION, VIEW_AXIS_BOTH);
 			view_toggle_maximize(view, axis);
 		}
 		break;
 	case ACTION_TYPE_MAXIMIZE:
 		if (view) {
 			enum view_axis axis = action_get_int(action,
-				"direction", VIEW_AXIS_BOTH);
+				ACTION_KEY_DIRECTION, VIEW_AXIS_BOTH);
 			view_maximize(view, axis,
 				/*store_natural_geometry*/ true);
 		}
@@ -1174,7 +1495,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_UNMAXIMIZE:
 		if (view) {
 			enum view_axis axis = action_get_int(action,
-				"direction", VIEW_AXIS_BOTH);
+				ACTION_KEY_DIRECTION, VIEW_AXIS_BOTH);
 			view_maximize(view, view->maximized & ~axis,
 				/*store_natural_geometry*/ true);
 		}
@@ -1187,9 +1508,9 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_SET_DECORATIONS:
 		if (view) {
 			enum lab_ssd_mode mode = action_get_int(action,
-				"decorations", LAB_SSD_MODE_FULL);
+				ACTION_KEY_DECORATIONS, LAB_SSD_MODE_FULL);
 			bool force_ssd = action_get_bool(action,
-				"forceSSD", false);
+				ACTION_KEY_FORCE_SSD, false);
 			view_set_decorations(view, mode, force_ssd);
 		}
 		break;
@@ -1250,7 +1571,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 			 * the current cursor position (existing behaviour).
 			 */
 			enum lab_edge resize_edges =
-				action_get_int(action, "direction", LAB_EDGE_NONE);
+				action_get_int(action, ACTION_KEY_DIRECTION, LAB_EDGE_NONE);
 			if (resize_edges == LAB_EDGE_NONE) {
 				resize_edges = cursor_get_resize_edges(
 					server->seat.cursor, ctx);
@@ -1261,25 +1582,25 @@ run_action(struct view *view, struct server *server, struct action *action,
 		break;
 	case ACTION_TYPE_RESIZE_RELATIVE:
 		if (view) {
-			int left = action_get_int(action, "left", 0);
-			int right = action_get_int(action, "right", 0);
-			int top = action_get_int(action, "top", 0);
-			int bottom = action_get_int(action, "bottom", 0);
+			int left = action_get_int(action, ACTION_KEY_LEFT, 0);
+			int right = action_get_int(action, ACTION_KEY_RIGHT, 0);
+			int top = action_get_int(action, ACTION_KEY_TOP, 0);
+			int bottom = action_get_int(action, ACTION_KEY_BOTTOM, 0);
 			view_resize_relative(view, left, right, top, bottom);
 		}
 		break;
 	case ACTION_TYPE_MOVETO:
 		if (view) {
-			int x = action_get_int(action, "x", 0);
-			int y = action_get_int(action, "y", 0);
+			int x = action_get_int(action, ACTION_KEY_X, 0);
+			int y = action_get_int(action, ACTION_KEY_Y, 0);
 			struct border margin = ssd_thickness(view);
 			view_move(view, x + margin.left, y + margin.top);
 		}
 		break;
 	case ACTION_TYPE_RESIZETO:
 		if (view) {
-			int width = action_get_int(action, "width", 0);
-			int height = action_get_int(action, "height", 0);
+			int width = action_get_int(action, ACTION_KEY_WIDTH, 0);
+			int height = action_get_int(action, ACTION_KEY_HEIGHT, 0);
 
 			/*
 			 * To support only setting one of width/height
@@ -1298,8 +1619,8 @@ run_action(struct view *view, struct server *server, struct action *action,
 		break;
 	case ACTION_TYPE_MOVE_RELATIVE:
 		if (view) {
-			int x = action_get_int(action, "x", 0);
-			int y = action_get_int(action, "y", 0);
+			int x = action_get_int(action, ACTION_KEY_X, 0);
+			int y = action_get_int(action, ACTION_KEY_Y, 0);
 			view_move_relative(view, x, y);
 		}
 		break;
@@ -1318,8 +1639,8 @@ run_action(struct view *view, struct server *server, struct action *action,
 		/* Falls through to GoToDesktop */
 	case ACTION_TYPE_GO_TO_DESKTOP: {
 		bool follow = true;
-		bool wrap = action_get_bool(action, "wrap", true);
-		const char *to = action_get_str(action, "to", NULL);
+		bool wrap = action_get_bool(action, ACTION_KEY_WRAP, true);
+		const char *to = action_get_str(action, ACTION_KEY_TO, NULL);
 		/*
 		 * `to` is always != NULL here because otherwise we would have
 		 * removed the action during the initial parsing step as it is
@@ -1328,7 +1649,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 		struct workspace *target_workspace = workspaces_find(
 			server->workspaces.current, to, wrap);
 		if (action->type == ACTION_TYPE_GO_TO_DESKTOP) {
-			bool toggle = action_get_bool(action, "toggle", false);
+			bool toggle = action_get_bool(action, ACTION_KEY_TOGGLE, false);
 			if (target_workspace == server->workspaces.current
 				&& toggle) {
 				target_workspace = server->workspaces.last;
@@ -1339,7 +1660,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 		}
 		if (action->type == ACTION_TYPE_SEND_TO_DESKTOP) {
 			view_move_to_workspace(view, target_workspace);
-			follow = action_get_bool(action, "follow", true);
+			follow = action_get_bool(action, ACTION_KEY_FOLLOW, true);
 
 			/* Ensure that the focus is not on another desktop */
 			if (!follow && server->active_view == view) {
@@ -1378,7 +1699,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 		if (!output) {
 			break;
 		}
-		const char *region_name = action_get_str(action, "region", NULL);
+		const char *region_name = action_get_str(action, ACTION_KEY_REGION, NULL);
 		struct region *region = regions_from_name(region_name, output);
 		if (region) {
 			if (action->type == ACTION_TYPE_TOGGLE_SNAP_TO_REGION
@@ -1421,7 +1742,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 	}
 	case ACTION_TYPE_IF: {
 		/* At least one of the queries was matched or there was no query */
-		if (action_get_str(action, "message.prompt", NULL)) {
+		if (action_get_str(action, ACTION_KEY_MESSAGE_PROMPT, NULL)) {
 			/*
 			 * We delay the selection and execution of the
 			 * branch until we get a response from the user.
@@ -1430,9 +1751,9 @@ run_action(struct view *view, struct server *server, struct action *action,
 		} else if (view) {
 			struct wl_list *actions;
 			if (match_queries(view, action)) {
-				actions = action_get_actionlist(action, "then");
+				actions = action_get_branch(action, ACTION_KEY_THEN);
 			} else {
-				actions = action_get_actionlist(action, "else");
+				actions = action_get_branch(action, ACTION_KEY_ELSE);
 			}
 			if (actions) {
 				actions_run(view, server, actions, ctx);
@@ -1448,21 +1769,41 @@ run_action(struct view *view, struct server *server, struct action *action,
 		wl_array_init(&views);
 		view_array_append(server, &views, LAB_VIEW_CRITERIA_NONE);
 
-		struct view **item;
-		wl_array_for_each(item, &views) {
-			if (match_queries(*item, action)) {
-				matches = true;
-				actions = action_get_actionlist(action, "then");
-			} else {
-				actions = action_get_actionlist(action, "else");
-			}
+		/*
+		 * Match all views before running any branch, so that the
+		 * branches don't change which views the queries match.
+		 */
+		size_t nr_views = views.size / sizeof(struct view *);
+		bool *matched = znew_n(bool, nr_views);
+		struct view **views_data = views.data;
+		for (size_t i = 0; i < nr_views; i++) {
+			matched[i] = match_queries(views_data[i], action);
+			matches |= matched[i];
+		}
+
+		/*
+		 * Present the changes to all views at once, and only refocus
+		 * and update the struts once at the end.
+		 */
+		struct wl_list *then_actions =
+			action_get_branch(action, ACTION_KEY_THEN);
+		struct wl_list *else_actions =
+			action_get_branch(action, ACTION_KEY_ELSE);
+		layout_transaction_begin(server);
+		view_visibility_batch_begin();
+		for (size_t i = 0; i < nr_views; i++) {
+			actions = matched[i] ? then_actions : else_actions;
 			if (actions) {
-				actions_run(*item, server, actions, ctx);
+				actions_run(views_data[i], server, actions, ctx);
 			}
 		}
+		view_visibility_batch_end(server);
+		layout_transaction_commit(server);
+		free(matched);
 		wl_array_release(&views);
+
 		if (!matches) {
-			actions = action_get_actionlist(action, "none");
+			actions = action_get_branch(action, ACTION_KEY_NONE);
 			if (actions) {
 				actions_run(view, server, actions, NULL);
 			}
@@ -1472,7 +1813,7 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_VIRTUAL_OUTPUT_ADD: {
 		/* TODO: rename this argument to "outputName" */
 		const char *output_name =
-			action_get_str(action, "output_name", NULL);
+			action_get_str(action, ACTION_KEY_OUTPUT_NAME, NULL);
 		output_virtual_add(server, output_name,
 				/*store_wlr_output*/ NULL, 0, 0, 0);
 		break;
@@ -1480,14 +1821,14 @@ run_action(struct view *view, struct server *server, struct action *action,
 	case ACTION_TYPE_VIRTUAL_OUTPUT_REMOVE: {
 		/* TODO: rename this argument to "outputName" */
 		const char *output_name =
-			action_get_str(action, "output_name", NULL);
+			action_get_str(action, ACTION_KEY_OUTPUT_NAME, NULL);
 		output_virtual_remove(server, output_name);
 		break;
 	}
 	case ACTION_TYPE_AUTO_PLACE:
 		if (view) {
 			enum lab_placement_policy policy =
-				action_get_int(action, "policy", LAB_PLACE_AUTOMATIC);
+				action_get_int(action, ACTION_KEY_POLICY, LAB_PLACE_AUTOMATIC);
 			view_place_by_policy(view,
 				/* allow_cursor */ true, policy);
 		}
@@ -1556,9 +1897,9 @@ run_action(struct view *view, struct server *server, struct action *action,
 		magnifier_set_scale(server, MAGNIFY_DECREASE);
 		break;
 	case ACTION_TYPE_WARP_CURSOR: {
-		const char *to = action_get_str(action, "to", "output");
-		const char *x = action_get_str(action, "x", "center");
-		const char *y = action_get_str(action, "y", "center");
+		const char *to = action_get_str(action, ACTION_KEY_TO, "output");
+		const char *x = action_get_str(action, ACTION_KEY_X, "center");
+		const char *y = action_get_str(action, ACTION_KEY_Y, "center");
 		warp_cursor(server, view, to, x, y);
 		break;
 	}
@@ -1566,11 +1907,8 @@ run_action(struct view *view, struct server *server, struct action *action,
 		cursor_set_visible(&server->seat, false);
 		break;
 	case ACTION_TYPE_ENABLE_KEYBIND: {
-		const char *id = action_get_str(action, "id", NULL);
-		if (!id) {
-			wlr_log(WLR_ERROR, "EnableKeybind action requires 'id' parameter");
-			break;
-		}
+		/* Config parsing makes sure that id is set */
+		const char *id = action_get_str(action, ACTION_KEY_ID, NULL);
 		struct keybind *keybind = keybind_find_by_id(id);
 		if (!keybind) {
 			wlr_log(WLR_ERROR, "Keybind with id '%s' not found", id);
@@ -1584,17 +1922,15 @@ run_action(struct view *view, struct server *server, struct action *action,
 		if (keybind_check_condition_sync(keybind)) {
 			keybind->enabled = true;
 			wlr_log(WLR_INFO, "Enabled keybind with id '%s'", id);
+			ipc_emit(IPC_EVENT_KEYBIND);
 		} else {
 			wlr_log(WLR_INFO, "Keybind with id '%s' condition not met, not enabling", id);
 		}
 		break;
 	}
 	case ACTION_TYPE_DISABLE_KEYBIND: {
-		const char *id = action_get_str(action, "id", NULL);
-		if (!id) {
-			wlr_log(WLR_ERROR, "DisableKeybind action requires 'id' parameter");
-			break;
-		}
+		/* Config parsing makes sure that id is set */
+		const char *id = action_get_str(action, ACTION_KEY_ID, NULL);
 		struct keybind *keybind = keybind_find_by_id(id);
 		if (!keybind) {
 			wlr_log(WLR_ERROR, "Keybind with id '%s' not found", id);
@@ -1606,14 +1942,12 @@ run_action(struct view *view, struct server *server, struct action *action,
 		}
 		keybind->enabled = false;
 		wlr_log(WLR_INFO, "Disabled keybind with id '%s'", id);
+		ipc_emit(IPC_EVENT_KEYBIND);
 		break;
 	}
 	case ACTION_TYPE_TOGGLE_KEYBIND: {
-		const char *id = action_get_str(action, "id", NULL);
-		if (!id) {
-			wlr_log(WLR_ERROR, "ToggleKeybind action requires 'id' parameter");
-			break;
-		}
+		/* Config parsing makes sure that id is set */
+		const char *id = action_get_str(action, ACTION_KEY_ID, NULL);
 		struct keybind *keybind = keybind_find_by_id(id);
 		if (!keybind) {
 			wlr_log(WLR_ERROR, "Keybind with id '%s' not found", id);
@@ -1627,11 +1961,13 @@ run_action(struct view *view, struct server *server, struct action *action,
 		if (keybind->enabled) {
 			keybind->enabled = false;
 			wlr_log(WLR_INFO, "Disabled keybind with id '%s'", id);
+			ipc_emit(IPC_EVENT_KEYBIND);
 		} else {
 			/* Check condition before enabling */
 			if (keybind_check_condition_sync(keybind)) {
 				keybind->enabled = true;
 				wlr_log(WLR_INFO, "Enabled keybind with id '%s'", id);
+				ipc_emit(IPC_EVENT_KEYBIND);
 			} else {
 				wlr_log(WLR_INFO, "Keybind with id '%s' condition not met, not enabling", id);
 			}
@@ -1661,6 +1997,7 @@ actions_run(struct view *activator, struct server *server,
 		wlr_log(WLR_ERROR, "empty actions");
 		return;
 	}
+	trace_begin("actions_run");
 
 	/* This cancels any pending on-release keybinds */
 	keyboard_reset_current_keybind();
@@ -1689,6 +2026,11 @@ actions_run(struct view *activator, struct server *server,
 		 */
 		struct view *view = view_for_action(activator, server, action, &ctx);
 
+		uint64_t start = stats_start();
 		run_action(view, server, action, &ctx);
+		if (action->type < ARRAY_SIZE(stats.actions)) {
+			stats_record(&stats.actions[action->type], start);
+		}
 	}
+	trace_end("actions_run");
 }
@@ -27,11 +27,157 @@
 #include "buffer.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <drm_fourcc.h>
+#include <glib.h>
 #include <wlr/interfaces/wlr_buffer.h>
 #include <wlr/util/log.h>
 #include "common/box.h"
+#include "common/macros.h"
 #include "common/mem.h"
+#include "common/pixel-convert.h"
+#include "metrics.h"
+
+/* Text is rendered on worker threads, so the counters need a lock */
+static GMutex stats_lock;
+static struct {
+	size_t count[BUFFER_NR_CATEGORIES];
+	size_t bytes[BUFFER_NR_CATEGORIES];
+	size_t peak[BUFFER_NR_CATEGORIES];
+	size_t total_peak;
+} stats;
+
+static const char *const category_names[BUFFER_NR_CATEGORIES] = {
+	[BUFFER_OTHER] = "other",
+	[BUFFER_TITLE] = "title",
+	[BUFFER_MENU] = "menu",
+	[BUFFER_ICON] = "icon",
+	[BUFFER_BUTTON] = "button",
+	[BUFFER_SHADOW] = "shadow",
+	[BUFFER_OSD] = "osd",
+	[BUFFER_THUMBNAIL] = "thumbnail",
+};
+
+static size_t
+get_total_bytes(void)
+{
+	size_t total = 0;
+	for (int i = 0; i < BUFFER_NR_CATEGORIES; i++) {
+		total += stats.bytes[i];
+	}
+	return total;
+}
+
+static void
+account_add(enum buffer_category category, size_t bytes)
+{
+	assert(category < BUFFER_NR_CATEGORIES);
+	g_mutex_lock(&stats_lock);
+	stats.count[category]++;
+	stats.bytes[category] += bytes;
+	stats.peak[category] = MAX(stats.peak[category], stats.bytes[category]);
+	stats.total_peak = MAX(stats.total_peak, get_total_bytes());
+	g_mutex_unlock(&stats_lock);
+}
+
+static void
+account_remove(enum buffer_category category, size_t bytes)
+{
+	assert(category < BUFFER_NR_CATEGORIES);
+	g_mutex_lock(&stats_lock);
+	assert(stats.count[category] && stats.bytes[category] >= bytes);
+	stats.count[category]--;
+	stats.bytes[category] -= bytes;
+	g_mutex_unlock(&stats_lock);
+}
+
+void
+buffer_account(enum buffer_category category, ssize_t bytes)
+{
+	if (bytes >= 0) {
+		account_add(category, bytes);
+	} else {
+		account_remove(category, -bytes);
+	}
+}
+
+void
+buffer_stats_print(FILE *stream)
+{
+	g_mutex_lock(&stats_lock);
+	fprintf(stream, "%-10s %8s %12s %12s\n", "category", "buffers",
+		"bytes", "peak");
+	for (int i = 0; i < BUFFER_NR_CATEGORIES; i++) {
+		fprintf(stream, "%-10s %8zu %12zu %12zu\n", category_names[i],
+			stats.count[i], stats.bytes[i], stats.peak[i]);
+	}
+	fprintf(stream, "%-10s %8s %12zu %12zu\n", "total", "",
+		get_total_bytes(), stats.total_peak);
+	g_mutex_unlock(&stats_lock);
+}
+
+void
+buffer_stats_get_bytes(size_t bytes[BUFFER_NR_CATEGORIES])
+{
+	g_mutex_lock(&stats_lock);
+	memcpy(bytes, stats.bytes, sizeof(stats.bytes));
+	g_mutex_unlock(&stats_lock);
+}
+
+const char *
+buffer_category_name(enum buffer_category category)
+{
+	assert(category < BUFFER_NR_CATEGORIES);
+	return category_names[category];
+}
+
+/* Buffers are also allocated on worker threads, hence the lock */
+static uint64_t
+read_category_bytes(void *data)
+{
+	size_t category = GPOINTER_TO_SIZE(data);
+	g_mutex_lock(&stats_lock);
+	size_t bytes = stats.bytes[category];
+	g_mutex_unlock(&stats_lock);
+	return bytes;
+}
+
+static uint64_t
+read_category_count(void *data)
+{
+	size_t category = GPOINTER_TO_SIZE(data);
+	g_mutex_lock(&stats_lock);
+	size_t count = stats.count[category];
+	g_mutex_unlock(&stats_lock);
+	return count;
+}
+
+void
+buffer_add_metrics(void)
+{
+	for (size_t i = 0; i < BUFFER_NR_CATEGORIES; i++) {
+		char labels[64];
+		snprintf(labels, sizeof(labels), "category=\"%s\"",
+			category_names[i]);
+		metrics_add_fn("buffer_bytes", labels, "Bytes of live buffers",
+			METRIC_GAUGE, read_category_bytes,
+			GSIZE_TO_POINTER(i), NULL);
+		metrics_add_fn("buffers", labels, "Live buffers",
+			METRIC_GAUGE, read_category_count,
+			GSIZE_TO_POINTER(i), NULL);
+	}
+}
+
+void
+buffer_stats_reset_peaks(void)
+{
+	g_mutex_lock(&stats_lock);
+	for (int i = 0; i < BUFFER_NR_CATEGORIES; i++) {
+		stats.peak[i] = stats.bytes[i];
+	}
+	stats.total_peak = get_total_bytes();
+	g_mutex_unlock(&stats_lock);
+}
 
 static struct lab_data_buffer *data_buffer_from_buffer(
 	struct wlr_buffer *buffer);
@@ -40,6 +186,10 @@ static void
 data_buffer_destroy(struct wlr_buffer *wlr_buffer)
 {
 	struct lab_data_buffer *buffer = data_buffer_from_buffer(wlr_buffer);
+	account_remove(buffer->category, buffer->bytes);
+	if (buffer->half) {
+		wlr_buffer_drop(&buffer->half->base);
+	}
 	/* this also frees buffer->data if surface_owns_data == true */
 	cairo_surface_destroy(buffer->surface);
 	if (!buffer->surface_owns_data) {
@@ -81,6 +231,37 @@ data_buffer_from_buffer(struct wlr_buffer *buffer)
 	return (struct lab_data_buffer *)buffer;
 }
 
+/* Called once the stride and size of a new buffer are known */
+static void
+account_new_buffer(struct lab_data_buffer *buffer)
+{
+	buffer->bytes = buffer->stride * buffer->base.height;
+	account_add(BUFFER_OTHER, buffer->bytes);
+}
+
+void
+buffer_set_category(struct lab_data_buffer *buffer,
+		enum buffer_category category)
+{
+	for (; buffer; buffer = buffer->half) {
+		if (buffer->category != BUFFER_OTHER || category == BUFFER_OTHER) {
+			return;
+		}
+		account_remove(BUFFER_OTHER, buffer->bytes);
+		buffer->category = category;
+		account_add(category, buffer->bytes);
+	}
+}
+
+struct lab_data_buffer *
+buffer_try_from_wlr_buffer(struct wlr_buffer *buffer)
+{
+	if (!buffer || buffer->impl != &data_buffer_impl) {
+		return NULL;
+	}
+	return (struct lab_data_buffer *)buffer;
+}
+
 struct lab_data_buffer *
 buffer_adopt_cairo_surface(cairo_surface_t *surface)
 {
@@ -100,6 +281,7 @@ buffer_adopt_cairo_surface(cairo_surface_t *surface)
 	buffer->logical_width = width;
 	buffer->logical_height = height;
 	buffer->surface_owns_data = true;
+	account_new_buffer(buffer);
 
 	return buffer;
 }
@@ -147,6 +329,7 @@ buffer_create_from_data(void *pixel_data, uint32_t width, uint32_t height,
 	buffer->surface = cairo_image_surface_create_for_data(
 		pixel_data, CAIRO_FORMAT_ARGB32, width, height, stride);
 	buffer->surface_owns_data = false;
+	account_new_buffer(buffer);
 	return buffer;
 }
 
@@ -161,19 +344,64 @@ buffer_create_from_wlr_buffer(struct wlr_buffer *wlr_buffer)
 		wlr_log(WLR_ERROR, "failed to access wlr_buffer");
 		return NULL;
 	}
-	if (format != DRM_FORMAT_ARGB8888) {
+	if (format != DRM_FORMAT_ARGB8888 && format != DRM_FORMAT_XRGB8888
+			&& format != DRM_FORMAT_ABGR8888
+			&& format != DRM_FORMAT_XBGR8888) {
 		/* TODO: support other formats */
 		wlr_buffer_end_data_ptr_access(wlr_buffer);
 		wlr_log(WLR_ERROR, "cannot create buffer: format=%d", format);
 		return NULL;
 	}
-	size_t buffer_size = stride * wlr_buffer->height;
-	void *copied_data = xmalloc(buffer_size);
-	memcpy(copied_data, data, buffer_size);
+
+	/* Convert to ARGB8888 row by row, as the stride may include padding */
+	int width = wlr_buffer->width;
+	int height = wlr_buffer->height;
+	uint32_t *copied_data = xmalloc((size_t)width * height * 4);
+	for (int y = 0; y < height; y++) {
+		const uint32_t *src = (const uint32_t *)((const char *)data + y * stride);
+		uint32_t *dst = copied_data + (size_t)y * width;
+		switch (format) {
+		case DRM_FORMAT_ARGB8888:
+			memcpy(dst, src, width * 4);
+			break;
+		case DRM_FORMAT_XRGB8888:
+			pixel_set_opaque(dst, src, width);
+			break;
+		case DRM_FORMAT_ABGR8888:
+			pixel_swap_red_blue(dst, src, width);
+			break;
+		case DRM_FORMAT_XBGR8888:
+			pixel_swap_red_blue(dst, src, width);
+			pixel_set_opaque(dst, dst, width);
+			break;
+		}
+	}
 	wlr_buffer_end_data_ptr_access(wlr_buffer);
 
-	return buffer_create_from_data(copied_data,
-		wlr_buffer->width, wlr_buffer->height, stride);
+	return buffer_create_from_data(copied_data, width, height, width * 4);
+}
+
+static struct lab_data_buffer *
+get_half_buffer(struct lab_data_buffer *buffer)
+{
+	if (buffer->half) {
+		return buffer->half;
+	}
+	cairo_surface_t *surface = buffer->surface;
+	int src_w = cairo_image_surface_get_width(surface);
+	int src_h = cairo_image_surface_get_height(surface);
+	int width = MAX(src_w / 2, 1);
+	int height = MAX(src_h / 2, 1);
+
+	cairo_surface_flush(surface);
+	uint32_t *data = xmalloc((size_t)width * height * 4);
+	pixel_downscale_half(data, width * 4,
+		(const uint32_t *)cairo_image_surface_get_data(surface),
+		cairo_image_surface_get_stride(surface), src_w, src_h);
+	buffer->half = buffer_create_from_data(data, width, height, width * 4);
+	buffer->half->opaque = buffer->opaque;
+	buffer_set_category(buffer->half, buffer->category);
+	return buffer->half;
 }
 
 struct lab_data_buffer *
@@ -186,16 +414,26 @@ buffer_resize(struct lab_data_buffer *src_buffer, int width, int height,
 	int src_w = cairo_image_surface_get_width(surface);
 	int src_h = cairo_image_surface_get_height(surface);
 
-	struct lab_data_buffer *buffer =
-		buffer_create_cairo(width, height, scale);
-	cairo_t *cairo = cairo_create(buffer->surface);
-
 	struct wlr_box container = {
 		.width = width,
 		.height = height,
 	};
-
 	struct wlr_box dst_box = box_fit_within(src_w, src_h, &container);
+
+	/* Halve the source while it is at least twice the output size */
+	while (src_w >= 2 * dst_box.width * scale
+			&& src_h >= 2 * dst_box.height * scale
+			&& src_w > 1 && src_h > 1) {
+		src_buffer = get_half_buffer(src_buffer);
+		surface = src_buffer->surface;
+		src_w = cairo_image_surface_get_width(surface);
+		src_h = cairo_image_surface_get_height(surface);
+	}
+
+	struct lab_data_buffer *buffer =
+		buffer_create_cairo(width, height, scale);
+	cairo_t *cairo = cairo_create(buffer->surface);
+
 	double scene_scale = (double)dst_box.width / (double)src_w;
 	cairo_translate(cairo, dst_box.x, dst_box.y);
 	cairo_scale(cairo, scene_scale, scene_scale);
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* For syscall() */
+#define _GNU_SOURCE
+#include "child-watch.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "common/list.h"
+#include "common/mem.h"
+
+struct child_watch {
+	pid_t pid;
+	int pidfd;
+	struct wl_event_source *source;
+	struct wl_list link;
+};
+
+static struct {
+	struct wl_event_loop *loop;
+	void (*child_exited)(pid_t pid, int code, int status, void *data);
+	void *data;
+	struct wl_list watches;
+	bool unsupported;
+} state;
+
+static int
+pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	/* pidfds are always close-on-exec */
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void
+watch_destroy(struct child_watch *watch)
+{
+	wl_event_source_remove(watch->source);
+	close(watch->pidfd);
+	wl_list_remove(&watch->link);
+	free(watch);
+}
+
+/* Reap the child if it has exited, with @flags added to waitid() */
+static void
+watch_reap(struct child_watch *watch, int flags)
+{
+	siginfo_t info = { 0 };
+	if (waitid(P_PID, watch->pid, &info, WEXITED | flags) == -1) {
+		/* Someone else reaped it, there is nothing to report */
+		if (errno == ECHILD) {
+			watch_destroy(watch);
+		}
+		return;
+	}
+	if (!info.si_pid) {
+		return;
+	}
+	pid_t pid = watch->pid;
+	watch_destroy(watch);
+	state.child_exited(pid, info.si_code, info.si_status, state.data);
+}
+
+static int
+handle_pidfd(int fd, uint32_t mask, void *data)
+{
+	/* A readable pidfd means the process has exited */
+	watch_reap(data, WNOHANG);
+	return 0;
+}
+
+void
+child_watch_init(struct wl_event_loop *loop,
+		void (*child_exited)(pid_t pid, int code, int status, void *data),
+		void *data)
+{
+	state.loop = loop;
+	state.child_exited = child_exited;
+	state.data = data;
+	wl_list_init(&state.watches);
+}
+
+void
+child_watch_finish(void)
+{
+	if (!state.loop) {
+		return;
+	}
+	struct child_watch *watch, *tmp;
+	wl_list_for_each_safe(watch, tmp, &state.watches, link) {
+		watch_destroy(watch);
+	}
+	state.loop = NULL;
+}
+
+void
+child_watch_add(pid_t pid)
+{
+	if (!state.loop || state.unsupported) {
+		return;
+	}
+	int pidfd = pidfd_open(pid);
+	if (pidfd < 0) {
+		if (errno == ENOSYS) {
+			wlr_log(WLR_INFO, "no pidfd support, reaping children "
+				"on SIGCHLD only");
+			state.unsupported = true;
+		} else {
+			wlr_log_errno(WLR_ERROR, "pidfd_open(%ld)", (long)pid);
+		}
+		return;
+	}
+
+	struct child_watch *watch = znew(*watch);
+	watch->source = wl_event_loop_add_fd(state.loop, pidfd,
+		WL_EVENT_READABLE, handle_pidfd, watch);
+	if (!watch->source) {
+		wlr_log(WLR_ERROR, "cannot watch child %ld", (long)pid);
+		close(pidfd);
+		free(watch);
+		return;
+	}
+	watch->pid = pid;
+	watch->pidfd = pidfd;
+	wl_list_append(&state.watches, &watch->link);
+}
+
+bool
+child_watch_reap(pid_t pid)
+{
+	if (!state.loop) {
+		return false;
+	}
+	struct child_watch *watch;
+	wl_list_for_each(watch, &state.watches, link) {
+		if (watch->pid == pid) {
+			/* The caller knows that it is waitable */
+			watch_reap(watch, 0);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "common/arena.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "common/mem.h"
+
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static size_t
+align_up(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+	if (!size) {
+		return NULL;
+	}
+	if (size > SIZE_MAX - ARENA_CHUNK_SIZE - sizeof(struct arena_chunk)) {
+		die_if_null(NULL);
+	}
+	size = align_up(size);
+
+	struct arena_chunk *chunk = arena->chunks;
+	if (!chunk || chunk->size - chunk->used < size) {
+		/* Objects larger than a chunk get a chunk of their own */
+		size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		struct arena_chunk *new_chunk =
+			xmalloc(sizeof(*new_chunk) + chunk_size);
+		new_chunk->size = chunk_size;
+		new_chunk->used = 0;
+		if (chunk && chunk_size > ARENA_CHUNK_SIZE) {
+			/* Keep filling the current chunk */
+			new_chunk->next = chunk->next;
+			chunk->next = new_chunk;
+		} else {
+			new_chunk->next = chunk;
+			arena->chunks = new_chunk;
+		}
+		chunk = new_chunk;
+	}
+
+	void *ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+char *
+arena_strdup(struct arena *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *copy = arena_alloc(arena, len);
+	memcpy(copy, str, len);
+	return copy;
+}
+
+void
+arena_finish(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->chunks;
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->chunks = NULL;
+}
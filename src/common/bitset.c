@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "common/bitset.h"
+#include <wlr/util/log.h>
+
+bool
+lab_bitset_contains(const struct lab_bitset *set, uint32_t value)
+{
+	if (value > LAB_BITSET_MAX_VALUE) {
+		return false;
+	}
+	return set->words[value / 64] & (UINT64_C(1) << (value % 64));
+}
+
+void
+lab_bitset_add(struct lab_bitset *set, uint32_t value)
+{
+	if (value > LAB_BITSET_MAX_VALUE) {
+		wlr_log(WLR_ERROR, "lab_bitset value %u out of range", value);
+		return;
+	}
+	set->words[value / 64] |= UINT64_C(1) << (value % 64);
+}
+
+void
+lab_bitset_remove(struct lab_bitset *set, uint32_t value)
+{
+	if (value > LAB_BITSET_MAX_VALUE) {
+		return;
+	}
+	set->words[value / 64] &= ~(UINT64_C(1) << (value % 64));
+}
+
+int
+lab_bitset_count(const struct lab_bitset *set)
+{
+	int count = 0;
+	for (int i = 0; i < LAB_BITSET_WORDS; i++) {
+		count += __builtin_popcountll(set->words[i]);
+	}
+	return count;
+}
+
+void
+lab_bitset_subtract(struct lab_bitset *dst, const struct lab_bitset *a,
+		const struct lab_bitset *b)
+{
+	for (int i = 0; i < LAB_BITSET_WORDS; i++) {
+		dst->words[i] = a->words[i] & ~b->words[i];
+	}
+}
+
+int
+lab_bitset_to_array(const struct lab_bitset *set, uint32_t *values, int max)
+{
+	int n = 0;
+	for (int i = 0; i < LAB_BITSET_WORDS; i++) {
+		uint64_t word = set->words[i];
+		while (word && n < max) {
+			values[n++] = i * 64 + __builtin_ctzll(word);
+			/* Clear the lowest set bit */
+			word &= word - 1;
+		}
+	}
+	return n;
+}
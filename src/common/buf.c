@@ -15,32 +15,22 @@ void
 buf_expand_tilde(struct buf *s)
 {
 	struct buf tmp = BUF_INIT;
-	for (int i = 0 ; i < s->len ; i++) {
+	size_t start = 0;
+	for (size_t i = 0; i < s->len; i++) {
 		if (s->data[i] == '~') {
+			buf_add_n(&tmp, s->data + start, i - start);
 			buf_add(&tmp, getenv("HOME"));
-		} else {
-			buf_add_char(&tmp, s->data[i]);
+			start = i + 1;
 		}
 	}
+	buf_add_n(&tmp, s->data + start, s->len - start);
 	buf_move(s, &tmp);
 }
 
-static void
-strip_curly_braces(char *s)
-{
-	size_t len = strlen(s);
-	if (s[0] != '{' || s[len - 1] != '}') {
-		return;
-	}
-	len -= 2;
-	memmove(s, s + 1, len);
-	s[len] = 0;
-}
-
 static bool
 isvalid(char p)
 {
-	return isalnum(p) || p == '_' || p == '{' || p == '}';
+	return isalnum((unsigned char)p) || p == '_' || p == '{' || p == '}';
 }
 
 void
@@ -49,32 +39,40 @@ buf_expand_shell_variables(struct buf *s)
 	struct buf tmp = BUF_INIT;
 	struct buf environment_variable = BUF_INIT;
 
-	for (int i = 0 ; i < s->len ; i++) {
-		if (s->data[i] == '$' && isvalid(s->data[i+1])) {
-			/* expand environment variable */
-			buf_clear(&environment_variable);
-			buf_add(&environment_variable, s->data + i + 1);
-			char *p = environment_variable.data;
-			while (isvalid(*p)) {
-				++p;
-			}
-			*p = '\0';
-			i += strlen(environment_variable.data);
-			strip_curly_braces(environment_variable.data);
-			p = getenv(environment_variable.data);
-			if (p) {
-				buf_add(&tmp, p);
-			}
-		} else {
-			buf_add_char(&tmp, s->data[i]);
+	/* s->data[s->len] is NUL, so isvalid() stops at the end */
+	size_t i = 0;
+	while (i < s->len) {
+		/* Copy everything up to the next variable at once */
+		size_t start = i;
+		while (i < s->len && !(s->data[i] == '$'
+				&& isvalid(s->data[i + 1]))) {
+			i++;
+		}
+		buf_add_n(&tmp, s->data + start, i - start);
+		if (i == s->len) {
+			break;
 		}
+
+		/* expand environment variable */
+		const char *name = s->data + ++i;
+		while (isvalid(s->data[i])) {
+			i++;
+		}
+		size_t len = s->data + i - name;
+		if (len >= 2 && name[0] == '{' && name[len - 1] == '}') {
+			name++;
+			len -= 2;
+		}
+		buf_clear(&environment_variable);
+		buf_add_n(&environment_variable, name, len);
+		buf_add(&tmp, getenv(environment_variable.data));
 	}
 	buf_reset(&environment_variable);
 	buf_move(s, &tmp);
 }
 
 static void
-buf_expand(struct buf *s, int new_alloc)
+buf_expand(struct buf *s, size_t new_alloc)
 {
 	/*
 	 * "s->alloc &&" ensures that s->data is always allocated after
@@ -86,7 +84,7 @@ buf_expand(struct buf *s, int new_alloc)
 		return;
 	}
 	new_alloc = MAX(new_alloc, 256);
-	new_alloc = MAX(new_alloc, s->alloc * 3 / 2);
+	new_alloc = MAX(new_alloc, s->alloc * 2);
 	if (s->alloc) {
 		assert(s->data);
 		s->data = xrealloc(s->data, new_alloc);
@@ -106,22 +104,22 @@ buf_add_fmt(struct buf *s, const char *fmt, ...)
 	}
 	va_list ap;
 
+	/* Usually the result fits into the spare room, so format only once */
+	buf_expand(s, s->len + 1);
+	size_t avail = s->alloc - s->len;
 	va_start(ap, fmt);
-	int n = vsnprintf(NULL, 0, fmt, ap);
+	int n = vsnprintf(s->data + s->len, avail, fmt, ap);
 	va_end(ap);
 
-	if (n < 0) {
-		return;
+	if (n >= 0 && (size_t)n >= avail) {
+		buf_expand(s, s->len + n + 1);
+		va_start(ap, fmt);
+		n = vsnprintf(s->data + s->len, s->alloc - s->len, fmt, ap);
+		va_end(ap);
 	}
 
-	size_t size = (size_t)n + 1;
-	buf_expand(s, s->len + size);
-
-	va_start(ap, fmt);
-	n = vsnprintf(s->data + s->len, size, fmt, ap);
-	va_end(ap);
-
 	if (n < 0) {
+		s->data[s->len] = 0;
 		return;
 	}
 
@@ -154,18 +152,26 @@ buf_add_hex_color(struct buf *s, float color[4])
 }
 
 void
-buf_add(struct buf *s, const char *data)
+buf_add_n(struct buf *s, const char *data, size_t len)
 {
-	if (string_null_or_empty(data)) {
+	if (!len) {
 		return;
 	}
-	int len = strlen(data);
 	buf_expand(s, s->len + len + 1);
 	memcpy(s->data + s->len, data, len);
 	s->len += len;
 	s->data[s->len] = 0;
 }
 
+void
+buf_add(struct buf *s, const char *data)
+{
+	if (string_null_or_empty(data)) {
+		return;
+	}
+	buf_add_n(s, data, strlen(data));
+}
+
 void
 buf_add_char(struct buf *s, char ch)
 {
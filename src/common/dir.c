@@ -4,14 +4,21 @@
  *
  * Copyright Johan Malm 2020
  */
+#define _POSIX_C_SOURCE 200809L
 #include "common/dir.h"
 #include <assert.h>
+#include <errno.h>
 #include <glib.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <wlr/util/log.h>
 #include "common/buf.h"
+#include "common/hash.h"
 #include "common/list.h"
 #include "common/mem.h"
+#include "common/time-helpers.h"
 #include "common/string-helpers.h"
 #include "config/rcxml.h"
 
@@ -52,6 +59,18 @@ static struct dir theme_dirs[] = {
 	}
 };
 
+static struct dir data_dirs[] = {
+	{
+		.prefix = "XDG_DATA_HOME",
+		.default_prefix = "$HOME/.local/share",
+	}, {
+		.prefix = "XDG_DATA_DIRS",
+		.default_prefix = "/usr/local/share:/usr/share",
+	}, {
+		.path = NULL,
+	}
+};
+
 struct ctx {
 	void (*build_path_fn)(struct ctx *ctx, char *prefix, const char *path);
 	const char *filename;
@@ -72,6 +91,13 @@ build_config_path(struct ctx *ctx, char *prefix, const char *path)
 	snprintf(ctx->buf, ctx->len, "%s/%s/%s", prefix, path, ctx->filename);
 }
 
+static void
+build_data_path(struct ctx *ctx, char *prefix, const char *path)
+{
+	assert(prefix);
+	snprintf(ctx->buf, ctx->len, "%s/%s", prefix, ctx->filename);
+}
+
 static void
 build_theme_path_labwc(struct ctx *ctx, char *prefix, const char *path)
 {
@@ -94,7 +120,7 @@ find_dir(struct ctx *ctx)
 	char *debug = getenv("LABWC_DEBUG_DIR_CONFIG_AND_THEME");
 
 	struct buf prefix = BUF_INIT;
-	for (int i = 0; ctx->dirs[i].path; i++) {
+	for (int i = 0; ctx->dirs[i].prefix; i++) {
 		struct dir d = ctx->dirs[i];
 		buf_clear(&prefix);
 
@@ -172,7 +198,7 @@ void
 paths_theme_create(struct wl_list *paths, const char *theme_name,
 		const char *filename)
 {
-	static char buf[4096] = { 0 };
+	char buf[4096] = { 0 };
 	wl_list_init(paths);
 	struct ctx ctx = {
 		.build_path_fn = build_theme_path_labwc,
@@ -189,6 +215,87 @@ paths_theme_create(struct wl_list *paths, const char *theme_name,
 	find_dir(&ctx);
 }
 
+void
+paths_data_create(struct wl_list *paths, const char *filename)
+{
+	char buf[4096] = { 0 };
+	wl_list_init(paths);
+	struct ctx ctx = {
+		.build_path_fn = build_data_path,
+		.filename = filename,
+		.buf = buf,
+		.len = sizeof(buf),
+		.dirs = data_dirs,
+		.list = paths,
+	};
+	find_dir(&ctx);
+}
+
+bool
+cache_dir_get(char *path, size_t len, const char *subdir, bool create)
+{
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int ret;
+	if (cache_home && *cache_home) {
+		ret = snprintf(path, len, "%s/labwc", cache_home);
+	} else if (home && *home) {
+		ret = snprintf(path, len, "%s/.cache/labwc", home);
+	} else {
+		return false;
+	}
+	if (ret < 0 || (size_t)ret >= len) {
+		return false;
+	}
+	if (create && mkdir(path, 0755) && errno != EEXIST) {
+		return false;
+	}
+	if (!subdir) {
+		return true;
+	}
+	size_t dir_len = strlen(path);
+	ret = snprintf(path + dir_len, len - dir_len, "/%s", subdir);
+	if (ret < 0 || (size_t)ret >= len - dir_len) {
+		return false;
+	}
+	if (create && mkdir(path, 0755) && errno != EEXIST) {
+		wlr_log_errno(WLR_DEBUG, "cannot create %s", path);
+		return false;
+	}
+	return true;
+}
+
+static uint64_t
+hash_stat(uint64_t hash, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st)) {
+		return hash;
+	}
+	hash = hash_add_str(hash, path);
+	hash = hash_add(hash, &st.st_size, sizeof(st.st_size));
+	uint64_t mtime = timespec_to_nsec(&st.st_mtim);
+	hash = hash_add(hash, &mtime, sizeof(mtime));
+	return hash;
+}
+
+uint64_t
+paths_hash(struct wl_list *paths, bool with_dirs)
+{
+	uint64_t hash = HASH_INIT;
+	struct path *path;
+	wl_list_for_each(path, paths, link) {
+		hash = hash_stat(hash, path->string);
+		if (!with_dirs) {
+			continue;
+		}
+		char *dir = g_path_get_dirname(path->string);
+		hash = hash_stat(hash, dir);
+		g_free(dir);
+	}
+	return hash;
+}
+
 void
 paths_destroy(struct wl_list *paths)
 {
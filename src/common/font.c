@@ -2,11 +2,46 @@
 #include "common/font.h"
 #include <cairo.h>
 #include <pango/pangocairo.h>
+#include <wayland-util.h>
 #include <wlr/util/log.h>
 #include "common/graphic-helpers.h"
+#include "common/mem.h"
 #include "common/string-helpers.h"
 #include "buffer.h"
 
+/* Number of measured strings remembered per font */
+#define FONT_EXTENTS_CACHE_SIZE 256
+
+struct extents_entry {
+	char *text;
+	PangoRectangle rect;
+	struct wl_list link; /* font_metrics.lru */
+};
+
+/*
+ * Measuring text needs a PangoLayout, which is expensive to set up, so one
+ * layout is kept for each font that has been measured, together with the
+ * font height and the extents of recently measured strings.
+ *
+ * struct font is copied around freely, so the cache is keyed by the font
+ * attributes rather than attached to the struct itself.
+ */
+struct font_metrics {
+	struct font font; /* owns a copy of font.name */
+	PangoLayout *layout;
+	int height; /* -1 until measured */
+	GHashTable *extents; /* text -> struct extents_entry */
+	struct wl_list lru; /* struct extents_entry.link, recent first */
+	struct wl_list link; /* metrics_cache.fonts */
+};
+
+static struct {
+	cairo_surface_t *surface;
+	cairo_t *cairo;
+	struct wl_list fonts; /* struct font_metrics.link */
+	bool initialized;
+} metrics_cache;
+
 PangoFontDescription *
 font_to_pango_desc(struct font *font)
 {
@@ -18,43 +53,111 @@ font_to_pango_desc(struct font *font)
 	return desc;
 }
 
-static PangoRectangle
-font_extents(struct font *font, const char *string)
+static void
+extents_entry_destroy(gpointer data)
 {
-	PangoRectangle rect = { 0 };
-	if (string_null_or_empty(string)) {
-		return rect;
+	struct extents_entry *entry = data;
+	wl_list_remove(&entry->link);
+	free(entry->text);
+	free(entry);
+}
+
+static struct font_metrics *
+get_font_metrics(struct font *font)
+{
+	if (!metrics_cache.initialized) {
+		wl_list_init(&metrics_cache.fonts);
+		metrics_cache.initialized = true;
+	}
+
+	struct font_metrics *metrics;
+	wl_list_for_each(metrics, &metrics_cache.fonts, link) {
+		if (str_equal(metrics->font.name, font->name)
+				&& metrics->font.size == font->size
+				&& metrics->font.slant == font->slant
+				&& metrics->font.weight == font->weight) {
+			return metrics;
+		}
+	}
+
+	if (!metrics_cache.cairo) {
+		metrics_cache.surface =
+			cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+		metrics_cache.cairo = cairo_create(metrics_cache.surface);
 	}
-	cairo_surface_t *surface;
-	cairo_t *c;
-	PangoLayout *layout;
 
-	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
-	c = cairo_create(surface);
-	layout = pango_cairo_create_layout(c);
+	metrics = znew(*metrics);
+	metrics->font = *font;
+	metrics->font.name = font->name ? xstrdup(font->name) : NULL;
+	metrics->height = -1;
+	metrics->extents = g_hash_table_new_full(g_str_hash, g_str_equal,
+		NULL, extents_entry_destroy);
+	wl_list_init(&metrics->lru);
+
+	PangoLayout *layout = pango_cairo_create_layout(metrics_cache.cairo);
 	pango_context_set_round_glyph_positions(pango_layout_get_context(layout), false);
 	PangoFontDescription *desc = font_to_pango_desc(font);
-
 	pango_layout_set_font_description(layout, desc);
-	pango_layout_set_text(layout, string, -1);
+	pango_font_description_free(desc);
 	pango_layout_set_single_paragraph_mode(layout, TRUE);
 	pango_layout_set_width(layout, -1);
 	pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_MIDDLE);
-	pango_layout_get_extents(layout, NULL, &rect);
+	metrics->layout = layout;
+
+	wl_list_insert(&metrics_cache.fonts, &metrics->link);
+	return metrics;
+}
+
+static PangoRectangle
+measure(struct font_metrics *metrics, const char *string)
+{
+	PangoRectangle rect = { 0 };
+	pango_layout_set_text(metrics->layout, string, -1);
+	pango_layout_get_extents(metrics->layout, NULL, &rect);
 	pango_extents_to_pixels(&rect, NULL);
+	return rect;
+}
 
-	cairo_destroy(c);
-	cairo_surface_destroy(surface);
-	pango_font_description_free(desc);
-	g_object_unref(layout);
+static PangoRectangle
+font_extents(struct font *font, const char *string)
+{
+	PangoRectangle rect = { 0 };
+	if (string_null_or_empty(string)) {
+		return rect;
+	}
+
+	struct font_metrics *metrics = get_font_metrics(font);
+	struct extents_entry *entry =
+		g_hash_table_lookup(metrics->extents, string);
+	if (entry) {
+		wl_list_remove(&entry->link);
+		wl_list_insert(&metrics->lru, &entry->link);
+		return entry->rect;
+	}
+
+	rect = measure(metrics, string);
+
+	if (g_hash_table_size(metrics->extents) >= FONT_EXTENTS_CACHE_SIZE) {
+		struct extents_entry *oldest = wl_container_of(
+			metrics->lru.prev, oldest, link);
+		g_hash_table_remove(metrics->extents, oldest->text);
+	}
+	entry = znew(*entry);
+	entry->text = xstrdup(string);
+	entry->rect = rect;
+	wl_list_insert(&metrics->lru, &entry->link);
+	g_hash_table_insert(metrics->extents, entry->text, entry);
 	return rect;
 }
 
 int
 font_height(struct font *font)
 {
-	PangoRectangle rectangle = font_extents(font, "abcdefg");
-	return rectangle.height;
+	struct font_metrics *metrics = get_font_metrics(font);
+	if (metrics->height < 0) {
+		metrics->height = measure(metrics, "abcdefg").height;
+	}
+	return metrics->height;
 }
 
 int
@@ -91,6 +194,15 @@ font_buffer_create(struct lab_data_buffer **buffer, int max_width,
 		height = computed_height;
 	}
 
+	font_buffer_draw(buffer, width, height, computed_height, text, font,
+		color, bg_pattern, scale);
+}
+
+void
+font_buffer_draw(struct lab_data_buffer **buffer, int width, int height,
+	int text_height, const char *text, struct font *font,
+	const float *color, cairo_pattern_t *bg_pattern, double scale)
+{
 	*buffer = buffer_create_cairo(width, height, scale);
 	if (!*buffer) {
 		wlr_log(WLR_ERROR, "Failed to create font buffer");
@@ -114,11 +226,12 @@ font_buffer_create(struct lab_data_buffer **buffer, int max_width,
 	if (opaque_bg) {
 		cairo_set_source(cairo, bg_pattern);
 		cairo_paint(cairo);
+		(*buffer)->opaque = true;
 	}
 
 	set_cairo_color(cairo, color);
 	/* center vertically if height was explicitly specified */
-	cairo_move_to(cairo, 0, (height - computed_height) / 2);
+	cairo_move_to(cairo, 0, (height - text_height) / 2);
 
 	PangoLayout *layout = pango_cairo_create_layout(cairo);
 	pango_context_set_round_glyph_positions(pango_layout_get_context(layout), false);
@@ -150,5 +263,21 @@ font_buffer_create(struct lab_data_buffer **buffer, int max_width,
 void
 font_finish(void)
 {
+	if (metrics_cache.initialized) {
+		struct font_metrics *metrics, *tmp;
+		wl_list_for_each_safe(metrics, tmp, &metrics_cache.fonts, link) {
+			g_hash_table_destroy(metrics->extents);
+			g_object_unref(metrics->layout);
+			free(metrics->font.name);
+			wl_list_remove(&metrics->link);
+			free(metrics);
+		}
+	}
+	if (metrics_cache.cairo) {
+		cairo_destroy(metrics_cache.cairo);
+		cairo_surface_destroy(metrics_cache.surface);
+		metrics_cache.cairo = NULL;
+		metrics_cache.surface = NULL;
+	}
 	pango_cairo_font_map_set_default(NULL);
 }
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "common/intern.h"
+#include <assert.h>
+#include <glib.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/mem.h"
+
+struct interned {
+	int refcount;
+	/* Lower-case version, the entry itself if @str has no upper case */
+	struct interned *folded;
+	char str[];
+};
+
+/* Keyed by the string of the entry */
+static GHashTable *table;
+
+static struct interned *
+entry_from_str(const char *str)
+{
+	return (struct interned *)(str - offsetof(struct interned, str));
+}
+
+const char *
+lab_intern(const char *str)
+{
+	if (!str) {
+		return NULL;
+	}
+	if (!table) {
+		table = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	struct interned *entry = g_hash_table_lookup(table, str);
+	if (entry) {
+		entry->refcount++;
+		return entry->str;
+	}
+
+	size_t len = strlen(str);
+	entry = xzalloc(sizeof(*entry) + len + 1);
+	memcpy(entry->str, str, len + 1);
+	entry->refcount = 1;
+	g_hash_table_insert(table, entry->str, entry);
+
+	char *lower = g_ascii_strdown(str, len);
+	if (strcmp(lower, str)) {
+		/* The lower-case entry is kept alive by this one */
+		entry->folded = entry_from_str(lab_intern(lower));
+	} else {
+		entry->folded = entry;
+	}
+	g_free(lower);
+	return entry->str;
+}
+
+void
+lab_intern_unref(const char *str)
+{
+	if (!str) {
+		return;
+	}
+	struct interned *entry = entry_from_str(str);
+	assert(entry->refcount > 0);
+	if (--entry->refcount) {
+		return;
+	}
+
+	g_hash_table_remove(table, entry->str);
+	struct interned *folded = entry->folded != entry ? entry->folded : NULL;
+	free(entry);
+	/* The lower-case entry, if any, is still in the table */
+	if (!g_hash_table_size(table)) {
+		g_hash_table_destroy(table);
+		table = NULL;
+	}
+	if (folded) {
+		lab_intern_unref(folded->str);
+	}
+}
+
+const char *
+lab_intern_folded(const char *str)
+{
+	return str ? entry_from_str(str)->folded->str : NULL;
+}
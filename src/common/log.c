@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "common/log.h"
+#include <stdlib.h>
+#include <string.h>
+#include "common/buf.h"
+#include "common/macros.h"
+#include "common/mem.h"
+
+uint32_t lab_log_categories;
+
+static const struct {
+	const char *name;
+	enum lab_log_category category;
+} categories[] = {
+	{ "keyboard", LAB_LOG_KEYBOARD },
+	{ "cursor", LAB_LOG_CURSOR },
+	{ "tiling", LAB_LOG_TILING },
+	{ "ipc", LAB_LOG_IPC },
+	{ "menu", LAB_LOG_MENU },
+};
+
+static bool
+parse_name(const char *name, uint32_t *mask)
+{
+	if (!strcmp(name, "all")) {
+		*mask |= LAB_LOG_ALL;
+		return true;
+	}
+	if (!strcmp(name, "none")) {
+		return true;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(categories); i++) {
+		if (!strcmp(name, categories[i].name)) {
+			*mask |= categories[i].category;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+lab_log_parse_categories(const char *list, uint32_t *mask)
+{
+	char *copy = xstrdup(list);
+	uint32_t result = 0;
+	bool ok = true;
+	char *saveptr = NULL;
+	for (char *name = strtok_r(copy, ", \t", &saveptr); name;
+			name = strtok_r(NULL, ", \t", &saveptr)) {
+		if (!parse_name(name, &result)) {
+			ok = false;
+			break;
+		}
+	}
+	free(copy);
+	if (ok) {
+		*mask = result;
+	}
+	return ok;
+}
+
+void
+lab_log_print_categories(struct buf *buf, uint32_t mask)
+{
+	bool first = true;
+	for (size_t i = 0; i < ARRAY_SIZE(categories); i++) {
+		if (mask & categories[i].category) {
+			buf_add_fmt(buf, "%s%s", first ? "" : ",",
+				categories[i].name);
+			first = false;
+		}
+	}
+	if (first) {
+		buf_add(buf, "none");
+	}
+}
@@ -1,10 +1,148 @@
 // SPDX-License-Identifier: GPL-2.0-only
-
 #include "common/match.h"
+#include <ctype.h>
 #include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "common/intern.h"
+#include "common/mem.h"
 
 bool
 match_glob(const char *pattern, const char *string)
 {
 	return fnmatch(pattern, string, FNM_CASEFOLD) == 0;
 }
+
+/*
+ * Only ASCII literals are matched by hand. FNM_CASEFOLD folds multibyte
+ * characters according to the locale, which we leave to fnmatch().
+ */
+static bool
+is_plain_literal(const char *s, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = s[i];
+		if (c >= 0x80 || strchr("*?[\\", c)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+classify(struct match_pattern *match)
+{
+	const char *start = match->pattern;
+	const char *end = start + strlen(start);
+	bool leading_star = false;
+	bool trailing_star = false;
+
+	while (*start == '*') {
+		leading_star = true;
+		start++;
+	}
+	while (end > start && end[-1] == '*') {
+		trailing_star = true;
+		end--;
+	}
+
+	size_t len = end - start;
+	if (!is_plain_literal(start, len)) {
+		match->kind = MATCH_GLOB;
+		return;
+	}
+	if (!len) {
+		/* Only stars, or the empty pattern matching "" */
+		match->kind = leading_star ? MATCH_ANY : MATCH_EXACT;
+	} else if (leading_star && trailing_star) {
+		match->kind = MATCH_CONTAINS;
+	} else if (leading_star) {
+		match->kind = MATCH_SUFFIX;
+	} else if (trailing_star) {
+		match->kind = MATCH_PREFIX;
+	} else {
+		match->kind = MATCH_EXACT;
+	}
+
+	char *literal = xmalloc(len + 1);
+	for (size_t i = 0; i < len; i++) {
+		literal[i] = tolower((unsigned char)start[i]);
+	}
+	literal[len] = '\0';
+	match->literal = lab_intern(literal);
+	free(literal);
+	match->len = len;
+}
+
+void
+match_pattern_set(struct match_pattern *match, const char *pattern)
+{
+	match_pattern_finish(match);
+	if (pattern) {
+		match->pattern = xstrdup(pattern);
+		classify(match);
+	}
+}
+
+void
+match_pattern_finish(struct match_pattern *match)
+{
+	zfree(match->pattern);
+	lab_intern_unref(match->literal);
+	match->literal = NULL;
+	match->kind = MATCH_ANY;
+	match->len = 0;
+}
+
+static bool
+contains(const char *haystack, const char *needle, size_t len)
+{
+	for (; *haystack; haystack++) {
+		if (!strncasecmp(haystack, needle, len)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+match_pattern_matches(const struct match_pattern *match, const char *string)
+{
+	if (!match->pattern) {
+		return true;
+	}
+	if (!string) {
+		return false;
+	}
+
+	switch (match->kind) {
+	case MATCH_ANY:
+		return true;
+	case MATCH_EXACT:
+		return !strcasecmp(string, match->literal);
+	case MATCH_PREFIX:
+		return !strncasecmp(string, match->literal, match->len);
+	case MATCH_SUFFIX: {
+		size_t len = strlen(string);
+		return len >= match->len && !strcasecmp(
+			string + len - match->len, match->literal);
+	}
+	case MATCH_CONTAINS:
+		return contains(string, match->literal, match->len);
+	case MATCH_GLOB:
+		break;
+	}
+	return match_glob(match->pattern, string);
+}
+
+bool
+match_pattern_matches_interned(const struct match_pattern *match,
+		const char *string)
+{
+	/* Literals are ASCII and lower case, so they are their own folding */
+	if (match->pattern && match->kind == MATCH_EXACT && string) {
+		return lab_intern_folded(string) == match->literal;
+	}
+	return match_pattern_matches(match, string);
+}
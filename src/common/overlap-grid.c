@@ -0,0 +1,475 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "common/overlap-grid.h"
+#include <assert.h>
+#include <stdlib.h>
+#include "common/macros.h"
+#include "common/mem.h"
+
+#define count_index(grid, i, j) ((i) * ((grid)->nr_cols - 1) + (j))
+#define sat_index(grid, i, j) ((i) * (grid)->nr_cols + (j))
+
+static int
+compare_ints(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* Sort and de-duplicate a list of points that define a 1-D grid */
+static int
+order_grid(int *edges, int nedges)
+{
+	/* Sort grid edges */
+	qsort(edges, nedges, sizeof(int), compare_ints);
+
+	/* Skip over non-unique edges, counting the unique ones */
+	/* This is taken almost verbatim from Openbox. */
+	int i = 0;
+	int j = 0;
+
+	while (j < nedges) {
+		int last = edges[j++];
+		edges[i++] = last;
+		while (j < nedges && edges[j] == last) {
+			++j;
+		}
+	}
+
+	return i;
+}
+
+/*
+ * Perform a rightmost binary search along a list of edges in a 1-D grid for
+ * the maximum index j such that edges[j] <= val. The list of edges must be
+ * sorted in increasing order.
+ *
+ * For a returned index j:
+ *
+ * - The index j == -1 implies that val < edges[0].
+ * - An index 0 <= j < (nedges - 1) implies that edges[j] <= val < edges[j + 1].
+ * - The index j == (nedges - 1) implies that edges[nedges - 1] <= val.
+ */
+static int
+find_interval(const int *edges, int nedges, double val)
+{
+	int l = 0;
+	int r = nedges;
+
+	while (l < r) {
+		int m = (l + r) / 2;
+		if (edges[m] > val) {
+			r = m;
+		} else {
+			l = m + 1;
+		}
+	}
+
+	return r - 1;
+}
+
+void
+overlap_grid_finish(struct overlap_grid *grid)
+{
+	assert(grid);
+
+	zfree(grid->rows);
+	zfree(grid->cols);
+	zfree(grid->counts);
+	zfree(grid->sat);
+
+	grid->nr_rows = 0;
+	grid->nr_cols = 0;
+}
+
+/*
+ * Add a column (row) for each box edge within the usable area. By
+ * construction, no box then partially intersects any interval.
+ */
+static void
+build_edges(struct overlap_grid *grid, struct wlr_box usable,
+		const struct wlr_box *boxes, int nr_boxes)
+{
+	/* Number of rows/columns is bounded by two per box plus screen edges */
+	int max_rc = 2 * nr_boxes + 2;
+
+	grid->rows = xzalloc(max_rc * sizeof(int));
+	grid->cols = xzalloc(max_rc * sizeof(int));
+
+	/* First edges of grid are start of usable area of output */
+	int usable_right = usable.x + usable.width;
+	int usable_bottom = usable.y + usable.height;
+
+	grid->cols[0] = usable.x;
+	grid->rows[0] = usable.y;
+
+	grid->cols[1] = usable_right;
+	grid->rows[1] = usable_bottom;
+
+	int nr_rows = 2;
+	int nr_cols = 2;
+
+	for (int n = 0; n < nr_boxes; n++) {
+		const struct wlr_box *box = &boxes[n];
+		int xs[] = { box->x, box->x + box->width };
+		int ys[] = { box->y, box->y + box->height };
+
+		for (int k = 0; k < 2; k++) {
+			/* Add a column if the edge is in the usable region */
+			if (xs[k] > usable.x && xs[k] < usable_right) {
+				assert(nr_cols < max_rc);
+				grid->cols[nr_cols++] = xs[k];
+			}
+			/* Add a row if the edge is in the usable region */
+			if (ys[k] > usable.y && ys[k] < usable_bottom) {
+				assert(nr_rows < max_rc);
+				grid->rows[nr_rows++] = ys[k];
+			}
+		}
+	}
+
+	grid->nr_rows = order_grid(grid->rows, nr_rows);
+	grid->nr_cols = order_grid(grid->cols, nr_cols);
+}
+
+/*
+ * Count the boxes covering each interval. Each box marks the corners of
+ * the intervals it spans in a 2-D difference array, which a prefix sum
+ * then turns into the counts, so this is linear in the grid size rather
+ * than in the grid size times the number of boxes.
+ */
+static void
+build_counts(struct overlap_grid *grid, const struct wlr_box *boxes,
+		int nr_boxes)
+{
+	int nri = grid->nr_rows - 1;
+	int nci = grid->nr_cols - 1;
+
+	for (int n = 0; n < nr_boxes; n++) {
+		const struct wlr_box *box = &boxes[n];
+
+		/*
+		 * Find the first and last row and column intervals spanned by
+		 * this box. We want the left and top edges to fall in a
+		 * half-open interval [low, high) but the right and bottom
+		 * edges to fall in a half-open interval (low, high] to ensure
+		 * that the results do not include intervals adjacent to the
+		 * box. Box edges are guaranteed by construction to fall
+		 * exactly on the grid points, so we perturb the left and top
+		 * edges by +0.5 units, and the right and bottom edges by -0.5
+		 * units, to ensure that we are always searching in the
+		 * interior of an interval.
+		 */
+
+		/* First row and column overlapping the box */
+		int fc = find_interval(grid->cols, grid->nr_cols, box->x + 0.5);
+		int fr = find_interval(grid->rows, grid->nr_rows, box->y + 0.5);
+
+		/* Clip first row/column to start of usable grid */
+		fc = MAX(fc, 0);
+		fr = MAX(fr, 0);
+
+		/* Last row and column overlapping the box */
+		int lc = find_interval(grid->cols, grid->nr_cols,
+			box->x + box->width - 0.5);
+		int lr = find_interval(grid->rows, grid->nr_rows,
+			box->y + box->height - 0.5);
+
+		/*
+		 * Increment the last indices to convert them to strict upper
+		 * bounds, then clip them to the limits of the usable grid.
+		 */
+		lc = MIN(nci, lc + 1);
+		lr = MIN(nri, lr + 1);
+
+		if (fc >= lc || fr >= lr) {
+			/* Outside of the usable area */
+			continue;
+		}
+
+		/* Every interval in [fr, lr) x [fc, lc) is covered */
+		grid->counts[count_index(grid, fr, fc)]++;
+		if (lc < nci) {
+			grid->counts[count_index(grid, fr, lc)]--;
+		}
+		if (lr < nri) {
+			grid->counts[count_index(grid, lr, fc)]--;
+		}
+		if (lc < nci && lr < nri) {
+			grid->counts[count_index(grid, lr, lc)]++;
+		}
+	}
+
+	for (int i = 0; i < nri; i++) {
+		for (int j = 0; j < nci; j++) {
+			int *count = &grid->counts[count_index(grid, i, j)];
+			if (i > 0) {
+				*count += grid->counts[count_index(grid, i - 1, j)];
+			}
+			if (j > 0) {
+				*count += grid->counts[count_index(grid, i, j - 1)];
+			}
+			if (i > 0 && j > 0) {
+				*count -= grid->counts[count_index(grid, i - 1, j - 1)];
+			}
+		}
+	}
+}
+
+static void
+build_sat(struct overlap_grid *grid)
+{
+	for (int i = 1; i < grid->nr_rows; i++) {
+		int64_t rh = grid->rows[i] - grid->rows[i - 1];
+		for (int j = 1; j < grid->nr_cols; j++) {
+			int64_t cw = grid->cols[j] - grid->cols[j - 1];
+			int count = grid->counts[count_index(grid, i - 1, j - 1)];
+			grid->sat[sat_index(grid, i, j)] = count * rh * cw
+				+ grid->sat[sat_index(grid, i - 1, j)]
+				+ grid->sat[sat_index(grid, i, j - 1)]
+				- grid->sat[sat_index(grid, i - 1, j - 1)];
+		}
+	}
+}
+
+void
+overlap_grid_build(struct overlap_grid *grid, struct wlr_box usable,
+		const struct wlr_box *boxes, int nr_boxes)
+{
+	assert(grid);
+
+	*grid = (struct overlap_grid){ 0 };
+	if (nr_boxes < 1 || usable.width <= 0 || usable.height <= 0) {
+		return;
+	}
+
+	build_edges(grid, usable, boxes, nr_boxes);
+
+	int nri = grid->nr_rows - 1;
+	int nci = grid->nr_cols - 1;
+	grid->counts = xzalloc(nri * nci * sizeof(int));
+	grid->sat = xzalloc(grid->nr_rows * grid->nr_cols * sizeof(int64_t));
+
+	build_counts(grid, boxes, nr_boxes);
+	build_sat(grid);
+}
+
+/*
+ * Return the overlap of the rectangle from (cols[0], rows[0]) to (x, y),
+ * where x lies in column interval j and y in row interval i (including
+ * their right and bottom edges). The count is constant within an
+ * interval, so the overlap is bilinear there and follows from the table
+ * entries at the top-left corner of the interval.
+ */
+static int64_t
+integral(const struct overlap_grid *grid, int x, int j, int y, int i)
+{
+	assert(i >= 0 && i < grid->nr_rows - 1);
+	assert(j >= 0 && j < grid->nr_cols - 1);
+
+	int64_t dx = x - grid->cols[j];
+	int64_t dy = y - grid->rows[i];
+	int64_t cw = grid->cols[j + 1] - grid->cols[j];
+	int64_t rh = grid->rows[i + 1] - grid->rows[i];
+
+	int64_t corner = grid->sat[sat_index(grid, i, j)];
+	/* Overlap per unit of width of the column above the interval */
+	int64_t above = (grid->sat[sat_index(grid, i, j + 1)] - corner) / cw;
+	/* Overlap per unit of height of the row left of the interval */
+	int64_t left = (grid->sat[sat_index(grid, i + 1, j)] - corner) / rh;
+	int count = grid->counts[count_index(grid, i, j)];
+
+	return corner + dx * above + dy * left + dx * dy * count;
+}
+
+/*
+ * Return the interval of a 1-D grid that contains @val, which must be
+ * within the grid. The last edge belongs to the last interval.
+ */
+static int
+find_containing_interval(const int *edges, int nedges, int val)
+{
+	return MIN(find_interval(edges, nedges, val), nedges - 2);
+}
+
+/*
+ * Overlap of a region whose edges x0, x1, y0 and y1 lie in the
+ * intervals j0, j1, i0 and i1
+ */
+static int64_t
+region_overlap(const struct overlap_grid *grid, int x0, int j0, int x1,
+		int j1, int y0, int i0, int y1, int i1)
+{
+	return integral(grid, x1, j1, y1, i1) - integral(grid, x0, j0, y1, i1)
+		- integral(grid, x1, j1, y0, i0) + integral(grid, x0, j0, y0, i0);
+}
+
+int64_t
+overlap_grid_get_overlap(const struct overlap_grid *grid,
+		const struct wlr_box *box)
+{
+	if (grid->nr_rows < 2 || grid->nr_cols < 2) {
+		return 0;
+	}
+
+	int x1 = box->x + box->width;
+	int y1 = box->y + box->height;
+	if (box->x < grid->cols[0] || box->y < grid->rows[0]
+			|| x1 > grid->cols[grid->nr_cols - 1]
+			|| y1 > grid->rows[grid->nr_rows - 1]) {
+		return INT64_MAX;
+	}
+
+	return region_overlap(grid,
+		box->x, find_containing_interval(grid->cols, grid->nr_cols, box->x),
+		x1, find_containing_interval(grid->cols, grid->nr_cols, x1),
+		box->y, find_containing_interval(grid->rows, grid->nr_rows, box->y),
+		y1, find_containing_interval(grid->rows, grid->nr_rows, y1));
+}
+
+struct region_end {
+	int pos;
+	int interval;
+};
+
+/*
+ * For a region of @size starting at each edges[k] (when @forward) or
+ * ending at each edges[k + 1] (otherwise), store the position and
+ * interval of its other edge in @ends, or an interval of -1 if the
+ * region would extend beyond the grid. The other edge moves
+ * monotonically with k, so this is linear in the number of intervals.
+ */
+
+static void
+find_region_ends(const int *edges, int nedges, int size, bool forward,
+		struct region_end *ends)
+{
+	int nintervals = nedges - 1;
+	int l = 0;
+	for (int k = 0; k < nintervals; k++) {
+		int pos = forward ? edges[k] + size : edges[k + 1] - size;
+		ends[k] = (struct region_end){ .pos = pos, .interval = -1 };
+		if (pos < edges[0] || pos > edges[nedges - 1]) {
+			continue;
+		}
+		while (l < nintervals - 1 && edges[l + 1] <= pos) {
+			l++;
+		}
+		ends[k].interval = l;
+	}
+}
+
+bool
+overlap_grid_find_best(const struct overlap_grid *grid, int width,
+		int height, int *x, int *y)
+{
+	int64_t min_overlap = INT64_MAX;
+
+	int nri = grid->nr_rows - 1;
+	int nci = grid->nr_cols - 1;
+	if (nri < 1 || nci < 1) {
+		return false;
+	}
+
+	/* Other edges of regions extending right, left, down and up */
+	struct region_end *rights = xzalloc(nci * sizeof(*rights));
+	struct region_end *lefts = xzalloc(nci * sizeof(*lefts));
+	struct region_end *downs = xzalloc(nri * sizeof(*downs));
+	struct region_end *ups = xzalloc(nri * sizeof(*ups));
+	find_region_ends(grid->cols, grid->nr_cols, width, true, rights);
+	find_region_ends(grid->cols, grid->nr_cols, width, false, lefts);
+	find_region_ends(grid->rows, grid->nr_rows, height, true, downs);
+	find_region_ends(grid->rows, grid->nr_rows, height, false, ups);
+
+	/*
+	 * Convolve the region with the overlap grid to determine the total
+	 * overlap of the region in all possible positions on the grid.
+	 *
+	 * When the region starts in a particular interval and is wider than
+	 * the interval, it can extend either rightward (by placing the left
+	 * edge of the region on the left edge of the interval) or leftward
+	 * (by placing the right edge of the region on the right edge of the
+	 * interval) into adjoining intervals. Likewise, when the region is
+	 * taller than the interval in which it starts, it can extend either
+	 * upward (by placing the bottom edge of the region on the bottom edge
+	 * of the interval) or downward (by placing the top edge of the region
+	 * on the top edge of the interval). All four possibilities produce
+	 * different overlap characteristics and need to be checked
+	 * independently.
+	 *
+	 * If the region is no larger than the interval in which it starts,
+	 * there is no need to check multiple directions---the overlap will be
+	 * the same regardless of where in the interval the region is placed.
+	 *
+	 * The interval (and, when the region spans more than one interval,
+	 * directions in which it should extend) that produces the smallest
+	 * overlap with other boxes will determine the placement.
+	 */
+	for (int i = 0; i < nri; ++i) {
+		int rh = grid->rows[i + 1] - grid->rows[i];
+		for (int j = 0; j < nci; ++j) {
+			int cw = grid->cols[j + 1] - grid->cols[j];
+			bool single = width <= cw && height <= rh;
+
+			/*
+			 * Search all directions, as a two-bit field, starting
+			 * from interval (i, j).
+			 */
+			for (int ii = 0; ii < 4; ++ii) {
+				/* Left/right is determined by first bit */
+				bool rt = (ii & 0x1) == 0;
+				/* Up/down is determined by second bit */
+				bool dn = (ii & 0x2) == 0;
+
+				/*
+				 * The edge on the grid line lies in interval
+				 * j (or i), the other one was found above.
+				 */
+				struct region_end xe = rt ? rights[j] : lefts[j];
+				struct region_end ye = dn ? downs[i] : ups[i];
+				int64_t overlap = INT64_MAX;
+				if (xe.interval >= 0 && ye.interval >= 0) {
+					int x0 = rt ? grid->cols[j] : xe.pos;
+					int x1 = rt ? xe.pos : grid->cols[j + 1];
+					int y0 = dn ? grid->rows[i] : ye.pos;
+					int y1 = dn ? ye.pos : grid->rows[i + 1];
+					overlap = region_overlap(grid,
+						x0, rt ? j : xe.interval,
+						x1, rt ? xe.interval : j,
+						y0, dn ? i : ye.interval,
+						y1, dn ? ye.interval : i);
+				}
+
+				/* Move on if overlap isn't reduced */
+				if (overlap >= min_overlap) {
+					if (single) {
+						break;
+					}
+					continue;
+				}
+
+				min_overlap = overlap;
+				*x = rt ? grid->cols[j] : xe.pos;
+				*y = dn ? grid->rows[i] : ye.pos;
+
+				/* If there is no overlap, the search is done. */
+				if (min_overlap <= 0) {
+					goto out;
+				}
+
+				/*
+				 * Skip multi-directional searches when the
+				 * region fits completely within one interval.
+				 */
+				if (single) {
+					break;
+				}
+			}
+		}
+	}
+
+out:
+	free(rights);
+	free(lefts);
+	free(downs);
+	free(ups);
+	return min_overlap < INT64_MAX;
+}
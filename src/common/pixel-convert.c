@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "common/pixel-convert.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Clamp a row or column index to a source of size @n */
+#define CLAMP_INDEX(i, n) ((i) < (n) ? (i) : (n) - 1)
+
+/* Exactly x * a / 255 for x, a <= 255 */
+#define MUL_DIV_255(t) (((t) + 1 + ((t) >> 8)) >> 8)
+
+static uint32_t
+premultiply(uint32_t pixel)
+{
+	uint32_t a = pixel >> 24;
+	uint32_t r = (pixel >> 16) & 0xff;
+	uint32_t g = (pixel >> 8) & 0xff;
+	uint32_t b = pixel & 0xff;
+	return (a << 24) | (MUL_DIV_255(r * a) << 16)
+		| (MUL_DIV_255(g * a) << 8) | MUL_DIV_255(b * a);
+}
+
+/* Rounded average of four pixels, two channels at a time */
+static uint32_t
+average4(uint32_t p0, uint32_t p1, uint32_t p2, uint32_t p3)
+{
+	const uint32_t mask = 0x00ff00ff;
+	uint32_t rb = (p0 & mask) + (p1 & mask) + (p2 & mask) + (p3 & mask);
+	uint32_t ag = ((p0 >> 8) & mask) + ((p1 >> 8) & mask)
+		+ ((p2 >> 8) & mask) + ((p3 >> 8) & mask);
+	rb = ((rb + 0x00020002) >> 2) & mask;
+	ag = ((ag + 0x00020002) >> 2) & mask;
+	return rb | (ag << 8);
+}
+
+static uint32_t
+swap_red_blue(uint32_t pixel)
+{
+	return (pixel & 0xff00ff00) | ((pixel >> 16) & 0xff)
+		| ((pixel & 0xff) << 16);
+}
+
+#if defined(__SSE2__)
+
+/* Premultiply two pixels unpacked to 16 bits per channel */
+static __m128i
+premultiply_2x16(__m128i px, __m128i alpha_mask)
+{
+	/* Broadcast alpha, but multiply alpha itself by 255 */
+	__m128i alpha = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_or_si128(alpha, alpha_mask);
+
+	__m128i t = _mm_mullo_epi16(px, alpha);
+	t = _mm_add_epi16(_mm_add_epi16(t, _mm_set1_epi16(1)),
+		_mm_srli_epi16(t, 8));
+	return _mm_srli_epi16(t, 8);
+}
+
+static size_t
+premultiply_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha_mask = _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i lo = premultiply_2x16(_mm_unpacklo_epi8(px, zero),
+			alpha_mask);
+		__m128i hi = premultiply_2x16(_mm_unpackhi_epi8(px, zero),
+			alpha_mask);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+static size_t
+swap_red_blue_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m128i green_alpha = _mm_set1_epi32(0xff00ff00);
+	const __m128i low_byte = _mm_set1_epi32(0xff);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i out = _mm_and_si128(px, green_alpha);
+		out = _mm_or_si128(out,
+			_mm_and_si128(_mm_srli_epi32(px, 16), low_byte));
+		out = _mm_or_si128(out,
+			_mm_slli_epi32(_mm_and_si128(px, low_byte), 16));
+		_mm_storeu_si128((__m128i *)(dst + i), out);
+	}
+	return i;
+}
+
+static size_t
+set_opaque_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(px, alpha));
+	}
+	return i;
+}
+
+#elif defined(__ARM_NEON)
+
+static uint8x8_t
+mul_div_255_neon(uint8x8_t x, uint8x8_t a)
+{
+	uint16x8_t t = vmull_u8(x, a);
+	t = vaddq_u16(vaddq_u16(t, vdupq_n_u16(1)), vshrq_n_u16(t, 8));
+	return vshrn_n_u16(t, 8);
+}
+
+static size_t
+premultiply_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		/* Channels in memory order on little endian: b, g, r, a */
+		uint8x8x4_t px = vld4_u8((const uint8_t *)(src + i));
+		px.val[0] = mul_div_255_neon(px.val[0], px.val[3]);
+		px.val[1] = mul_div_255_neon(px.val[1], px.val[3]);
+		px.val[2] = mul_div_255_neon(px.val[2], px.val[3]);
+		vst4_u8((uint8_t *)(dst + i), px);
+	}
+	return i;
+}
+
+static size_t
+swap_red_blue_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		uint8x8x4_t px = vld4_u8((const uint8_t *)(src + i));
+		uint8x8_t tmp = px.val[0];
+		px.val[0] = px.val[2];
+		px.val[2] = tmp;
+		vst4_u8((uint8_t *)(dst + i), px);
+	}
+	return i;
+}
+
+static size_t
+set_opaque_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		vst1q_u32(dst + i, vorrq_u32(vld1q_u32(src + i), alpha));
+	}
+	return i;
+}
+
+#else
+
+static size_t
+premultiply_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	return 0;
+}
+
+static size_t
+swap_red_blue_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	return 0;
+}
+
+static size_t
+set_opaque_simd(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	return 0;
+}
+
+#endif
+
+void
+pixel_premultiply(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = premultiply_simd(dst, src, count); i < count; i++) {
+		dst[i] = premultiply(src[i]);
+	}
+}
+
+void
+pixel_swap_red_blue(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = swap_red_blue_simd(dst, src, count); i < count; i++) {
+		dst[i] = swap_red_blue(src[i]);
+	}
+}
+
+void
+pixel_set_opaque(uint32_t *dst, const uint32_t *src, size_t count)
+{
+	for (size_t i = set_opaque_simd(dst, src, count); i < count; i++) {
+		dst[i] = src[i] | 0xff000000;
+	}
+}
+
+void
+pixel_downscale_half(uint32_t *dst, size_t dst_stride,
+		const uint32_t *src, size_t src_stride, int src_width, int src_height)
+{
+	int width = src_width / 2 > 1 ? src_width / 2 : 1;
+	int height = src_height / 2 > 1 ? src_height / 2 : 1;
+	for (int y = 0; y < height; y++) {
+		int y0 = CLAMP_INDEX(2 * y, src_height);
+		int y1 = CLAMP_INDEX(2 * y + 1, src_height);
+		const uint32_t *row0 = (const uint32_t *)
+			((const char *)src + (size_t)y0 * src_stride);
+		const uint32_t *row1 = (const uint32_t *)
+			((const char *)src + (size_t)y1 * src_stride);
+		uint32_t *out = (uint32_t *)((char *)dst + (size_t)y * dst_stride);
+		for (int x = 0; x < width; x++) {
+			int x0 = CLAMP_INDEX(2 * x, src_width);
+			int x1 = CLAMP_INDEX(2 * x + 1, src_width);
+			out[x] = average4(row0[x0], row0[x1], row1[x0], row1[x1]);
+		}
+	}
+}
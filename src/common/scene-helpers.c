@@ -2,9 +2,12 @@
 
 #include "common/scene-helpers.h"
 #include <assert.h>
+#include <pixman.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
+#include "buffer.h"
+#include "common/time-helpers.h"
 #include "magnifier.h"
 #include "output.h"
 
@@ -36,12 +39,35 @@ lab_wlr_scene_get_prev_node(struct wlr_scene_node *node)
 	return prev;
 }
 
+void
+lab_wlr_scene_buffer_update_opaque_region(struct wlr_scene_buffer *scene_buffer)
+{
+	struct lab_data_buffer *buffer =
+		buffer_try_from_wlr_buffer(scene_buffer->buffer);
+
+	pixman_region32_t region;
+	if (buffer && buffer->opaque) {
+		int width = scene_buffer->dst_width > 0
+			? scene_buffer->dst_width : buffer->base.width;
+		int height = scene_buffer->dst_height > 0
+			? scene_buffer->dst_height : buffer->base.height;
+		pixman_region32_init_rect(&region, 0, 0, width, height);
+	} else {
+		pixman_region32_init(&region);
+	}
+	/* This is a no-op if the region didn't change */
+	wlr_scene_buffer_set_opaque_region(scene_buffer, &region);
+	pixman_region32_fini(&region);
+}
+
 /*
  * This is a slightly modified copy of scene_output_damage(),
  * required to properly add the magnifier damage to scene_output
  * ->damage_ring and scene_output->pending_commit_damage.
  *
  * The only difference is code style and removal of wlr_output_schedule_frame().
+ * The damage is added before the frame is built, so the scene re-renders
+ * the areas vacated (or newly covered) by the magnifier.
  */
 static void
 scene_output_damage(struct wlr_scene_output *scene_output,
@@ -74,15 +100,21 @@ lab_wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 	assert(state);
 	struct wlr_output *wlr_output = scene_output->output;
 	struct output *output = wlr_output->data;
-	bool wants_magnification = output_wants_magnification(output);
 
-	/*
-	 * FIXME: Regardless of wants_magnification, we are currently adding
-	 * damages to next frame when magnifier is shown, which forces
-	 * rendering on every output commit and overloads CPU.
-	 * We also need to verify the necessity of wants_magnification.
-	 */
-	if (!wlr_scene_output_needs_frame(scene_output) && !wants_magnification) {
+	pixman_region32_t mag_damage;
+	pixman_region32_init(&mag_damage);
+	magnifier_prepare(output,
+		&scene_output->WLR_PRIVATE.pending_commit_damage, &mag_damage);
+	scene_output_damage(scene_output, &mag_damage);
+	pixman_region32_fini(&mag_damage);
+
+	struct output_captures captures;
+	bool gamma = state->committed & WLR_OUTPUT_STATE_GAMMA_LUT;
+	if (!wlr_scene_output_needs_frame(scene_output) && !gamma) {
+		/* Nothing changed, so capture clients keep waiting */
+		output_stats_count_captures(output, NULL, &captures);
+		output_stats_record_captures(output, &captures,
+			/*committed*/ false);
 		return true;
 	}
 
@@ -92,17 +124,24 @@ lab_wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 		return false;
 	}
 
+	bool tested = false;
 	if (state->tearing_page_flip) {
-		if (!wlr_output_test_state(wlr_output, state)) {
+		tested = wlr_output_test_state(wlr_output, state);
+		if (!tested) {
 			state->tearing_page_flip = false;
 		}
 	}
+	if (gamma && !tested && !wlr_output_test_state(wlr_output, state)) {
+		output_drop_gamma(output, state);
+	}
 
-	struct wlr_box additional_damage = {0};
 	if (state->buffer && magnifier_is_enabled()) {
-		magnifier_draw(output, state->buffer, &additional_damage);
+		uint64_t start = time_now_nsec();
+		magnifier_draw(output, state->buffer);
+		output_stats_record_magnifier(output, time_now_nsec() - start);
 	}
 
+	output_stats_count_captures(output, state, &captures);
 	bool committed = wlr_output_commit_state(wlr_output, state);
 	/*
 	 * Handle case where the output state test for tearing succeeded,
@@ -113,6 +152,10 @@ lab_wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 		committed = wlr_output_commit_state(wlr_output, state);
 	}
 	if (committed) {
+		output_stats_record_scanout(output,
+			output_get_scanout(output, state->buffer));
+		output_stats_record_captures(output, &captures,
+			/*committed*/ true);
 		if (state == &output->pending) {
 			wlr_output_state_finish(&output->pending);
 			wlr_output_state_init(&output->pending);
@@ -123,14 +166,5 @@ lab_wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 		return false;
 	}
 
-	if (!wlr_box_empty(&additional_damage)) {
-		pixman_region32_t region;
-		pixman_region32_init_rect(&region,
-			additional_damage.x, additional_damage.y,
-			additional_damage.width, additional_damage.height);
-		scene_output_damage(scene_output, &region);
-		pixman_region32_fini(&region);
-	}
-
 	return true;
 }
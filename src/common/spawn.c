@@ -1,27 +1,78 @@
 // SPDX-License-Identifier: GPL-2.0-only
-#define _POSIX_C_SOURCE 200809L
+/* For POSIX_SPAWN_SETSID with glibc */
+#define _GNU_SOURCE
 #include "common/spawn.h"
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <glib.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
+#include "child-watch.h"
 #include "common/fd-util.h"
+#include "launcher.h"
 
-static void
-reset_signals_and_limits(void)
+#ifndef POSIX_SPAWN_SETSID
+/* Older C libraries leave the child in the compositor's session */
+#define POSIX_SPAWN_SETSID 0
+#endif
+
+extern char **environ;
+
+/*
+ * posix_spawnp() creates the child with vfork semantics (CLONE_VM |
+ * CLONE_VFORK on glibc and musl), so launching a command does not copy
+ * the page tables of the compositor, which can take milliseconds with
+ * large GPU mappings.
+ *
+ * The child gets an empty signal mask and default SIGPIPE handling
+ * through the spawn attributes. The open files limit cannot be set that
+ * way, so it is restored in the compositor for the duration of the call.
+ * This is fine because spawning happens on the event loop thread.
+ *
+ * Returns the pid of the child or -1 with errno set.
+ */
+static pid_t
+spawn(char *const argv[], const posix_spawn_file_actions_t *actions,
+		short flags)
 {
-	restore_nofile_limit();
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
 
 	sigset_t set;
 	sigemptyset(&set);
-	sigprocmask(SIG_SETMASK, &set, NULL);
+	posix_spawnattr_setsigmask(&attr, &set);
 
 	/* Restore ignored signals */
-	signal(SIGPIPE, SIG_DFL);
+	sigaddset(&set, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &set);
+
+	posix_spawnattr_setflags(&attr,
+		POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | flags);
+
+	pid_t pid;
+	restore_nofile_limit();
+	int err = posix_spawnp(&pid, argv[0], actions, &attr, argv, environ);
+	increase_nofile_limit();
+
+	posix_spawnattr_destroy(&attr);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	child_watch_add(pid);
+	return pid;
+}
+
+static pid_t
+spawn_shell(const char *command, const posix_spawn_file_actions_t *actions)
+{
+	char *const argv[] = { "/bin/sh", "-c", (char *)command, NULL };
+	return spawn(argv, actions, 0);
 }
 
 static bool
@@ -42,8 +93,8 @@ set_cloexec(int fd)
 	return true;
 }
 
-void
-spawn_async_no_shell(char const *command)
+char **
+spawn_parse_argv(const char *command)
 {
 	GError *err = NULL;
 	gchar **argv = NULL;
@@ -55,73 +106,82 @@ spawn_async_no_shell(char const *command)
 	if (err) {
 		g_message("%s", err->message);
 		g_error_free(err);
-		return;
+		return NULL;
 	}
+	return argv;
+}
+
+void
+spawn_argv_async_no_shell(char *const argv[])
+{
+	assert(argv && argv[0]);
 
 	/*
-	 * Avoid zombie processes by using a double-fork, whereby the
-	 * grandchild becomes orphaned & the responsibility of the OS.
+	 * The child is reaped through src/child-watch.c or the SIGCHLD
+	 * handler and runs in a session of its own, detached from the
+	 * compositor.
 	 */
-	pid_t child = 0, grandchild = 0;
-
-	child = fork();
-	switch (child) {
-	case -1:
-		wlr_log(WLR_ERROR, "unable to fork()");
-		goto out;
-	case 0:
-		reset_signals_and_limits();
-
-		setsid();
-		grandchild = fork();
-		if (grandchild == 0) {
-			execvp(argv[0], argv);
-			_exit(0);
-		} else if (grandchild < 0) {
-			wlr_log(WLR_ERROR, "unable to fork()");
-		}
-		_exit(0);
-	default:
-		break;
+	if (launcher_spawn(argv)) {
+		/* Started on our behalf by the spawn helper */
+	} else if (spawn(argv, NULL, POSIX_SPAWN_SETSID) < 0) {
+		wlr_log_errno(WLR_ERROR, "unable to execute %s", argv[0]);
 	}
-	waitpid(child, NULL, 0);
-out:
+}
+
+void
+spawn_async_no_shell(char const *command)
+{
+	gchar **argv = spawn_parse_argv(command);
+	if (!argv) {
+		return;
+	}
+	spawn_argv_async_no_shell(argv);
 	g_strfreev(argv);
 }
 
 pid_t
-spawn_primary_client(const char *command)
+spawn_argv_async_no_shell_tracked(char *const argv[])
 {
-	assert(command);
-
-	GError *err = NULL;
-	gchar **argv = NULL;
+	assert(argv && argv[0]);
+	pid_t pid = spawn(argv, NULL, POSIX_SPAWN_SETSID);
+	if (pid < 0) {
+		wlr_log_errno(WLR_INFO, "unable to execute %s", argv[0]);
+	}
+	return pid;
+}
 
-	/* Use glib's shell-parse to mimic Openbox's behaviour */
-	g_shell_parse_argv((gchar *)command, NULL, &argv, &err);
-	if (err) {
-		g_message("%s", err->message);
-		g_error_free(err);
+pid_t
+spawn_async_no_shell_tracked(const char *command)
+{
+	gchar **argv = spawn_parse_argv(command);
+	if (!argv) {
 		return -1;
 	}
+	pid_t pid = spawn_argv_async_no_shell_tracked(argv);
+	g_strfreev(argv);
+	return pid;
+}
 
-	pid_t child = fork();
-	switch (child) {
-	case -1:
-		wlr_log_errno(WLR_ERROR, "Failed to fork");
-		g_strfreev(argv);
+pid_t
+spawn_primary_client(const char *command)
+{
+	gchar **argv = spawn_parse_argv(command);
+	if (!argv) {
 		return -1;
-	case 0:
-		/* child */
-		close(STDIN_FILENO);
-		reset_signals_and_limits();
-		execvp(argv[0], argv);
-		wlr_log_errno(WLR_ERROR, "Failed to execute primary client %s", command);
-		_exit(1);
-	default:
-		g_strfreev(argv);
-		return child;
 	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addclose(&actions, STDIN_FILENO);
+
+	pid_t child = spawn(argv, &actions, 0);
+	if (child < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to execute primary client %s",
+			command);
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	g_strfreev(argv);
+	return child;
 }
 
 pid_t
@@ -135,49 +195,28 @@ spawn_piped(const char *command, int *pipe_fd)
 		return -1;
 	}
 
-	pid_t pid = fork();
+	/*
+	 * Replace stdin and stderr with /dev/null
+	 * and stdout with the write end of the pipe
+	 */
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, pipe_rw[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, pipe_rw[0]);
+	posix_spawn_file_actions_addclose(&actions, pipe_rw[1]);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+		O_RDWR, 0);
+	posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO);
+
+	pid_t pid = spawn_shell(command, &actions);
+	posix_spawn_file_actions_destroy(&actions);
 	if (pid < 0) {
+		wlr_log_errno(WLR_ERROR, "unable to spawn %s", command);
 		close(pipe_rw[0]);
 		close(pipe_rw[1]);
-		wlr_log(WLR_ERROR, "unable to fork()");
 		return pid;
 	}
 
-	if (pid == 0) {
-		/* child */
-		reset_signals_and_limits();
-
-		/*
-		 * replace stdin and stderr with /dev/null
-		 * and stdout with the write end of the pipe
-		 */
-		dup2(pipe_rw[1], STDOUT_FILENO);
-		close(pipe_rw[0]);
-		close(pipe_rw[1]);
-
-		int dev_null = open("/dev/null", O_RDWR);
-		if (dev_null < 0) {
-			wlr_log_errno(WLR_ERROR, "opening /dev/null failed");
-			/*
-			 * Just close stdin and stderr and
-			 * hope $command can deal with that.
-			 */
-			close(STDIN_FILENO);
-			close(STDERR_FILENO);
-		} else {
-			dup2(dev_null, STDIN_FILENO);
-			dup2(dev_null, STDERR_FILENO);
-			close(dev_null);
-		}
-
-		execl("/bin/sh", "sh", "-c", command, NULL);
-		/*
-		 * Our stderr points to /dev/null or is closed
-		 * at this point so logging is pretty useless.
-		 */
-		_exit(1);
-	}
-
 	/* labwc */
 	close(pipe_rw[1]);
 
@@ -191,9 +230,62 @@ spawn_piped(const char *command, int *pipe_fd)
 	return pid;
 }
 
+pid_t
+spawn_piped_rw(const char *command, int *read_fd, int *write_fd)
+{
+	assert(command);
+
+	int out_rw[2], in_rw[2];
+	if (pipe(out_rw) != 0) {
+		wlr_log(WLR_ERROR, "unable to pipe()");
+		return -1;
+	}
+	if (pipe(in_rw) != 0) {
+		wlr_log(WLR_ERROR, "unable to pipe()");
+		close(out_rw[0]);
+		close(out_rw[1]);
+		return -1;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in_rw[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out_rw[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, in_rw[0]);
+	posix_spawn_file_actions_addclose(&actions, in_rw[1]);
+	posix_spawn_file_actions_addclose(&actions, out_rw[0]);
+	posix_spawn_file_actions_addclose(&actions, out_rw[1]);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+		O_WRONLY, 0);
+
+	pid_t pid = spawn_shell(command, &actions);
+	posix_spawn_file_actions_destroy(&actions);
+	if (pid < 0) {
+		wlr_log_errno(WLR_ERROR, "unable to spawn %s", command);
+		close(out_rw[0]);
+		close(out_rw[1]);
+		close(in_rw[0]);
+		close(in_rw[1]);
+		return pid;
+	}
+
+	/* labwc */
+	close(in_rw[0]);
+	close(out_rw[1]);
+
+	set_cloexec(out_rw[0]);
+	set_cloexec(in_rw[1]);
+	fcntl(out_rw[0], F_SETFL, fcntl(out_rw[0], F_GETFL) | O_NONBLOCK);
+	fcntl(in_rw[1], F_SETFL, fcntl(in_rw[1], F_GETFL) | O_NONBLOCK);
+
+	*read_fd = out_rw[0];
+	*write_fd = in_rw[1];
+	return pid;
+}
+
 void
 spawn_piped_close(pid_t pid, int pipe_fd)
 {
 	close(pipe_fd);
-	/* waitpid() is done in a generic SIGCHLD handler in src/server.c */
+	/* The child is reaped through src/child-watch.c or on SIGCHLD */
 }
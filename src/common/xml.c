@@ -3,6 +3,7 @@
 #include <glib.h>
 #include <stdbool.h>
 #include <strings.h>
+#include <wayland-util.h>
 #include "common/xml.h"
 #include "common/parse-bool.h"
 
@@ -132,6 +133,17 @@ lab_xml_expand_dotted_attributes(xmlNode *parent)
 	}
 }
 
+void
+lab_xml_docs_release(struct wl_array *docs)
+{
+	xmlDoc **d;
+	wl_array_for_each(d, docs) {
+		xmlFreeDoc(*d);
+	}
+	wl_array_release(docs);
+	wl_array_init(docs);
+}
+
 bool
 lab_xml_node_is_leaf(xmlNode *node)
 {
@@ -11,12 +11,97 @@
 #include <unistd.h>
 #include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/util/log.h>
+#include "common/arena.h"
 #include "common/list.h"
 #include "common/mem.h"
 #include "common/spawn.h"
+#include "common/time-helpers.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 
+/*
+ * Index of rc.keybinds keyed by (modifiers, keysym) and (modifiers,
+ * keycode). Each value is a GPtrArray of keybinds in rc.keybinds order,
+ * so the first match is the same as with a linear scan.
+ */
+static GHashTable *keybind_index;
+
+#define INDEX_KEY_KEYCODE (1ULL << 63)
+
+static gint64
+index_key(uint32_t modifiers, xkb_keysym_t sym, xkb_keycode_t keycode)
+{
+	uint64_t key = (uint64_t)modifiers << 32;
+	if (sym == XKB_KEY_NoSymbol) {
+		key |= INDEX_KEY_KEYCODE | keycode;
+	} else {
+		key |= sym;
+	}
+	return (gint64)key;
+}
+
+static void
+index_add(struct keybind *keybind, xkb_keysym_t sym, xkb_keycode_t keycode)
+{
+	gint64 key = index_key(keybind->modifiers, sym, keycode);
+	GPtrArray *keybinds = g_hash_table_lookup(keybind_index, &key);
+	if (!keybinds) {
+		gint64 *stored_key = g_new(gint64, 1);
+		*stored_key = key;
+		keybinds = g_ptr_array_new();
+		g_hash_table_insert(keybind_index, stored_key, keybinds);
+	}
+	/* A keybind may contain the same keysym/keycode more than once */
+	if (keybinds->len && g_ptr_array_index(keybinds, keybinds->len - 1) == keybind) {
+		return;
+	}
+	g_ptr_array_add(keybinds, keybind);
+}
+
+static void
+keybind_index_invalidate(void)
+{
+	if (keybind_index) {
+		g_hash_table_destroy(keybind_index);
+		keybind_index = NULL;
+	}
+}
+
+static void
+keybind_index_rebuild(void)
+{
+	keybind_index_invalidate();
+	keybind_index = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+		g_free, (GDestroyNotify)g_ptr_array_unref);
+
+	struct keybind *keybind;
+	wl_list_for_each(keybind, &rc.keybinds, link) {
+		for (size_t i = 0; i < keybind->keysyms_len; i++) {
+			index_add(keybind, keybind->keysyms[i], 0);
+		}
+		for (size_t i = 0; i < keybind->keycodes_len; i++) {
+			index_add(keybind, XKB_KEY_NoSymbol, keybind->keycodes[i]);
+		}
+	}
+}
+
+struct keybind **
+keybind_index_lookup(uint32_t modifiers, xkb_keysym_t sym,
+		xkb_keycode_t keycode, size_t *nr_keybinds)
+{
+	if (!keybind_index) {
+		keybind_index_rebuild();
+	}
+	gint64 key = index_key(modifiers, sym, keycode);
+	GPtrArray *keybinds = g_hash_table_lookup(keybind_index, &key);
+	if (!keybinds) {
+		*nr_keybinds = 0;
+		return NULL;
+	}
+	*nr_keybinds = keybinds->len;
+	return (struct keybind **)keybinds->pdata;
+}
+
 uint32_t
 parse_modifier(const char *symname)
 {
@@ -77,51 +162,87 @@ keybind_contains_keysym(struct keybind *keybind, xkb_keysym_t keysym)
 	return false;
 }
 
-static bool
-keybind_contains_any_keysym(struct keybind *keybind,
-		const xkb_keysym_t *syms, int nr_syms)
+/*
+ * Keycodes producing each keysym at shift level 0 of one layout, built in
+ * a single pass over the keymap so that every keybind can be resolved by
+ * lookup instead of comparing each key against each keybind.
+ */
+struct keysym_map {
+	xkb_layout_index_t layout;
+	/* xkb_keysym_t => GArray of xkb_keycode_t in ascending order */
+	GHashTable *keycodes;
+};
+
+static void
+keysym_map_iter(struct xkb_keymap *keymap, xkb_keycode_t key, void *data)
 {
+	struct keysym_map *map = data;
+	const xkb_keysym_t *syms;
+	int nr_syms = xkb_keymap_key_get_syms_by_level(keymap, key,
+		map->layout, 0, &syms);
 	for (int i = 0; i < nr_syms; i++) {
-		if (keybind_contains_keysym(keybind, syms[i])) {
-			return true;
+		gpointer sym = GUINT_TO_POINTER(syms[i]);
+		GArray *keycodes = g_hash_table_lookup(map->keycodes, sym);
+		if (!keycodes) {
+			keycodes = g_array_new(FALSE, FALSE, sizeof(xkb_keycode_t));
+			g_hash_table_insert(map->keycodes, sym, keycodes);
+		}
+		/* A key may produce the same keysym more than once */
+		if (keycodes->len && g_array_index(keycodes, xkb_keycode_t,
+				keycodes->len - 1) == key) {
+			continue;
 		}
+		g_array_append_val(keycodes, key);
 	}
-	return false;
 }
 
+static gint
+compare_keycodes(gconstpointer a, gconstpointer b)
+{
+	xkb_keycode_t keycode_a = *(const xkb_keycode_t *)a;
+	xkb_keycode_t keycode_b = *(const xkb_keycode_t *)b;
+	return (keycode_a > keycode_b) - (keycode_a < keycode_b);
+}
+
+/* @candidates is scratch space, to avoid an allocation per keybind */
 static void
-update_keycodes_iter(struct xkb_keymap *keymap, xkb_keycode_t key, void *data)
+update_keybind_keycodes(struct keybind *keybind, struct keysym_map *map,
+		GArray *candidates)
 {
-	struct keybind *keybind;
-	const xkb_keysym_t *syms;
-	xkb_layout_index_t layout = *(xkb_layout_index_t *)data;
-	int nr_syms = xkb_keymap_key_get_syms_by_level(keymap, key, layout, 0, &syms);
-	if (!nr_syms) {
+	if (keybind->keycodes_layout >= 0
+			&& (xkb_layout_index_t)keybind->keycodes_layout != map->layout) {
+		/* Prevent storing keycodes from multiple layouts */
 		return;
 	}
-	wl_list_for_each(keybind, &rc.keybinds, link) {
-		if (keybind->keycodes_layout >= 0
-				&& (xkb_layout_index_t)keybind->keycodes_layout != layout) {
-			/* Prevent storing keycodes from multiple layouts */
-			continue;
+	if (keybind->use_syms_only) {
+		return;
+	}
+
+	g_array_set_size(candidates, 0);
+	for (size_t i = 0; i < keybind->keysyms_len; i++) {
+		GArray *keycodes = g_hash_table_lookup(map->keycodes,
+			GUINT_TO_POINTER(keybind->keysyms[i]));
+		if (keycodes) {
+			g_array_append_vals(candidates, keycodes->data, keycodes->len);
 		}
-		if (keybind->use_syms_only) {
+	}
+	/* Store keycodes in keymap order, as if iterating over all keys */
+	g_array_sort(candidates, compare_keycodes);
+
+	for (guint i = 0; i < candidates->len; i++) {
+		xkb_keycode_t key = g_array_index(candidates, xkb_keycode_t, i);
+		if (keybind_contains_keycode(keybind, key)) {
+			/* Prevent storing the same keycode twice */
 			continue;
 		}
-		if (keybind_contains_any_keysym(keybind, syms, nr_syms)) {
-			if (keybind_contains_keycode(keybind, key)) {
-				/* Prevent storing the same keycode twice */
-				continue;
-			}
-			if (keybind->keycodes_len == MAX_KEYCODES) {
-				wlr_log(WLR_ERROR,
-					"Already stored %lu keycodes for keybind",
-					keybind->keycodes_len);
-				continue;
-			}
-			keybind->keycodes[keybind->keycodes_len++] = key;
-			keybind->keycodes_layout = layout;
+		if (keybind->keycodes_len == MAX_KEYCODES) {
+			wlr_log(WLR_ERROR,
+				"Already stored %lu keycodes for keybind",
+				keybind->keycodes_len);
+			continue;
 		}
+		keybind->keycodes[keybind->keycodes_len++] = key;
+		keybind->keycodes_layout = map->layout;
 	}
 }
 
@@ -136,11 +257,23 @@ keybind_update_keycodes(struct server *server)
 		keybind->keycodes_len = 0;
 		keybind->keycodes_layout = -1;
 	}
+	GArray *candidates = g_array_new(FALSE, FALSE, sizeof(xkb_keycode_t));
 	xkb_layout_index_t layouts = xkb_keymap_num_layouts(keymap);
 	for (xkb_layout_index_t i = 0; i < layouts; i++) {
 		wlr_log(WLR_DEBUG, "Found layout %s", xkb_keymap_layout_get_name(keymap, i));
-		xkb_keymap_key_for_each(keymap, update_keycodes_iter, &i);
+		struct keysym_map map = {
+			.layout = i,
+			.keycodes = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, (GDestroyNotify)g_array_unref),
+		};
+		xkb_keymap_key_for_each(keymap, keysym_map_iter, &map);
+		wl_list_for_each(keybind, &rc.keybinds, link) {
+			update_keybind_keycodes(keybind, &map, candidates);
+		}
+		g_hash_table_destroy(map.keycodes);
 	}
+	g_array_unref(candidates);
+	keybind_index_rebuild();
 }
 
 struct keybind *
@@ -162,8 +295,10 @@ struct keybind *
 keybind_create(const char *keybind)
 {
 	xkb_keysym_t sym;
-	struct keybind *k = znew(*k);
+	uint32_t modifiers = 0;
 	xkb_keysym_t keysyms[MAX_KEYSYMS];
+	size_t keysyms_len = 0;
+	bool valid = true;
 	gchar **symnames = g_strsplit(keybind, "-", -1);
 	for (size_t i = 0; symnames[i]; i++) {
 		const char *symname = symnames[i];
@@ -188,7 +323,7 @@ keybind_create(const char *keybind)
 		}
 		uint32_t modifier = parse_modifier(symname);
 		if (modifier != 0) {
-			k->modifiers |= modifier;
+			modifiers |= modifier;
 		} else {
 			sym = xkb_keysym_from_name(symname, XKB_KEYSYM_CASE_INSENSITIVE);
 			if (sym == XKB_KEY_NoSymbol && g_utf8_strlen(symname, -1) == 1) {
@@ -207,15 +342,12 @@ keybind_create(const char *keybind)
 			sym = xkb_keysym_to_lower(sym);
 			if (sym == XKB_KEY_NoSymbol) {
 				wlr_log(WLR_ERROR, "unknown keybind (%s)", symname);
-				free(k);
-				k = NULL;
+				valid = false;
 				break;
 			}
-			keysyms[k->keysyms_len] = sym;
-			wlr_log(WLR_INFO, "keybind_create: added keysym %u (0x%x) for keybind '%s'", 
-				sym, sym, keybind);
-			k->keysyms_len++;
-			if (k->keysyms_len == MAX_KEYSYMS) {
+			keysyms[keysyms_len] = sym;
+			keysyms_len++;
+			if (keysyms_len == MAX_KEYSYMS) {
 				wlr_log(WLR_ERROR, "There are a lot of fingers involved. "
 					"We stopped counting at %u.", MAX_KEYSYMS);
 				wlr_log(WLR_ERROR, "Offending keybind was %s", keybind);
@@ -224,12 +356,18 @@ keybind_create(const char *keybind)
 		}
 	}
 	g_strfreev(symnames);
-	if (!k) {
+	if (!valid) {
 		return NULL;
 	}
+
+	/* Keep the keysyms next to the keybind for matching key presses */
+	struct keybind *k = arena_new(&rc.arena, *k);
+	k->modifiers = modifiers;
+	k->keysyms = arena_new_n(&rc.arena, xkb_keysym_t, keysyms_len);
+	k->keysyms_len = keysyms_len;
+	memcpy(k->keysyms, keysyms, keysyms_len * sizeof(xkb_keysym_t));
 	wl_list_append(&rc.keybinds, &k->link);
-	k->keysyms = xmalloc(k->keysyms_len * sizeof(xkb_keysym_t));
-	memcpy(k->keysyms, keysyms, k->keysyms_len * sizeof(xkb_keysym_t));
+	keybind_index_invalidate();
 	wl_list_init(&k->actions);
 	wl_list_init(&k->device_blacklist);
 	wl_list_init(&k->device_whitelist);
@@ -246,31 +384,12 @@ void
 keybind_destroy(struct keybind *keybind)
 {
 	assert(wl_list_empty(&keybind->actions));
+	keybind_index_invalidate();
 
-	struct keybind_device_blacklist *entry, *entry_tmp;
-	wl_list_for_each_safe(entry, entry_tmp, &keybind->device_blacklist, link) {
-		wl_list_remove(&entry->link);
-		zfree(entry->device_name);
-		zfree(entry);
-	}
-
-	struct keybind_device_whitelist *whitelist_entry, *whitelist_entry_tmp;
-	wl_list_for_each_safe(whitelist_entry, whitelist_entry_tmp, &keybind->device_whitelist, link) {
-		wl_list_remove(&whitelist_entry->link);
-		zfree(whitelist_entry->device_name);
-		zfree(whitelist_entry);
-	}
-
-	zfree(keybind->keysyms);
-	zfree(keybind->id);
-	if (keybind->condition_values) {
-		for (size_t i = 0; i < keybind->condition_values_len; i++) {
-			zfree(keybind->condition_values[i]);
-		}
-		zfree(keybind->condition_values);
-	}
-	zfree(keybind->condition_command);
-	zfree(keybind);
+	/*
+	 * The keybind and everything it points to is allocated from
+	 * rc.arena and released by rcxml_finish()
+	 */
 }
 
 bool
@@ -281,6 +400,15 @@ keybind_check_condition_sync(struct keybind *keybind)
 		return true;
 	}
 
+	bool matched;
+	if (keybind_condition_cache_lookup(keybind, &matched)) {
+		return matched;
+	}
+	if (keybind->condition_use_helper) {
+		/* The helper is only queried asynchronously, on key press */
+		return true;
+	}
+
 	int pipe_fd = 0;
 	pid_t pid = spawn_piped(keybind->condition_command, &pipe_fd);
 	if (pid <= 0) {
@@ -313,16 +441,91 @@ keybind_check_condition_sync(struct keybind *keybind)
 	}
 	buffer[len] = '\0';
 
+	matched = keybind_condition_matches(keybind, buffer);
+	keybind_condition_cache_store(keybind, matched);
+	return matched;
+}
+
+bool
+keybind_condition_matches(struct keybind *keybind, const char *output)
+{
 	/* Check if output matches any expected value */
 	if (keybind->condition_values_len > 0) {
 		for (size_t i = 0; i < keybind->condition_values_len; i++) {
-			if (strcmp(buffer, keybind->condition_values[i]) == 0) {
+			if (strcmp(output, keybind->condition_values[i]) == 0) {
 				return true;
 			}
 		}
 		return false;
 	} else {
 		/* If no values specified, any non-empty output is considered a match */
-		return (len > 0);
+		return output[0] != '\0';
+	}
+}
+
+static uint64_t condition_focus_serial;
+static uint64_t condition_workspace_serial;
+
+bool
+keybind_condition_cache_lookup(struct keybind *keybind, bool *matched)
+{
+	if (!keybind->condition_cache_ms) {
+		return false;
+	}
+	struct keybind_condition_cache *cache = &keybind->condition_cache;
+	uint64_t ttl_ns = (uint64_t)keybind->condition_cache_ms * 1000000;
+
+	bool hit = cache->valid
+		&& time_now_nsec() - cache->stored_ns < ttl_ns
+		&& (!(keybind->condition_cache_reset & KEYBIND_CONDITION_EVENT_FOCUS)
+			|| cache->focus_serial == condition_focus_serial)
+		&& (!(keybind->condition_cache_reset & KEYBIND_CONDITION_EVENT_WORKSPACE)
+			|| cache->workspace_serial == condition_workspace_serial);
+	if (hit) {
+		cache->hits++;
+		*matched = cache->matched;
+	} else {
+		cache->misses++;
+	}
+	return hit;
+}
+
+void
+keybind_condition_cache_store(struct keybind *keybind, bool matched)
+{
+	if (!keybind->condition_cache_ms) {
+		return;
+	}
+	struct keybind_condition_cache *cache = &keybind->condition_cache;
+	cache->valid = true;
+	cache->matched = matched;
+	cache->stored_ns = time_now_nsec();
+	cache->focus_serial = condition_focus_serial;
+	cache->workspace_serial = condition_workspace_serial;
+}
+
+void
+keybind_condition_cache_notify(enum keybind_condition_event event)
+{
+	if (event & KEYBIND_CONDITION_EVENT_FOCUS) {
+		condition_focus_serial++;
+	}
+	if (event & KEYBIND_CONDITION_EVENT_WORKSPACE) {
+		condition_workspace_serial++;
+	}
+}
+
+void
+keybind_condition_cache_report(void)
+{
+	struct keybind *keybind;
+	wl_list_for_each(keybind, &rc.keybinds, link) {
+		struct keybind_condition_cache *cache = &keybind->condition_cache;
+		if (!keybind->condition_cache_ms || !(cache->hits + cache->misses)) {
+			continue;
+		}
+		wlr_log(WLR_INFO, "keybind condition cache '%s': %lu hits, %lu misses",
+			keybind->condition_command, (unsigned long)cache->hits,
+			(unsigned long)cache->misses);
 	}
 }
@@ -79,6 +79,34 @@ libinput_category_create(void)
 	return l;
 }
 
+bool
+libinput_category_settings_equal(const struct libinput_category *a,
+		const struct libinput_category *b)
+{
+	if (a->have_calibration_matrix != b->have_calibration_matrix
+			|| (a->have_calibration_matrix
+				&& memcmp(a->calibration_matrix,
+					b->calibration_matrix,
+					sizeof(a->calibration_matrix)))) {
+		return false;
+	}
+	return a->pointer_speed == b->pointer_speed
+		&& a->natural_scroll == b->natural_scroll
+		&& a->left_handed == b->left_handed
+		&& a->tap == b->tap
+		&& a->tap_button_map == b->tap_button_map
+		&& a->tap_and_drag == b->tap_and_drag
+		&& a->drag_lock == b->drag_lock
+		&& a->three_finger_drag == b->three_finger_drag
+		&& a->accel_profile == b->accel_profile
+		&& a->middle_emu == b->middle_emu
+		&& a->dwt == b->dwt
+		&& a->click_method == b->click_method
+		&& a->scroll_method == b->scroll_method
+		&& a->send_events_mode == b->send_events_mode
+		&& a->scroll_factor == b->scroll_factor;
+}
+
 /* After rcxml_read(), a default category always exists. */
 struct libinput_category *
 libinput_category_get_default(void)
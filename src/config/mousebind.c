@@ -121,7 +121,7 @@ mousebind_create(const char *context)
 		wlr_log(WLR_ERROR, "mousebind context not specified");
 		return NULL;
 	}
-	struct mousebind *m = znew(*m);
+	struct mousebind *m = arena_new(&rc.arena, *m);
 	m->context = node_type_parse(context);
 	if (m->context != LAB_NODE_NONE) {
 		wl_list_append(&rc.mousebinds, &m->link);
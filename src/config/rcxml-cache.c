@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "config/rcxml-cache.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libxml/uri.h>
+#include <wlr/util/log.h>
+#include "common/buf.h"
+#include "common/dir.h"
+#include "common/hash.h"
+#include "common/time-helpers.h"
+
+/* Deeper documents are not cached, to bound the recursion when loading */
+#define MAX_DEPTH 64
+
+static const char magic[8] = "labwcXC";
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_deps;
+	uint64_t key;
+};
+
+enum record_type {
+	RECORD_ELEMENT = 'E',
+	RECORD_TEXT = 'T',
+};
+
+static uint64_t
+get_key(const char *filename, const struct buf *b)
+{
+	uint64_t key = hash_add_str(HASH_INIT, filename);
+	return hash_add(key, b->data, b->len);
+}
+
+static bool
+get_cache_path(char *path, size_t len, const char *filename, bool create)
+{
+	if (!cache_dir_get(path, len, "config", create)) {
+		return false;
+	}
+	size_t dir_len = strlen(path);
+	int ret = snprintf(path + dir_len, len - dir_len, "/%016" PRIx64,
+		hash_add_str(HASH_INIT, filename));
+	return ret >= 0 && (size_t)ret < len - dir_len;
+}
+
+static bool
+get_file_stamp(const char *path, uint64_t *size, uint64_t *mtime)
+{
+	struct stat st;
+	if (stat(path, &st)) {
+		return false;
+	}
+	*size = st.st_size;
+	*mtime = timespec_to_nsec(&st.st_mtim);
+	return true;
+}
+
+/* Reading */
+
+struct reader {
+	const unsigned char *pos;
+	const unsigned char *end;
+};
+
+static bool
+read_bytes(struct reader *r, void *dst, size_t len)
+{
+	if ((size_t)(r->end - r->pos) < len) {
+		return false;
+	}
+	memcpy(dst, r->pos, len);
+	r->pos += len;
+	return true;
+}
+
+/* Points @str into the mapping, as it isn't NUL-terminated */
+static bool
+read_string(struct reader *r, const unsigned char **str, uint32_t *len)
+{
+	if (!read_bytes(r, len, sizeof(*len))
+			|| (size_t)(r->end - r->pos) < *len) {
+		return false;
+	}
+	*str = r->pos;
+	r->pos += *len;
+	return true;
+}
+
+static bool
+deps_are_current(struct reader *r, uint32_t nr_deps)
+{
+	for (uint32_t i = 0; i < nr_deps; i++) {
+		const unsigned char *str;
+		uint32_t len;
+		uint64_t size, mtime, cur_size, cur_mtime;
+		if (!read_string(r, &str, &len) || len >= PATH_MAX
+				|| !read_bytes(r, &size, sizeof(size))
+				|| !read_bytes(r, &mtime, sizeof(mtime))) {
+			return false;
+		}
+		char path[PATH_MAX];
+		memcpy(path, str, len);
+		path[len] = '\0';
+		if (!get_file_stamp(path, &cur_size, &cur_mtime)
+				|| cur_size != size || cur_mtime != mtime) {
+			wlr_log(WLR_DEBUG, "config cache: %s changed", path);
+			return false;
+		}
+	}
+	return true;
+}
+
+static xmlNode *
+read_node(struct reader *r, xmlDoc *doc, int depth)
+{
+	uint8_t type;
+	const unsigned char *str;
+	uint32_t len;
+	if (depth > MAX_DEPTH || !read_bytes(r, &type, sizeof(type))
+			|| !read_string(r, &str, &len)) {
+		return NULL;
+	}
+
+	if (type == RECORD_TEXT) {
+		return xmlNewDocTextLen(doc, str, len);
+	}
+	uint32_t nr_children;
+	if (type != RECORD_ELEMENT
+			|| !read_bytes(r, &nr_children, sizeof(nr_children))) {
+		return NULL;
+	}
+	xmlNode *node = xmlNewDocNodeEatName(doc, NULL,
+		xmlStrndup(str, len), NULL);
+	for (uint32_t i = 0; i < nr_children; i++) {
+		xmlNode *child = read_node(r, doc, depth + 1);
+		if (!child) {
+			xmlFreeNode(node);
+			return NULL;
+		}
+		xmlAddChild(node, child);
+	}
+	return node;
+}
+
+xmlDoc *
+rcxml_cache_load(const char *filename, const struct buf *b)
+{
+	char path[PATH_MAX];
+	if (!filename || !get_cache_path(path, sizeof(path), filename,
+			/*create*/ false)) {
+		return NULL;
+	}
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	xmlDoc *doc = NULL;
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct cache_header)) {
+		goto out;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		goto out;
+	}
+
+	struct cache_header header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, magic, sizeof(magic))
+			|| header.version != RCXML_CACHE_VERSION
+			|| header.key != get_key(filename, b)) {
+		wlr_log(WLR_DEBUG, "config cache for %s is outdated", filename);
+		goto unmap;
+	}
+
+	struct reader r = {
+		.pos = (const unsigned char *)data + sizeof(header),
+		.end = (const unsigned char *)data + st.st_size,
+	};
+	if (!deps_are_current(&r, header.nr_deps)) {
+		goto unmap;
+	}
+
+	doc = xmlNewDoc((const xmlChar *)"1.0");
+	xmlNode *root = read_node(&r, doc, 0);
+	if (!root || r.pos != r.end) {
+		wlr_log(WLR_ERROR, "config cache %s is corrupt", path);
+		xmlFreeNode(root);
+		xmlFreeDoc(doc);
+		doc = NULL;
+		goto unmap;
+	}
+	xmlDocSetRootElement(doc, root);
+	wlr_log(WLR_INFO, "read config file %s from cache", filename);
+
+unmap:
+	munmap(data, st.st_size);
+out:
+	close(fd);
+	return doc;
+}
+
+/* Writing */
+
+static bool
+write_bytes(FILE *f, const void *data, size_t len)
+{
+	return fwrite(data, 1, len, f) == len;
+}
+
+static bool
+write_string(FILE *f, const char *str)
+{
+	uint32_t len = str ? strlen(str) : 0;
+	return write_bytes(f, &len, sizeof(len)) && write_bytes(f, str, len);
+}
+
+static bool
+is_stored(xmlNode *node)
+{
+	return node->type == XML_ELEMENT_NODE || node->type == XML_TEXT_NODE
+		|| node->type == XML_CDATA_SECTION_NODE;
+}
+
+static bool
+write_node(FILE *f, xmlNode *node, int depth)
+{
+	if (depth > MAX_DEPTH) {
+		return false;
+	}
+	if (node->type != XML_ELEMENT_NODE) {
+		uint8_t type = RECORD_TEXT;
+		return write_bytes(f, &type, sizeof(type))
+			&& write_string(f, (const char *)node->content);
+	}
+
+	/* Attributes have been converted into child nodes */
+	if (node->properties) {
+		return false;
+	}
+	uint8_t type = RECORD_ELEMENT;
+	uint32_t nr_children = 0;
+	for (xmlNode *child = node->children; child; child = child->next) {
+		nr_children += is_stored(child);
+	}
+	if (!write_bytes(f, &type, sizeof(type))
+			|| !write_string(f, (const char *)node->name)
+			|| !write_bytes(f, &nr_children, sizeof(nr_children))) {
+		return false;
+	}
+	for (xmlNode *child = node->children; child; child = child->next) {
+		if (is_stored(child) && !write_node(f, child, depth + 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Append the local files included by @node and its descendants to @deps,
+ * one path per line. Returns false if any of them cannot be resolved.
+ */
+static bool
+collect_deps(xmlDoc *doc, xmlNode *node, struct buf *deps, uint32_t *nr_deps)
+{
+	for (; node; node = node->next) {
+		if (node->type == XML_XINCLUDE_START) {
+			xmlChar *href = xmlGetProp(node, (const xmlChar *)"href");
+			xmlChar *base = xmlNodeGetBase(doc, node);
+			xmlChar *uri = href ? xmlBuildURI(href, base) : NULL;
+			xmlFree(href);
+			xmlFree(base);
+			if (!uri) {
+				return false;
+			}
+			const char *path = (const char *)uri;
+			if (!strncmp(path, "file://", 7)) {
+				path += 7;
+			}
+			bool local = path[0] == '/' && !strchr(path, '\n');
+			if (local) {
+				buf_add(deps, path);
+				buf_add_char(deps, '\n');
+				(*nr_deps)++;
+			}
+			xmlFree(uri);
+			if (!local) {
+				return false;
+			}
+		}
+		if (node->children && !collect_deps(doc, node->children,
+				deps, nr_deps)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+write_deps(FILE *f, char *deps)
+{
+	char *saveptr = NULL;
+	for (char *path = strtok_r(deps, "\n", &saveptr); path;
+			path = strtok_r(NULL, "\n", &saveptr)) {
+		uint64_t size, mtime;
+		if (!get_file_stamp(path, &size, &mtime)
+				|| !write_string(f, path)
+				|| !write_bytes(f, &size, sizeof(size))
+				|| !write_bytes(f, &mtime, sizeof(mtime))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+rcxml_cache_store(const char *filename, const struct buf *b, xmlDoc *doc)
+{
+	xmlNode *root = xmlDocGetRootElement(doc);
+	if (!filename || !root) {
+		return;
+	}
+
+	struct buf deps = BUF_INIT;
+	uint32_t nr_deps = 0;
+	if (!collect_deps(doc, doc->children, &deps, &nr_deps)) {
+		wlr_log(WLR_DEBUG, "not caching %s, which includes non-local files",
+			filename);
+		buf_reset(&deps);
+		return;
+	}
+
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	if (!get_cache_path(path, sizeof(path), filename, /*create*/ true)
+			|| snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+				>= (int)sizeof(tmp_path)) {
+		buf_reset(&deps);
+		return;
+	}
+	FILE *f = fopen(tmp_path, "w");
+	if (!f) {
+		wlr_log_errno(WLR_DEBUG, "cannot write %s", tmp_path);
+		buf_reset(&deps);
+		return;
+	}
+
+	struct cache_header header = {
+		.version = RCXML_CACHE_VERSION,
+		.nr_deps = nr_deps,
+		.key = get_key(filename, b),
+	};
+	memcpy(header.magic, magic, sizeof(magic));
+
+	bool ok = write_bytes(f, &header, sizeof(header))
+		&& (!nr_deps || write_deps(f, deps.data))
+		&& write_node(f, root, 0);
+	ok = !fclose(f) && ok;
+	buf_reset(&deps);
+	if (!ok || rename(tmp_path, path)) {
+		wlr_log(WLR_DEBUG, "cannot store config cache for %s", filename);
+		unlink(tmp_path);
+	}
+}
@@ -15,6 +15,7 @@
 #include "action.h"
 #include "common/buf.h"
 #include "common/dir.h"
+#include "common/hash.h"
 #include "common/list.h"
 #include "common/macros.h"
 #include "common/mem.h"
@@ -27,6 +28,7 @@
 #include "config/keybind.h"
 #include "config/libinput.h"
 #include "config/mousebind.h"
+#include "config/rcxml-cache.h"
 #include "config/tablet.h"
 #include "config/tablet-tool.h"
 #include "config/touch.h"
@@ -34,6 +36,8 @@
 #include "labwc.h"
 #include "regions.h"
 #include "ssd.h"
+#include "tiling.h"
+#include "trace.h"
 #include "translate.h"
 #include "view.h"
 #include "window-rules.h"
@@ -229,6 +233,32 @@ fill_usable_area_override(xmlNode *node)
 	}
 }
 
+static void
+fill_render_delay_config(xmlNode *node)
+{
+	struct render_delay_config *config = znew(*config);
+	wl_list_append(&rc.render_delay_configs, &config->link);
+
+	xmlNode *child;
+	char *key, *content;
+	LAB_XML_FOR_EACH(node, child, key, content) {
+		if (!strcmp(key, "output")) {
+			xstrdup_replace(config->output, content);
+		} else if (!strcasecmp(key, "maxRenderTime")) {
+			if (!strcasecmp(content, "auto")) {
+				config->max_render_time = LAB_MAX_RENDER_TIME_AUTO;
+			} else if (!strcasecmp(content, "off")) {
+				config->max_render_time = LAB_MAX_RENDER_TIME_OFF;
+			} else {
+				config->max_render_time = MAX(0, atoi(content));
+			}
+		} else {
+			wlr_log(WLR_ERROR, "Unexpected data render-delay "
+				"parser: %s=\"%s\"", key, content);
+		}
+	}
+}
+
 /* Does a boolean-parse but also allows 'default' */
 static void
 set_property(const char *str, enum property *variable)
@@ -248,9 +278,9 @@ static void
 fill_window_rule(xmlNode *node)
 {
 	struct window_rule *window_rule = znew(*window_rule);
+	enum property *props = window_rule->properties;
 	window_rule->window_type = LAB_WINDOW_TYPE_INVALID;
-	window_rule->tile = LAB_PROP_UNSPECIFIED;
-	window_rule->tile_direction = LAB_PROP_UNSPECIFIED;
+	window_rule->id_slot = -1;
 	wl_list_append(&rc.window_rules, &window_rule->link);
 	wl_list_init(&window_rule->actions);
 
@@ -259,17 +289,17 @@ fill_window_rule(xmlNode *node)
 	LAB_XML_FOR_EACH(node, child, key, content) {
 		/* Criteria */
 		if (!strcmp(key, "identifier")) {
-			xstrdup_replace(window_rule->identifier, content);
+			match_pattern_set(&window_rule->identifier, content);
 		} else if (!strcmp(key, "title")) {
-			xstrdup_replace(window_rule->title, content);
+			match_pattern_set(&window_rule->title, content);
 		} else if (!strcmp(key, "type")) {
 			window_rule->window_type = parse_window_type(content);
 		} else if (!strcasecmp(key, "matchOnce")) {
 			set_bool(content, &window_rule->match_once);
 		} else if (!strcasecmp(key, "sandboxEngine")) {
-			xstrdup_replace(window_rule->sandbox_engine, content);
+			match_pattern_set(&window_rule->sandbox_engine, content);
 		} else if (!strcasecmp(key, "sandboxAppId")) {
-			xstrdup_replace(window_rule->sandbox_app_id, content);
+			match_pattern_set(&window_rule->sandbox_app_id, content);
 
 		/* Event */
 		} else if (!strcmp(key, "event")) {
@@ -283,35 +313,43 @@ fill_window_rule(xmlNode *node)
 
 		/* Properties */
 		} else if (!strcasecmp(key, "serverDecoration")) {
-			set_property(content, &window_rule->server_decoration);
+			set_property(content, &props[WINDOW_RULE_PROP_SERVER_DECORATION]);
 		} else if (!strcasecmp(key, "iconPriority")) {
 			if (!strcasecmp(content, "client")) {
-				window_rule->icon_prefer_client = LAB_PROP_TRUE;
+				props[WINDOW_RULE_PROP_ICON_PREFER_CLIENT] = LAB_PROP_TRUE;
 			} else if (!strcasecmp(content, "server")) {
-				window_rule->icon_prefer_client = LAB_PROP_FALSE;
+				props[WINDOW_RULE_PROP_ICON_PREFER_CLIENT] = LAB_PROP_FALSE;
 			} else {
 				wlr_log(WLR_ERROR,
 					"Invalid value for window rule property 'iconPriority'");
 			}
 		} else if (!strcasecmp(key, "skipTaskbar")) {
-			set_property(content, &window_rule->skip_taskbar);
+			set_property(content, &props[WINDOW_RULE_PROP_SKIP_TASKBAR]);
 		} else if (!strcasecmp(key, "skipWindowSwitcher")) {
-			set_property(content, &window_rule->skip_window_switcher);
+			set_property(content, &props[WINDOW_RULE_PROP_SKIP_WINDOW_SWITCHER]);
 		} else if (!strcasecmp(key, "ignoreFocusRequest")) {
-			set_property(content, &window_rule->ignore_focus_request);
+			set_property(content, &props[WINDOW_RULE_PROP_IGNORE_FOCUS_REQUEST]);
 		} else if (!strcasecmp(key, "ignoreConfigureRequest")) {
-			set_property(content, &window_rule->ignore_configure_request);
+			set_property(content, &props[WINDOW_RULE_PROP_IGNORE_CONFIGURE_REQUEST]);
 		} else if (!strcasecmp(key, "fixedPosition")) {
-			set_property(content, &window_rule->fixed_position);
+			set_property(content, &props[WINDOW_RULE_PROP_FIXED_POSITION]);
+		} else if (!strcasecmp(key, "throttleWhenHidden")) {
+			set_property(content, &props[WINDOW_RULE_PROP_THROTTLE_WHEN_HIDDEN]);
+		} else if (!strcasecmp(key, "allowTearing")) {
+			set_property(content, &props[WINDOW_RULE_PROP_ALLOW_TEARING]);
+		} else if (!strcasecmp(key, "adaptiveSync")) {
+			set_property(content, &props[WINDOW_RULE_PROP_ADAPTIVE_SYNC]);
+		} else if (!strcasecmp(key, "receiveModifiers")) {
+			set_property(content, &props[WINDOW_RULE_PROP_RECEIVE_MODIFIERS]);
 		} else if (!strcasecmp(key, "tile")) {
-			set_property(content, &window_rule->tile);
+			set_property(content, &props[WINDOW_RULE_PROP_TILE]);
 		} else if (!strcasecmp(key, "tileDirection")) {
 			if (!strcasecmp(content, "vertical")) {
-				window_rule->tile_direction = LAB_PROP_TRUE;
+				props[WINDOW_RULE_PROP_TILE_DIRECTION] = LAB_PROP_TRUE;
 			} else if (!strcasecmp(content, "horizontal")) {
-				window_rule->tile_direction = LAB_PROP_FALSE;
+				props[WINDOW_RULE_PROP_TILE_DIRECTION] = LAB_PROP_FALSE;
 			} else if (!strcasecmp(content, "auto") || !strcasecmp(content, "default")) {
-				window_rule->tile_direction = LAB_PROP_UNSET;
+				props[WINDOW_RULE_PROP_TILE_DIRECTION] = LAB_PROP_UNSET;
 			} else {
 				wlr_log(WLR_ERROR,
 					"Invalid value for window rule property 'tileDirection': %s (expected: vertical, horizontal, or auto)",
@@ -430,15 +468,15 @@ fill_action_query(struct action *action, xmlNode *node, struct view_query *query
 	char *key, *content;
 	LAB_XML_FOR_EACH(node, child, key, content) {
 		if (!strcasecmp(key, "identifier")) {
-			xstrdup_replace(query->identifier, content);
+			match_pattern_set(&query->identifier, content);
 		} else if (!strcasecmp(key, "title")) {
-			xstrdup_replace(query->title, content);
+			match_pattern_set(&query->title, content);
 		} else if (!strcmp(key, "type")) {
 			query->window_type = parse_window_type(content);
 		} else if (!strcasecmp(key, "sandboxEngine")) {
-			xstrdup_replace(query->sandbox_engine, content);
+			match_pattern_set(&query->sandbox_engine, content);
 		} else if (!strcasecmp(key, "sandboxAppId")) {
-			xstrdup_replace(query->sandbox_app_id, content);
+			match_pattern_set(&query->sandbox_app_id, content);
 		} else if (!strcasecmp(key, "shaded")) {
 			query->shaded = parse_tristate(content);
 		} else if (!strcasecmp(key, "maximized")) {
@@ -453,7 +491,7 @@ fill_action_query(struct action *action, xmlNode *node, struct view_query *query
 			query->tiled = lab_edge_parse(content,
 				/*tiled*/ true, /*any*/ true);
 		} else if (!strcasecmp(key, "tiled_region")) {
-			xstrdup_replace(query->tiled_region, content);
+			match_pattern_set(&query->tiled_region, content);
 		} else if (!strcasecmp(key, "desktop")) {
 			xstrdup_replace(query->desktop, content);
 		} else if (!strcasecmp(key, "decoration")) {
@@ -590,7 +628,7 @@ fill_keybind(xmlNode *node)
 
 	char id_buf[256];
 	if (lab_xml_get_string(node, "id", id_buf, sizeof(id_buf))) {
-		xstrdup_replace(keybind->id, id_buf);
+		keybind->id = arena_strdup(&rc.arena, id_buf);
 	}
 
 	char device_blacklist_buf[1024];
@@ -608,8 +646,9 @@ fill_keybind(xmlNode *node)
 				end--;
 			}
 			if (*device_name) {
-				struct keybind_device_blacklist *entry = znew(*entry);
-				xstrdup_replace(entry->device_name, device_name);
+				struct keybind_device_blacklist *entry =
+					arena_new(&rc.arena, *entry);
+				entry->device_name = arena_strdup(&rc.arena, device_name);
 				wl_list_append(&keybind->device_blacklist, &entry->link);
 			}
 		}
@@ -631,8 +670,9 @@ fill_keybind(xmlNode *node)
 				end--;
 			}
 			if (*device_name) {
-				struct keybind_device_whitelist *entry = znew(*entry);
-				xstrdup_replace(entry->device_name, device_name);
+				struct keybind_device_whitelist *entry =
+					arena_new(&rc.arena, *entry);
+				entry->device_name = arena_strdup(&rc.arena, device_name);
 				wl_list_append(&keybind->device_whitelist, &entry->link);
 				wlr_log(WLR_INFO, "keybind whitelist: added device '%s' to whitelist",
 					entry->device_name);
@@ -643,7 +683,8 @@ fill_keybind(xmlNode *node)
 
 	char condition_command_buf[1024];
 	if (lab_xml_get_string(node, "conditionCommand", condition_command_buf, sizeof(condition_command_buf))) {
-		xstrdup_replace(keybind->condition_command, condition_command_buf);
+		keybind->condition_command =
+			arena_strdup(&rc.arena, condition_command_buf);
 	}
 
 	char condition_values_buf[1024];
@@ -666,7 +707,8 @@ fill_keybind(xmlNode *node)
 			}
 		}
 		if (count > 0) {
-			keybind->condition_values = xmalloc(count * sizeof(char *));
+			keybind->condition_values =
+				arena_new_n(&rc.arena, char *, count);
 			keybind->condition_values_len = 0;
 			for (size_t i = 0; values[i]; i++) {
 				char *value = values[i];
@@ -681,7 +723,8 @@ fill_keybind(xmlNode *node)
 				}
 				if (*value) {
 					/* Allocate and copy the trimmed value */
-					keybind->condition_values[keybind->condition_values_len] = xstrdup(value);
+					keybind->condition_values[keybind->condition_values_len] =
+						arena_strdup(&rc.arena, value);
 					keybind->condition_values_len++;
 				}
 			}
@@ -689,6 +732,33 @@ fill_keybind(xmlNode *node)
 		g_strfreev(values);
 	}
 
+	lab_xml_get_bool(node, "conditionHelper", &keybind->condition_use_helper);
+
+	int condition_cache_ms;
+	if (lab_xml_get_int(node, "conditionCacheTime", &condition_cache_ms)) {
+		keybind->condition_cache_ms = MAX(condition_cache_ms, 0);
+	}
+
+	char condition_cache_reset_buf[256];
+	if (lab_xml_get_string(node, "conditionCacheReset",
+			condition_cache_reset_buf, sizeof(condition_cache_reset_buf))) {
+		gchar **events = g_strsplit(condition_cache_reset_buf, ",", -1);
+		for (size_t i = 0; events[i]; i++) {
+			char *event = g_strstrip(events[i]);
+			if (!strcasecmp(event, "focus")) {
+				keybind->condition_cache_reset |=
+					KEYBIND_CONDITION_EVENT_FOCUS;
+			} else if (!strcasecmp(event, "workspace")) {
+				keybind->condition_cache_reset |=
+					KEYBIND_CONDITION_EVENT_WORKSPACE;
+			} else if (*event) {
+				wlr_log(WLR_ERROR, "invalid conditionCacheReset event '%s'",
+					event);
+			}
+		}
+		g_strfreev(events);
+	}
+
 	/* If keybind has a condition, check it before setting enabled state */
 	/* This must be done after parsing condition_command and condition_values */
 	if (enabled_specified && enabled_from_xml && keybind->condition_command) {
@@ -1214,6 +1284,559 @@ set_tearing_mode(const char *str, enum tearing_mode *variable)
 	}
 }
 
+static void
+parse_decoration(const char *content)
+{
+	rc.xdg_shell_server_side_deco = !!strcmp(content, "client");
+}
+
+static void
+parse_adaptive_sync(const char *content)
+{
+	set_adaptive_sync_mode(content, &rc.adaptive_sync);
+}
+
+static void
+parse_allow_tearing(const char *content)
+{
+	set_tearing_mode(content, &rc.allow_tearing);
+}
+
+static void
+parse_placement_policy(const char *content)
+{
+	enum lab_placement_policy policy = view_placement_parse(content);
+	if (policy != LAB_PLACE_INVALID) {
+		rc.placement_policy = policy;
+	}
+}
+
+static void
+parse_show_title(const char *content)
+{
+	rc.show_title = parse_bool(content, true);
+}
+
+static void
+parse_maximized_decoration(const char *content)
+{
+	if (!strcasecmp(content, "titlebar")) {
+		rc.hide_maximized_window_titlebar = false;
+	} else if (!strcasecmp(content, "none")) {
+		rc.hide_maximized_window_titlebar = true;
+	}
+}
+
+static void
+parse_doubleclick_time(const char *content)
+{
+	long doubleclick_time_parsed = strtol(content, NULL, 10);
+	if (doubleclick_time_parsed > 0) {
+		rc.doubleclick_time = doubleclick_time_parsed;
+	} else {
+		wlr_log(WLR_ERROR, "invalid doubleClickTime");
+	}
+}
+
+static void
+parse_motion_coalescing(const char *content)
+{
+	if (!strcasecmp(content, "frame")) {
+		rc.motion_coalescing = LAB_MOTION_COALESCING_FRAME;
+	} else if (!strcasecmp(content, "no")) {
+		rc.motion_coalescing = LAB_MOTION_COALESCING_OFF;
+	} else {
+		rc.motion_coalescing = MAX(0, atoi(content));
+	}
+}
+
+static void
+parse_numlock(const char *content)
+{
+	bool value;
+	set_bool(content, &value);
+	rc.kb_numlock_enable = value ? LAB_STATE_ENABLED
+		: LAB_STATE_DISABLED;
+}
+
+static void
+parse_layout_scope(const char *content)
+{
+	/*
+	 * This can be changed to an enum later on
+	 * if we decide to also support "application".
+	 */
+	rc.kb_layout_per_window = !strcasecmp(content, "window");
+}
+
+static void
+parse_snap_range(const char *content)
+{
+	rc.snap_edge_range_inner = atoi(content);
+	rc.snap_edge_range_outer = atoi(content);
+	wlr_log(WLR_ERROR, "<snapping><range> is deprecated. "
+		"Use <snapping><range inner=\"\" outer=\"\"> instead.");
+}
+
+static void
+parse_notify_client(const char *content)
+{
+	if (!strcasecmp(content, "always")) {
+		rc.snap_tiling_events_mode = LAB_TILING_EVENTS_ALWAYS;
+	} else if (!strcasecmp(content, "region")) {
+		rc.snap_tiling_events_mode = LAB_TILING_EVENTS_REGION;
+	} else if (!strcasecmp(content, "edge")) {
+		rc.snap_tiling_events_mode = LAB_TILING_EVENTS_EDGE;
+	} else if (!strcasecmp(content, "never")) {
+		rc.snap_tiling_events_mode = LAB_TILING_EVENTS_NEVER;
+	} else {
+		wlr_log(WLR_ERROR, "ignoring invalid value for notifyClient");
+	}
+}
+
+static void
+parse_tiling_layout(const char *content)
+{
+	enum lab_tiling_layout layout = tiling_layout_parse(content);
+	if (layout == LAB_TILING_LAYOUT_INVALID) {
+		wlr_log(WLR_ERROR, "ignoring invalid tiling layout '%s'", content);
+	} else {
+		rc.tiling_layout = layout;
+	}
+}
+
+static void
+parse_master_ratio(const char *content)
+{
+	double ratio = rc.tiling_master_ratio;
+	set_double(content, &ratio);
+	if (ratio >= 0.1 && ratio <= 0.9) {
+		rc.tiling_master_ratio = ratio;
+	} else {
+		wlr_log(WLR_ERROR, "ignoring invalid masterRatio '%s'", content);
+	}
+}
+
+static void
+parse_window_switcher_style(const char *content)
+{
+	if (!strcasecmp(content, "classic")) {
+		rc.window_switcher.style = CYCLE_OSD_STYLE_CLASSIC;
+	} else if (!strcasecmp(content, "thumbnail")) {
+		rc.window_switcher.style = CYCLE_OSD_STYLE_THUMBNAIL;
+	} else {
+		wlr_log(WLR_ERROR, "Invalid windowSwitcher style '%s': "
+			"should be one of classic|thumbnail", content);
+	}
+}
+
+static void
+parse_window_switcher_output(const char *content)
+{
+	if (!strcasecmp(content, "all")) {
+		rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_ALL;
+	} else if (!strcasecmp(content, "cursor")) {
+		rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_CURSOR;
+	} else if (!strcasecmp(content, "focused")) {
+		rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_FOCUSED;
+	} else {
+		wlr_log(WLR_ERROR, "Invalid windowSwitcher output '%s': "
+			"should be one of all|focused|cursor", content);
+	}
+}
+
+static void
+parse_window_switcher_order(const char *content)
+{
+	if (!strcasecmp(content, "focus")) {
+		rc.window_switcher.order = WINDOW_SWITCHER_ORDER_FOCUS;
+	} else if (!strcasecmp(content, "age")) {
+		rc.window_switcher.order = WINDOW_SWITCHER_ORDER_AGE;
+	} else {
+		wlr_log(WLR_ERROR, "Invalid windowSwitcher order '%s': "
+			"should be one of focus|age", content);
+	}
+}
+
+/* The following two are for backward compatibility only. */
+static void
+parse_deprecated_window_switcher_show(const char *content)
+{
+	set_bool(content, &rc.window_switcher.show);
+	wlr_log(WLR_ERROR, "<windowSwitcher show=\"\" /> is deprecated."
+		" Use <windowSwitcher><osd show=\"\" />");
+}
+
+static void
+parse_deprecated_window_switcher_style(const char *content)
+{
+	if (!strcasecmp(content, "classic")) {
+		rc.window_switcher.style = CYCLE_OSD_STYLE_CLASSIC;
+	} else if (!strcasecmp(content, "thumbnail")) {
+		rc.window_switcher.style = CYCLE_OSD_STYLE_THUMBNAIL;
+	}
+	wlr_log(WLR_ERROR, "<windowSwitcher style=\"\" /> is deprecated."
+		" Use <windowSwitcher><osd style=\"\" />");
+}
+
+static void
+parse_all_workspaces(const char *content)
+{
+	if (parse_bool(content, -1) == true) {
+		rc.window_switcher.criteria &=
+			~LAB_VIEW_CRITERIA_CURRENT_WORKSPACE;
+	}
+}
+
+/* The following three are for backward compatibility only */
+static void
+parse_cycle_view_osd(const char *content)
+{
+	set_bool(content, &rc.window_switcher.show);
+	wlr_log(WLR_ERROR, "<cycleViewOSD> is deprecated."
+		" Use <windowSwitcher show=\"\" />");
+}
+
+static void
+parse_cycle_view_preview(const char *content)
+{
+	set_bool(content, &rc.window_switcher.preview);
+	wlr_log(WLR_ERROR, "<cycleViewPreview> is deprecated."
+		" Use <windowSwitcher preview=\"\" />");
+}
+
+static void
+parse_cycle_view_outlines(const char *content)
+{
+	set_bool(content, &rc.window_switcher.outlines);
+	wlr_log(WLR_ERROR, "<cycleViewOutlines> is deprecated."
+		" Use <windowSwitcher outlines=\"\" />");
+}
+
+static void
+parse_workspace_name(const char *content)
+{
+	struct workspace *workspace = znew(*workspace);
+	workspace->name = xstrdup(content);
+	wl_list_append(&rc.workspace_config.workspaces, &workspace->link);
+}
+
+static void
+parse_workspace_number(const char *content)
+{
+	rc.workspace_config.min_nr_workspaces = MAX(1, atoi(content));
+}
+
+static void
+parse_swipe_fingers(const char *content)
+{
+	int fingers = atoi(content);
+	if (fingers && (fingers < 3 || fingers > 4)) {
+		wlr_log(WLR_ERROR, "invalid swipeFingers value %s", content);
+	} else {
+		rc.workspace_config.swipe_fingers = fingers;
+	}
+}
+
+static void
+parse_resize_popup_show(const char *content)
+{
+	if (!strcasecmp(content, "Always")) {
+		rc.resize_indicator = LAB_RESIZE_INDICATOR_ALWAYS;
+	} else if (!strcasecmp(content, "Never")) {
+		rc.resize_indicator = LAB_RESIZE_INDICATOR_NEVER;
+	} else if (!strcasecmp(content, "Nonpixel")) {
+		rc.resize_indicator = LAB_RESIZE_INDICATOR_NON_PIXEL;
+	} else {
+		wlr_log(WLR_ERROR, "Invalid value for <resize popupShow />");
+	}
+}
+
+static void
+parse_tablet_rotation(const char *content)
+{
+	rc.tablet.rotation = tablet_parse_rotation(atoi(content));
+}
+
+static void
+parse_tablet_area_left(const char *content)
+{
+	rc.tablet.box.x = tablet_get_dbl_if_positive(content, "left");
+}
+
+static void
+parse_tablet_area_top(const char *content)
+{
+	rc.tablet.box.y = tablet_get_dbl_if_positive(content, "top");
+}
+
+static void
+parse_tablet_area_width(const char *content)
+{
+	rc.tablet.box.width = tablet_get_dbl_if_positive(content, "width");
+}
+
+static void
+parse_tablet_area_height(const char *content)
+{
+	rc.tablet.box.height = tablet_get_dbl_if_positive(content, "height");
+}
+
+static void
+parse_tablet_tool_motion(const char *content)
+{
+	rc.tablet_tool.motion = tablet_parse_motion(content);
+}
+
+static void
+parse_relative_motion_sensitivity(const char *content)
+{
+	rc.tablet_tool.relative_motion_sensitivity =
+		tablet_get_dbl_if_positive(content, "relativeMotionSensitivity");
+}
+
+static void
+parse_magnifier_scale(const char *content)
+{
+	set_float(content, &rc.mag_scale);
+	rc.mag_scale = MAX(1.0, rc.mag_scale);
+}
+
+static void
+parse_magnifier_increment(const char *content)
+{
+	set_float(content, &rc.mag_increment);
+	rc.mag_increment = MAX(0, rc.mag_increment);
+}
+
+enum leaf_type {
+	LEAF_BOOL,
+	LEAF_INT,
+	/* Negative values are clamped to 0 */
+	LEAF_UINT,
+	LEAF_DOUBLE,
+	LEAF_STRING,
+	LEAF_CUSTOM,
+};
+
+/*
+ * Non-empty leaf nodes, looked up by their full lower case nodename.
+ * The table is sorted once on first use, so entries can be kept grouped
+ * by section.
+ */
+static struct leaf_option {
+	const char *name;
+	enum leaf_type type;
+	union {
+		void *value;
+		void (*parse)(const char *content);
+	};
+} leaf_options[] = {
+#define BOOL_OPTION(n, v) { .name = (n), .type = LEAF_BOOL, .value = (v) }
+#define INT_OPTION(n, v) { .name = (n), .type = LEAF_INT, .value = (v) }
+#define UINT_OPTION(n, v) { .name = (n), .type = LEAF_UINT, .value = (v) }
+#define DOUBLE_OPTION(n, v) { .name = (n), .type = LEAF_DOUBLE, .value = (v) }
+#define STRING_OPTION(n, v) { .name = (n), .type = LEAF_STRING, .value = (v) }
+#define CUSTOM_OPTION(n, f) { .name = (n), .type = LEAF_CUSTOM, .parse = (f) }
+	CUSTOM_OPTION("decoration.core", parse_decoration),
+	INT_OPTION("gap.core", &rc.gap),
+	CUSTOM_OPTION("adaptiveSync.core", parse_adaptive_sync),
+	CUSTOM_OPTION("allowTearing.core", parse_allow_tearing),
+	BOOL_OPTION("autoEnableOutputs.core", &rc.auto_enable_outputs),
+	BOOL_OPTION("reuseOutputMode.core", &rc.reuse_output_mode),
+	BOOL_OPTION("xwaylandPersistence.core", &rc.xwayland_persistence),
+	UINT_OPTION("xwaylandPrestart.core", &rc.xwayland_prestart),
+	UINT_OPTION("xwaylandIdleShutdown.core", &rc.xwayland_idle_shutdown),
+	BOOL_OPTION("spawnHelper.core", &rc.spawn_helper),
+	BOOL_OPTION("primarySelection.core", &rc.primary_selection),
+	STRING_OPTION("promptCommand.core", &rc.prompt_command),
+	BOOL_OPTION("nativePrompt.core", &rc.native_prompt),
+	UINT_OPTION("bufferCacheSize.core", &rc.scaled_buffer_cache_size),
+	BOOL_OPTION("prerenderScales.core", &rc.prerender_scales),
+	BOOL_OPTION("asyncTextRendering.core", &rc.async_text_rendering),
+	BOOL_OPTION("asyncIconLoading.core", &rc.async_icon_loading),
+	BOOL_OPTION("deferredStartup.core", &rc.deferred_startup),
+	UINT_OPTION("titleUpdateInterval.core", &rc.title_update_interval),
+	UINT_OPTION("memoryPressureThreshold.core", &rc.memory_pressure_threshold),
+	UINT_OPTION("hiddenFrameRate.core", &rc.hidden_frame_rate),
+	UINT_OPTION("idleNotifyInterval.core", &rc.idle_notify_interval),
+	BOOL_OPTION("hideOverlaysOnFullscreen.core",
+		&rc.hide_overlays_on_fullscreen),
+	UINT_OPTION("virtualOutputMaxFrameRate.core",
+		&rc.virtual_output_max_frame_rate),
+	UINT_OPTION("outputReleaseDelay.core", &rc.output_release_delay),
+	UINT_OPTION("sessionScriptTimeout.core", &rc.session_script_timeout),
+	UINT_OPTION("metricsInterval.core", &rc.metrics_interval),
+	CUSTOM_OPTION("cycleViewOSD.core", parse_cycle_view_osd),
+	CUSTOM_OPTION("cycleViewPreview.core", parse_cycle_view_preview),
+	CUSTOM_OPTION("cycleViewOutlines.core", parse_cycle_view_outlines),
+
+	CUSTOM_OPTION("policy.placement", parse_placement_policy),
+	INT_OPTION("x.cascadeOffset.placement", &rc.placement_cascade_offset_x),
+	INT_OPTION("y.cascadeOffset.placement", &rc.placement_cascade_offset_y),
+
+	STRING_OPTION("name.theme", &rc.theme_name),
+	STRING_OPTION("icon.theme", &rc.icon_theme_name),
+	STRING_OPTION("fallbackAppIcon.theme", &rc.fallback_app_icon_name),
+	CUSTOM_OPTION("layout.titlebar.theme", fill_title_layout),
+	CUSTOM_OPTION("showTitle.titlebar.theme", parse_show_title),
+	INT_OPTION("cornerRadius.theme", &rc.corner_radius),
+	BOOL_OPTION("keepBorder.theme", &rc.ssd_keep_border),
+	CUSTOM_OPTION("maximizedDecoration.theme", parse_maximized_decoration),
+	BOOL_OPTION("dropShadows.theme", &rc.shadows_enabled),
+	BOOL_OPTION("dropShadowsOnTiled.theme", &rc.shadows_on_tiled),
+
+	BOOL_OPTION("followMouse.focus", &rc.focus_follow_mouse),
+	BOOL_OPTION("followMouseRequiresMovement.focus",
+		&rc.focus_follow_mouse_requires_movement),
+	BOOL_OPTION("raiseOnFocus.focus", &rc.raise_on_focus),
+
+	CUSTOM_OPTION("doubleClickTime.mouse", parse_doubleclick_time),
+	CUSTOM_OPTION("motionCoalescing.mouse", parse_motion_coalescing),
+	UINT_OPTION("hardwareCursorMaxSize.mouse", &rc.hardware_cursor_max_size),
+	/* This is deprecated. Show an error message in post_processing() */
+	DOUBLE_OPTION("scrollFactor.mouse", &mouse_scroll_factor),
+
+	INT_OPTION("repeatRate.keyboard", &rc.repeat_rate),
+	INT_OPTION("repeatDelay.keyboard", &rc.repeat_delay),
+	CUSTOM_OPTION("numlock.keyboard", parse_numlock),
+	STRING_OPTION("conditionHelper.keyboard", &rc.kb_condition_helper),
+	CUSTOM_OPTION("layoutScope.keyboard", parse_layout_scope),
+
+	INT_OPTION("screenEdgeStrength.resistance", &rc.screen_edge_strength),
+	INT_OPTION("windowEdgeStrength.resistance", &rc.window_edge_strength),
+	INT_OPTION("unSnapThreshold.resistance", &rc.unsnap_threshold),
+	INT_OPTION("unMaximizeThreshold.resistance", &rc.unmaximize_threshold),
+
+	CUSTOM_OPTION("range.snapping", parse_snap_range),
+	INT_OPTION("inner.range.snapping", &rc.snap_edge_range_inner),
+	INT_OPTION("outer.range.snapping", &rc.snap_edge_range_outer),
+	INT_OPTION("cornerRange.snapping", &rc.snap_edge_corner_range),
+	BOOL_OPTION("enabled.overlay.snapping", &rc.snap_overlay_enabled),
+	INT_OPTION("inner.delay.overlay.snapping", &rc.snap_overlay_delay_inner),
+	INT_OPTION("outer.delay.overlay.snapping", &rc.snap_overlay_delay_outer),
+	BOOL_OPTION("topMaximize.snapping", &rc.snap_top_maximize),
+	CUSTOM_OPTION("notifyClient.snapping", parse_notify_client),
+
+	CUSTOM_OPTION("layout.tiling", parse_tiling_layout),
+	CUSTOM_OPTION("masterRatio.tiling", parse_master_ratio),
+
+	/*
+	 * <windowSwitcher preview="" outlines="">
+	 *   <osd show="" style="" output="" thumbnailLabelFormat="" />
+	 * </windowSwitcher>
+	 *
+	 * thumnailLabelFormat is handled in entry() to allow for an empty value
+	 */
+	BOOL_OPTION("show.osd.windowSwitcher", &rc.window_switcher.show),
+	CUSTOM_OPTION("style.osd.windowSwitcher", parse_window_switcher_style),
+	CUSTOM_OPTION("output.osd.windowSwitcher", parse_window_switcher_output),
+	CUSTOM_OPTION("order.windowSwitcher", parse_window_switcher_order),
+	CUSTOM_OPTION("show.windowSwitcher",
+		parse_deprecated_window_switcher_show),
+	CUSTOM_OPTION("style.windowSwitcher",
+		parse_deprecated_window_switcher_style),
+	BOOL_OPTION("preview.windowSwitcher", &rc.window_switcher.preview),
+	BOOL_OPTION("outlines.windowSwitcher", &rc.window_switcher.outlines),
+	CUSTOM_OPTION("allWorkspaces.windowSwitcher", parse_all_workspaces),
+	BOOL_OPTION("unshade.windowSwitcher", &rc.window_switcher.unshade),
+
+	CUSTOM_OPTION("name.names.desktops", parse_workspace_name),
+	INT_OPTION("popupTime.desktops", &rc.workspace_config.popuptime),
+	CUSTOM_OPTION("number.desktops", parse_workspace_number),
+	CUSTOM_OPTION("swipeFingers.desktops", parse_swipe_fingers),
+
+	CUSTOM_OPTION("popupShow.resize", parse_resize_popup_show),
+	BOOL_OPTION("drawContents.resize", &rc.resize_draw_contents),
+	BOOL_OPTION("clientPaced.resize", &rc.resize_client_paced),
+	BOOL_OPTION("snapshot.resize", &rc.resize_snapshot),
+	INT_OPTION("cornerRange.resize", &rc.resize_corner_range),
+	UINT_OPTION("minimumArea.resize", &rc.resize_minimum_area),
+
+	BOOL_OPTION("mouseEmulation.tablet", &rc.tablet.force_mouse_emulation),
+	STRING_OPTION("mapToOutput.tablet", &rc.tablet.output_name),
+	CUSTOM_OPTION("rotate.tablet", parse_tablet_rotation),
+	CUSTOM_OPTION("left.area.tablet", parse_tablet_area_left),
+	CUSTOM_OPTION("top.area.tablet", parse_tablet_area_top),
+	CUSTOM_OPTION("width.area.tablet", parse_tablet_area_width),
+	CUSTOM_OPTION("height.area.tablet", parse_tablet_area_height),
+	CUSTOM_OPTION("motion.tabletTool", parse_tablet_tool_motion),
+	BOOL_OPTION("motionCoalescing.tabletTool",
+		&rc.tablet_tool.motion_coalescing),
+	CUSTOM_OPTION("relativeMotionSensitivity.tabletTool",
+		parse_relative_motion_sensitivity),
+
+	INT_OPTION("ignoreButtonReleasePeriod.menu",
+		&rc.menu_ignore_button_release_period),
+	BOOL_OPTION("showIcons.menu", &rc.menu_show_icons),
+	INT_OPTION("idleTimeout.menu", &rc.menu_idle_timeout),
+
+	INT_OPTION("width.magnifier", &rc.mag_width),
+	INT_OPTION("height.magnifier", &rc.mag_height),
+	CUSTOM_OPTION("initScale.magnifier", parse_magnifier_scale),
+	CUSTOM_OPTION("increment.magnifier", parse_magnifier_increment),
+	BOOL_OPTION("useFilter.magnifier", &rc.mag_filter),
+
+	BOOL_OPTION("screencopy.protocols", &rc.protocol_screencopy),
+	BOOL_OPTION("dataControl.protocols", &rc.protocol_data_control),
+	BOOL_OPTION("foreignToplevel.protocols", &rc.protocol_foreign_toplevel),
+	BOOL_OPTION("drmLease.protocols", &rc.protocol_drm_lease),
+	BOOL_OPTION("tearingControl.protocols", &rc.protocol_tearing_control),
+#undef BOOL_OPTION
+#undef INT_OPTION
+#undef UINT_OPTION
+#undef DOUBLE_OPTION
+#undef STRING_OPTION
+#undef CUSTOM_OPTION
+};
+
+static int
+compare_leaf_options(const void *a, const void *b)
+{
+	const struct leaf_option *option_a = a;
+	const struct leaf_option *option_b = b;
+	return strcasecmp(option_a->name, option_b->name);
+}
+
+static struct leaf_option *
+find_leaf_option(const char *nodename)
+{
+	static bool sorted;
+	if (!sorted) {
+		qsort(leaf_options, ARRAY_SIZE(leaf_options),
+			sizeof(leaf_options[0]), compare_leaf_options);
+		sorted = true;
+	}
+	struct leaf_option key = { .name = nodename };
+	return bsearch(&key, leaf_options, ARRAY_SIZE(leaf_options),
+		sizeof(leaf_options[0]), compare_leaf_options);
+}
+
+static void
+set_leaf_option(struct leaf_option *option, const char *content)
+{
+	switch (option->type) {
+	case LEAF_BOOL:
+		set_bool(content, option->value);
+		break;
+	case LEAF_INT:
+		*(int *)option->value = atoi(content);
+		break;
+	case LEAF_UINT:
+		*(int *)option->value = MAX(0, atoi(content));
+		break;
+	case LEAF_DOUBLE:
+		set_double(content, option->value);
+		break;
+	case LEAF_STRING:
+		xstrdup_replace(*(char **)option->value, content);
+		break;
+	case LEAF_CUSTOM:
+		option->parse(content);
+		break;
+	}
+}
+
 /* Returns true if the node's children should also be traversed */
 static bool
 entry(xmlNode *node, char *nodename, char *content)
@@ -1228,6 +1851,8 @@ entry(xmlNode *node, char *nodename, char *content)
 	/* handle nested nodes */
 	if (!strcasecmp(nodename, "margin")) {
 		fill_usable_area_override(node);
+	} else if (!strcasecmp(nodename, "renderDelay")) {
+		fill_render_delay_config(node);
 	} else if (!strcasecmp(nodename, "keybind.keyboard")) {
 		fill_keybind(node);
 	} else if (!strcasecmp(nodename, "context.mouse")) {
@@ -1267,286 +1892,16 @@ entry(xmlNode *node, char *nodename, char *content)
 		wlr_log(WLR_ERROR, "Empty string is not allowed for %s. "
 			"Ignoring.", nodename);
 
-	/* handle non-empty leaf nodes */
-	} else if (!strcmp(nodename, "decoration.core")) {
-		if (!strcmp(content, "client")) {
-			rc.xdg_shell_server_side_deco = false;
-		} else {
-			rc.xdg_shell_server_side_deco = true;
-		}
-	} else if (!strcmp(nodename, "gap.core")) {
-		rc.gap = atoi(content);
-	} else if (!strcasecmp(nodename, "adaptiveSync.core")) {
-		set_adaptive_sync_mode(content, &rc.adaptive_sync);
-	} else if (!strcasecmp(nodename, "allowTearing.core")) {
-		set_tearing_mode(content, &rc.allow_tearing);
-	} else if (!strcasecmp(nodename, "autoEnableOutputs.core")) {
-		set_bool(content, &rc.auto_enable_outputs);
-	} else if (!strcasecmp(nodename, "reuseOutputMode.core")) {
-		set_bool(content, &rc.reuse_output_mode);
-	} else if (!strcasecmp(nodename, "xwaylandPersistence.core")) {
-		set_bool(content, &rc.xwayland_persistence);
-	} else if (!strcasecmp(nodename, "primarySelection.core")) {
-		set_bool(content, &rc.primary_selection);
-
-	} else if (!strcasecmp(nodename, "promptCommand.core")) {
-		xstrdup_replace(rc.prompt_command, content);
-
-	} else if (!strcmp(nodename, "policy.placement")) {
-		enum lab_placement_policy policy = view_placement_parse(content);
-		if (policy != LAB_PLACE_INVALID) {
-			rc.placement_policy = policy;
-		}
-	} else if (!strcasecmp(nodename, "x.cascadeOffset.placement")) {
-		rc.placement_cascade_offset_x = atoi(content);
-	} else if (!strcasecmp(nodename, "y.cascadeOffset.placement")) {
-		rc.placement_cascade_offset_y = atoi(content);
-	} else if (!strcmp(nodename, "name.theme")) {
-		xstrdup_replace(rc.theme_name, content);
-	} else if (!strcmp(nodename, "icon.theme")) {
-		xstrdup_replace(rc.icon_theme_name, content);
-	} else if (!strcasecmp(nodename, "fallbackAppIcon.theme")) {
-		xstrdup_replace(rc.fallback_app_icon_name, content);
-	} else if (!strcasecmp(nodename, "layout.titlebar.theme")) {
-		fill_title_layout(content);
-	} else if (!strcasecmp(nodename, "showTitle.titlebar.theme")) {
-		rc.show_title = parse_bool(content, true);
-	} else if (!strcmp(nodename, "cornerradius.theme")) {
-		rc.corner_radius = atoi(content);
-	} else if (!strcasecmp(nodename, "keepBorder.theme")) {
-		set_bool(content, &rc.ssd_keep_border);
-	} else if (!strcasecmp(nodename, "maximizedDecoration.theme")) {
-		if (!strcasecmp(content, "titlebar")) {
-			rc.hide_maximized_window_titlebar = false;
-		} else if (!strcasecmp(content, "none")) {
-			rc.hide_maximized_window_titlebar = true;
-		}
-	} else if (!strcasecmp(nodename, "dropShadows.theme")) {
-		set_bool(content, &rc.shadows_enabled);
-	} else if (!strcasecmp(nodename, "dropShadowsOnTiled.theme")) {
-		set_bool(content, &rc.shadows_on_tiled);
-	} else if (!strcasecmp(nodename, "followMouse.focus")) {
-		set_bool(content, &rc.focus_follow_mouse);
-	} else if (!strcasecmp(nodename, "followMouseRequiresMovement.focus")) {
-		set_bool(content, &rc.focus_follow_mouse_requires_movement);
-	} else if (!strcasecmp(nodename, "raiseOnFocus.focus")) {
-		set_bool(content, &rc.raise_on_focus);
-	} else if (!strcasecmp(nodename, "doubleClickTime.mouse")) {
-		long doubleclick_time_parsed = strtol(content, NULL, 10);
-		if (doubleclick_time_parsed > 0) {
-			rc.doubleclick_time = doubleclick_time_parsed;
-		} else {
-			wlr_log(WLR_ERROR, "invalid doubleClickTime");
-		}
-	} else if (!strcasecmp(nodename, "scrollFactor.mouse")) {
-		/* This is deprecated. Show an error message in post_processing() */
-		set_double(content, &mouse_scroll_factor);
-
-	} else if (!strcasecmp(nodename, "repeatRate.keyboard")) {
-		rc.repeat_rate = atoi(content);
-	} else if (!strcasecmp(nodename, "repeatDelay.keyboard")) {
-		rc.repeat_delay = atoi(content);
-	} else if (!strcasecmp(nodename, "numlock.keyboard")) {
-		bool value;
-		set_bool(content, &value);
-		rc.kb_numlock_enable = value ? LAB_STATE_ENABLED
-			: LAB_STATE_DISABLED;
-	} else if (!strcasecmp(nodename, "layoutScope.keyboard")) {
-		/*
-		 * This can be changed to an enum later on
-		 * if we decide to also support "application".
-		 */
-		rc.kb_layout_per_window = !strcasecmp(content, "window");
-	} else if (!strcasecmp(nodename, "screenEdgeStrength.resistance")) {
-		rc.screen_edge_strength = atoi(content);
-	} else if (!strcasecmp(nodename, "windowEdgeStrength.resistance")) {
-		rc.window_edge_strength = atoi(content);
-	} else if (!strcasecmp(nodename, "unSnapThreshold.resistance")) {
-		rc.unsnap_threshold = atoi(content);
-	} else if (!strcasecmp(nodename, "unMaximizeThreshold.resistance")) {
-		rc.unmaximize_threshold = atoi(content);
-	} else if (!strcasecmp(nodename, "range.snapping")) {
-		rc.snap_edge_range_inner = atoi(content);
-		rc.snap_edge_range_outer = atoi(content);
-		wlr_log(WLR_ERROR, "<snapping><range> is deprecated. "
-			"Use <snapping><range inner=\"\" outer=\"\"> instead.");
-	} else if (!strcasecmp(nodename, "inner.range.snapping")) {
-		rc.snap_edge_range_inner = atoi(content);
-	} else if (!strcasecmp(nodename, "outer.range.snapping")) {
-		rc.snap_edge_range_outer = atoi(content);
-	} else if (!strcasecmp(nodename, "cornerRange.snapping")) {
-		rc.snap_edge_corner_range = atoi(content);
-	} else if (!strcasecmp(nodename, "enabled.overlay.snapping")) {
-		set_bool(content, &rc.snap_overlay_enabled);
-	} else if (!strcasecmp(nodename, "inner.delay.overlay.snapping")) {
-		rc.snap_overlay_delay_inner = atoi(content);
-	} else if (!strcasecmp(nodename, "outer.delay.overlay.snapping")) {
-		rc.snap_overlay_delay_outer = atoi(content);
-	} else if (!strcasecmp(nodename, "topMaximize.snapping")) {
-		set_bool(content, &rc.snap_top_maximize);
-	} else if (!strcasecmp(nodename, "notifyClient.snapping")) {
-		if (!strcasecmp(content, "always")) {
-			rc.snap_tiling_events_mode = LAB_TILING_EVENTS_ALWAYS;
-		} else if (!strcasecmp(content, "region")) {
-			rc.snap_tiling_events_mode = LAB_TILING_EVENTS_REGION;
-		} else if (!strcasecmp(content, "edge")) {
-			rc.snap_tiling_events_mode = LAB_TILING_EVENTS_EDGE;
-		} else if (!strcasecmp(content, "never")) {
-			rc.snap_tiling_events_mode = LAB_TILING_EVENTS_NEVER;
-		} else {
-			wlr_log(WLR_ERROR, "ignoring invalid value for notifyClient");
-		}
-
-	/*
-	 * <windowSwitcher preview="" outlines="">
-	 *   <osd show="" style="" output="" thumbnailLabelFormat="" />
-	 * </windowSwitcher>
-	 *
-	 * thumnailLabelFormat is handled above to allow for an empty value
-	 */
-	} else if (!strcasecmp(nodename, "show.osd.windowSwitcher")) {
-		set_bool(content, &rc.window_switcher.show);
-	} else if (!strcasecmp(nodename, "style.osd.windowSwitcher")) {
-		if (!strcasecmp(content, "classic")) {
-			rc.window_switcher.style = CYCLE_OSD_STYLE_CLASSIC;
-		} else if (!strcasecmp(content, "thumbnail")) {
-			rc.window_switcher.style = CYCLE_OSD_STYLE_THUMBNAIL;
-		} else {
-			wlr_log(WLR_ERROR, "Invalid windowSwitcher style '%s': "
-				"should be one of classic|thumbnail", content);
-		}
-	} else if (!strcasecmp(nodename, "output.osd.windowSwitcher")) {
-		if (!strcasecmp(content, "all")) {
-			rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_ALL;
-		} else if (!strcasecmp(content, "cursor")) {
-			rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_CURSOR;
-		} else if (!strcasecmp(content, "focused")) {
-			rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_FOCUSED;
-		} else {
-			wlr_log(WLR_ERROR, "Invalid windowSwitcher output '%s': "
-				"should be one of all|focused|cursor", content);
-		}
-	} else if (!strcasecmp(nodename, "order.windowSwitcher")) {
-		if (!strcasecmp(content, "focus")) {
-			rc.window_switcher.order = WINDOW_SWITCHER_ORDER_FOCUS;
-		} else if (!strcasecmp(content, "age")) {
-			rc.window_switcher.order = WINDOW_SWITCHER_ORDER_AGE;
-		} else {
-			wlr_log(WLR_ERROR, "Invalid windowSwitcher order '%s': "
-				"should be one of focus|age", content);
-		}
-
-	/* The following two are for backward compatibility only. */
-	} else if (!strcasecmp(nodename, "show.windowSwitcher")) {
-		set_bool(content, &rc.window_switcher.show);
-		wlr_log(WLR_ERROR, "<windowSwitcher show=\"\" /> is deprecated."
-			" Use <windowSwitcher><osd show=\"\" />");
-	} else if (!strcasecmp(nodename, "style.windowSwitcher")) {
-		if (!strcasecmp(content, "classic")) {
-			rc.window_switcher.style = CYCLE_OSD_STYLE_CLASSIC;
-		} else if (!strcasecmp(content, "thumbnail")) {
-			rc.window_switcher.style = CYCLE_OSD_STYLE_THUMBNAIL;
-		}
-		wlr_log(WLR_ERROR, "<windowSwitcher style=\"\" /> is deprecated."
-			" Use <windowSwitcher><osd style=\"\" />");
-
-	} else if (!strcasecmp(nodename, "preview.windowSwitcher")) {
-		set_bool(content, &rc.window_switcher.preview);
-	} else if (!strcasecmp(nodename, "outlines.windowSwitcher")) {
-		set_bool(content, &rc.window_switcher.outlines);
-	} else if (!strcasecmp(nodename, "allWorkspaces.windowSwitcher")) {
-		if (parse_bool(content, -1) == true) {
-			rc.window_switcher.criteria &=
-				~LAB_VIEW_CRITERIA_CURRENT_WORKSPACE;
-		}
-	} else if (!strcasecmp(nodename, "unshade.windowSwitcher")) {
-		set_bool(content, &rc.window_switcher.unshade);
-
 	/* Remove this long term - just a friendly warning for now */
 	} else if (strstr(nodename, "windowswitcher.core")) {
 		wlr_log(WLR_ERROR, "<windowSwitcher> should not be child of <core>");
 
-	/* The following three are for backward compatibility only */
-	} else if (!strcasecmp(nodename, "show.windowSwitcher.core")) {
-		set_bool(content, &rc.window_switcher.show);
-	} else if (!strcasecmp(nodename, "preview.windowSwitcher.core")) {
-		set_bool(content, &rc.window_switcher.preview);
-	} else if (!strcasecmp(nodename, "outlines.windowSwitcher.core")) {
-		set_bool(content, &rc.window_switcher.outlines);
-
-	/* The following three are for backward compatibility only */
-	} else if (!strcasecmp(nodename, "cycleViewOSD.core")) {
-		set_bool(content, &rc.window_switcher.show);
-		wlr_log(WLR_ERROR, "<cycleViewOSD> is deprecated."
-			" Use <windowSwitcher show=\"\" />");
-	} else if (!strcasecmp(nodename, "cycleViewPreview.core")) {
-		set_bool(content, &rc.window_switcher.preview);
-		wlr_log(WLR_ERROR, "<cycleViewPreview> is deprecated."
-			" Use <windowSwitcher preview=\"\" />");
-	} else if (!strcasecmp(nodename, "cycleViewOutlines.core")) {
-		set_bool(content, &rc.window_switcher.outlines);
-		wlr_log(WLR_ERROR, "<cycleViewOutlines> is deprecated."
-			" Use <windowSwitcher outlines=\"\" />");
-
-	} else if (!strcasecmp(nodename, "name.names.desktops")) {
-		struct workspace *workspace = znew(*workspace);
-		workspace->name = xstrdup(content);
-		wl_list_append(&rc.workspace_config.workspaces, &workspace->link);
-	} else if (!strcasecmp(nodename, "popupTime.desktops")) {
-		rc.workspace_config.popuptime = atoi(content);
-	} else if (!strcasecmp(nodename, "number.desktops")) {
-		rc.workspace_config.min_nr_workspaces = MAX(1, atoi(content));
-	} else if (!strcasecmp(nodename, "popupShow.resize")) {
-		if (!strcasecmp(content, "Always")) {
-			rc.resize_indicator = LAB_RESIZE_INDICATOR_ALWAYS;
-		} else if (!strcasecmp(content, "Never")) {
-			rc.resize_indicator = LAB_RESIZE_INDICATOR_NEVER;
-		} else if (!strcasecmp(content, "Nonpixel")) {
-			rc.resize_indicator = LAB_RESIZE_INDICATOR_NON_PIXEL;
-		} else {
-			wlr_log(WLR_ERROR, "Invalid value for <resize popupShow />");
+	/* handle non-empty leaf nodes */
+	} else {
+		struct leaf_option *option = find_leaf_option(nodename);
+		if (option) {
+			set_leaf_option(option, content);
 		}
-	} else if (!strcasecmp(nodename, "drawContents.resize")) {
-		set_bool(content, &rc.resize_draw_contents);
-	} else if (!strcasecmp(nodename, "cornerRange.resize")) {
-		rc.resize_corner_range = atoi(content);
-	} else if (!strcasecmp(nodename, "minimumArea.resize")) {
-		rc.resize_minimum_area = MAX(0, atoi(content));
-	} else if (!strcasecmp(nodename, "mouseEmulation.tablet")) {
-		set_bool(content, &rc.tablet.force_mouse_emulation);
-	} else if (!strcasecmp(nodename, "mapToOutput.tablet")) {
-		xstrdup_replace(rc.tablet.output_name, content);
-	} else if (!strcasecmp(nodename, "rotate.tablet")) {
-		rc.tablet.rotation = tablet_parse_rotation(atoi(content));
-	} else if (!strcasecmp(nodename, "left.area.tablet")) {
-		rc.tablet.box.x = tablet_get_dbl_if_positive(content, "left");
-	} else if (!strcasecmp(nodename, "top.area.tablet")) {
-		rc.tablet.box.y = tablet_get_dbl_if_positive(content, "top");
-	} else if (!strcasecmp(nodename, "width.area.tablet")) {
-		rc.tablet.box.width = tablet_get_dbl_if_positive(content, "width");
-	} else if (!strcasecmp(nodename, "height.area.tablet")) {
-		rc.tablet.box.height = tablet_get_dbl_if_positive(content, "height");
-	} else if (!strcasecmp(nodename, "motion.tabletTool")) {
-		rc.tablet_tool.motion = tablet_parse_motion(content);
-	} else if (!strcasecmp(nodename, "relativeMotionSensitivity.tabletTool")) {
-		rc.tablet_tool.relative_motion_sensitivity =
-			tablet_get_dbl_if_positive(content, "relativeMotionSensitivity");
-	} else if (!strcasecmp(nodename, "ignoreButtonReleasePeriod.menu")) {
-		rc.menu_ignore_button_release_period = atoi(content);
-	} else if (!strcasecmp(nodename, "showIcons.menu")) {
-		set_bool(content, &rc.menu_show_icons);
-	} else if (!strcasecmp(nodename, "width.magnifier")) {
-		rc.mag_width = atoi(content);
-	} else if (!strcasecmp(nodename, "height.magnifier")) {
-		rc.mag_height = atoi(content);
-	} else if (!strcasecmp(nodename, "initScale.magnifier")) {
-		set_float(content, &rc.mag_scale);
-		rc.mag_scale = MAX(1.0, rc.mag_scale);
-	} else if (!strcasecmp(nodename, "increment.magnifier")) {
-		set_float(content, &rc.mag_increment);
-		rc.mag_increment = MAX(0, rc.mag_increment);
-	} else if (!strcasecmp(nodename, "useFilter.magnifier")) {
-		set_bool(content, &rc.mag_filter);
 	}
 
 	return false;
@@ -1567,14 +1922,73 @@ traverse(xmlNode *node)
 	}
 }
 
+static uint64_t
+hash_xml_node(uint64_t hash, xmlNode *node)
+{
+	hash = hash_add(hash, &node->type, sizeof(node->type));
+	hash = hash_add_str(hash, (const char *)node->name);
+	hash = hash_add_str(hash, (const char *)node->content);
+	for (xmlAttr *attr = node->properties; attr; attr = attr->next) {
+		hash = hash_add_str(hash, (const char *)attr->name);
+		if (attr->children) {
+			hash = hash_add_str(hash,
+				(const char *)attr->children->content);
+		}
+	}
+	for (xmlNode *child = node->children; child; child = child->next) {
+		hash = hash_xml_node(hash, child);
+	}
+	return hash;
+}
+
+static enum rc_section
+section_from_name(const char *name)
+{
+	static const struct {
+		const char *name;
+		enum rc_section section;
+	} sections[] = {
+		{ "core", RC_SECTION_CORE },
+		{ "theme", RC_SECTION_THEME },
+		{ "resize", RC_SECTION_RESIZE },
+		{ "keyboard", RC_SECTION_KEYBOARD },
+		{ "mouse", RC_SECTION_MOUSE },
+		{ "windowRules", RC_SECTION_WINDOW_RULES },
+		{ "menu", RC_SECTION_MENU },
+		{ "libinput", RC_SECTION_LIBINPUT },
+		{ "desktops", RC_SECTION_DESKTOPS },
+		{ "regions", RC_SECTION_REGIONS },
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(sections); i++) {
+		if (!strcasecmp(name, sections[i].name)) {
+			return sections[i].section;
+		}
+	}
+	return RC_SECTION_OTHER;
+}
+
+/* Mix the top-level elements of @root into rc.section_hashes */
 static void
-rcxml_parse_xml(struct buf *b, const char *filename)
+hash_sections(xmlNode *root)
+{
+	for (xmlNode *node = root->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		enum rc_section section = section_from_name((const char *)node->name);
+		rc.section_hashes[section] =
+			hash_xml_node(rc.section_hashes[section], node);
+	}
+}
+
+static xmlDoc *
+read_xml(struct buf *b, const char *filename)
 {
 	int options = XML_PARSE_XINCLUDE;
 	xmlDoc *d = xmlReadMemory(b->data, b->len, filename, NULL, options);
 	if (!d) {
 		wlr_log(WLR_ERROR, "error parsing config file");
-		return;
+		return NULL;
 	}
 
 	/* Process XInclude directives */
@@ -1586,12 +2000,30 @@ rcxml_parse_xml(struct buf *b, const char *filename)
 	}
 
 	xmlNode *root = xmlDocGetRootElement(d);
+	if (root) {
+		lab_xml_expand_dotted_attributes(root);
+		if (rc.config_cache && ret >= 0) {
+			rcxml_cache_store(filename, b, d);
+		}
+	}
+	return d;
+}
 
-	lab_xml_expand_dotted_attributes(root);
-	traverse(root);
-
-	xmlFreeDoc(d);
-	xmlCleanupParser();
+static xmlDoc *
+rcxml_parse_xml(struct buf *b, const char *filename)
+{
+	xmlDoc *d = NULL;
+	if (rc.config_cache) {
+		d = rcxml_cache_load(filename, b);
+	}
+	if (!d) {
+		d = read_xml(b, filename);
+	}
+	if (d && !xmlDocGetRootElement(d)) {
+		xmlFreeDoc(d);
+		d = NULL;
+	}
+	return d;
 }
 
 static void
@@ -1609,6 +2041,7 @@ rcxml_init(void)
 
 	if (!has_run) {
 		wl_list_init(&rc.usable_area_overrides);
+		wl_list_init(&rc.render_delay_configs);
 		wl_list_init(&rc.keybinds);
 		wl_list_init(&rc.mousebinds);
 		wl_list_init(&rc.libinput_categories);
@@ -1640,7 +2073,25 @@ rcxml_init(void)
 	rc.auto_enable_outputs = true;
 	rc.reuse_output_mode = false;
 	rc.xwayland_persistence = false;
+	rc.xwayland_prestart = 0;
+	rc.xwayland_idle_shutdown = 0;
+	rc.spawn_helper = false;
 	rc.primary_selection = true;
+	rc.native_prompt = false;
+	rc.scaled_buffer_cache_size = 64;
+	rc.prerender_scales = false;
+	rc.async_text_rendering = false;
+	rc.async_icon_loading = false;
+	rc.deferred_startup = false;
+	rc.title_update_interval = 0;
+	rc.memory_pressure_threshold = 0;
+	rc.hidden_frame_rate = 0;
+	rc.idle_notify_interval = 50;
+	rc.hide_overlays_on_fullscreen = false;
+	rc.virtual_output_max_frame_rate = 0;
+	rc.output_release_delay = 0;
+	rc.session_script_timeout = 0;
+	rc.metrics_interval = 0;
 
 	init_font_defaults(&rc.font_activewindow);
 	init_font_defaults(&rc.font_inactivewindow);
@@ -1653,6 +2104,8 @@ rcxml_init(void)
 	rc.raise_on_focus = false;
 
 	rc.doubleclick_time = 500;
+	rc.motion_coalescing = LAB_MOTION_COALESCING_OFF;
+	rc.hardware_cursor_max_size = 0;
 
 	rc.tablet.force_mouse_emulation = false;
 	rc.tablet.output_name = NULL;
@@ -1661,6 +2114,7 @@ rcxml_init(void)
 	tablet_load_default_button_mappings();
 	rc.tablet_tool.motion = LAB_MOTION_ABSOLUTE;
 	rc.tablet_tool.relative_motion_sensitivity = 1.0;
+	rc.tablet_tool.motion_coalescing = false;
 
 	rc.repeat_rate = 25;
 	rc.repeat_delay = 600;
@@ -1680,6 +2134,9 @@ rcxml_init(void)
 	rc.snap_top_maximize = true;
 	rc.snap_tiling_events_mode = LAB_TILING_EVENTS_ALWAYS;
 
+	rc.tiling_layout = LAB_TILING_LAYOUT_GRID;
+	rc.tiling_master_ratio = 0.55;
+
 	rc.window_switcher.show = true;
 	rc.window_switcher.style = CYCLE_OSD_STYLE_CLASSIC;
 	rc.window_switcher.output_criteria = CYCLE_OSD_OUTPUT_ALL;
@@ -1694,20 +2151,30 @@ rcxml_init(void)
 
 	rc.resize_indicator = LAB_RESIZE_INDICATOR_NEVER;
 	rc.resize_draw_contents = true;
+	rc.resize_client_paced = true;
+	rc.resize_snapshot = false;
 	rc.resize_corner_range = -1;
 	rc.resize_minimum_area = 8;
 
 	rc.workspace_config.popuptime = INT_MIN;
 	rc.workspace_config.min_nr_workspaces = 1;
+	rc.workspace_config.swipe_fingers = 0;
 
 	rc.menu_ignore_button_release_period = 250;
 	rc.menu_show_icons = true;
+	rc.menu_idle_timeout = 0;
 
 	rc.mag_width = 400;
 	rc.mag_height = 400;
 	rc.mag_scale = 2.0;
 	rc.mag_increment = 0.2;
 	rc.mag_filter = true;
+
+	rc.protocol_screencopy = true;
+	rc.protocol_data_control = true;
+	rc.protocol_foreign_toplevel = true;
+	rc.protocol_drm_lease = true;
+	rc.protocol_tearing_control = true;
 }
 
 static void
@@ -1792,7 +2259,6 @@ deduplicate_mouse_bindings(void)
 			if (mousebind_the_same(existing, current)) {
 				wl_list_remove(&existing->link);
 				action_list_free(&existing->actions);
-				free(existing);
 				replaced++;
 				break;
 			}
@@ -1801,7 +2267,6 @@ deduplicate_mouse_bindings(void)
 	wl_list_for_each_safe(current, tmp, &rc.mousebinds, link) {
 		if (wl_list_empty(&current->actions)) {
 			wl_list_remove(&current->link);
-			free(current);
 			cleared++;
 		}
 	}
@@ -2000,10 +2465,10 @@ static void
 rule_destroy(struct window_rule *rule)
 {
 	wl_list_remove(&rule->link);
-	zfree(rule->identifier);
-	zfree(rule->title);
-	zfree(rule->sandbox_engine);
-	zfree(rule->sandbox_app_id);
+	match_pattern_finish(&rule->identifier);
+	match_pattern_finish(&rule->title);
+	match_pattern_finish(&rule->sandbox_engine);
+	match_pattern_finish(&rule->sandbox_app_id);
 	action_list_free(&rule->actions);
 	zfree(rule);
 }
@@ -2072,8 +2537,10 @@ validate(void)
 	/* Window-rule criteria */
 	struct window_rule *rule, *rule_tmp;
 	wl_list_for_each_safe(rule, rule_tmp, &rc.window_rules, link) {
-		if (!rule->identifier && !rule->title && rule->window_type < 0
-				&& !rule->sandbox_engine && !rule->sandbox_app_id) {
+		if (!rule->identifier.pattern && !rule->title.pattern
+				&& rule->window_type < 0
+				&& !rule->sandbox_engine.pattern
+				&& !rule->sandbox_app_id.pattern) {
 			wlr_log(WLR_ERROR, "Deleting rule %p as it has no criteria", rule);
 			rule_destroy(rule);
 		}
@@ -2092,25 +2559,27 @@ validate(void)
 			cycle_osd_field_free(field);
 		}
 	}
+	rc.window_switcher.thumbnail_label = cycle_osd_format_compile(
+		rc.window_switcher.thumbnail_label_format);
 }
 
 void
-rcxml_read(const char *filename)
+rcxml_get_paths(struct wl_list *paths, const char *filename)
 {
-	rcxml_init();
-
-	struct wl_list paths;
-
 	if (filename) {
 		/* Honour command line argument -c <filename> */
-		wl_list_init(&paths);
+		wl_list_init(paths);
 		struct path *path = znew(*path);
 		path->string = xstrdup(filename);
-		wl_list_append(&paths, &path->link);
+		wl_list_append(paths, &path->link);
 	} else {
-		paths_config_create(&paths, "rc.xml");
+		paths_config_create(paths, "rc.xml");
 	}
+}
 
+void
+rcxml_load(struct wl_list *paths, struct wl_array *docs)
+{
 	/* Reading file into buffer before parsing - better for unit tests */
 	bool should_merge_config = rc.merge_config;
 	struct wl_list *(*iter)(struct wl_list *list);
@@ -2126,7 +2595,7 @@ rcxml_read(const char *filename)
 	 * If merging, we iterate backwards (least important XDG Base Dir first)
 	 * and keep going.
 	 */
-	for (struct wl_list *elm = iter(&paths); elm != &paths; elm = iter(elm)) {
+	for (struct wl_list *elm = iter(paths); elm != paths; elm = iter(elm)) {
 		struct path *path = wl_container_of(elm, path, link);
 		struct buf b = buf_from_file(path->string);
 		if (!b.len) {
@@ -2135,15 +2604,51 @@ rcxml_read(const char *filename)
 
 		wlr_log(WLR_INFO, "read config file %s", path->string);
 
-		rcxml_parse_xml(&b, path->string);
+		xmlDoc *d = rcxml_parse_xml(&b, path->string);
+		if (d) {
+			xmlDoc **slot = wl_array_add(docs, sizeof(*slot));
+			*slot = d;
+		}
 		buf_reset(&b);
 		if (!should_merge_config) {
 			break;
 		}
 	};
-	paths_destroy(&paths);
+}
+
+void
+rcxml_read_docs(struct wl_array *docs)
+{
+	trace_begin("rcxml_read");
+	rcxml_init();
+	for (int i = 0; i < RC_SECTION_COUNT; i++) {
+		rc.section_hashes[i] = HASH_INIT;
+	}
+
+	xmlDoc **d;
+	wl_array_for_each(d, docs) {
+		xmlNode *root = xmlDocGetRootElement(*d);
+		hash_sections(root);
+		traverse(root);
+	}
+	lab_xml_docs_release(docs);
+
 	post_processing();
 	validate();
+	window_rules_compile();
+	trace_end("rcxml_read");
+}
+
+void
+rcxml_read(const char *filename)
+{
+	struct wl_list paths;
+	rcxml_get_paths(&paths, filename);
+	struct wl_array docs;
+	wl_array_init(&docs);
+	rcxml_load(&paths, &docs);
+	paths_destroy(&paths);
+	rcxml_read_docs(&docs);
 }
 
 void
@@ -2155,12 +2660,15 @@ rcxml_finish(void)
 	zfree(rc.font_menuitem.name);
 	zfree(rc.font_osd.name);
 	zfree(rc.prompt_command);
+	zfree(rc.kb_condition_helper);
 	zfree(rc.theme_name);
 	zfree(rc.icon_theme_name);
 	zfree(rc.fallback_app_icon_name);
 	zfree(rc.workspace_config.prefix);
 	zfree(rc.tablet.output_name);
 	zfree(rc.window_switcher.thumbnail_label_format);
+	cycle_osd_format_destroy(rc.window_switcher.thumbnail_label);
+	rc.window_switcher.thumbnail_label = NULL;
 
 	clear_title_layout();
 
@@ -2171,6 +2679,15 @@ rcxml_finish(void)
 		zfree(area);
 	}
 
+	struct render_delay_config *delay, *delay_tmp;
+	wl_list_for_each_safe(delay, delay_tmp, &rc.render_delay_configs, link) {
+		wl_list_remove(&delay->link);
+		zfree(delay->output);
+		zfree(delay);
+	}
+
+	keybind_condition_cache_report();
+
 	struct keybind *k, *k_tmp;
 	wl_list_for_each_safe(k, k_tmp, &rc.keybinds, link) {
 		wl_list_remove(&k->link);
@@ -2182,7 +2699,6 @@ rcxml_finish(void)
 	wl_list_for_each_safe(m, m_tmp, &rc.mousebinds, link) {
 		wl_list_remove(&m->link);
 		action_list_free(&m->actions);
-		zfree(m);
 	}
 
 	struct touch_config_entry *touch_config, *touch_config_tmp;
@@ -2222,6 +2738,10 @@ rcxml_finish(void)
 	wl_list_for_each_safe(rule, rule_tmp, &rc.window_rules, link) {
 		rule_destroy(rule);
 	}
+	window_rules_compile();
+
+	/* Keybinds and mousebinds */
+	arena_finish(&rc.arena);
 
 	/* Reset state vars for starting fresh when Reload is triggered */
 	mouse_scroll_factor = -1;
@@ -3,6 +3,7 @@
 #include "config/session.h"
 #include <assert.h>
 #include <dirent.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,11 +15,15 @@
 #include "common/buf.h"
 #include "common/dir.h"
 #include "common/file-helpers.h"
+#include "common/hash.h"
+#include "common/macros.h"
+#include "common/mem.h"
 #include "common/parse-bool.h"
 #include "common/spawn.h"
 #include "common/string-helpers.h"
 #include "config/rcxml.h"
 #include "labwc.h"
+#include "timer.h"
 
 static const char *const env_vars[] = {
 	"DISPLAY",
@@ -28,6 +33,7 @@ static const char *const env_vars[] = {
 	"XCURSOR_THEME",
 	"XDG_SESSION_TYPE",
 	"LABWC_PID",
+	"LABWC_SOCK",
 	"LABWC_VER",
 	NULL
 };
@@ -115,7 +121,7 @@ strdup_env_path_validate(const char *prefix, struct dirent *dirent)
 		return NULL;
 	}
 
-	/* Valid environment files must be regular files */
+	/* Valid environment files and session scripts must be regular files */
 	struct stat statbuf;
 	if (stat(full_path, &statbuf) == 0 && S_ISREG(statbuf.st_mode)) {
 		return full_path;
@@ -176,6 +182,89 @@ env_dir_cleanup:
 	return success;
 }
 
+/* Longest wait for the activation environment update before autostart */
+#define ACTIVATION_TIMEOUT_MS 1000
+
+static struct {
+	/* Of the values of env_vars when they were last exported */
+	uint64_t exported_hash;
+	/* dbus-update-activation-environment and systemctl */
+	pid_t pids[2];
+	/* Autostart waits for the update, as it may rely on D-Bus activation */
+	bool autostart_pending;
+	struct wl_event_source *timeout;
+} activation;
+
+static uint64_t
+env_vars_hash(void)
+{
+	uint64_t hash = HASH_INIT;
+	for (const char *const *var = env_vars; *var; var++) {
+		const char *value = getenv(*var);
+		bool set = value;
+		hash = hash_add(hash, &set, sizeof(set));
+		hash = hash_add_str(hash, value);
+	}
+	return hash;
+}
+
+static bool
+activation_pending(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(activation.pids); i++) {
+		if (activation.pids[i] > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+run_pending_autostart(void)
+{
+	if (activation.timeout) {
+		wl_event_source_remove(activation.timeout);
+		activation.timeout = NULL;
+	}
+	if (activation.autostart_pending) {
+		activation.autostart_pending = false;
+		session_run_script("autostart");
+	}
+}
+
+static int
+handle_activation_timeout(void *data)
+{
+	wlr_log(WLR_ERROR, "activation environment update takes more than %d ms, "
+		"running autostart anyway", ACTIVATION_TIMEOUT_MS);
+	run_pending_autostart();
+	return 0;
+}
+
+bool
+session_check_activation_result(pid_t pid, int exit_code)
+{
+	bool found = false;
+	for (size_t i = 0; i < ARRAY_SIZE(activation.pids); i++) {
+		if (pid > 0 && activation.pids[i] == pid) {
+			activation.pids[i] = 0;
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+	if (exit_code) {
+		/* Each may fail gracefully */
+		wlr_log(WLR_INFO, "activation environment update %ld exited with %d",
+			(long)pid, exit_code);
+	}
+	if (!activation_pending()) {
+		run_pending_autostart();
+	}
+	return true;
+}
+
 static void
 backend_check_drm(struct wlr_backend *backend, void *is_drm)
 {
@@ -210,43 +299,74 @@ should_update_activation(struct server *server)
 	return have_drm;
 }
 
-static void
+/*
+ * Returns true if the update has been started and is tracked in
+ * activation.pids, which is only done when initializing. Clearing the
+ * environment on shutdown isn't waited for.
+ */
+static bool
 update_activation_env(struct server *server, bool initialize)
 {
 	if (!should_update_activation(server)) {
-		return;
+		return false;
 	}
 
 	if (!getenv("DBUS_SESSION_BUS_ADDRESS")) {
 		/* Prevent accidentally auto-launching a dbus session */
 		wlr_log(WLR_INFO, "Not updating dbus execution environment: "
 			"DBUS_SESSION_BUS_ADDRESS not set");
-		return;
+		return false;
+	}
+
+	uint64_t hash = env_vars_hash();
+	if (initialize && hash == activation.exported_hash) {
+		wlr_log(WLR_DEBUG, "dbus execution environment is up to date");
+		return false;
 	}
+	activation.exported_hash = initialize ? hash : 0;
 
 	wlr_log(WLR_INFO, "Updating dbus execution environment");
 
 	char *env_keys = str_join(env_vars, "%s", " ");
 	char *env_unset_keys = initialize ? NULL : str_join(env_vars, "%s=", " ");
 
-	char *cmd =
+	char *cmds[] = {
 		strdup_printf("dbus-update-activation-environment %s",
-			initialize ? env_keys : env_unset_keys);
-	spawn_async_no_shell(cmd);
-	free(cmd);
-
-	cmd = strdup_printf("systemctl --user %s %s",
-		initialize ? "import-environment" : "unset-environment", env_keys);
-	spawn_async_no_shell(cmd);
-	free(cmd);
+			initialize ? env_keys : env_unset_keys),
+		strdup_printf("systemctl --user %s %s",
+			initialize ? "import-environment" : "unset-environment",
+			env_keys),
+	};
+	static_assert(ARRAY_SIZE(cmds) == ARRAY_SIZE(activation.pids),
+		"one pid per command");
+	for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if (initialize) {
+			activation.pids[i] = spawn_async_no_shell_tracked(cmds[i]);
+		} else {
+			spawn_async_no_shell(cmds[i]);
+		}
+		free(cmds[i]);
+	}
 
 	free(env_keys);
 	free(env_unset_keys);
+	return initialize && activation_pending();
+}
+
+/* Never 0, which struct action uses for "independent of the environment" */
+static uint64_t environment_serial = 1;
+
+uint64_t
+session_environment_serial(void)
+{
+	return environment_serial;
 }
 
 void
 session_environment_init(void)
 {
+	environment_serial++;
+
 	/*
 	 * Set default for XDG_CURRENT_DESKTOP so xdg-desktop-portal-wlr is happy.
 	 * May be overridden either by already having a value set or by the user
@@ -286,11 +406,145 @@ session_environment_init(void)
 	paths_destroy(&paths);
 }
 
+/*
+ * Session scripts are tracked until they exit, through a pidfd where the
+ * kernel supports it. The compositor never waits for them, except for the
+ * shutdown scripts when they have a timeout. Scripts from the *.d
+ * directory run in parallel.
+ */
+struct session_script {
+	char *path;
+	pid_t pid;
+	/* Terminated after <core><sessionScriptTimeout>, or NULL */
+	struct lab_timer *timeout;
+	bool timed_out;
+	struct wl_list link;
+};
+
+static struct wl_list scripts = { &scripts, &scripts };
+
+static void
+script_destroy(struct session_script *script)
+{
+	if (script->timeout) {
+		lab_timer_destroy(script->timeout);
+	}
+	wl_list_remove(&script->link);
+	free(script->path);
+	free(script);
+}
+
+static int
+handle_script_timeout(void *data)
+{
+	struct session_script *script = data;
+	wlr_log(WLR_ERROR, "session script %s takes more than %u ms, terminating",
+		script->path, rc.session_script_timeout);
+	script->timed_out = true;
+	/* Only the shell, commands it started in the background keep running */
+	kill(script->pid, SIGTERM);
+	return 0;
+}
+
+bool
+session_check_script_result(pid_t pid, int exit_code)
+{
+	struct session_script *script;
+	wl_list_for_each(script, &scripts, link) {
+		if (script->pid != pid) {
+			continue;
+		}
+		if (exit_code && !script->timed_out) {
+			wlr_log(WLR_ERROR, "session script %s exited with %d",
+				script->path, exit_code);
+		} else {
+			wlr_log(WLR_DEBUG, "session script %s exited",
+				script->path);
+		}
+		script_destroy(script);
+		return true;
+	}
+	return false;
+}
+
+static void
+start_script(const char *path, bool with_timeout)
+{
+	/* Running a script again, for example on reconfigure, replaces it */
+	struct session_script *script, *tmp;
+	wl_list_for_each_safe(script, tmp, &scripts, link) {
+		if (!strcmp(script->path, path)) {
+			wlr_log(WLR_INFO, "session script %s still running, "
+				"terminating it", path);
+			kill(script->pid, SIGTERM);
+			script_destroy(script);
+		}
+	}
+
+	wlr_log(WLR_INFO, "run session script %s", path);
+	char *const argv[] = { "sh", (char *)path, NULL };
+	pid_t pid = spawn_argv_async_no_shell_tracked(argv);
+	if (pid < 0) {
+		return;
+	}
+
+	script = znew(*script);
+	script->path = xstrdup(path);
+	script->pid = pid;
+	if (with_timeout && rc.session_script_timeout) {
+		script->timeout = lab_timer_create(handle_script_timeout,
+			script, /*slack_ms*/ 100);
+		lab_timer_update(script->timeout, rc.session_script_timeout);
+	}
+	wl_list_insert(scripts.prev, &script->link);
+}
+
+static int
+script_file_filter(const struct dirent *dirent)
+{
+	/* Skip hidden files and editor backups */
+	return dirent->d_name[0] != '.' && !str_endswith(dirent->d_name, "~");
+}
+
+/* Returns true if any script was started from the directory */
+static bool
+start_script_dir(const char *path_prefix, bool with_timeout)
+{
+	bool success = false;
+	char *path = strdup_printf("%s.d", path_prefix);
+
+	struct dirent **dirlist = NULL;
+	int num_entries = scandir(path, &dirlist, script_file_filter, alphasort);
+	for (int i = 0; i < num_entries; i++) {
+		char *script_path = strdup_env_path_validate(path, dirlist[i]);
+		free(dirlist[i]);
+		if (script_path) {
+			start_script(script_path, with_timeout);
+			free(script_path);
+			success = true;
+		}
+	}
+	free(dirlist);
+	free(path);
+	return success;
+}
+
+static bool
+script_has_timeout(const char *script)
+{
+	/*
+	 * autostart and xinitrc often keep long-running commands in the
+	 * foreground, so only reconfigure and shutdown are limited.
+	 */
+	return !strcmp(script, "reconfigure") || !strcmp(script, "shutdown");
+}
+
 void
 session_run_script(const char *script)
 {
 	struct wl_list paths;
 	paths_config_create(&paths, script);
+	bool with_timeout = script_has_timeout(script);
 
 	bool should_merge_config = rc.merge_config;
 	struct wl_list *(*iter)(struct wl_list *list);
@@ -298,15 +552,14 @@ session_run_script(const char *script)
 
 	for (struct wl_list *elm = iter(&paths); elm != &paths; elm = iter(elm)) {
 		struct path *path = wl_container_of(elm, path, link);
-		if (!file_exists(path->string)) {
-			continue;
+		bool success = false;
+		if (file_exists(path->string)) {
+			start_script(path->string, with_timeout);
+			success = true;
 		}
-		wlr_log(WLR_INFO, "run session script %s", path->string);
-		char *cmd = strdup_printf("sh %s", path->string);
-		spawn_async_no_shell(cmd);
-		free(cmd);
+		success |= start_script_dir(path->string, with_timeout);
 
-		if (!should_merge_config) {
+		if (success && !should_merge_config) {
 			break;
 		}
 	}
@@ -317,8 +570,36 @@ void
 session_autostart_init(struct server *server)
 {
 	/* Update dbus and systemd user environment, each may fail gracefully */
-	update_activation_env(server, /* initialize */ true);
-	session_run_script("autostart");
+	if (!update_activation_env(server, /* initialize */ true)) {
+		session_run_script("autostart");
+		return;
+	}
+	activation.autostart_pending = true;
+	activation.timeout = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_activation_timeout, NULL);
+	wl_event_source_timer_update(activation.timeout, ACTIVATION_TIMEOUT_MS);
+}
+
+void
+session_update_activation_env(struct server *server)
+{
+	/* Only after the initial export, and only if something changed */
+	if (activation.exported_hash) {
+		update_activation_env(server, /* initialize */ true);
+	}
+}
+
+/* Scripts that the compositor still waits for */
+static bool
+scripts_waiting(void)
+{
+	struct session_script *script;
+	wl_list_for_each(script, &scripts, link) {
+		if (script->timeout && !script->timed_out) {
+			return true;
+		}
+	}
+	return false;
 }
 
 void
@@ -326,6 +607,26 @@ session_shutdown(struct server *server)
 {
 	session_run_script("shutdown");
 
+	/*
+	 * With a timeout, keep the event loop running until the shutdown
+	 * scripts have exited, so that they can still use the display
+	 */
+	while (scripts_waiting()) {
+		wl_display_flush_clients(server->wl_display);
+		if (wl_event_loop_dispatch(server->wl_event_loop, -1) < 0) {
+			break;
+		}
+	}
+	struct session_script *script, *tmp;
+	wl_list_for_each_safe(script, tmp, &scripts, link) {
+		script_destroy(script);
+	}
+
+	if (activation.timeout) {
+		wl_event_source_remove(activation.timeout);
+		activation.timeout = NULL;
+	}
+
 	/* Clear the dbus and systemd user environment, each may fail gracefully */
 	update_activation_env(server, /* initialize */ false);
 }
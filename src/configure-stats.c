@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "configure-stats.h"
+#include <glib.h>
+#include "common/time-helpers.h"
+#include "view.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+
+struct app_stats {
+	uint64_t samples;
+	uint64_t timeouts;
+	uint64_t acks;
+	uint64_t ack_ns_total;
+	uint64_t done_ns_total;
+	uint64_t done_ns_max;
+
+	/* Most recent catch-up times, for the rolling average */
+	uint64_t recent_ns[CONFIGURE_STATS_WINDOW];
+	uint32_t nr_recent;
+	uint32_t next_recent;
+};
+
+/* app_id -> struct app_stats */
+static GHashTable *stats_by_app_id;
+
+static const char *
+get_app_id(struct view *view)
+{
+	return view->app_id ? view->app_id : "";
+}
+
+static struct app_stats *
+get_stats(struct view *view, bool create)
+{
+	if (!stats_by_app_id) {
+		if (!create) {
+			return NULL;
+		}
+		stats_by_app_id = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+	}
+	const char *app_id = get_app_id(view);
+	struct app_stats *stats = g_hash_table_lookup(stats_by_app_id, app_id);
+	if (!stats && create) {
+		stats = g_new0(struct app_stats, 1);
+		g_hash_table_insert(stats_by_app_id, g_strdup(app_id), stats);
+	}
+	return stats;
+}
+
+void
+configure_stats_sent(struct view *view)
+{
+	/* Later requests extend the measurement until the client catches up */
+	if (!view->configure_sent_ns) {
+		view->configure_sent_ns = time_now_nsec();
+		view->configure_acked_ns = 0;
+	}
+}
+
+void
+configure_stats_acked(struct view *view)
+{
+	if (view->configure_sent_ns) {
+		view->configure_acked_ns = time_now_nsec();
+	}
+}
+
+void
+configure_stats_done(struct view *view, bool timed_out)
+{
+	if (!view->configure_sent_ns) {
+		return;
+	}
+	uint64_t now = time_now_nsec();
+	uint64_t done_ns = timed_out ? CONFIGURE_TIMEOUT_MS * NSEC_PER_MSEC
+		: now - view->configure_sent_ns;
+
+	struct app_stats *stats = get_stats(view, /*create*/ true);
+	stats->samples++;
+	if (timed_out) {
+		stats->timeouts++;
+	}
+	if (view->configure_acked_ns) {
+		stats->acks++;
+		stats->ack_ns_total +=
+			view->configure_acked_ns - view->configure_sent_ns;
+	}
+	stats->done_ns_total += done_ns;
+	if (done_ns > stats->done_ns_max) {
+		stats->done_ns_max = done_ns;
+	}
+
+	stats->recent_ns[stats->next_recent] = done_ns;
+	stats->next_recent = (stats->next_recent + 1) % CONFIGURE_STATS_WINDOW;
+	if (stats->nr_recent < CONFIGURE_STATS_WINDOW) {
+		stats->nr_recent++;
+	}
+
+	view->configure_sent_ns = 0;
+	view->configure_acked_ns = 0;
+}
+
+static uint64_t
+get_recent_avg_ns(const struct app_stats *stats)
+{
+	if (!stats->nr_recent) {
+		return 0;
+	}
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < stats->nr_recent; i++) {
+		total += stats->recent_ns[i];
+	}
+	return total / stats->nr_recent;
+}
+
+static bool
+stats_are_slow(const struct app_stats *stats)
+{
+	return stats->nr_recent >= CONFIGURE_STATS_MIN_SAMPLES
+		&& get_recent_avg_ns(stats)
+			> CONFIGURE_STATS_SLOW_MS * NSEC_PER_MSEC;
+}
+
+bool
+configure_stats_view_is_slow(struct view *view)
+{
+	struct app_stats *stats = get_stats(view, /*create*/ false);
+	return stats && stats_are_slow(stats);
+}
+
+static void
+print_app_stats(gpointer key, gpointer value, gpointer data)
+{
+	const char *app_id = key;
+	const struct app_stats *stats = value;
+	FILE *stream = data;
+
+	fprintf(stream, "app_id %s%s\n", *app_id ? app_id : "(none)",
+		stats_are_slow(stats) ? " (slow)" : "");
+	fprintf(stream, "  samples: %lu\n", (unsigned long)stats->samples);
+	fprintf(stream, "  timeouts: %lu\n", (unsigned long)stats->timeouts);
+	fprintf(stream, "  ack_avg_us: %lu\n", stats->acks
+		? (unsigned long)(stats->ack_ns_total / stats->acks / 1000)
+		: 0UL);
+	fprintf(stream, "  done_avg_us: %lu\n",
+		(unsigned long)(stats->done_ns_total / stats->samples / 1000));
+	fprintf(stream, "  done_max_us: %lu\n",
+		(unsigned long)(stats->done_ns_max / 1000));
+	fprintf(stream, "  done_recent_avg_us: %lu\n",
+		(unsigned long)(get_recent_avg_ns(stats) / 1000));
+}
+
+void
+configure_stats_print(FILE *stream)
+{
+	if (stats_by_app_id) {
+		g_hash_table_foreach(stats_by_app_id, print_app_stats, stream);
+	}
+}
+
+void
+configure_stats_reset(void)
+{
+	if (stats_by_app_id) {
+		g_hash_table_remove_all(stats_by_app_id);
+	}
+}
+
+void
+configure_stats_finish(void)
+{
+	if (stats_by_app_id) {
+		g_hash_table_destroy(stats_by_app_id);
+		stats_by_app_id = NULL;
+	}
+}
@@ -6,6 +6,7 @@
 #include <wlr/util/log.h>
 #include "common/lab-scene-rect.h"
 #include "common/list.h"
+#include "common/macros.h"
 #include "common/scene-helpers.h"
 #include "config/rcxml.h"
 #include "labwc.h"
@@ -267,38 +268,171 @@ get_osd_impl(void)
 }
 
 static void
-create_osd_on_output(struct output *output)
+destroy_cached_item(struct cycle_osd_item *item)
 {
-	if (!output_is_usable(output)) {
-		return;
+	wlr_scene_node_destroy(&item->tree->node);
+	wl_list_remove(&item->link);
+	free(item);
+}
+
+void
+cycle_osd_drop_cached_items(struct output *output)
+{
+	struct cycle_osd_item *item, *tmp;
+	wl_list_for_each_safe(item, tmp, &output->cycle_osd.cached_items, link) {
+		destroy_cached_item(item);
 	}
-	get_osd_impl()->create(output);
-	assert(output->cycle_osd.tree);
 }
 
-static void
-insert_view_ordered_by_age(struct wl_list *views, struct view *new_view)
+void
+cycle_osd_reset_cache(struct server *server)
 {
-	struct wl_list *link = views;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		cycle_osd_drop_cached_items(output);
+	}
+}
+
+void
+cycle_osd_forget_view(struct view *view)
+{
+	struct output *output;
+	wl_list_for_each(output, &view->server->outputs, link) {
+		struct cycle_osd_item *item, *tmp;
+		wl_list_for_each_safe(item, tmp,
+				&output->cycle_osd.cached_items, link) {
+			if (item->view == view) {
+				destroy_cached_item(item);
+			}
+		}
+	}
+}
+
+void
+cycle_osd_cache_items(struct output *output)
+{
+	if (!wl_list_empty(&output->cycle_osd.items)
+			&& !output->cycle_osd.cache_tree) {
+		output->cycle_osd.cache_tree =
+			wlr_scene_tree_create(output->cycle_osd_tree);
+		wlr_scene_node_set_enabled(
+			&output->cycle_osd.cache_tree->node, false);
+	}
+	struct cycle_osd_item *item, *tmp;
+	wl_list_for_each_safe(item, tmp, &output->cycle_osd.items, link) {
+		wlr_scene_node_reparent(&item->tree->node,
+			output->cycle_osd.cache_tree);
+		wl_list_remove(&item->link);
+		wl_list_append(&output->cycle_osd.cached_items, &item->link);
+	}
+}
+
+bool
+cycle_osd_scroll_to_selection(struct output *output)
+{
+	struct cycle_osd_scene *osd = &output->cycle_osd;
+	struct cycle_state *cycle = &output->server->cycle;
+	int nr_views = wl_list_length(&cycle->views);
+	if (!cycle->selected_view || osd->nr_shown >= nr_views) {
+		return false;
+	}
+
+	int index = 0;
 	struct view *view;
-	wl_list_for_each(view, views, cycle_link) {
-		if (view->creation_id >= new_view->creation_id) {
+	wl_list_for_each(view, &cycle->views, cycle_link) {
+		if (view == cycle->selected_view) {
 			break;
 		}
-		link = &view->cycle_link;
+		index++;
+	}
+
+	/* Scroll by whole rows, just far enough to show the selection */
+	int row_length = MAX(osd->row_length, 1);
+	int first = osd->first_item;
+	if (index < first) {
+		first = index - index % row_length;
+	} else if (index >= first + osd->nr_shown) {
+		int row = index - index % row_length;
+		first = row + row_length - osd->nr_shown;
 	}
-	wl_list_insert(link, &new_view->cycle_link);
+	int last_row = (nr_views - 1) - (nr_views - 1) % row_length;
+	first = MAX(0, MIN(first, last_row + row_length - osd->nr_shown));
+	if (first == osd->first_item) {
+		return false;
+	}
+	osd->first_item = first;
+	return true;
+}
+
+void
+cycle_osd_update_scrollbar(struct output *output, int x, int y, int width,
+		int height)
+{
+	struct cycle_osd_scene *osd = &output->cycle_osd;
+	int nr_views = wl_list_length(&output->server->cycle.views);
+	if (osd->nr_shown >= nr_views) {
+		if (osd->scrollbar) {
+			wlr_scene_node_destroy(&osd->scrollbar->node);
+			osd->scrollbar = NULL;
+		}
+		return;
+	}
+
+	int bar_height = MAX(height * osd->nr_shown / nr_views, 1);
+	int bar_y = y + height * osd->first_item / nr_views;
+	if (!osd->scrollbar) {
+		osd->scrollbar = wlr_scene_rect_create(osd->tree, width,
+			bar_height, output->server->theme->osd_border_color);
+	}
+	wlr_scene_rect_set_size(osd->scrollbar, width, bar_height);
+	wlr_scene_node_set_position(&osd->scrollbar->node, x, bar_y);
+	wlr_scene_node_raise_to_top(&osd->scrollbar->node);
+}
+
+struct cycle_osd_item *
+cycle_osd_reuse_item(struct output *output, struct view *view, uint64_t hash,
+		struct wlr_scene_tree *parent)
+{
+	struct cycle_osd_item *item;
+	wl_list_for_each(item, &output->cycle_osd.cached_items, link) {
+		if (item->view == view && item->hash == hash) {
+			wlr_scene_node_reparent(&item->tree->node, parent);
+			wl_list_remove(&item->link);
+			wl_list_append(&output->cycle_osd.items, &item->link);
+			return item;
+		}
+	}
+	return NULL;
+}
+
+static void
+create_osd_on_output(struct output *output)
+{
+	if (!output_is_usable(output)) {
+		return;
+	}
+	get_osd_impl()->create(output);
+	assert(output->cycle_osd.tree);
+	/* Items of views which left the list or changed */
+	cycle_osd_drop_cached_items(output);
 }
 
 /* Return false on failure */
 static bool
 init_cycle(struct server *server)
 {
+	/* Both orders are kept up to date, so this only filters the views */
 	struct view *view;
-	for_each_view(view, &server->views, rc.window_switcher.criteria) {
-		if (rc.window_switcher.order == WINDOW_SWITCHER_ORDER_AGE) {
-			insert_view_ordered_by_age(&server->cycle.views, view);
-		} else {
+	enum lab_view_criteria criteria = rc.window_switcher.criteria;
+	if (rc.window_switcher.order == WINDOW_SWITCHER_ORDER_AGE) {
+		wl_list_for_each(view, &server->views_by_age, age_link) {
+			if (view_matches_view_criteria(view, criteria)) {
+				wl_list_append(&server->cycle.views,
+					&view->cycle_link);
+			}
+		}
+	} else {
+		for_each_view(view, &server->views, criteria) {
 			wl_list_append(&server->cycle.views, &view->cycle_link);
 		}
 	}
@@ -369,15 +503,14 @@ destroy_cycle(struct server *server)
 {
 	struct output *output;
 	wl_list_for_each(output, &server->outputs, link) {
-		struct cycle_osd_item *item, *tmp;
-		wl_list_for_each_safe(item, tmp, &output->cycle_osd.items, link) {
-			wl_list_remove(&item->link);
-			free(item);
-		}
+		/* Keep the items hidden for the next session */
+		cycle_osd_cache_items(output);
 		if (output->cycle_osd.tree) {
 			wlr_scene_node_destroy(&output->cycle_osd.tree->node);
 			output->cycle_osd.tree = NULL;
 		}
+		output->cycle_osd.scrollbar = NULL;
+		output->cycle_osd.first_item = 0;
 	}
 
 	restore_preview_node(server);
@@ -6,8 +6,10 @@
 #include <wlr/util/log.h>
 #include "common/buf.h"
 #include "common/font.h"
+#include "common/hash.h"
 #include "common/lab-scene-rect.h"
 #include "common/list.h"
+#include "common/macros.h"
 #include "common/mem.h"
 #include "common/string-helpers.h"
 #include "config/rcxml.h"
@@ -15,6 +17,7 @@
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "scaled-buffer/scaled-font-buffer.h"
 #include "scaled-buffer/scaled-icon-buffer.h"
 #include "theme.h"
@@ -57,6 +60,7 @@ create_fields_scene(struct server *server, struct view *view,
 			if (!string_null_or_empty(buf.data)) {
 				struct scaled_font_buffer *font_buffer =
 					scaled_font_buffer_create(parent);
+				font_buffer->scaled_buffer->category = BUFFER_OSD;
 				scaled_font_buffer_update(font_buffer,
 					buf.data, field_width,
 					&rc.font_osd, text_color, bg_color);
@@ -76,34 +80,211 @@ create_fields_scene(struct server *server, struct view *view,
 	}
 }
 
-static void
-cycle_osd_classic_create(struct output *output)
+/* Everything an item shows apart from the icon, which updates itself */
+static uint64_t
+get_item_hash(struct view *view, int w, int field_widths_sum)
 {
-	assert(!output->cycle_osd.tree && wl_list_empty(&output->cycle_osd.items));
+	uint64_t hash = hash_add(HASH_INIT, &w, sizeof(w));
+	hash = hash_add(hash, &field_widths_sum, sizeof(field_widths_sum));
 
+	struct buf buf = BUF_INIT;
+	struct cycle_osd_field *field;
+	wl_list_for_each(field, &rc.window_switcher.fields, link) {
+		if (field->content != LAB_FIELD_ICON) {
+			cycle_osd_field_get_content(field, &buf, view);
+			hash = hash_add_str(hash, buf.data);
+			buf_clear(&buf);
+		}
+	}
+	buf_reset(&buf);
+	return hash;
+}
+
+static struct cycle_osd_item *
+create_item_scene(struct output *output, struct view *view, int w,
+		int field_widths_sum)
+{
 	struct server *server = output->server;
 	struct theme *theme = server->theme;
 	struct window_switcher_classic_theme *switcher_theme =
 		&theme->osd_window_switcher_classic;
 	int padding = theme->osd_border_width + switcher_theme->padding;
-	bool show_workspace = wl_list_length(&rc.workspace_config.workspaces) > 1;
-	const char *workspace_name = server->workspaces.current->name;
-	int nr_views = wl_list_length(&server->cycle.views);
+	float *text_color = theme->osd_label_text_color;
+	float *bg_color = theme->osd_bg_color;
+
+	struct cycle_osd_classic_item *item = znew(*item);
+	wl_list_append(&output->cycle_osd.items, &item->base.link);
+	item->base.view = view;
+	item->base.tree = wlr_scene_tree_create(output->cycle_osd.tree);
+	node_descriptor_create(&item->base.tree->node,
+		LAB_NODE_CYCLE_OSD_ITEM, NULL, item);
+	/*
+	 *    OSD border
+	 * +---------------------------------+
+	 * |                                 |
+	 * |  item border                    |
+	 * |+-------------------------------+|
+	 * ||                               ||
+	 * ||padding between each field     ||
+	 * ||| field-1 | field-2 | field-n |||
+	 * ||                               ||
+	 * ||                               ||
+	 * |+-------------------------------+|
+	 * |                                 |
+	 * |                                 |
+	 * +---------------------------------+
+	 */
+	int x = padding
+		+ switcher_theme->item_active_border_width
+		+ switcher_theme->item_padding_x;
+	item->normal_tree = wlr_scene_tree_create(item->base.tree);
+	item->active_tree = wlr_scene_tree_create(item->base.tree);
+	wlr_scene_node_set_enabled(&item->active_tree->node, false);
+
+	float *active_bg_color = switcher_theme->item_active_bg_color;
+	float *active_border_color = switcher_theme->item_active_border_color;
+
+	/* Highlight around selected window's item */
+	struct lab_scene_rect_options highlight_opts = {
+		.border_colors = (float *[1]) {active_border_color},
+		.nr_borders = 1,
+		.border_width = switcher_theme->item_active_border_width,
+		.bg_color = active_bg_color,
+		.width = w - 2 * padding,
+		.height = switcher_theme->item_height,
+	};
+	struct lab_scene_rect *highlight_rect = lab_scene_rect_create(
+		item->active_tree, &highlight_opts);
+	wlr_scene_node_set_position(&highlight_rect->tree->node, padding, 0);
+
+	/* hitbox for mouse clicks */
+	struct wlr_scene_rect *hitbox = wlr_scene_rect_create(item->base.tree,
+		w - 2 * padding, switcher_theme->item_height, (float[4]) {0});
+	wlr_scene_node_set_position(&hitbox->node, padding, 0);
 
+	create_fields_scene(server, view, item->normal_tree,
+		text_color, bg_color, field_widths_sum, x, 0);
+	create_fields_scene(server, view, item->active_tree,
+		text_color, active_bg_color, field_widths_sum, x, 0);
+
+	return &item->base;
+}
+
+struct classic_layout {
 	struct wlr_box output_box;
+	int padding;
+	bool show_workspace;
+	/* Width of the OSD */
+	int w;
+	/* Width of the area available for text fields */
+	int field_widths_sum;
+	/* Of the first item */
+	int y;
+};
+
+static void
+get_layout(struct output *output, struct classic_layout *layout)
+{
+	struct server *server = output->server;
+	struct theme *theme = server->theme;
+	struct window_switcher_classic_theme *switcher_theme =
+		&theme->osd_window_switcher_classic;
+
 	wlr_output_layout_get_box(server->output_layout, output->wlr_output,
-		&output_box);
+		&layout->output_box);
+	layout->padding = theme->osd_border_width + switcher_theme->padding;
+	layout->show_workspace =
+		wl_list_length(&rc.workspace_config.workspaces) > 1;
 
-	int w = switcher_theme->width;
+	layout->w = switcher_theme->width;
 	if (switcher_theme->width_is_percent) {
-		w = output_box.width * switcher_theme->width / 100;
+		layout->w = layout->output_box.width * switcher_theme->width / 100;
+	}
+
+	int nr_fields = wl_list_length(&rc.window_switcher.fields);
+	layout->field_widths_sum = layout->w - 2 * layout->padding
+		- 2 * switcher_theme->item_active_border_width
+		- (nr_fields + 1) * switcher_theme->item_padding_x;
+
+	layout->y = layout->padding;
+	if (layout->show_workspace) {
+		layout->y += switcher_theme->item_height;
 	}
-	int h = nr_views * switcher_theme->item_height + 2 * padding;
-	if (show_workspace) {
-		/* workspace indicator */
-		h += switcher_theme->item_height;
+}
+
+/* Create or reuse the items for the views shown, see first_item */
+static void
+place_items(struct output *output, struct classic_layout *layout)
+{
+	struct server *server = output->server;
+	struct window_switcher_classic_theme *switcher_theme =
+		&server->theme->osd_window_switcher_classic;
+	struct cycle_osd_scene *osd = &output->cycle_osd;
+
+	cycle_osd_cache_items(output);
+
+	int index = 0;
+	int y = layout->y;
+	struct view *view;
+	wl_list_for_each(view, &server->cycle.views, cycle_link) {
+		if (index < osd->first_item) {
+			index++;
+			continue;
+		}
+		if (index >= osd->first_item + osd->nr_shown) {
+			break;
+		}
+		uint64_t hash = get_item_hash(view, layout->w,
+			layout->field_widths_sum);
+		struct cycle_osd_item *item = cycle_osd_reuse_item(output,
+			view, hash, osd->tree);
+		if (!item) {
+			item = create_item_scene(output, view, layout->w,
+				layout->field_widths_sum);
+			item->hash = hash;
+		}
+		wlr_scene_node_set_position(&item->tree->node, 0, y);
+		y += switcher_theme->item_height;
+		index++;
 	}
 
+	/* In the right padding, along the items */
+	int bar_width = MAX(switcher_theme->padding, 2);
+	cycle_osd_update_scrollbar(output,
+		layout->w - server->theme->osd_border_width - bar_width,
+		layout->y, bar_width, osd->nr_shown * switcher_theme->item_height);
+}
+
+static void
+cycle_osd_classic_create(struct output *output)
+{
+	assert(!output->cycle_osd.tree && wl_list_empty(&output->cycle_osd.items));
+
+	struct server *server = output->server;
+	struct theme *theme = server->theme;
+	struct window_switcher_classic_theme *switcher_theme =
+		&theme->osd_window_switcher_classic;
+	const char *workspace_name = server->workspaces.current->name;
+	int nr_views = wl_list_length(&server->cycle.views);
+
+	struct classic_layout layout;
+	get_layout(output, &layout);
+	int w = layout.w;
+	int padding = layout.padding;
+
+	/*
+	 * Only create items for as many views as fit on the output,
+	 * scrolling along with the selection
+	 */
+	int rows_fit = (layout.output_box.height - layout.y - padding)
+		/ switcher_theme->item_height;
+	output->cycle_osd.first_item = 0;
+	output->cycle_osd.nr_shown = MIN(nr_views, MAX(rows_fit, 1));
+	output->cycle_osd.row_length = 1;
+
+	int h = layout.y + output->cycle_osd.nr_shown
+		* switcher_theme->item_height + padding;
+
 	output->cycle_osd.tree = wlr_scene_tree_create(output->cycle_osd_tree);
 
 	float *text_color = theme->osd_label_text_color;
@@ -120,10 +301,8 @@ cycle_osd_classic_create(struct output *output)
 	};
 	lab_scene_rect_create(output->cycle_osd.tree, &bg_opts);
 
-	int y = padding;
-
 	/* Draw workspace indicator */
-	if (show_workspace) {
+	if (layout.show_workspace) {
 		struct font font = rc.font_osd;
 		font.weight = PANGO_WEIGHT_BOLD;
 
@@ -137,95 +316,40 @@ cycle_osd_classic_create(struct output *output)
 
 		struct scaled_font_buffer *font_buffer =
 			scaled_font_buffer_create(output->cycle_osd.tree);
+		font_buffer->scaled_buffer->category = BUFFER_OSD;
 		wlr_scene_node_set_position(&font_buffer->scene_buffer->node,
-			x, y + (switcher_theme->item_height - font_height(&font)) / 2);
+			x, padding + (switcher_theme->item_height
+				- font_height(&font)) / 2);
 		scaled_font_buffer_update(font_buffer, workspace_name, 0,
 			&font, text_color, bg_color);
-		y += switcher_theme->item_height;
 	}
 
-	int nr_fields = wl_list_length(&rc.window_switcher.fields);
-
-	/* This is the width of the area available for text fields */
-	int field_widths_sum = w - 2 * padding
-		- 2 * switcher_theme->item_active_border_width
-		- (nr_fields + 1) * switcher_theme->item_padding_x;
-	if (field_widths_sum <= 0) {
+	if (layout.field_widths_sum <= 0) {
 		wlr_log(WLR_ERROR, "Not enough spaces for osd contents");
 		goto error;
 	}
 
-	/* Draw text for each node */
-	struct view *view;
-	wl_list_for_each(view, &server->cycle.views, cycle_link) {
-		struct cycle_osd_classic_item *item = znew(*item);
-		wl_list_append(&output->cycle_osd.items, &item->base.link);
-		item->base.view = view;
-		item->base.tree = wlr_scene_tree_create(output->cycle_osd.tree);
-		node_descriptor_create(&item->base.tree->node,
-			LAB_NODE_CYCLE_OSD_ITEM, NULL, item);
-		/*
-		 *    OSD border
-		 * +---------------------------------+
-		 * |                                 |
-		 * |  item border                    |
-		 * |+-------------------------------+|
-		 * ||                               ||
-		 * ||padding between each field     ||
-		 * ||| field-1 | field-2 | field-n |||
-		 * ||                               ||
-		 * ||                               ||
-		 * |+-------------------------------+|
-		 * |                                 |
-		 * |                                 |
-		 * +---------------------------------+
-		 */
-		int x = padding
-			+ switcher_theme->item_active_border_width
-			+ switcher_theme->item_padding_x;
-		item->normal_tree = wlr_scene_tree_create(item->base.tree);
-		item->active_tree = wlr_scene_tree_create(item->base.tree);
-		wlr_scene_node_set_enabled(&item->active_tree->node, false);
-
-		float *active_bg_color = switcher_theme->item_active_bg_color;
-		float *active_border_color = switcher_theme->item_active_border_color;
-
-		/* Highlight around selected window's item */
-		struct lab_scene_rect_options highlight_opts = {
-			.border_colors = (float *[1]) {active_border_color},
-			.nr_borders = 1,
-			.border_width = switcher_theme->item_active_border_width,
-			.bg_color = active_bg_color,
-			.width = w - 2 * padding,
-			.height = switcher_theme->item_height,
-		};
-		struct lab_scene_rect *highlight_rect = lab_scene_rect_create(
-			item->active_tree, &highlight_opts);
-		wlr_scene_node_set_position(&highlight_rect->tree->node, padding, y);
-
-		/* hitbox for mouse clicks */
-		struct wlr_scene_rect *hitbox = wlr_scene_rect_create(item->base.tree,
-			w - 2 * padding, switcher_theme->item_height, (float[4]) {0});
-		wlr_scene_node_set_position(&hitbox->node, padding, y);
-
-		create_fields_scene(server, view, item->normal_tree,
-			text_color, bg_color, field_widths_sum, x, y);
-		create_fields_scene(server, view, item->active_tree,
-			text_color, active_bg_color, field_widths_sum, x, y);
-
-		y += switcher_theme->item_height;
-	}
+	/* Draw text for each node, reusing the items of the last session */
+	place_items(output, &layout);
 
 error:;
 	/* Center OSD */
 	wlr_scene_node_set_position(&output->cycle_osd.tree->node,
-		output_box.x + (output_box.width - w) / 2,
-		output_box.y + (output_box.height - h) / 2);
+		layout.output_box.x + (layout.output_box.width - w) / 2,
+		layout.output_box.y + (layout.output_box.height - h) / 2);
 }
 
 static void
 cycle_osd_classic_update(struct output *output)
 {
+	if (cycle_osd_scroll_to_selection(output)) {
+		struct classic_layout layout;
+		get_layout(output, &layout);
+		if (layout.field_widths_sum > 0) {
+			place_items(output, &layout);
+		}
+	}
+
 	struct cycle_osd_classic_item *item;
 	wl_list_for_each(item, &output->cycle_osd.items, base.link) {
 		bool active = item->base.view == output->server->cycle.selected_view;
@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <assert.h>
 #include <ctype.h>
+#include <string.h>
 #include <wlr/util/log.h>
+#include "common/array.h"
 #include "common/buf.h"
 #include "common/mem.h"
 #include "config/rcxml.h"
@@ -14,7 +16,6 @@
 
 /* includes '%', terminating 's' and NULL byte, 8 is enough for %-9999s */
 #define LAB_FIELD_SINGLE_FMT_MAX_LEN 8
-static_assert(LAB_FIELD_SINGLE_FMT_MAX_LEN <= 255, "fmt_position is a unsigned char");
 
 /* forward declares */
 typedef void field_conversion_type(struct buf *buf, struct view *view, const char *format);
@@ -207,82 +208,162 @@ static const struct field_converter field_converter[LAB_FIELD_COUNT] = {
 	[LAB_FIELD_CUSTOM]             = { '\0', cycle_osd_field_set_custom },
 };
 
-void
-cycle_osd_field_set_custom(struct buf *buf, struct view *view, const char *format)
+/*
+ * One piece of a compiled custom format: literal text or a conversion
+ * with an optional minimum width like printf's %-10s
+ */
+struct format_token {
+	/* LAB_FIELD_NONE for literal text */
+	enum cycle_osd_field_content content;
+	int width;
+	bool left_justify;
+	/* Offset of the NUL-terminated literal in cycle_osd_format.text */
+	int literal;
+};
+
+struct cycle_osd_format {
+	struct buf text;
+	struct wl_array tokens; /* struct format_token */
+};
+
+static void
+add_literal_char(struct cycle_osd_format *compiled, char ch)
+{
+	struct format_token *last = NULL;
+	if (compiled->tokens.size) {
+		last = (struct format_token *)((char *)compiled->tokens.data
+			+ compiled->tokens.size) - 1;
+	}
+	if (last && last->content == LAB_FIELD_NONE) {
+		/* Extend the literal at the end of text */
+		compiled->text.data[compiled->text.len - 1] = ch;
+	} else {
+		struct format_token token = {
+			.content = LAB_FIELD_NONE,
+			.literal = compiled->text.len,
+		};
+		array_add(&compiled->tokens, token);
+		buf_add_char(&compiled->text, ch);
+	}
+	buf_add_char(&compiled->text, '\0');
+}
+
+struct cycle_osd_format *
+cycle_osd_format_compile(const char *format)
 {
 	if (!format) {
 		wlr_log(WLR_ERROR, "Missing format for custom window switcher field");
-		return;
+		return NULL;
 	}
 
-	char fmt[LAB_FIELD_SINGLE_FMT_MAX_LEN];
-	unsigned char fmt_position = 0;
+	struct cycle_osd_format *compiled = znew(*compiled);
+	compiled->text = BUF_INIT;
+	wl_array_init(&compiled->tokens);
 
-	struct buf field_result = BUF_INIT;
-	char converted_field[4096];
+	bool in_directive = false;
+	/* Like the '-' and digits of a printf conversion, within limits */
+	int spec_len = 0;
+	struct format_token token = {0};
 
 	for (const char *p = format; *p; p++) {
-		if (!fmt_position) {
+		if (!in_directive) {
 			if (*p == '%') {
-				fmt[fmt_position++] = *p;
+				in_directive = true;
 			} else {
-				/*
-				 * Just relay anything not part of a
-				 * format string to the output buffer.
-				 */
-				buf_add_char(buf, *p);
+				add_literal_char(compiled, *p);
 			}
 			continue;
 		}
 
-		/* Allow string formatting */
 		/* TODO: add . for manual truncating? */
-		/*
-		 * Remove the || *p == '#' section as not used/needed
-		 * change (*p >= '0' && *p <= '9') to isdigit(*p)
-		 * changes by droc12345
-		 */
 		if (*p == '-' || isdigit(*p)) {
-			if (fmt_position >= LAB_FIELD_SINGLE_FMT_MAX_LEN - 2) {
-				/* Leave space for terminating 's' and NULL byte */
+			if (spec_len >= LAB_FIELD_SINGLE_FMT_MAX_LEN - 3) {
+				/* '%', 's' and NUL byte in the original format */
 				wlr_log(WLR_ERROR,
 					"single format string length exceeded: '%s'", p);
+			} else if (*p == '-') {
+				token.left_justify = true;
+				spec_len++;
 			} else {
-				fmt[fmt_position++] = *p;
+				token.width = token.width * 10 + (*p - '0');
+				spec_len++;
 			}
 			continue;
 		}
 
 		/* Handlers */
+		token.content = LAB_FIELD_NONE;
 		for (unsigned char i = 0; i < LAB_FIELD_COUNT; i++) {
-			if (*p != field_converter[i].fmt_char) {
-				continue;
+			if (*p == field_converter[i].fmt_char) {
+				token.content = i;
+				break;
 			}
+		}
+		if (token.content != LAB_FIELD_NONE) {
+			array_add(&compiled->tokens, token);
+		} else {
+			wlr_log(WLR_ERROR,
+				"invalid format character found for osd %s: '%c'",
+				format, *p);
+		}
 
-			/* Generate the actual content*/
-			field_converter[i].fn(&field_result, view, /*format*/ NULL);
-
-			/* Throw it at snprintf to allow formatting / padding */
-			fmt[fmt_position++] = 's';
-			fmt[fmt_position++] = '\0';
-			snprintf(converted_field, sizeof(converted_field),
-				fmt, field_result.data);
+		/* Reset format string */
+		in_directive = false;
+		spec_len = 0;
+		token = (struct format_token){0};
+	}
+	return compiled;
+}
 
-			/* And finally write it to the output buffer */
-			buf_add(buf, converted_field);
-			goto reset_format;
+void
+cycle_osd_format_apply(struct cycle_osd_format *compiled, struct buf *buf,
+		struct view *view)
+{
+	if (!compiled) {
+		return;
+	}
+	struct format_token *token;
+	wl_array_for_each(token, &compiled->tokens) {
+		if (token->content == LAB_FIELD_NONE) {
+			buf_add(buf, compiled->text.data + token->literal);
+			continue;
 		}
 
-		wlr_log(WLR_ERROR,
-			"invalid format character found for osd %s: '%c'",
-			format, *p);
+		/* Convert straight into @buf, then pad it to the width */
+		size_t start = buf->len;
+		field_converter[token->content].fn(buf, view, /*format*/ NULL);
+		int len = buf->len - start;
+		int padding = token->width - len;
+		if (padding <= 0) {
+			continue;
+		}
+		for (int i = 0; i < padding; i++) {
+			buf_add_char(buf, ' ');
+		}
+		if (!token->left_justify) {
+			memmove(buf->data + start + padding, buf->data + start, len);
+			memset(buf->data + start, ' ', padding);
+		}
+	}
+}
 
-reset_format:
-		/* Reset format string and tmp field result buffer */
-		buf_clear(&field_result);
-		fmt_position = 0;
+void
+cycle_osd_format_destroy(struct cycle_osd_format *compiled)
+{
+	if (!compiled) {
+		return;
 	}
-	buf_reset(&field_result);
+	buf_reset(&compiled->text);
+	wl_array_release(&compiled->tokens);
+	free(compiled);
+}
+
+void
+cycle_osd_field_set_custom(struct buf *buf, struct view *view, const char *format)
+{
+	struct cycle_osd_format *compiled = cycle_osd_format_compile(format);
+	cycle_osd_format_apply(compiled, buf, view);
+	cycle_osd_format_destroy(compiled);
 }
 
 void
@@ -321,6 +402,8 @@ cycle_osd_field_arg_from_xml_node(struct cycle_osd_field *field,
 	} else if (!strcmp(nodename, "format")) {
 		zfree(field->format);
 		field->format = xstrdup(content);
+		cycle_osd_format_destroy(field->compiled);
+		field->compiled = cycle_osd_format_compile(content);
 	} else if (!strcmp(nodename, "width") && !strchr(content, '%')) {
 		wlr_log(WLR_ERROR, "Invalid osd field width: %s, misses trailing %%", content);
 	} else if (!strcmp(nodename, "width")) {
@@ -359,6 +442,10 @@ cycle_osd_field_get_content(struct cycle_osd_field *field,
 	}
 	assert(field->content < LAB_FIELD_COUNT && field_converter[field->content].fn);
 
+	if (field->content == LAB_FIELD_CUSTOM) {
+		cycle_osd_format_apply(field->compiled, buf, view);
+		return;
+	}
 	field_converter[field->content].fn(buf, view, field->format);
 }
 
@@ -366,5 +453,6 @@ void
 cycle_osd_field_free(struct cycle_osd_field *field)
 {
 	zfree(field->format);
+	cycle_osd_format_destroy(field->compiled);
 	zfree(field);
 }
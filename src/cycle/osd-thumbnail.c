@@ -1,19 +1,25 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <assert.h>
+#include <math.h>
 #include <wlr/render/allocator.h>
 #include <wlr/render/swapchain.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
+#include "buffer.h"
 #include "config/rcxml.h"
 #include "common/box.h"
 #include "common/buf.h"
+#include "common/hash.h"
 #include "common/lab-scene-rect.h"
 #include "common/list.h"
+#include "common/macros.h"
 #include "common/mem.h"
 #include "cycle.h"
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "scaled-buffer/scaled-font-buffer.h"
 #include "scaled-buffer/scaled-icon-buffer.h"
 #include "theme.h"
@@ -26,16 +32,206 @@ struct cycle_osd_thumbnail_item {
 	struct lab_scene_rect *active_bg;
 };
 
+/*
+ * Downscaled thumbnail of a view, kept between window switcher sessions
+ * and only re-rendered when the view has committed since, its scene tree
+ * shows other buffers or a different thumbnail size is needed.
+ */
+struct thumbnail {
+	struct view *view;
+	struct wlr_buffer *buffer;
+	uint64_t content_serial;
+	uint64_t content_hash;
+	struct wl_listener view_destroy;
+	struct wl_list link; /* thumbnails */
+};
+
+static struct wl_list thumbnails = WL_LIST_INIT(&thumbnails);
+
+/*
+ * Textures for buffers which are not client buffers, which would
+ * otherwise be imported again for every thumbnail. wlr_buffers don't
+ * change content, so a texture stays valid until its buffer is destroyed.
+ */
+#define TEXTURE_CACHE_SIZE 64
+
+struct cached_texture {
+	struct wlr_buffer *buffer;
+	struct wlr_texture *texture;
+	struct wl_listener buffer_destroy;
+	struct wl_list link; /* textures, most recently used first */
+};
+
+static struct wl_list textures = WL_LIST_INIT(&textures);
+static int nr_textures;
+
+static void
+cached_texture_destroy(struct cached_texture *cached)
+{
+	wlr_texture_destroy(cached->texture);
+	wl_list_remove(&cached->buffer_destroy.link);
+	wl_list_remove(&cached->link);
+	free(cached);
+	nr_textures--;
+}
+
+static void
+handle_buffer_destroy(struct wl_listener *listener, void *data)
+{
+	struct cached_texture *cached =
+		wl_container_of(listener, cached, buffer_destroy);
+	cached_texture_destroy(cached);
+}
+
+/* The returned texture must not be destroyed by the caller */
+static struct wlr_texture *
+get_texture(struct wlr_renderer *renderer, struct wlr_buffer *buffer)
+{
+	/*
+	 * Surfaces already have a texture, which the scene renders too,
+	 * unless it belongs to the renderer of another GPU
+	 */
+	struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
+	if (client_buffer && client_buffer->texture
+			&& client_buffer->texture->renderer == renderer) {
+		return client_buffer->texture;
+	}
+
+	struct cached_texture *cached;
+	wl_list_for_each(cached, &textures, link) {
+		if (cached->buffer == buffer
+				&& cached->texture->renderer == renderer) {
+			wl_list_remove(&cached->link);
+			wl_list_insert(&textures, &cached->link);
+			return cached->texture;
+		}
+	}
+
+	struct wlr_texture *texture =
+		wlr_texture_from_buffer(renderer, buffer);
+	if (!texture) {
+		return NULL;
+	}
+	if (nr_textures >= TEXTURE_CACHE_SIZE) {
+		cached_texture_destroy(wl_container_of(textures.prev,
+			cached, link));
+	}
+	cached = znew(*cached);
+	cached->buffer = buffer;
+	cached->texture = texture;
+	cached->buffer_destroy.notify = handle_buffer_destroy;
+	wl_signal_add(&buffer->events.destroy, &cached->buffer_destroy);
+	wl_list_insert(&textures, &cached->link);
+	nr_textures++;
+	return texture;
+}
+
+static ssize_t
+get_buffer_bytes(struct wlr_buffer *buffer)
+{
+	/* An estimate, the allocator may pad or compress */
+	return (ssize_t)buffer->width * buffer->height * 4;
+}
+
+static void
+thumbnail_set_buffer(struct thumbnail *thumbnail, struct wlr_buffer *buffer)
+{
+	if (thumbnail->buffer) {
+		buffer_account(BUFFER_THUMBNAIL,
+			-get_buffer_bytes(thumbnail->buffer));
+		wlr_buffer_drop(thumbnail->buffer);
+	}
+	thumbnail->buffer = buffer;
+	if (buffer) {
+		buffer_account(BUFFER_THUMBNAIL, get_buffer_bytes(buffer));
+	}
+}
+
+static void
+thumbnail_destroy(struct thumbnail *thumbnail)
+{
+	thumbnail_set_buffer(thumbnail, NULL);
+	wl_list_remove(&thumbnail->view_destroy.link);
+	wl_list_remove(&thumbnail->link);
+	free(thumbnail);
+}
+
 static void
-render_node(struct server *server, struct wlr_render_pass *pass,
-		struct wlr_scene_node *node, int x, int y)
+handle_view_destroy(struct wl_listener *listener, void *data)
+{
+	struct thumbnail *thumbnail =
+		wl_container_of(listener, thumbnail, view_destroy);
+	thumbnail_destroy(thumbnail);
+}
+
+static struct thumbnail *
+thumbnail_get(struct view *view)
 {
+	struct thumbnail *thumbnail;
+	wl_list_for_each(thumbnail, &thumbnails, link) {
+		if (thumbnail->view == view) {
+			return thumbnail;
+		}
+	}
+	thumbnail = znew(*thumbnail);
+	thumbnail->view = view;
+	thumbnail->view_destroy.notify = handle_view_destroy;
+	wl_signal_add(&view->events.destroy, &thumbnail->view_destroy);
+	wl_list_insert(&thumbnails, &thumbnail->link);
+	return thumbnail;
+}
+
+/*
+ * Commits of subsurfaces are not seen by the view, but mostly come
+ * with a new buffer, so also hash what is shown in the tree.
+ */
+static uint64_t
+hash_node(uint64_t hash, struct wlr_scene_node *node)
+{
+	if (!node->enabled) {
+		return hash;
+	}
+	hash = hash_add(hash, &node->x, sizeof(node->x));
+	hash = hash_add(hash, &node->y, sizeof(node->y));
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &tree->children, link) {
+			hash = hash_node(hash, child);
+		}
+	} else if (node->type == WLR_SCENE_NODE_BUFFER) {
+		struct wlr_scene_buffer *scene_buffer =
+			wlr_scene_buffer_from_node(node);
+		hash = hash_add(hash, &scene_buffer->buffer,
+			sizeof(scene_buffer->buffer));
+		hash = hash_add(hash, &scene_buffer->dst_width,
+			sizeof(scene_buffer->dst_width));
+		hash = hash_add(hash, &scene_buffer->dst_height,
+			sizeof(scene_buffer->dst_height));
+	}
+	return hash;
+}
+
+/*
+ * Render @node scaled down by @scale, skipping what is hidden or would
+ * end up outside of @bounds or smaller than a pixel in the thumbnail
+ */
+static void
+render_node(struct wlr_renderer *renderer, struct wlr_render_pass *pass,
+		struct wlr_scene_node *node, int x, int y, double scale,
+		struct wlr_box *bounds)
+{
+	if (!node->enabled) {
+		return;
+	}
+
 	switch (node->type) {
 	case WLR_SCENE_NODE_TREE: {
 		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
 		struct wlr_scene_node *child;
 		wl_list_for_each(child, &tree->children, link) {
-			render_node(server, pass, child, x + node->x, y + node->y);
+			render_node(renderer, pass, child, x + node->x, y + node->y,
+				scale, bounds);
 		}
 		break;
 	}
@@ -45,23 +241,36 @@ render_node(struct server *server, struct wlr_render_pass *pass,
 		if (!scene_buffer->buffer) {
 			break;
 		}
-		struct wlr_texture *texture = wlr_texture_from_buffer(
-			server->renderer, scene_buffer->buffer);
+		int width = scene_buffer->dst_width;
+		int height = scene_buffer->dst_height;
+		if (!width || !height) {
+			width = scene_buffer->buffer->width;
+			height = scene_buffer->buffer->height;
+		}
+		x += node->x;
+		y += node->y;
+		struct wlr_box dst_box = {
+			.x = lround(x * scale),
+			.y = lround(y * scale),
+			.width = lround((x + width) * scale) - lround(x * scale),
+			.height = lround((y + height) * scale) - lround(y * scale),
+		};
+		/* Before importing a texture, which may be a copy */
+		if (!box_intersects(&dst_box, bounds)) {
+			break;
+		}
+		struct wlr_texture *texture =
+			get_texture(renderer, scene_buffer->buffer);
 		if (!texture) {
 			break;
 		}
 		wlr_render_pass_add_texture(pass, &(struct wlr_render_texture_options){
 			.texture = texture,
 			.src_box = scene_buffer->src_box,
-			.dst_box = {
-				.x = x,
-				.y = y,
-				.width = scene_buffer->dst_width,
-				.height = scene_buffer->dst_height,
-			},
+			.dst_box = dst_box,
 			.transform = scene_buffer->transform,
+			.filter_mode = WLR_SCALE_FILTER_BILINEAR,
 		});
-		wlr_texture_destroy(texture);
 		break;
 	}
 	case WLR_SCENE_NODE_RECT:
@@ -71,28 +280,64 @@ render_node(struct server *server, struct wlr_render_pass *pass,
 	}
 }
 
+/*
+ * Render the content of @view into a buffer of @width x @height pixels.
+ * The returned buffer is owned by the thumbnail cache.
+ */
 static struct wlr_buffer *
-render_thumb(struct output *output, struct view *view)
+render_thumb(struct output *output, struct view *view, int width, int height)
 {
-	if (!view->content_tree) {
+	if (!view->content_tree || view->current.width <= 0) {
 		/*
 		 * Defensive. Could possibly occur if view was unmapped
 		 * with OSD already displayed.
 		 */
 		return NULL;
 	}
-	struct server *server = output->server;
-	struct wlr_buffer *buffer = wlr_allocator_create_buffer(server->allocator,
-		view->current.width, view->current.height,
+
+	struct thumbnail *thumbnail = thumbnail_get(view);
+	uint64_t content_hash = hash_node(HASH_INIT, &view->content_tree->node);
+	if (thumbnail->buffer && thumbnail->buffer->width == width
+			&& thumbnail->buffer->height == height
+			&& thumbnail->content_serial == view->content_serial
+			&& thumbnail->content_hash == content_hash) {
+		return thumbnail->buffer;
+	}
+
+	/* Render with the GPU which composites the output showing the OSD */
+	struct wlr_renderer *renderer = output->wlr_output->renderer;
+	struct wlr_buffer *buffer = wlr_allocator_create_buffer(
+		output->wlr_output->allocator, width, height,
 		&output->wlr_output->swapchain->format);
+	if (!buffer) {
+		wlr_log(WLR_ERROR, "failed to allocate thumbnail buffer");
+		return NULL;
+	}
 	struct wlr_render_pass *pass = wlr_renderer_begin_buffer_pass(
-		server->renderer, buffer, NULL);
-	render_node(server, pass, &view->content_tree->node, 0, 0);
+		renderer, buffer, NULL);
+	if (!pass) {
+		wlr_buffer_drop(buffer);
+		return NULL;
+	}
+	/* The content of new buffers is undefined, so clear it first */
+	struct wlr_box bounds = { .width = width, .height = height };
+	wlr_render_pass_add_rect(pass, &(struct wlr_render_rect_options){
+		.box = bounds,
+		.color = { 0, 0, 0, 0 },
+		.blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+	});
+	double scale = (double)width / view->current.width;
+	render_node(renderer, pass, &view->content_tree->node, 0, 0, scale,
+		&bounds);
 	if (!wlr_render_pass_submit(pass)) {
 		wlr_log(WLR_ERROR, "failed to submit render pass");
 		wlr_buffer_drop(buffer);
 		return NULL;
 	}
+
+	thumbnail_set_buffer(thumbnail, buffer);
+	thumbnail->content_serial = view->content_serial;
+	thumbnail->content_hash = content_hash;
 	return buffer;
 }
 
@@ -102,10 +347,10 @@ create_label(struct wlr_scene_tree *parent, struct view *view,
 		const float *text_color, const float *bg_color, int y)
 {
 	struct buf buf = BUF_INIT;
-	cycle_osd_field_set_custom(&buf, view,
-		rc.window_switcher.thumbnail_label_format);
+	cycle_osd_format_apply(rc.window_switcher.thumbnail_label, &buf, view);
 	struct scaled_font_buffer *buffer =
 		scaled_font_buffer_create(parent);
+	buffer->scaled_buffer->category = BUFFER_OSD;
 	scaled_font_buffer_update(buffer, buf.data,
 		switcher_theme->item_width - 2 * switcher_theme->item_padding,
 		&rc.font_osd, text_color, bg_color);
@@ -158,15 +403,19 @@ create_item_scene(struct wlr_scene_tree *parent, struct view *view,
 	wlr_scene_rect_create(tree, switcher_theme->item_width,
 		switcher_theme->item_height, (float[4]) {0});
 
-	/* thumbnail */
-	struct wlr_buffer *thumb_buffer = render_thumb(output, view);
+	/* thumbnail, rendered at the size it is shown at */
+	struct wlr_box thumb_box = box_fit_within(view->current.width,
+		view->current.height, &thumb_bounds);
+	float scale = output->wlr_output->scale;
+	struct wlr_buffer *thumb_buffer = NULL;
+	if (thumb_box.width > 0 && thumb_box.height > 0) {
+		thumb_buffer = render_thumb(output, view,
+			ceilf(thumb_box.width * scale),
+			ceilf(thumb_box.height * scale));
+	}
 	if (thumb_buffer) {
 		struct wlr_scene_buffer *thumb_scene_buffer =
 			wlr_scene_buffer_create(tree, thumb_buffer);
-		wlr_buffer_drop(thumb_buffer);
-		struct wlr_box thumb_box = box_fit_within(
-			thumb_buffer->width, thumb_buffer->height,
-			&thumb_bounds);
 		wlr_scene_buffer_set_dest_size(thumb_scene_buffer,
 			thumb_box.width, thumb_box.height);
 		wlr_scene_node_set_position(&thumb_scene_buffer->node,
@@ -193,6 +442,25 @@ create_item_scene(struct wlr_scene_tree *parent, struct view *view,
 	return item;
 }
 
+/*
+ * Everything an item shows apart from the icon, which updates itself.
+ * The item sizes only change with the theme, which drops all items.
+ */
+static uint64_t
+get_item_hash(struct output *output, struct view *view)
+{
+	struct buf buf = BUF_INIT;
+	cycle_osd_format_apply(rc.window_switcher.thumbnail_label, &buf, view);
+	uint64_t hash = hash_add_str(HASH_INIT, buf.data);
+	buf_reset(&buf);
+
+	float scale = output->wlr_output->scale;
+	hash = hash_add(hash, &scale, sizeof(scale));
+	hash = hash_add(hash, &view->current, sizeof(view->current));
+	return hash_add(hash, &view->content_serial,
+		sizeof(view->content_serial));
+}
+
 static void
 get_items_geometry(struct output *output, struct theme *theme,
 		int nr_thumbs, int *nr_rows, int *nr_cols)
@@ -225,6 +493,58 @@ get_items_geometry(struct output *output, struct theme *theme,
 	}
 }
 
+/* Create or reuse the items for the views shown, see first_item */
+static void
+place_items(struct output *output)
+{
+	struct server *server = output->server;
+	struct theme *theme = server->theme;
+	struct window_switcher_thumbnail_theme *switcher_theme =
+		&theme->osd_window_switcher_thumbnail;
+	struct cycle_osd_scene *osd = &output->cycle_osd;
+	int padding = theme->osd_border_width + switcher_theme->padding;
+	int nr_cols = osd->row_length;
+
+	cycle_osd_cache_items(output);
+
+	struct view *view;
+	int index = 0;
+	wl_list_for_each(view, &server->cycle.views, cycle_link) {
+		if (index < osd->first_item) {
+			index++;
+			continue;
+		}
+		if (index >= osd->first_item + osd->nr_shown) {
+			break;
+		}
+		uint64_t hash = get_item_hash(output, view);
+		struct cycle_osd_item *item = cycle_osd_reuse_item(output,
+			view, hash, osd->tree);
+		if (!item) {
+			struct cycle_osd_thumbnail_item *thumbnail_item =
+				create_item_scene(osd->tree, view, output);
+			if (!thumbnail_item) {
+				break;
+			}
+			item = &thumbnail_item->base;
+			item->hash = hash;
+		}
+		int shown_index = index - osd->first_item;
+		int x = (shown_index % nr_cols) * switcher_theme->item_width + padding;
+		int y = (shown_index / nr_cols) * switcher_theme->item_height + padding;
+		wlr_scene_node_set_position(&item->tree->node, x, y);
+		index++;
+	}
+
+	/* In the right padding, along the rows */
+	int bar_width = MAX(switcher_theme->padding, 2);
+	int nr_rows = osd->nr_shown / nr_cols;
+	cycle_osd_update_scrollbar(output,
+		nr_cols * switcher_theme->item_width + 2 * padding
+			- theme->osd_border_width - bar_width,
+		padding, bar_width, nr_rows * switcher_theme->item_height);
+}
+
 static void
 cycle_osd_thumbnail_create(struct output *output)
 {
@@ -243,20 +563,21 @@ cycle_osd_thumbnail_create(struct output *output)
 	int nr_rows, nr_cols;
 	get_items_geometry(output, theme, nr_views, &nr_rows, &nr_cols);
 
+	/*
+	 * Only create items for as many rows as fit on the output,
+	 * scrolling along with the selection
+	 */
+	int output_width, output_height;
+	wlr_output_effective_resolution(output->wlr_output,
+		&output_width, &output_height);
+	int rows_fit = (output_height - 2 * padding) / switcher_theme->item_height;
+	nr_rows = MIN(nr_rows, MAX(rows_fit, 1));
+	output->cycle_osd.first_item = 0;
+	output->cycle_osd.row_length = nr_cols;
+	output->cycle_osd.nr_shown = nr_rows * nr_cols;
+
 	/* items */
-	struct view *view;
-	int index = 0;
-	wl_list_for_each(view, &server->cycle.views, cycle_link) {
-		struct cycle_osd_thumbnail_item *item = create_item_scene(
-			output->cycle_osd.tree, view, output);
-		if (!item) {
-			break;
-		}
-		int x = (index % nr_cols) * switcher_theme->item_width + padding;
-		int y = (index / nr_cols) * switcher_theme->item_height + padding;
-		wlr_scene_node_set_position(&item->base.tree->node, x, y);
-		index++;
-	}
+	place_items(output);
 
 	/* background */
 	struct lab_scene_rect_options bg_opts = {
@@ -283,6 +604,10 @@ cycle_osd_thumbnail_create(struct output *output)
 static void
 cycle_osd_thumbnail_update(struct output *output)
 {
+	if (cycle_osd_scroll_to_selection(output)) {
+		place_items(output);
+	}
+
 	struct cycle_osd_thumbnail_item *item;
 	wl_list_for_each(item, &output->cycle_osd.items, base.link) {
 		bool active = (item->base.view == output->server->cycle.selected_view);
@@ -294,6 +619,19 @@ cycle_osd_thumbnail_update(struct output *output)
 	}
 }
 
+void
+cycle_osd_thumbnail_reset(void)
+{
+	struct thumbnail *thumbnail, *thumbnail_tmp;
+	wl_list_for_each_safe(thumbnail, thumbnail_tmp, &thumbnails, link) {
+		thumbnail_destroy(thumbnail);
+	}
+	struct cached_texture *cached, *cached_tmp;
+	wl_list_for_each_safe(cached, cached_tmp, &textures, link) {
+		cached_texture_destroy(cached);
+	}
+}
+
 struct cycle_osd_impl cycle_osd_thumbnail_impl = {
 	.create = cycle_osd_thumbnail_create,
 	.update = cycle_osd_thumbnail_update,
@@ -1,9 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include "debug.h"
+#include <glib.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_scene.h>
+#include "buffer.h"
 #include "common/lab-scene-rect.h"
+#include "common/macros.h"
+#include "common/mem.h"
 #include "common/scene-helpers.h"
 #include "common/string-helpers.h"
 #include "input/ime.h"
@@ -250,3 +255,306 @@ debug_dump_scene(struct server *server)
 	 */
 	last_view = NULL;
 }
+
+/* Scene statistics */
+
+#define NR_DEEPEST 5
+#define MAX_PATH_DEPTH 64
+
+enum scene_owner {
+	OWNER_OTHER = 0,
+	OWNER_VIEW_CONTENT,
+	OWNER_SSD,
+	OWNER_SHADOW,
+	OWNER_MENU,
+	OWNER_OSD,
+	OWNER_LAYER,
+	OWNER_POPUP,
+	NR_OWNERS,
+};
+
+static const char *const owner_names[NR_OWNERS] = {
+	[OWNER_OTHER] = "other",
+	[OWNER_VIEW_CONTENT] = "view_content",
+	[OWNER_SSD] = "ssd",
+	[OWNER_SHADOW] = "shadow",
+	[OWNER_MENU] = "menu",
+	[OWNER_OSD] = "osd",
+	[OWNER_LAYER] = "layer",
+	[OWNER_POPUP] = "popup",
+};
+
+enum scene_node_kind {
+	KIND_TREE = 0,
+	KIND_RECT,
+	KIND_BUFFER,
+	KIND_SURFACE,
+	NR_KINDS,
+};
+
+static const char *const kind_names[NR_KINDS] = {
+	[KIND_TREE] = "tree",
+	[KIND_RECT] = "rect",
+	[KIND_BUFFER] = "buffer",
+	[KIND_SURFACE] = "surface",
+};
+
+struct owner_stats {
+	int nodes;
+	int buffers;
+	uint64_t bytes;
+};
+
+struct deep_path {
+	int depth;
+	char *path;
+};
+
+struct scene_stats {
+	struct server *server;
+	int nodes[NR_KINDS];
+	struct owner_stats owners[NR_OWNERS];
+	/* wlr_buffer -> number of scene buffers showing it */
+	GHashTable *buffers;
+	int max_depth;
+	struct deep_path deepest[NR_DEEPEST];
+	/* Component names of the path to the current node */
+	char names[MAX_PATH_DEPTH][LEFT_COL_SPACE];
+};
+
+static enum scene_node_kind
+get_node_kind(struct wlr_scene_node *node)
+{
+	switch (node->type) {
+	case WLR_SCENE_NODE_TREE:
+		return KIND_TREE;
+	case WLR_SCENE_NODE_RECT:
+		return KIND_RECT;
+	case WLR_SCENE_NODE_BUFFER:
+		break;
+	}
+	return lab_wlr_surface_from_node(node) ? KIND_SURFACE : KIND_BUFFER;
+}
+
+/* Return the subsystem owning @node, given that its parent is in @owner */
+static enum scene_owner
+get_owner(struct server *server, struct wlr_scene_node *node,
+		enum scene_owner owner)
+{
+	if (node == &server->menu_tree->node) {
+		return OWNER_MENU;
+	}
+	if (node == &server->xdg_popup_tree->node) {
+		return OWNER_POPUP;
+	}
+	if (server->cycle.preview_outline
+			&& node == &server->cycle.preview_outline->tree->node) {
+		return OWNER_OSD;
+	}
+#if HAVE_XWAYLAND
+	if (node == &server->unmanaged_tree->node) {
+		return OWNER_VIEW_CONTENT;
+	}
+#endif
+	if (node->parent == &server->scene->tree) {
+		struct output *output;
+		wl_list_for_each(output, &server->outputs, link) {
+			if (node == &output->cycle_osd_tree->node) {
+				return OWNER_OSD;
+			}
+			if (node == &output->layer_popup_tree->node) {
+				return OWNER_LAYER;
+			}
+			for (int i = 0; i < 4; i++) {
+				if (node == &output->layer_tree[i]->node) {
+					return OWNER_LAYER;
+				}
+			}
+		}
+	}
+
+	/* Set by get_special() when entering the tree of a view */
+	struct view *view = last_view;
+	if (!view) {
+		return owner;
+	}
+	if (node == &view->scene_tree->node) {
+		return OWNER_VIEW_CONTENT;
+	}
+	if (node->parent == view->scene_tree) {
+		if (ssd_debug_is_root_node(view->ssd, node)) {
+			return OWNER_SSD;
+		}
+		return OWNER_VIEW_CONTENT;
+	}
+	if (ssd_debug_is_shadow_node(view->ssd, node)) {
+		return OWNER_SHADOW;
+	}
+	return owner;
+}
+
+static uint64_t
+get_buffer_bytes(struct wlr_buffer *buffer)
+{
+	struct lab_data_buffer *data_buffer = buffer_try_from_wlr_buffer(buffer);
+	if (!data_buffer) {
+		/* Allocated by the client, typically ARGB8888 */
+		return (uint64_t)buffer->width * buffer->height * 4;
+	}
+	uint64_t bytes = 0;
+	for (; data_buffer; data_buffer = data_buffer->half) {
+		bytes += (uint64_t)data_buffer->stride * data_buffer->base.height;
+	}
+	return bytes;
+}
+
+static void
+add_buffer(struct scene_stats *stats, struct wlr_scene_node *node,
+		enum scene_owner owner)
+{
+	struct wlr_buffer *buffer = wlr_scene_buffer_from_node(node)->buffer;
+	if (!buffer) {
+		return;
+	}
+	struct owner_stats *owner_stats = &stats->owners[owner];
+	owner_stats->buffers++;
+
+	/* The memory of a shared buffer goes to the first owner found */
+	gpointer count = g_hash_table_lookup(stats->buffers, buffer);
+	if (!count) {
+		owner_stats->bytes += get_buffer_bytes(buffer);
+	}
+	g_hash_table_insert(stats->buffers, buffer,
+		GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
+}
+
+static void
+add_deep_path(struct scene_stats *stats, int depth)
+{
+	/* The list is sorted by decreasing depth */
+	int slot = NR_DEEPEST - 1;
+	if (depth <= stats->deepest[slot].depth) {
+		return;
+	}
+	free(stats->deepest[slot].path);
+	for (; slot > 0 && stats->deepest[slot - 1].depth < depth; slot--) {
+		stats->deepest[slot] = stats->deepest[slot - 1];
+	}
+
+	GString *path = g_string_new(NULL);
+	for (int i = 0; i <= MIN(depth, MAX_PATH_DEPTH - 1); i++) {
+		g_string_append_printf(path, "%s%s", i ? "/" : "",
+			stats->names[i]);
+	}
+	if (depth >= MAX_PATH_DEPTH) {
+		g_string_append(path, "/...");
+	}
+	stats->deepest[slot].depth = depth;
+	stats->deepest[slot].path = g_string_free(path, false);
+}
+
+static void
+collect_stats(struct scene_stats *stats, struct wlr_scene_node *node,
+		enum scene_owner owner, int depth)
+{
+	struct server *server = stats->server;
+
+	/* get_special() keeps track of the view we are in */
+	const char *name = get_special(server, node);
+	if (depth < MAX_PATH_DEPTH) {
+		snprintf(stats->names[depth], sizeof(stats->names[depth]),
+			"%s", name);
+	}
+	owner = get_owner(server, node, owner);
+
+	enum scene_node_kind kind = get_node_kind(node);
+	stats->nodes[kind]++;
+	stats->owners[owner].nodes++;
+	if (node->type == WLR_SCENE_NODE_BUFFER) {
+		add_buffer(stats, node, owner);
+	}
+	stats->max_depth = MAX(stats->max_depth, depth);
+
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		add_deep_path(stats, depth);
+		return;
+	}
+	struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+	if (wl_list_empty(&tree->children)) {
+		add_deep_path(stats, depth);
+	}
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->children, link) {
+		collect_stats(stats, child, owner, depth + 1);
+	}
+}
+
+static void
+print_json_string(FILE *stream, const char *str)
+{
+	fputc('"', stream);
+	for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			fprintf(stream, "\\%c", *p);
+		} else if (*p < 0x20) {
+			fprintf(stream, "\\u%04x", *p);
+		} else {
+			fputc(*p, stream);
+		}
+	}
+	fputc('"', stream);
+}
+
+void
+debug_scene_stats(struct server *server, FILE *stream)
+{
+	struct scene_stats *stats = znew(*stats);
+	stats->server = server;
+	stats->buffers = g_hash_table_new(g_direct_hash, g_direct_equal);
+	collect_stats(stats, &server->scene->tree.node, OWNER_OTHER, 0);
+	last_view = NULL;
+
+	int total = 0;
+	fprintf(stream, "{\n  \"nodes\": {");
+	for (int i = 0; i < NR_KINDS; i++) {
+		fprintf(stream, "\"%s\": %d, ", kind_names[i], stats->nodes[i]);
+		total += stats->nodes[i];
+	}
+	fprintf(stream, "\"total\": %d},\n  \"owners\": {", total);
+	for (int i = 0; i < NR_OWNERS; i++) {
+		struct owner_stats *owner = &stats->owners[i];
+		fprintf(stream, "%s\n    \"%s\": {\"nodes\": %d, "
+			"\"buffers\": %d, \"bytes\": %" PRIu64 "}",
+			i ? "," : "", owner_names[i], owner->nodes,
+			owner->buffers, owner->bytes);
+	}
+
+	int data_buffers = 0, shared = 0;
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, stats->buffers);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (!buffer_try_from_wlr_buffer(key)) {
+			continue;
+		}
+		data_buffers++;
+		shared += GPOINTER_TO_INT(value) > 1;
+	}
+	fprintf(stream, "\n  },\n  \"buffers\": {\"distinct\": %u, "
+		"\"lab_data_buffers\": %d, \"shared_lab_data_buffers\": %d},\n",
+		g_hash_table_size(stats->buffers), data_buffers, shared);
+
+	fprintf(stream, "  \"max_depth\": %d,\n  \"deepest\": [",
+		stats->max_depth);
+	for (int i = 0; i < NR_DEEPEST && stats->deepest[i].path; i++) {
+		fprintf(stream, "%s\n    {\"depth\": %d, \"path\": ",
+			i ? "," : "", stats->deepest[i].depth);
+		print_json_string(stream, stats->deepest[i].path);
+		fputc('}', stream);
+		g_free(stats->deepest[i].path);
+	}
+	fprintf(stream, "\n  ]\n}\n");
+
+	g_hash_table_destroy(stats->buffers);
+	free(stats);
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "deferred-startup.h"
+#include <stdbool.h>
+#include <wlr/util/log.h>
+#include "common/macros.h"
+#include "config.h"
+#include "config/rcxml.h"
+#include "desktop-entry.h"
+#include "labwc.h"
+#include "menu/menu.h"
+#include "startup-profile.h"
+#include "timer.h"
+
+/* For example with the lid closed and no external monitor */
+#define FIRST_FRAME_TIMEOUT_MS 1000
+/* Long enough to return to the event loop between steps */
+#define STEP_INTERVAL_MS 1
+
+static void
+init_desktop_entries(struct server *server)
+{
+#if HAVE_LIBSFDO
+	desktop_entry_init(server);
+#endif
+}
+
+/* In priority order */
+static const struct step {
+	const char *name;
+	void (*init)(struct server *server);
+} steps[] = {
+	/* Panels started by autostart need these first */
+	{ "foreign_toplevel_init", server_init_foreign_toplevel },
+	{ "desktop_entry_init", init_desktop_entries },
+	{ "menu_init", menu_init },
+};
+
+static struct {
+	struct server *server;
+	void (*ready)(void *data);
+	void *data;
+	struct lab_timer *timer;
+	bool waiting_for_frame;
+	size_t next_step;
+} deferred;
+
+static void
+run_step(void)
+{
+	const struct step *step = &steps[deferred.next_step++];
+	startup_profile_begin(step->name);
+	step->init(deferred.server);
+	startup_profile_end();
+	wlr_log(WLR_DEBUG, "deferred startup: %s done", step->name);
+}
+
+static void
+release(void)
+{
+	lab_timer_destroy(deferred.timer);
+	deferred.timer = NULL;
+	void (*ready)(void *data) = deferred.ready;
+	deferred.ready = NULL;
+	wlr_log(WLR_INFO, "deferred startup: ready");
+	ready(deferred.data);
+}
+
+static int
+handle_timer(void *data)
+{
+	if (deferred.waiting_for_frame) {
+		wlr_log(WLR_INFO, "deferred startup: no frame within %d ms",
+			FIRST_FRAME_TIMEOUT_MS);
+		deferred.waiting_for_frame = false;
+	}
+	if (deferred.next_step < ARRAY_SIZE(steps)) {
+		run_step();
+	}
+	if (deferred.next_step < ARRAY_SIZE(steps)) {
+		lab_timer_update(deferred.timer, STEP_INTERVAL_MS);
+	} else {
+		release();
+	}
+	return 0;
+}
+
+void
+deferred_startup_start(struct server *server, void (*ready)(void *data),
+		void *data)
+{
+	if (!rc.deferred_startup) {
+		ready(data);
+		return;
+	}
+	deferred.server = server;
+	deferred.ready = ready;
+	deferred.data = data;
+	deferred.next_step = 0;
+	deferred.timer = lab_timer_create(handle_timer, NULL, 0);
+	deferred.waiting_for_frame = true;
+	lab_timer_update(deferred.timer, FIRST_FRAME_TIMEOUT_MS);
+}
+
+void
+deferred_startup_frame_committed(void)
+{
+	if (!deferred.waiting_for_frame) {
+		return;
+	}
+	deferred.waiting_for_frame = false;
+	wlr_log(WLR_DEBUG, "deferred startup: first frame committed");
+	lab_timer_update(deferred.timer, STEP_INTERVAL_MS);
+}
+
+void
+deferred_startup_flush(void)
+{
+	if (!deferred.ready) {
+		return;
+	}
+	deferred.waiting_for_frame = false;
+	while (deferred.next_step < ARRAY_SIZE(steps)) {
+		run_step();
+	}
+	release();
+}
+
+void
+deferred_startup_finish(void)
+{
+	if (deferred.timer) {
+		lab_timer_destroy(deferred.timer);
+		deferred.timer = NULL;
+	}
+	deferred.ready = NULL;
+	deferred.waiting_for_frame = false;
+}
@@ -1,26 +1,59 @@
 // SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
 #include "desktop-entry.h"
+#include <assert.h>
+#include <glib.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <locale.h>
 #include <sfdo-desktop.h>
 #include <sfdo-icon.h>
 #include <sfdo-basedir.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <wlr/util/log.h>
+#include "common/dir.h"
+#include "common/hash.h"
+#include "common/macros.h"
 #include "common/mem.h"
 #include "common/string-helpers.h"
+#include "common/time-helpers.h"
 #include "config/rcxml.h"
 #include "img/img.h"
 #include "labwc.h"
+#include "scaled-buffer/scaled-icon-buffer.h"
+
+#define ICON_PATHS_FILE "icon-paths"
+#define ICON_PATHS_VERSION 1
 
 static const char *debug_libsfdo;
 
+struct icon_path {
+	char *path; /* NULL if the app_id has no icon */
+	enum sfdo_icon_file_format format;
+};
+
 struct sfdo {
 	struct sfdo_desktop_ctx *desktop_ctx;
 	struct sfdo_icon_ctx *icon_ctx;
 	struct sfdo_desktop_db *desktop_db;
 	struct sfdo_icon_theme *icon_theme;
+
+	/*
+	 * Icon files resolved from app_ids, keyed by "app_id\tsize\tscale"
+	 * with the lookup size and scale. This is stored in
+	 * $XDG_CACHE_HOME/labwc/icon-paths together with a hash of the
+	 * mtimes of the application and icon directories.
+	 */
+	GHashTable *icon_paths;
+	uint64_t icon_paths_stamp;
+	bool icon_paths_dirty;
 };
 
 static void
@@ -54,12 +87,188 @@ log_handler(enum sfdo_log_level level, const char *fmt, va_list args, void *tag)
 	_wlr_vlog((enum wlr_log_importance)level, fmt, args);
 }
 
-void
-desktop_entry_init(struct server *server)
+static void
+icon_path_destroy(gpointer data)
 {
-	struct sfdo *sfdo = znew(*sfdo);
+	struct icon_path *icon_path = data;
+	free(icon_path->path);
+	free(icon_path);
+}
 
-	debug_libsfdo = getenv("LABWC_DEBUG_LIBSFDO");
+static uint64_t
+add_dir_mtime(uint64_t stamp, const char *path)
+{
+	struct stat st;
+	uint64_t mtime = 0;
+	if (!stat(path, &st)) {
+		mtime = timespec_to_nsec(&st.st_mtim);
+	}
+	stamp = hash_add_str(stamp, path);
+	return hash_add(stamp, &mtime, sizeof(mtime));
+}
+
+/*
+ * Call @fn for each directory whose contents affect desktop entry and icon
+ * lookups. Installing or removing applications changes the mtime of an
+ * applications directory, and updating an icon theme (including its
+ * icon-theme.cache) changes the mtime of the theme directory.
+ */
+static void
+for_each_data_dir(const char *icon_theme_name,
+		void (*fn)(const char *dir, void *data), void *data)
+{
+	char theme_dir[PATH_MAX];
+	snprintf(theme_dir, sizeof(theme_dir), "icons/%s",
+		icon_theme_name ? icon_theme_name : "hicolor");
+	const char *subdirs[] = { "applications", "icons", theme_dir,
+		"icons/hicolor", "pixmaps" };
+
+	for (size_t i = 0; i < ARRAY_SIZE(subdirs); i++) {
+		struct wl_list paths;
+		paths_data_create(&paths, subdirs[i]);
+		struct path *path;
+		wl_list_for_each(path, &paths, link) {
+			fn(path->string, data);
+		}
+		paths_destroy(&paths);
+	}
+
+	const char *home = getenv("HOME");
+	if (home) {
+		char icons[PATH_MAX];
+		snprintf(icons, sizeof(icons), "%s/.icons", home);
+		fn(icons, data);
+	}
+}
+
+static void
+add_dir_mtime_cb(const char *dir, void *data)
+{
+	uint64_t *stamp = data;
+	*stamp = add_dir_mtime(*stamp, dir);
+}
+
+static uint64_t
+get_icon_paths_stamp(const char *icon_theme_name)
+{
+	uint64_t stamp = hash_add_str(HASH_INIT, icon_theme_name);
+	for_each_data_dir(icon_theme_name, add_dir_mtime_cb, &stamp);
+	return stamp;
+}
+
+static bool
+get_icon_paths_file(char *path, size_t len, bool create)
+{
+	if (!cache_dir_get(path, len, NULL, create)) {
+		return false;
+	}
+	size_t dir_len = strlen(path);
+	int ret = snprintf(path + dir_len, len - dir_len, "/%s", ICON_PATHS_FILE);
+	return ret >= 0 && (size_t)ret < len - dir_len;
+}
+
+static void
+load_icon_paths(struct sfdo *sfdo, const char *icon_theme_name)
+{
+	sfdo->icon_paths = g_hash_table_new_full(g_str_hash, g_str_equal,
+		free, icon_path_destroy);
+	sfdo->icon_paths_stamp = get_icon_paths_stamp(icon_theme_name);
+
+	char filename[PATH_MAX];
+	if (!get_icon_paths_file(filename, sizeof(filename), false)) {
+		return;
+	}
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		return;
+	}
+
+	char *line = NULL;
+	size_t size = 0;
+	unsigned int version = 0;
+	uint64_t stamp = 0;
+	if (getline(&line, &size, f) < 0
+			|| sscanf(line, "labwc-icon-paths %u %" SCNx64,
+				&version, &stamp) != 2
+			|| version != ICON_PATHS_VERSION
+			|| stamp != sfdo->icon_paths_stamp) {
+		wlr_log(WLR_DEBUG, "icon path cache is outdated");
+		sfdo->icon_paths_dirty = true;
+		goto out;
+	}
+
+	ssize_t len;
+	while ((len = getline(&line, &size, f)) > 0) {
+		if (line[len - 1] == '\n') {
+			line[len - 1] = '\0';
+		}
+		/* app_id \t size \t scale \t format \t path */
+		char *fields[5] = { line };
+		int nr_fields = 1;
+		for (char *p = line; *p && nr_fields < 5; p++) {
+			if (*p == '\t') {
+				*p = '\0';
+				fields[nr_fields++] = p + 1;
+			}
+		}
+		if (nr_fields != 5) {
+			continue;
+		}
+		struct icon_path *icon_path = znew(*icon_path);
+		icon_path->format = atoi(fields[3]);
+		if (*fields[4]) {
+			icon_path->path = xstrdup(fields[4]);
+		}
+		g_hash_table_insert(sfdo->icon_paths, strdup_printf("%s\t%s\t%s",
+			fields[0], fields[1], fields[2]), icon_path);
+	}
+	wlr_log(WLR_DEBUG, "loaded %u cached icon paths",
+		g_hash_table_size(sfdo->icon_paths));
+out:
+	free(line);
+	fclose(f);
+}
+
+static void
+save_icon_paths(struct sfdo *sfdo)
+{
+	if (!sfdo->icon_paths_dirty) {
+		return;
+	}
+	char filename[PATH_MAX];
+	char tmp_filename[PATH_MAX];
+	if (!get_icon_paths_file(filename, sizeof(filename), true)
+			|| snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp",
+				filename) >= (int)sizeof(tmp_filename)) {
+		return;
+	}
+	FILE *f = fopen(tmp_filename, "w");
+	if (!f) {
+		wlr_log_errno(WLR_DEBUG, "cannot write %s", tmp_filename);
+		return;
+	}
+
+	fprintf(f, "labwc-icon-paths %u %016" PRIx64 "\n", ICON_PATHS_VERSION,
+		sfdo->icon_paths_stamp);
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, sfdo->icon_paths);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct icon_path *icon_path = value;
+		fprintf(f, "%s\t%d\t%s\n", (char *)key, icon_path->format,
+			icon_path->path ? icon_path->path : "");
+	}
+	if (fclose(f) || rename(tmp_filename, filename)) {
+		wlr_log(WLR_DEBUG, "cannot store icon path cache");
+		unlink(tmp_filename);
+	}
+}
+
+/* Runs on the loader thread, so must not access rc or the server */
+static struct sfdo *
+load_sfdo(const char *icon_theme_name, const char *locale)
+{
+	struct sfdo *sfdo = znew(*sfdo);
 
 	struct sfdo_basedir_ctx *basedir_ctx = sfdo_basedir_ctx_create();
 	if (!basedir_ctx) {
@@ -82,11 +291,6 @@ desktop_entry_init(struct server *server)
 	sfdo_icon_ctx_set_log_handler(
 		sfdo->icon_ctx, level, log_handler, "sfdo-icon");
 
-	char *locale = NULL;
-#if HAVE_NLS
-	locale = setlocale(LC_ALL, "");
-#endif
-
 	sfdo->desktop_db = sfdo_desktop_db_load(sfdo->desktop_ctx, locale);
 	if (!sfdo->desktop_db) {
 		goto err_desktop_db;
@@ -108,7 +312,7 @@ desktop_entry_init(struct server *server)
 
 	sfdo->icon_theme = sfdo_icon_theme_load(
 		sfdo->icon_ctx,
-		rc.icon_theme_name, load_options);
+		icon_theme_name, load_options);
 	if (!sfdo->icon_theme) {
 		/*
 		 * sfdo_icon_theme_load() falls back to hicolor theme with
@@ -117,7 +321,7 @@ desktop_entry_init(struct server *server)
 		 * So manually call sfdo_icon_theme_load() again here.
 		 */
 		wlr_log(WLR_ERROR, "Failed to load icon theme %s, falling back to 'hicolor'",
-			rc.icon_theme_name);
+			icon_theme_name);
 
 		if (!debug_libsfdo) {
 			wlr_log(WLR_ERROR, "Further information is available by setting "
@@ -134,8 +338,8 @@ desktop_entry_init(struct server *server)
 	/* basedir_ctx is not referenced by other objects */
 	sfdo_basedir_ctx_destroy(basedir_ctx);
 
-	server->sfdo = sfdo;
-	return;
+	load_icon_paths(sfdo, icon_theme_name);
+	return sfdo;
 
 err_icon_theme:
 	sfdo_desktop_db_destroy(sfdo->desktop_db);
@@ -152,22 +356,232 @@ err_basedir_ctx:
 		wlr_log(WLR_ERROR, "Further information is available by setting "
 			"the LABWC_DEBUG_LIBSFDO=1 env var before starting labwc");
 	}
+	return NULL;
 }
 
-void
-desktop_entry_finish(struct server *server)
+static void
+sfdo_destroy(struct sfdo *sfdo)
 {
-	struct sfdo *sfdo = server->sfdo;
-	if (!sfdo) {
-		return;
-	}
-
+	save_icon_paths(sfdo);
+	g_hash_table_destroy(sfdo->icon_paths);
 	sfdo_icon_theme_destroy(sfdo->icon_theme);
 	sfdo_desktop_db_destroy(sfdo->desktop_db);
 	sfdo_icon_ctx_destroy(sfdo->icon_ctx);
 	sfdo_desktop_ctx_destroy(sfdo->desktop_ctx);
 	free(sfdo);
-	server->sfdo = NULL;
+}
+
+/*
+ * Loading the desktop entry and icon theme databases scans all
+ * applications and icon theme directories, which can take hundreds of
+ * milliseconds. So it is done on a thread and the result is published to
+ * server->sfdo when ready. Icons requested before that are rendered
+ * without libsfdo and updated once it is available.
+ */
+static struct {
+	GThread *thread;
+	int eventfd;
+	struct wl_event_source *source;
+	char *icon_theme_name;
+	char *locale;
+	struct sfdo *sfdo; /* set by the thread */
+} loader = { .eventfd = -1 };
+
+static gpointer
+loader_run(gpointer data)
+{
+	loader.sfdo = load_sfdo(loader.icon_theme_name, loader.locale);
+	uint64_t one = 1;
+	if (write(loader.eventfd, &one, sizeof(one)) != sizeof(one)) {
+		wlr_log_errno(WLR_ERROR, "cannot signal loaded icon theme");
+	}
+	return NULL;
+}
+
+/* Wait for the thread and return its result */
+static struct sfdo *
+loader_finish(void)
+{
+	g_thread_join(loader.thread);
+	loader.thread = NULL;
+	wl_event_source_remove(loader.source);
+	loader.source = NULL;
+	close(loader.eventfd);
+	loader.eventfd = -1;
+	zfree(loader.icon_theme_name);
+	zfree(loader.locale);
+
+	struct sfdo *sfdo = loader.sfdo;
+	loader.sfdo = NULL;
+	return sfdo;
+}
+
+static int
+handle_loaded(int fd, uint32_t mask, void *data)
+{
+	struct server *server = data;
+	struct sfdo *sfdo = loader_finish();
+	if (!sfdo) {
+		/* Keep the previous databases if reloading failed */
+		return 0;
+	}
+	if (server->sfdo) {
+		/* Its icon path cache was computed for the old directories */
+		server->sfdo->icon_paths_dirty = false;
+		sfdo_destroy(server->sfdo);
+	}
+	server->sfdo = sfdo;
+	wlr_log(WLR_DEBUG, "desktop entries and icon theme loaded");
+	scaled_icon_buffer_reload_all();
+	return 0;
+}
+
+static bool
+loader_start(struct server *server, const char *locale)
+{
+	assert(!loader.thread);
+	loader.eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (loader.eventfd >= 0) {
+		loader.source = wl_event_loop_add_fd(server->wl_event_loop,
+			loader.eventfd, WL_EVENT_READABLE, handle_loaded, server);
+	}
+	if (!loader.source) {
+		wlr_log(WLR_ERROR, "cannot load icon theme in the background");
+		if (loader.eventfd >= 0) {
+			close(loader.eventfd);
+			loader.eventfd = -1;
+		}
+		return false;
+	}
+
+	loader.icon_theme_name =
+		rc.icon_theme_name ? xstrdup(rc.icon_theme_name) : NULL;
+	loader.locale = locale ? xstrdup(locale) : NULL;
+	loader.thread = g_thread_new("sfdo-loader", loader_run, NULL);
+	return true;
+}
+
+/*
+ * Application and icon directories are watched with inotify so that
+ * installed applications and updated icon themes are picked up without a
+ * reconfigure. Changes usually come in bursts (package managers, flatpak),
+ * so the databases are reloaded in the background once the directories
+ * have been quiet for RELOAD_DELAY_MS.
+ */
+#define RELOAD_DELAY_MS 1000
+
+static struct {
+	int fd;
+	struct wl_event_source *source;
+	struct wl_event_source *timer;
+	char *locale;
+} watch = { .fd = -1 };
+
+static void
+add_watch(const char *dir, void *data)
+{
+	/* Most of the directories don't exist, which is fine */
+	inotify_add_watch(watch.fd, dir, IN_CREATE | IN_DELETE | IN_MOVED_FROM
+		| IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR);
+}
+
+static int
+handle_reload_timer(void *data)
+{
+	struct server *server = data;
+	if (loader.thread) {
+		/* Still loading, try again later */
+		wl_event_source_timer_update(watch.timer, RELOAD_DELAY_MS);
+		return 0;
+	}
+	wlr_log(WLR_INFO, "reloading desktop entries and icon theme");
+	loader_start(server, watch.locale);
+	return 0;
+}
+
+static int
+handle_inotify(int fd, uint32_t mask, void *data)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	while (read(fd, buf, sizeof(buf)) > 0) {
+		/* Drain the events, they are all handled the same */
+	}
+	wl_event_source_timer_update(watch.timer, RELOAD_DELAY_MS);
+	return 0;
+}
+
+static void
+watch_finish(void)
+{
+	if (watch.timer) {
+		wl_event_source_remove(watch.timer);
+		watch.timer = NULL;
+	}
+	if (watch.source) {
+		wl_event_source_remove(watch.source);
+		watch.source = NULL;
+	}
+	if (watch.fd >= 0) {
+		close(watch.fd);
+		watch.fd = -1;
+	}
+	zfree(watch.locale);
+}
+
+static void
+watch_init(struct server *server, const char *locale)
+{
+	watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch.fd < 0) {
+		wlr_log_errno(WLR_INFO, "cannot watch icon directories");
+		return;
+	}
+	watch.source = wl_event_loop_add_fd(server->wl_event_loop, watch.fd,
+		WL_EVENT_READABLE, handle_inotify, server);
+	watch.timer = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_reload_timer, server);
+	if (!watch.source || !watch.timer) {
+		wlr_log(WLR_INFO, "cannot watch icon directories");
+		watch_finish();
+		return;
+	}
+	watch.locale = locale ? xstrdup(locale) : NULL;
+	for_each_data_dir(rc.icon_theme_name, add_watch, NULL);
+}
+
+void
+desktop_entry_init(struct server *server)
+{
+	debug_libsfdo = getenv("LABWC_DEBUG_LIBSFDO");
+
+	char *locale = NULL;
+#if HAVE_NLS
+	locale = setlocale(LC_ALL, "");
+#endif
+
+	if (!loader_start(server, locale)) {
+		server->sfdo = load_sfdo(rc.icon_theme_name, locale);
+	}
+	watch_init(server, locale);
+}
+
+void
+desktop_entry_finish(struct server *server)
+{
+	watch_finish();
+	if (loader.thread) {
+		/* Still loading, so wait for it and discard the result */
+		struct sfdo *sfdo = loader_finish();
+		if (sfdo) {
+			sfdo_destroy(sfdo);
+		}
+	}
+
+	if (server->sfdo) {
+		sfdo_destroy(server->sfdo);
+		server->sfdo = NULL;
+	}
 }
 
 struct icon_ctx {
@@ -347,42 +761,100 @@ convert_img_type(enum sfdo_icon_file_format fmt)
 	}
 }
 
-struct lab_img *
-desktop_entry_load_icon(struct server *server, const char *icon_name, int size, float scale)
+/*
+ * libsfdo doesn't support loading icons for fractional scales,
+ * so round down and increase the icon size to compensate.
+ */
+static void
+get_lookup_size(int size, float scale, int *lookup_size, int *lookup_scale)
+{
+	*lookup_scale = MAX((int)scale, 1);
+	*lookup_size = lroundf(size * scale / *lookup_scale);
+}
+
+/*
+ * Return 0 on success and -1 on error
+ * The calling function is responsible for free()ing ctx->path
+ */
+static int
+resolve_icon(struct sfdo *sfdo, const char *icon_name, int lookup_size,
+		int lookup_scale, struct icon_ctx *ctx)
+{
+	int ret;
+	if (icon_name[0] == '/') {
+		ret = process_abs_name(ctx, icon_name);
+	} else {
+		ret = process_rel_name(ctx, icon_name, sfdo, lookup_size, lookup_scale);
+	}
+	if (ret < 0) {
+		wlr_log(WLR_INFO, "failed to load icon file %s", icon_name);
+	}
+	return ret;
+}
+
+bool
+desktop_entry_find_icon(struct server *server, const char *icon_name,
+		int size, float scale, char **path, enum lab_img_type *type)
 {
 	/* static analyzer isn't able to detect the NULL check in string_null_or_empty() */
 	if (string_null_or_empty(icon_name) || !icon_name) {
-		return NULL;
+		return false;
 	}
 
 	struct sfdo *sfdo = server->sfdo;
 	if (!sfdo) {
-		return NULL;
+		return false;
 	}
 
-	/*
-	 * libsfdo doesn't support loading icons for fractional scales,
-	 * so round down and increase the icon size to compensate.
-	 */
-	int lookup_scale = MAX((int)scale, 1);
-	int lookup_size = lroundf(size * scale / lookup_scale);
+	int lookup_size, lookup_scale;
+	get_lookup_size(size, scale, &lookup_size, &lookup_scale);
 
 	struct icon_ctx ctx = {0};
-	int ret;
-	if (icon_name[0] == '/') {
-		ret = process_abs_name(&ctx, icon_name);
-	} else {
-		ret = process_rel_name(&ctx, icon_name, sfdo, lookup_size, lookup_scale);
+	if (resolve_icon(sfdo, icon_name, lookup_size, lookup_scale, &ctx) < 0) {
+		return false;
 	}
-	if (ret < 0) {
-		wlr_log(WLR_INFO, "failed to load icon file %s", icon_name);
+	*path = ctx.path;
+	*type = convert_img_type(ctx.format);
+	return true;
+}
+
+struct lab_img *
+desktop_entry_load_icon(struct server *server, const char *icon_name, int size, float scale)
+{
+	char *path;
+	enum lab_img_type type;
+	if (!desktop_entry_find_icon(server, icon_name, size, scale, &path, &type)) {
 		return NULL;
 	}
 
-	wlr_log(WLR_DEBUG, "loading icon file %s", ctx.path);
-	struct lab_img *img = lab_img_load(convert_img_type(ctx.format), ctx.path, NULL);
+	wlr_log(WLR_DEBUG, "loading icon file %s", path);
+	struct lab_img *img = lab_img_load(type, path, NULL);
+
+	free(path);
+	return img;
+}
 
-	free(ctx.path);
+/* Resolve and load @icon_name, remembering the file in @icon_path */
+static struct lab_img *
+load_icon_remember_path(struct sfdo *sfdo, const char *icon_name,
+		int lookup_size, int lookup_scale, struct icon_path *icon_path)
+{
+	if (string_null_or_empty(icon_name) || !icon_name) {
+		return NULL;
+	}
+	struct icon_ctx ctx = {0};
+	if (resolve_icon(sfdo, icon_name, lookup_size, lookup_scale, &ctx) < 0) {
+		return NULL;
+	}
+	wlr_log(WLR_DEBUG, "loading icon file %s", ctx.path);
+	struct lab_img *img =
+		lab_img_load(convert_img_type(ctx.format), ctx.path, NULL);
+	if (img) {
+		icon_path->path = ctx.path;
+		icon_path->format = ctx.format;
+	} else {
+		free(ctx.path);
+	}
 	return img;
 }
 
@@ -399,20 +871,133 @@ desktop_entry_load_icon_from_app_id(struct server *server,
 		return NULL;
 	}
 
+	int lookup_size, lookup_scale;
+	get_lookup_size(size, scale, &lookup_size, &lookup_scale);
+	char *key = strdup_printf("%s\t%d\t%d", app_id, lookup_size,
+		lookup_scale);
+
+	struct icon_path *icon_path = g_hash_table_lookup(sfdo->icon_paths, key);
+	if (icon_path) {
+		struct lab_img *img = NULL;
+		if (icon_path->path) {
+			img = lab_img_load(convert_img_type(icon_path->format),
+				icon_path->path, NULL);
+		}
+		if (img || !icon_path->path) {
+			free(key);
+			return img;
+		}
+		/* The file has gone, so look it up again */
+		g_hash_table_remove(sfdo->icon_paths, key);
+	}
+
 	const char *icon_name = NULL;
 	struct sfdo_desktop_entry *entry = get_desktop_entry(sfdo, app_id);
 	if (entry) {
 		icon_name = sfdo_desktop_entry_get_icon(entry, NULL);
 	}
 
-	struct lab_img *img = desktop_entry_load_icon(server, icon_name, size, scale);
+	icon_path = znew(*icon_path);
+	struct lab_img *img = load_icon_remember_path(sfdo, icon_name,
+		lookup_size, lookup_scale, icon_path);
 	if (!img) {
 		/* Icon not defined in .desktop file or could not be loaded */
-		img = desktop_entry_load_icon(server, app_id, size, scale);
+		img = load_icon_remember_path(sfdo, app_id, lookup_size,
+			lookup_scale, icon_path);
+	}
+
+	/* Tabs and newlines would break the cache file */
+	if (strpbrk(app_id, "\t\n")) {
+		icon_path_destroy(icon_path);
+		free(key);
+	} else {
+		g_hash_table_insert(sfdo->icon_paths, key, icon_path);
+		sfdo->icon_paths_dirty = true;
 	}
 	return img;
 }
 
+/* Resolve @icon_name, remembering the file in @icon_path */
+static bool
+find_icon_remember_path(struct sfdo *sfdo, const char *icon_name,
+		int lookup_size, int lookup_scale, struct icon_path *icon_path)
+{
+	if (string_null_or_empty(icon_name) || !icon_name) {
+		return false;
+	}
+	struct icon_ctx ctx = {0};
+	if (resolve_icon(sfdo, icon_name, lookup_size, lookup_scale, &ctx) < 0) {
+		return false;
+	}
+	icon_path->path = ctx.path;
+	icon_path->format = ctx.format;
+	return true;
+}
+
+bool
+desktop_entry_find_icon_from_app_id(struct server *server, const char *app_id,
+		int size, float scale, char **path, enum lab_img_type *type)
+{
+	if (string_null_or_empty(app_id)) {
+		return false;
+	}
+
+	struct sfdo *sfdo = server->sfdo;
+	if (!sfdo) {
+		return false;
+	}
+
+	int lookup_size, lookup_scale;
+	get_lookup_size(size, scale, &lookup_size, &lookup_scale);
+	char *key = strdup_printf("%s\t%d\t%d", app_id, lookup_size,
+		lookup_scale);
+
+	struct icon_path *icon_path = g_hash_table_lookup(sfdo->icon_paths, key);
+	if (icon_path && (!icon_path->path || !access(icon_path->path, R_OK))) {
+		free(key);
+		goto out;
+	}
+	if (icon_path) {
+		/* The file has gone, so look it up again */
+		g_hash_table_remove(sfdo->icon_paths, key);
+	}
+
+	const char *icon_name = NULL;
+	struct sfdo_desktop_entry *entry = get_desktop_entry(sfdo, app_id);
+	if (entry) {
+		icon_name = sfdo_desktop_entry_get_icon(entry, NULL);
+	}
+
+	icon_path = znew(*icon_path);
+	if (!find_icon_remember_path(sfdo, icon_name, lookup_size,
+			lookup_scale, icon_path)) {
+		/* Icon not defined in .desktop file or not found */
+		find_icon_remember_path(sfdo, app_id, lookup_size,
+			lookup_scale, icon_path);
+	}
+
+	/* Tabs and newlines would break the cache file */
+	if (strpbrk(app_id, "\t\n")) {
+		bool found = icon_path->path;
+		if (found) {
+			*path = icon_path->path;
+			*type = convert_img_type(icon_path->format);
+		}
+		free(icon_path);
+		free(key);
+		return found;
+	}
+	g_hash_table_insert(sfdo->icon_paths, key, icon_path);
+	sfdo->icon_paths_dirty = true;
+out:
+	if (!icon_path->path) {
+		return false;
+	}
+	*path = xstrdup(icon_path->path);
+	*type = convert_img_type(icon_path->format);
+	return true;
+}
+
 const char *
 desktop_entry_name_lookup(struct server *server, const char *app_id)
 {
@@ -9,15 +9,20 @@
 #include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include "common/list.h"
+#include "common/macros.h"
 #include "common/mem.h"
 #include "common/scene-helpers.h"
 #include "config/rcxml.h"
 #include "dnd.h"
 #include "labwc.h"
 #include "layers.h"
+#include "layout-transaction.h"
 #include "node.h"
 #include "output.h"
 #include "ssd.h"
+#include "tiling.h"
+#include "timer.h"
+#include "trace.h"
 #include "view.h"
 #include "window-rules.h"
 #include "workspaces.h"
@@ -29,6 +34,11 @@
 void
 desktop_arrange_all_views(struct server *server)
 {
+	if (server->arrange_all_views_timer) {
+		lab_timer_destroy(server->arrange_all_views_timer);
+		server->arrange_all_views_timer = NULL;
+	}
+
 	/*
 	 * Adjust window positions/sizes. Skip views with no size since
 	 * we can't do anything useful with them; they will presumably
@@ -39,12 +49,44 @@ desktop_arrange_all_views(struct server *server)
 	 * still unmapped. We do want to adjust the geometry of those
 	 * views.
 	 */
+	server->arranging_views = true;
 	struct view *view;
 	wl_list_for_each(view, &server->views, link) {
 		if (!wlr_box_empty(&view->pending)) {
 			view_adjust_for_layout_change(view);
 		}
 	}
+	server->arranging_views = false;
+
+	/*
+	 * The outputs of the views, and the top layers depending on them,
+	 * are updated once for all views rather than after each move.
+	 */
+	view_update_all_outputs(server);
+	if (server->top_layer_visibility_pending) {
+		desktop_update_top_layer_visibility(server);
+	}
+	desktop_schedule_arrange_tiled(server);
+}
+
+static int
+handle_arrange_all_views_timer(void *data)
+{
+	struct server *server = data;
+	desktop_arrange_all_views(server);
+	return 0;
+}
+
+void
+desktop_schedule_arrange_all_views(struct server *server)
+{
+	if (!server->arrange_all_views_timer) {
+		server->arrange_all_views_timer = lab_timer_create(
+			handle_arrange_all_views_timer, server,
+			/*slack_ms*/ 100);
+	}
+	lab_timer_update(server->arrange_all_views_timer,
+		LAYOUT_CHANGE_SETTLE_MS);
 }
 
 static void
@@ -139,10 +181,25 @@ desktop_focus_view_or_surface(struct seat *seat, struct view *view,
 static struct view *
 desktop_topmost_focusable_view(struct server *server)
 {
+	struct workspace *workspace = server->workspaces.current;
 	struct view *view;
+
+	/*
+	 * Unmapped and minimized views have already been removed from the
+	 * focus order, so this normally returns the first entry.
+	 */
+	wl_list_for_each(view, &workspace->focus_views, focus_link) {
+		/* Always-on-top and always-on-bottom views are skipped */
+		if (view->scene_tree->node.parent == workspace->tree
+				&& view_is_focusable(view)) {
+			return view;
+		}
+	}
+
+	/* Views which have never been focused, from the top */
 	struct wl_list *node_list;
 	struct wlr_scene_node *node;
-	node_list = &server->workspaces.current->tree->children;
+	node_list = &workspace->tree->children;
 	wl_list_for_each_reverse(node, node_list, link) {
 		if (!node->data) {
 			/* We found some non-view, most likely the region overlay */
@@ -214,16 +271,32 @@ desktop_focus_output(struct output *output)
 void
 desktop_update_top_layer_visibility(struct server *server)
 {
+	if (server->arranging_views) {
+		server->top_layer_visibility_pending = true;
+		return;
+	}
+	server->top_layer_visibility_pending = false;
+
 	struct view *view;
 	struct output *output;
 	uint32_t top = ZWLR_LAYER_SHELL_V1_LAYER_TOP;
 
-	/* Enable all top layers */
+	/*
+	 * Enable all top layers. Only outputs with fullscreen views need
+	 * the views to be walked, which is usually none of them.
+	 */
+	uint64_t fullscreen_outputs = 0;
 	wl_list_for_each(output, &server->outputs, link) {
 		if (!output_is_usable(output)) {
 			continue;
 		}
 		wlr_scene_node_set_enabled(&output->layer_tree[top]->node, true);
+		if (output->nr_fullscreen_views) {
+			fullscreen_outputs |= output->id_bit;
+		}
+	}
+	if (!fullscreen_outputs) {
+		return;
 	}
 
 	/*
@@ -243,6 +316,10 @@ desktop_update_top_layer_visibility(struct server *server)
 				&view->output->layer_tree[top]->node, false);
 		}
 		outputs_covered |= view->outputs;
+		if ((outputs_covered & fullscreen_outputs) == fullscreen_outputs) {
+			/* No fullscreen view below can be uncovered */
+			break;
+		}
 	}
 }
 
@@ -280,24 +357,18 @@ avoid_edge_rounding_issues(struct cursor_context *ctx)
 }
 
 /* TODO: make this less big and scary */
-struct cursor_context
-get_cursor_context(struct server *server)
+static struct cursor_context
+find_cursor_context(struct server *server)
 {
 	struct cursor_context ret = {.type = LAB_NODE_NONE};
 	struct wlr_cursor *cursor = server->seat.cursor;
 
-	/* Prevent drag icons to be on top of the hitbox detection */
-	if (server->seat.drag.active) {
-		dnd_icons_show(&server->seat, false);
-	}
-
-	struct wlr_scene_node *node =
-		wlr_scene_node_at(&server->scene->tree.node,
-			cursor->x, cursor->y, &ret.sx, &ret.sy);
-
-	if (server->seat.drag.active) {
-		dnd_icons_show(&server->seat, true);
-	}
+	/*
+	 * Drag icons are skipped by the index, so they do not need to be
+	 * hidden to prevent being on top of the hitbox detection.
+	 */
+	struct wlr_scene_node *node = scene_index_node_at(server,
+		cursor->x, cursor->y, &ret.sx, &ret.sy);
 
 	if (!node) {
 		ret.type = LAB_NODE_ROOT;
@@ -404,103 +475,203 @@ get_cursor_context(struct server *server)
 	return ret;
 }
 
-/**
- * desktop_arrange_tiled() - Arrange all windows on the current workspace
- * in a tiled layout, similar to Sway's automatic tiling.
- *
- * Windows are arranged in a grid-like layout, with each window getting
- * an equal share of the screen space.
- */
+struct cursor_context
+get_cursor_context(struct server *server)
+{
+	trace_begin("get_cursor_context");
+	struct cursor_context ctx = find_cursor_context(server);
+	trace_end("get_cursor_context");
+	return ctx;
+}
+
+static bool
+reuse_cursor_context(struct server *server, struct cursor_context_saved *saved_ctx,
+		struct cursor_context *ctx)
+{
+	struct wlr_cursor *cursor = server->seat.cursor;
+	struct wlr_scene_node *node = saved_ctx->ctx.node;
+
+	/*
+	 * Only client surfaces of views are reused. For SSD parts and
+	 * menus, the context depends on the exact cursor position.
+	 */
+	if (saved_ctx->ctx.type != LAB_NODE_CLIENT || !saved_ctx->ctx.view
+			|| !saved_ctx->ctx.surface || !node
+			|| node->type != WLR_SCENE_NODE_BUFFER) {
+		return false;
+	}
+	if (saved_ctx->scene_generation != scene_index_get_generation(server)) {
+		return false;
+	}
+
+	int lx, ly;
+	if (!wlr_scene_node_coords(node, &lx, &ly)) {
+		return false;
+	}
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	struct wlr_box box = {
+		.x = lx,
+		.y = ly,
+		.width = buffer->dst_width,
+		.height = buffer->dst_height,
+	};
+	if (!wlr_box_contains_point(&box, cursor->x, cursor->y)) {
+		return false;
+	}
+
+	double sx = cursor->x - lx;
+	double sy = cursor->y - ly;
+	if (buffer->point_accepts_input
+			&& !buffer->point_accepts_input(buffer, &sx, &sy)) {
+		return false;
+	}
+	if (!scene_index_node_exposed_at(server, node, cursor->x, cursor->y)) {
+		return false;
+	}
+
+	*ctx = saved_ctx->ctx;
+	ctx->sx = sx;
+	ctx->sy = sy;
+	avoid_edge_rounding_issues(ctx);
+	return true;
+}
+
+struct cursor_context
+get_cursor_context_cached(struct server *server,
+		struct cursor_context_saved *saved_ctx)
+{
+	struct cursor_context ctx;
+	if (reuse_cursor_context(server, saved_ctx, &ctx)) {
+		return ctx;
+	}
+	ctx = get_cursor_context(server);
+	cursor_context_save(saved_ctx, &ctx);
+	saved_ctx->scene_generation = server->scene_index.generation;
+	return ctx;
+}
+
+static void
+handle_arrange_tiled_idle(void *data)
+{
+	struct server *server = data;
+	server->tiling_arrange_idle = NULL;
+	desktop_arrange_tiled(server);
+}
+
 void
-desktop_arrange_tiled(struct server *server)
+desktop_schedule_arrange_tiled(struct server *server)
 {
-	if (!server->tiling_mode) {
+	if (!server->tiling_mode || server->tiling_arrange_idle) {
 		return;
 	}
+	server->tiling_arrange_idle = wl_event_loop_add_idle(
+		server->wl_event_loop, handle_arrange_tiled_idle, server);
+}
+
+/* Views on the current workspace taking part in tiling, per output */
+struct tiling_bucket {
+	struct output *output;
+	struct wl_array views; /* struct view *, in stacking order */
+	bool prefer_vertical;
+	bool prefer_horizontal;
+};
+
+/*
+ * Sort the tiling candidates into one bucket per output with a single
+ * walk of server->views, so that the window rules of each view are only
+ * evaluated once per arrangement. Returns the number of bucketed views.
+ */
+static int
+tiling_buckets_build(struct server *server, struct tiling_bucket **buckets,
+		int *nr_buckets)
+{
+	*nr_buckets = wl_list_length(&server->outputs);
+	*buckets = znew_n(**buckets, MAX(*nr_buckets, 1));
+
+	int i = 0;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		(*buckets)[i].output = output;
+		wl_array_init(&(*buckets)[i].views);
+		i++;
+	}
 
-	/* Count tiled views on current workspace */
 	int count = 0;
 	struct view *view;
 	for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-		/* Skip views that shouldn't be tiled */
-		if (view->minimized || view->fullscreen ||
-		    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-			continue;
-		}
-		/* Skip views with fixed position */
-		if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
+		if (!view->output || !view_is_tiling_candidate(view)) {
 			continue;
 		}
-		/* Skip views that explicitly opt out of tiling */
-		enum property tile_prop = window_rules_get_property(view, "tile");
-		if (tile_prop == LAB_PROP_FALSE) {
-			continue;
+		for (i = 0; i < *nr_buckets; i++) {
+			struct tiling_bucket *bucket = &(*buckets)[i];
+			if (bucket->output != view->output) {
+				continue;
+			}
+			struct view **slot = wl_array_add(&bucket->views, sizeof(*slot));
+			if (!slot) {
+				wlr_log(WLR_ERROR, "wl_array_add(): out of memory");
+				break;
+			}
+			*slot = view;
+			count++;
+
+			enum property tile_dir =
+				window_rules_get_property(view, WINDOW_RULE_PROP_TILE_DIRECTION);
+			if (tile_dir == LAB_PROP_TRUE) {
+				bucket->prefer_vertical = true;
+			} else if (tile_dir == LAB_PROP_FALSE) {
+				bucket->prefer_horizontal = true;
+			}
+			break;
 		}
-		count++;
 	}
+	return count;
+}
 
+static void
+tiling_buckets_destroy(struct tiling_bucket *buckets, int nr_buckets)
+{
+	for (int i = 0; i < nr_buckets; i++) {
+		wl_array_release(&buckets[i].views);
+	}
+	free(buckets);
+}
+
+/**
+ * arrange_tiled() - Arrange all windows on the current workspace
+ * in a tiled layout, similar to Sway's automatic tiling.
+ *
+ * Windows are arranged in a grid-like layout, with each window getting
+ * an equal share of the screen space.
+ */
+static void
+arrange_tiled(struct server *server)
+{
+
+	struct tiling_bucket *buckets;
+	int nr_buckets;
+	int count = tiling_buckets_build(server, &buckets, &nr_buckets);
 	if (count == 0) {
+		tiling_buckets_destroy(buckets, nr_buckets);
 		return;
 	}
 
-	/* Group views by output */
-	struct output *output;
-	wl_list_for_each(output, &server->outputs, link) {
+	struct view *view;
+	for (int b = 0; b < nr_buckets; b++) {
+		struct tiling_bucket *bucket = &buckets[b];
+		struct output *output = bucket->output;
 		if (!output_is_usable(output)) {
 			continue;
 		}
 
-		/* Count views on this output */
-		int output_count = 0;
-		for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-			if (view->minimized || view->fullscreen ||
-			    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-				continue;
-			}
-			if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-				continue;
-			}
-			/* Skip views that explicitly opt out of tiling */
-			enum property tile_prop = window_rules_get_property(view, "tile");
-			if (tile_prop == LAB_PROP_FALSE) {
-				continue;
-			}
-			if (view->output == output) {
-				output_count++;
-			}
-		}
-
+		int output_count = bucket->views.size / sizeof(struct view *);
 		if (output_count == 0) {
 			continue;
 		}
 
 		struct wlr_box usable = output_usable_area_in_layout_coords(output);
-
-		/* Check if any window has a preferred tile direction */
-		bool prefer_vertical = false;
-		bool prefer_horizontal = false;
-		for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-			if (view->minimized || view->fullscreen ||
-			    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-				continue;
-			}
-			if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-				continue;
-			}
-			enum property tile_prop = window_rules_get_property(view, "tile");
-			if (tile_prop == LAB_PROP_FALSE) {
-				continue;
-			}
-			if (view->output != output) {
-				continue;
-			}
-			enum property tile_dir = window_rules_get_property(view, "tileDirection");
-			if (tile_dir == LAB_PROP_TRUE) {
-				prefer_vertical = true;
-			} else if (tile_dir == LAB_PROP_FALSE) {
-				prefer_horizontal = true;
-			}
-		}
+		bool prefer_vertical = bucket->prefer_vertical;
+		bool prefer_horizontal = bucket->prefer_horizontal;
 
 		/* Calculate optimal layout - choose between horizontal and vertical splitting */
 		bool use_vertical_split = false;
@@ -706,19 +877,10 @@ desktop_arrange_tiled(struct server *server)
 
 			/* Find windows that are adjacent to the resized window */
 			/* A window is adjacent if it shares an edge or overlaps with the resized window's area */
-			for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-				if (view == resized_view || view->minimized || view->fullscreen ||
-				    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-					continue;
-				}
-				if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-					continue;
-				}
-				enum property tile_prop = window_rules_get_property(view, "tile");
-				if (tile_prop == LAB_PROP_FALSE) {
-					continue;
-				}
-				if (view->output != output) {
+			struct view **viewp;
+			wl_array_for_each(viewp, &bucket->views) {
+				view = *viewp;
+				if (view == resized_view) {
 					continue;
 				}
 
@@ -904,22 +1066,9 @@ desktop_arrange_tiled(struct server *server)
 
 		/* Tile views */
 		int idx = 0;
-		for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-			if (view->minimized || view->fullscreen ||
-			    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-				continue;
-			}
-			if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-				continue;
-			}
-			/* Skip views that explicitly opt out of tiling */
-			enum property tile_prop = window_rules_get_property(view, "tile");
-			if (tile_prop == LAB_PROP_FALSE) {
-				continue;
-			}
-			if (view->output != output) {
-				continue;
-			}
+		struct view **viewp;
+		wl_array_for_each(viewp, &bucket->views) {
+			view = *viewp;
 
 			/* If we have a resized view with adjacent windows, only process adjacent ones */
 			if (resized_view && !wl_list_empty(&adjacent_views)) {
@@ -963,20 +1112,10 @@ desktop_arrange_tiled(struct server *server)
 				/* Check for overlaps with other windows and adjust if necessary */
 				bool needs_adjustment = false;
 				struct view *other_view;
-				for_each_view(other_view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-					if (other_view == resized_view || other_view->minimized ||
-					    other_view->fullscreen || view_is_always_on_top(other_view) ||
-					    view_is_always_on_bottom(other_view)) {
-						continue;
-					}
-					if (window_rules_get_property(other_view, "fixedPosition") == LAB_PROP_TRUE) {
-						continue;
-					}
-					enum property other_tile_prop = window_rules_get_property(other_view, "tile");
-					if (other_tile_prop == LAB_PROP_FALSE) {
-						continue;
-					}
-					if (other_view->output != output) {
+				struct view **other_viewp;
+				wl_array_for_each(other_viewp, &bucket->views) {
+					other_view = *other_viewp;
+					if (other_view == resized_view) {
 						continue;
 					}
 
@@ -1229,7 +1368,9 @@ desktop_arrange_tiled(struct server *server)
 		for (int iteration = 0; iteration < max_iterations; iteration++) {
 			bool space_filled = true;
 			
-			wl_list_for_each(output, &server->outputs, link) {
+			for (int b = 0; b < nr_buckets; b++) {
+				struct tiling_bucket *bucket = &buckets[b];
+				struct output *output = bucket->output;
 				if (!output_is_usable(output)) {
 					continue;
 				}
@@ -1241,18 +1382,9 @@ desktop_arrange_tiled(struct server *server)
 				struct wlr_box occupied = {0};
 				bool has_occupied = false;
 				
-				for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-					if (view->minimized || view->fullscreen ||
-					    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-						continue;
-					}
-					if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-						continue;
-					}
-					enum property tile_prop = window_rules_get_property(view, "tile");
-					if (tile_prop == LAB_PROP_FALSE) {
-						continue;
-					}
+				struct view **viewp;
+				wl_array_for_each(viewp, &bucket->views) {
+					view = *viewp;
 					if (view->output != output) {
 						continue;
 					}
@@ -1312,18 +1444,9 @@ desktop_arrange_tiled(struct server *server)
 					/* Expand multiple windows in one iteration for efficiency */
 					int windows_expanded = 0;
 					
-					for_each_view(view, &server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-						if (view->minimized || view->fullscreen ||
-						    view_is_always_on_top(view) || view_is_always_on_bottom(view)) {
-							continue;
-						}
-						if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE) {
-							continue;
-						}
-						enum property tile_prop = window_rules_get_property(view, "tile");
-						if (tile_prop == LAB_PROP_FALSE) {
-							continue;
-						}
+					struct view **expand_viewp;
+					wl_array_for_each(expand_viewp, &bucket->views) {
+						view = *expand_viewp;
 						if (view->output != output) {
 							continue;
 						}
@@ -1440,5 +1563,24 @@ desktop_arrange_tiled(struct server *server)
 			}
 		}
 	}
+
+	tiling_buckets_destroy(buckets, nr_buckets);
+}
+
+void
+desktop_arrange_tiled(struct server *server)
+{
+	if (!server->tiling_mode) {
+		return;
+	}
+	trace_begin("desktop_arrange_tiled");
+	layout_transaction_begin(server);
+	if (server->tiling_layout == LAB_TILING_LAYOUT_GRID) {
+		arrange_tiled(server);
+	} else {
+		tiling_arrange(server);
+	}
+	layout_transaction_commit(server);
+	trace_end("desktop_arrange_tiled");
 }
 
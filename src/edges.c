@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <limits.h>
 #include <pixman.h>
+#include <stdlib.h>
+#include <wayland-util.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/box.h>
@@ -261,9 +263,13 @@ compute_edges_visible(const struct wlr_box *view_size,
 	return edges_visible;
 }
 
-/* Test if parts of the current view is covered by the remaining space in the region */
+/*
+ * Test if parts of the current view is covered by the remaining space in the
+ * region of @output and record the visible edges in @output->visible_views
+ */
 static void
-subtract_view_from_space(struct view *view, pixman_region32_t *available)
+subtract_view_from_space(struct view *view, pixman_region32_t *available,
+		struct output *output)
 {
 	struct wlr_box view_size = ssd_max_extents(view);
 	pixman_box32_t view_rect = {
@@ -273,22 +279,29 @@ subtract_view_from_space(struct view *view, pixman_region32_t *available)
 		.y2 = view_size.y + view_size.height
 	};
 
+	enum lab_edge edges_visible = LAB_EDGE_NONE;
 	pixman_region_overlap_t overlap =
 		pixman_region32_contains_rectangle(available, &view_rect);
 
 	switch (overlap) {
 	case PIXMAN_REGION_IN:
-		view->edges_visible = LAB_EDGES_ALL;
+		edges_visible = LAB_EDGES_ALL;
 		break;
 	case PIXMAN_REGION_OUT:
-		view->edges_visible = LAB_EDGE_NONE;
 		return;
 	case PIXMAN_REGION_PART:
-		view->edges_visible = compute_edges_visible(
+		edges_visible = compute_edges_visible(
 			&view_size, &view_rect, available);
 		break;
 	}
 
+	struct visible_view *entry =
+		wl_array_add(&output->visible_views, sizeof(*entry));
+	if (entry) {
+		entry->view = view;
+		entry->edges_visible = edges_visible;
+	}
+
 	/* Subtract the view geometry from the available region for the next check */
 	pixman_region32_t view_region;
 	pixman_region32_init_rects(&view_region, &view_rect, 1);
@@ -298,12 +311,16 @@ subtract_view_from_space(struct view *view, pixman_region32_t *available)
 
 static void
 subtract_node_tree(struct wlr_scene_tree *tree, pixman_region32_t *available,
-		struct view *ignored_view)
+		struct output *output, struct view *ignored_view)
 {
 	struct view *view;
 	struct wlr_scene_node *node;
 	struct node_descriptor *node_desc;
 	wl_list_for_each_reverse(node, &tree->children, link) {
+		if (!pixman_region32_not_empty(available)) {
+			/* Everything below is covered */
+			return;
+		}
 		if (!node->enabled) {
 			/*
 			 * This skips everything that is not being
@@ -318,54 +335,146 @@ subtract_node_tree(struct wlr_scene_tree *tree, pixman_region32_t *available,
 		if (node_desc && node_desc->type == LAB_NODE_VIEW) {
 			view = node_view_from_node(node);
 			if (view != ignored_view) {
-				subtract_view_from_space(view, available);
+				subtract_view_from_space(view, available, output);
 			}
 		} else if (node->type == WLR_SCENE_NODE_TREE) {
 			subtract_node_tree(wlr_scene_tree_from_node(node),
-				available, ignored_view);
+				available, output, ignored_view);
 		}
 	}
 }
 
+/* The view left out by the last edges_calculate_visibility() */
+static struct view *visibility_ignored_view;
+
+static bool
+output_has_visible_view(struct output *output, struct view *view)
+{
+	struct visible_view *entry;
+	wl_array_for_each(entry, &output->visible_views) {
+		if (entry->view == view) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Mark the outputs on which @view was visible at the last computation or
+ * which it overlaps now. A view which was completely covered everywhere
+ * did not hide anything below it, so its old position does not matter.
+ */
+static void
+invalidate_view_outputs(struct server *server, struct view *view)
+{
+	struct wlr_box extents = ssd_max_extents(view);
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->visibility_dirty) {
+			continue;
+		}
+		struct wlr_box layout_box;
+		wlr_output_layout_get_box(server->output_layout,
+			output->wlr_output, &layout_box);
+		if (box_intersects(&extents, &layout_box)
+				|| output_has_visible_view(output, view)) {
+			output->visibility_dirty = true;
+		}
+	}
+}
+
+void
+edges_visibility_invalidate(struct server *server, struct view *view)
+{
+	edges_index_invalidate();
+	if (!view) {
+		struct output *output;
+		wl_list_for_each(output, &server->outputs, link) {
+			output->visibility_dirty = true;
+		}
+		return;
+	}
+	invalidate_view_outputs(server, view);
+	if (view == visibility_ignored_view) {
+		/*
+		 * The outputs it was left out on have just been marked,
+		 * and forgetting it keeps a destroyed view from being
+		 * dereferenced later.
+		 */
+		visibility_ignored_view = NULL;
+	}
+}
+
 void
 edges_calculate_visibility(struct server *server, struct view *ignored_view)
 {
 	/*
-	 * The region stores the available output layout space
-	 * and subtracts the window geometries in reverse rendering
-	 * order, e.g. a window rendered on top is subtracted first.
+	 * Each output keeps the views visible on it from the last call.
+	 * Only outputs marked by edges_visibility_invalidate() since then
+	 * are computed again, and changing the ignored view only affects
+	 * the outputs which it and the previously ignored view overlap.
+	 */
+	if (ignored_view != visibility_ignored_view) {
+		if (visibility_ignored_view) {
+			invalidate_view_outputs(server, visibility_ignored_view);
+		}
+		if (ignored_view) {
+			invalidate_view_outputs(server, ignored_view);
+		}
+		visibility_ignored_view = ignored_view;
+	}
+
+	/*
+	 * For each output, the region stores the available space and
+	 * subtracts the window geometries in reverse rendering order,
+	 * e.g. a window rendered on top is subtracted first.
 	 *
 	 * This allows to detect if a window is actually visible.
 	 * If there is no overlap of its geometry and the remaining
 	 * region it must be completely covered by other windows.
 	 *
+	 * Working per output rather than on the union of all of them
+	 * also avoids covering invisible areas of the layout in case
+	 * the output resolutions differ.
 	 */
-	pixman_region32_t region;
-	pixman_region32_init(&region);
-
-	/*
-	 * Initialize the region with each individual output.
-	 *
-	 * If we were to use NULL for the reference output we
-	 * would get a single combined wlr_box of the whole
-	 * layout which could cover actual invisible areas
-	 * in case the output resolutions differ.
-	 */
+	bool changed = false;
 	struct output *output;
-	struct wlr_box layout_box;
 	wl_list_for_each(output, &server->outputs, link) {
+		if (!output->visibility_dirty) {
+			continue;
+		}
+		output->visibility_dirty = false;
+		output->visible_views.size = 0;
+		changed = true;
 		if (!output_is_usable(output)) {
 			continue;
 		}
+
+		struct wlr_box layout_box;
 		wlr_output_layout_get_box(server->output_layout,
 			output->wlr_output, &layout_box);
-		pixman_region32_union_rect(&region, &region,
-			layout_box.x, layout_box.y, layout_box.width, layout_box.height);
+		pixman_region32_t region;
+		pixman_region32_init_rect(&region, layout_box.x, layout_box.y,
+			layout_box.width, layout_box.height);
+		subtract_node_tree(&server->scene->tree, &region, output,
+			ignored_view);
+		pixman_region32_fini(&region);
+	}
+	if (!changed) {
+		return;
 	}
 
-	subtract_node_tree(&server->scene->tree, &region, ignored_view);
-
-	pixman_region32_fini(&region);
+	/* An edge is visible if it is visible on any output */
+	struct view *view;
+	wl_list_for_each(view, &server->views, link) {
+		view->edges_visible = LAB_EDGE_NONE;
+	}
+	wl_list_for_each(output, &server->outputs, link) {
+		struct visible_view *entry;
+		wl_array_for_each(entry, &output->visible_views) {
+			entry->view->edges_visible |= entry->edges_visible;
+		}
+	}
 }
 
 void
@@ -425,6 +534,186 @@ edges_find_neighbors(struct border *nearest_edges, struct view *view,
 	}
 }
 
+/* Visible edge of a view, sorted by offset in edge_index.edges */
+struct indexed_edge {
+	int offset;
+	struct view *view;
+	struct border region;
+	enum lab_edge edges_visible;
+};
+
+/*
+ * Edges of the views that matter to the view being moved, one array per
+ * side (left, right, top, bottom). Queries find the edges close to a
+ * motion with a binary search instead of validating every view.
+ */
+static struct {
+	bool valid;
+	struct view *view;
+	struct wl_array edges[4]; /* struct indexed_edge */
+} edge_index;
+
+static const enum lab_edge index_sides[4] = {
+	LAB_EDGE_LEFT, LAB_EDGE_RIGHT, LAB_EDGE_TOP, LAB_EDGE_BOTTOM,
+};
+
+static struct wl_array *
+index_edges(enum lab_edge side)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(index_sides); i++) {
+		if (index_sides[i] == side) {
+			return &edge_index.edges[i];
+		}
+	}
+	abort();
+}
+
+static int
+compare_indexed_edges(const void *a, const void *b)
+{
+	const struct indexed_edge *edge_a = a;
+	const struct indexed_edge *edge_b = b;
+	return (edge_a->offset > edge_b->offset)
+		- (edge_a->offset < edge_b->offset);
+}
+
+void
+edges_index_invalidate(void)
+{
+	if (!edge_index.valid) {
+		return;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(edge_index.edges); i++) {
+		wl_array_release(&edge_index.edges[i]);
+	}
+	edge_index.valid = false;
+	edge_index.view = NULL;
+}
+
+static void
+edges_index_build(struct view *view)
+{
+	edges_index_invalidate();
+	for (size_t i = 0; i < ARRAY_SIZE(edge_index.edges); i++) {
+		wl_array_init(&edge_index.edges[i]);
+	}
+
+	/* Same criteria as edges_find_neighbors() with ignore_hidden */
+	struct view *v;
+	for_each_view(v, &view->server->views, LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
+		if (v == view || v->minimized || !output_is_usable(v->output)
+				|| v->edges_visible == LAB_EDGE_NONE) {
+			continue;
+		}
+
+		struct border border = ssd_get_margin(v->ssd);
+		struct border win_edges = {
+			.top = v->current.y - border.top,
+			.right = v->current.x + v->current.width + border.right,
+			.bottom = v->current.y + border.bottom
+				+ view_effective_height(v, /* use_pending */ false),
+			.left = v->current.x - border.left,
+		};
+
+		for (size_t i = 0; i < ARRAY_SIZE(index_sides); i++) {
+			enum lab_edge side = index_sides[i];
+			if (!(v->edges_visible & side)) {
+				continue;
+			}
+			struct indexed_edge *edge =
+				wl_array_add(&edge_index.edges[i], sizeof(*edge));
+			*edge = (struct indexed_edge){
+				.offset = build_edge(win_edges, side, 0).offset,
+				.view = v,
+				.region = win_edges,
+				.edges_visible = v->edges_visible,
+			};
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(edge_index.edges); i++) {
+		struct wl_array *edges = &edge_index.edges[i];
+		qsort(edges->data, edges->size / sizeof(struct indexed_edge),
+			sizeof(struct indexed_edge), compare_indexed_edges);
+	}
+	edge_index.view = view;
+	edge_index.valid = true;
+}
+
+/* Return the first edge with an offset of at least @offset */
+static size_t
+find_first_edge(struct wl_array *edges, int offset)
+{
+	const struct indexed_edge *data = edges->data;
+	size_t l = 0;
+	size_t r = edges->size / sizeof(*data);
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (data[m].offset < offset) {
+			l = m + 1;
+		} else {
+			r = m;
+		}
+	}
+	return l;
+}
+
+void
+edges_find_neighbors_near(struct border *nearest_edges, struct view *view,
+		struct wlr_box origin, struct wlr_box target, int distance,
+		edge_validator_t validator)
+{
+	assert(view);
+	assert(validator);
+	assert(nearest_edges);
+
+	if (!output_is_usable(view->output)) {
+		wlr_log(WLR_DEBUG, "ignoring edge search for view on unusable output");
+		return;
+	}
+
+	if (!edge_index.valid || edge_index.view != view) {
+		edges_index_build(view);
+	}
+
+	struct border view_edges = { 0 };
+	struct border target_edges = { 0 };
+
+	edges_for_target_geometry(&view_edges, view, origin);
+	edges_for_target_geometry(&target_edges, view, target);
+
+	int *valid_edges[4] = {
+		&nearest_edges->left, &nearest_edges->right,
+		&nearest_edges->top, &nearest_edges->bottom,
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(index_sides); i++) {
+		enum lab_edge direction = index_sides[i];
+		int cur = build_edge(view_edges, direction, 0).offset;
+		int tgt = build_edge(target_edges, direction, 0).offset;
+
+		/* A moving edge can only meet the opposing edges of others */
+		struct wl_array *edges = index_edges(lab_edge_invert(direction));
+		const struct indexed_edge *data = edges->data;
+		size_t nr_edges = edges->size / sizeof(*data);
+		int lo = clipped_sub(MIN(cur, tgt), distance);
+		int hi = clipped_add(MAX(cur, tgt), distance);
+
+		for (size_t k = find_first_edge(edges, lo);
+				k < nr_edges && data[k].offset <= hi; k++) {
+			struct view *v = data[k].view;
+			/* Both view and v must share a common output */
+			if (view->output != v->output
+					&& !(view->outputs & v->outputs)) {
+				continue;
+			}
+			validate_single_region_edge(valid_edges[i], view_edges,
+				target_edges, data[k].region, validator,
+				direction, data[k].edges_visible);
+		}
+	}
+}
+
 void
 edges_find_outputs(struct border *nearest_edges, struct view *view,
 		struct wlr_box origin, struct wlr_box target,
@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <wlr/types/wlr_ext_foreign_toplevel_list_v1.h>
 #include "common/macros.h"
+#include "common/string-helpers.h"
+#include "foreign-toplevel/foreign.h"
 #include "labwc.h"
 #include "view.h"
 
@@ -20,38 +22,67 @@ handle_handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&ext_toplevel->on_view.new_app_id.link);
 	wl_list_remove(&ext_toplevel->on_view.new_title.link);
 
+	if (ext_toplevel->idle_source) {
+		wl_event_source_remove(ext_toplevel->idle_source);
+		ext_toplevel->idle_source = NULL;
+	}
 	ext_toplevel->handle = NULL;
 }
 
-/* Compositor signals */
+/*
+ * Title and app_id changes are flushed once per event loop iteration, so
+ * that clients only see the latest value of anything that changed several
+ * times in between.
+ */
 static void
-handle_new_app_id(struct wl_listener *listener, void *data)
+handle_idle_update_state(void *data)
 {
-	struct ext_foreign_toplevel *ext_toplevel =
-		wl_container_of(listener, ext_toplevel, on_view.new_app_id);
-	assert(ext_toplevel->handle);
+	struct ext_foreign_toplevel *ext_toplevel = data;
+	ext_toplevel->idle_source = NULL;
 
+	struct view *view = ext_toplevel->view;
+	if (str_equal(ext_toplevel->handle->title, view->title)
+			&& str_equal(ext_toplevel->handle->app_id, view->app_id)) {
+		return;
+	}
 	struct wlr_ext_foreign_toplevel_handle_v1_state state = {
-		.title = ext_toplevel->view->title,
-		.app_id = ext_toplevel->view->app_id,
+		.title = view->title,
+		.app_id = view->app_id,
 	};
 	wlr_ext_foreign_toplevel_handle_v1_update_state(ext_toplevel->handle,
 		&state);
 }
 
+static void
+schedule_update(struct ext_foreign_toplevel *ext_toplevel)
+{
+	assert(ext_toplevel->handle);
+	if (!foreign_toplevel_ext_bound()) {
+		/* Sent by ext_foreign_toplevel_sync() on the next bind */
+		return;
+	}
+	if (!ext_toplevel->idle_source) {
+		ext_toplevel->idle_source = wl_event_loop_add_idle(
+			ext_toplevel->view->server->wl_event_loop,
+			handle_idle_update_state, ext_toplevel);
+	}
+}
+
+/* Compositor signals */
+static void
+handle_new_app_id(struct wl_listener *listener, void *data)
+{
+	struct ext_foreign_toplevel *ext_toplevel =
+		wl_container_of(listener, ext_toplevel, on_view.new_app_id);
+	schedule_update(ext_toplevel);
+}
+
 static void
 handle_new_title(struct wl_listener *listener, void *data)
 {
 	struct ext_foreign_toplevel *ext_toplevel =
 		wl_container_of(listener, ext_toplevel, on_view.new_title);
-	assert(ext_toplevel->handle);
-
-	struct wlr_ext_foreign_toplevel_handle_v1_state state = {
-		.title = ext_toplevel->view->title,
-		.app_id = ext_toplevel->view->app_id,
-	};
-	wlr_ext_foreign_toplevel_handle_v1_update_state(ext_toplevel->handle,
-		&state);
+	schedule_update(ext_toplevel);
 }
 
 /* Internal API */
@@ -59,8 +90,11 @@ void
 ext_foreign_toplevel_init(struct ext_foreign_toplevel *ext_toplevel,
 		struct view *view)
 {
-	assert(view->server->foreign_toplevel_list);
 	ext_toplevel->view = view;
+	if (!foreign_toplevel_ext_bound()) {
+		/* Created by ext_foreign_toplevel_sync() on the first bind */
+		return;
+	}
 
 	struct wlr_ext_foreign_toplevel_handle_v1_state state = {
 		.title = view->title,
@@ -84,6 +118,20 @@ ext_foreign_toplevel_init(struct ext_foreign_toplevel *ext_toplevel,
 	CONNECT_SIGNAL(view, &ext_toplevel->on_view, new_title);
 }
 
+void
+ext_foreign_toplevel_sync(struct ext_foreign_toplevel *ext_toplevel)
+{
+	if (!ext_toplevel->handle) {
+		ext_foreign_toplevel_init(ext_toplevel, ext_toplevel->view);
+		return;
+	}
+	if (ext_toplevel->idle_source) {
+		wl_event_source_remove(ext_toplevel->idle_source);
+	}
+	/* Does nothing if neither title nor app_id changed */
+	handle_idle_update_state(ext_toplevel);
+}
+
 void
 ext_foreign_toplevel_finish(struct ext_foreign_toplevel *ext_toplevel)
 {
@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include "foreign-toplevel/foreign.h"
 #include <assert.h>
+#include <string.h>
+#include <wayland-server-core.h>
 #include "common/mem.h"
 #include "foreign-toplevel/ext-foreign.h"
 #include "foreign-toplevel/wlr-foreign.h"
+#include "labwc.h"
 #include "view.h"
 
 struct foreign_toplevel {
@@ -14,6 +17,143 @@ struct foreign_toplevel {
 	/* TODO: add struct xdg_x11_mapped_toplevel at some point */
 };
 
+/*
+ * The protocol handles are only created once a client has bound the
+ * manager of their protocol, and only updated while one is bound, so
+ * that sessions without a taskbar or dock don't pay for them. Binds are
+ * seen from the resource-created signal of each client, which is emitted
+ * before wlroots sends the existing handles to the new manager resource.
+ * Handles created from there are thus sent to it right away.
+ */
+enum foreign_protocol {
+	FOREIGN_WLR,
+	FOREIGN_EXT,
+	FOREIGN_NR_PROTOCOLS
+};
+
+static const char *const manager_interfaces[FOREIGN_NR_PROTOCOLS] = {
+	[FOREIGN_WLR] = "zwlr_foreign_toplevel_manager_v1",
+	[FOREIGN_EXT] = "ext_foreign_toplevel_list_v1",
+};
+
+static struct {
+	struct server *server;
+	struct wl_listener client_created;
+	/* Bound manager resources per protocol */
+	int nr_bound[FOREIGN_NR_PROTOCOLS];
+} binds;
+
+struct client_watch {
+	struct wl_listener resource_created;
+	struct wl_listener destroy;
+};
+
+struct manager_bind {
+	enum foreign_protocol protocol;
+	struct wl_listener destroy;
+};
+
+bool
+foreign_toplevel_wlr_bound(void)
+{
+	return binds.nr_bound[FOREIGN_WLR] > 0;
+}
+
+bool
+foreign_toplevel_ext_bound(void)
+{
+	return binds.nr_bound[FOREIGN_EXT] > 0;
+}
+
+/* Create missing handles and send what changed while nobody was bound */
+static void
+sync_all(enum foreign_protocol protocol)
+{
+	struct view *view;
+	wl_list_for_each(view, &binds.server->views, link) {
+		struct foreign_toplevel *toplevel = view->foreign_toplevel;
+		if (!toplevel) {
+			continue;
+		}
+		if (protocol == FOREIGN_WLR) {
+			wlr_foreign_toplevel_sync(&toplevel->wlr_toplevel);
+		} else {
+			ext_foreign_toplevel_sync(&toplevel->ext_toplevel);
+		}
+	}
+	if (protocol != FOREIGN_WLR) {
+		return;
+	}
+	wl_list_for_each(view, &binds.server->views, link) {
+		struct view *parent = view->foreign_toplevel
+			? view->impl->get_parent(view) : NULL;
+		if (parent && parent->foreign_toplevel) {
+			foreign_toplevel_set_parent(view->foreign_toplevel,
+				parent->foreign_toplevel);
+		}
+	}
+}
+
+static void
+handle_manager_destroy(struct wl_listener *listener, void *data)
+{
+	struct manager_bind *bind = wl_container_of(listener, bind, destroy);
+	binds.nr_bound[bind->protocol]--;
+	assert(binds.nr_bound[bind->protocol] >= 0);
+	wl_list_remove(&bind->destroy.link);
+	free(bind);
+}
+
+static void
+handle_resource_created(struct wl_listener *listener, void *data)
+{
+	struct wl_resource *resource = data;
+	const char *class = wl_resource_get_class(resource);
+	for (int i = 0; i < FOREIGN_NR_PROTOCOLS; i++) {
+		if (strcmp(class, manager_interfaces[i])) {
+			continue;
+		}
+		struct manager_bind *bind = znew(*bind);
+		bind->protocol = i;
+		bind->destroy.notify = handle_manager_destroy;
+		wl_resource_add_destroy_listener(resource, &bind->destroy);
+		if (!binds.nr_bound[i]++) {
+			sync_all(i);
+		}
+		return;
+	}
+}
+
+static void
+handle_client_destroy(struct wl_listener *listener, void *data)
+{
+	struct client_watch *watch = wl_container_of(listener, watch, destroy);
+	wl_list_remove(&watch->resource_created.link);
+	wl_list_remove(&watch->destroy.link);
+	free(watch);
+}
+
+static void
+handle_client_created(struct wl_listener *listener, void *data)
+{
+	struct wl_client *client = data;
+	struct client_watch *watch = znew(*watch);
+	watch->resource_created.notify = handle_resource_created;
+	wl_client_add_resource_created_listener(client,
+		&watch->resource_created);
+	watch->destroy.notify = handle_client_destroy;
+	wl_client_add_destroy_listener(client, &watch->destroy);
+}
+
+void
+foreign_toplevel_watch_binds(struct server *server)
+{
+	binds.server = server;
+	binds.client_created.notify = handle_client_created;
+	wl_display_add_client_created_listener(server->wl_display,
+		&binds.client_created);
+}
+
 struct foreign_toplevel *
 foreign_toplevel_create(struct view *view)
 {
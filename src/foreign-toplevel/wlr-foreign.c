@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include "common/macros.h"
+#include "common/string-helpers.h"
+#include "foreign-toplevel/foreign.h"
 #include "labwc.h"
 #include "output.h"
 #include "view.h"
@@ -83,19 +85,106 @@ handle_handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&wlr_toplevel->on_view.fullscreened.link);
 	wl_list_remove(&wlr_toplevel->on_view.activated.link);
 
+	if (wlr_toplevel->idle_source) {
+		wl_event_source_remove(wlr_toplevel->idle_source);
+		wlr_toplevel->idle_source = NULL;
+	}
+	wlr_toplevel->pending = 0;
 	wlr_toplevel->handle = NULL;
 }
 
+/*
+ * Compositor side state changes are not forwarded right away but collected
+ * and flushed once per event loop iteration, so that clients only see the
+ * latest value of anything that changed several times in between, e.g.
+ * while tiling re-arranges windows.
+ */
+static void
+send_pending(struct wlr_foreign_toplevel *wlr_toplevel)
+{
+	struct wlr_foreign_toplevel_handle_v1 *handle = wlr_toplevel->handle;
+	struct view *view = wlr_toplevel->view;
+	uint32_t pending = wlr_toplevel->pending;
+	wlr_toplevel->pending = 0;
+
+	if ((pending & WLR_FOREIGN_PENDING_APP_ID)
+			&& !str_equal(handle->app_id, view->app_id)) {
+		wlr_foreign_toplevel_handle_v1_set_app_id(handle, view->app_id);
+	}
+	if ((pending & WLR_FOREIGN_PENDING_TITLE)
+			&& !str_equal(handle->title, view->title)) {
+		wlr_foreign_toplevel_handle_v1_set_title(handle, view->title);
+	}
+	if (pending & WLR_FOREIGN_PENDING_OUTPUTS) {
+		/*
+		 * Loop over all outputs and notify foreign_toplevel clients
+		 * about changes. wlr_foreign_toplevel_handle_v1_output_xxx()
+		 * keeps track of the active outputs internally and merges the
+		 * events. It also listens to output destroy events so its fine
+		 * to just relay the current state and let wlr_foreign_toplevel
+		 * handle the rest.
+		 */
+		struct output *output;
+		wl_list_for_each(output, &view->server->outputs, link) {
+			if (view_on_output(view, output)) {
+				wlr_foreign_toplevel_handle_v1_output_enter(
+					handle, output->wlr_output);
+			} else {
+				wlr_foreign_toplevel_handle_v1_output_leave(
+					handle, output->wlr_output);
+			}
+		}
+	}
+	/* The state setters below do nothing if the state is unchanged */
+	if (pending & WLR_FOREIGN_PENDING_MAXIMIZED) {
+		wlr_foreign_toplevel_handle_v1_set_maximized(handle,
+			view->maximized == VIEW_AXIS_BOTH);
+	}
+	if (pending & WLR_FOREIGN_PENDING_MINIMIZED) {
+		wlr_foreign_toplevel_handle_v1_set_minimized(handle,
+			view->minimized);
+	}
+	if (pending & WLR_FOREIGN_PENDING_FULLSCREEN) {
+		wlr_foreign_toplevel_handle_v1_set_fullscreen(handle,
+			view->fullscreen);
+	}
+	if (pending & WLR_FOREIGN_PENDING_ACTIVATED) {
+		wlr_foreign_toplevel_handle_v1_set_activated(handle,
+			wlr_toplevel->activated);
+	}
+}
+
+static void
+handle_idle_send_pending(void *data)
+{
+	struct wlr_foreign_toplevel *wlr_toplevel = data;
+	wlr_toplevel->idle_source = NULL;
+	send_pending(wlr_toplevel);
+}
+
+static void
+schedule_update(struct wlr_foreign_toplevel *wlr_toplevel, uint32_t change)
+{
+	assert(wlr_toplevel->handle);
+	wlr_toplevel->pending |= change;
+	if (!foreign_toplevel_wlr_bound()) {
+		/* Sent by wlr_foreign_toplevel_sync() on the next bind */
+		return;
+	}
+	if (!wlr_toplevel->idle_source) {
+		wlr_toplevel->idle_source = wl_event_loop_add_idle(
+			wlr_toplevel->view->server->wl_event_loop,
+			handle_idle_send_pending, wlr_toplevel);
+	}
+}
+
 /* Compositor signals */
 static void
 handle_new_app_id(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.new_app_id);
-	assert(wlr_toplevel->handle);
-
-	wlr_foreign_toplevel_handle_v1_set_app_id(wlr_toplevel->handle,
-		wlr_toplevel->view->app_id);
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_APP_ID);
 }
 
 static void
@@ -103,10 +192,7 @@ handle_new_title(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.new_title);
-	assert(wlr_toplevel->handle);
-
-	wlr_foreign_toplevel_handle_v1_set_title(wlr_toplevel->handle,
-		wlr_toplevel->view->title);
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_TITLE);
 }
 
 static void
@@ -114,25 +200,7 @@ handle_new_outputs(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.new_outputs);
-	assert(wlr_toplevel->handle);
-
-	/*
-	 * Loop over all outputs and notify foreign_toplevel clients about changes.
-	 * wlr_foreign_toplevel_handle_v1_output_xxx() keeps track of the active
-	 * outputs internally and merges the events. It also listens to output
-	 * destroy events so its fine to just relay the current state and let
-	 * wlr_foreign_toplevel handle the rest.
-	 */
-	struct output *output;
-	wl_list_for_each(output, &wlr_toplevel->view->server->outputs, link) {
-		if (view_on_output(wlr_toplevel->view, output)) {
-			wlr_foreign_toplevel_handle_v1_output_enter(
-				wlr_toplevel->handle, output->wlr_output);
-		} else {
-			wlr_foreign_toplevel_handle_v1_output_leave(
-				wlr_toplevel->handle, output->wlr_output);
-		}
-	}
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_OUTPUTS);
 }
 
 static void
@@ -140,10 +208,7 @@ handle_maximized(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.maximized);
-	assert(wlr_toplevel->handle);
-
-	wlr_foreign_toplevel_handle_v1_set_maximized(wlr_toplevel->handle,
-		wlr_toplevel->view->maximized == VIEW_AXIS_BOTH);
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_MAXIMIZED);
 }
 
 static void
@@ -151,10 +216,7 @@ handle_minimized(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.minimized);
-	assert(wlr_toplevel->handle);
-
-	wlr_foreign_toplevel_handle_v1_set_minimized(wlr_toplevel->handle,
-		wlr_toplevel->view->minimized);
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_MINIMIZED);
 }
 
 static void
@@ -162,10 +224,7 @@ handle_fullscreened(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.fullscreened);
-	assert(wlr_toplevel->handle);
-
-	wlr_foreign_toplevel_handle_v1_set_fullscreen(wlr_toplevel->handle,
-		wlr_toplevel->view->fullscreen);
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_FULLSCREEN);
 }
 
 static void
@@ -173,11 +232,10 @@ handle_activated(struct wl_listener *listener, void *data)
 {
 	struct wlr_foreign_toplevel *wlr_toplevel =
 		wl_container_of(listener, wlr_toplevel, on_view.activated);
-	assert(wlr_toplevel->handle);
 
 	bool *activated = data;
-	wlr_foreign_toplevel_handle_v1_set_activated(wlr_toplevel->handle,
-		*activated);
+	wlr_toplevel->activated = *activated;
+	schedule_update(wlr_toplevel, WLR_FOREIGN_PENDING_ACTIVATED);
 }
 
 /* Internal API */
@@ -185,8 +243,11 @@ void
 wlr_foreign_toplevel_init(struct wlr_foreign_toplevel *wlr_toplevel,
 		struct view *view)
 {
-	assert(view->server->foreign_toplevel_manager);
 	wlr_toplevel->view = view;
+	if (!foreign_toplevel_wlr_bound()) {
+		/* Created by wlr_foreign_toplevel_sync() on the first bind */
+		return;
+	}
 
 	wlr_toplevel->handle = wlr_foreign_toplevel_handle_v1_create(
 		view->server->foreign_toplevel_manager);
@@ -197,14 +258,9 @@ wlr_foreign_toplevel_init(struct wlr_foreign_toplevel *wlr_toplevel,
 	}
 
 	/* These states may be set before the initial map */
-	handle_new_app_id(&wlr_toplevel->on_view.new_app_id, NULL);
-	handle_new_title(&wlr_toplevel->on_view.new_title, NULL);
-	handle_new_outputs(&wlr_toplevel->on_view.new_outputs, NULL);
-	handle_maximized(&wlr_toplevel->on_view.maximized, NULL);
-	handle_minimized(&wlr_toplevel->on_view.minimized, NULL);
-	handle_fullscreened(&wlr_toplevel->on_view.fullscreened, NULL);
-	handle_activated(&wlr_toplevel->on_view.activated,
-		&(bool){view == view->server->active_view});
+	wlr_toplevel->activated = view == view->server->active_view;
+	wlr_toplevel->pending = WLR_FOREIGN_PENDING_ALL;
+	send_pending(wlr_toplevel);
 
 	/* Client side requests */
 	CONNECT_SIGNAL(wlr_toplevel->handle, &wlr_toplevel->on, request_maximize);
@@ -225,6 +281,22 @@ wlr_foreign_toplevel_init(struct wlr_foreign_toplevel *wlr_toplevel,
 	CONNECT_SIGNAL(view, &wlr_toplevel->on_view, activated);
 }
 
+void
+wlr_foreign_toplevel_sync(struct wlr_foreign_toplevel *wlr_toplevel)
+{
+	if (!wlr_toplevel->handle) {
+		wlr_foreign_toplevel_init(wlr_toplevel, wlr_toplevel->view);
+		return;
+	}
+	if (wlr_toplevel->idle_source) {
+		wl_event_source_remove(wlr_toplevel->idle_source);
+		wlr_toplevel->idle_source = NULL;
+	}
+	if (wlr_toplevel->pending) {
+		send_pending(wlr_toplevel);
+	}
+}
+
 void
 wlr_foreign_toplevel_set_parent(struct wlr_foreign_toplevel *wlr_toplevel,
 		struct wlr_foreign_toplevel *parent)
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "hidden-frames.h"
+#include <time.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include "common/macros.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "output.h"
+#include "view.h"
+#include "window-rules.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+/* Used for outputs that do not report their refresh rate */
+#define DEFAULT_REFRESH_MHZ 60000
+/*
+ * How often to look for newly hidden windows with a throttleWhenHidden="no"
+ * window rule if there is no <core><hiddenFrameRate>
+ */
+#define UNTHROTTLED_POLL_MS 100
+
+static struct {
+	struct server *server;
+	struct wl_event_source *timer;
+	/* A window rule disables throttling for some window */
+	bool unthrottled_rules;
+} hidden_frames;
+
+static void
+check_primary_output(struct wlr_scene_buffer *buffer, int sx, int sy,
+		void *data)
+{
+	bool *shown = data;
+	if (buffer->primary_output) {
+		*shown = true;
+	}
+}
+
+static bool
+view_is_hidden(struct view *view)
+{
+	int lx, ly;
+	if (!wlr_scene_node_coords(&view->scene_tree->node, &lx, &ly)) {
+		/* Minimized or on another workspace */
+		return true;
+	}
+	/*
+	 * The scene sets the primary output of a buffer based on its
+	 * visible area, which excludes anything covered by opaque buffers
+	 */
+	bool shown = false;
+	wlr_scene_node_for_each_buffer(&view->content_tree->node,
+		check_primary_output, &shown);
+	return !shown;
+}
+
+/* Returns the rate in mHz at which to send frame callbacks to hidden @view */
+static int
+get_hidden_frame_rate(struct view *view)
+{
+	if (hidden_frames.unthrottled_rules && window_rules_get_property(view,
+			WINDOW_RULE_PROP_THROTTLE_WHEN_HIDDEN) == LAB_PROP_FALSE) {
+		int refresh = output_is_usable(view->output)
+			? view->output->wlr_output->refresh : 0;
+		return refresh > 0 ? refresh : DEFAULT_REFRESH_MHZ;
+	}
+	return rc.hidden_frame_rate * 1000;
+}
+
+static void
+send_frame_done(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	wlr_surface_send_frame_done(surface, data);
+}
+
+static uint64_t
+get_poll_interval(void)
+{
+	if (rc.hidden_frame_rate > 0) {
+		return 1000000000ULL / rc.hidden_frame_rate;
+	}
+	return UNTHROTTLED_POLL_MS * NSEC_PER_MSEC;
+}
+
+static int
+handle_timer(void *data)
+{
+	if (rc.hidden_frame_rate <= 0 && !hidden_frames.unthrottled_rules) {
+		return 0;
+	}
+
+	struct timespec now_ts;
+	clock_gettime(CLOCK_MONOTONIC, &now_ts);
+	uint64_t now = timespec_to_nsec(&now_ts);
+	uint64_t next = get_poll_interval();
+
+	struct view *view;
+	wl_list_for_each(view, &hidden_frames.server->views, link) {
+		if (!view->mapped || !view->surface || !view->content_tree
+				|| !view_is_hidden(view)) {
+			continue;
+		}
+		int rate = get_hidden_frame_rate(view);
+		if (rate <= 0) {
+			continue;
+		}
+		uint64_t interval = 1000000000000ULL / rate;
+		uint64_t elapsed = now - view->hidden_frame_nsec;
+		/* Allow for the millisecond resolution of the timer */
+		if (elapsed + NSEC_PER_MSEC >= interval) {
+			wlr_surface_for_each_surface(view->surface,
+				send_frame_done, &now_ts);
+			view->hidden_frame_nsec = now;
+			elapsed = 0;
+		}
+		next = MIN(next, interval - elapsed);
+	}
+
+	wl_event_source_timer_update(hidden_frames.timer,
+		MAX(1, (int)(next / NSEC_PER_MSEC)));
+	return 0;
+}
+
+void
+hidden_frames_reconfigure(void)
+{
+	hidden_frames.unthrottled_rules = false;
+	struct window_rule *rule;
+	wl_list_for_each(rule, &rc.window_rules, link) {
+		if (rule->properties[WINDOW_RULE_PROP_THROTTLE_WHEN_HIDDEN]
+				== LAB_PROP_FALSE) {
+			hidden_frames.unthrottled_rules = true;
+			break;
+		}
+	}
+
+	if (!hidden_frames.timer) {
+		return;
+	}
+	if (rc.hidden_frame_rate > 0 || hidden_frames.unthrottled_rules) {
+		wl_event_source_timer_update(hidden_frames.timer,
+			MAX(1, (int)(get_poll_interval() / NSEC_PER_MSEC)));
+	} else {
+		wl_event_source_timer_update(hidden_frames.timer, 0);
+	}
+}
+
+void
+hidden_frames_init(struct server *server)
+{
+	hidden_frames.server = server;
+	hidden_frames.timer = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_timer, NULL);
+	hidden_frames_reconfigure();
+}
+
+void
+hidden_frames_finish(void)
+{
+	if (hidden_frames.timer) {
+		wl_event_source_remove(hidden_frames.timer);
+		hidden_frames.timer = NULL;
+	}
+	hidden_frames.server = NULL;
+}
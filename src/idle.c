@@ -6,6 +6,8 @@
 #include <wlr/types/wlr_idle_notify_v1.h>
 #include <wlr/types/wlr_idle_inhibit_v1.h>
 #include "common/mem.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
 
 struct lab_idle_inhibitor {
 	struct wlr_idle_inhibitor_v1 *wlr_inhibitor;
@@ -14,6 +16,8 @@ struct lab_idle_inhibitor {
 
 struct lab_idle_manager {
 	struct wlr_idle_notifier_v1 *ext;
+	/* Time of the last activity passed on, see <core><idleNotifyInterval> */
+	uint64_t last_activity_nsec;
 	struct {
 		struct wlr_idle_inhibit_manager_v1 *manager;
 		struct wl_listener on_new_inhibitor;
@@ -96,5 +100,26 @@ idle_manager_notify_activity(struct wlr_seat *seat)
 		return;
 	}
 
+	/*
+	 * Resetting the idle timers and notifying resumed clients on every
+	 * event is wasted effort at kHz input rates. Events dropped within
+	 * the interval after a notification only make the idle timeouts
+	 * start a little earlier, while the first event after a quiet
+	 * period always gets through.
+	 */
+	uint64_t now = time_now_nsec();
+	if (rc.idle_notify_interval && manager->last_activity_nsec
+			&& now - manager->last_activity_nsec
+				< rc.idle_notify_interval * 1000000ULL) {
+		return;
+	}
+	manager->last_activity_nsec = now;
+
 	wlr_idle_notifier_v1_notify_activity(manager->ext, seat);
 }
+
+uint64_t
+idle_manager_get_last_activity(void)
+{
+	return manager ? manager->last_activity_nsec : 0;
+}
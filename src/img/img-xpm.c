@@ -11,30 +11,30 @@
  * Adapted for labwc by John Lindgren, 2024
  */
 
+#define _POSIX_C_SOURCE 200809L
 #include "img/img-xpm.h"
+#include <fcntl.h>
 #include <glib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <wlr/util/log.h>
 
 #include "buffer.h"
-#include "common/buf.h"
 #include "common/graphic-helpers.h"
+#include "common/hash.h"
+#include "common/macros.h"
 #include "common/mem.h"
 
-enum buf_op { op_header, op_cmap, op_body };
-
 struct xpm_color {
-	char *color_string;
+	/* The first cpp chars are the key, NULL for an empty slot */
+	const char *key;
 	uint32_t argb;
 };
 
-struct file_handle {
-	FILE *infile;
-	struct buf buf;
-};
-
 static inline uint32_t
 make_argb(uint8_t a, uint8_t r, uint8_t g, uint8_t b)
 {
@@ -82,78 +82,96 @@ parse_color(const char *spec, uint32_t *argb)
 	}
 }
 
+/* Character classes, so that the scanners test one table entry per byte */
+enum char_class {
+	CLASS_SPACE = 1 << 0,
+	/* Characters the string scanner has to stop at */
+	CLASS_DELIM = 1 << 1,
+};
+
+static const uint8_t char_class[256] = {
+	[' '] = CLASS_SPACE,
+	['\t'] = CLASS_SPACE,
+	['\n'] = CLASS_SPACE,
+	['\v'] = CLASS_SPACE,
+	['\f'] = CLASS_SPACE,
+	['\r'] = CLASS_SPACE,
+	['"'] = CLASS_DELIM,
+	['/'] = CLASS_DELIM,
+	['{'] = CLASS_DELIM,
+};
+
+/* The mapped file; strings point into it and are not NUL-terminated */
+struct xpm_reader {
+	const char *pos;
+	const char *end;
+};
+
+struct xpm_string {
+	const char *data;
+	size_t len;
+};
+
+/* Skip to the next @c outside of comments and past it */
 static bool
-xpm_seek_string(FILE *infile, const char *str)
+xpm_seek_char(struct xpm_reader *r, char c)
 {
-	char instr[1024];
-
-	while (!feof(infile)) {
-		if (fscanf(infile, "%1023s", instr) < 0) {
-			return false;
+	const char *p = r->pos;
+	const char *end = r->end;
+	while (p < end) {
+		if (!(char_class[(unsigned char)*p] & CLASS_DELIM)) {
+			p++;
+			continue;
 		}
-		if (strcmp(instr, str) == 0) {
+		if (*p == c) {
+			r->pos = p + 1;
 			return true;
 		}
+		if (*p == '/' && p + 1 < end && p[1] == '*') {
+			/* Skip the comment */
+			for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/');) {
+				p++;
+			}
+			p += 2;
+			continue;
+		}
+		p++;
 	}
-
+	r->pos = end;
 	return false;
 }
 
 static bool
-xpm_seek_char(FILE *infile, char c)
+xpm_seek_header(struct xpm_reader *r)
 {
-	int b, oldb;
-
-	while ((b = getc(infile)) != EOF) {
-		if (c != b && b == '/') {
-			b = getc(infile);
-			if (b == EOF) {
-				return false;
-			} else if (b == '*') { /* we have a comment */
-				b = -1;
-				do {
-					oldb = b;
-					b = getc(infile);
-					if (b == EOF) {
-						return false;
-					}
-				} while (!(oldb == '*' && b == '/'));
-			}
-		} else if (c == b) {
-			return true;
+	for (const char *p = r->pos; p + 3 <= r->end; p++) {
+		if (p[0] == 'X' && p[1] == 'P' && p[2] == 'M') {
+			r->pos = p + 3;
+			return xpm_seek_char(r, '{');
 		}
 	}
-
 	return false;
 }
 
 static bool
-xpm_read_string(FILE *infile, struct buf *buf)
+xpm_read_string(struct xpm_reader *r, struct xpm_string *str)
 {
-	buf_clear(buf);
-	int c;
-
-	do {
-		c = getc(infile);
-		if (c == EOF) {
-			return false;
-		}
-	} while (c != '"');
-
-	while ((c = getc(infile)) != EOF) {
-		if (c == '"') {
-			return true;
-		}
-		buf_add_char(buf, c);
+	if (!xpm_seek_char(r, '"')) {
+		return false;
 	}
-
-	return false;
+	const char *quote = memchr(r->pos, '"', r->end - r->pos);
+	if (!quote) {
+		return false;
+	}
+	str->data = r->pos;
+	str->len = quote - r->pos;
+	r->pos = quote + 1;
+	return true;
 }
 
 static uint32_t
-xpm_extract_color(const char *buffer)
+xpm_extract_color(const char *p, const char *end)
 {
-	const char *p = buffer;
 	int new_key = 0;
 	int key = 0;
 	int current_key = 1;
@@ -165,11 +183,13 @@ xpm_extract_color(const char *buffer)
 	current_color[0] = '\0';
 	while (true) {
 		/* skip whitespace */
-		for (; *p != '\0' && g_ascii_isspace(*p); p++) {
+		for (; p < end && (char_class[(unsigned char)*p] & CLASS_SPACE);
+				p++) {
 			/* nothing */
 		}
 		/* copy word */
-		for (r = word; *p != '\0' && !g_ascii_isspace(*p)
+		for (r = word; p < end
+				&& !(char_class[(unsigned char)*p] & CLASS_SPACE)
 				&& r - word < (int)sizeof(word) - 1;
 				p++, r++) {
 			*r = *p;
@@ -216,7 +236,7 @@ xpm_extract_color(const char *buffer)
 			}
 			color[0] = '\0';
 			key = new_key;
-			if (*p == '\0') {
+			if (p == end) {
 				break;
 			}
 		}
@@ -231,50 +251,87 @@ xpm_extract_color(const char *buffer)
 	}
 }
 
-static const char *
-file_buffer(enum buf_op op, struct file_handle *h)
-{
-	switch (op) {
-	case op_header:
-		if (!xpm_seek_string(h->infile, "XPM")) {
-			break;
-		}
-		if (!xpm_seek_char(h->infile, '{')) {
-			break;
-		}
-		/* Fall through to the next xpm_seek_char. */
+/*
+ * Open-addressing map from the pixel characters to the colors. Lookups hash
+ * @cpp bytes in place, so the pixel rows are never copied.
+ */
+struct color_map {
+	struct xpm_color *slots;
+	size_t mask;
+	int cpp;
+	/* Direct lookup for one char per pixel, by far the most common case */
+	struct xpm_color *by_char[256];
+};
 
-	case op_cmap:
-		xpm_seek_char(h->infile, '"');
-		if (fseek(h->infile, -1, SEEK_CUR) != 0) {
-			return NULL;
-		}
-		/* Fall through to the xpm_read_string. */
+static size_t
+color_map_hash(const struct color_map *map, const char *key)
+{
+	return hash_add(HASH_INIT, key, map->cpp) & map->mask;
+}
 
-	case op_body:
-		if (!xpm_read_string(h->infile, &h->buf)) {
-			return NULL;
-		}
-		return h->buf.data;
+static void
+color_map_init(struct color_map *map, int n_col, int cpp)
+{
+	size_t size = 16;
+	while (size < (size_t)n_col * 2) {
+		size *= 2;
+	}
+	*map = (struct color_map){
+		.slots = znew_n(struct xpm_color, size),
+		.mask = size - 1,
+		.cpp = cpp,
+	};
+}
 
-	default:
-		g_assert_not_reached();
+static void
+color_map_insert(struct color_map *map, const char *key, uint32_t argb)
+{
+	size_t i = color_map_hash(map, key);
+	struct xpm_color *slot = &map->slots[i];
+	while (slot->key && memcmp(slot->key, key, map->cpp)) {
+		i = (i + 1) & map->mask;
+		slot = &map->slots[i];
+	}
+	/* A key defined twice gets the last color */
+	slot->key = key;
+	slot->argb = argb;
+	if (map->cpp == 1 && !map->by_char[(unsigned char)*key]) {
+		map->by_char[(unsigned char)*key] = slot;
 	}
+}
 
+static const struct xpm_color *
+color_map_lookup(const struct color_map *map, const char *key)
+{
+	if (map->cpp == 1) {
+		return map->by_char[(unsigned char)*key];
+	}
+	size_t i = color_map_hash(map, key);
+	for (const struct xpm_color *slot = &map->slots[i]; slot->key;
+			slot = &map->slots[i]) {
+		if (!memcmp(slot->key, key, map->cpp)) {
+			return slot;
+		}
+		i = (i + 1) & map->mask;
+	}
 	return NULL;
 }
 
 static cairo_surface_t *
-xpm_load_to_surface(struct file_handle *handle)
+xpm_load_to_surface(struct xpm_reader *reader)
 {
-	const char *buffer = file_buffer(op_header, handle);
-	if (!buffer) {
+	struct xpm_string str;
+	if (!xpm_seek_header(reader) || !xpm_read_string(reader, &str)) {
 		wlr_log(WLR_DEBUG, "No XPM header found");
 		return NULL;
 	}
 
+	char header[128];
+	size_t header_len = MIN(str.len, sizeof(header) - 1);
+	memcpy(header, str.data, header_len);
+	header[header_len] = '\0';
 	int w, h, n_col, cpp, x_hot, y_hot;
-	int items = sscanf(buffer, "%d %d %d %d %d %d", &w, &h, &n_col, &cpp,
+	int items = sscanf(header, "%d %d %d %d %d %d", &w, &h, &n_col, &cpp,
 		&x_hot, &y_hot);
 
 	if (items != 4 && items != 6) {
@@ -304,46 +361,33 @@ xpm_load_to_surface(struct file_handle *handle)
 		return NULL;
 	}
 
-	/* The hash is used for fast lookups of color from chars */
-	GHashTable *color_hash = g_hash_table_new(g_str_hash, g_str_equal);
-
-	char *name_buf = xzalloc(n_col * (cpp + 1));
-	struct xpm_color *colors = znew_n(struct xpm_color, n_col);
+	struct color_map map;
+	color_map_init(&map, n_col, cpp);
 	cairo_surface_t *surface = NULL;
-	struct xpm_color *fallbackcolor = NULL;
-	char pixel_str[32]; /* cpp < 32 */
+	uint32_t fallback_argb = 0;
 
 	for (int cnt = 0; cnt < n_col; cnt++) {
-		buffer = file_buffer(op_cmap, handle);
-		if (!buffer) {
+		if (!xpm_read_string(reader, &str) || str.len < (size_t)cpp) {
 			wlr_log(WLR_DEBUG, "Cannot read XPM colormap");
 			goto out;
 		}
-
-		struct xpm_color *color = &colors[cnt];
-		color->color_string = &name_buf[cnt * (cpp + 1)];
-		g_strlcpy(color->color_string, buffer, cpp + 1);
-		buffer += strlen(color->color_string);
-
-		color->argb = xpm_extract_color(buffer);
-
-		g_hash_table_insert(color_hash, color->color_string, color);
-
+		uint32_t argb = xpm_extract_color(str.data + cpp,
+			str.data + str.len);
+		color_map_insert(&map, str.data, argb);
 		if (cnt == 0) {
-			fallbackcolor = color;
+			fallback_argb = argb;
 		}
 	}
 
 	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
 	uint32_t *data = (uint32_t *)cairo_image_surface_get_data(surface);
 	int stride = cairo_image_surface_get_stride(surface) / sizeof(uint32_t);
+	size_t wbytes = (size_t)w * cpp;
 
 	for (int ycnt = 0; ycnt < h; ycnt++) {
 		uint32_t *pixtmp = data + stride * ycnt;
-		int wbytes = w * cpp;
 
-		buffer = file_buffer(op_body, handle);
-		if (!buffer || (strlen(buffer) < (size_t)wbytes)) {
+		if (!xpm_read_string(reader, &str) || str.len < wbytes) {
 			/* Advertised width doesn't match pixels */
 			wlr_log(WLR_DEBUG, "Dimensions do not match data");
 			cairo_surface_destroy(surface);
@@ -351,50 +395,51 @@ xpm_load_to_surface(struct file_handle *handle)
 			goto out;
 		}
 
-		for (int n = 0, xcnt = 0; n < wbytes; n += cpp, xcnt++) {
-			g_strlcpy(pixel_str, &buffer[n], cpp + 1);
-
-			struct xpm_color *color =
-				g_hash_table_lookup(color_hash, pixel_str);
-
+		for (size_t n = 0; n < wbytes; n += cpp) {
+			const struct xpm_color *color =
+				color_map_lookup(&map, &str.data[n]);
 			/* Bad XPM...punt */
-			if (!color) {
-				color = fallbackcolor;
-			}
-
-			*pixtmp++ = color->argb;
+			*pixtmp++ = color ? color->argb : fallback_argb;
 		}
 	}
 	/* let cairo know pixel data has been modified */
 	cairo_surface_mark_dirty(surface);
 
 out:
-	g_hash_table_destroy(color_hash);
-	free(colors);
-	free(name_buf);
+	free(map.slots);
 	return surface;
 }
 
 struct lab_data_buffer *
 img_xpm_load(const char *filename)
 {
-	struct file_handle h = {0};
-	h.infile = fopen(filename, "rb");
-	if (!h.infile) {
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
 		wlr_log(WLR_ERROR, "error opening '%s'", filename);
 		return NULL;
 	}
 
-	cairo_surface_t *surface = xpm_load_to_surface(&h);
 	struct lab_data_buffer *buffer = NULL;
+	cairo_surface_t *surface = NULL;
+	struct stat st;
+	void *mapping = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size > 0) {
+		mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if (mapping != MAP_FAILED) {
+		struct xpm_reader reader = {
+			.pos = mapping,
+			.end = (const char *)mapping + st.st_size,
+		};
+		surface = xpm_load_to_surface(&reader);
+		munmap(mapping, st.st_size);
+	}
+	close(fd);
+
 	if (surface) {
 		buffer = buffer_adopt_cairo_surface(surface);
 	} else {
 		wlr_log(WLR_ERROR, "error loading '%s'", filename);
 	}
-
-	fclose(h.infile);
-	buf_reset(&h.buf);
-
 	return buffer;
 }
@@ -1,14 +1,21 @@
 // SPDX-License-Identifier: GPL-2.0-only
-
+#define _POSIX_C_SOURCE 200809L
 #include "img/img.h"
 #include <assert.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-util.h>
 #include "buffer.h"
 #include "config.h"
 #include "common/box.h"
 #include "common/graphic-helpers.h"
+#include "common/hash.h"
 #include "common/macros.h"
 #include "common/mem.h"
 #include "common/string-helpers.h"
+#include "common/time-helpers.h"
 #include "img/img-png.h"
 #if HAVE_RSVG
 #include "img/img-svg.h"
@@ -18,18 +25,120 @@
 #include "labwc.h"
 #include "theme.h"
 
+/* How long decoded files are kept after their last lab_img is destroyed */
+#define IMG_CACHE_MAX_AGE_NSEC (60 * 1000000000ull)
+
 struct lab_img_data {
 	enum lab_img_type type;
 	/* lab_img_data is refcounted to be shared by multiple lab_imgs */
 	int refcount;
 
+	/* Cache key of data loaded from a file, path is NULL otherwise */
+	char *path;
+	uint64_t mtime;
+	float xbm_color[4];
+	uint64_t unused_since; /* when refcount dropped to zero */
+	struct wl_list link; /* img_cache */
+
 	/* Handler for the loaded image file */
 	struct lab_data_buffer *buffer; /* for PNG/XBM/XPM image */
 #if HAVE_RSVG
+	/*
+	 * SVG images are only parsed when they are rendered for the first
+	 * time, so theme variants that are never shown cost nothing but
+	 * their path.
+	 */
+	char *svg_path;
 	RsvgHandle *svg; /* for SVG image */
 #endif
 };
 
+/*
+ * Decoded image files by (type, path, mtime, xbm color), so that loading the
+ * same file again (e.g. theme buttons on reconfigure or menu icons) shares
+ * the decoded data. Unused entries are freed once they are older than
+ * IMG_CACHE_MAX_AGE_NSEC.
+ *
+ * Images are loaded from worker threads during theme_init(), so the cache
+ * and all refcounts are protected by a lock.
+ */
+static struct wl_list img_cache = WL_LIST_INIT(&img_cache);
+G_LOCK_DEFINE_STATIC(img_cache);
+
+#if HAVE_RSVG
+/*
+ * Icons are rendered from worker threads with <core><asyncIconLoading>.
+ * SVG images are parsed on first use and an RsvgHandle must not be used
+ * from two threads at once, so SVG rendering is serialized.
+ */
+G_LOCK_DEFINE_STATIC(svg);
+#endif
+
+static void
+img_data_destroy(struct lab_img_data *img_data)
+{
+	if (img_data->buffer) {
+		wlr_buffer_drop(&img_data->buffer->base);
+	}
+#if HAVE_RSVG
+	if (img_data->svg) {
+		g_object_unref(img_data->svg);
+	}
+	free(img_data->svg_path);
+#endif
+	free(img_data->path);
+	free(img_data);
+}
+
+/* Called with the lock held */
+static void
+sweep_cache_older_than(uint64_t max_age_nsec)
+{
+	uint64_t now = time_now_nsec();
+	struct lab_img_data *img_data, *tmp;
+	wl_list_for_each_safe(img_data, tmp, &img_cache, link) {
+		if (!img_data->refcount
+				&& now - img_data->unused_since >= max_age_nsec) {
+			wl_list_remove(&img_data->link);
+			img_data_destroy(img_data);
+		}
+	}
+}
+
+/* Called with the lock held */
+static void
+sweep_cache(void)
+{
+	sweep_cache_older_than(IMG_CACHE_MAX_AGE_NSEC);
+}
+
+void
+lab_img_cache_trim(void)
+{
+	G_LOCK(img_cache);
+	sweep_cache_older_than(0);
+	G_UNLOCK(img_cache);
+}
+
+/* Called with the lock held */
+static struct lab_img_data *
+find_cached(enum lab_img_type type, const char *path, uint64_t mtime,
+		const float *xbm_color)
+{
+	struct lab_img_data *img_data;
+	wl_list_for_each(img_data, &img_cache, link) {
+		if (img_data->type == type && img_data->mtime == mtime
+				&& !strcmp(img_data->path, path)
+				&& (type != LAB_IMG_XBM
+					|| !memcmp(img_data->xbm_color, xbm_color,
+						sizeof(img_data->xbm_color)))) {
+			return img_data;
+		}
+	}
+	return NULL;
+}
+
+/* Called with the lock held if @img_data is in the cache */
 static struct lab_img *
 create_img(struct lab_img_data *img_data)
 {
@@ -47,7 +156,24 @@ lab_img_load(enum lab_img_type type, const char *path, float *xbm_color)
 		return NULL;
 	}
 
-	struct lab_img_data *img_data = znew(*img_data);
+	struct stat st;
+	if (stat(path, &st) < 0) {
+		return NULL;
+	}
+	uint64_t mtime = timespec_to_nsec(&st.st_mtim);
+
+	G_LOCK(img_cache);
+	sweep_cache();
+	struct lab_img_data *img_data =
+		find_cached(type, path, mtime, xbm_color);
+	if (img_data) {
+		struct lab_img *img = create_img(img_data);
+		G_UNLOCK(img_cache);
+		return img;
+	}
+	G_UNLOCK(img_cache);
+
+	img_data = znew(*img_data);
 	img_data->type = type;
 
 	switch (type) {
@@ -63,22 +189,34 @@ lab_img_load(enum lab_img_type type, const char *path, float *xbm_color)
 		break;
 	case LAB_IMG_SVG:
 #if HAVE_RSVG
-		img_data->svg = img_svg_load(path);
+		if (access(path, R_OK) == 0) {
+			img_data->svg_path = xstrdup(path);
+		}
 #endif
 		break;
 	}
 
 	bool img_is_loaded = (bool)img_data->buffer;
 #if HAVE_RSVG
-	img_is_loaded |= (bool)img_data->svg;
+	img_is_loaded |= (bool)img_data->svg_path;
 #endif
 
-	if (img_is_loaded) {
-		return create_img(img_data);
-	} else {
+	if (!img_is_loaded) {
 		free(img_data);
 		return NULL;
 	}
+
+	img_data->path = xstrdup(path);
+	img_data->mtime = mtime;
+	if (type == LAB_IMG_XBM) {
+		memcpy(img_data->xbm_color, xbm_color,
+			sizeof(img_data->xbm_color));
+	}
+	G_LOCK(img_cache);
+	wl_list_insert(&img_cache, &img_data->link);
+	struct lab_img *img = create_img(img_data);
+	G_UNLOCK(img_cache);
+	return img;
 }
 
 struct lab_img *
@@ -99,7 +237,9 @@ lab_img_load_from_bitmap(const char *bitmap, float *rgba)
 struct lab_img *
 lab_img_copy(struct lab_img *img)
 {
+	G_LOCK(img_cache);
 	struct lab_img *new_img = create_img(img->data);
+	G_UNLOCK(img_cache);
 	wl_array_copy(&new_img->modifiers, &img->modifiers);
 	return new_img;
 }
@@ -125,7 +265,17 @@ lab_img_render(struct lab_img *img, int width, int height, double scale)
 		break;
 #if HAVE_RSVG
 	case LAB_IMG_SVG:
-		buffer = img_svg_render(img->data->svg, width, height, scale);
+		G_LOCK(svg);
+		if (img->data->svg_path) {
+			/* Parse once; a broken file will not be retried */
+			img->data->svg = img_svg_load(img->data->svg_path);
+			zfree(img->data->svg_path);
+		}
+		if (img->data->svg) {
+			buffer = img_svg_render(img->data->svg,
+				width, height, scale);
+		}
+		G_UNLOCK(svg);
 		break;
 #endif
 	default:
@@ -158,18 +308,18 @@ lab_img_destroy(struct lab_img *img)
 		return;
 	}
 
-	img->data->refcount--;
-	if (img->data->refcount == 0) {
-		if (img->data->buffer) {
-			wlr_buffer_drop(&img->data->buffer->base);
-		}
-#if HAVE_RSVG
-		if (img->data->svg) {
-			g_object_unref(img->data->svg);
+	G_LOCK(img_cache);
+	struct lab_img_data *img_data = img->data;
+	img_data->refcount--;
+	if (img_data->refcount == 0) {
+		if (img_data->path) {
+			/* Keep it cached for a while */
+			img_data->unused_since = time_now_nsec();
+		} else {
+			img_data_destroy(img_data);
 		}
-#endif
-		free(img->data);
 	}
+	G_UNLOCK(img_cache);
 
 	wl_array_release(&img->modifiers);
 	free(img);
@@ -189,3 +339,10 @@ lab_img_equal(struct lab_img *img_a, struct lab_img *img_b)
 		|| !memcmp(img_a->modifiers.data, img_b->modifiers.data,
 			img_a->modifiers.size);
 }
+
+uint64_t
+lab_img_hash(struct lab_img *img)
+{
+	uint64_t hash = hash_add(HASH_INIT, &img->data, sizeof(img->data));
+	return hash_add(hash, img->modifiers.data, img->modifiers.size);
+}
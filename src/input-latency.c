@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "input-latency.h"
+#include <glib.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include "common/macros.h"
+#include "common/time-helpers.h"
+#include "config.h"
+#include "labwc.h"
+#include "output.h"
+#include "view.h"
+#if HAVE_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
+
+#define NSEC_PER_MSEC 1000000ULL
+
+enum latency_part {
+	LATENCY_TOTAL,
+	LATENCY_COMPOSITOR,
+	LATENCY_CLIENT,
+	LATENCY_SCANOUT,
+	LATENCY_NR_PARTS,
+};
+
+static const char *const part_names[LATENCY_NR_PARTS] = {
+	[LATENCY_TOTAL] = "total",
+	[LATENCY_COMPOSITOR] = "compositor",
+	[LATENCY_CLIENT] = "client",
+	[LATENCY_SCANOUT] = "scanout",
+};
+
+struct part_stats {
+	uint64_t ns_total;
+	uint64_t ns_max;
+	uint64_t buckets[INPUT_LATENCY_BUCKETS];
+};
+
+struct app_stats {
+	uint64_t samples;
+	uint64_t dropped;
+	struct part_stats parts[LATENCY_NR_PARTS];
+};
+
+bool input_latency_enabled;
+
+/* app_id -> struct app_stats */
+static GHashTable *stats_by_app_id;
+
+static struct app_stats *
+get_stats(struct view *view)
+{
+	if (!stats_by_app_id) {
+		stats_by_app_id = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+	}
+	const char *app_id = view->app_id ? view->app_id : "";
+	struct app_stats *stats = g_hash_table_lookup(stats_by_app_id, app_id);
+	if (!stats) {
+		stats = g_new0(struct app_stats, 1);
+		g_hash_table_insert(stats_by_app_id, g_strdup(app_id), stats);
+	}
+	return stats;
+}
+
+static void
+clear_sample(struct view *view)
+{
+	view->latency.input_ns = 0;
+	view->latency.delivered_ns = 0;
+	view->latency.commit_ns = 0;
+	view->latency.frame_ns = 0;
+	view->latency.output = NULL;
+}
+
+static void
+add_part(struct part_stats *part, uint64_t ns)
+{
+	part->ns_total += ns;
+	if (ns > part->ns_max) {
+		part->ns_max = ns;
+	}
+	int bucket = 0;
+	for (uint64_t ms = ns / NSEC_PER_MSEC; ms
+			&& bucket < INPUT_LATENCY_BUCKETS - 1; ms >>= 1) {
+		bucket++;
+	}
+	part->buckets[bucket]++;
+}
+
+/* Popups and subsurfaces count towards the window they belong to */
+static struct view *
+view_from_input_surface(struct wlr_surface *surface)
+{
+	surface = wlr_surface_get_root_surface(surface);
+	struct wlr_xdg_popup *popup;
+	while ((popup = wlr_xdg_popup_try_from_wlr_surface(surface))) {
+		if (!popup->parent) {
+			return NULL;
+		}
+		surface = wlr_surface_get_root_surface(popup->parent);
+	}
+	struct wlr_xdg_toplevel *toplevel =
+		wlr_xdg_toplevel_try_from_wlr_surface(surface);
+	if (toplevel) {
+		return toplevel->base->data;
+	}
+#if HAVE_XWAYLAND
+	struct wlr_xwayland_surface *xsurface =
+		wlr_xwayland_surface_try_from_wlr_surface(surface);
+	if (xsurface) {
+		return xsurface->data;
+	}
+#endif
+	return NULL;
+}
+
+void
+input_latency_enable(bool enable)
+{
+	input_latency_enabled = enable;
+}
+
+void
+input_latency_record_input(struct wlr_surface *surface, uint32_t time_msec)
+{
+	if (!surface) {
+		return;
+	}
+	struct view *view = view_from_input_surface(surface);
+	if (!view) {
+		return;
+	}
+
+	uint64_t now = time_now_nsec();
+	if (view->latency.input_ns) {
+		if (now - view->latency.delivered_ns
+				< INPUT_LATENCY_TIMEOUT_MS * NSEC_PER_MSEC) {
+			return;
+		}
+		/* Not committed or not presented, e.g. while hidden */
+		get_stats(view)->dropped++;
+	}
+
+	/*
+	 * Event times are in milliseconds of CLOCK_MONOTONIC and wrap
+	 * around. Nested backends may use another clock entirely, in which
+	 * case the compositor part can't be measured.
+	 */
+	uint32_t age_ms = (uint32_t)(now / NSEC_PER_MSEC) - time_msec;
+	if (age_ms > INPUT_LATENCY_TIMEOUT_MS) {
+		age_ms = 0;
+	}
+	view->latency.input_ns = now - MIN(now, age_ms * NSEC_PER_MSEC);
+	view->latency.delivered_ns = now;
+	view->latency.commit_ns = 0;
+	view->latency.frame_ns = 0;
+	view->latency.output = NULL;
+}
+
+void
+input_latency_record_commit(struct view *view)
+{
+	if (view->latency.input_ns && !view->latency.commit_ns) {
+		view->latency.commit_ns = time_now_nsec();
+	}
+}
+
+void
+input_latency_record_output_commit(struct output *output, uint64_t start_nsec)
+{
+	struct view *view;
+	wl_list_for_each(view, &output->server->views, link) {
+		if (view->latency.commit_ns && !view->latency.output
+				&& view->output == output
+				&& view->latency.commit_ns <= start_nsec) {
+			view->latency.output = output;
+			view->latency.frame_ns = start_nsec;
+		}
+	}
+}
+
+void
+input_latency_record_present(struct output *output,
+		const struct wlr_output_event_present *event)
+{
+	bool presented = event->presented && event->when.tv_sec;
+	uint64_t when = presented ? timespec_to_nsec(&event->when) : 0;
+
+	struct view *view;
+	wl_list_for_each(view, &output->server->views, link) {
+		if (view->latency.output != output) {
+			continue;
+		}
+		if (!presented || when < view->latency.commit_ns) {
+			/* Wait for the next frame */
+			view->latency.output = NULL;
+			view->latency.frame_ns = 0;
+			continue;
+		}
+		struct app_stats *stats = get_stats(view);
+		stats->samples++;
+		add_part(&stats->parts[LATENCY_TOTAL],
+			when - view->latency.input_ns);
+		add_part(&stats->parts[LATENCY_COMPOSITOR],
+			view->latency.delivered_ns - view->latency.input_ns);
+		add_part(&stats->parts[LATENCY_CLIENT],
+			view->latency.commit_ns - view->latency.delivered_ns);
+		add_part(&stats->parts[LATENCY_SCANOUT],
+			when - view->latency.commit_ns);
+		clear_sample(view);
+	}
+}
+
+void
+input_latency_forget_output(struct output *output)
+{
+	struct view *view;
+	wl_list_for_each(view, &output->server->views, link) {
+		if (view->latency.output == output) {
+			view->latency.output = NULL;
+			view->latency.frame_ns = 0;
+		}
+	}
+}
+
+static void
+print_part(FILE *stream, const struct app_stats *stats, enum latency_part i)
+{
+	const struct part_stats *part = &stats->parts[i];
+	fprintf(stream, "  %s_avg_us: %lu\n", part_names[i],
+		(unsigned long)(part->ns_total / stats->samples / 1000));
+	fprintf(stream, "  %s_max_us: %lu\n", part_names[i],
+		(unsigned long)(part->ns_max / 1000));
+	fprintf(stream, "  %s_ms:", part_names[i]);
+	for (int bucket = 0; bucket < INPUT_LATENCY_BUCKETS; bucket++) {
+		if (bucket < INPUT_LATENCY_BUCKETS - 1) {
+			fprintf(stream, " <%d:%lu", 1 << bucket,
+				(unsigned long)part->buckets[bucket]);
+		} else {
+			fprintf(stream, " >=%d:%lu", 1 << (bucket - 1),
+				(unsigned long)part->buckets[bucket]);
+		}
+	}
+	fprintf(stream, "\n");
+}
+
+static void
+print_app_stats(gpointer key, gpointer value, gpointer data)
+{
+	const char *app_id = key;
+	const struct app_stats *stats = value;
+	FILE *stream = data;
+
+	fprintf(stream, "app_id %s\n", *app_id ? app_id : "(none)");
+	fprintf(stream, "  samples: %lu\n", (unsigned long)stats->samples);
+	fprintf(stream, "  dropped: %lu\n", (unsigned long)stats->dropped);
+	if (!stats->samples) {
+		return;
+	}
+	for (int i = 0; i < LATENCY_NR_PARTS; i++) {
+		print_part(stream, stats, i);
+	}
+}
+
+void
+input_latency_print(FILE *stream)
+{
+	fprintf(stream, "tracing: %s\n", input_latency_enabled ? "on" : "off");
+	if (stats_by_app_id) {
+		g_hash_table_foreach(stats_by_app_id, print_app_stats, stream);
+	}
+}
+
+void
+input_latency_reset(void)
+{
+	if (stats_by_app_id) {
+		g_hash_table_remove_all(stats_by_app_id);
+	}
+}
+
+void
+input_latency_finish(void)
+{
+	if (stats_by_app_id) {
+		g_hash_table_destroy(stats_by_app_id);
+		stats_by_app_id = NULL;
+	}
+}
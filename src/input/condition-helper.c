@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "input/condition-helper.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "common/buf.h"
+#include "common/list.h"
+#include "common/mem.h"
+#include "common/spawn.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "timer.h"
+
+struct condition_query {
+	condition_helper_answer_func_t answer;
+	void *data;
+	uint64_t deadline_ns;
+	struct wl_list link; /* helper.queries */
+};
+
+static struct {
+	pid_t pid;
+	int read_fd;
+	int write_fd;
+	struct wl_event_source *event_read;
+	struct lab_timer *event_timeout;
+	struct buf buf;
+	struct wl_list queries; /* struct condition_query.link, oldest first */
+	bool initialized;
+} helper = {
+	.pid = -1,
+	.read_fd = -1,
+	.write_fd = -1,
+};
+
+static void
+arm_timeout(void)
+{
+	if (!helper.event_timeout) {
+		return;
+	}
+	if (wl_list_empty(&helper.queries)) {
+		lab_timer_update(helper.event_timeout, 0);
+		return;
+	}
+	struct condition_query *query =
+		wl_container_of(helper.queries.next, query, link);
+	uint64_t now = time_now_nsec();
+	int ms = 1;
+	if (query->deadline_ns > now) {
+		ms = (query->deadline_ns - now + 999999) / 1000000;
+	}
+	lab_timer_update(helper.event_timeout, ms);
+}
+
+static void
+answer_query(struct condition_query *query, const char *answer)
+{
+	wl_list_remove(&query->link);
+	query->answer(answer, query->data);
+	free(query);
+}
+
+void
+condition_helper_stop(void)
+{
+	if (!helper.initialized) {
+		return;
+	}
+	if (helper.event_read) {
+		wl_event_source_remove(helper.event_read);
+		helper.event_read = NULL;
+	}
+	if (helper.event_timeout) {
+		lab_timer_destroy(helper.event_timeout);
+		helper.event_timeout = NULL;
+	}
+	if (helper.write_fd >= 0) {
+		close(helper.write_fd);
+		helper.write_fd = -1;
+	}
+	if (helper.pid > 0) {
+		kill(helper.pid, SIGTERM);
+		spawn_piped_close(helper.pid, helper.read_fd);
+		helper.pid = -1;
+		helper.read_fd = -1;
+	}
+	buf_reset(&helper.buf);
+
+	/* Answer callbacks may queue new queries, so detach the list first */
+	struct wl_list pending;
+	wl_list_init(&pending);
+	wl_list_insert_list(&pending, &helper.queries);
+	wl_list_init(&helper.queries);
+	struct condition_query *query, *tmp;
+	wl_list_for_each_safe(query, tmp, &pending, link) {
+		answer_query(query, NULL);
+	}
+}
+
+static void
+handle_line(const char *line)
+{
+	if (wl_list_empty(&helper.queries)) {
+		wlr_log(WLR_ERROR, "condition helper sent unexpected output '%s'",
+			line);
+		return;
+	}
+	struct condition_query *query =
+		wl_container_of(helper.queries.next, query, link);
+	answer_query(query, line);
+}
+
+static int
+handle_readable(int fd, uint32_t mask, void *data)
+{
+	char buffer[4096];
+	ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+	if (n < 0 && errno == EAGAIN) {
+		return 0;
+	}
+	if (n <= 0) {
+		if (n < 0) {
+			wlr_log_errno(WLR_ERROR, "failed to read from condition helper");
+		} else {
+			wlr_log(WLR_ERROR, "condition helper exited");
+		}
+		condition_helper_stop();
+		return 0;
+	}
+	buffer[n] = '\0';
+	buf_add(&helper.buf, buffer);
+
+	char *newline;
+	while (helper.pid > 0 && (newline = strchr(helper.buf.data, '\n'))) {
+		*newline = '\0';
+		char *line = xstrdup(helper.buf.data);
+		char *rest = xstrdup(newline + 1);
+		buf_clear(&helper.buf);
+		buf_add(&helper.buf, rest);
+		free(rest);
+
+		/* Trim trailing whitespace, like condition command output */
+		size_t len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' '
+				|| line[len - 1] == '\t')) {
+			line[--len] = '\0';
+		}
+		handle_line(line);
+		free(line);
+	}
+	arm_timeout();
+	return 0;
+}
+
+static int
+handle_timeout(void *data)
+{
+	/*
+	 * A late answer would be attributed to the wrong query, so
+	 * restart the helper to get back in sync.
+	 */
+	wlr_log(WLR_ERROR, "condition helper timed out, restarting");
+	condition_helper_stop();
+	return 0;
+}
+
+static bool
+start(struct server *server)
+{
+	if (!rc.kb_condition_helper) {
+		wlr_log(WLR_ERROR, "no <keyboard><conditionHelper> configured");
+		return false;
+	}
+
+	helper.pid = spawn_piped_rw(rc.kb_condition_helper,
+		&helper.read_fd, &helper.write_fd);
+	if (helper.pid <= 0) {
+		wlr_log(WLR_ERROR, "failed to spawn condition helper '%s'",
+			rc.kb_condition_helper);
+		helper.pid = -1;
+		return false;
+	}
+	helper.buf = BUF_INIT;
+
+	helper.event_read = wl_event_loop_add_fd(server->wl_event_loop,
+		helper.read_fd, WL_EVENT_READABLE, handle_readable, NULL);
+	helper.event_timeout = lab_timer_create(handle_timeout, NULL,
+		/*slack_ms*/ 100);
+	if (!helper.event_read) {
+		wlr_log(WLR_ERROR, "failed to watch condition helper");
+		condition_helper_stop();
+		return false;
+	}
+	wlr_log(WLR_INFO, "started condition helper '%s'", rc.kb_condition_helper);
+	return true;
+}
+
+bool
+condition_helper_query(struct server *server, const char *query_str,
+		int timeout_ms, condition_helper_answer_func_t answer, void *data)
+{
+	if (!helper.initialized) {
+		wl_list_init(&helper.queries);
+		helper.initialized = true;
+	}
+	if (helper.pid <= 0 && !start(server)) {
+		return false;
+	}
+
+	struct buf line = BUF_INIT;
+	buf_add(&line, query_str);
+	buf_add_char(&line, '\n');
+	ssize_t n = write(helper.write_fd, line.data, line.len);
+	bool written = n >= 0 && (size_t)n == line.len;
+	buf_reset(&line);
+	if (!written) {
+		/* Don't leave a partial line in the pipe */
+		if (n < 0) {
+			wlr_log_errno(WLR_ERROR, "failed to write to condition helper");
+		} else {
+			wlr_log(WLR_ERROR, "short write to condition helper");
+		}
+		condition_helper_stop();
+		return false;
+	}
+
+	struct condition_query *query = znew(*query);
+	query->answer = answer;
+	query->data = data;
+	query->deadline_ns = time_now_nsec() + (uint64_t)timeout_ms * 1000000;
+	wl_list_append(&helper.queries, &query->link);
+	arm_timeout();
+	return true;
+}
@@ -17,6 +17,7 @@
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/region.h>
 #include "action.h"
+#include "common/log.h"
 #include "common/macros.h"
 #include "common/mem.h"
 #include "config/mousebind.h"
@@ -24,12 +25,14 @@
 #include "cycle.h"
 #include "dnd.h"
 #include "idle.h"
+#include "input-latency.h"
 #include "input/gestures.h"
 #include "input/keyboard.h"
 #include "input/tablet.h"
 #include "input/touch.h"
 #include "labwc.h"
 #include "layers.h"
+#include "magnifier.h"
 #include "menu/menu.h"
 #include "output.h"
 #include "resistance.h"
@@ -225,7 +228,7 @@ handle_request_set_shape(struct wl_listener *listener, void *data)
 	 * actually has pointer focus first.
 	 */
 	if (event->seat_client != focused_client) {
-		wlr_log(WLR_INFO, "seat client %p != focused client %p",
+		lab_log(LAB_LOG_CURSOR, "seat client %p != focused client %p",
 			event->seat_client, focused_client);
 		return;
 	}
@@ -240,7 +243,7 @@ handle_request_set_shape(struct wl_listener *listener, void *data)
 		return;
 	}
 
-	wlr_log(WLR_DEBUG, "set xcursor to shape %s", shape_name);
+	lab_log(LAB_LOG_CURSOR, "set xcursor to shape %s", shape_name);
 	wlr_cursor_set_xcursor(seat->cursor, seat->xcursor_manager, shape_name);
 }
 
@@ -265,8 +268,9 @@ handle_request_set_primary_selection(struct wl_listener *listener, void *data)
 }
 
 static void
-process_cursor_move(struct server *server, uint32_t time)
+apply_cursor_move(struct server *server)
 {
+	server->move_deferred = false;
 	struct view *view = server->grabbed_view;
 
 	int x = server->grab_box.x + (server->seat.cursor->x - server->grab_x);
@@ -303,6 +307,52 @@ process_cursor_move(struct server *server, uint32_t time)
 	overlay_update(&server->seat);
 }
 
+static void
+process_cursor_move(struct server *server, uint32_t time)
+{
+	/*
+	 * Each move updates the scene, the outputs of the view and the
+	 * snapping overlay. With high polling rates, there are several
+	 * motion events per frame, so only the latest position is applied
+	 * just before the next frame is rendered.
+	 */
+	if (server->move_deferred) {
+		return;
+	}
+	struct output *output = output_nearest_to_cursor(server);
+	if (!output_is_usable(output)) {
+		apply_cursor_move(server);
+		return;
+	}
+	server->move_deferred = true;
+	/* Flushed by handle_output_frame() */
+	wlr_output_schedule_frame(output->wlr_output);
+}
+
+void
+cursor_flush_move(struct server *server)
+{
+	if (!server->move_deferred) {
+		return;
+	}
+	if (server->input_mode != LAB_INPUT_STATE_MOVE
+			|| !server->grabbed_view) {
+		server->move_deferred = false;
+		return;
+	}
+	apply_cursor_move(server);
+}
+
+static bool
+resize_is_client_paced(struct view *view)
+{
+	/* Only xdg-shell clients ack configure requests */
+	return rc.resize_client_paced && rc.resize_draw_contents
+		&& view->type == LAB_XDG_SHELL_VIEW;
+}
+
+static void apply_cursor_resize(struct server *server);
+
 static void
 process_cursor_resize(struct server *server, uint32_t time)
 {
@@ -311,7 +361,19 @@ process_cursor_resize(struct server *server, uint32_t time)
 	static struct view *last_resize_view = NULL;
 
 	assert(server->grabbed_view);
-	if (server->grabbed_view == last_resize_view) {
+	if (resize_is_client_paced(server->grabbed_view)) {
+		/*
+		 * Let the client set the pace: while it has not acked the
+		 * previous configure, only remember that the pointer moved.
+		 * cursor_flush_resize() picks up the latest geometry once
+		 * the client catches up, so no backlog of stale sizes can
+		 * build up with slow clients.
+		 */
+		if (server->grabbed_view->pending_configure_serial) {
+			server->resize_deferred = true;
+			return;
+		}
+	} else if (server->grabbed_view == last_resize_view) {
 		int32_t refresh = 0;
 		if (output_is_usable(last_resize_view->output)) {
 			refresh = last_resize_view->output->wlr_output->refresh;
@@ -328,6 +390,13 @@ process_cursor_resize(struct server *server, uint32_t time)
 
 	last_resize_time = time;
 	last_resize_view = server->grabbed_view;
+	apply_cursor_resize(server);
+}
+
+static void
+apply_cursor_resize(struct server *server)
+{
+	server->resize_deferred = false;
 
 	double dx = server->seat.cursor->x - server->grab_x;
 	double dy = server->seat.cursor->y - server->grab_y;
@@ -373,6 +442,21 @@ process_cursor_resize(struct server *server, uint32_t time)
 	}
 }
 
+void
+cursor_flush_resize(struct view *view, bool force)
+{
+	struct server *server = view->server;
+	if (server->input_mode != LAB_INPUT_STATE_RESIZE
+			|| server->grabbed_view != view
+			|| !server->resize_deferred) {
+		return;
+	}
+	if (view->pending_configure_serial && !force) {
+		return;
+	}
+	apply_cursor_resize(server);
+}
+
 void
 cursor_set(struct seat *seat, enum lab_cursors cursor)
 {
@@ -622,6 +706,9 @@ cursor_get_resize_edges(struct wlr_cursor *cursor, struct cursor_context *ctx)
 bool
 cursor_process_motion(struct server *server, uint32_t time, double *sx, double *sy)
 {
+	/* Hardware cursors do not damage the scene, so tell the magnifier */
+	magnifier_handle_cursor_motion(server);
+
 	/* If the mode is non-passthrough, delegate to those functions. */
 	if (server->input_mode == LAB_INPUT_STATE_MOVE) {
 		process_cursor_move(server, time);
@@ -632,8 +719,9 @@ cursor_process_motion(struct server *server, uint32_t time, double *sx, double *
 	}
 
 	/* Otherwise, find view under the pointer and send the event along */
-	struct cursor_context ctx = get_cursor_context(server);
 	struct seat *seat = &server->seat;
+	struct cursor_context ctx =
+		get_cursor_context_cached(server, &seat->motion_ctx);
 
 	if (ctx.type == LAB_NODE_MENUITEM) {
 		menu_process_cursor_motion(ctx.node);
@@ -873,6 +961,67 @@ cursor_locked(struct seat *seat, struct wlr_pointer *pointer)
 			== seat->seat->pointer_state.focused_surface;
 }
 
+void
+cursor_flush_motion(struct seat *seat)
+{
+	if (!seat->coalesced_motion.pending) {
+		return;
+	}
+	seat->coalesced_motion.pending = false;
+
+	double sx, sy;
+	uint32_t time_msec = seat->coalesced_motion.time_msec;
+	bool notify = cursor_process_motion(seat->server, time_msec, &sx, &sy);
+	if (notify) {
+		wlr_seat_pointer_notify_motion(seat->seat, time_msec, sx, sy);
+		input_latency_input(seat->seat->pointer_state.focused_surface,
+			time_msec);
+	}
+	/* The frame event of the original motion has been suppressed */
+	wlr_seat_pointer_notify_frame(seat->seat);
+}
+
+static int
+handle_coalesced_motion_timer(void *data)
+{
+	struct seat *seat = data;
+	cursor_flush_motion(seat);
+	return 0;
+}
+
+/*
+ * Returns true if the motion will be processed later, after merging it
+ * with subsequent motion events.
+ */
+static bool
+coalesce_motion(struct seat *seat, uint32_t time_msec)
+{
+	if (rc.motion_coalescing == LAB_MOTION_COALESCING_OFF) {
+		return false;
+	}
+
+	bool was_pending = seat->coalesced_motion.pending;
+	seat->coalesced_motion.pending = true;
+	seat->coalesced_motion.time_msec = time_msec;
+	if (was_pending) {
+		return true;
+	}
+
+	if (rc.motion_coalescing == LAB_MOTION_COALESCING_FRAME) {
+		struct output *output = output_nearest_to_cursor(seat->server);
+		if (!output_is_usable(output)) {
+			seat->coalesced_motion.pending = false;
+			return false;
+		}
+		/* Flushed by handle_output_frame() */
+		wlr_output_schedule_frame(output->wlr_output);
+	} else {
+		wl_event_source_timer_update(seat->coalesced_motion.timer,
+			rc.motion_coalescing);
+	}
+	return true;
+}
+
 static void
 preprocess_cursor_motion(struct seat *seat, struct wlr_pointer *pointer,
 		uint32_t time_msec, double dx, double dy)
@@ -891,10 +1040,15 @@ preprocess_cursor_motion(struct seat *seat, struct wlr_pointer *pointer,
 	 * without any input.
 	 */
 	wlr_cursor_move(seat->cursor, &pointer->base, dx, dy);
+	if (coalesce_motion(seat, time_msec)) {
+		return;
+	}
 	double sx, sy;
 	bool notify = cursor_process_motion(seat->server, time_msec, &sx, &sy);
 	if (notify) {
 		wlr_seat_pointer_notify_motion(seat->seat, time_msec, sx, sy);
+		input_latency_input(seat->seat->pointer_state.focused_surface,
+			time_msec);
 	}
 }
 
@@ -1165,7 +1319,7 @@ cursor_process_button_press(struct seat *seat, uint32_t button, uint32_t time_ms
 	 * the Focus action (used for normal views) does not work.
 	 */
 	if (ctx.type == LAB_NODE_LAYER_SURFACE) {
-		wlr_log(WLR_DEBUG, "press on layer-(sub)surface");
+		lab_log(LAB_LOG_CURSOR, "press on layer-(sub)surface");
 		struct wlr_layer_surface_v1 *layer = get_root_layer(ctx.surface);
 		if (layer && layer->current.keyboard_interactive) {
 			layer_try_set_focus(seat, layer);
@@ -1293,6 +1447,7 @@ handle_button(struct wl_listener *listener, void *data)
 	struct wlr_pointer_button_event *event = data;
 	idle_manager_notify_activity(seat->seat);
 	cursor_set_visible(seat, /* visible */ true);
+	cursor_flush_motion(seat);
 
 	bool notify;
 	switch (event->state) {
@@ -1302,6 +1457,9 @@ handle_button(struct wl_listener *listener, void *data)
 		if (notify) {
 			wlr_seat_pointer_notify_button(seat->seat, event->time_msec,
 				event->button, event->state);
+			input_latency_input(
+				seat->seat->pointer_state.focused_surface,
+				event->time_msec);
 		}
 		break;
 	case WL_POINTER_BUTTON_STATE_RELEASED:
@@ -1310,6 +1468,9 @@ handle_button(struct wl_listener *listener, void *data)
 		if (notify) {
 			wlr_seat_pointer_notify_button(seat->seat, event->time_msec,
 				event->button, event->state);
+			input_latency_input(
+				seat->seat->pointer_state.focused_surface,
+				event->time_msec);
 		}
 		cursor_finish_button_release(seat, event->button);
 		break;
@@ -1392,6 +1553,14 @@ process_cursor_axis(struct server *server, enum wl_pointer_axis orientation,
 		wlr_log(WLR_DEBUG, "Failed to handle cursor axis event");
 	}
 
+	if (ctx.type == LAB_NODE_MENUITEM) {
+		if (orientation == WL_POINTER_AXIS_VERTICAL_SCROLL
+				&& info.run_action) {
+			menu_process_cursor_axis(ctx.node, info.direction);
+		}
+		return false;
+	}
+
 	bool consumed = false;
 	if (direction != LAB_DIRECTION_INVALID) {
 		struct mousebind *mousebind;
@@ -1440,6 +1609,7 @@ handle_axis(struct wl_listener *listener, void *data)
 	struct wlr_pointer_axis_event *event = data;
 	idle_manager_notify_activity(seat->seat);
 	cursor_set_visible(seat, /* visible */ true);
+	cursor_flush_motion(seat);
 
 	/* input->scroll_factor is set for pointer/touch devices */
 	assert(event->pointer->base.type == WLR_INPUT_DEVICE_POINTER
@@ -1470,6 +1640,10 @@ handle_frame(struct wl_listener *listener, void *data)
 	 * between.
 	 */
 	struct seat *seat = wl_container_of(listener, seat, on_cursor.frame);
+	if (seat->coalesced_motion.pending) {
+		/* Sent by cursor_flush_motion() instead */
+		return;
+	}
 	/* Notify the client with pointer focus of the frame event. */
 	wlr_seat_pointer_notify_frame(seat->seat);
 }
@@ -1505,7 +1679,7 @@ cursor_emulate_move(struct seat *seat, struct wlr_input_device *device,
 		double dx, double dy, uint32_t time_msec)
 {
 	if (!dx && !dy) {
-		wlr_log(WLR_DEBUG, "dropping useless cursor_emulate: %.10f,%.10f", dx, dy);
+		lab_log(LAB_LOG_CURSOR, "dropping useless cursor_emulate: %.10f,%.10f", dx, dy);
 		return;
 	}
 
@@ -1519,6 +1693,8 @@ cursor_emulate_move(struct seat *seat, struct wlr_input_device *device,
 	bool notify = cursor_process_motion(seat->server, time_msec, &sx, &sy);
 	if (notify) {
 		wlr_seat_pointer_notify_motion(seat->seat, time_msec, sx, sy);
+		input_latency_input(seat->seat->pointer_state.focused_surface,
+			time_msec);
 	}
 	wlr_seat_pointer_notify_frame(seat->seat);
 }
@@ -1547,12 +1723,18 @@ cursor_emulate_button(struct seat *seat, uint32_t button,
 		notify = cursor_process_button_press(seat, button, time_msec);
 		if (notify) {
 			wlr_seat_pointer_notify_button(seat->seat, time_msec, button, state);
+			input_latency_input(
+				seat->seat->pointer_state.focused_surface,
+				time_msec);
 		}
 		break;
 	case WL_POINTER_BUTTON_STATE_RELEASED:
 		notify = cursor_process_button_release(seat, button, time_msec);
 		if (notify) {
 			wlr_seat_pointer_notify_button(seat->seat, time_msec, button, state);
+			input_latency_input(
+				seat->seat->pointer_state.focused_surface,
+				time_msec);
 		}
 		cursor_finish_button_release(seat, button);
 		break;
@@ -1560,18 +1742,69 @@ cursor_emulate_button(struct seat *seat, uint32_t button,
 	wlr_seat_pointer_notify_frame(seat->seat);
 }
 
+/*
+ * The size to load the cursor theme at. With <mouse><hardwareCursorMaxSize>,
+ * cursors that would be larger than that on the output with the highest
+ * scale are loaded smaller, so that they still fit the cursor plane instead
+ * of falling back to a software cursor.
+ */
+static uint32_t
+cursor_theme_size(struct seat *seat)
+{
+	const char *xcursor_size = getenv("XCURSOR_SIZE");
+	uint32_t size = xcursor_size ? atoi(xcursor_size) : 24;
+	if (!rc.hardware_cursor_max_size) {
+		return size;
+	}
+
+	float max_scale = 1;
+	struct output *output;
+	wl_list_for_each(output, &seat->server->outputs, link) {
+		if (output->wlr_output->enabled) {
+			max_scale = MAX(max_scale, output->wlr_output->scale);
+		}
+	}
+	uint32_t max_size = rc.hardware_cursor_max_size / max_scale;
+	return MAX(MIN(size, max_size), 1);
+}
+
+void
+cursor_preload_scales(struct seat *seat)
+{
+	/* A new highest scale may require a smaller theme size */
+	if (seat->xcursor_manager
+			&& seat->xcursor_manager->size != cursor_theme_size(seat)) {
+		cursor_reload(seat);
+		return;
+	}
+
+	/*
+	 * Loading a theme reads all of its cursors for one scale. wlr_cursor
+	 * loads scales on demand when setting an image, which makes the
+	 * first cursor change on a newly used scale hitch, so load them
+	 * up front. Scales which are already loaded are skipped.
+	 */
+	struct output *output;
+	wl_list_for_each(output, &seat->server->outputs, link) {
+		if (output->wlr_output->enabled) {
+			wlr_xcursor_manager_load(seat->xcursor_manager,
+				output->wlr_output->scale);
+		}
+	}
+}
+
 static void
 cursor_load(struct seat *seat)
 {
 	const char *xcursor_theme = getenv("XCURSOR_THEME");
-	const char *xcursor_size = getenv("XCURSOR_SIZE");
-	uint32_t size = xcursor_size ? atoi(xcursor_size) : 24;
+	uint32_t size = cursor_theme_size(seat);
 
 	if (seat->xcursor_manager) {
 		wlr_xcursor_manager_destroy(seat->xcursor_manager);
 	}
 	seat->xcursor_manager = wlr_xcursor_manager_create(xcursor_theme, size);
 	wlr_xcursor_manager_load(seat->xcursor_manager, 1);
+	cursor_preload_scales(seat);
 
 	/*
 	 * Wlroots provides integrated fallback cursor icons using
@@ -1632,6 +1865,9 @@ cursor_init(struct seat *seat)
 	CONNECT_SIGNAL(seat->cursor, &seat->on_cursor, axis);
 	CONNECT_SIGNAL(seat->cursor, &seat->on_cursor, frame);
 
+	seat->coalesced_motion.timer = wl_event_loop_add_timer(
+		seat->server->wl_event_loop, handle_coalesced_motion_timer, seat);
+
 	gestures_init(seat);
 	touch_init(seat);
 	tablet_init(seat);
@@ -1659,6 +1895,11 @@ void cursor_finish(struct seat *seat)
 	wl_list_remove(&seat->on_cursor.axis.link);
 	wl_list_remove(&seat->on_cursor.frame.link);
 
+	if (seat->coalesced_motion.timer) {
+		wl_event_source_remove(seat->coalesced_motion.timer);
+		seat->coalesced_motion.timer = NULL;
+	}
+
 	gestures_finish(seat);
 	touch_finish(seat);
 
@@ -5,6 +5,7 @@
 #include "common/macros.h"
 #include "labwc.h"
 #include "idle.h"
+#include "workspace-swipe.h"
 
 static void
 handle_pinch_begin(struct wl_listener *listener, void *data)
@@ -55,6 +56,9 @@ handle_swipe_begin(struct wl_listener *listener, void *data)
 	idle_manager_notify_activity(seat->seat);
 	cursor_set_visible(seat, /* visible */ true);
 
+	if (workspace_swipe_begin(seat->server, event->fingers)) {
+		return;
+	}
 	wlr_pointer_gestures_v1_send_swipe_begin(seat->pointer_gestures,
 		seat->seat, event->time_msec, event->fingers);
 }
@@ -68,6 +72,9 @@ handle_swipe_update(struct wl_listener *listener, void *data)
 	idle_manager_notify_activity(seat->seat);
 	cursor_set_visible(seat, /* visible */ true);
 
+	if (workspace_swipe_update(seat->server, event->time_msec, event->dx)) {
+		return;
+	}
 	wlr_pointer_gestures_v1_send_swipe_update(seat->pointer_gestures,
 		seat->seat, event->time_msec, event->dx, event->dy);
 }
@@ -81,6 +88,9 @@ handle_swipe_end(struct wl_listener *listener, void *data)
 	idle_manager_notify_activity(seat->seat);
 	cursor_set_visible(seat, /* visible */ true);
 
+	if (workspace_swipe_end(seat->server, event->cancelled)) {
+		return;
+	}
 	wlr_pointer_gestures_v1_send_swipe_end(seat->pointer_gestures,
 		seat->seat, event->time_msec, event->cancelled);
 }
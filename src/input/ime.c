@@ -174,6 +174,36 @@ update_text_inputs_focused_surface(struct input_method_relay *relay)
 	}
 }
 
+/* Returns false if the focused surface doesn't support a cursor rectangle */
+static bool
+resolve_anchor(struct input_method_relay *relay)
+{
+	if (relay->anchor.valid) {
+		return relay->anchor.supported;
+	}
+	relay->anchor.valid = true;
+
+	struct wlr_xdg_surface *xdg_surface =
+		wlr_xdg_surface_try_from_wlr_surface(relay->focused_surface);
+	struct wlr_layer_surface_v1 *layer_surface =
+		wlr_layer_surface_v1_try_from_wlr_surface(relay->focused_surface);
+	relay->anchor.supported = xdg_surface || layer_surface;
+	relay->anchor.xdg_surface = xdg_surface;
+	if (!relay->anchor.supported) {
+		return false;
+	}
+
+	/*
+	 * wlr_surface->data is:
+	 * - for XDG surfaces: view->content_tree
+	 * - for layer surfaces: lab_layer_surface->scene_layer_surface->tree
+	 * - for layer popups: lab_layer_popup->scene_tree
+	 */
+	struct wlr_scene_tree *tree = relay->focused_surface->data;
+	wlr_scene_node_coords(&tree->node, &relay->anchor.lx, &relay->anchor.ly);
+	return true;
+}
+
 static void
 update_popup_position(struct input_method_popup *popup)
 {
@@ -186,36 +216,30 @@ update_popup_position(struct input_method_popup *popup)
 		return;
 	}
 
-	struct wlr_box cursor_rect;
-	struct wlr_xdg_surface *xdg_surface =
-		wlr_xdg_surface_try_from_wlr_surface(relay->focused_surface);
-	struct wlr_layer_surface_v1 *layer_surface =
-		wlr_layer_surface_v1_try_from_wlr_surface(relay->focused_surface);
-
+	struct wlr_box cursor_rect = {0};
 	if ((text_input->input->current.features
 			& WLR_TEXT_INPUT_V3_FEATURE_CURSOR_RECTANGLE)
-			&& (xdg_surface || layer_surface)) {
+			&& resolve_anchor(relay)) {
 		cursor_rect = text_input->input->current.cursor_rectangle;
+		cursor_rect.x += relay->anchor.lx;
+		cursor_rect.y += relay->anchor.ly;
 
-		/*
-		 * wlr_surface->data is:
-		 * - for XDG surfaces: view->content_tree
-		 * - for layer surfaces: lab_layer_surface->scene_layer_surface->tree
-		 * - for layer popups: lab_layer_popup->scene_tree
-		 */
-		struct wlr_scene_tree *tree = relay->focused_surface->data;
-		int lx, ly;
-		wlr_scene_node_coords(&tree->node, &lx, &ly);
-		cursor_rect.x += lx;
-		cursor_rect.y += ly;
-
+		struct wlr_xdg_surface *xdg_surface = relay->anchor.xdg_surface;
 		if (xdg_surface) {
 			/* Take into account invisible xdg-shell CSD borders */
 			cursor_rect.x -= xdg_surface->geometry.x;
 			cursor_rect.y -= xdg_surface->geometry.y;
 		}
-	} else {
-		cursor_rect = (struct wlr_box){0};
+	}
+
+	/* Make sure IME popups are always on top, above layer-shell surfaces */
+	wlr_scene_node_raise_to_top(&relay->popup_tree->node);
+
+	int width = popup->popup_surface->surface->current.width;
+	int height = popup->popup_surface->surface->current.height;
+	if (popup->positioned && wlr_box_equal(&cursor_rect, &popup->cursor_rect)
+			&& width == popup->width && height == popup->height) {
+		return;
 	}
 
 	struct output *output =
@@ -238,8 +262,8 @@ update_popup_position(struct input_method_popup *popup)
 			XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_FLIP_Y
 			| XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_SLIDE_X,
 		.size = {
-			.width = popup->popup_surface->surface->current.width,
-			.height = popup->popup_surface->surface->current.height,
+			.width = width,
+			.height = height,
 		},
 	};
 
@@ -249,8 +273,10 @@ update_popup_position(struct input_method_popup *popup)
 
 	wlr_scene_node_set_position(
 		&popup->tree->node, popup_box.x, popup_box.y);
-	/* Make sure IME popups are always on top, above layer-shell surfaces */
-	wlr_scene_node_raise_to_top(&relay->popup_tree->node);
+	popup->positioned = true;
+	popup->cursor_rect = cursor_rect;
+	popup->width = width;
+	popup->height = height;
 
 	wlr_input_popup_surface_v2_send_text_input_rectangle(
 		popup->popup_surface, &(struct wlr_box){
@@ -620,7 +646,22 @@ input_method_relay_set_focus(struct input_method_relay *relay,
 		wl_signal_add(&surface->events.destroy,
 			&relay->focused_surface_destroy);
 	}
+	input_method_relay_invalidate(relay);
 
 	update_text_inputs_focused_surface(relay);
 	update_active_text_input(relay);
 }
+
+void
+input_method_relay_invalidate(struct input_method_relay *relay)
+{
+	/* NULL after seat_finish() */
+	if (!relay) {
+		return;
+	}
+	relay->anchor.valid = false;
+	struct input_method_popup *popup;
+	wl_list_for_each(popup, &relay->popups, link) {
+		popup->positioned = false;
+	}
+}
@@ -4,12 +4,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "common/set.h"
+#include "common/bitset.h"
 
-static struct lab_set pressed, bound, pressed_sent;
+static struct lab_bitset pressed, bound;
+
+/* Filled by key_state_pressed_sent_keycodes() */
+static uint32_t pressed_sent[LAB_BITSET_MAX_VALUE + 1];
+static int nr_pressed_sent;
 
 static void
-report(struct lab_set *key_set, const char *msg)
+report(struct lab_bitset *key_set, const char *msg)
 {
 	static char *should_print;
 	static bool has_run;
@@ -22,8 +26,10 @@ report(struct lab_set *key_set, const char *msg)
 		return;
 	}
 	printf("%s", msg);
-	for (int i = 0; i < key_set->size; ++i) {
-		printf("%d,", key_set->values[i]);
+	for (uint32_t i = 0; i <= LAB_BITSET_MAX_VALUE; ++i) {
+		if (lab_bitset_contains(key_set, i)) {
+			printf("%u,", i);
+		}
 	}
 	printf("\n");
 }
@@ -35,52 +41,52 @@ key_state_pressed_sent_keycodes(void)
 	report(&bound, "before - bound:");
 
 	/* pressed_sent = pressed - bound */
-	pressed_sent = pressed;
-	for (int i = 0; i < bound.size; ++i) {
-		lab_set_remove(&pressed_sent, bound.values[i]);
-	}
+	struct lab_bitset sent;
+	lab_bitset_subtract(&sent, &pressed, &bound);
+	nr_pressed_sent = lab_bitset_to_array(&sent, pressed_sent,
+		LAB_BITSET_MAX_VALUE + 1);
 
-	report(&pressed_sent, "after - pressed_sent:");
+	report(&sent, "after - pressed_sent:");
 
-	return pressed_sent.values;
+	return pressed_sent;
 }
 
 int
 key_state_nr_pressed_sent_keycodes(void)
 {
-	return pressed_sent.size;
+	return nr_pressed_sent;
 }
 
 void
 key_state_set_pressed(uint32_t keycode, bool is_pressed)
 {
 	if (is_pressed) {
-		lab_set_add(&pressed, keycode);
+		lab_bitset_add(&pressed, keycode);
 	} else {
-		lab_set_remove(&pressed, keycode);
+		lab_bitset_remove(&pressed, keycode);
 	}
 }
 
 void
 key_state_store_pressed_key_as_bound(uint32_t keycode)
 {
-	lab_set_add(&bound, keycode);
+	lab_bitset_add(&bound, keycode);
 }
 
 bool
 key_state_corresponding_press_event_was_bound(uint32_t keycode)
 {
-	return lab_set_contains(&bound, keycode);
+	return lab_bitset_contains(&bound, keycode);
 }
 
 void
 key_state_bound_key_remove(uint32_t keycode)
 {
-	lab_set_remove(&bound, keycode);
+	lab_bitset_remove(&bound, keycode);
 }
 
 int
 key_state_nr_bound_keys(void)
 {
-	return bound.size;
+	return lab_bitset_count(&bound);
 }
@@ -3,9 +3,11 @@
 #include "input/keyboard.h"
 #include <assert.h>
 #include <errno.h>
+#include <glib.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <wlr/backend/session.h>
 #include <wlr/interfaces/wlr_keyboard.h>
@@ -13,6 +15,7 @@
 #include <wlr/types/wlr_seat.h>
 #include "action.h"
 #include "common/buf.h"
+#include "common/log.h"
 #include "common/macros.h"
 #include "common/mem.h"
 #include "common/spawn.h"
@@ -20,12 +23,17 @@
 #include "config/rcxml.h"
 #include "cycle.h"
 #include "idle.h"
+#include "input-latency.h"
+#include "input/condition-helper.h"
 #include "input/ime.h"
 #include "input/key-state.h"
 #include "labwc.h"
 #include "menu/menu.h"
 #include "session-lock.h"
+#include "timer.h"
+#include "trace.h"
 #include "view.h"
+#include "window-rules.h"
 #include "workspaces.h"
 
 enum lab_key_handled {
@@ -53,6 +61,13 @@ static struct keybind *cur_keybind;
 
 #define KEYBIND_CONDITION_TIMEOUT_MS 2000  /* 2 seconds */
 
+enum keybind_condition_state {
+	KEYBIND_CONDITION_MET,
+	KEYBIND_CONDITION_NOT_MET,
+	/* Condition command is running or failed to start */
+	KEYBIND_CONDITION_PENDING,
+};
+
 struct keybind_condition_context {
 	struct keybind *keybind;
 	struct server *server;
@@ -61,7 +76,7 @@ struct keybind_condition_context {
 	uint32_t time_msec;
 	struct buf buf;
 	struct wl_event_source *event_read;
-	struct wl_event_source *event_timeout;
+	struct lab_timer *event_timeout;
 	pid_t pid;
 	int pipe_fd;
 	bool cleaned_up;
@@ -113,7 +128,53 @@ seat_client_from_keyboard_resource(struct wl_resource *resource)
 }
 
 static void
-broadcast_modifiers_to_unfocused_clients(struct wlr_seat *seat,
+send_modifiers(struct wlr_seat_client *client,
+		const struct wlr_keyboard_modifiers *modifiers)
+{
+	uint32_t serial = wlr_seat_client_next_serial(client);
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &client->keyboards) {
+		if (!seat_client_from_keyboard_resource(resource)) {
+			continue;
+		}
+		wl_keyboard_send_modifiers(resource, serial,
+			modifiers->depressed, modifiers->latched,
+			modifiers->locked, modifiers->group);
+	}
+}
+
+/* Send to @client unless it is keyboard-focused or already in @sent */
+static void
+send_modifiers_once(struct wlr_seat *seat, struct wlr_seat_client *client,
+		const struct wlr_keyboard_modifiers *modifiers, struct wl_array *sent)
+{
+	if (!client || client == seat->keyboard_state.focused_client) {
+		/*
+		 * We've already notified the focused client by calling
+		 * wlr_seat_keyboard_notify_modifiers()
+		 */
+		return;
+	}
+	struct wlr_seat_client **iter;
+	wl_array_for_each(iter, sent) {
+		if (*iter == client) {
+			return;
+		}
+	}
+	struct wlr_seat_client **slot = wl_array_add(sent, sizeof(*slot));
+	if (slot) {
+		*slot = client;
+	}
+	send_modifiers(client, modifiers);
+}
+
+/*
+ * Modifiers are passed to the pointer-focused client, like KWin and
+ * Weston do, and to clients of views with the receiveModifiers window
+ * rule property. Other clients are not woken up.
+ */
+static void
+broadcast_modifiers_to_unfocused_clients(struct seat *seat,
 		const struct keyboard *keyboard,
 		const struct wlr_keyboard_modifiers *modifiers)
 {
@@ -122,31 +183,54 @@ broadcast_modifiers_to_unfocused_clients(struct wlr_seat *seat,
 		return;
 	}
 
-	struct wlr_seat_client *client;
-	wl_list_for_each(client, &seat->clients, link) {
-		if (client == seat->keyboard_state.focused_client) {
-			/*
-			 * We've already notified the focused client by calling
-			 * wlr_seat_keyboard_notify_modifiers()
-			 */
-			continue;
-		}
-		uint32_t serial = wlr_seat_client_next_serial(client);
-		struct wl_resource *resource;
-		wl_resource_for_each(resource, &client->keyboards) {
-			if (!seat_client_from_keyboard_resource(resource)) {
+	/* Keyboard groups may report the same state more than once */
+	static struct wlr_keyboard_modifiers last;
+	static bool has_last;
+	if (has_last && !memcmp(&last, modifiers, sizeof(last))) {
+		return;
+	}
+	last = *modifiers;
+	has_last = true;
+
+	struct wlr_seat *wlr_seat = seat->seat;
+	struct wl_array sent;
+	wl_array_init(&sent);
+	send_modifiers_once(wlr_seat, wlr_seat->pointer_state.focused_client,
+		modifiers, &sent);
+
+	if (window_rules_sets_property(WINDOW_RULE_PROP_RECEIVE_MODIFIERS)) {
+		struct view *view;
+		wl_list_for_each(view, &seat->server->views, link) {
+			if (!view->mapped || !view->surface
+					|| window_rules_get_property(view,
+						WINDOW_RULE_PROP_RECEIVE_MODIFIERS)
+						!= LAB_PROP_TRUE) {
 				continue;
 			}
-			if (!modifiers) {
-				wl_keyboard_send_modifiers(resource, serial, 0,
-					0, 0, 0);
-			} else {
-				wl_keyboard_send_modifiers(resource, serial,
-					modifiers->depressed, modifiers->latched,
-					modifiers->locked, modifiers->group);
-			}
+			struct wl_client *wl_client =
+				wl_resource_get_client(view->surface->resource);
+			send_modifiers_once(wlr_seat,
+				wlr_seat_client_for_wl_client(wlr_seat, wl_client),
+				modifiers, &sent);
 		}
 	}
+	wl_array_release(&sent);
+}
+
+void
+keyboard_send_modifiers_on_pointer_enter(struct seat *seat,
+		struct wlr_surface *surface)
+{
+	struct wlr_seat *wlr_seat = seat->seat;
+	if (!surface || !seat->keyboard_group) {
+		return;
+	}
+	struct wlr_seat_client *client = wlr_seat_client_for_wl_client(wlr_seat,
+		wl_resource_get_client(surface->resource));
+	if (!client || client == wlr_seat->keyboard_state.focused_client) {
+		return;
+	}
+	send_modifiers(client, &seat->keyboard_group->keyboard.modifiers);
 }
 
 static void
@@ -201,11 +285,11 @@ handle_modifiers(struct wl_listener *listener, void *data)
 		 * clients, whereas KWin and Weston pass modifiers to clients
 		 * with pointer-focus.
 		 *
-		 * This could be made configurable if there are unintended
-		 * consequences. If so, modifiers ought to still be passed to
-		 * clients with pointer-focus (see issue #2271)
+		 * We do the same, as modifiers ought to be passed to clients
+		 * with pointer-focus (see issue #2271). Other clients can opt
+		 * in with the receiveModifiers window rule property.
 		 */
-		broadcast_modifiers_to_unfocused_clients(seat->seat,
+		broadcast_modifiers_to_unfocused_clients(seat,
 			keyboard, &wlr_keyboard->modifiers);
 	}
 }
@@ -233,22 +317,22 @@ keybind_device_is_whitelisted(struct keybind *keybind, const char *device_name)
 		return true;
 	}
 	if (!device_name) {
-		wlr_log(WLR_INFO, "keybind whitelist: device_name is NULL, blocking");
+		lab_log(LAB_LOG_KEYBOARD, "keybind whitelist: device_name is NULL, blocking");
 		return false;
 	}
-	wlr_log(WLR_INFO, "keybind whitelist: checking device '%s' against whitelist", device_name);
+	lab_log(LAB_LOG_KEYBOARD, "keybind whitelist: checking device '%s' against whitelist", device_name);
 	struct keybind_device_whitelist *entry;
 	wl_list_for_each(entry, &keybind->device_whitelist, link) {
 		if (entry->device_name) {
-			wlr_log(WLR_INFO, "keybind whitelist: comparing '%s' == '%s'", 
+			lab_log(LAB_LOG_KEYBOARD, "keybind whitelist: comparing '%s' == '%s'",
 				entry->device_name, device_name);
 			if (!strcasecmp(entry->device_name, device_name)) {
-				wlr_log(WLR_INFO, "keybind whitelist: MATCH FOUND!");
+				lab_log(LAB_LOG_KEYBOARD, "keybind whitelist: MATCH FOUND!");
 				return true;
 			}
 		}
 	}
-	wlr_log(WLR_INFO, "keybind whitelist: NO MATCH for device '%s'", device_name);
+	lab_log(LAB_LOG_KEYBOARD, "keybind whitelist: NO MATCH for device '%s'", device_name);
 	return false;
 }
 
@@ -256,65 +340,35 @@ static struct keybind *
 match_keybinding_for_sym(struct server *server, uint32_t modifiers,
 		xkb_keysym_t sym, xkb_keycode_t xkb_keycode, const char *device_name)
 {
-	struct keybind *keybind;
-	int keybind_count = 0;
-	wl_list_for_each(keybind, &rc.keybinds, link) {
-		keybind_count++;
-		if (modifiers ^ keybind->modifiers) {
-			wlr_log(WLR_DEBUG, "keybind #%d: modifier mismatch (have=0x%x, need=0x%x)",
-				keybind_count, modifiers, keybind->modifiers);
-			continue;
-		}
+	if (sym != XKB_KEY_NoSymbol) {
+		sym = xkb_keysym_to_lower(sym);
+	}
+
+	size_t nr_keybinds;
+	struct keybind **keybinds = keybind_index_lookup(modifiers, sym,
+		xkb_keycode, &nr_keybinds);
+	for (size_t i = 0; i < nr_keybinds; i++) {
+		struct keybind *keybind = keybinds[i];
 		if (!keybind->enabled) {
-			/* Log which keybind this is for debugging */
-			if (keybind->keysyms_len > 0) {
-				wlr_log(WLR_INFO, "keybind #%d: disabled (keysym=%u/0x%x, modifiers=0x%x)",
-					keybind_count, keybind->keysyms[0], keybind->keysyms[0], keybind->modifiers);
-			} else {
-				wlr_log(WLR_DEBUG, "keybind #%d: disabled", keybind_count);
-			}
+			lab_log(LAB_LOG_KEYBOARD, "keybind %p: disabled", (void *)keybind);
 			continue;
 		}
 		if (view_inhibits_actions(server->active_view, &keybind->actions)) {
-			wlr_log(WLR_DEBUG, "keybind #%d: view inhibits actions", keybind_count);
+			lab_log(LAB_LOG_KEYBOARD, "keybind %p: view inhibits actions", (void *)keybind);
 			continue;
 		}
 		if (keybind_device_is_blacklisted(keybind, device_name)) {
-			wlr_log(WLR_DEBUG, "keybind #%d: blacklisted", keybind_count);
+			lab_log(LAB_LOG_KEYBOARD, "keybind %p: blacklisted", (void *)keybind);
 			continue;
 		}
 		if (!keybind_device_is_whitelisted(keybind, device_name)) {
-			wlr_log(WLR_INFO, "keybind #%d: blocked by whitelist check", keybind_count);
+			lab_log(LAB_LOG_KEYBOARD, "keybind %p: blocked by whitelist check",
+				(void *)keybind);
 			continue;
 		}
-		wlr_log(WLR_INFO, "keybind #%d: passed whitelist check, checking key match (sym=%u/0x%x, keycode=%u)...",
-			keybind_count, sym, sym, xkb_keycode);
-		wlr_log(WLR_INFO, "keybind #%d: has %zu keysyms, modifiers=0x%x", 
-			keybind_count, keybind->keysyms_len, keybind->modifiers);
-		for (size_t i = 0; i < keybind->keysyms_len; i++) {
-			wlr_log(WLR_INFO, "keybind #%d: keysym[%zu]=%u (0x%x)", 
-				keybind_count, i, keybind->keysyms[i], keybind->keysyms[i]);
-		}
-		if (sym == XKB_KEY_NoSymbol) {
-			/* Use keycodes */
-			if (keybind_contains_keycode(keybind, xkb_keycode)) {
-				wlr_log(WLR_INFO, "keybind #%d: KEYCODE MATCH! returning keybind", keybind_count);
-				return keybind;
-			} else {
-				wlr_log(WLR_INFO, "keybind #%d: keycode %u not in keybind", keybind_count, xkb_keycode);
-			}
-		} else {
-			/* Use syms */
-			xkb_keysym_t lower_sym = xkb_keysym_to_lower(sym);
-			wlr_log(WLR_INFO, "keybind #%d: checking if keysym %u (lower=%u) matches", 
-				keybind_count, sym, lower_sym);
-			if (keybind_contains_keysym(keybind, lower_sym)) {
-				wlr_log(WLR_INFO, "keybind #%d: KEYSYM MATCH! returning keybind", keybind_count);
-				return keybind;
-			} else {
-				wlr_log(WLR_INFO, "keybind #%d: keysym %u not in keybind", keybind_count, lower_sym);
-			}
-		}
+		lab_log(LAB_LOG_KEYBOARD, "keybind %p: matched (sym=0x%x, keycode=%u)",
+			(void *)keybind, sym, xkb_keycode);
+		return keybind;
 	}
 	return NULL;
 }
@@ -348,9 +402,9 @@ static struct keybind *
 match_keybinding(struct server *server, struct keyinfo *keyinfo,
 		bool is_virtual, const char *device_name)
 {
-	wlr_log(WLR_INFO, "match_keybinding: device='%s', is_virtual=%d, modifiers=0x%x",
+	lab_log(LAB_LOG_KEYBOARD, "match_keybinding: device='%s', is_virtual=%d, modifiers=0x%x",
 		device_name ? device_name : "NULL", is_virtual, keyinfo->modifiers);
-	wlr_log(WLR_INFO, "match_keybinding: translated syms=%d, raw syms=%d",
+	lab_log(LAB_LOG_KEYBOARD, "match_keybinding: translated syms=%d, raw syms=%d",
 		keyinfo->translated.nr_syms, keyinfo->raw.nr_syms);
 	if (!is_virtual) {
 		/* First try keycodes */
@@ -358,39 +412,39 @@ match_keybinding(struct server *server, struct keyinfo *keyinfo,
 			keyinfo->modifiers, XKB_KEY_NoSymbol, keyinfo->xkb_keycode,
 			device_name);
 		if (keybind) {
-			wlr_log(WLR_DEBUG, "keycode matched");
+			lab_log(LAB_LOG_KEYBOARD, "keycode matched");
 			return keybind;
 		}
 	}
 
 	/* Then fall back to keysyms */
 	for (int i = 0; i < keyinfo->translated.nr_syms; i++) {
-		wlr_log(WLR_INFO, "match_keybinding: trying translated keysym[%d]=%u", 
+		lab_log(LAB_LOG_KEYBOARD, "match_keybinding: trying translated keysym[%d]=%u",
 			i, keyinfo->translated.syms[i]);
 		struct keybind *keybind =
 			match_keybinding_for_sym(server, keyinfo->modifiers,
 				keyinfo->translated.syms[i], keyinfo->xkb_keycode,
 				device_name);
 		if (keybind) {
-			wlr_log(WLR_INFO, "translated keysym matched");
+			lab_log(LAB_LOG_KEYBOARD, "translated keysym matched");
 			return keybind;
 		}
 	}
 
 	/* And finally test for keysyms without modifier */
 	for (int i = 0; i < keyinfo->raw.nr_syms; i++) {
-		wlr_log(WLR_INFO, "match_keybinding: trying raw keysym[%d]=%u", 
+		lab_log(LAB_LOG_KEYBOARD, "match_keybinding: trying raw keysym[%d]=%u",
 			i, keyinfo->raw.syms[i]);
 		struct keybind *keybind =
 			match_keybinding_for_sym(server, keyinfo->modifiers,
 				keyinfo->raw.syms[i], keyinfo->xkb_keycode,
 				device_name);
 		if (keybind) {
-			wlr_log(WLR_INFO, "raw keysym matched");
+			lab_log(LAB_LOG_KEYBOARD, "raw keysym matched");
 			return keybind;
 		}
 	}
-	wlr_log(WLR_INFO, "match_keybinding: no keybind matched");
+	lab_log(LAB_LOG_KEYBOARD, "match_keybinding: no keybind matched");
 
 	return NULL;
 }
@@ -608,7 +662,7 @@ keybind_condition_cleanup(struct keybind_condition_context *ctx)
 		ctx->event_read = NULL;
 	}
 	if (ctx->event_timeout) {
-		wl_event_source_remove(ctx->event_timeout);
+		lab_timer_destroy(ctx->event_timeout);
 		ctx->event_timeout = NULL;
 	}
 	if (ctx->pipe_fd >= 0) {
@@ -623,11 +677,86 @@ static int
 keybind_condition_timeout(void *data)
 {
 	struct keybind_condition_context *ctx = data;
-	wlr_log(WLR_DEBUG, "Keybind condition check timed out");
+	lab_log(LAB_LOG_KEYBOARD, "Keybind condition check timed out");
 	keybind_condition_cleanup(ctx);
 	return 0;
 }
 
+static void
+keybind_condition_finish(struct keybind_condition_context *ctx,
+		const char *output)
+{
+	if (!output) {
+		output = "";
+	}
+
+	/* Copy output to local buffer before cleanup frees it */
+	char trimmed[4096] = {0};
+	size_t len = strlen(output);
+
+	/* Trim trailing newlines and whitespace */
+	while (len > 0 && (output[len - 1] == '\n' || output[len - 1] == '\r' || output[len - 1] == ' ' || output[len - 1] == '\t')) {
+		len--;
+	}
+
+	/* Copy to trimmed buffer */
+	if (len > 0 && len < sizeof(trimmed) - 1) {
+		memcpy(trimmed, output, len);
+		trimmed[len] = '\0';
+	}
+
+	bool matched = keybind_condition_matches(ctx->keybind, trimmed);
+	keybind_condition_cache_store(ctx->keybind, matched);
+
+	/* Store keybind and server before cleanup */
+	struct keybind *keybind = ctx->keybind;
+	struct server *server = ctx->server;
+	struct keyboard *keyboard = ctx->keyboard;
+	uint32_t keycode = ctx->keycode;
+	uint32_t time_msec = ctx->time_msec;
+
+	/* Cleanup now that we've copied everything we need */
+	keybind_condition_cleanup(ctx);
+
+	if (matched) {
+		lab_log(LAB_LOG_KEYBOARD, "Keybind condition matched, executing actions");
+		/* Key is already marked as bound, just execute actions */
+		actions_run(NULL, server, &keybind->actions, NULL);
+	} else {
+		lab_log(LAB_LOG_KEYBOARD, "Keybind condition did not match (output: '%s'), forwarding key", trimmed);
+		/* Condition didn't match - unmark as bound and forward the keypress */
+		key_state_bound_key_remove(keycode);
+		struct seat *seat = keyboard->base.seat;
+		struct wlr_seat *wlr_seat = seat->seat;
+		struct wlr_keyboard_key_event forward_event = {
+			.keycode = keycode,
+			.state = WL_KEYBOARD_KEY_STATE_PRESSED,
+			.time_msec = time_msec,
+			.update_state = false
+		};
+		if (!input_method_keyboard_grab_forward_key(keyboard, &forward_event)) {
+			wlr_seat_set_keyboard(wlr_seat, keyboard->wlr_keyboard);
+			wlr_seat_keyboard_notify_key(wlr_seat, time_msec, keycode,
+				WL_KEYBOARD_KEY_STATE_PRESSED);
+			input_latency_input(
+				wlr_seat->keyboard_state.focused_surface,
+				time_msec);
+		}
+	}
+}
+
+static void
+keybind_condition_answered(const char *answer, void *data)
+{
+	struct keybind_condition_context *ctx = data;
+	if (!answer) {
+		/* Helper failed or timed out */
+		keybind_condition_cleanup(ctx);
+		return;
+	}
+	keybind_condition_finish(ctx, answer);
+}
+
 static int
 keybind_condition_readable(int fd, uint32_t mask, void *data)
 {
@@ -646,72 +775,7 @@ keybind_condition_readable(int fd, uint32_t mask, void *data)
 
 	if (n == 0) {
 		/* EOF - command finished, check output */
-		const char *output = ctx->buf.data;
-		if (!output) {
-			output = "";
-		}
-		
-		/* Copy output to local buffer before cleanup frees it */
-		char trimmed[4096] = {0};
-		size_t len = strlen(output);
-		
-		/* Trim trailing newlines and whitespace */
-		while (len > 0 && (output[len - 1] == '\n' || output[len - 1] == '\r' || output[len - 1] == ' ' || output[len - 1] == '\t')) {
-			len--;
-		}
-		
-		/* Copy to trimmed buffer */
-		if (len > 0 && len < sizeof(trimmed) - 1) {
-			memcpy(trimmed, output, len);
-			trimmed[len] = '\0';
-		}
-
-		bool matched = false;
-		if (ctx->keybind->condition_values_len > 0) {
-			for (size_t i = 0; i < ctx->keybind->condition_values_len; i++) {
-				if (strcmp(trimmed, ctx->keybind->condition_values[i]) == 0) {
-					matched = true;
-					break;
-				}
-			}
-		} else {
-			/* If no values specified, any non-empty output is considered a match */
-			matched = (len > 0);
-		}
-
-		/* Store keybind and server before cleanup */
-		struct keybind *keybind = ctx->keybind;
-		struct server *server = ctx->server;
-		struct keyboard *keyboard = ctx->keyboard;
-		uint32_t keycode = ctx->keycode;
-		uint32_t time_msec = ctx->time_msec;
-
-		/* Cleanup now that we've copied everything we need */
-		keybind_condition_cleanup(ctx);
-
-		if (matched) {
-			wlr_log(WLR_DEBUG, "Keybind condition matched, executing actions");
-			/* Key is already marked as bound, just execute actions */
-			actions_run(NULL, server, &keybind->actions, NULL);
-		} else {
-			wlr_log(WLR_DEBUG, "Keybind condition did not match (output: '%s'), forwarding key", trimmed);
-			/* Condition didn't match - unmark as bound and forward the keypress */
-			key_state_bound_key_remove(keycode);
-			struct seat *seat = keyboard->base.seat;
-			struct wlr_seat *wlr_seat = seat->seat;
-			struct wlr_keyboard_key_event forward_event = {
-				.keycode = keycode,
-				.state = WL_KEYBOARD_KEY_STATE_PRESSED,
-				.time_msec = time_msec,
-				.update_state = false
-			};
-			if (!input_method_keyboard_grab_forward_key(keyboard, &forward_event)) {
-				wlr_seat_set_keyboard(wlr_seat, keyboard->wlr_keyboard);
-				wlr_seat_keyboard_notify_key(wlr_seat, time_msec, keycode,
-					WL_KEYBOARD_KEY_STATE_PRESSED);
-			}
-		}
-
+		keybind_condition_finish(ctx, ctx->buf.data);
 		return 0;
 	}
 
@@ -721,23 +785,51 @@ keybind_condition_readable(int fd, uint32_t mask, void *data)
 	return 0;
 }
 
-static bool
+static enum keybind_condition_state
 keybind_check_condition_async(struct keybind *keybind, struct server *server,
 		struct keyboard *keyboard, uint32_t keycode, uint32_t time_msec)
 {
 	if (!keybind->condition_command) {
 		/* No condition, execute immediately */
-		return true;
+		return KEYBIND_CONDITION_MET;
+	}
+
+	bool matched;
+	if (keybind_condition_cache_lookup(keybind, &matched)) {
+		lab_log(LAB_LOG_KEYBOARD, "keybind condition cache hit (%s): %s",
+			matched ? "met" : "not met", keybind->condition_command);
+		return matched ? KEYBIND_CONDITION_MET : KEYBIND_CONDITION_NOT_MET;
+	}
+	if (keybind->condition_cache_ms) {
+		lab_log(LAB_LOG_KEYBOARD, "keybind condition cache miss: %s",
+			keybind->condition_command);
 	}
 
-	wlr_log(WLR_DEBUG, "Checking keybind condition: %s", keybind->condition_command);
+	lab_log(LAB_LOG_KEYBOARD, "Checking keybind condition: %s", keybind->condition_command);
+
+	if (keybind->condition_use_helper) {
+		struct keybind_condition_context *ctx = znew(*ctx);
+		ctx->keybind = keybind;
+		ctx->server = server;
+		ctx->keyboard = keyboard;
+		ctx->keycode = keycode;
+		ctx->time_msec = time_msec;
+		ctx->buf = BUF_INIT;
+		ctx->pipe_fd = -1;
+		if (!condition_helper_query(server, keybind->condition_command,
+				KEYBIND_CONDITION_TIMEOUT_MS,
+				keybind_condition_answered, ctx)) {
+			keybind_condition_cleanup(ctx);
+		}
+		return KEYBIND_CONDITION_PENDING;
+	}
 
 	int pipe_fd = 0;
 	pid_t pid = spawn_piped(keybind->condition_command, &pipe_fd);
 	if (pid <= 0) {
 		wlr_log(WLR_ERROR, "Failed to spawn condition command: %s",
 			keybind->condition_command);
-		return false;
+		return KEYBIND_CONDITION_PENDING;
 	}
 
 	struct keybind_condition_context *ctx = znew(*ctx);
@@ -758,20 +850,15 @@ keybind_check_condition_async(struct keybind *keybind, struct server *server,
 	if (!ctx->event_read) {
 		wlr_log(WLR_ERROR, "Failed to add condition check file descriptor");
 		keybind_condition_cleanup(ctx);
-		return false;
+		return KEYBIND_CONDITION_PENDING;
 	}
 
-	ctx->event_timeout = wl_event_loop_add_timer(server->wl_event_loop,
-		keybind_condition_timeout, ctx);
-	if (!ctx->event_timeout) {
-		wlr_log(WLR_ERROR, "Failed to add condition check timeout");
-		keybind_condition_cleanup(ctx);
-		return false;
-	}
-	wl_event_source_timer_update(ctx->event_timeout, KEYBIND_CONDITION_TIMEOUT_MS);
+	ctx->event_timeout = lab_timer_create(keybind_condition_timeout, ctx,
+		/*slack_ms*/ 100);
+	lab_timer_update(ctx->event_timeout, KEYBIND_CONDITION_TIMEOUT_MS);
 
 	/* Condition check is in progress, don't execute actions yet */
-	return false;
+	return KEYBIND_CONDITION_PENDING;
 }
 
 static enum lab_key_handled
@@ -796,7 +883,8 @@ handle_compositor_keybindings(struct keyboard *keyboard,
 			}
 			/* Check condition if present, otherwise execute immediately */
 			if (keybind_check_condition_async(cur_keybind, server, keyboard,
-					event->keycode, event->time_msec)) {
+					event->keycode, event->time_msec)
+					== KEYBIND_CONDITION_MET) {
 				actions_run(NULL, server, &cur_keybind->actions, NULL);
 			}
 			/* For on_release, we always consume the release event */
@@ -842,30 +930,37 @@ handle_compositor_keybindings(struct keyboard *keyboard,
 	 */
 	cur_keybind = match_keybinding(server, &keyinfo, keyboard->is_virtual,
 		keyboard->base.wlr_input_device->name);
-	wlr_log(WLR_INFO, "match_keybinding returned: %s", cur_keybind ? "keybind found" : "NULL");
+	lab_log(LAB_LOG_KEYBOARD, "match_keybinding returned: %s", cur_keybind ? "keybind found" : "NULL");
 	if (cur_keybind) {
-		wlr_log(WLR_INFO, "keybind found: locked=%d, allow_when_locked=%d", 
+		lab_log(LAB_LOG_KEYBOARD, "keybind found: locked=%d, allow_when_locked=%d",
 			locked, cur_keybind->allow_when_locked);
 	}
 	if (cur_keybind && (!locked || cur_keybind->allow_when_locked)) {
-		wlr_log(WLR_INFO, "keybind passed lock check, executing...");
+		lab_log(LAB_LOG_KEYBOARD, "keybind passed lock check, executing...");
 		if (!cur_keybind->on_release) {
 			/* Check condition if present, otherwise execute immediately */
-			if (keybind_check_condition_async(cur_keybind, server, keyboard,
-					event->keycode, event->time_msec)) {
-				/* No condition or condition check failed, execute immediately */
+			enum keybind_condition_state condition =
+				keybind_check_condition_async(cur_keybind, server,
+					keyboard, event->keycode, event->time_msec);
+			if (condition == KEYBIND_CONDITION_NOT_MET) {
+				/* Cached result, forward the key right away */
+				cur_keybind = NULL;
+				return LAB_KEY_HANDLED_FALSE;
+			}
+			if (condition == KEYBIND_CONDITION_MET) {
+				/* No condition or condition cached as met, execute immediately */
 				int action_count = 0;
 				struct action *action;
 				wl_list_for_each(action, &cur_keybind->actions, link) {
 					action_count++;
 				}
-				wlr_log(WLR_INFO, "keybind: executing actions_run with %d action(s)", action_count);
+				lab_log(LAB_LOG_KEYBOARD, "keybind: executing actions_run with %d action(s)", action_count);
 				if (action_count == 0) {
 					wlr_log(WLR_ERROR, "keybind: WARNING - no actions in keybind!");
 				}
 				key_state_store_pressed_key_as_bound(event->keycode);
 				actions_run(NULL, server, &cur_keybind->actions, NULL);
-				wlr_log(WLR_INFO, "keybind: actions_run completed");
+				lab_log(LAB_LOG_KEYBOARD, "keybind: actions_run completed");
 				return LAB_KEY_HANDLED_TRUE;
 			} else {
 				/* Condition check is async - consume the key for now */
@@ -896,10 +991,11 @@ handle_keybind_repeat(void *data)
 		.state = WL_KEYBOARD_KEY_STATE_PRESSED
 	};
 
+	trace_begin("handle_compositor_keybindings");
 	handle_compositor_keybindings(keyboard, &event);
+	trace_end("handle_compositor_keybindings");
 	int next_repeat_ms = 1000 / keyboard->keybind_repeat_rate;
-	wl_event_source_timer_update(keyboard->keybind_repeat,
-		next_repeat_ms);
+	lab_timer_update(keyboard->keybind_repeat, next_repeat_ms);
 
 	return 0; /* ignored per wl_event_loop docs */
 }
@@ -915,9 +1011,10 @@ start_keybind_repeat(struct server *server, struct keyboard *keyboard,
 			&& wlr_keyboard->repeat_info.delay > 0) {
 		keyboard->keybind_repeat_keycode = event->keycode;
 		keyboard->keybind_repeat_rate = wlr_keyboard->repeat_info.rate;
-		keyboard->keybind_repeat = wl_event_loop_add_timer(
-			server->wl_event_loop, handle_keybind_repeat, keyboard);
-		wl_event_source_timer_update(keyboard->keybind_repeat,
+		/* Any delay would be noticeable */
+		keyboard->keybind_repeat = lab_timer_create(
+			handle_keybind_repeat, keyboard, /*slack_ms*/ 0);
+		lab_timer_update(keyboard->keybind_repeat,
 			wlr_keyboard->repeat_info.delay);
 	}
 }
@@ -926,7 +1023,7 @@ void
 keyboard_cancel_keybind_repeat(struct keyboard *keyboard)
 {
 	if (keyboard->keybind_repeat) {
-		wl_event_source_remove(keyboard->keybind_repeat);
+		lab_timer_destroy(keyboard->keybind_repeat);
 		keyboard->keybind_repeat = NULL;
 	}
 }
@@ -957,8 +1054,10 @@ handle_key(struct wl_listener *listener, void *data)
 	/* any new press/release cancels current keybind repeat */
 	keyboard_cancel_keybind_repeat(keyboard);
 
+	trace_begin("handle_compositor_keybindings");
 	enum lab_key_handled handled =
 		handle_compositor_keybindings(keyboard, event);
+	trace_end("handle_compositor_keybindings");
 
 	if (handled == LAB_KEY_HANDLED_TRUE_AND_VT_CHANGED) {
 		return;
@@ -978,6 +1077,8 @@ handle_key(struct wl_listener *listener, void *data)
 		wlr_seat_set_keyboard(wlr_seat, keyboard->wlr_keyboard);
 		wlr_seat_keyboard_notify_key(wlr_seat, event->time_msec,
 			event->keycode, event->state);
+		input_latency_input(wlr_seat->keyboard_state.focused_surface,
+			event->time_msec);
 	}
 }
 
@@ -1017,6 +1118,11 @@ keyboard_update_layout(struct seat *seat, xkb_layout_index_t layout)
 {
 	assert(seat);
 
+	/* All members of the group share the layout, so this is the common case */
+	if (seat->keyboard_group->keyboard.modifiers.group == layout) {
+		return;
+	}
+
 	struct input *input;
 	struct keyboard *keyboard;
 	struct wlr_keyboard *kb = NULL;
@@ -1047,6 +1153,25 @@ keyboard_update_layout(struct seat *seat, xkb_layout_index_t layout)
 		kb->modifiers.latched, kb->modifiers.locked, layout);
 }
 
+/* Bumped to forget the layouts stored in all views at once */
+static uint32_t layout_generation = 1;
+
+void
+keyboard_store_view_layout(struct view *view, xkb_layout_index_t layout)
+{
+	view->keyboard_layout = layout;
+	view->keyboard_layout_generation = layout_generation;
+}
+
+xkb_layout_index_t
+keyboard_get_view_layout(struct view *view)
+{
+	if (view->keyboard_layout_generation != layout_generation) {
+		return 0;
+	}
+	return view->keyboard_layout;
+}
+
 static void
 reset_window_keyboard_layout_groups(struct server *server)
 {
@@ -1059,16 +1184,208 @@ reset_window_keyboard_layout_groups(struct server *server)
 	 * to new group ones if particular layouts exist in both old and new,
 	 * but let's keep it simple for now and just reset them all.
 	 */
-	struct view *view;
-	for_each_view(view, &server->views, LAB_VIEW_CRITERIA_NONE) {
-		view->keyboard_layout = 0;
-	}
+	layout_generation++;
 
 	struct view *active_view = server->active_view;
 	if (!active_view) {
 		return;
 	}
-	keyboard_update_layout(&server->seat, active_view->keyboard_layout);
+	keyboard_update_layout(&server->seat,
+		keyboard_get_view_layout(active_view));
+}
+
+/*
+ * Keymaps are compiled from the XKB_DEFAULT_* environment variables.
+ * The last few are kept, keyed by the values they were compiled from, and
+ * the same keymap object is given to all keyboards.
+ *
+ * Once keyboards exist, a keymap for changed variables is compiled on a
+ * thread, which takes tens of milliseconds. The keyboards keep their
+ * previous keymap until it is ready.
+ */
+#define NR_CACHED_KEYMAPS 4
+
+static const char *const xkb_env_names[] = {
+	"XKB_DEFAULT_RULES", "XKB_DEFAULT_MODEL", "XKB_DEFAULT_LAYOUT",
+	"XKB_DEFAULT_VARIANT", "XKB_DEFAULT_OPTIONS",
+};
+#define NR_XKB_ENV ARRAY_SIZE(xkb_env_names)
+
+/* Keyed by the values of the variables, most recently used first */
+static struct cached_keymap {
+	char *key;
+	struct xkb_keymap *keymap;
+} cached_keymaps[NR_CACHED_KEYMAPS];
+
+static struct {
+	GThread *thread;
+	int eventfd;
+	struct wl_event_source *source;
+	struct server *server;
+	char *key;
+	char *values[NR_XKB_ENV]; /* NULL if unset */
+	struct xkb_keymap *keymap; /* set by the thread */
+} compile_job = { .eventfd = -1 };
+
+static char *
+get_xkb_env_key(void)
+{
+	struct buf key = BUF_INIT;
+	for (size_t i = 0; i < NR_XKB_ENV; i++) {
+		const char *value = getenv(xkb_env_names[i]);
+		/* Distinguish unset from empty */
+		buf_add_fmt(&key, "%s%s\n", value ? "=" : "", value ? value : "");
+	}
+	return key.data;
+}
+
+/* Returns the cached keymap for @key, without taking a reference */
+static struct xkb_keymap *
+lookup_keymap(const char *key)
+{
+	for (int i = 0; i < NR_CACHED_KEYMAPS; i++) {
+		struct cached_keymap entry = cached_keymaps[i];
+		if (entry.key && !strcmp(entry.key, key)) {
+			memmove(&cached_keymaps[1], &cached_keymaps[0],
+				i * sizeof(cached_keymaps[0]));
+			cached_keymaps[0] = entry;
+			return entry.keymap;
+		}
+	}
+	return NULL;
+}
+
+/* Takes ownership of @key and @keymap */
+static void
+insert_keymap(char *key, struct xkb_keymap *keymap)
+{
+	struct cached_keymap *last = &cached_keymaps[NR_CACHED_KEYMAPS - 1];
+	free(last->key);
+	xkb_keymap_unref(last->keymap);
+	memmove(&cached_keymaps[1], &cached_keymaps[0],
+		(NR_CACHED_KEYMAPS - 1) * sizeof(cached_keymaps[0]));
+	cached_keymaps[0] = (struct cached_keymap){ key, keymap };
+}
+
+static void
+apply_keymap(struct server *server, struct wlr_keyboard *kb,
+		struct xkb_keymap *keymap)
+{
+	/* Members of the keyboard group get the same keymap object */
+	if (kb->keymap != keymap
+			&& !wlr_keyboard_keymaps_match(kb->keymap, keymap)) {
+		wlr_keyboard_set_keymap(kb, keymap);
+		reset_window_keyboard_layout_groups(server);
+	}
+}
+
+static gpointer
+compile_job_run(gpointer data)
+{
+	/* Only use the values copied from the environment of the main thread */
+	struct xkb_context *context =
+		xkb_context_new(XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+	if (context) {
+		struct xkb_rule_names rules = {
+			.rules = compile_job.values[0],
+			.model = compile_job.values[1],
+			.layout = compile_job.values[2],
+			.variant = compile_job.values[3],
+			.options = compile_job.values[4],
+		};
+		compile_job.keymap = xkb_keymap_new_from_names(context, &rules,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		xkb_context_unref(context);
+	}
+	uint64_t one = 1;
+	if (write(compile_job.eventfd, &one, sizeof(one)) != sizeof(one)) {
+		wlr_log_errno(WLR_ERROR, "cannot signal compiled keymap");
+	}
+	return NULL;
+}
+
+/* Wait for the thread and return its result, with ownership of @key */
+static struct xkb_keymap *
+compile_job_finish(char **key)
+{
+	g_thread_join(compile_job.thread);
+	compile_job.thread = NULL;
+	wl_event_source_remove(compile_job.source);
+	compile_job.source = NULL;
+	close(compile_job.eventfd);
+	compile_job.eventfd = -1;
+	for (size_t i = 0; i < NR_XKB_ENV; i++) {
+		zfree(compile_job.values[i]);
+	}
+	*key = compile_job.key;
+	compile_job.key = NULL;
+	struct xkb_keymap *keymap = compile_job.keymap;
+	compile_job.keymap = NULL;
+	return keymap;
+}
+
+static void set_layout(struct server *server, struct wlr_keyboard *kb);
+
+static int
+handle_keymap_compiled(int fd, uint32_t mask, void *data)
+{
+	struct server *server = compile_job.server;
+	char *key;
+	struct xkb_keymap *keymap = compile_job_finish(&key);
+	if (!keymap) {
+		wlr_log(WLR_ERROR, "failed to compile xkb keymap, keeping "
+			"the previous one");
+		free(key);
+		return 0;
+	}
+	insert_keymap(key, keymap);
+
+	/*
+	 * Go through set_layout() again, which either applies the new
+	 * keymap or compiles another one if the environment has changed
+	 * in the meantime.
+	 */
+	struct input *input;
+	wl_list_for_each(input, &server->seat.inputs, link) {
+		struct keyboard *keyboard = (struct keyboard *)input;
+		if (input->wlr_input_device->type == WLR_INPUT_DEVICE_KEYBOARD
+				&& !keyboard->is_virtual) {
+			set_layout(server, keyboard->wlr_keyboard);
+		}
+	}
+	set_layout(server, &server->seat.keyboard_group->keyboard);
+	if (!compile_job.thread) {
+		keybind_update_keycodes(server);
+	}
+	return 0;
+}
+
+/* Takes ownership of @key. Returns false if no thread could be started. */
+static bool
+compile_job_start(struct server *server, char *key)
+{
+	assert(!compile_job.thread);
+	compile_job.eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (compile_job.eventfd >= 0) {
+		compile_job.source = wl_event_loop_add_fd(server->wl_event_loop,
+			compile_job.eventfd, WL_EVENT_READABLE,
+			handle_keymap_compiled, NULL);
+	}
+	if (!compile_job.source) {
+		if (compile_job.eventfd >= 0) {
+			close(compile_job.eventfd);
+			compile_job.eventfd = -1;
+		}
+		return false;
+	}
+	compile_job.server = server;
+	compile_job.key = key;
+	for (size_t i = 0; i < NR_XKB_ENV; i++) {
+		const char *value = getenv(xkb_env_names[i]);
+		compile_job.values[i] = value ? xstrdup(value) : NULL;
+	}
+	compile_job.thread = g_thread_new("keymap", compile_job_run, NULL);
+	return true;
 }
 
 /*
@@ -1080,10 +1397,8 @@ set_layout(struct server *server, struct wlr_keyboard *kb)
 {
 	static bool fallback_mode;
 
-	struct xkb_rule_names rules = { 0 };
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	struct xkb_keymap *keymap = xkb_map_new_from_names(context, &rules,
-		XKB_KEYMAP_COMPILE_NO_FLAGS);
+	char *key = get_xkb_env_key();
+	struct xkb_keymap *keymap = lookup_keymap(key);
 
 	/*
 	 * With XKB_DEFAULT_LAYOUT set to empty odd things happen with
@@ -1092,12 +1407,32 @@ set_layout(struct server *server, struct wlr_keyboard *kb)
 	 */
 	const char *layout = getenv("XKB_DEFAULT_LAYOUT");
 	bool layout_empty = layout && !*layout;
-	if (keymap && !layout_empty) {
-		if (!wlr_keyboard_keymaps_match(kb->keymap, keymap)) {
-			wlr_keyboard_set_keymap(kb, keymap);
-			reset_window_keyboard_layout_groups(server);
+
+	if (!keymap && !layout_empty) {
+		if (compile_job.thread) {
+			/* Checked again once the running job is done */
+			free(key);
+			return;
 		}
-		xkb_keymap_unref(keymap);
+		/* Keyboards with a keymap keep it until the new one is ready */
+		if (kb->keymap && compile_job_start(server, key)) {
+			return;
+		}
+		struct xkb_context *context =
+			xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		struct xkb_rule_names rules = { 0 };
+		keymap = xkb_keymap_new_from_names(context, &rules,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		xkb_context_unref(context);
+		if (keymap) {
+			insert_keymap(key, keymap);
+			key = NULL;
+		}
+	}
+	free(key);
+
+	if (keymap && !layout_empty) {
+		apply_keymap(server, kb, keymap);
 	} else {
 		wlr_log(WLR_ERROR, "failed to create xkb keymap for layout '%s'",
 			layout);
@@ -1108,7 +1443,6 @@ set_layout(struct server *server, struct wlr_keyboard *kb)
 			set_layout(server, kb);
 		}
 	}
-	xkb_context_unref(context);
 }
 
 void
@@ -1118,7 +1452,6 @@ keyboard_configure(struct seat *seat, struct wlr_keyboard *kb, bool is_virtual)
 		set_layout(seat->server, kb);
 	}
 	wlr_keyboard_set_repeat_info(kb, rc.repeat_rate, rc.repeat_delay);
-	keybind_update_keycodes(seat->server);
 }
 
 void
@@ -1130,6 +1463,7 @@ keyboard_group_init(struct seat *seat)
 	seat->keyboard_group = wlr_keyboard_group_create();
 	keyboard_configure(seat, &seat->keyboard_group->keyboard,
 		/* is_virtual */ false);
+	keybind_update_keycodes(seat->server);
 }
 
 void
@@ -1150,4 +1484,14 @@ keyboard_group_finish(struct seat *seat)
 		wlr_keyboard_group_destroy(seat->keyboard_group);
 		seat->keyboard_group = NULL;
 	}
+	if (compile_job.thread) {
+		char *key;
+		xkb_keymap_unref(compile_job_finish(&key));
+		free(key);
+	}
+	for (int i = 0; i < NR_CACHED_KEYMAPS; i++) {
+		zfree(cached_keymaps[i].key);
+		xkb_keymap_unref(cached_keymaps[i].keymap);
+		cached_keymaps[i].keymap = NULL;
+	}
 }
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <linux/input-event-codes.h>
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_tablet_tool.h>
 #include <wlr/types/wlr_tablet_v2.h>
 #include <wlr/util/log.h>
@@ -16,6 +17,8 @@
 #include "input/cursor.h"
 #include "input/tablet-pad.h"
 #include "labwc.h"
+#include "output.h"
+#include "scene-index.h"
 #include "idle.h"
 #include "action.h"
 #include "view.h"
@@ -193,8 +196,8 @@ adjust_for_motion_sensitivity(double motion_sensitivity, double *dx, double *dy)
 	*dy = *dy * motion_sensitivity;
 }
 
-static struct wlr_surface*
-tablet_get_coords(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
+static void
+tablet_adjust_coords(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
 		double *x, double *y, double *dx, double *dy)
 {
 	*x = tool->x;
@@ -206,14 +209,27 @@ tablet_get_coords(struct drawing_tablet *tablet, struct drawing_tablet_tool *too
 		rc.tablet.box, x, y);
 	adjust_for_rotation_relative(rc.tablet.rotation, dx, dy);
 	adjust_for_motion_sensitivity(rc.tablet_tool.relative_motion_sensitivity, dx, dy);
+}
+
+static bool
+tablet_mouse_emulation(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool)
+{
+	return rc.tablet.force_mouse_emulation || tool->force_mouse_emulation
+		|| !tablet->tablet_v2;
+}
+
+static struct wlr_surface*
+tablet_get_coords(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
+		double *x, double *y, double *dx, double *dy)
+{
+	tablet_adjust_coords(tablet, tool, x, y, dx, dy);
 
 	/*
 	 * Do not return a surface when mouse emulation is enforced. Not
 	 * having a surface will trigger the fallback to mouse emulation
 	 * in the tablet signal handlers.
 	 */
-	if (rc.tablet.force_mouse_emulation || tool->force_mouse_emulation
-			|| !tablet->tablet_v2) {
+	if (tablet_mouse_emulation(tablet, tool)) {
 		return NULL;
 	}
 
@@ -237,9 +253,10 @@ tablet_get_coords(struct drawing_tablet *tablet, struct drawing_tablet_tool *too
 		break;
 	}
 
+	/* Like the pointer, this skips drag icons without hiding them */
 	double sx, sy;
 	struct wlr_scene_node *node =
-		wlr_scene_node_at(&tablet->seat->server->scene->tree.node, lx, ly, &sx, &sy);
+		scene_index_node_at(tablet->seat->server, lx, ly, &sx, &sy);
 
 	/* find the surface and return it if it accepts tablet events */
 	struct wlr_surface *surface = lab_wlr_surface_from_node(node);
@@ -277,6 +294,9 @@ notify_motion(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
 	double sx, sy;
 	bool notify = cursor_process_motion(tablet->seat->server, time, &sx, &sy);
 	if (notify) {
+		tool->has_surface_origin = true;
+		tool->surface_origin_x = tablet->seat->cursor->x - sx;
+		tool->surface_origin_y = tablet->seat->cursor->y - sy;
 		wlr_tablet_v2_tablet_tool_notify_motion(tool->tool_v2, sx, sy);
 		if (enter_surface) {
 			/*
@@ -314,6 +334,80 @@ notify_motion(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
 	}
 }
 
+void
+tablet_flush_motion(struct seat *seat)
+{
+	struct drawing_tablet_tool *tool;
+	wl_list_for_each(tool, &seat->tablet_tools, link) {
+		if (!tool->coalesced_motion.pending) {
+			continue;
+		}
+		tool->coalesced_motion.pending = false;
+
+		/*
+		 * The client has already received every sample, so just
+		 * catch up with the cursor and the compositor state.
+		 */
+		wlr_cursor_warp_absolute(seat->cursor,
+			tool->coalesced_motion.tablet->wlr_input_device,
+			tool->coalesced_motion.x, tool->coalesced_motion.y);
+		double sx, sy;
+		if (cursor_process_motion(seat->server,
+				tool->coalesced_motion.time_msec, &sx, &sy)) {
+			tool->surface_origin_x = seat->cursor->x - sx;
+			tool->surface_origin_y = seat->cursor->y - sy;
+		} else {
+			tool->has_surface_origin = false;
+		}
+	}
+}
+
+/*
+ * Returns true if the motion has been sent to the client and the cursor
+ * will be moved on the next output frame.
+ *
+ * This is limited to strokes, that is while the tip is down on a tablet
+ * capable surface: the implicit grab keeps the focused surface fixed, so
+ * the hit-test can be skipped and surface-local coordinates are derived
+ * from the surface position found by the last processed motion.
+ */
+static bool
+coalesce_motion(struct drawing_tablet *tablet, struct drawing_tablet_tool *tool,
+		double x, double y, uint32_t time_msec)
+{
+	if (!rc.tablet_tool.motion_coalescing
+			|| tool->motion_mode != LAB_MOTION_ABSOLUTE
+			|| tablet_mouse_emulation(tablet, tool)
+			|| !tool->has_surface_origin
+			|| !tool->tool_v2->is_down
+			|| !tool->tool_v2->focused_surface
+			|| tablet->seat->server->input_mode
+				!= LAB_INPUT_STATE_PASSTHROUGH) {
+		return false;
+	}
+
+	if (!tool->coalesced_motion.pending) {
+		struct output *output = output_nearest_to_cursor(tablet->seat->server);
+		if (!output_is_usable(output)) {
+			return false;
+		}
+		/* Flushed by handle_output_frame() */
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+	tool->coalesced_motion.pending = true;
+	tool->coalesced_motion.tablet = tablet;
+	tool->coalesced_motion.x = x;
+	tool->coalesced_motion.y = y;
+	tool->coalesced_motion.time_msec = time_msec;
+
+	double lx, ly;
+	wlr_cursor_absolute_to_layout_coords(tablet->seat->cursor,
+		tablet->wlr_input_device, x, y, &lx, &ly);
+	wlr_tablet_v2_tablet_tool_notify_motion(tool->tool_v2,
+		lx - tool->surface_origin_x, ly - tool->surface_origin_y);
+	return true;
+}
+
 static void
 handle_tablet_tool_proximity(struct wl_listener *listener, void *data)
 {
@@ -325,6 +419,7 @@ handle_tablet_tool_proximity(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	tablet_flush_motion(tablet->seat);
 	idle_manager_notify_activity(tablet->seat->seat);
 	cursor_set_visible(tablet->seat, /* visible */ true);
 
@@ -358,6 +453,7 @@ handle_tablet_tool_proximity(struct wl_listener *listener, void *data)
 	tool->rotation = 0;
 	tool->slider = 0;
 	tool->wheel_delta = 0;
+	tool->has_surface_origin = false;
 
 	tool->x = ev->x;
 	tool->y = ev->y;
@@ -436,7 +532,16 @@ handle_tablet_tool_axis(struct wl_listener *listener, void *data)
 	}
 
 	double x, y, dx, dy;
-	struct wlr_surface *surface = tablet_get_coords(tablet, tool, &x, &y, &dx, &dy);
+	struct wlr_surface *surface = NULL;
+	bool coalesced = false;
+	if (!is_down_mouse_emulation) {
+		tablet_adjust_coords(tablet, tool, &x, &y, &dx, &dy);
+		coalesced = coalesce_motion(tablet, tool, x, y, ev->time_msec);
+	}
+	if (!coalesced) {
+		tablet_flush_motion(tablet->seat);
+		surface = tablet_get_coords(tablet, tool, &x, &y, &dx, &dy);
+	}
 
 	/*
 	 * We are sending tablet notifications on the following conditions:
@@ -448,11 +553,14 @@ handle_tablet_tool_axis(struct wl_listener *listener, void *data)
 	 *   grab (e.g. from out-of-surface scrolling).
 	 * Note that surface is also NULL when mouse emulation is forced.
 	 */
-	if (!is_down_mouse_emulation && ((surface
+	if (coalesced || (!is_down_mouse_emulation && ((surface
 			&& tablet->seat->server->input_mode == LAB_INPUT_STATE_PASSTHROUGH)
-			|| wlr_tablet_tool_v2_has_implicit_grab(tool->tool_v2))) {
+			|| wlr_tablet_tool_v2_has_implicit_grab(tool->tool_v2)))) {
 		/* motion seems to be supported by all tools */
-		notify_motion(tablet, tool, surface, x, y, dx, dy, ev->time_msec);
+		if (!coalesced) {
+			notify_motion(tablet, tool, surface, x, y, dx, dy,
+				ev->time_msec);
+		}
 
 		/* notify about other axis based on tool capabilities */
 		if (ev->tool->distance) {
@@ -565,6 +673,8 @@ handle_tablet_tool_tip(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/* Catch up with merged motion, the press is at the current position */
+	tablet_flush_motion(tablet->seat);
 	idle_manager_notify_activity(tablet->seat->seat);
 	cursor_set_visible(tablet->seat, /* visible */ true);
 
@@ -644,6 +754,8 @@ handle_tablet_tool_button(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/* Catch up with merged motion, the press is at the current position */
+	tablet_flush_motion(tablet->seat);
 	idle_manager_notify_activity(tablet->seat->seat);
 	cursor_set_visible(tablet->seat, /* visible */ true);
 
@@ -704,6 +816,14 @@ handle_destroy(struct wl_listener *listener, void *data)
 	struct drawing_tablet *tablet =
 		wl_container_of(listener, tablet, handlers.destroy);
 
+	struct drawing_tablet_tool *tool;
+	wl_list_for_each(tool, &tablet->seat->tablet_tools, link) {
+		if (tool->coalesced_motion.tablet == tablet) {
+			tool->coalesced_motion.pending = false;
+			tool->coalesced_motion.tablet = NULL;
+		}
+	}
+
 	wl_list_remove(&tablet->link);
 	tablet_pad_attach_tablet(tablet->seat);
 
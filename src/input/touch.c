@@ -15,6 +15,7 @@
 #include "config/touch.h"
 #include "idle.h"
 #include "labwc.h"
+#include "scene-index.h"
 #include "ssd.h"
 #include "view.h"
 
@@ -25,8 +26,26 @@ struct touch_point {
 	uint32_t y_offset;
 	struct wlr_surface *surface;
 	struct wl_list link; /* seat.touch_points */
+
+	/* Latest motion, reported on the next touch frame */
+	bool motion_pending;
+	struct wlr_touch *touch;
+	double x, y;
+	uint32_t time_msec;
 };
 
+static struct touch_point *
+find_touch_point(struct seat *seat, int32_t touch_id)
+{
+	struct touch_point *touch_point;
+	wl_list_for_each(touch_point, &seat->touch_points, link) {
+		if (touch_point->touch_id == touch_id) {
+			return touch_point;
+		}
+	}
+	return NULL;
+}
+
 static struct wlr_surface*
 touch_get_coords(struct seat *seat, struct wlr_touch *touch, double x, double y,
 		double *x_offset, double *y_offset)
@@ -63,7 +82,7 @@ touch_get_coords(struct seat *seat, struct wlr_touch *touch, double x, double y,
 
 	double sx, sy;
 	struct wlr_scene_node *node =
-		wlr_scene_node_at(&seat->server->scene->tree.node, lx, ly, &sx, &sy);
+		scene_index_node_at(seat->server, lx, ly, &sx, &sy);
 
 	*x_offset = lx - sx;
 	*y_offset = ly - sy;
@@ -77,6 +96,50 @@ touch_get_coords(struct seat *seat, struct wlr_touch *touch, double x, double y,
 	return surface;
 }
 
+/*
+ * Report the latest motion of @touch_point, using the offsets (and the
+ * surface) determined on touch down
+ */
+static void
+flush_motion(struct seat *seat, struct touch_point *touch_point,
+		int touch_point_count)
+{
+	if (!touch_point->motion_pending) {
+		return;
+	}
+	touch_point->motion_pending = false;
+
+	struct wlr_touch *touch = touch_point->touch;
+	if (touch_point->surface) {
+		/* Convert coordinates: first [0, 1] => layout */
+		double lx, ly;
+		wlr_cursor_absolute_to_layout_coords(seat->cursor, &touch->base,
+			touch_point->x, touch_point->y, &lx, &ly);
+
+		/* Apply offsets to get surface coords before reporting event */
+		double sx = lx - touch_point->x_offset;
+		double sy = ly - touch_point->y_offset;
+
+		if (touch_point_count == 1) {
+			wlr_cursor_warp_absolute(seat->cursor, &touch->base,
+				touch_point->x, touch_point->y);
+		}
+		wlr_seat_touch_notify_motion(seat->seat, touch_point->time_msec,
+			touch_point->touch_id, sx, sy);
+	} else {
+		if (touch_point_count == 1) {
+			cursor_emulate_move_absolute(seat, &touch->base,
+				touch_point->x, touch_point->y,
+				touch_point->time_msec);
+		}
+	}
+}
+
+/*
+ * Touchscreens report all points which moved since the last frame, at
+ * up to a few hundred frames per second. Only the last motion of each
+ * point within a frame is reported, in handle_touch_frame().
+ */
 static void
 handle_touch_motion(struct wl_listener *listener, void *data)
 {
@@ -85,37 +148,15 @@ handle_touch_motion(struct wl_listener *listener, void *data)
 
 	idle_manager_notify_activity(seat->seat);
 
-	int touch_point_count = wl_list_length(&seat->touch_points);
-
-	/* Find existing touch point to determine initial offsets to subtract */
-	struct touch_point *touch_point;
-	wl_list_for_each(touch_point, &seat->touch_points, link) {
-		if (touch_point->touch_id == event->touch_id) {
-			if (touch_point->surface) {
-				/* Convert coordinates: first [0, 1] => layout */
-				double lx, ly;
-				wlr_cursor_absolute_to_layout_coords(seat->cursor,
-					&event->touch->base, event->x, event->y, &lx, &ly);
-
-				/* Apply offsets to get surface coords before reporting event */
-				double sx = lx - touch_point->x_offset;
-				double sy = ly - touch_point->y_offset;
-
-				if (touch_point_count == 1) {
-					wlr_cursor_warp_absolute(seat->cursor, &event->touch->base,
-						event->x, event->y);
-				}
-				wlr_seat_touch_notify_motion(seat->seat, event->time_msec,
-					event->touch_id, sx, sy);
-			} else {
-				if (touch_point_count == 1) {
-					cursor_emulate_move_absolute(seat, &event->touch->base,
-						event->x, event->y, event->time_msec);
-				}
-			}
-			return;
-		}
+	struct touch_point *touch_point = find_touch_point(seat, event->touch_id);
+	if (!touch_point) {
+		return;
 	}
+	touch_point->motion_pending = true;
+	touch_point->touch = event->touch;
+	touch_point->x = event->x;
+	touch_point->y = event->y;
+	touch_point->time_msec = event->time_msec;
 }
 
 static void
@@ -123,6 +164,11 @@ handle_touch_frame(struct wl_listener *listener, void *data)
 {
 	struct seat *seat = wl_container_of(listener, seat, touch_frame);
 
+	int touch_point_count = wl_list_length(&seat->touch_points);
+	struct touch_point *touch_point;
+	wl_list_for_each(touch_point, &seat->touch_points, link) {
+		flush_motion(seat, touch_point, touch_point_count);
+	}
 	wlr_seat_touch_notify_frame(seat->seat);
 }
 
@@ -197,23 +243,26 @@ handle_touch_up(struct wl_listener *listener, void *data)
 
 	idle_manager_notify_activity(seat->seat);
 
-	/* Remove the touch point from the seat */
-	struct touch_point *touch_point, *tmp;
-	wl_list_for_each_safe(touch_point, tmp, &seat->touch_points, link) {
-		if (touch_point->touch_id == event->touch_id) {
-			if (touch_point->surface) {
-				wlr_seat_touch_notify_up(seat->seat, event->time_msec,
-					event->touch_id);
-			} else {
-				cursor_emulate_button(seat, BTN_LEFT,
-					WL_POINTER_BUTTON_STATE_RELEASED, event->time_msec);
-				ssd_update_hovered_button(seat->server, NULL);
-			}
-			wl_list_remove(&touch_point->link);
-			zfree(touch_point);
-			break;
-		}
+	struct touch_point *touch_point = find_touch_point(seat, event->touch_id);
+	if (!touch_point) {
+		return;
 	}
+
+	/* Report where the point was lifted before the frame ends */
+	flush_motion(seat, touch_point, wl_list_length(&seat->touch_points));
+
+	if (touch_point->surface) {
+		wlr_seat_touch_notify_up(seat->seat, event->time_msec,
+			event->touch_id);
+	} else {
+		cursor_emulate_button(seat, BTN_LEFT,
+			WL_POINTER_BUTTON_STATE_RELEASED, event->time_msec);
+		ssd_update_hovered_button(seat->server, NULL);
+	}
+
+	/* Remove the touch point from the seat */
+	wl_list_remove(&touch_point->link);
+	zfree(touch_point);
 }
 
 void
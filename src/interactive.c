@@ -3,11 +3,14 @@
 #include <wlr/types/wlr_cursor.h>
 #include "config/rcxml.h"
 #include "edges.h"
+#include "input/cursor.h"
 #include "input/keyboard.h"
 #include "labwc.h"
 #include "output.h"
 #include "regions.h"
 #include "resize-indicator.h"
+#include "ssd.h"
+#include "tiling.h"
 #include "view.h"
 #include "window-rules.h"
 
@@ -54,6 +57,18 @@ interactive_anchor_to_cursor(struct server *server, struct wlr_box *geo)
 	geo->y = server->grab_box.y + (server->seat.cursor->y - server->grab_y);
 }
 
+/* Keep snap previews off the geometry code during a move */
+static void
+update_edge_snap_boxes(struct server *server)
+{
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output_is_usable(output)) {
+			output_update_edge_snap_boxes(output);
+		}
+	}
+}
+
 void
 interactive_begin(struct view *view, enum input_mode mode, enum lab_edge edges)
 {
@@ -70,7 +85,7 @@ interactive_begin(struct view *view, enum input_mode mode, enum lab_edge edges)
 	}
 
 	/* Prevent moving/resizing fixed-position and panel-like views */
-	if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE
+	if (window_rules_get_property(view, WINDOW_RULE_PROP_FIXED_POSITION) == LAB_PROP_TRUE
 			|| view_has_strut_partial(view)) {
 		return;
 	}
@@ -98,6 +113,7 @@ interactive_begin(struct view *view, enum input_mode mode, enum lab_edge edges)
 
 		/* Prevent region snapping when just moving via A-Left mousebind */
 		seat->region_prevent_snap = keyboard_get_all_modifiers(seat);
+		update_edge_snap_boxes(server);
 
 		cursor_shape = LAB_CURSOR_GRAB;
 		break;
@@ -145,13 +161,9 @@ interactive_begin(struct view *view, enum input_mode mode, enum lab_edge edges)
 	server->grab_y = seat->cursor->y;
 	server->grab_box = view->current;
 	server->resize_edges = edges;
+	server->resize_deferred = false;
 
 	seat_focus_override_begin(seat, mode, cursor_shape);
-	
-	/* Disable timer during resize operations */
-	if (mode == LAB_INPUT_STATE_RESIZE) {
-		tiling_timer_update(server);
-	}
 
 	/*
 	 * Un-tile maximized/tiled view immediately if <unSnapThreshold> is
@@ -176,6 +188,8 @@ interactive_begin(struct view *view, enum input_mode mode, enum lab_edge edges)
 	}
 	if (rc.window_edge_strength) {
 		edges_calculate_visibility(server, view);
+		/* Rebuilt with the new visibility on the first motion */
+		edges_index_invalidate();
 	}
 }
 
@@ -318,6 +332,9 @@ interactive_finish(struct view *view)
 	}
 
 	if (view->server->input_mode == LAB_INPUT_STATE_MOVE) {
+		/* Snap where the pointer was released */
+		cursor_flush_move(view->server);
+
 		bool was_snapped = false;
 		if (!snap_to_region(view)) {
 			was_snapped = snap_to_edge(view);
@@ -327,58 +344,45 @@ interactive_finish(struct view *view)
 
 		/* Rearrange tiled windows when a window is moved in tiling mode */
 		/* In tiling mode, override edge/region snapping to keep windows tiled */
-		if (view->server->tiling_mode &&
-		    !view->minimized && !view->fullscreen &&
-		    !view_is_always_on_top(view) && !view_is_always_on_bottom(view) &&
-		    window_rules_get_property(view, "fixedPosition") != LAB_PROP_TRUE) {
-			/* Check if this view should be tiled */
-			enum property tile_prop = window_rules_get_property(view, "tile");
-			if (tile_prop != LAB_PROP_FALSE) {
-				/* If this was the resized view, clear it since we're moving it */
-				if (view->server->resized_view == view) {
-					view->server->resized_view = NULL;
-				}
-				/* If window was snapped, untile it first */
-				if (was_snapped && view_is_tiled(view)) {
-					view_set_untiled(view);
-				}
-				desktop_arrange_tiled(view->server);
+		if (view->server->tiling_mode && view_is_tiling_candidate(view)) {
+			/* If this was the resized view, clear it since we're moving it */
+			if (view->server->resized_view == view) {
+				view->server->resized_view = NULL;
 			}
+			/* If window was snapped, untile it first */
+			if (was_snapped && view_is_tiled(view)) {
+				view_set_untiled(view);
+			}
+			desktop_schedule_arrange_tiled(view->server);
 		}
 	} else if (view->server->input_mode == LAB_INPUT_STATE_RESIZE) {
+		/* Do not lose the last pointer motion of a client-paced resize */
+		cursor_flush_resize(view, /*force*/ true);
+
 		/* Rearrange tiled windows when a window is resized in tiling mode */
-		if (view->server->tiling_mode &&
-		    !view->minimized && !view->fullscreen &&
-		    !view_is_always_on_top(view) && !view_is_always_on_bottom(view) &&
-		    window_rules_get_property(view, "fixedPosition") != LAB_PROP_TRUE) {
-			/* Check if this view should be tiled */
-			enum property tile_prop = window_rules_get_property(view, "tile");
-			if (tile_prop != LAB_PROP_FALSE) {
-				/* In smart mode (grid_mode=false), preserve the resized window's geometry */
-				if (!view->server->tiling_grid_mode) {
-					/* Store the resized window's current geometry to preserve it */
-					/* Use current geometry as it reflects what's actually displayed */
-					view->server->resized_view_geometry = view->current;
-					view->server->resized_view = view;
-					/* Untile the resized window so it can keep its new size */
-					if (view_is_tiled(view)) {
-						view_set_untiled(view);
-					}
+		if (view->server->tiling_mode && view_is_tiling_candidate(view)) {
+			if (view->server->tiling_layout != LAB_TILING_LAYOUT_GRID) {
+				/* Tree layouts adopt the new size as split ratios */
+				tiling_view_resized(view);
+			} else if (!view->server->tiling_grid_mode) {
+				/* In smart mode, preserve the resized window's geometry */
+				/* Store the resized window's current geometry to preserve it */
+				/* Use current geometry as it reflects what's actually displayed */
+				view->server->resized_view_geometry = view->current;
+				view->server->resized_view = view;
+				/* Untile the resized window so it can keep its new size */
+				if (view_is_tiled(view)) {
+					view_set_untiled(view);
 				}
-				/* Arrange all windows - this will preserve the resized one in smart mode */
-				desktop_arrange_tiled(view->server);
-				/* Don't clear resized_view here - keep it persistent so it's preserved
-				 * when other windows are created/destroyed/moved later */
 			}
+			/* Arrange all windows - this will preserve the resized one in smart mode */
+			desktop_schedule_arrange_tiled(view->server);
+			/* Don't clear resized_view here - keep it persistent so it's preserved
+			 * when other windows are created/destroyed/moved later */
 		}
 	}
 
 	interactive_cancel(view);
-	
-	/* Re-enable timer after resize/move completes (input_mode is now PASSTHROUGH) */
-	if (view->server->tiling_mode && !view->server->tiling_grid_mode) {
-		tiling_timer_update(view->server);
-	}
 }
 
 /*
@@ -392,13 +396,22 @@ interactive_cancel(struct view *view)
 	if (view->server->grabbed_view != view) {
 		return;
 	}
+	bool was_resizing =
+		view->server->input_mode == LAB_INPUT_STATE_RESIZE;
 
 	overlay_finish(&view->server->seat);
 
 	resize_indicator_hide(view);
+	/* The view has been left out of the visibility during the grab */
+	edges_visibility_invalidate(view->server, view);
 
 	view->server->grabbed_view = NULL;
 
+	/* Replace a title cropped during the resize by an ellipsized one */
+	if (was_resizing) {
+		ssd_update_title(view->ssd);
+	}
+
 	/* Restore keyboard/pointer focus */
 	seat_focus_override_end(&view->server->seat);
 }
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Client side of the control socket, kept apart from the compositor side
+ * so that helper programs such as lab-bench can link it on its own
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "ipc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "common/buf.h"
+#include "common/mem.h"
+
+#define IPC_CLIENT_TIMEOUT_SEC 5
+
+static int
+client_connect(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *path = getenv("LABWC_SOCK");
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	const char *display = getenv("WAYLAND_DISPLAY");
+	int len;
+	if (path) {
+		len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	} else if (runtime_dir && display) {
+		len = snprintf(addr.sun_path, sizeof(addr.sun_path),
+			"%s/labwc.%s.sock", runtime_dir, display);
+	} else {
+		errno = ENOENT;
+		return -1;
+	}
+	if (len < 0 || (size_t)len >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	struct timeval timeout = { .tv_sec = IPC_CLIENT_TIMEOUT_SEC };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+	return fd;
+}
+
+static bool
+write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+	while (len) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool
+read_all(int fd, void *data, size_t len)
+{
+	char *p = data;
+	while (len) {
+		ssize_t n = recv(fd, p, len, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			if (n == 0) {
+				errno = ECONNRESET;
+			}
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool
+ipc_client_request(const char *request, struct buf *reply)
+{
+	size_t len = strlen(request);
+	if (len > IPC_MAX_PAYLOAD) {
+		buf_add(reply, "request too large");
+		return false;
+	}
+
+	int fd = client_connect();
+	if (fd < 0) {
+		buf_add_fmt(reply, "cannot connect to labwc: %s", strerror(errno));
+		return false;
+	}
+
+	struct ipc_header header = { .length = len };
+	if (!write_all(fd, &header, sizeof(header))
+			|| !write_all(fd, request, len)
+			|| !read_all(fd, &header, sizeof(header))) {
+		buf_add_fmt(reply, "lost connection to labwc: %s",
+			strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (header.length > IPC_MAX_PAYLOAD) {
+		buf_add(reply, "invalid reply from labwc");
+		close(fd);
+		return false;
+	}
+
+	char *payload = xmalloc(header.length + 1);
+	bool received = read_all(fd, payload, header.length);
+	int saved_errno = errno;
+	close(fd);
+	if (!received) {
+		buf_add_fmt(reply, "lost connection to labwc: %s",
+			strerror(saved_errno));
+		free(payload);
+		return false;
+	}
+	payload[header.length] = '\0';
+
+	char *text = strchr(payload, '\n');
+	if (text) {
+		*text++ = '\0';
+		buf_add(reply, text);
+	}
+	bool ok = !strcmp(payload, "ok");
+	if (!ok && strcmp(payload, "error")) {
+		buf_clear(reply);
+		buf_add(reply, "invalid reply from labwc");
+	}
+	free(payload);
+	return ok;
+}
@@ -0,0 +1,640 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "ipc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/log.h>
+#include "common/buf.h"
+#include "common/log.h"
+#include "common/macros.h"
+#include "common/mem.h"
+#include "common/string-helpers.h"
+#include "config/keybind.h"
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "output.h"
+#include "tiling.h"
+#include "view.h"
+#include "workspaces.h"
+
+/* Stop reading requests from clients which don't read their replies */
+#define IPC_MAX_PENDING_OUTPUT (1024 * 1024)
+
+struct ipc_client {
+	int fd;
+	struct wl_event_source *source;
+	struct wl_array in;
+	struct wl_array out;
+	size_t out_sent;
+	uint32_t subscriptions; /* enum ipc_event */
+	uint32_t dirty; /* subscribed events not sent since they changed */
+	bool closing; /* client hung up, drop it once the replies are sent */
+	struct wl_list link; /* ipc.clients */
+};
+
+static struct {
+	struct server *server;
+	int fd;
+	char *path;
+	struct wl_event_source *source;
+	struct wl_event_source *events_idle;
+	struct wl_list clients;
+	/* Bumped on every change of the window list */
+	uint64_t windows_generation;
+} ipc = {
+	.fd = -1,
+};
+
+static void
+client_destroy(struct ipc_client *client)
+{
+	wl_event_source_remove(client->source);
+	close(client->fd);
+	wl_array_release(&client->in);
+	wl_array_release(&client->out);
+	wl_list_remove(&client->link);
+	free(client);
+}
+
+static size_t
+client_pending_output(struct ipc_client *client)
+{
+	return client->out.size - client->out_sent;
+}
+
+/* Returns false if the client was destroyed */
+static bool
+client_update_mask(struct ipc_client *client)
+{
+	uint32_t mask = 0;
+	if (client_pending_output(client)) {
+		mask |= WL_EVENT_WRITABLE;
+	} else if (client->closing) {
+		client_destroy(client);
+		return false;
+	}
+	if (!client->closing
+			&& client_pending_output(client) < IPC_MAX_PENDING_OUTPUT) {
+		mask |= WL_EVENT_READABLE;
+	}
+	wl_event_source_fd_update(client->source, mask);
+	return true;
+}
+
+static void
+client_queue(struct ipc_client *client, const char *payload, size_t len)
+{
+	struct ipc_header header = { .length = len };
+	char *data = wl_array_add(&client->out, sizeof(header) + len);
+	if (!data) {
+		wlr_log(WLR_ERROR, "ipc: out of memory");
+		return;
+	}
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), payload, len);
+}
+
+static const char *const event_names[] = {
+	"tiling",
+	"workspace",
+	"focus",
+	"keybind",
+	"output",
+	"occupancy",
+	"windows",
+};
+
+#define IPC_EVENT_ALL ((1u << ARRAY_SIZE(event_names)) - 1)
+
+static void
+add_line(struct buf *data, const char *line)
+{
+	if (data->len) {
+		buf_add_char(data, '\n');
+	}
+	buf_add(data, line);
+}
+
+/* Tabs and newlines would break up the fields and lines */
+static void
+add_field(struct buf *data, const char *field)
+{
+	buf_add_char(data, '\t');
+	for (const char *p = field; *p; p++) {
+		buf_add_char(data, (*p == '\t' || *p == '\n') ? ' ' : *p);
+	}
+}
+
+static void
+add_state(struct buf *data, bool *first, bool set, const char *name)
+{
+	if (set) {
+		buf_add(data, *first ? "\t" : ",");
+		buf_add(data, name);
+		*first = false;
+	}
+}
+
+static void
+describe_windows(struct server *server, struct buf *data)
+{
+	buf_add_fmt(data, "generation %" PRIu64, ipc.windows_generation);
+
+	struct view *view;
+	wl_list_for_each(view, &server->views, link) {
+		if (!view->mapped) {
+			continue;
+		}
+		struct wlr_box *box = &view->current;
+		buf_add_fmt(data, "\n%" PRIu64 "\t%d\t%d\t%d\t%d",
+			view->creation_id, box->x, box->y, box->width,
+			box->height);
+		add_field(data, output_is_usable(view->output)
+			? view->output->wlr_output->name : "-");
+		add_field(data, view->workspace ? view->workspace->name : "-");
+
+		bool first = true;
+		add_state(data, &first, view == server->active_view, "active");
+		add_state(data, &first, view->minimized, "minimized");
+		add_state(data, &first, view->maximized != VIEW_AXIS_NONE,
+			"maximized");
+		add_state(data, &first, view->fullscreen, "fullscreen");
+		add_state(data, &first, view->tiled, "tiled");
+		add_state(data, &first, view->shaded, "shaded");
+		add_state(data, &first, view_is_omnipresent(view),
+			"omnipresent");
+		add_state(data, &first, view_is_always_on_top(view),
+			"always-on-top");
+		if (first) {
+			buf_add(data, "\t-");
+		}
+
+		add_field(data, view->app_id);
+		add_field(data, view->title);
+	}
+}
+
+static void
+describe_state(enum ipc_event event, struct buf *data)
+{
+	struct server *server = ipc.server;
+	char line[256];
+
+	switch (event) {
+	case IPC_EVENT_TILING:
+		buf_add(data, tiling_status(server));
+		break;
+	case IPC_EVENT_WORKSPACE:
+		if (server->workspaces.current) {
+			buf_add(data, server->workspaces.current->name);
+		}
+		break;
+	case IPC_EVENT_FOCUS:
+		if (server->active_view) {
+			buf_add(data, server->active_view->app_id);
+			buf_add_char(data, '\n');
+			buf_add(data, server->active_view->title);
+		}
+		break;
+	case IPC_EVENT_KEYBIND: {
+		struct keybind *keybind;
+		wl_list_for_each(keybind, &rc.keybinds, link) {
+			if (!keybind->toggleable || !keybind->id) {
+				continue;
+			}
+			snprintf(line, sizeof(line), "%s %s", keybind->id,
+				keybind->enabled ? "enabled" : "disabled");
+			add_line(data, line);
+		}
+		break;
+	}
+	case IPC_EVENT_OUTPUT: {
+		struct output *output;
+		wl_list_for_each(output, &server->outputs, link) {
+			if (!output_is_usable(output)) {
+				continue;
+			}
+			struct wlr_box box;
+			wlr_output_layout_get_box(server->output_layout,
+				output->wlr_output, &box);
+			snprintf(line, sizeof(line), "%s %d %d %d %d %g",
+				output->wlr_output->name, box.x, box.y,
+				box.width, box.height, output->wlr_output->scale);
+			add_line(data, line);
+		}
+		break;
+	}
+	case IPC_EVENT_OCCUPANCY: {
+		struct workspace *workspace;
+		wl_list_for_each(workspace, &server->workspaces.all, link) {
+			snprintf(line, sizeof(line), "%d %s",
+				workspace->nr_views, workspace->name);
+			add_line(data, line);
+		}
+		break;
+	}
+	case IPC_EVENT_WINDOWS:
+		describe_windows(server, data);
+		break;
+	}
+}
+
+static void
+client_queue_events(struct ipc_client *client)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(event_names); i++) {
+		enum ipc_event event = 1u << i;
+		if (!(client->dirty & event)) {
+			continue;
+		}
+		struct buf message = BUF_INIT;
+		buf_add_fmt(&message, "event %s\n", event_names[i]);
+		describe_state(event, &message);
+		client_queue(client, message.data, message.len);
+		buf_reset(&message);
+	}
+	client->dirty = 0;
+}
+
+/* Returns false if the client was destroyed */
+static bool
+client_flush(struct ipc_client *client)
+{
+	while (client_pending_output(client)) {
+		ssize_t n = send(client->fd,
+			(char *)client->out.data + client->out_sent,
+			client_pending_output(client), MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (n < 0) {
+			wlr_log_errno(WLR_DEBUG, "ipc: failed to write to client");
+			client_destroy(client);
+			return false;
+		}
+		client->out_sent += n;
+
+		if (!client_pending_output(client)) {
+			client->out.size = 0;
+			client->out_sent = 0;
+			/*
+			 * Events which changed while the client was busy are
+			 * only sent now, with the latest state
+			 */
+			if (client->dirty && !client->closing) {
+				client_queue_events(client);
+			}
+		}
+	}
+	return client_update_mask(client);
+}
+
+static void
+handle_events_idle(void *data)
+{
+	ipc.events_idle = NULL;
+
+	struct ipc_client *client, *tmp;
+	wl_list_for_each_safe(client, tmp, &ipc.clients, link) {
+		if (!client->dirty || client_pending_output(client)) {
+			continue;
+		}
+		client_queue_events(client);
+		client_flush(client);
+	}
+}
+
+static void
+schedule_events(void)
+{
+	if (!ipc.events_idle) {
+		ipc.events_idle = wl_event_loop_add_idle(
+			ipc.server->wl_event_loop, handle_events_idle, NULL);
+	}
+}
+
+void
+ipc_emit(enum ipc_event event)
+{
+	if (event & IPC_EVENT_WINDOWS) {
+		ipc.windows_generation++;
+	}
+	if (!ipc.path) {
+		return;
+	}
+	bool subscribed = false;
+	struct ipc_client *client;
+	wl_list_for_each(client, &ipc.clients, link) {
+		if (client->subscriptions & event) {
+			client->dirty |= event;
+			subscribed = true;
+		}
+	}
+	if (subscribed) {
+		schedule_events();
+	}
+}
+
+static bool
+handle_events_request(struct ipc_client *client, const char *command,
+		char *arg, struct buf *result)
+{
+	bool subscribe = !strcmp(command, "subscribe");
+	if (!subscribe && strcmp(command, "unsubscribe")) {
+		buf_add_fmt(result, "Unknown events command: %s", command);
+		return false;
+	}
+
+	uint32_t mask = 0;
+	char *saveptr = NULL;
+	for (char *name = strtok_r(arg, " \t,", &saveptr); name;
+			name = strtok_r(NULL, " \t,", &saveptr)) {
+		size_t i;
+		for (i = 0; i < ARRAY_SIZE(event_names); i++) {
+			if (!strcmp(name, event_names[i])) {
+				break;
+			}
+		}
+		if (i < ARRAY_SIZE(event_names)) {
+			mask |= 1u << i;
+		} else if (!strcmp(name, "all")) {
+			mask |= IPC_EVENT_ALL;
+		} else {
+			buf_add_fmt(result, "Unknown event: %s", name);
+			return false;
+		}
+	}
+	if (!mask) {
+		buf_add(result, "expected a list of events");
+		return false;
+	}
+
+	if (subscribe) {
+		/* Start with the current state */
+		client->subscriptions |= mask;
+		client->dirty |= mask;
+		schedule_events();
+	} else {
+		client->subscriptions &= ~mask;
+		client->dirty &= client->subscriptions;
+	}
+	return true;
+}
+
+static void
+handle_request(struct ipc_client *client, char *request)
+{
+	char *domain = string_strip(request);
+	char *command = domain + strcspn(domain, " \t");
+	if (*command) {
+		*command++ = '\0';
+		command += strspn(command, " \t");
+	}
+	char *arg = command + strcspn(command, " \t");
+	if (*arg) {
+		*arg++ = '\0';
+		arg = string_strip(arg);
+	}
+
+	struct buf result = BUF_INIT;
+	bool ok;
+	if (!*domain || !*command) {
+		buf_add(&result, "expected <domain> <command> [argument]");
+		ok = false;
+	} else if (!strcmp(domain, "events")) {
+		ok = handle_events_request(client, command, arg, &result);
+	} else if (!strcmp(domain, "windows")) {
+		ok = !strcmp(command, "list");
+		if (ok) {
+			describe_windows(ipc.server, &result);
+		} else {
+			buf_add_fmt(&result, "Unknown windows command: %s",
+				command);
+		}
+	} else {
+		ok = server_run_command(ipc.server, domain, command,
+			*arg ? arg : NULL, &result);
+	}
+	if (!ok) {
+		wlr_log(WLR_INFO, "ipc: '%s %s' failed: %s", domain, command,
+			result.data);
+	} else {
+		lab_log(LAB_LOG_IPC, "ipc: '%s %s%s%s' ok", domain, command,
+			*arg ? " " : "", arg);
+	}
+
+	struct buf reply = BUF_INIT;
+	buf_add(&reply, ok ? "ok" : "error");
+	if (result.len) {
+		buf_add_char(&reply, '\n');
+		buf_add(&reply, result.data);
+	}
+	client_queue(client, reply.data, reply.len);
+	buf_reset(&reply);
+	buf_reset(&result);
+}
+
+/* Process all complete requests, returns false on protocol errors */
+static bool
+client_process_input(struct ipc_client *client)
+{
+	size_t offset = 0;
+	while (client->in.size - offset >= sizeof(struct ipc_header)) {
+		struct ipc_header header;
+		memcpy(&header, (char *)client->in.data + offset, sizeof(header));
+		if (header.length > IPC_MAX_PAYLOAD) {
+			wlr_log(WLR_ERROR, "ipc: request too large (%u bytes)",
+				header.length);
+			return false;
+		}
+		size_t frame = sizeof(header) + header.length;
+		if (client->in.size - offset < frame) {
+			break;
+		}
+		char *request = xmalloc(header.length + 1);
+		memcpy(request, (char *)client->in.data + offset + sizeof(header),
+			header.length);
+		request[header.length] = '\0';
+		offset += frame;
+
+		if (strlen(request) != header.length) {
+			wlr_log(WLR_ERROR, "ipc: request contains NUL bytes");
+			free(request);
+			return false;
+		}
+		handle_request(client, request);
+		free(request);
+	}
+
+	/* Keep a partial request for the next read */
+	memmove(client->in.data, (char *)client->in.data + offset,
+		client->in.size - offset);
+	client->in.size -= offset;
+	return true;
+}
+
+static int
+handle_client_event(int fd, uint32_t mask, void *data)
+{
+	struct ipc_client *client = data;
+
+	if (mask & WL_EVENT_READABLE) {
+		char buffer[4096];
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			wlr_log_errno(WLR_DEBUG, "ipc: failed to read from client");
+			client_destroy(client);
+			return 0;
+		}
+		if (n == 0) {
+			client->closing = true;
+		} else if (n > 0) {
+			char *dest = wl_array_add(&client->in, n);
+			if (!dest) {
+				client_destroy(client);
+				return 0;
+			}
+			memcpy(dest, buffer, n);
+			if (!client_process_input(client)) {
+				client_destroy(client);
+				return 0;
+			}
+		}
+	} else if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		client_destroy(client);
+		return 0;
+	}
+
+	client_flush(client);
+	return 0;
+}
+
+static int
+handle_connection(int fd, uint32_t mask, void *data)
+{
+	int client_fd = accept(fd, NULL, NULL);
+	if (client_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to accept connection");
+		return 0;
+	}
+	if (fcntl(client_fd, F_SETFD, FD_CLOEXEC) < 0
+			|| fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to set up connection");
+		close(client_fd);
+		return 0;
+	}
+
+	struct ipc_client *client = znew(*client);
+	client->fd = client_fd;
+	wl_array_init(&client->in);
+	wl_array_init(&client->out);
+	client->source = wl_event_loop_add_fd(ipc.server->wl_event_loop,
+		client_fd, WL_EVENT_READABLE, handle_client_event, client);
+	if (!client->source) {
+		wlr_log(WLR_ERROR, "ipc: failed to watch connection");
+		close(client_fd);
+		free(client);
+		return 0;
+	}
+	wl_list_insert(&ipc.clients, &client->link);
+	return 0;
+}
+
+void
+ipc_init(struct server *server, const char *wayland_socket)
+{
+	ipc.server = server;
+	wl_list_init(&ipc.clients);
+
+	ipc.path = strdup_printf("%s/labwc.%s.sock",
+		getenv("XDG_RUNTIME_DIR"), wayland_socket);
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(ipc.path) >= sizeof(addr.sun_path)) {
+		wlr_log(WLR_ERROR, "ipc: socket path '%s' is too long", ipc.path);
+		goto err;
+	}
+	strcpy(addr.sun_path, ipc.path);
+
+	ipc.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (ipc.fd < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to create socket");
+		goto err;
+	}
+	if (fcntl(ipc.fd, F_SETFD, FD_CLOEXEC) < 0
+			|| fcntl(ipc.fd, F_SETFL, O_NONBLOCK) < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to set up socket");
+		goto err;
+	}
+
+	/* The name is unique for this compositor, so any leftover is stale */
+	unlink(ipc.path);
+	if (bind(ipc.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to bind '%s'", ipc.path);
+		goto err;
+	}
+	chmod(ipc.path, S_IRUSR | S_IWUSR);
+	if (listen(ipc.fd, 16) < 0) {
+		wlr_log_errno(WLR_ERROR, "ipc: failed to listen");
+		goto err_unlink;
+	}
+
+	ipc.source = wl_event_loop_add_fd(server->wl_event_loop, ipc.fd,
+		WL_EVENT_READABLE, handle_connection, NULL);
+	if (!ipc.source) {
+		wlr_log(WLR_ERROR, "ipc: failed to watch socket");
+		goto err_unlink;
+	}
+
+	if (setenv("LABWC_SOCK", ipc.path, true) < 0) {
+		wlr_log_errno(WLR_ERROR, "unable to set LABWC_SOCK");
+	} else {
+		wlr_log(WLR_DEBUG, "LABWC_SOCK=%s", ipc.path);
+	}
+	return;
+
+err_unlink:
+	unlink(ipc.path);
+err:
+	if (ipc.fd >= 0) {
+		close(ipc.fd);
+		ipc.fd = -1;
+	}
+	zfree(ipc.path);
+}
+
+void
+ipc_finish(void)
+{
+	if (!ipc.path) {
+		return;
+	}
+	struct ipc_client *client, *tmp;
+	wl_list_for_each_safe(client, tmp, &ipc.clients, link) {
+		client_destroy(client);
+	}
+	if (ipc.events_idle) {
+		wl_event_source_remove(ipc.events_idle);
+		ipc.events_idle = NULL;
+	}
+	wl_event_source_remove(ipc.source);
+	ipc.source = NULL;
+	close(ipc.fd);
+	ipc.fd = -1;
+	unlink(ipc.path);
+	zfree(ipc.path);
+}
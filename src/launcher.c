@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* For ppoll() and POSIX_SPAWN_SETSID with glibc */
+#define _GNU_SOURCE
+#include "launcher.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "common/buf.h"
+#include "common/macros.h"
+#include "common/mem.h"
+#include "config/rcxml.h"
+
+#ifndef POSIX_SPAWN_SETSID
+#define POSIX_SPAWN_SETSID 0
+#endif
+
+/* Larger requests are spawned by the compositor itself */
+#define MAX_REQUEST (256 * 1024)
+
+extern char **environ;
+
+/*
+ * A request is a struct request_header followed by argc NUL-terminated
+ * arguments and then the NUL-terminated environment strings.
+ */
+struct request_header {
+	uint32_t argc;
+};
+
+struct exit_report {
+	int32_t pid;
+	int32_t code;
+	int32_t status;
+};
+
+static struct {
+	int fd;
+	struct wl_event_source *source;
+	void (*child_exited)(pid_t pid, int code, int status, void *data);
+	void *data;
+} launcher = { .fd = -1 };
+
+/* Helper process */
+
+static void
+handle_sigchld(int signal)
+{
+	/* Only interrupts ppoll() */
+	(void)signal;
+}
+
+static void
+reap_children(int fd)
+{
+	for (;;) {
+		siginfo_t info = { 0 };
+		if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG) || !info.si_pid) {
+			return;
+		}
+		struct exit_report report = {
+			.pid = info.si_pid,
+			.code = info.si_code,
+			.status = info.si_status,
+		};
+		send(fd, &report, sizeof(report), MSG_NOSIGNAL);
+	}
+}
+
+/* Split @len bytes at @data into NUL-terminated strings */
+static char **
+split_strings(char *data, size_t len, size_t *nr_strings)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < len; i++) {
+		count += !data[i];
+	}
+	char **strings = znew_n(char *, count + 1);
+	for (size_t i = 0; i < count; i++) {
+		strings[i] = data;
+		data += strlen(data) + 1;
+	}
+	*nr_strings = count;
+	return strings;
+}
+
+static void
+handle_request(char *data, size_t len)
+{
+	struct request_header header;
+	if (len < sizeof(header) + 1 || data[len - 1]) {
+		wlr_log(WLR_ERROR, "spawn helper: malformed request");
+		return;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	size_t nr_strings;
+	char **strings = split_strings(data + sizeof(header),
+		len - sizeof(header), &nr_strings);
+	if (!header.argc || header.argc > nr_strings) {
+		wlr_log(WLR_ERROR, "spawn helper: malformed request");
+		free(strings);
+		return;
+	}
+
+	/* argv and envp must both be NULL-terminated */
+	char **argv = znew_n(char *, header.argc + 1);
+	memcpy(argv, strings, header.argc * sizeof(char *));
+	char **envp = strings + header.argc;
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t set;
+	sigemptyset(&set);
+	posix_spawnattr_setsigmask(&attr, &set);
+	posix_spawnattr_setflags(&attr,
+		POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSID);
+
+	pid_t pid;
+	int err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, envp);
+	if (err) {
+		errno = err;
+		wlr_log_errno(WLR_ERROR, "unable to execute %s", argv[0]);
+	}
+	posix_spawnattr_destroy(&attr);
+	free(argv);
+	free(strings);
+}
+
+static void
+run_helper(int fd)
+{
+	/* Keep SIGCHLD blocked except while waiting in ppoll() */
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &blocked, &unblocked);
+	sigdelset(&unblocked, SIGCHLD);
+
+	struct sigaction sa = { .sa_handler = handle_sigchld };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	char *buffer = xmalloc(MAX_REQUEST);
+	struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+	for (;;) {
+		reap_children(fd);
+		if (ppoll(&pollfd, 1, NULL, &unblocked) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (!(pollfd.revents & POLLIN)) {
+			break;
+		}
+		/* Zero bytes means that the compositor has exited */
+		ssize_t len = recv(fd, buffer, MAX_REQUEST, 0);
+		if (len <= 0) {
+			break;
+		}
+		handle_request(buffer, len);
+	}
+	_exit(0);
+}
+
+void
+launcher_init(void)
+{
+	if (!rc.spawn_helper) {
+		return;
+	}
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot create spawn helper socket");
+		return;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot fork spawn helper");
+		close(fds[0]);
+		close(fds[1]);
+		return;
+	} else if (pid == 0) {
+		close(fds[0]);
+		run_helper(fds[1]);
+	}
+
+	close(fds[1]);
+	launcher.fd = fds[0];
+	wlr_log(WLR_INFO, "started spawn helper %ld", (long)pid);
+}
+
+/* Compositor */
+
+static void
+close_connection(void)
+{
+	if (launcher.source) {
+		wl_event_source_remove(launcher.source);
+		launcher.source = NULL;
+	}
+	if (launcher.fd >= 0) {
+		close(launcher.fd);
+		launcher.fd = -1;
+	}
+}
+
+static int
+handle_reports(int fd, uint32_t mask, void *data)
+{
+	struct exit_report report;
+	while (recv(fd, &report, sizeof(report), MSG_DONTWAIT)
+			== sizeof(report)) {
+		launcher.child_exited(report.pid, report.code, report.status,
+			launcher.data);
+	}
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		wlr_log(WLR_ERROR, "spawn helper exited, spawning directly");
+		close_connection();
+	}
+	return 0;
+}
+
+void
+launcher_attach(struct wl_event_loop *loop,
+		void (*child_exited)(pid_t pid, int code, int status, void *data),
+		void *data)
+{
+	if (launcher.fd < 0) {
+		return;
+	}
+	launcher.child_exited = child_exited;
+	launcher.data = data;
+	launcher.source = wl_event_loop_add_fd(loop, launcher.fd,
+		WL_EVENT_READABLE, handle_reports, NULL);
+}
+
+void
+launcher_finish(void)
+{
+	close_connection();
+}
+
+bool
+launcher_spawn(char *const argv[])
+{
+	if (launcher.fd < 0 || !argv[0]) {
+		return false;
+	}
+
+	struct request_header header = { 0 };
+	struct buf strings = BUF_INIT;
+	for (; argv[header.argc]; header.argc++) {
+		buf_add(&strings, argv[header.argc]);
+		buf_add_char(&strings, '\0');
+	}
+	for (char **env = environ; *env; env++) {
+		buf_add(&strings, *env);
+		buf_add_char(&strings, '\0');
+	}
+
+	struct iovec iov[] = {
+		{ .iov_base = &header, .iov_len = sizeof(header) },
+		{ .iov_base = strings.data, .iov_len = strings.len },
+	};
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = ARRAY_SIZE(iov) };
+	ssize_t ret = -1;
+	if (sizeof(header) + strings.len <= MAX_REQUEST) {
+		/* Sent atomically, it's all or nothing on SOCK_SEQPACKET */
+		ret = sendmsg(launcher.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+	buf_reset(&strings);
+
+	if (ret < 0 && (errno == EPIPE || errno == ECONNRESET)) {
+		wlr_log(WLR_ERROR, "spawn helper exited, spawning directly");
+		close_connection();
+	}
+	return ret >= 0;
+}
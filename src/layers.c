@@ -20,6 +20,7 @@
 #include "common/macros.h"
 #include "common/mem.h"
 #include "config/rcxml.h"
+#include "input/ime.h"
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
@@ -116,6 +117,8 @@ layers_arrange(struct output *output)
 	}
 
 	output->usable_area = usable_area;
+	/* Layer-shell surfaces may have moved */
+	input_method_relay_invalidate(server->seat.input_method_relay);
 }
 
 static void
@@ -248,6 +251,36 @@ is_on_demand(struct wlr_layer_surface_v1 *layer_surface)
 		ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_ON_DEMAND;
 }
 
+/* Returns true if the state relevant to layers_arrange() changed */
+static bool
+update_arranged_state(struct lab_layer_surface *layer)
+{
+	const struct wlr_layer_surface_v1_state *state =
+		&layer->layer_surface->current;
+	bool changed = layer->arranged.anchor != state->anchor
+		|| layer->arranged.exclusive_zone != state->exclusive_zone
+		|| layer->arranged.exclusive_edge != state->exclusive_edge
+		|| layer->arranged.desired_width != state->desired_width
+		|| layer->arranged.desired_height != state->desired_height
+		|| layer->arranged.margin_top != state->margin.top
+		|| layer->arranged.margin_right != state->margin.right
+		|| layer->arranged.margin_bottom != state->margin.bottom
+		|| layer->arranged.margin_left != state->margin.left
+		|| layer->arranged.layer != state->layer;
+
+	layer->arranged.anchor = state->anchor;
+	layer->arranged.exclusive_zone = state->exclusive_zone;
+	layer->arranged.exclusive_edge = state->exclusive_edge;
+	layer->arranged.desired_width = state->desired_width;
+	layer->arranged.desired_height = state->desired_height;
+	layer->arranged.margin_top = state->margin.top;
+	layer->arranged.margin_right = state->margin.right;
+	layer->arranged.margin_bottom = state->margin.bottom;
+	layer->arranged.margin_left = state->margin.left;
+	layer->arranged.layer = state->layer;
+	return changed;
+}
+
 static void
 handle_surface_commit(struct wl_listener *listener, void *data)
 {
@@ -295,7 +328,14 @@ handle_surface_commit(struct wl_listener *listener, void *data)
 	}
 out:
 
-	if (committed || layer->mapped != layer_surface->surface->mapped) {
+	/*
+	 * Clients such as animated bars commit the same state over and
+	 * over, so only re-arrange if something affecting the arrangement
+	 * actually changed.
+	 */
+	bool arrangement_changed = update_arranged_state(layer);
+	if (layer_surface->initial_commit || arrangement_changed
+			|| layer->mapped != layer_surface->surface->mapped) {
 		layer->mapped = layer_surface->surface->mapped;
 		output_update_usable_area(output);
 		/*
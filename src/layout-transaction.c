@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "layout-transaction.h"
+#include <assert.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "configure-stats.h"
+#include "labwc.h"
+#include "output.h"
+#include "view.h"
+
+static struct {
+	struct server *server;
+	int depth;
+	/* Views with a configure request sent during the transaction */
+	int nr_pending;
+	struct wl_event_source *deadline;
+} transaction;
+
+static void
+finish(void)
+{
+	if (transaction.deadline) {
+		wl_event_source_remove(transaction.deadline);
+		transaction.deadline = NULL;
+	}
+
+	/* Present the new layout in one go */
+	struct output *output;
+	wl_list_for_each(output, &transaction.server->outputs, link) {
+		if (output_is_usable(output)) {
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+}
+
+static int
+handle_deadline(void *data)
+{
+	wlr_log(WLR_DEBUG, "layout transaction timed out with %d pending views",
+		transaction.nr_pending);
+
+	struct view *view;
+	wl_list_for_each(view, &transaction.server->views, link) {
+		view->in_layout_transaction = false;
+	}
+	transaction.nr_pending = 0;
+	finish();
+	return 0;
+}
+
+void
+layout_transaction_begin(struct server *server)
+{
+	transaction.server = server;
+	transaction.depth++;
+}
+
+void
+layout_transaction_commit(struct server *server)
+{
+	assert(transaction.depth > 0);
+	if (--transaction.depth > 0) {
+		return;
+	}
+	if (!transaction.nr_pending) {
+		if (transaction.deadline) {
+			/* An earlier transaction completed in the meantime */
+			finish();
+		}
+		return;
+	}
+
+	/*
+	 * Every participant has its own configure timeout, but a view may
+	 * get re-configured repeatedly, so bound the whole transaction too.
+	 * The deadline is not extended by later transactions to ensure that
+	 * constant relayouts cannot stall rendering.
+	 */
+	if (!transaction.deadline) {
+		transaction.deadline = wl_event_loop_add_timer(
+			server->wl_event_loop, handle_deadline, NULL);
+		if (!transaction.deadline) {
+			handle_deadline(NULL);
+			return;
+		}
+		wl_event_source_timer_update(transaction.deadline,
+			CONFIGURE_TIMEOUT_MS);
+	}
+}
+
+void
+layout_transaction_add_view(struct view *view)
+{
+	if (!transaction.depth || view->in_layout_transaction) {
+		return;
+	}
+	/* Do not keep everybody else waiting for a known-slow client */
+	if (configure_stats_view_is_slow(view)) {
+		return;
+	}
+	view->in_layout_transaction = true;
+	transaction.nr_pending++;
+}
+
+void
+layout_transaction_view_done(struct view *view)
+{
+	if (!view->in_layout_transaction) {
+		return;
+	}
+	view->in_layout_transaction = false;
+	assert(transaction.nr_pending > 0);
+	if (--transaction.nr_pending == 0 && !transaction.depth) {
+		finish();
+	}
+}
+
+bool
+layout_transaction_blocks_output(void)
+{
+	return transaction.nr_pending > 0;
+}
@@ -2,6 +2,7 @@
 
 #include "magnifier.h"
 #include <assert.h>
+#include <math.h>
 #include <wlr/render/allocator.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/types/wlr_cursor.h>
@@ -9,6 +10,7 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/transform.h>
 #include "common/box.h"
+#include "common/macros.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "output.h"
@@ -17,10 +19,97 @@
 static bool magnify_on;
 static double mag_scale = 0.0;
 
-/* Reuse a single scratch buffer */
+/*
+ * Reuse a single scratch buffer, only used on the magnified output. It
+ * is allocated in steps of TMP_BUFFER_STEP pixels and kept as long as it
+ * is large enough, so that zooming or moving to another output doesn't
+ * reallocate it every time.
+ */
+#define TMP_BUFFER_STEP 128
 static struct wlr_buffer *tmp_buffer = NULL;
 static struct wlr_texture *tmp_texture = NULL;
 
+/*
+ * The magnifier is only redrawn when its content may have changed, i.e.
+ * when the cursor moved, the scale changed or scene damage intersects
+ * the magnified area. Each such change bumps the generation below.
+ *
+ * As the output renders into a swapchain, we also remember which
+ * generation has been drawn into each buffer. Buffers that are already
+ * up to date are left alone.
+ */
+static struct {
+	struct output *output;
+	struct wlr_box box; /* magnifier incl. border in physical coords */
+	double cursor_x, cursor_y;
+	double scale;
+	uint64_t generation;
+} state;
+
+#define MAG_BUFFER_SLOTS 4
+
+static struct mag_buffer_slot {
+	struct wlr_buffer *buffer;
+	uint64_t generation;
+	struct wl_listener destroy;
+} slots[MAG_BUFFER_SLOTS];
+
+struct mag_geometry {
+	struct wlr_box output_box;   /* physical output coordinates */
+	struct wlr_box cursor_pos;   /* physical output coordinates */
+	struct wlr_box mag_box;      /* magnified area, not clipped */
+	struct wlr_box damage_box;   /* mag_box incl. border, clipped */
+	double cursor_logical_x, cursor_logical_y;
+};
+
+static void
+slot_clear(struct mag_buffer_slot *slot)
+{
+	if (slot->buffer) {
+		wl_list_remove(&slot->destroy.link);
+	}
+	*slot = (struct mag_buffer_slot){0};
+}
+
+static void
+handle_buffer_destroy(struct wl_listener *listener, void *data)
+{
+	struct mag_buffer_slot *slot = wl_container_of(listener, slot, destroy);
+	slot_clear(slot);
+}
+
+static struct mag_buffer_slot *
+slot_for_buffer(struct wlr_buffer *buffer)
+{
+	struct mag_buffer_slot *free_slot = NULL;
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].buffer == buffer) {
+			return &slots[i];
+		}
+		if (!free_slot && !slots[i].buffer) {
+			free_slot = &slots[i];
+		}
+	}
+	if (!free_slot) {
+		/* More buffers than expected, just recycle the first slot */
+		free_slot = &slots[0];
+		slot_clear(free_slot);
+	}
+	free_slot->buffer = buffer;
+	free_slot->generation = 0;
+	free_slot->destroy.notify = handle_buffer_destroy;
+	wl_signal_add(&buffer->events.destroy, &free_slot->destroy);
+	return free_slot;
+}
+
+static void
+slots_clear_all(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		slot_clear(&slots[i]);
+	}
+}
+
 static void
 box_logical_to_physical(struct wlr_box *box, struct wlr_output *output)
 {
@@ -38,56 +127,207 @@ box_logical_to_physical(struct wlr_box *box, struct wlr_output *output)
 		output_w, output_h);
 }
 
-void
-magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct wlr_box *damage)
+static bool
+magnifier_fullscreen(void)
+{
+	return rc.mag_width == -1 || rc.mag_height == -1;
+}
+
+/* Returns false if the cursor is not on the output */
+static bool
+get_geometry(struct output *output, struct mag_geometry *geo)
 {
 	struct server *server = output->server;
 	struct theme *theme = server->theme;
-	bool fullscreen = (rc.mag_width == -1 || rc.mag_height == -1);
 
-	struct wlr_box output_box = {
-		.width = output_buffer->width,
-		.height = output_buffer->height,
+	geo->output_box = (struct wlr_box){
+		.width = output->wlr_output->width,
+		.height = output->wlr_output->height,
 	};
 
 	/* Cursor position in per-output logical coordinate */
-	double cursor_logical_x = server->seat.cursor->x;
-	double cursor_logical_y = server->seat.cursor->y;
+	geo->cursor_logical_x = server->seat.cursor->x;
+	geo->cursor_logical_y = server->seat.cursor->y;
 	wlr_output_layout_output_coords(server->output_layout,
-		output->wlr_output, &cursor_logical_x, &cursor_logical_y);
+		output->wlr_output, &geo->cursor_logical_x,
+		&geo->cursor_logical_y);
 	/* Cursor position in per-output physical coordinate */
-	struct wlr_box cursor_pos = {
-		.x = cursor_logical_x,
-		.y = cursor_logical_y,
+	geo->cursor_pos = (struct wlr_box){
+		.x = geo->cursor_logical_x,
+		.y = geo->cursor_logical_y,
 	};
-	box_logical_to_physical(&cursor_pos, output->wlr_output);
+	box_logical_to_physical(&geo->cursor_pos, output->wlr_output);
+
+	if (!wlr_box_contains_point(&geo->output_box,
+			geo->cursor_pos.x, geo->cursor_pos.y)) {
+		return false;
+	}
 
-	if (!wlr_box_contains_point(&output_box,
-			cursor_pos.x, cursor_pos.y)) {
+	/* Magnifier geometry in physical output coordinate */
+	if (magnifier_fullscreen()) {
+		geo->mag_box = geo->output_box;
+		geo->damage_box = geo->output_box;
+		return true;
+	}
+
+	geo->mag_box.x = geo->cursor_logical_x - (rc.mag_width / 2.0);
+	geo->mag_box.y = geo->cursor_logical_y - (rc.mag_height / 2.0);
+	geo->mag_box.width = rc.mag_width;
+	geo->mag_box.height = rc.mag_height;
+	box_logical_to_physical(&geo->mag_box, output->wlr_output);
+
+	int border_width = theme->mag_border_width * output->wlr_output->scale;
+	struct wlr_box border_box = {
+		.x = geo->mag_box.x - border_width,
+		.y = geo->mag_box.y - border_width,
+		.width = geo->mag_box.width + border_width * 2,
+		.height = geo->mag_box.height + border_width * 2,
+	};
+	wlr_box_intersection(&geo->damage_box, &border_box, &geo->output_box);
+	return true;
+}
+
+static void
+add_box_damage(pixman_region32_t *damage, const struct wlr_box *box)
+{
+	if (!wlr_box_empty(box)) {
+		pixman_region32_union_rect(damage, damage,
+			box->x, box->y, box->width, box->height);
+	}
+}
+
+static void
+state_invalidate(pixman_region32_t *damage)
+{
+	add_box_damage(damage, &state.box);
+	state.generation++;
+}
+
+void
+magnifier_prepare(struct output *output,
+		const pixman_region32_t *pending_damage, pixman_region32_t *damage)
+{
+	if (!magnify_on) {
+		/* Clean up after the magnifier has been switched off */
+		if (state.output == output) {
+			state_invalidate(damage);
+			state.output = NULL;
+			state.box = (struct wlr_box){0};
+		}
+		return;
+	}
+
+	struct mag_geometry geo;
+	if (!get_geometry(output, &geo)) {
+		/* The cursor has left this output */
+		if (state.output == output) {
+			state_invalidate(damage);
+			state.output = NULL;
+			state.box = (struct wlr_box){0};
+		}
 		return;
 	}
 
+	if (mag_scale == 0.0) {
+		mag_scale = rc.mag_scale;
+	}
+
+	bool changed = state.output != output
+		|| !wlr_box_equal(&state.box, &geo.damage_box)
+		|| state.cursor_x != geo.cursor_pos.x
+		|| state.cursor_y != geo.cursor_pos.y
+		|| state.scale != mag_scale;
+
+	if (!changed) {
+		/* Re-render only if the magnified area has been damaged */
+		pixman_region32_t intersection;
+		pixman_region32_init(&intersection);
+		pixman_region32_intersect_rect(&intersection, pending_damage,
+			geo.damage_box.x, geo.damage_box.y,
+			geo.damage_box.width, geo.damage_box.height);
+		changed = pixman_region32_not_empty(&intersection);
+		pixman_region32_fini(&intersection);
+	}
+	if (!changed) {
+		return;
+	}
+
+	/* Damage both the old and the new location */
+	if (state.output == output) {
+		add_box_damage(damage, &state.box);
+	}
+	state.output = output;
+	state.box = geo.damage_box;
+	state.cursor_x = geo.cursor_pos.x;
+	state.cursor_y = geo.cursor_pos.y;
+	state.scale = mag_scale;
+	state_invalidate(damage);
+}
+
+void
+magnifier_draw(struct output *output, struct wlr_buffer *output_buffer)
+{
+	struct server *server = output->server;
+	struct theme *theme = server->theme;
+	/* The renderer of the GPU the output buffer was allocated on */
+	struct wlr_renderer *renderer = output->wlr_output->renderer;
+	bool fullscreen = magnifier_fullscreen();
+
+	if (state.output != output) {
+		return;
+	}
+
+	struct mag_buffer_slot *slot = slot_for_buffer(output_buffer);
+	if (slot->generation == state.generation) {
+		/* This buffer already shows the current magnifier */
+		return;
+	}
+
+	struct mag_geometry geo;
+	if (!get_geometry(output, &geo)) {
+		return;
+	}
+	struct wlr_box output_box = geo.output_box;
+	struct wlr_box cursor_pos = geo.cursor_pos;
+	struct wlr_box mag_box = geo.mag_box;
+
 	if (mag_scale == 0.0) {
 		mag_scale = rc.mag_scale;
 	}
 	assert(mag_scale >= 1.0);
 
-	/* Magnifier geometry in physical output coordinate */
-	struct wlr_box mag_box;
+	/* Region of the output buffer which is magnified into mag_box */
+	struct wlr_fbox src_box = {
+		.width = mag_box.width / mag_scale,
+		.height = mag_box.height / mag_scale,
+	};
 	if (fullscreen) {
-		mag_box = output_box;
+		src_box.x = cursor_pos.x - (cursor_pos.x / mag_scale);
+		src_box.y = cursor_pos.y - (cursor_pos.y / mag_scale);
 	} else {
-		mag_box.x = cursor_logical_x - (rc.mag_width / 2.0);
-		mag_box.y = cursor_logical_y - (rc.mag_height / 2.0);
-		mag_box.width = rc.mag_width;
-		mag_box.height = rc.mag_height;
-		box_logical_to_physical(&mag_box, output->wlr_output);
+		src_box.x = mag_box.x
+			+ mag_box.width * (mag_scale - 1.0) / (2.0 * mag_scale);
+		src_box.y = mag_box.y
+			+ mag_box.height * (mag_scale - 1.0) / (2.0 * mag_scale);
 	}
 
+	/*
+	 * Only that region is copied, rather than all of mag_box, which is
+	 * mag_scale^2 times fewer pixels. Add a margin of one pixel for
+	 * the filter.
+	 */
+	struct wlr_box copy_box = {
+		.x = (int)floor(src_box.x) - 1,
+		.y = (int)floor(src_box.y) - 1,
+	};
+	copy_box.width = (int)ceil(src_box.x + src_box.width) + 1 - copy_box.x;
+	copy_box.height = (int)ceil(src_box.y + src_box.height) + 1 - copy_box.y;
+
 	/* (Re)create the temporary buffer if required */
-	if (tmp_buffer && (tmp_buffer->width != mag_box.width
-			|| tmp_buffer->height != mag_box.height)) {
-		wlr_log(WLR_DEBUG, "tmp magnifier buffer size changed, dropping");
+	if (tmp_buffer && (tmp_buffer->width < copy_box.width
+			|| tmp_buffer->height < copy_box.height
+			|| tmp_texture->renderer != renderer)) {
+		wlr_log(WLR_DEBUG, "tmp magnifier buffer too small, dropping");
 		assert(tmp_texture);
 		wlr_texture_destroy(tmp_texture);
 		wlr_buffer_drop(tmp_buffer);
@@ -95,8 +335,12 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 		tmp_texture = NULL;
 	}
 	if (!tmp_buffer) {
+		int width = (copy_box.width + TMP_BUFFER_STEP - 1)
+			/ TMP_BUFFER_STEP * TMP_BUFFER_STEP;
+		int height = (copy_box.height + TMP_BUFFER_STEP - 1)
+			/ TMP_BUFFER_STEP * TMP_BUFFER_STEP;
 		tmp_buffer = wlr_allocator_create_buffer(
-			server->allocator, mag_box.width, mag_box.height,
+			output->wlr_output->allocator, width, height,
 			&output->wlr_output->swapchain->format);
 	}
 	if (!tmp_buffer) {
@@ -105,7 +349,7 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 	}
 
 	if (!tmp_texture) {
-		tmp_texture = wlr_texture_from_buffer(server->renderer, tmp_buffer);
+		tmp_texture = wlr_texture_from_buffer(renderer, tmp_buffer);
 	}
 	if (!tmp_texture) {
 		wlr_log(WLR_ERROR, "Failed to allocate temporary magnifier texture");
@@ -116,7 +360,7 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 
 	/* Extract source region into temporary buffer */
 	struct wlr_render_pass *tmp_render_pass = wlr_renderer_begin_buffer_pass(
-		server->renderer, tmp_buffer, NULL);
+		renderer, tmp_buffer, NULL);
 	if (!tmp_render_pass) {
 		wlr_log(WLR_ERROR, "Failed to begin magnifier render pass");
 		return;
@@ -124,17 +368,17 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 
 	wlr_buffer_lock(output_buffer);
 	struct wlr_texture *output_texture = wlr_texture_from_buffer(
-		server->renderer, output_buffer);
+		renderer, output_buffer);
 	if (!output_texture) {
 		goto cleanup;
 	}
 
 	struct wlr_box src_box_for_copy;
-	wlr_box_intersection(&src_box_for_copy, &mag_box, &output_box);
+	wlr_box_intersection(&src_box_for_copy, &copy_box, &output_box);
 
 	struct wlr_box dst_box_for_copy = src_box_for_copy;
-	dst_box_for_copy.x -= mag_box.x;
-	dst_box_for_copy.y -= mag_box.y;
+	dst_box_for_copy.x -= copy_box.x;
+	dst_box_for_copy.y -= copy_box.y;
 
 	struct wlr_render_texture_options opts = {
 		.texture = output_texture,
@@ -151,16 +395,13 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 
 	/* Render to the output buffer itself */
 	tmp_render_pass = wlr_renderer_begin_buffer_pass(
-		server->renderer, output_buffer, NULL);
+		renderer, output_buffer, NULL);
 	if (!tmp_render_pass) {
 		wlr_log(WLR_ERROR, "Failed to begin second magnifier render pass");
 		goto cleanup;
 	}
 
-	struct wlr_box damage_box;
-	if (fullscreen) {
-		damage_box = output_box;
-	} else {
+	if (!fullscreen) {
 		/* Draw borders */
 		int border_width =
 			theme->mag_border_width * output->wlr_output->scale;
@@ -181,23 +422,11 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 			.clip = NULL,
 		};
 		wlr_render_pass_add_rect(tmp_render_pass, &bg_opts);
-		wlr_box_intersection(&damage_box, &border_box, &output_box);
 	}
 
-	struct wlr_fbox src_box_for_paste = {
-		.width = mag_box.width / mag_scale,
-		.height = mag_box.height / mag_scale,
-	};
-
-	if (fullscreen) {
-		src_box_for_paste.x = cursor_pos.x - (cursor_pos.x / mag_scale);
-		src_box_for_paste.y = cursor_pos.y - (cursor_pos.y / mag_scale);
-	} else {
-		src_box_for_paste.x =
-			mag_box.width * (mag_scale - 1.0) / (2.0 * mag_scale);
-		src_box_for_paste.y =
-			mag_box.height * (mag_scale - 1.0) / (2.0 * mag_scale);
-	}
+	struct wlr_fbox src_box_for_paste = src_box;
+	src_box_for_paste.x -= copy_box.x;
+	src_box_for_paste.y -= copy_box.y;
 
 	/* Paste the magnified result back into the output buffer */
 	opts = (struct wlr_render_texture_options) {
@@ -213,29 +442,48 @@ magnifier_draw(struct output *output, struct wlr_buffer *output_buffer, struct w
 		goto cleanup;
 	}
 
-	/* And finally mark the extra damage */
-	*damage = damage_box;
+	slot->generation = state.generation;
 cleanup:
 	wlr_buffer_unlock(output_buffer);
 }
 
-bool
-output_wants_magnification(struct output *output)
+void
+magnifier_handle_cursor_motion(struct server *server)
 {
-	static double x = -1;
-	static double y = -1;
-	struct wlr_cursor *cursor = output->server->seat.cursor;
 	if (!magnify_on) {
-		x = -1;
-		y = -1;
-		return false;
+		return;
 	}
-	if (cursor->x == x && cursor->y == y) {
-		return false;
+	/* The magnifier follows the cursor, so a new frame is needed */
+	struct output *output = output_nearest_to_cursor(server);
+	if (output) {
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+	if (state.output && state.output != output) {
+		/* Remove the magnifier from the output the cursor left */
+		wlr_output_schedule_frame(state.output->wlr_output);
+	}
+}
+
+void
+magnifier_output_destroyed(struct output *output)
+{
+	if (state.output == output) {
+		state.output = NULL;
+		state.box = (struct wlr_box){0};
 	}
-	x = cursor->x;
-	y = cursor->y;
-	return output_nearest_to_cursor(output->server) == output;
+	/* The swapchain buffers of the output are going away as well */
+	slots_clear_all();
+}
+
+void
+magnifier_output_released(struct output *output)
+{
+	if (state.output != output) {
+		return;
+	}
+	magnifier_output_destroyed(output);
+	/* The scratch buffer is only in use on the magnified output */
+	magnifier_reset();
 }
 
 static void
@@ -256,6 +504,9 @@ magnifier_toggle(struct server *server)
 	if (output) {
 		wlr_output_schedule_frame(output->wlr_output);
 	}
+	if (state.output && state.output != output) {
+		wlr_output_schedule_frame(state.output->wlr_output);
+	}
 }
 
 /* Increases and decreases magnification scale */
@@ -294,6 +545,8 @@ magnifier_reset(void)
 		tmp_buffer = NULL;
 		tmp_texture = NULL;
 	}
+	slots_clear_all();
+	state.generation++;
 }
 
 /* Report whether magnification is enabled */
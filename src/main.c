@@ -8,14 +8,22 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "common/buf.h"
 #include "common/fd-util.h"
 #include "common/font.h"
+#include "common/log.h"
 #include "common/spawn.h"
 #include "config/keybind.h"
 #include "config/rcxml.h"
 #include "config/session.h"
+#include "deferred-startup.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "launcher.h"
+#include "startup-profile.h"
+#include "theme-cache.h"
 #include "theme.h"
+#include "trace.h"
 #include "translate.h"
 #include "menu/menu.h"
 
@@ -24,6 +32,7 @@ struct rcxml rc = { 0 };
 static const struct option long_options[] = {
 	{"config", required_argument, NULL, 'c'},
 	{"config-dir", required_argument, NULL, 'C'},
+	{"config-cache", no_argument, NULL, 9000},
 	{"debug", no_argument, NULL, 'd'},
 	{"exit", no_argument, NULL, 'e'},
 	{"help", no_argument, NULL, 'h'},
@@ -46,8 +55,32 @@ static const struct option long_options[] = {
 	{"tiling-grid-mode", required_argument, NULL, 3003},
 	{"recalculate-tiling", no_argument, NULL, 3004},
 	{"tiling-status", no_argument, NULL, 3005},
+	{"tiling-layout", required_argument, NULL, 3006},
 	{"virtual-output-add", required_argument, NULL, 4000},
 	{"virtual-output-remove", optional_argument, NULL, 4001},
+	{"output-stats", no_argument, NULL, 5000},
+	{"reset-output-stats", no_argument, NULL, 5001},
+	{"action-profile", required_argument, NULL, 6000},
+	{"action-stats", no_argument, NULL, 6001},
+	{"reset-action-stats", no_argument, NULL, 6002},
+	{"buffer-cache-stats", no_argument, NULL, 7000},
+	{"reset-buffer-cache-stats", no_argument, NULL, 7001},
+	{"buffer-memory-stats", no_argument, NULL, 7002},
+	{"configure-stats", no_argument, NULL, 8000},
+	{"reset-configure-stats", no_argument, NULL, 8001},
+	{"trace", required_argument, NULL, 10000},
+	{"trace-dump", optional_argument, NULL, 10001},
+	{"scene-stats", no_argument, NULL, 11000},
+	{"debug-categories", required_argument, NULL, 12000},
+	{"worker-stats", no_argument, NULL, 13000},
+	{"reset-worker-stats", no_argument, NULL, 13001},
+	{"timer-stats", no_argument, NULL, 14000},
+	{"reset-timer-stats", no_argument, NULL, 14001},
+	{"list-windows", no_argument, NULL, 15000},
+	{"input-latency", required_argument, NULL, 16000},
+	{"input-latency-stats", no_argument, NULL, 16001},
+	{"reset-input-latency-stats", no_argument, NULL, 16002},
+	{"metrics", no_argument, NULL, 16003},
 	{0, 0, 0, 0}
 };
 
@@ -55,6 +88,7 @@ static const char labwc_usage[] =
 "Usage: labwc [options...]\n"
 "  -c, --config <file>      Specify config file (with path)\n"
 "  -C, --config-dir <dir>   Specify config directory\n"
+"      --config-cache       Cache the preprocessed rc.xml\n"
 "  -d, --debug              Enable full logging, including debug information\n"
 "  -e, --exit               Exit the compositor\n"
 "  -h, --help               Show help message and quit\n"
@@ -76,10 +110,34 @@ static const char labwc_usage[] =
 "      --toggle-tiling           Toggle automatic tiling mode on/off\n"
 "      --tiling-grid-mode <on|off|toggle>  Set grid snapping mode (on=simple grid, off=smart resize preservation)\n"
 "      --recalculate-tiling      Recalculate and rearrange tiled windows\n"
-"      --tiling-status           Query the current tiling mode (stacking/grid/smart)\n"
+"      --tiling-status           Query the current tiling mode (stacking/grid/smart/master-stack/bsp)\n"
+"      --tiling-layout <grid|master-stack|bsp>  Switch the tiling layout\n"
 "      --virtual-output-add <name[:WIDTHxHEIGHT[@REFRESH]]>  Create a virtual output\n"
 "                                                             (e.g., ScreenCasting:1920x1080@60)\n"
-"      --virtual-output-remove [name] Remove a virtual output (by name, or last if no name provided)\n";
+"      --virtual-output-remove [name] Remove a virtual output (by name, or last if no name provided)\n"
+"      --output-stats            Print per-output frame time statistics\n"
+"      --reset-output-stats      Reset per-output frame time statistics\n"
+"      --action-profile <on|off|toggle>  Profile the execution of actions\n"
+"      --action-stats            Print action execution statistics\n"
+"      --reset-action-stats      Reset action execution statistics\n"
+"      --buffer-cache-stats      Print scaled buffer cache statistics\n"
+"      --reset-buffer-cache-stats  Reset scaled buffer cache statistics\n"
+"      --buffer-memory-stats     Print the memory of buffers by category\n"
+"      --configure-stats         Print per-application configure latency statistics\n"
+"      --reset-configure-stats   Reset configure latency statistics\n"
+"      --trace <off|marker|ring>  Trace compositor hot paths\n"
+"      --trace-dump [path]       Write the trace ring buffer as JSON\n"
+"      --scene-stats             Print scene graph statistics as JSON\n"
+"      --debug-categories <list>  Set the debug log categories, e.g. keyboard,ipc\n"
+"      --worker-stats            Print worker thread job statistics\n"
+"      --reset-worker-stats      Reset worker thread job statistics\n"
+"      --timer-stats             Print timer wakeup statistics\n"
+"      --reset-timer-stats       Reset timer wakeup statistics\n"
+"      --list-windows            Print all windows with their geometry\n"
+"      --input-latency <on|off>  Trace input-to-photon latency\n"
+"      --input-latency-stats     Print per-application input latency histograms\n"
+"      --reset-input-latency-stats  Reset input latency statistics\n"
+"      --metrics                Print all counters and gauges (OpenMetrics)\n";
 
 static void
 usage(void)
@@ -156,212 +214,31 @@ send_signal_to_labwc_pid(int signal)
 	kill(pid, signal);
 }
 
+/*
+ * Run a command in the running compositor, print its result and exit.
+ * See ipc.h for the protocol.
+ */
 static void
-send_keybind_command(const char *command, const char *id)
+send_command(const char *domain, const char *command, const char *arg)
 {
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char *labwc_pid = getenv("LABWC_PID");
-	if (!labwc_pid) {
-		fprintf(stderr, "LABWC_PID not set - labwc is not running\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char cmd_file[256];
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-keybind-cmd", runtime_dir);
-
-	FILE *f = fopen(cmd_file, "w");
-	if (!f) {
-		perror("Failed to open command file");
-		exit(EXIT_FAILURE);
-	}
-
-	fprintf(f, "%s %s\n", command, id);
-	fclose(f);
-
-	/* Trigger the running instance to process the command */
-	send_signal_to_labwc_pid(SIGUSR1);
-}
-
-static void
-send_tiling_command(const char *command, const char *arg)
-{
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char *labwc_pid = getenv("LABWC_PID");
-	if (!labwc_pid) {
-		fprintf(stderr, "LABWC_PID not set - labwc is not running\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char cmd_file[256];
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-tiling-cmd", runtime_dir);
-
-	FILE *f = fopen(cmd_file, "w");
-	if (!f) {
-		perror("Failed to open command file");
-		exit(EXIT_FAILURE);
-	}
-
-	if (arg) {
-		fprintf(f, "%s %s\n", command, arg);
-	} else {
-		fprintf(f, "%s\n", command);
-	}
-	fclose(f);
-
-	/* Trigger the running instance to process the command */
-	send_signal_to_labwc_pid(SIGUSR1);
-}
-
-static void
-send_workspace_command(const char *command, const char *arg)
-{
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char *labwc_pid = getenv("LABWC_PID");
-	if (!labwc_pid) {
-		fprintf(stderr, "LABWC_PID not set - labwc is not running\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char cmd_file[256];
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-workspace-cmd", runtime_dir);
-
-	FILE *f = fopen(cmd_file, "w");
-	if (!f) {
-		perror("Failed to open command file");
-		exit(EXIT_FAILURE);
-	}
-
-	if (arg) {
-		fprintf(f, "%s %s\n", command, arg);
-	} else {
-		fprintf(f, "%s\n", command);
-	}
-	fclose(f);
-
-	/* Trigger the running instance to process the command */
-	send_signal_to_labwc_pid(SIGUSR1);
-}
-
-static void
-send_virtual_output_command(const char *command, const char *arg)
-{
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char *labwc_pid = getenv("LABWC_PID");
-	if (!labwc_pid) {
-		fprintf(stderr, "LABWC_PID not set - labwc is not running\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char cmd_file[256];
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-virtual-output-cmd", runtime_dir);
-
-	FILE *f = fopen(cmd_file, "w");
-	if (!f) {
-		perror("Failed to open command file");
-		exit(EXIT_FAILURE);
-	}
-
+	struct buf request = BUF_INIT;
+	buf_add_fmt(&request, "%s %s", domain, command);
 	if (arg) {
-		fprintf(f, "%s %s\n", command, arg);
-	} else {
-		fprintf(f, "%s\n", command);
-	}
-	fclose(f);
-
-	/* Trigger the running instance to process the command */
-	send_signal_to_labwc_pid(SIGUSR1);
-}
-
-static void
-query_workspace_current(void)
-{
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char status_file[256];
-	snprintf(status_file, sizeof(status_file), "%s/labwc-workspace-current", runtime_dir);
-
-	FILE *f = fopen(status_file, "r");
-	if (!f) {
-		fprintf(stderr, "Failed to read workspace status file\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char workspace[256];
-	if (fgets(workspace, sizeof(workspace), f)) {
-		/* Remove trailing newline if present */
-		size_t len = strlen(workspace);
-		if (len > 0 && workspace[len - 1] == '\n') {
-			workspace[len - 1] = '\0';
-		}
-		printf("%s\n", workspace);
-	} else {
-		fprintf(stderr, "Failed to read workspace name\n");
-		fclose(f);
-		exit(EXIT_FAILURE);
-	}
-
-	fclose(f);
-	exit(0);
-}
-
-static void
-query_tiling_status(void)
-{
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		fprintf(stderr, "XDG_RUNTIME_DIR not set\n");
-		exit(EXIT_FAILURE);
+		buf_add_fmt(&request, " %s", arg);
 	}
 
-	char status_file[256];
-	snprintf(status_file, sizeof(status_file), "%s/labwc-tiling-status", runtime_dir);
-
-	FILE *f = fopen(status_file, "r");
-	if (!f) {
-		fprintf(stderr, "Failed to read tiling status file\n");
-		exit(EXIT_FAILURE);
-	}
-
-	char status[256];
-	if (fgets(status, sizeof(status), f)) {
-		/* Remove trailing newline if present */
-		size_t len = strlen(status);
-		if (len > 0 && status[len - 1] == '\n') {
-			status[len - 1] = '\0';
+	struct buf reply = BUF_INIT;
+	bool ok = ipc_client_request(request.data, &reply);
+	if (reply.len) {
+		FILE *stream = ok ? stdout : stderr;
+		fputs(reply.data, stream);
+		if (reply.data[reply.len - 1] != '\n') {
+			fputc('\n', stream);
 		}
-		printf("%s\n", status);
-	} else {
-		fprintf(stderr, "Failed to read tiling status\n");
-		fclose(f);
-		exit(EXIT_FAILURE);
 	}
-
-	fclose(f);
-	exit(0);
+	buf_reset(&request);
+	buf_reset(&reply);
+	exit(ok ? 0 : EXIT_FAILURE);
 }
 
 struct idle_ctx {
@@ -371,9 +248,8 @@ struct idle_ctx {
 };
 
 static void
-idle_callback(void *data)
+start_clients(void *data)
 {
-	/* Idle callbacks destroy automatically once triggered */
 	struct idle_ctx *ctx = data;
 
 	/* Start session-manager if one is specified by -S|--session */
@@ -387,10 +263,23 @@ idle_callback(void *data)
 		}
 	}
 
+	startup_profile_begin("autostart");
 	session_autostart_init(ctx->server);
 	if (ctx->startup_cmd) {
 		spawn_async_no_shell(ctx->startup_cmd);
 	}
+	startup_profile_end();
+	startup_profile_finish();
+}
+
+static void
+idle_callback(void *data)
+{
+	/* Idle callbacks destroy automatically once triggered */
+	struct idle_ctx *ctx = data;
+
+	/* Autostart is released once deferred startup is done */
+	deferred_startup_start(ctx->server, start_clients, ctx);
 }
 
 int
@@ -423,6 +312,9 @@ main(int argc, char *argv[])
 		case 'm':
 			rc.merge_config = true;
 			break;
+		case 9000: /* --config-cache */
+			rc.config_cache = true;
+			break;
 		case 'r':
 			send_signal_to_labwc_pid(SIGHUP);
 			exit(0);
@@ -439,50 +331,122 @@ main(int argc, char *argv[])
 			verbosity = WLR_INFO;
 			break;
 		case 1000: /* --enable-keybind */
-			send_keybind_command("enable", optarg);
+			send_command("keybind", "enable", optarg);
 			exit(0);
 		case 1001: /* --disable-keybind */
-			send_keybind_command("disable", optarg);
+			send_command("keybind", "disable", optarg);
 			exit(0);
 		case 1002: /* --toggle-keybind */
-			send_keybind_command("toggle", optarg);
+			send_command("keybind", "toggle", optarg);
 			exit(0);
 		case 2000: /* --workspace-switch */
-			send_workspace_command("switch", optarg);
+			send_command("workspace", "switch", optarg);
 			exit(0);
 		case 2001: /* --workspace-next */
-			send_workspace_command("next", NULL);
+			send_command("workspace", "next", NULL);
 			exit(0);
 		case 2002: /* --workspace-prev */
-			send_workspace_command("prev", NULL);
+			send_command("workspace", "prev", NULL);
 			exit(0);
 		case 2003: /* --workspace-current */
-			query_workspace_current();
+			send_command("workspace", "current", NULL);
 			break;
 		case 3000: /* --enable-tiling */
-			send_tiling_command("enable", NULL);
+			send_command("tiling", "enable", NULL);
 			exit(0);
 		case 3001: /* --disable-tiling */
-			send_tiling_command("disable", NULL);
+			send_command("tiling", "disable", NULL);
 			exit(0);
 		case 3002: /* --toggle-tiling */
-			send_tiling_command("toggle", NULL);
+			send_command("tiling", "toggle", NULL);
 			exit(0);
 		case 3003: /* --tiling-grid-mode */
-			send_tiling_command("grid-mode", optarg);
+			send_command("tiling", "grid-mode", optarg);
 			exit(0);
 		case 3004: /* --recalculate-tiling */
-			send_tiling_command("recalculate", NULL);
+			send_command("tiling", "recalculate", NULL);
 			exit(0);
 		case 3005: /* --tiling-status */
-			query_tiling_status();
+			send_command("tiling", "status", NULL);
 			break;
+		case 3006: /* --tiling-layout */
+			send_command("tiling", "layout", optarg);
+			exit(0);
 		case 4000: /* --virtual-output-add */
-			send_virtual_output_command("add", optarg);
+			send_command("virtual-output", "add", optarg);
 			exit(0);
 		case 4001: /* --virtual-output-remove */
-			send_virtual_output_command("remove", optarg);
+			send_command("virtual-output", "remove", optarg);
+			exit(0);
+		case 5000: /* --output-stats */
+			send_command("output", "stats", NULL);
+			break;
+		case 5001: /* --reset-output-stats */
+			send_command("output", "reset-stats", NULL);
+			exit(0);
+		case 6000: /* --action-profile */
+			send_command("action", "profile", optarg);
+			exit(0);
+		case 6001: /* --action-stats */
+			send_command("action", "stats", NULL);
+			break;
+		case 6002: /* --reset-action-stats */
+			send_command("action", "reset-stats", NULL);
+			exit(0);
+		case 7000: /* --buffer-cache-stats */
+			send_command("buffer-cache", "stats", NULL);
+			break;
+		case 7001: /* --reset-buffer-cache-stats */
+			send_command("buffer-cache", "reset-stats", NULL);
+			exit(0);
+		case 7002: /* --buffer-memory-stats */
+			send_command("buffer-cache", "memory", NULL);
+			break;
+		case 8000: /* --configure-stats */
+			send_command("configure", "stats", NULL);
+			break;
+		case 8001: /* --reset-configure-stats */
+			send_command("configure", "reset-stats", NULL);
+			exit(0);
+		case 10000: /* --trace */
+			send_command("trace", "mode", optarg);
+			exit(0);
+		case 10001: /* --trace-dump */
+			send_command("trace", "dump", optarg);
+			break;
+		case 11000: /* --scene-stats */
+			send_command("scene", "stats", NULL);
+			break;
+		case 12000: /* --debug-categories */
+			send_command("debug", "categories", optarg);
+			break;
+		case 13000: /* --worker-stats */
+			send_command("worker", "stats", NULL);
+			break;
+		case 13001: /* --reset-worker-stats */
+			send_command("worker", "reset-stats", NULL);
+			exit(0);
+		case 14000: /* --timer-stats */
+			send_command("timer", "stats", NULL);
+			break;
+		case 14001: /* --reset-timer-stats */
+			send_command("timer", "reset-stats", NULL);
+			exit(0);
+		case 15000: /* --list-windows */
+			send_command("windows", "list", NULL);
+			break;
+		case 16000: /* --input-latency */
+			send_command("latency", "tracing", optarg);
+			exit(0);
+		case 16001: /* --input-latency-stats */
+			send_command("latency", "stats", NULL);
+			break;
+		case 16002: /* --reset-input-latency-stats */
+			send_command("latency", "reset-stats", NULL);
 			exit(0);
+		case 16003: /* --metrics */
+			send_command("metrics", "dump", NULL);
+			break;
 		case 'h':
 		default:
 			usage();
@@ -495,9 +459,13 @@ main(int argc, char *argv[])
 	wlr_log_init(verbosity, NULL);
 
 	die_on_detecting_suid();
+	startup_profile_begin("font_check");
 	die_on_no_fonts();
+	startup_profile_end();
 
+	startup_profile_begin("session_environment_init");
 	session_environment_init();
+	startup_profile_end();
 
 #if HAVE_NLS
 	/* Initialize locale after setting env vars */
@@ -506,7 +474,22 @@ main(int argc, char *argv[])
 	textdomain(GETTEXT_PACKAGE);
 #endif
 
+	const char *debug = getenv("LABWC_DEBUG");
+	if (debug && !lab_log_parse_categories(debug, &lab_log_categories)) {
+		wlr_log(WLR_ERROR, "invalid LABWC_DEBUG '%s'", debug);
+	}
+	if (getenv("LABWC_DEBUG_KEYBINDS")) {
+		lab_log_categories |= LAB_LOG_KEYBOARD;
+	}
+
+	const char *trace = getenv("LABWC_TRACE");
+	if (trace && !trace_set_mode(trace)) {
+		wlr_log(WLR_ERROR, "invalid LABWC_TRACE '%s'", trace);
+	}
+
+	startup_profile_begin("rcxml_read");
 	rcxml_read(rc.config_file);
+	startup_profile_end();
 
 	/*
 	 * Set environment variable LABWC_PID to the pid of the compositor
@@ -533,18 +516,31 @@ main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	/* Fork while the compositor is small and has default limits */
+	launcher_init();
+
 	increase_nofile_limit();
 
 	struct server server = { 0 };
+	startup_profile_begin("server_init");
 	server_init(&server);
+	startup_profile_end();
+	startup_profile_begin("server_start");
 	server_start(&server);
+	startup_profile_end();
 
 	struct theme theme = { 0 };
+	startup_profile_begin("theme_init");
 	theme_init(&theme, &server, rc.theme_name);
+	startup_profile_end();
 	rc.theme = &theme;
 	server.theme = &theme;
 
-	menu_init(&server);
+	if (!rc.deferred_startup) {
+		startup_profile_begin("menu_init");
+		menu_init(&server);
+		startup_profile_end();
+	}
 
 	/* Delay startup of applications until the event loop is ready */
 	struct idle_ctx idle_ctx = {
@@ -558,8 +554,10 @@ main(int argc, char *argv[])
 
 	session_shutdown(&server);
 
+	deferred_startup_finish();
 	menu_finish(&server);
 	theme_finish(&theme);
+	theme_cache_finish();
 	rcxml_finish();
 	font_finish();
 
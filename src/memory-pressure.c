@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "memory-pressure.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "buffer.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "cycle.h"
+#include "img/img.h"
+#include "labwc.h"
+#include "menu/menu.h"
+#include "scaled-buffer/scaled-buffer.h"
+#include "ssd.h"
+#include "view.h"
+
+#define PSI_PATH "/proc/pressure/memory"
+#define PSI_WINDOW_USEC 1000000
+/* Caches refill slowly, so don't shrink them again right away */
+#define MIN_SHRINK_INTERVAL_NSEC (10 * 1000000000ULL)
+
+static struct {
+	struct server *server;
+	int psi_fd;
+	/* PSI triggers signal EPOLLPRI, which the event loop cannot wait for */
+	int epoll_fd;
+	struct wl_event_source *source;
+	uint64_t last_shrink_nsec;
+} pressure = { .psi_fd = -1, .epoll_fd = -1 };
+
+void
+memory_pressure_shrink(struct server *server)
+{
+	size_t before[BUFFER_NR_CATEGORIES];
+	buffer_stats_get_bytes(before);
+
+	struct view *view;
+	wl_list_for_each(view, &server->views, link) {
+		ssd_release_hidden(view->ssd);
+	}
+	ssd_pool_flush();
+	scaled_buffer_cache_shrink();
+	menu_free_closed_scenes(server);
+	if (server->input_mode != LAB_INPUT_STATE_CYCLE) {
+		cycle_osd_thumbnail_reset();
+	}
+	lab_img_cache_trim();
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+
+	size_t after[BUFFER_NR_CATEGORIES];
+	buffer_stats_get_bytes(after);
+	size_t total = 0;
+	for (int i = 0; i < BUFFER_NR_CATEGORIES; i++) {
+		if (before[i] > after[i]) {
+			wlr_log(WLR_INFO, "memory pressure: freed %zu KiB of %s "
+				"buffers", (before[i] - after[i]) / 1024,
+				buffer_category_name(i));
+			total += before[i] - after[i];
+		}
+	}
+	wlr_log(WLR_INFO, "memory pressure: freed %zu KiB of buffers in total",
+		total / 1024);
+}
+
+static int
+handle_pressure(int fd, uint32_t mask, void *data)
+{
+	struct epoll_event event;
+	if (epoll_wait(fd, &event, 1, 0) < 1) {
+		return 0;
+	}
+	if (event.events & EPOLLERR) {
+		wlr_log(WLR_ERROR, "memory pressure monitoring failed");
+		memory_pressure_finish();
+		return 0;
+	}
+
+	uint64_t now = time_now_nsec();
+	if (pressure.last_shrink_nsec
+			&& now - pressure.last_shrink_nsec < MIN_SHRINK_INTERVAL_NSEC) {
+		return 0;
+	}
+	pressure.last_shrink_nsec = now;
+	wlr_log(WLR_INFO, "memory pressure above %u ms/s, shrinking caches",
+		rc.memory_pressure_threshold);
+	memory_pressure_shrink(pressure.server);
+	return 0;
+}
+
+void
+memory_pressure_init(struct server *server)
+{
+	if (!rc.memory_pressure_threshold) {
+		return;
+	}
+	pressure.server = server;
+	pressure.psi_fd = open(PSI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (pressure.psi_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot open %s", PSI_PATH);
+		return;
+	}
+
+	/* The stall time must be below the window */
+	unsigned int stall_usec = rc.memory_pressure_threshold * 1000;
+	if (stall_usec >= PSI_WINDOW_USEC) {
+		stall_usec = PSI_WINDOW_USEC - 1;
+	}
+	char trigger[64];
+	snprintf(trigger, sizeof(trigger), "some %u %u", stall_usec,
+		PSI_WINDOW_USEC);
+	if (write(pressure.psi_fd, trigger, strlen(trigger) + 1) < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot set memory pressure trigger");
+		goto err;
+	}
+
+	pressure.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event = { .events = EPOLLPRI };
+	if (pressure.epoll_fd < 0 || epoll_ctl(pressure.epoll_fd,
+			EPOLL_CTL_ADD, pressure.psi_fd, &event) < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot watch memory pressure");
+		goto err;
+	}
+	pressure.source = wl_event_loop_add_fd(server->wl_event_loop,
+		pressure.epoll_fd, WL_EVENT_READABLE, handle_pressure, NULL);
+	if (!pressure.source) {
+		goto err;
+	}
+	return;
+err:
+	memory_pressure_finish();
+}
+
+void
+memory_pressure_finish(void)
+{
+	if (pressure.source) {
+		wl_event_source_remove(pressure.source);
+		pressure.source = NULL;
+	}
+	if (pressure.epoll_fd >= 0) {
+		close(pressure.epoll_fd);
+		pressure.epoll_fd = -1;
+	}
+	if (pressure.psi_fd >= 0) {
+		close(pressure.psi_fd);
+		pressure.psi_fd = -1;
+	}
+}
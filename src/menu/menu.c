@@ -2,6 +2,8 @@
 #define _POSIX_C_SOURCE 200809L
 #include "menu/menu.h"
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <libxml/parser.h>
 #include <signal.h>
 #include <stdio.h>
@@ -13,42 +15,72 @@
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
 #include "action.h"
+#include "action-prompt-codes.h"
 #include "common/buf.h"
 #include "common/dir.h"
 #include "common/font.h"
 #include "common/lab-scene-rect.h"
 #include "common/list.h"
+#include "common/log.h"
 #include "common/mem.h"
 #include "common/spawn.h"
 #include "common/string-helpers.h"
+#include "common/time-helpers.h"
 #include "common/xml.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "scaled-buffer/scaled-font-buffer.h"
 #include "scaled-buffer/scaled-icon-buffer.h"
 #include "theme.h"
+#include "timer.h"
+#include "trace.h"
 #include "translate.h"
 #include "view.h"
 #include "workspaces.h"
 
 #define PIPEMENU_MAX_BUF_SIZE 1048576  /* 1 MiB */
 #define PIPEMENU_TIMEOUT_IN_MS 4000    /* 4 seconds */
+#define PIPEMENU_MAX_PREFETCH 2
+#define MENU_SCROLL_MARGIN 4 /* items */
 
 #define ICON_SIZE (rc.theme->menu_item_height - 2 * rc.theme->menu_items_padding_y)
+#define PROMPT_MENU_ID "labwc-prompt"
 
 static bool waiting_for_pipe_menu;
+/* Frees the scenes of menus after <menu><idleTimeout> */
+static struct wl_event_source *idle_timer;
+static bool idle_timer_armed;
 static struct menuitem *selected_item;
+static int nr_prefetching;
+
+/* See menu_open_prompt() */
+static struct {
+	menu_prompt_done_fn done;
+	void *data;
+	struct menuitem *yes;
+} prompt;
+
+enum pipemenu_job {
+	PIPEMENU_OPEN = 0,
+	PIPEMENU_REFRESH,  /* update a stale cache */
+	PIPEMENU_PREFETCH, /* run before the submenu is selected */
+};
 
 struct menu_pipe_context {
 	struct wlr_box anchor_rect;
 	struct menu *pipemenu;
-	struct buf buf;
+	/* Output is parsed as it arrives */
+	xmlParserCtxt *parser;
+	size_t nr_bytes;
 	struct wl_event_source *event_read;
-	struct wl_event_source *event_timeout;
+	struct lab_timer *event_timeout;
 	pid_t pid;
 	int pipe_fd;
+	/* Background jobs only store the output in menu.cache */
+	enum pipemenu_job job;
 };
 
 /* TODO: split this whole file into parser.c and actions.c*/
@@ -136,7 +168,6 @@ item_create(struct menu *menu, const char *text, const char *icon_name, bool sho
 	assert(menu);
 	assert(text);
 
-	struct theme *theme = menu->server->theme;
 	struct menuitem *menuitem = znew(*menuitem);
 	menuitem->parent = menu;
 	menuitem->selectable = true;
@@ -151,11 +182,8 @@ item_create(struct menu *menu, const char *text, const char *icon_name, bool sho
 	}
 #endif
 
-	menuitem->native_width = font_width(&rc.font_menuitem, text);
-	if (menuitem->arrow) {
-		menuitem->native_width += font_width(&rc.font_menuitem, menuitem->arrow)
-					+ theme->menu_items_padding_x;
-	}
+	/* Measured when the menu is first opened */
+	menuitem->native_width = -1;
 
 	wl_list_append(&menu->menuitems, &menuitem->link);
 	wl_list_init(&menuitem->actions);
@@ -213,6 +241,7 @@ item_create_scene_for_state(struct menuitem *item, float *text_color,
 	/* Create label */
 	struct scaled_font_buffer *label_buffer = scaled_font_buffer_create(tree);
 	assert(label_buffer);
+	label_buffer->scaled_buffer->category = BUFFER_MENU;
 	scaled_font_buffer_update(label_buffer, item->text, label_max_width,
 		&rc.font_menuitem, text_color, bg_color);
 	/* Vertically center and left-align label */
@@ -227,6 +256,7 @@ item_create_scene_for_state(struct menuitem *item, float *text_color,
 	/* Create arrow for submenu items */
 	struct scaled_font_buffer *arrow_buffer = scaled_font_buffer_create(tree);
 	assert(arrow_buffer);
+	arrow_buffer->scaled_buffer->category = BUFFER_MENU;
 	scaled_font_buffer_update(arrow_buffer, item->arrow, -1,
 		&rc.font_menuitem, text_color, bg_color);
 	/* Vertically center and right-align arrow */
@@ -238,7 +268,7 @@ item_create_scene_for_state(struct menuitem *item, float *text_color,
 }
 
 static void
-item_create_scene(struct menuitem *menuitem, int *item_y)
+item_create_scene(struct menuitem *menuitem)
 {
 	assert(menuitem);
 	assert(menuitem->type == LAB_MENU_ITEM);
@@ -246,7 +276,7 @@ item_create_scene(struct menuitem *menuitem, int *item_y)
 	struct theme *theme = menu->server->theme;
 
 	/* Menu item root node */
-	menuitem->tree = wlr_scene_tree_create(menu->scene_tree);
+	menuitem->tree = wlr_scene_tree_create(menu->items_tree);
 	node_descriptor_create(&menuitem->tree->node, LAB_NODE_MENUITEM,
 		/*view*/ NULL, menuitem);
 
@@ -257,13 +287,14 @@ item_create_scene(struct menuitem *menuitem, int *item_y)
 	menuitem->selected_tree = item_create_scene_for_state(menuitem,
 		theme->menu_items_active_text_color,
 		theme->menu_items_active_bg_color);
-	/* Hide selected state */
-	wlr_scene_node_set_enabled(&menuitem->selected_tree->node, false);
+	/* Hide selected state, unless it was scrolled out while selected */
+	bool selected = menu->selection.item == menuitem;
+	wlr_scene_node_set_enabled(&menuitem->normal_tree->node, !selected);
+	wlr_scene_node_set_enabled(&menuitem->selected_tree->node, selected);
 
 	/* Position the item in relation to its menu */
 	wlr_scene_node_set_position(&menuitem->tree->node,
-		theme->menu_border_width, *item_y);
-	*item_y += theme->menu_item_height;
+		theme->menu_border_width, menuitem->y);
 }
 
 static struct menuitem *
@@ -278,7 +309,7 @@ separator_create(struct menu *menu, const char *label)
 		: LAB_MENU_TITLE;
 	if (menuitem->type == LAB_MENU_TITLE) {
 		menuitem->text = xstrdup(label);
-		menuitem->native_width = font_width(&rc.font_menuheader, label);
+		menuitem->native_width = -1;
 	}
 
 	wl_list_append(&menu->menuitems, &menuitem->link);
@@ -287,7 +318,7 @@ separator_create(struct menu *menu, const char *label)
 }
 
 static void
-separator_create_scene(struct menuitem *menuitem, int *item_y)
+separator_create_scene(struct menuitem *menuitem)
 {
 	assert(menuitem);
 	assert(menuitem->type == LAB_MENU_SEPARATOR_LINE);
@@ -295,15 +326,14 @@ separator_create_scene(struct menuitem *menuitem, int *item_y)
 	struct theme *theme = menu->server->theme;
 
 	/* Menu item root node */
-	menuitem->tree = wlr_scene_tree_create(menu->scene_tree);
+	menuitem->tree = wlr_scene_tree_create(menu->items_tree);
 	node_descriptor_create(&menuitem->tree->node, LAB_NODE_MENUITEM,
 		/*view*/ NULL, menuitem);
 
 	/* Tree to hold background and line buffer */
 	menuitem->normal_tree = wlr_scene_tree_create(menuitem->tree);
 
-	int bg_height = theme->menu_separator_line_thickness
-		+ 2 * theme->menu_separator_padding_height;
+	int bg_height = menuitem->height;
 	int bg_width = menu->size.width - 2 * theme->menu_border_width;
 	int line_width = bg_width - 2 * theme->menu_separator_padding_width;
 
@@ -328,12 +358,11 @@ separator_create_scene(struct menuitem *menuitem, int *item_y)
 		theme->menu_separator_padding_height);
 error:
 	wlr_scene_node_set_position(&menuitem->tree->node,
-		theme->menu_border_width, *item_y);
-	*item_y += bg_height;
+		theme->menu_border_width, menuitem->y);
 }
 
 static void
-title_create_scene(struct menuitem *menuitem, int *item_y)
+title_create_scene(struct menuitem *menuitem)
 {
 	assert(menuitem);
 	assert(menuitem->type == LAB_MENU_TITLE);
@@ -343,7 +372,7 @@ title_create_scene(struct menuitem *menuitem, int *item_y)
 	float *text_color = theme->menu_title_text_color;
 
 	/* Menu item root node */
-	menuitem->tree = wlr_scene_tree_create(menu->scene_tree);
+	menuitem->tree = wlr_scene_tree_create(menu->items_tree);
 	node_descriptor_create(&menuitem->tree->node, LAB_NODE_MENUITEM,
 		/*view*/ NULL, menuitem);
 
@@ -366,6 +395,7 @@ title_create_scene(struct menuitem *menuitem, int *item_y)
 	struct scaled_font_buffer *title_font_buffer =
 		scaled_font_buffer_create(menuitem->normal_tree);
 	assert(title_font_buffer);
+	title_font_buffer->scaled_buffer->category = BUFFER_MENU;
 	scaled_font_buffer_update(title_font_buffer, menuitem->text,
 		text_width, &rc.font_menuheader, text_color, bg_color);
 
@@ -388,41 +418,233 @@ title_create_scene(struct menuitem *menuitem, int *item_y)
 		title_x, title_y);
 error:
 	wlr_scene_node_set_position(&menuitem->tree->node,
-		theme->menu_border_width, *item_y);
-	*item_y += theme->menu_header_height;
+		theme->menu_border_width, menuitem->y);
+}
+
+/* Get the width of the text of @item, measuring it on first use */
+static int
+item_get_native_width(struct menuitem *item)
+{
+	if (item->native_width >= 0) {
+		return item->native_width;
+	}
+	struct theme *theme = item->parent->server->theme;
+	switch (item->type) {
+	case LAB_MENU_ITEM:
+		item->native_width = font_width(&rc.font_menuitem, item->text);
+		if (item->arrow) {
+			item->native_width += font_width(&rc.font_menuitem, item->arrow)
+				+ theme->menu_items_padding_x;
+		}
+		break;
+	case LAB_MENU_SEPARATOR_LINE:
+		item->native_width = 0;
+		break;
+	case LAB_MENU_TITLE:
+		item->native_width = font_width(&rc.font_menuheader, item->text);
+		break;
+	}
+	return item->native_width;
+}
+
+static int
+item_get_height(struct theme *theme, struct menuitem *item)
+{
+	switch (item->type) {
+	case LAB_MENU_ITEM:
+		return theme->menu_item_height;
+	case LAB_MENU_SEPARATOR_LINE:
+		return theme->menu_separator_line_thickness
+			+ 2 * theme->menu_separator_padding_height;
+	case LAB_MENU_TITLE:
+		return theme->menu_header_height;
+	}
+	return 0;
+}
+
+static void
+item_create_scene_for_type(struct menuitem *item)
+{
+	assert(!item->tree);
+	switch (item->type) {
+	case LAB_MENU_ITEM:
+		item_create_scene(item);
+		break;
+	case LAB_MENU_SEPARATOR_LINE:
+		separator_create_scene(item);
+		break;
+	case LAB_MENU_TITLE:
+		title_create_scene(item);
+		break;
+	}
+}
+
+static void
+item_destroy_scene(struct menuitem *item)
+{
+	if (item->tree) {
+		wlr_scene_node_destroy(&item->tree->node);
+		item->tree = NULL;
+		item->normal_tree = NULL;
+		item->selected_tree = NULL;
+	}
+}
+
+/*
+ * Create the scene nodes of items within the visible part of the menu or
+ * MENU_SCROLL_MARGIN items around it, and destroy those of all others.
+ * Only fully visible items are shown.
+ */
+static void
+menu_update_item_scenes(struct menu *menu)
+{
+	struct theme *theme = menu->server->theme;
+	int top = menu->scroll.offset + theme->menu_border_width;
+	int bottom = menu->scroll.offset + menu->size.height
+		- theme->menu_border_width;
+	int margin = MENU_SCROLL_MARGIN * theme->menu_item_height;
+
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		bool near = item->y + item->height > top - margin
+			&& item->y < bottom + margin;
+		if (near && !item->tree) {
+			item_create_scene_for_type(item);
+		} else if (!near && item != menu->selection.item) {
+			item_destroy_scene(item);
+			continue;
+		}
+		if (item->tree) {
+			bool visible = item->y >= top
+				&& item->y + item->height <= bottom;
+			wlr_scene_node_set_enabled(&item->tree->node, visible);
+		}
+	}
+}
+
+/*
+ * Get the smallest scroll offset of at least @min which starts the visible
+ * part at the top of an item, so that no item is cut off at the top.
+ */
+static int
+aligned_scroll_offset(struct menu *menu, int min)
+{
+	int border = menu->server->theme->menu_border_width;
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		if (item->y - border >= min) {
+			return item->y - border;
+		}
+	}
+	return min;
+}
+
+static void
+menu_scroll_to(struct menu *menu, int offset)
+{
+	int max = aligned_scroll_offset(menu,
+		menu->scroll.content_height - menu->size.height);
+	menu->scroll.offset = MAX(MIN(offset, max), 0);
+	wlr_scene_node_set_position(&menu->items_tree->node,
+		0, -menu->scroll.offset);
+	menu_update_item_scenes(menu);
+}
+
+/* Scroll by @steps items, negative to scroll up */
+static void
+menu_scroll(struct menu *menu, int steps)
+{
+	int border = menu->server->theme->menu_border_width;
+	struct wl_list *current = &menu->menuitems;
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		if (item->y - border >= menu->scroll.offset) {
+			current = &item->link;
+			break;
+		}
+	}
+	for (; steps > 0 && current->next != &menu->menuitems; steps--) {
+		current = current->next;
+	}
+	for (; steps < 0 && current->prev != &menu->menuitems; steps++) {
+		current = current->prev;
+	}
+	if (current == &menu->menuitems) {
+		return;
+	}
+	item = wl_container_of(current, item, link);
+	menu_scroll_to(menu, item->y - border);
+}
+
+/* Scroll just enough to fully show @item */
+static void
+menu_scroll_to_item(struct menu *menu, struct menuitem *item)
+{
+	int border = menu->server->theme->menu_border_width;
+	int top = item->y - border;
+	int bottom = item->y + item->height + border - menu->size.height;
+	if (top < menu->scroll.offset) {
+		menu_scroll_to(menu, top);
+	} else if (bottom > menu->scroll.offset) {
+		menu_scroll_to(menu, aligned_scroll_offset(menu, bottom));
+	}
+}
+
+/*
+ * Limit the height of @menu to @max_height, making it scrollable if its
+ * items do not fit
+ */
+static void
+menu_set_max_height(struct menu *menu, int max_height)
+{
+	int height = MIN(menu->scroll.content_height, max_height);
+	if (height != menu->size.height) {
+		menu->size.height = height;
+		lab_scene_rect_set_size(menu->bg_rect, menu->size.width, height);
+	}
+	menu_scroll_to(menu, 0);
 }
 
 static void item_destroy(struct menuitem *item);
 
+/* Destroy all scene nodes of @menu, keeping its items */
 static void
-reset_menu(struct menu *menu)
+menu_destroy_scene(struct menu *menu)
 {
-	struct menuitem *item, *next;
-	wl_list_for_each_safe(item, next, &menu->menuitems, link) {
-		item_destroy(item);
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		item_destroy_scene(item);
 	}
 	if (menu->scene_tree) {
 		wlr_scene_node_destroy(&menu->scene_tree->node);
 		menu->scene_tree = NULL;
+		menu->items_tree = NULL;
+		menu->bg_rect = NULL;
+	}
+}
+
+static void
+reset_menu(struct menu *menu)
+{
+	struct menuitem *item, *next;
+	wl_list_for_each_safe(item, next, &menu->menuitems, link) {
+		item_destroy(item);
 	}
+	menu_destroy_scene(menu);
 	/* TODO: also reset other fields? */
 }
 
+/* Compute the width of @menu and the positions of its items */
 static void
-menu_create_scene(struct menu *menu)
+menu_layout(struct menu *menu)
 {
 	struct menuitem *item;
 	struct theme *theme = menu->server->theme;
 
-	assert(!menu->scene_tree);
-
-	menu->scene_tree = wlr_scene_tree_create(menu->server->menu_tree);
-	wlr_scene_node_set_enabled(&menu->scene_tree->node, false);
-
 	/* Menu width is the maximum item width, capped by menu.width.{min,max} */
 	menu->size.width = 0;
 	wl_list_for_each(item, &menu->menuitems, link) {
-		int width = item->native_width
+		int width = item_get_native_width(item)
 			+ 2 * theme->menu_items_padding_x
 			+ 2 * theme->menu_border_width;
 		menu->size.width = MAX(menu->size.width, width);
@@ -434,23 +656,57 @@ menu_create_scene(struct menu *menu)
 	menu->size.width = MAX(menu->size.width, theme->menu_min_width);
 	menu->size.width = MIN(menu->size.width, theme->menu_max_width);
 
-	/* Update all items for the new size */
+	/*
+	 * Lay out all items, but leave creating their scene nodes to
+	 * menu_update_item_scenes() once the visible part is known
+	 */
 	int item_y = theme->menu_border_width;
 	wl_list_for_each(item, &menu->menuitems, link) {
-		assert(!item->tree);
-		switch (item->type) {
-		case LAB_MENU_ITEM:
-			item_create_scene(item, &item_y);
-			break;
-		case LAB_MENU_SEPARATOR_LINE:
-			separator_create_scene(item, &item_y);
-			break;
-		case LAB_MENU_TITLE:
-			title_create_scene(item, &item_y);
-			break;
+		item->y = item_y;
+		item->height = item_get_height(theme, item);
+		item_y += item->height;
+	}
+	menu->scroll.content_height = item_y + theme->menu_border_width;
+	menu->scroll.offset = 0;
+	menu->size.height = menu->scroll.content_height;
+}
+
+/*
+ * Lay out @menu again after items were added, removed or changed. Scene
+ * nodes of unchanged items are kept unless the menu width changed.
+ */
+static void
+menu_relayout(struct menu *menu)
+{
+	int old_width = menu->size.width;
+	menu_layout(menu);
+
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		if (menu->size.width != old_width) {
+			item_destroy_scene(item);
+		}
+		if (item->tree) {
+			wlr_scene_node_set_position(&item->tree->node,
+				item->tree->node.x, item->y);
 		}
 	}
-	menu->size.height = item_y + theme->menu_border_width;
+	lab_scene_rect_set_size(menu->bg_rect, menu->size.width,
+		menu->size.height);
+}
+
+static void
+menu_create_scene(struct menu *menu)
+{
+	struct theme *theme = menu->server->theme;
+
+	assert(!menu->scene_tree);
+	trace_begin("menu_create_scene");
+
+	menu->scene_tree = wlr_scene_tree_create(menu->server->menu_tree);
+	wlr_scene_node_set_enabled(&menu->scene_tree->node, false);
+	menu->items_tree = wlr_scene_tree_create(menu->scene_tree);
+	menu_layout(menu);
 
 	struct lab_scene_rect_options opts = {
 		.border_colors = (float *[1]) {theme->menu_border_color},
@@ -459,9 +715,9 @@ menu_create_scene(struct menu *menu)
 		.width = menu->size.width,
 		.height = menu->size.height,
 	};
-	struct lab_scene_rect *bg_rect =
-		lab_scene_rect_create(menu->scene_tree, &opts);
-	wlr_scene_node_lower_to_bottom(&bg_rect->tree->node);
+	menu->bg_rect = lab_scene_rect_create(menu->scene_tree, &opts);
+	wlr_scene_node_lower_to_bottom(&menu->bg_rect->tree->node);
+	trace_end("menu_create_scene");
 }
 
 /*
@@ -506,6 +762,37 @@ item_destroy(struct menuitem *item)
 
 static bool parse_buf(struct server *server, struct menu *menu, struct buf *buf);
 static int handle_pipemenu_readable(int fd, uint32_t mask, void *_ctx);
+
+/*
+ * Parse a duration like "30s", "2m" or "500ms" into milliseconds. A plain
+ * number is taken as seconds. Returns false if @s is not a duration.
+ */
+static bool
+parse_cache_ttl(const char *s, uint32_t *ttl_ms)
+{
+	char *end;
+	errno = 0;
+	unsigned long value = strtoul(s, &end, 10);
+	if (errno || end == s) {
+		return false;
+	}
+	unsigned long scale;
+	if (!*end || !strcasecmp(end, "s")) {
+		scale = 1000;
+	} else if (!strcasecmp(end, "ms")) {
+		scale = 1;
+	} else if (!strcasecmp(end, "m")) {
+		scale = 60 * 1000;
+	} else {
+		return false;
+	}
+	if (value > UINT32_MAX / scale) {
+		return false;
+	}
+	*ttl_ms = value * scale;
+	return true;
+}
+
 static int handle_pipemenu_timeout(void *_ctx);
 static void fill_menu_children(struct server *server, struct menu *parent, xmlNode *n);
 
@@ -521,6 +808,7 @@ fill_menu(struct server *server, struct menu *parent, xmlNode *n)
 	char *label = (char *)xmlGetProp(n, (const xmlChar *)"label");
 	char *icon_name = (char *)xmlGetProp(n, (const xmlChar *)"icon");
 	char *execute = (char *)xmlGetProp(n, (const xmlChar *)"execute");
+	char *cache = (char *)xmlGetProp(n, (const xmlChar *)"cache");
 	char *id = (char *)xmlGetProp(n, (const xmlChar *)"id");
 
 	if (!id) {
@@ -533,6 +821,10 @@ fill_menu(struct server *server, struct menu *parent, xmlNode *n)
 
 		struct menu *pipemenu = menu_create(server, parent, id, label);
 		pipemenu->execute = xstrdup(execute);
+		if (cache && !parse_cache_ttl(cache, &pipemenu->cache.ttl_ms)) {
+			wlr_log(WLR_ERROR, "invalid cache '%s' for pipemenu '%s'",
+				cache, id);
+		}
 		if (!parent) {
 			/*
 			 * A pipemenu may not have its parent like:
@@ -622,6 +914,7 @@ error:
 	xmlFree(label);
 	xmlFree(icon_name);
 	xmlFree(execute);
+	xmlFree(cache);
 	xmlFree(id);
 }
 
@@ -661,13 +954,22 @@ fill_menu_children(struct server *server, struct menu *parent, xmlNode *n)
 	}
 }
 
-static bool
-parse_buf(struct server *server, struct menu *parent, struct buf *buf)
+static xmlDoc *
+read_buf(struct buf *buf)
 {
 	int options = 0;
 	xmlDoc *d = xmlReadMemory(buf->data, buf->len, NULL, NULL, options);
 	if (!d) {
 		wlr_log(WLR_ERROR, "xmlParseMemory()");
+	}
+	return d;
+}
+
+static bool
+parse_buf(struct server *server, struct menu *parent, struct buf *buf)
+{
+	xmlDoc *d = read_buf(buf);
+	if (!d) {
 		return false;
 	}
 
@@ -675,34 +977,44 @@ parse_buf(struct server *server, struct menu *parent, struct buf *buf)
 	fill_menu_children(server, parent, root);
 
 	xmlFreeDoc(d);
-	xmlCleanupParser();
 	return true;
 }
 
-static void
-parse_xml(const char *filename, struct server *server)
+void
+menu_load(struct wl_list *paths, struct wl_array *docs)
 {
-	struct wl_list paths;
-	paths_config_create(&paths, filename);
-
 	bool should_merge_config = rc.merge_config;
 	struct wl_list *(*iter)(struct wl_list *list);
 	iter = should_merge_config ? paths_get_prev : paths_get_next;
 
-	for (struct wl_list *elm = iter(&paths); elm != &paths; elm = iter(elm)) {
+	for (struct wl_list *elm = iter(paths); elm != paths; elm = iter(elm)) {
 		struct path *path = wl_container_of(elm, path, link);
 		struct buf buf = buf_from_file(path->string);
 		if (!buf.len) {
 			continue;
 		}
 		wlr_log(WLR_INFO, "read menu file %s", path->string);
-		parse_buf(server, /*parent*/ NULL, &buf);
+		xmlDoc *d = read_buf(&buf);
+		if (d) {
+			xmlDoc **slot = wl_array_add(docs, sizeof(*slot));
+			*slot = d;
+		}
 		buf_reset(&buf);
 		if (!should_merge_config) {
 			break;
 		}
 	}
-	paths_destroy(&paths);
+}
+
+static void
+parse_docs(struct server *server, struct wl_array *docs)
+{
+	xmlDoc **d;
+	wl_array_for_each(d, docs) {
+		fill_menu_children(server, /*parent*/ NULL,
+			xmlDocGetRootElement(*d));
+	}
+	lab_xml_docs_release(docs);
 }
 
 /*
@@ -719,7 +1031,7 @@ get_item_anchor_rect(struct theme *theme, struct menuitem *item)
 	int overlap_y = theme->menu_overlap_y - theme->menu_border_width;
 	return (struct wlr_box) {
 		.x = menu_x + overlap_x,
-		.y = menu_y + item->tree->node.y + overlap_y,
+		.y = menu_y + item->y - menu->scroll.offset + overlap_y,
 		.width = menu->size.width - 2 * overlap_x,
 		.height = theme->menu_item_height - 2 * overlap_y,
 	};
@@ -734,10 +1046,14 @@ menu_reposition(struct menu *menu, struct wlr_box anchor_rect)
 	if (!output) {
 		wlr_log(WLR_ERROR, "no output found around (%d,%d)",
 			anchor_rect.x, anchor_rect.y);
+		menu_set_max_height(menu, INT_MAX);
 		return;
 	}
 	struct wlr_box usable = output_usable_area_in_layout_coords(output);
 
+	/* Scroll menus which do not fit into the output */
+	menu_set_max_height(menu, usable.height);
+
 	/* Policy for menu placement */
 	struct wlr_xdg_positioner_rules rules = {0};
 	rules.size.width = menu->size.width;
@@ -800,6 +1116,77 @@ item_add_action(struct menuitem *item, const char *action_name)
 	return action;
 }
 
+/*
+ * Get an item showing @text at the position after @pos for one of the
+ * internal menus below, which are updated in place rather than rebuilt.
+ * Items up to @pos are up to date. An item after @pos which shows @view
+ * or the same kind of entry is reused and moved to the front, all others
+ * are destroyed by sync_finish(). The actions
+ * of the item are cleared for the caller to add. Separators without
+ * @text are drawn as a line.
+ */
+static struct menuitem *
+sync_item(struct menu *menu, struct wl_list **pos, enum menuitem_type type,
+		const char *text, struct view *view)
+{
+	if (type != LAB_MENU_ITEM) {
+		type = string_null_or_empty(text) ? LAB_MENU_SEPARATOR_LINE
+			: LAB_MENU_TITLE;
+		if (type == LAB_MENU_SEPARATOR_LINE) {
+			text = NULL;
+		}
+	}
+
+	/*
+	 * Usually the next item matches. Otherwise a view may have been
+	 * raised or moved to another workspace, or items were removed.
+	 */
+	struct menuitem *item = NULL;
+	struct wl_list *next;
+	for (next = (*pos)->next; next != &menu->menuitems; next = next->next) {
+		struct menuitem *iter = wl_container_of(next, iter, link);
+		if (iter->type == type && iter->client_list_view == view) {
+			item = iter;
+			break;
+		}
+	}
+
+	if (!item) {
+		if (type == LAB_MENU_ITEM) {
+			item = item_create(menu, text, NULL, /*show arrow*/ false);
+		} else {
+			item = separator_create(menu, text);
+		}
+	} else if (!str_equal(item->text, text)) {
+		xstrdup_replace(item->text, text);
+		item->native_width = -1;
+		item_destroy_scene(item);
+	}
+	action_list_free(&item->actions);
+	item->client_list_view = view;
+
+	if (&item->link != (*pos)->next) {
+		wl_list_remove(&item->link);
+		wl_list_insert(*pos, &item->link);
+	}
+	*pos = &item->link;
+	return item;
+}
+
+/* Destroy the items after @pos which were not reused by sync_item() */
+static void
+sync_finish(struct menu *menu, struct wl_list *pos)
+{
+	while (pos->next != &menu->menuitems) {
+		struct menuitem *item = wl_container_of(pos->next, item, link);
+		item_destroy(item);
+	}
+	if (menu->scene_tree) {
+		menu_relayout(menu);
+	}
+	menu->needs_update = false;
+}
+
 /*
  * This is client-send-to-menu
  * an internal menu similar to root-menu and client-menu
@@ -813,9 +1200,11 @@ update_client_send_to_menu(struct server *server)
 {
 	struct menu *menu = menu_get_by_id(server, "client-send-to-menu");
 	assert(menu);
+	if (!menu->needs_update) {
+		return;
+	}
 
-	reset_menu(menu);
-
+	struct wl_list *pos = &menu->menuitems;
 	struct workspace *workspace;
 
 	/*
@@ -829,8 +1218,8 @@ update_client_send_to_menu(struct server *server)
 		} else {
 			buf_add(&buf, workspace->name);
 		}
-		struct menuitem *item = item_create(menu, buf.data,
-			NULL, /*show arrow*/ false);
+		struct menuitem *item = sync_item(menu, &pos, LAB_MENU_ITEM,
+			buf.data, NULL);
 
 		struct action *action = item_add_action(item, "SendToDesktop");
 		action_arg_add_str(action, "to", workspace->name);
@@ -839,12 +1228,12 @@ update_client_send_to_menu(struct server *server)
 	}
 	buf_reset(&buf);
 
-	separator_create(menu, "");
-	struct menuitem *item = item_create(menu,
-		_("Always on Visible Workspace"), NULL, false);
+	sync_item(menu, &pos, LAB_MENU_SEPARATOR_LINE, NULL, NULL);
+	struct menuitem *item = sync_item(menu, &pos, LAB_MENU_ITEM,
+		_("Always on Visible Workspace"), NULL);
 	item_add_action(item, "ToggleOmnipresent");
 
-	menu_create_scene(menu);
+	sync_finish(menu, pos);
 }
 
 /*
@@ -860,18 +1249,22 @@ update_client_list_combined_menu(struct server *server)
 {
 	struct menu *menu = menu_get_by_id(server, "client-list-combined-menu");
 	assert(menu);
+	if (!menu->needs_update) {
+		return;
+	}
 
-	reset_menu(menu);
-
+	struct wl_list *pos = &menu->menuitems;
 	struct menuitem *item;
 	struct workspace *workspace;
 	struct view *view;
 	struct buf buffer = BUF_INIT;
+	bool had_icons = menu->has_icons;
+	menu->has_icons = false;
 
 	wl_list_for_each(workspace, &server->workspaces.all, link) {
 		buf_add_fmt(&buffer, workspace == server->workspaces.current ? ">%s<" : "%s",
 				workspace->name);
-		separator_create(menu, buffer.data);
+		sync_item(menu, &pos, LAB_MENU_TITLE, buffer.data, NULL);
 		buf_clear(&buffer);
 
 		wl_list_for_each(view, &server->views, link) {
@@ -889,22 +1282,49 @@ update_client_list_combined_menu(struct server *server)
 				} else {
 					buf_add(&buffer, view->title);
 				}
-				item = item_create(menu, buffer.data, NULL,
-					/*show arrow*/ false);
-				item->client_list_view = view;
+				item = sync_item(menu, &pos, LAB_MENU_ITEM,
+					buffer.data, view);
 				item_add_action(item, "Focus");
 				item_add_action(item, "Raise");
 				buf_clear(&buffer);
 				menu->has_icons = true;
 			}
 		}
-		item = item_create(menu, _("Go there..."), NULL,
-			/*show arrow*/ false);
+		item = sync_item(menu, &pos, LAB_MENU_ITEM, _("Go there..."), NULL);
 		struct action *action = item_add_action(item, "GoToDesktop");
 		action_arg_add_str(action, "to", workspace->name);
 	}
 	buf_reset(&buffer);
-	menu_create_scene(menu);
+
+	if (menu->has_icons != had_icons) {
+		/* Labels are offset by the icon */
+		wl_list_for_each(item, &menu->menuitems, link) {
+			item_destroy_scene(item);
+		}
+	}
+	sync_finish(menu, pos);
+}
+
+static void
+mark_for_update(struct server *server, const char *id)
+{
+	struct menu *menu = menu_get_by_id(server, id);
+	if (menu) {
+		menu->needs_update = true;
+	}
+}
+
+void
+menu_on_window_list_changed(struct server *server)
+{
+	mark_for_update(server, "client-list-combined-menu");
+}
+
+void
+menu_on_workspaces_changed(struct server *server)
+{
+	mark_for_update(server, "client-list-combined-menu");
+	mark_for_update(server, "client-send-to-menu");
 }
 
 static void
@@ -965,21 +1385,50 @@ init_windowmenu(struct server *server)
 	}
 }
 
-void
-menu_init(struct server *server)
+uint64_t
+menu_files_hash(void)
 {
-	wl_list_init(&server->menus);
+	struct wl_list paths;
+	paths_config_create(&paths, "menu.xml");
+	uint64_t hash = paths_hash(&paths, /*with_dirs*/ false);
+	paths_destroy(&paths);
+	return hash;
+}
 
-	/* Just create placeholder. Contents will be created when launched */
-	menu_create(server, NULL, "client-list-combined-menu", _("Windows"));
-	menu_create(server, NULL, "client-send-to-menu", _("Workspace"));
+static void
+init_from_docs(struct server *server, struct wl_array *docs)
+{
+	wl_list_init(&server->menus);
 
-	parse_xml("menu.xml", server);
+	/*
+	 * Just create placeholder. Contents will be created when launched
+	 * and then kept up to date.
+	 */
+	struct menu *menu = menu_create(server, NULL,
+		"client-list-combined-menu", _("Windows"));
+	menu->needs_update = true;
+	menu = menu_create(server, NULL, "client-send-to-menu", _("Workspace"));
+	menu->needs_update = true;
+
+	parse_docs(server, docs);
+	server->menu_files_hash = menu_files_hash();
 	init_rootmenu(server);
 	init_windowmenu(server);
 	validate(server);
 }
 
+void
+menu_init(struct server *server)
+{
+	struct wl_list paths;
+	paths_config_create(&paths, "menu.xml");
+	struct wl_array docs;
+	wl_array_init(&docs);
+	menu_load(&paths, &docs);
+	paths_destroy(&paths);
+	init_from_docs(server, &docs);
+}
+
 static void
 nullify_item_pointing_to_this_menu(struct menu *menu)
 {
@@ -1009,6 +1458,15 @@ nullify_item_pointing_to_this_menu(struct menu *menu)
 
 static void pipemenu_ctx_destroy(struct menu_pipe_context *ctx);
 
+static void
+pipemenu_cache_clear(struct menu *menu)
+{
+	if (menu->cache.doc) {
+		xmlFreeDoc(menu->cache.doc);
+		menu->cache.doc = NULL;
+	}
+}
+
 static void
 menu_free(struct menu *menu)
 {
@@ -1028,6 +1486,11 @@ menu_free(struct menu *menu)
 		pipemenu_ctx_destroy(menu->pipe_ctx);
 		assert(!menu->pipe_ctx);
 	}
+	if (menu->cache.background_ctx) {
+		pipemenu_ctx_destroy(menu->cache.background_ctx);
+		assert(!menu->cache.background_ctx);
+	}
+	pipemenu_cache_clear(menu);
 
 	/*
 	 * Destroying the root node will destroy everything,
@@ -1051,6 +1514,11 @@ menu_finish(struct server *server)
 	wl_list_for_each_safe(menu, tmp_menu, &server->menus, link) {
 		menu_free(menu);
 	}
+	if (idle_timer) {
+		wl_event_source_remove(idle_timer);
+		idle_timer = NULL;
+		idle_timer_armed = false;
+	}
 }
 
 void
@@ -1065,14 +1533,12 @@ menu_on_view_destroy(struct view *view)
 	}
 
 	/*
-	 * TODO: Instead of just setting client_list_view to NULL and deleting
-	 * the actions (as below), consider destroying the item and somehow
-	 * updating the menu and its selection state.
+	 * Also nullify the destroyed view in client-list-combined-menu, which
+	 * may be open at the moment. Its item is removed on the next update.
 	 */
-
-	/* Also nullify the destroyed view in client-list-combined-menu */
 	struct menu *menu = menu_get_by_id(server, "client-list-combined-menu");
 	if (menu) {
+		menu->needs_update = true;
 		struct menuitem *item;
 		wl_list_for_each(item, &menu->menuitems, link) {
 			if (item->client_list_view == view) {
@@ -1087,8 +1553,8 @@ menu_on_view_destroy(struct view *view)
 static void
 menu_set_selection(struct menu *menu, struct menuitem *item)
 {
-	/* Clear old selection */
-	if (menu->selection.item) {
+	/* Clear old selection, which may have been scrolled out */
+	if (menu->selection.item && menu->selection.item->tree) {
 		wlr_scene_node_set_enabled(
 			&menu->selection.item->normal_tree->node, true);
 		wlr_scene_node_set_enabled(
@@ -1096,6 +1562,8 @@ menu_set_selection(struct menu *menu, struct menuitem *item)
 	}
 	/* Set new selection */
 	if (item) {
+		menu_scroll_to_item(menu, item);
+		assert(item->tree);
 		wlr_scene_node_set_enabled(&item->normal_tree->node, false);
 		wlr_scene_node_set_enabled(&item->selected_tree->node, true);
 	}
@@ -1111,7 +1579,7 @@ menu_set_selection(struct menu *menu, struct menuitem *item)
 static void
 reset_pipemenus(struct server *server)
 {
-	wlr_log(WLR_DEBUG, "number of menus before close=%d",
+	lab_log(LAB_LOG_MENU, "number of menus before close=%d",
 		wl_list_length(&server->menus));
 
 	struct menu *iter, *tmp;
@@ -1125,19 +1593,91 @@ reset_pipemenus(struct server *server)
 			 * they are generated again when being opened
 			 */
 			reset_menu(iter);
+			if (!iter->cache.ttl_ms) {
+				pipemenu_cache_clear(iter);
+			}
 		}
 	}
 
-	wlr_log(WLR_DEBUG, "number of menus after  close=%d",
+	lab_log(LAB_LOG_MENU, "number of menus after  close=%d",
 		wl_list_length(&server->menus));
 }
 
+static void prefetch_pipemenus(struct menu *menu);
+static void cancel_prefetch(struct menu *menu);
+
+/*
+ * Free the scenes of menus which have not been opened for
+ * <menu><idleTimeout> seconds. They are created again on the next open.
+ */
+static int
+handle_idle_timeout(void *data)
+{
+	struct server *server = data;
+	uint64_t timeout_ns = (uint64_t)rc.menu_idle_timeout * 1000000000;
+	uint64_t now = time_now_nsec();
+	uint64_t next_ns = UINT64_MAX;
+
+	idle_timer_armed = false;
+	struct menu *menu;
+	wl_list_for_each(menu, &server->menus, link) {
+		/* Pipemenus are reset on close anyway */
+		if (!menu->scene_tree || menu->execute
+				|| menu->scene_tree->node.enabled) {
+			continue;
+		}
+		uint64_t idle_ns = now - menu->closed_ns;
+		if (idle_ns >= timeout_ns) {
+			lab_log(LAB_LOG_MENU, "freeing idle menu %s", menu->id);
+			menu_destroy_scene(menu);
+		} else {
+			next_ns = MIN(next_ns, timeout_ns - idle_ns);
+		}
+	}
+	if (next_ns != UINT64_MAX) {
+		wl_event_source_timer_update(idle_timer, next_ns / 1000000 + 1);
+		idle_timer_armed = true;
+	}
+	return 0;
+}
+
+void
+menu_free_closed_scenes(struct server *server)
+{
+	struct menu *menu;
+	wl_list_for_each(menu, &server->menus, link) {
+		if (menu->scene_tree && !menu->execute
+				&& !menu->scene_tree->node.enabled) {
+			menu_destroy_scene(menu);
+		}
+	}
+}
+
+static void
+schedule_idle_timeout(struct menu *menu)
+{
+	if (!rc.menu_idle_timeout || !menu->scene_tree) {
+		return;
+	}
+	menu->closed_ns = time_now_nsec();
+	if (!idle_timer) {
+		idle_timer = wl_event_loop_add_timer(menu->server->wl_event_loop,
+			handle_idle_timeout, menu->server);
+	}
+	if (idle_timer && !idle_timer_armed) {
+		wl_event_source_timer_update(idle_timer,
+			MIN(rc.menu_idle_timeout, (unsigned int)INT_MAX / 1000) * 1000);
+		idle_timer_armed = true;
+	}
+}
+
 static void
 _close(struct menu *menu)
 {
 	if (menu->scene_tree) {
 		wlr_scene_node_set_enabled(&menu->scene_tree->node, false);
 	}
+	schedule_idle_timeout(menu);
 	menu_set_selection(menu, NULL);
 	if (menu->selection.menu) {
 		_close(menu->selection.menu);
@@ -1147,6 +1687,7 @@ _close(struct menu *menu)
 		pipemenu_ctx_destroy(menu->pipe_ctx);
 		assert(!menu->pipe_ctx);
 	}
+	cancel_prefetch(menu);
 }
 
 static void
@@ -1174,6 +1715,7 @@ open_menu(struct menu *menu, struct wlr_box anchor_rect)
 	}
 	menu_reposition(menu, anchor_rect);
 	wlr_scene_node_set_enabled(&menu->scene_tree->node, true);
+	prefetch_pipemenus(menu);
 }
 
 static void open_pipemenu_async(struct menu *pipemenu, struct wlr_box anchor_rect);
@@ -1203,31 +1745,41 @@ menu_open_root(struct menu *menu, int x, int y)
 }
 
 static void
-create_pipe_menu(struct menu_pipe_context *ctx)
+create_pipe_menu(struct menu *pipemenu, struct wlr_box anchor_rect)
 {
-	struct server *server = ctx->pipemenu->server;
-	if (!parse_buf(server, ctx->pipemenu, &ctx->buf)) {
-		return;
-	}
+	struct server *server = pipemenu->server;
+	fill_menu_children(server, pipemenu,
+		xmlDocGetRootElement(pipemenu->cache.doc));
 	/* TODO: apply validate() only for generated pipemenus */
 	validate(server);
 
 	/* Finally open the new submenu tree */
-	open_menu(ctx->pipemenu, ctx->anchor_rect);
+	open_menu(pipemenu, anchor_rect);
 }
 
 static void
 pipemenu_ctx_destroy(struct menu_pipe_context *ctx)
 {
 	wl_event_source_remove(ctx->event_read);
-	wl_event_source_remove(ctx->event_timeout);
+	lab_timer_destroy(ctx->event_timeout);
 	spawn_piped_close(ctx->pid, ctx->pipe_fd);
-	buf_reset(&ctx->buf);
-	if (ctx->pipemenu) {
+	if (ctx->parser) {
+		xmlFreeDoc(ctx->parser->myDoc);
+		xmlFreeParserCtxt(ctx->parser);
+	}
+	switch (ctx->job) {
+	case PIPEMENU_OPEN:
 		ctx->pipemenu->pipe_ctx = NULL;
+		waiting_for_pipe_menu = false;
+		break;
+	case PIPEMENU_PREFETCH:
+		nr_prefetching--;
+		/* fallthrough */
+	case PIPEMENU_REFRESH:
+		ctx->pipemenu->cache.background_ctx = NULL;
+		break;
 	}
 	free(ctx);
-	waiting_for_pipe_menu = false;
 }
 
 static int
@@ -1260,8 +1812,9 @@ handle_pipemenu_readable(int fd, uint32_t mask, void *_ctx)
 		goto clean_up;
 	}
 
-	/* Limit pipemenu buffer to 1 MiB for safety */
-	if (ctx->buf.len + size > PIPEMENU_MAX_BUF_SIZE) {
+	/* Limit pipemenu output to 1 MiB for safety */
+	ctx->nr_bytes += size;
+	if (ctx->nr_bytes > PIPEMENU_MAX_BUF_SIZE) {
 		wlr_log(WLR_ERROR, "[pipemenu %ld] too big (> %d bytes); killing %s",
 			(long)ctx->pid, PIPEMENU_MAX_BUF_SIZE,
 			ctx->pipemenu->execute);
@@ -1269,20 +1822,58 @@ handle_pipemenu_readable(int fd, uint32_t mask, void *_ctx)
 		goto clean_up;
 	}
 
-	wlr_log(WLR_DEBUG, "[pipemenu %ld] read %ld bytes of data", (long)ctx->pid, size);
+	lab_log(LAB_LOG_MENU, "[pipemenu %ld] read %ld bytes of data", (long)ctx->pid, size);
 	if (size) {
 		data[size] = '\0';
-		buf_add(&ctx->buf, data);
+		if (!ctx->parser) {
+			if (str_space_only(data)) {
+				return 0;
+			}
+			/* Guard against badly formed data such as binary input */
+			if (!str_starts_with(data, '<', " \t\r\n")) {
+				wlr_log(WLR_ERROR, "expect xml data to start with '<'; "
+					"abort pipemenu");
+				goto clean_up;
+			}
+			ctx->parser = xmlCreatePushParserCtxt(NULL, NULL,
+				data, size, NULL);
+			if (!ctx->parser) {
+				wlr_log(WLR_ERROR, "xmlCreatePushParserCtxt()");
+				goto clean_up;
+			}
+		} else if (xmlParseChunk(ctx->parser, data, size, 0)) {
+			wlr_log(WLR_ERROR, "[pipemenu %ld] invalid xml from %s",
+				(long)ctx->pid, ctx->pipemenu->execute);
+			kill(ctx->pid, SIGTERM);
+			goto clean_up;
+		}
 		return 0;
 	}
 
-	/* Guard against badly formed data such as binary input */
-	if (!str_starts_with(ctx->buf.data, '<', " \t\r\n")) {
-		wlr_log(WLR_ERROR, "expect xml data to start with '<'; abort pipemenu");
+	if (!ctx->parser) {
+		wlr_log(WLR_ERROR, "[pipemenu %ld] no output from %s",
+			(long)ctx->pid, ctx->pipemenu->execute);
+		goto clean_up;
+	}
+	xmlParseChunk(ctx->parser, NULL, 0, /* terminate */ 1);
+	if (!ctx->parser->wellFormed || !ctx->parser->myDoc) {
+		wlr_log(WLR_ERROR, "[pipemenu %ld] invalid xml from %s",
+			(long)ctx->pid, ctx->pipemenu->execute);
+		goto clean_up;
+	}
+
+	struct menu *pipemenu = ctx->pipemenu;
+	pipemenu_cache_clear(pipemenu);
+	pipemenu->cache.doc = ctx->parser->myDoc;
+	ctx->parser->myDoc = NULL;
+	pipemenu->cache.stored_ns = time_now_nsec();
+	if (ctx->job != PIPEMENU_OPEN) {
+		lab_log(LAB_LOG_MENU, "[pipemenu %ld] stored output of %s",
+			(long)ctx->pid, pipemenu->execute);
 		goto clean_up;
 	}
 
-	create_pipe_menu(ctx);
+	create_pipe_menu(pipemenu, ctx->anchor_rect);
 
 clean_up:
 	pipemenu_ctx_destroy(ctx);
@@ -1290,13 +1881,11 @@ clean_up:
 }
 
 static void
-open_pipemenu_async(struct menu *pipemenu, struct wlr_box anchor_rect)
+spawn_pipemenu(struct menu *pipemenu, struct wlr_box anchor_rect,
+		enum pipemenu_job job)
 {
 	struct server *server = pipemenu->server;
 
-	assert(!pipemenu->pipe_ctx);
-	assert(!pipemenu->scene_tree);
-
 	int pipe_fd = 0;
 	pid_t pid = spawn_piped(pipemenu->execute, &pipe_fd);
 	if (pid <= 0) {
@@ -1305,26 +1894,116 @@ open_pipemenu_async(struct menu *pipemenu, struct wlr_box anchor_rect)
 		return;
 	}
 
-	waiting_for_pipe_menu = true;
 	struct menu_pipe_context *ctx = znew(*ctx);
 	ctx->pid = pid;
 	ctx->pipe_fd = pipe_fd;
-	ctx->buf = BUF_INIT;
 	ctx->anchor_rect = anchor_rect;
 	ctx->pipemenu = pipemenu;
-	pipemenu->pipe_ctx = ctx;
+	ctx->job = job;
+	switch (job) {
+	case PIPEMENU_OPEN:
+		waiting_for_pipe_menu = true;
+		pipemenu->pipe_ctx = ctx;
+		break;
+	case PIPEMENU_PREFETCH:
+		nr_prefetching++;
+		/* fallthrough */
+	case PIPEMENU_REFRESH:
+		pipemenu->cache.background_ctx = ctx;
+		break;
+	}
 
 	ctx->event_read = wl_event_loop_add_fd(server->wl_event_loop,
 		pipe_fd, WL_EVENT_READABLE, handle_pipemenu_readable, ctx);
 
-	ctx->event_timeout = wl_event_loop_add_timer(server->wl_event_loop,
-		handle_pipemenu_timeout, ctx);
-	wl_event_source_timer_update(ctx->event_timeout, PIPEMENU_TIMEOUT_IN_MS);
+	ctx->event_timeout = lab_timer_create(handle_pipemenu_timeout, ctx,
+		/*slack_ms*/ 250);
+	lab_timer_update(ctx->event_timeout, PIPEMENU_TIMEOUT_IN_MS);
 
-	wlr_log(WLR_DEBUG, "[pipemenu %ld] executed: %s",
+	lab_log(LAB_LOG_MENU, "[pipemenu %ld] executed: %s",
 		(long)ctx->pid, ctx->pipemenu->execute);
 }
 
+/*
+ * Stored output (prefetched, or cached with cache="") is parsed and shown
+ * right away. Once cached output is older than the cache time, the command
+ * is run again in the background and its output is used the next time the
+ * pipemenu is opened.
+ */
+static void
+open_pipemenu_async(struct menu *pipemenu, struct wlr_box anchor_rect)
+{
+	assert(!pipemenu->pipe_ctx);
+	assert(!pipemenu->scene_tree);
+
+	struct menu_pipe_context *ctx = pipemenu->cache.background_ctx;
+	if (!pipemenu->cache.doc && ctx) {
+		/* Adopt the running prefetch, including its timeout */
+		if (ctx->job == PIPEMENU_PREFETCH) {
+			nr_prefetching--;
+		}
+		ctx->job = PIPEMENU_OPEN;
+		ctx->anchor_rect = anchor_rect;
+		pipemenu->cache.background_ctx = NULL;
+		pipemenu->pipe_ctx = ctx;
+		waiting_for_pipe_menu = true;
+		return;
+	}
+	if (!pipemenu->cache.doc) {
+		spawn_pipemenu(pipemenu, anchor_rect, PIPEMENU_OPEN);
+		return;
+	}
+
+	/* Items created while parsing belong to the pipemenu */
+	waiting_for_pipe_menu = true;
+	create_pipe_menu(pipemenu, anchor_rect);
+	waiting_for_pipe_menu = false;
+
+	uint64_t age_ns = time_now_nsec() - pipemenu->cache.stored_ns;
+	if (pipemenu->cache.ttl_ms && !pipemenu->cache.background_ctx
+			&& age_ns >= (uint64_t)pipemenu->cache.ttl_ms * 1000000) {
+		spawn_pipemenu(pipemenu, anchor_rect, PIPEMENU_REFRESH);
+	}
+}
+
+/*
+ * Run the commands of the pipemenus in @menu before they are selected, so
+ * that their output is usually ready by the time the submenu opens.
+ */
+static void
+prefetch_pipemenus(struct menu *menu)
+{
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		if (nr_prefetching >= PIPEMENU_MAX_PREFETCH) {
+			return;
+		}
+		struct menu *pipemenu = item->submenu;
+		if (!pipemenu || !pipemenu->execute || pipemenu->pipe_ctx
+				|| pipemenu->cache.background_ctx
+				|| pipemenu->cache.doc) {
+			continue;
+		}
+		spawn_pipemenu(pipemenu, (struct wlr_box){0}, PIPEMENU_PREFETCH);
+	}
+}
+
+/* Stop prefetching the pipemenus of @menu once it is closed */
+static void
+cancel_prefetch(struct menu *menu)
+{
+	struct menuitem *item;
+	wl_list_for_each(item, &menu->menuitems, link) {
+		struct menu *pipemenu = item->submenu;
+		struct menu_pipe_context *ctx =
+			pipemenu ? pipemenu->cache.background_ctx : NULL;
+		if (ctx && ctx->job == PIPEMENU_PREFETCH) {
+			kill(ctx->pid, SIGTERM);
+			pipemenu_ctx_destroy(ctx);
+		}
+	}
+}
+
 static void
 menu_process_item_selection(struct menuitem *item)
 {
@@ -1417,6 +2096,18 @@ menu_item_select(struct server *server, bool forward)
 	menu_process_item_selection(item);
 }
 
+static void
+finish_prompt(int exit_code)
+{
+	menu_prompt_done_fn done = prompt.done;
+	void *data = prompt.data;
+	prompt.done = NULL;
+	prompt.data = NULL;
+	if (done) {
+		done(exit_code, data);
+	}
+}
+
 static bool
 menu_execute_item(struct menuitem *item)
 {
@@ -1432,6 +2123,12 @@ menu_execute_item(struct menuitem *item)
 	server->menu_current = NULL;
 	seat_focus_override_end(&server->seat);
 
+	if (!strcmp(item->parent->id, PROMPT_MENU_ID)) {
+		finish_prompt(item == prompt.yes
+			? LAB_EXIT_SUCCESS : LAB_EXIT_FAILURE);
+		return true;
+	}
+
 	/*
 	 * We call the actions after closing the menu so that virtual keyboard
 	 * input is sent to the focused_surface instead of being absorbed by the
@@ -1521,22 +2218,90 @@ menu_process_cursor_motion(struct wlr_scene_node *node)
 	menu_process_item_selection(item);
 }
 
+void
+menu_process_cursor_axis(struct wlr_scene_node *node, int steps)
+{
+	assert(node && node->data);
+	struct menuitem *item = node_menuitem_from_node(node);
+	struct menu *menu = item->parent;
+	if (menu->scroll.content_height > menu->size.height) {
+		menu_scroll(menu, steps);
+	}
+}
+
 void
 menu_close_root(struct server *server)
 {
 	assert(server->input_mode == LAB_INPUT_STATE_MENU);
 	assert(server->menu_current);
 
+	bool is_prompt = !strcmp(server->menu_current->id, PROMPT_MENU_ID);
 	menu_close(server->menu_current);
 	server->menu_current = NULL;
 	reset_pipemenus(server);
 	seat_focus_override_end(&server->seat);
+	if (is_prompt) {
+		finish_prompt(LAB_EXIT_CANCELLED);
+	}
+}
+
+bool
+menu_open_prompt(struct server *server, const char *message,
+		menu_prompt_done_fn done, void *data)
+{
+	assert(done);
+	struct output *output = output_nearest_to_cursor(server);
+	if (server->input_mode != LAB_INPUT_STATE_PASSTHROUGH
+			|| !output_is_usable(output)) {
+		return false;
+	}
+
+	struct menu *menu = menu_get_by_id(server, PROMPT_MENU_ID);
+	if (!menu) {
+		menu = menu_create(server, NULL, PROMPT_MENU_ID, "");
+	}
+	struct wl_list *pos = &menu->menuitems;
+	sync_item(menu, &pos, LAB_MENU_TITLE, message, NULL);
+	prompt.yes = sync_item(menu, &pos, LAB_MENU_ITEM, _("Yes"), NULL);
+	sync_item(menu, &pos, LAB_MENU_ITEM, _("No"), NULL);
+	sync_finish(menu, pos);
+
+	/* The size is only known once the scene exists */
+	if (!menu->scene_tree) {
+		menu_create_scene(menu);
+	}
+	struct wlr_box usable = output_usable_area_in_layout_coords(output);
+	int x = usable.x + (usable.width - menu->size.width) / 2;
+	int y = usable.y + (usable.height - menu->size.height) / 2;
+
+	prompt.done = done;
+	prompt.data = data;
+	menu_open_root(menu, x, y);
+	return true;
+}
+
+void
+menu_close_prompt(struct server *server, void *data)
+{
+	if (!prompt.done || prompt.data != data) {
+		return;
+	}
+	prompt.done = NULL;
+	prompt.data = NULL;
+	if (server->menu_current
+			&& !strcmp(server->menu_current->id, PROMPT_MENU_ID)) {
+		menu_close_root(server);
+	}
 }
 
 void
-menu_reconfigure(struct server *server)
+menu_reconfigure(struct server *server, struct wl_array *docs)
 {
 	menu_finish(server);
 	server->menu_current = NULL;
-	menu_init(server);
+	if (docs) {
+		init_from_docs(server, docs);
+	} else {
+		menu_init(server);
+	}
 }
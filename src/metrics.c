@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "metrics.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-util.h>
+#include <wlr/util/log.h>
+#include "common/mem.h"
+#include "common/string-helpers.h"
+#include "config/rcxml.h"
+#include "timer.h"
+
+enum metric_source {
+	METRIC_SOURCE_U64,
+	METRIC_SOURCE_SIZE,
+	METRIC_SOURCE_INT,
+	METRIC_SOURCE_FN,
+};
+
+struct metric {
+	const char *name;
+	char *labels;
+	const char *help;
+	enum metric_type type;
+	enum metric_source source;
+	union {
+		const uint64_t *u64;
+		const size_t *size;
+		const int *i;
+		struct {
+			uint64_t (*read)(void *data);
+			void *data;
+		} fn;
+	} value;
+	const void *owner;
+};
+
+static struct {
+	struct wl_array metrics; /* struct metric */
+	char *path;
+	struct lab_timer *timer;
+} registry;
+
+static struct metric *
+add_metric(const char *name, const char *labels, const char *help,
+		enum metric_type type, enum metric_source source,
+		const void *owner)
+{
+	assert(name && help);
+	struct metric *metric =
+		wl_array_add(&registry.metrics, sizeof(*metric));
+	*metric = (struct metric){
+		.name = name,
+		.labels = labels ? xstrdup(labels) : NULL,
+		.help = help,
+		.type = type,
+		.source = source,
+		.owner = owner,
+	};
+	return metric;
+}
+
+void
+metrics_add_u64(const char *name, const char *labels, const char *help,
+		enum metric_type type, const uint64_t *value, const void *owner)
+{
+	add_metric(name, labels, help, type, METRIC_SOURCE_U64,
+		owner)->value.u64 = value;
+}
+
+void
+metrics_add_size(const char *name, const char *labels, const char *help,
+		enum metric_type type, const size_t *value, const void *owner)
+{
+	add_metric(name, labels, help, type, METRIC_SOURCE_SIZE,
+		owner)->value.size = value;
+}
+
+void
+metrics_add_int(const char *name, const char *labels, const char *help,
+		enum metric_type type, const int *value, const void *owner)
+{
+	add_metric(name, labels, help, type, METRIC_SOURCE_INT,
+		owner)->value.i = value;
+}
+
+void
+metrics_add_fn(const char *name, const char *labels, const char *help,
+		enum metric_type type, uint64_t (*read)(void *data), void *data,
+		const void *owner)
+{
+	struct metric *metric = add_metric(name, labels, help, type,
+		METRIC_SOURCE_FN, owner);
+	metric->value.fn.read = read;
+	metric->value.fn.data = data;
+}
+
+void
+metrics_remove(const void *owner)
+{
+	assert(owner);
+	struct metric *metrics = registry.metrics.data;
+	size_t nr = registry.metrics.size / sizeof(*metrics);
+	size_t kept = 0;
+	for (size_t i = 0; i < nr; i++) {
+		if (metrics[i].owner == owner) {
+			free(metrics[i].labels);
+		} else {
+			metrics[kept++] = metrics[i];
+		}
+	}
+	registry.metrics.size = kept * sizeof(*metrics);
+}
+
+static uint64_t
+read_metric(const struct metric *metric)
+{
+	switch (metric->source) {
+	case METRIC_SOURCE_U64:
+		return *metric->value.u64;
+	case METRIC_SOURCE_SIZE:
+		return *metric->value.size;
+	case METRIC_SOURCE_INT:
+		return *metric->value.i > 0 ? *metric->value.i : 0;
+	case METRIC_SOURCE_FN:
+		return metric->value.fn.read(metric->value.fn.data);
+	}
+	return 0;
+}
+
+static int
+compare_metric_names(const void *a, const void *b)
+{
+	const struct metric *const *ma = a;
+	const struct metric *const *mb = b;
+	return strcmp((*ma)->name, (*mb)->name);
+}
+
+void
+metrics_print(FILE *stream)
+{
+	struct metric *metrics = registry.metrics.data;
+	size_t nr = registry.metrics.size / sizeof(*metrics);
+
+	/* The samples of one family must be consecutive */
+	const struct metric **sorted = znew_n(*sorted, nr ? nr : 1);
+	for (size_t i = 0; i < nr; i++) {
+		sorted[i] = &metrics[i];
+	}
+	qsort(sorted, nr, sizeof(*sorted), compare_metric_names);
+
+	const char *family = NULL;
+	for (size_t i = 0; i < nr; i++) {
+		const struct metric *metric = sorted[i];
+		bool counter = metric->type == METRIC_COUNTER;
+		if (!family || strcmp(family, metric->name)) {
+			family = metric->name;
+			fprintf(stream, "# TYPE labwc_%s %s\n", family,
+				counter ? "counter" : "gauge");
+			fprintf(stream, "# HELP labwc_%s %s\n", family,
+				metric->help);
+		}
+		fprintf(stream, "labwc_%s%s", metric->name,
+			counter ? "_total" : "");
+		if (metric->labels) {
+			fprintf(stream, "{%s}", metric->labels);
+		}
+		fprintf(stream, " %llu\n",
+			(unsigned long long)read_metric(metric));
+	}
+	fprintf(stream, "# EOF\n");
+	free(sorted);
+}
+
+/* Replace the file at once, so that scrapers never read half of it */
+static void
+write_file(void)
+{
+	char *tmp = strdup_printf("%s.tmp", registry.path);
+	FILE *stream = fopen(tmp, "w");
+	if (!stream) {
+		wlr_log_errno(WLR_ERROR, "cannot write %s", tmp);
+		free(tmp);
+		return;
+	}
+	metrics_print(stream);
+	if (fclose(stream) || rename(tmp, registry.path) < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot write %s", registry.path);
+		unlink(tmp);
+	}
+	free(tmp);
+}
+
+static int
+handle_timer(void *data)
+{
+	write_file();
+	lab_timer_update(registry.timer, rc.metrics_interval * 1000);
+	return 0;
+}
+
+void
+metrics_reconfigure(void)
+{
+	if (!registry.timer) {
+		return;
+	}
+	if (rc.metrics_interval) {
+		lab_timer_update(registry.timer, rc.metrics_interval * 1000);
+	} else {
+		lab_timer_update(registry.timer, 0);
+		unlink(registry.path);
+	}
+}
+
+void
+metrics_init(struct server *server, const char *wayland_socket)
+{
+	registry.path = strdup_printf("%s/labwc.%s.metrics",
+		getenv("XDG_RUNTIME_DIR"), wayland_socket);
+	/* Scrapers can take a second of delay */
+	registry.timer = lab_timer_create(handle_timer, NULL,
+		/*slack_ms*/ 1000);
+	metrics_reconfigure();
+}
+
+void
+metrics_finish(void)
+{
+	if (registry.timer) {
+		lab_timer_destroy(registry.timer);
+		registry.timer = NULL;
+	}
+	if (registry.path) {
+		unlink(registry.path);
+		zfree(registry.path);
+	}
+	struct metric *metric;
+	wl_array_for_each(metric, &registry.metrics) {
+		free(metric->labels);
+	}
+	wl_array_release(&registry.metrics);
+	wl_array_init(&registry.metrics);
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "output-mode-cache.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "common/dir.h"
+#include "common/hash.h"
+
+#define OUTPUT_MODE_CACHE_VERSION 1
+
+struct cache_entry {
+	int32_t width, height, refresh;
+	/* Preferred mode when the entry was stored */
+	int32_t preferred_width, preferred_height, preferred_refresh;
+};
+
+static bool
+get_cache_path(char *path, size_t len, struct wlr_output *wlr_output,
+		bool create)
+{
+	if (!cache_dir_get(path, len, "modes", create)) {
+		return false;
+	}
+	uint64_t key = hash_add_str(HASH_INIT, wlr_output->make);
+	key = hash_add_str(key, wlr_output->model);
+	key = hash_add_str(key, wlr_output->serial);
+	key = hash_add_str(key, wlr_output->name);
+	size_t dir_len = strlen(path);
+	int ret = snprintf(path + dir_len, len - dir_len, "/%016" PRIx64, key);
+	return ret >= 0 && (size_t)ret < len - dir_len;
+}
+
+static void
+get_entry(struct cache_entry *entry, struct wlr_output_mode *mode,
+		struct wlr_output_mode *preferred_mode)
+{
+	*entry = (struct cache_entry){
+		.width = mode->width,
+		.height = mode->height,
+		.refresh = mode->refresh,
+	};
+	if (preferred_mode) {
+		entry->preferred_width = preferred_mode->width;
+		entry->preferred_height = preferred_mode->height;
+		entry->preferred_refresh = preferred_mode->refresh;
+	}
+}
+
+static bool
+read_entry(struct cache_entry *entry, struct wlr_output *wlr_output)
+{
+	char path[PATH_MAX];
+	if (!get_cache_path(path, sizeof(path), wlr_output, /*create*/ false)) {
+		return false;
+	}
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+	int version = 0;
+	bool ok = fscanf(f, "%d %" SCNd32 " %" SCNd32 " %" SCNd32 " %" SCNd32
+			" %" SCNd32 " %" SCNd32, &version,
+			&entry->width, &entry->height, &entry->refresh,
+			&entry->preferred_width, &entry->preferred_height,
+			&entry->preferred_refresh) == 7
+		&& version == OUTPUT_MODE_CACHE_VERSION;
+	fclose(f);
+	return ok;
+}
+
+struct wlr_output_mode *
+output_mode_cache_lookup(struct wlr_output *wlr_output)
+{
+	struct cache_entry entry;
+	struct wlr_output_mode *preferred_mode =
+		wlr_output_preferred_mode(wlr_output);
+	if (!preferred_mode || !read_entry(&entry, wlr_output)) {
+		return NULL;
+	}
+
+	/* The monitor (or its EDID) changed since */
+	if (entry.preferred_width != preferred_mode->width
+			|| entry.preferred_height != preferred_mode->height
+			|| entry.preferred_refresh != preferred_mode->refresh) {
+		return NULL;
+	}
+
+	struct wlr_output_mode *mode;
+	wl_list_for_each(mode, &wlr_output->modes, link) {
+		if (mode->width == entry.width && mode->height == entry.height
+				&& mode->refresh == entry.refresh) {
+			return mode;
+		}
+	}
+	return NULL;
+}
+
+void
+output_mode_cache_store(struct wlr_output *wlr_output,
+		struct wlr_output_mode *mode)
+{
+	struct wlr_output_mode *preferred_mode =
+		wlr_output_preferred_mode(wlr_output);
+	if (!mode || !preferred_mode) {
+		return;
+	}
+
+	/* Avoid rewriting the file on every hotplug */
+	struct cache_entry entry, stored;
+	get_entry(&entry, mode, preferred_mode);
+	if (read_entry(&stored, wlr_output) && !memcmp(&entry, &stored,
+			sizeof(entry))) {
+		return;
+	}
+
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	if (!get_cache_path(path, sizeof(path), wlr_output, /*create*/ true)
+			|| snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+				>= (int)sizeof(tmp_path)) {
+		return;
+	}
+	FILE *f = fopen(tmp_path, "w");
+	if (!f) {
+		wlr_log_errno(WLR_DEBUG, "cannot write %s", tmp_path);
+		return;
+	}
+	bool ok = fprintf(f, "%d %" PRId32 " %" PRId32 " %" PRId32 " %" PRId32
+		" %" PRId32 " %" PRId32 "\n", OUTPUT_MODE_CACHE_VERSION,
+		entry.width, entry.height, entry.refresh,
+		entry.preferred_width, entry.preferred_height,
+		entry.preferred_refresh) > 0;
+	ok = !fclose(f) && ok;
+	if (!ok || rename(tmp_path, path)) {
+		wlr_log(WLR_DEBUG, "cannot store mode cache for %s",
+			wlr_output->name);
+		unlink(tmp_path);
+	}
+}
@@ -0,0 +1,444 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * output-stats.c: per-output frame time instrumentation
+ *
+ * Every handled frame event records how long the output commit took,
+ * whether there was any damage at all and - once the presentation
+ * feedback arrives - how many vblanks passed between starting the
+ * commit and the buffer being displayed. While a fullscreen view is on
+ * top, commits are also classified by whether the client buffer went to
+ * the display directly.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "output-stats.h"
+#include <stddef.h>
+#include <wlr/backend/headless.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_screencopy_v1.h>
+#include <wlr/util/log.h>
+#include "common/macros.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "metrics.h"
+#include "output.h"
+
+/* Upper bounds (exclusive) of the histogram buckets in microseconds */
+static const uint32_t bucket_limits_us[] = {
+	500, 1000, 2000, 4000, 7000, 8333, 11111, 16667, 33333, UINT32_MAX,
+};
+
+void
+output_stats_reset(struct output_stats *stats)
+{
+	*stats = (struct output_stats){0};
+}
+
+static const struct {
+	const char *name;
+	const char *help;
+	size_t offset;
+} counters[] = {
+	{ "output_frames", "Frame events handled",
+		offsetof(struct output_stats, frames) },
+	{ "output_commits", "Frames committed to the output",
+		offsetof(struct output_stats, commits) },
+	{ "output_commit_failures", "Failed output commits",
+		offsetof(struct output_stats, commit_failures) },
+	{ "output_missed_vblanks", "Vblanks missed between commit and "
+		"presentation", offsetof(struct output_stats, missed_vblanks) },
+	{ "output_scanout_commits", "Commits scanning out a fullscreen "
+		"client buffer", offsetof(struct output_stats, scanout_commits) },
+	{ "output_hardware_cursor_commits", "Commits showing the cursor on "
+		"the cursor plane",
+		offsetof(struct output_stats, hardware_cursor_commits) },
+	{ "output_software_cursor_commits", "Commits drawing the cursor in "
+		"software", offsetof(struct output_stats, software_cursor_commits) },
+	{ "output_capture_copies", "Screen capture frames served",
+		offsetof(struct output_stats, capture_copies) },
+};
+
+void
+output_stats_add_metrics(struct output *output)
+{
+	char labels[64];
+	snprintf(labels, sizeof(labels), "output=\"%s\"",
+		output->wlr_output->name);
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		const uint64_t *value = (const uint64_t *)
+			((const char *)&output->stats + counters[i].offset);
+		metrics_add_u64(counters[i].name, labels, counters[i].help,
+			METRIC_COUNTER, value, output);
+	}
+}
+
+static uint32_t
+nsec_to_usec_clamped(uint64_t nsec)
+{
+	uint64_t usec = nsec / 1000;
+	return usec > UINT32_MAX ? UINT32_MAX : (uint32_t)usec;
+}
+
+void
+output_stats_record_commit(struct output *output, uint64_t start_ns,
+		uint64_t end_ns, bool committed, bool failed)
+{
+	struct output_stats *stats = &output->stats;
+
+	stats->frames++;
+	if (failed) {
+		stats->commit_failures++;
+		return;
+	}
+	if (!committed) {
+		stats->empty_damage++;
+		return;
+	}
+
+	uint64_t duration = end_ns > start_ns ? end_ns - start_ns : 0;
+	stats->commits++;
+	stats->commit_ns_total += duration;
+	stats->commit_ns_max = MAX(stats->commit_ns_max, duration);
+
+	uint32_t idx = stats->next_sample;
+	stats->samples[idx] = (struct output_frame_sample) {
+		.commit_us = nsec_to_usec_clamped(duration),
+	};
+	stats->next_sample = (idx + 1) % OUTPUT_STATS_WINDOW;
+	stats->nr_samples = MIN(stats->nr_samples + 1, OUTPUT_STATS_WINDOW);
+
+	stats->pending_commit_start = start_ns;
+	stats->pending_sample = idx;
+}
+
+void
+output_stats_record_magnifier(struct output *output, uint64_t duration_ns)
+{
+	struct output_stats *stats = &output->stats;
+
+	stats->magnifier_passes++;
+	stats->magnifier_ns_total += duration_ns;
+	stats->magnifier_ns_max = MAX(stats->magnifier_ns_max, duration_ns);
+}
+
+void
+output_stats_record_scanout(struct output *output, enum output_scanout scanout)
+{
+	struct output_stats *stats = &output->stats;
+
+	stats->last_scanout = scanout;
+	if (scanout == OUTPUT_SCANOUT_NO_FULLSCREEN) {
+		return;
+	}
+	stats->fullscreen_commits++;
+	if (scanout == OUTPUT_SCANOUT_DIRECT) {
+		stats->scanout_commits++;
+	}
+}
+
+static const char *
+cursor_str(enum output_cursor cursor)
+{
+	switch (cursor) {
+	case OUTPUT_CURSOR_NONE:
+		return "none";
+	case OUTPUT_CURSOR_HARDWARE:
+		return "hardware";
+	case OUTPUT_CURSOR_SOFTWARE_LOCKED:
+		return "software (forced)";
+	case OUTPUT_CURSOR_SOFTWARE_UNSUPPORTED:
+		return "software (no cursor plane)";
+	case OUTPUT_CURSOR_SOFTWARE_SIZE:
+		return "software (larger than hardwareCursorMaxSize)";
+	case OUTPUT_CURSOR_SOFTWARE_REJECTED:
+		return "software (rejected by cursor plane)";
+	}
+	return "unknown";
+}
+
+static enum output_cursor
+get_cursor_state(struct wlr_output *wlr_output)
+{
+	struct wlr_output_cursor *cursor, *shown = NULL;
+	wl_list_for_each(cursor, &wlr_output->cursors, link) {
+		if (cursor->enabled && cursor->visible) {
+			shown = cursor;
+			break;
+		}
+	}
+	if (!shown) {
+		return OUTPUT_CURSOR_NONE;
+	}
+	if (wlr_output->hardware_cursor == shown) {
+		return OUTPUT_CURSOR_HARDWARE;
+	}
+	if (wlr_output->software_cursor_locks > 0) {
+		return OUTPUT_CURSOR_SOFTWARE_LOCKED;
+	}
+	if (wlr_output_is_headless(wlr_output)) {
+		return OUTPUT_CURSOR_SOFTWARE_UNSUPPORTED;
+	}
+	if (rc.hardware_cursor_max_size
+			&& MAX(shown->width, shown->height)
+				> rc.hardware_cursor_max_size) {
+		return OUTPUT_CURSOR_SOFTWARE_SIZE;
+	}
+	return OUTPUT_CURSOR_SOFTWARE_REJECTED;
+}
+
+void
+output_stats_record_cursor(struct output *output)
+{
+	struct output_stats *stats = &output->stats;
+	enum output_cursor cursor = get_cursor_state(output->wlr_output);
+
+	if (cursor == OUTPUT_CURSOR_HARDWARE) {
+		stats->hardware_cursor_commits++;
+	} else if (cursor != OUTPUT_CURSOR_NONE) {
+		stats->software_cursor_commits++;
+		if (stats->last_cursor == OUTPUT_CURSOR_HARDWARE) {
+			stats->software_cursor_fallbacks++;
+			wlr_log(WLR_DEBUG, "output %s: software cursor (%s)",
+				output->wlr_output->name, cursor_str(cursor));
+		}
+	}
+	stats->last_cursor = cursor;
+}
+
+void
+output_stats_count_captures(struct output *output,
+		const struct wlr_output_state *state, struct output_captures *captures)
+{
+	*captures = (struct output_captures){0};
+	struct wlr_screencopy_manager_v1 *manager =
+		output->server->screencopy_manager;
+	if (!manager) {
+		return;
+	}
+
+	const pixman_region32_t *damage = state
+		&& (state->committed & WLR_OUTPUT_STATE_DAMAGE)
+		? &state->damage : NULL;
+	struct wlr_screencopy_frame_v1 *frame;
+	wl_list_for_each(frame, &manager->frames, link) {
+		/* Frames without a buffer have not been asked to copy yet */
+		if (frame->output != output->wlr_output || !frame->buffer) {
+			continue;
+		}
+		captures->pending++;
+		if (!state) {
+			continue;
+		}
+		if (frame->with_damage && damage) {
+			pixman_box32_t box = {
+				.x1 = frame->box.x,
+				.y1 = frame->box.y,
+				.x2 = frame->box.x + frame->box.width,
+				.y2 = frame->box.y + frame->box.height,
+			};
+			if (pixman_region32_contains_rectangle(
+					(pixman_region32_t *)damage, &box)
+					== PIXMAN_REGION_OUT) {
+				continue;
+			}
+		}
+		captures->copies++;
+		captures->bytes += (uint64_t)frame->box.width
+			* frame->box.height * 4;
+	}
+}
+
+void
+output_stats_record_captures(struct output *output,
+		const struct output_captures *captures, bool committed)
+{
+	struct output_stats *stats = &output->stats;
+
+	if (!committed) {
+		stats->capture_skipped += captures->pending > 0;
+		return;
+	}
+	stats->capture_copies += captures->copies;
+	stats->capture_bytes += captures->bytes;
+}
+
+void
+output_stats_record_present(struct output *output,
+		const struct wlr_output_event_present *event)
+{
+	struct output_stats *stats = &output->stats;
+
+	if (event->presented && event->when.tv_sec) {
+		stats->last_present_ns = timespec_to_nsec(&event->when);
+		stats->refresh_ns = event->refresh > 0 ? event->refresh : 0;
+	}
+
+	if (!stats->pending_commit_start) {
+		return;
+	}
+	uint64_t start = stats->pending_commit_start;
+	stats->pending_commit_start = 0;
+
+	if (!event->presented || !event->when.tv_sec) {
+		return;
+	}
+
+	uint64_t when = timespec_to_nsec(&event->when);
+	if (when <= start) {
+		return;
+	}
+	uint64_t latency = when - start;
+	stats->samples[stats->pending_sample].present_us =
+		nsec_to_usec_clamped(latency);
+
+	/*
+	 * A commit started right after a frame event is expected to be
+	 * displayed at the following vblank, i.e. within one refresh
+	 * interval. Every additional interval is a missed vblank.
+	 */
+	if (event->refresh > 0) {
+		stats->missed_vblanks += latency / (uint64_t)event->refresh;
+	}
+}
+
+uint64_t
+output_stats_predict_commit_ns(const struct output_stats *stats,
+		uint32_t nr_frames)
+{
+	nr_frames = MIN(nr_frames, stats->nr_samples);
+
+	uint32_t max_us = 0;
+	uint32_t idx = stats->next_sample;
+	for (uint32_t i = 0; i < nr_frames; i++) {
+		idx = (idx + OUTPUT_STATS_WINDOW - 1) % OUTPUT_STATS_WINDOW;
+		max_us = MAX(max_us, stats->samples[idx].commit_us);
+	}
+	return (uint64_t)max_us * 1000;
+}
+
+static const char *
+scanout_str(enum output_scanout scanout)
+{
+	switch (scanout) {
+	case OUTPUT_SCANOUT_NO_FULLSCREEN:
+		return "composited (no fullscreen view)";
+	case OUTPUT_SCANOUT_DIRECT:
+		return "direct";
+	case OUTPUT_SCANOUT_BLOCKED_MAGNIFIER:
+		return "composited (magnifier)";
+	case OUTPUT_SCANOUT_BLOCKED_SSD:
+		return "composited (server side decoration)";
+	case OUTPUT_SCANOUT_BLOCKED_OVERLAY:
+		return "composited (overlay)";
+	case OUTPUT_SCANOUT_BLOCKED_LAYER_SURFACE:
+		return "composited (layer surface)";
+	case OUTPUT_SCANOUT_BLOCKED_LETTERBOX:
+		return "composited (view smaller than output)";
+	case OUTPUT_SCANOUT_BLOCKED_BUFFER:
+		return "composited (buffer not scanout capable)";
+	}
+	return "unknown";
+}
+
+static void
+print_histogram(FILE *stream, const char *name,
+		const struct output_stats *stats, bool present)
+{
+	uint32_t counts[ARRAY_SIZE(bucket_limits_us)] = {0};
+	uint32_t total = 0;
+
+	for (uint32_t i = 0; i < stats->nr_samples; i++) {
+		uint32_t value = present ? stats->samples[i].present_us
+			: stats->samples[i].commit_us;
+		if (present && !value) {
+			continue;
+		}
+		for (size_t b = 0; b < ARRAY_SIZE(bucket_limits_us); b++) {
+			if (value < bucket_limits_us[b]) {
+				counts[b]++;
+				break;
+			}
+		}
+		total++;
+	}
+
+	fprintf(stream, "  %s_histogram_us (%u samples):", name, total);
+	for (size_t b = 0; b < ARRAY_SIZE(bucket_limits_us); b++) {
+		if (bucket_limits_us[b] == UINT32_MAX) {
+			fprintf(stream, " inf:%u", counts[b]);
+		} else {
+			fprintf(stream, " <%u:%u", bucket_limits_us[b], counts[b]);
+		}
+	}
+	fprintf(stream, "\n");
+}
+
+void
+output_stats_print(struct server *server, FILE *stream)
+{
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		struct wlr_output *wlr_output = output->wlr_output;
+		struct output_stats *stats = &output->stats;
+
+		fprintf(stream, "output %s\n", wlr_output->name);
+		fprintf(stream, "  enabled: %s\n",
+			wlr_output->enabled ? "yes" : "no");
+		fprintf(stream, "  refresh_mhz: %d\n", wlr_output->refresh);
+		fprintf(stream, "  gpu: %s\n", output->cross_gpu
+			? "secondary (copied from primary)" : "primary");
+		fprintf(stream, "  frames: %lu\n", (unsigned long)stats->frames);
+		fprintf(stream, "  commits: %lu\n", (unsigned long)stats->commits);
+		fprintf(stream, "  empty_damage: %lu\n",
+			(unsigned long)stats->empty_damage);
+		fprintf(stream, "  commit_failures: %lu\n",
+			(unsigned long)stats->commit_failures);
+		fprintf(stream, "  missed_vblanks: %lu\n",
+			(unsigned long)stats->missed_vblanks);
+		fprintf(stream, "  commit_avg_us: %lu\n", stats->commits
+			? (unsigned long)(stats->commit_ns_total / stats->commits / 1000)
+			: 0UL);
+		fprintf(stream, "  commit_max_us: %lu\n",
+			(unsigned long)(stats->commit_ns_max / 1000));
+		if (stats->magnifier_passes) {
+			fprintf(stream, "  magnifier_passes: %lu\n",
+				(unsigned long)stats->magnifier_passes);
+			fprintf(stream, "  magnifier_avg_us: %lu\n",
+				(unsigned long)(stats->magnifier_ns_total
+					/ stats->magnifier_passes / 1000));
+			fprintf(stream, "  magnifier_max_us: %lu\n",
+				(unsigned long)(stats->magnifier_ns_max / 1000));
+		}
+		fprintf(stream, "  fullscreen_commits: %lu\n",
+			(unsigned long)stats->fullscreen_commits);
+		fprintf(stream, "  scanout_commits: %lu\n",
+			(unsigned long)stats->scanout_commits);
+		fprintf(stream, "  last_scanout: %s\n",
+			scanout_str(stats->last_scanout));
+		fprintf(stream, "  hardware_cursor_commits: %lu\n",
+			(unsigned long)stats->hardware_cursor_commits);
+		fprintf(stream, "  software_cursor_commits: %lu\n",
+			(unsigned long)stats->software_cursor_commits);
+		fprintf(stream, "  software_cursor_fallbacks: %lu\n",
+			(unsigned long)stats->software_cursor_fallbacks);
+		fprintf(stream, "  last_cursor: %s\n",
+			cursor_str(stats->last_cursor));
+		fprintf(stream, "  tearing: %s\n",
+			output->tearing_allowed ? "yes" : "no");
+		fprintf(stream, "  tearing_switches: %lu\n",
+			(unsigned long)stats->tearing_switches);
+		fprintf(stream, "  adaptive_sync: %s\n",
+			wlr_output->adaptive_sync_status
+				== WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ? "yes" : "no");
+		fprintf(stream, "  adaptive_sync_switches: %lu\n",
+			(unsigned long)stats->adaptive_sync_switches);
+		fprintf(stream, "  capture_copies: %lu\n",
+			(unsigned long)stats->capture_copies);
+		fprintf(stream, "  capture_bytes: %lu\n",
+			(unsigned long)stats->capture_bytes);
+		fprintf(stream, "  capture_skipped: %lu\n",
+			(unsigned long)stats->capture_skipped);
+		print_histogram(stream, "commit", stats, /*present*/ false);
+		print_histogram(stream, "present", stats, /*present*/ true);
+	}
+}
@@ -10,48 +10,85 @@
 #include "output.h"
 #include <assert.h>
 #include <strings.h>
+#include <sys/stat.h>
+#include <wlr/backend.h>
 #include <wlr/backend/drm.h>
+#include <wlr/backend/headless.h>
 #include <wlr/backend/wayland.h>
+#include <wlr/render/swapchain.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_drm_lease_v1.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
+#include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_management_v1.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
-#include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
+#include "common/lab-scene-rect.h"
 #include "common/macros.h"
 #include "common/mem.h"
 #include "common/scene-helpers.h"
+#include "common/time-helpers.h"
 #include "config/rcxml.h"
+#include "cycle.h"
+#include "deferred-startup.h"
+#include "edges.h"
+#include "input-latency.h"
+#include "input/ime.h"
+#include "input/tablet.h"
+#include "ipc.h"
 #include "labwc.h"
 #include "layers.h"
+#include "layout-transaction.h"
+#include "magnifier.h"
+#include "metrics.h"
 #include "node.h"
+#include "output-mode-cache.h"
 #include "output-state.h"
 #include "output-virtual.h"
 #include "protocols/cosmic-workspaces.h"
 #include "protocols/ext-workspace.h"
 #include "regions.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "session-lock.h"
+#include "tiling.h"
+#include "timer.h"
+#include "trace.h"
 #include "view.h"
+#include "window-rules.h"
+#include "workspace-swipe.h"
 #include "xwayland.h"
 
 bool
 output_get_tearing_allowance(struct output *output)
 {
 	struct server *server = output->server;
+	struct view *view = server->active_view;
 
-	/* never allow tearing when disabled */
-	if (!rc.allow_tearing) {
+	/* tearing is only allowed for the output with the active view */
+	if (!view || view->output != output) {
 		return false;
 	}
 
-	struct view *view = server->active_view;
+	/* a window rule applies unless overridden by action */
+	if (view->force_tearing == LAB_STATE_UNSPECIFIED) {
+		switch (window_rules_get_property(view,
+				WINDOW_RULE_PROP_ALLOW_TEARING)) {
+		case LAB_PROP_TRUE:
+			return true;
+		case LAB_PROP_FALSE:
+			return false;
+		default:
+			break;
+		}
+	}
 
-	/* tearing is only allowed for the output with the active view */
-	if (!view || view->output != output) {
+	/* never allow tearing when disabled */
+	if (!rc.allow_tearing) {
 		return false;
 	}
 
@@ -79,53 +116,152 @@ output_get_tearing_allowance(struct output *output)
 	return view->force_tearing == LAB_STATE_ENABLED;
 }
 
-static void
-output_apply_gamma(struct output *output)
+static uint64_t
+output_refresh_nsec(struct output *output)
 {
-	assert(output);
-	assert(output->gamma_lut_changed);
+	int32_t refresh_mhz = output->wlr_output->refresh;
+	if (refresh_mhz <= 0) {
+		/* Assume 60Hz for outputs without a fixed refresh rate */
+		refresh_mhz = 60000;
+	}
+	return 1000000000000ULL / refresh_mhz;
+}
 
-	struct server *server = output->server;
-	struct wlr_scene_output *scene_output = output->scene_output;
+static int
+handle_gamma_timer(void *data)
+{
+	struct output *output = data;
+	wlr_output_schedule_frame(output->wlr_output);
+	return 0;
+}
 
-	struct wlr_output_state pending;
-	wlr_output_state_init(&pending);
+/*
+ * Add a changed gamma LUT to the pending state of the frame, so that it
+ * is committed along with the frame rather than on its own. Tools that
+ * animate the color temperature may set the LUT any number of times, but
+ * it is applied at most once per refresh cycle.
+ */
+static void
+output_add_gamma(struct output *output, struct wlr_output_state *pending)
+{
+	if (!output->gamma_lut_changed) {
+		return;
+	}
+
+	uint64_t now = time_now_nsec();
+	uint64_t next_nsec = output->gamma_applied_nsec
+		+ output_refresh_nsec(output);
+	if (now < next_nsec) {
+		if (!output->gamma_timer) {
+			output->gamma_timer = lab_timer_create(
+				handle_gamma_timer, output, /*slack_ms*/ 4);
+		}
+		lab_timer_update(output->gamma_timer,
+			(next_nsec - now + 999999) / 1000000);
+		return;
+	}
 
-	output->gamma_lut_changed = false;
 	struct wlr_gamma_control_v1 *gamma_control =
 		wlr_gamma_control_manager_v1_get_control(
-			server->gamma_control_manager_v1,
+			output->server->gamma_control_manager_v1,
 			output->wlr_output);
+	output->gamma_lut_changed = false;
+	if (wlr_gamma_control_v1_apply(gamma_control, pending)) {
+		output->gamma_applied_nsec = now;
+	}
+}
 
-	if (!wlr_gamma_control_v1_apply(gamma_control, &pending)) {
-		wlr_output_state_finish(&pending);
-		return;
+void
+output_drop_gamma(struct output *output, struct wlr_output_state *state)
+{
+	assert(state->committed & WLR_OUTPUT_STATE_GAMMA_LUT);
+	state->committed &= ~WLR_OUTPUT_STATE_GAMMA_LUT;
+	zfree(state->gamma_lut);
+	state->gamma_lut_size = 0;
+
+	if (wlr_output_test_state(output->wlr_output, state)) {
+		/* The frame is fine without it, so the LUT is not supported */
+		struct wlr_gamma_control_v1 *gamma_control =
+			wlr_gamma_control_manager_v1_get_control(
+				output->server->gamma_control_manager_v1,
+				output->wlr_output);
+		if (gamma_control) {
+			wlr_gamma_control_v1_send_failed_and_destroy(
+				gamma_control);
+		}
+	} else {
+		/* Not the fault of the LUT, try again with the next frame */
+		output->gamma_lut_changed = true;
 	}
+}
+
+static void
+output_render(struct output *output)
+{
+	if (layout_transaction_blocks_output()) {
+		/*
+		 * Hold back the intermediate layout; a frame is scheduled
+		 * once the transaction completes.
+		 */
+	} else {
+		struct wlr_scene_output *scene_output = output->scene_output;
+		struct wlr_output_state *pending = &output->pending;
+		output_add_gamma(output, pending);
+
+		bool tearing = output_get_tearing_allowance(output);
+		if (tearing != output->tearing_allowed) {
+			output->tearing_allowed = tearing;
+			output->stats.tearing_switches++;
+			wlr_log(WLR_INFO, "tearing %sallowed on output %s",
+				tearing ? "" : "dis", output->wlr_output->name);
+		}
+		pending->tearing_page_flip = tearing;
 
-	if (!lab_wlr_scene_output_commit(scene_output, &pending)) {
-		wlr_gamma_control_v1_send_failed_and_destroy(gamma_control);
+		/*
+		 * lab_wlr_scene_output_commit() returns true without
+		 * committing when there is no damage, so use the commit
+		 * sequence to tell an empty frame from a committed one.
+		 */
+		uint32_t commit_seq = output->wlr_output->commit_seq;
+		uint64_t start = time_now_nsec();
+		bool ok = lab_wlr_scene_output_commit(scene_output, pending);
+		bool committed = ok && commit_seq != output->wlr_output->commit_seq;
+		output_stats_record_commit(output, start, time_now_nsec(),
+			committed, !ok);
+		if (committed) {
+			output->last_commit_nsec = start;
+			output_stats_record_cursor(output);
+			deferred_startup_frame_committed();
+			if (input_latency_enabled) {
+				input_latency_record_output_commit(output, start);
+			}
+		}
 	}
 
-	wlr_output_state_finish(&pending);
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wlr_scene_output_send_frame_done(output->scene_output, &now);
 }
 
-static void
-handle_output_frame(struct wl_listener *listener, void *data)
+static void output_reacquire(struct output *output);
+
+static bool
+output_can_render(struct output *output)
 {
-	/*
-	 * This function is called every time an output is ready to display a
-	 * frame - which is typically at 60 Hz.
-	 */
-	struct output *output = wl_container_of(listener, output, frame);
 	if (!output_is_usable(output)) {
-		return;
+		return false;
+	}
+
+	/* Enabled by other means than wlr-output-power-management */
+	if (output->released) {
+		output_reacquire(output);
 	}
 
 	/*
 	 * skip painting the session when it exists but is not active.
 	 */
 	if (output->server->session && !output->server->session->active) {
-		return;
+		return false;
 	}
 
 	if (!output->scene_output) {
@@ -136,30 +272,169 @@ handle_output_frame(struct wl_listener *listener, void *data)
 		 *       creating them on handle_new_output() only.
 		 */
 		wlr_log(WLR_INFO, "Failed to render new frame: no scene-output");
-		return;
+		return false;
 	}
+	return true;
+}
 
-	if (output->gamma_lut_changed) {
-		/*
-		 * We are not mixing the gamma state with
-		 * other pending output changes to make it
-		 * easier to handle a failed output commit
-		 * due to gamma without impacting other
-		 * unrelated output changes.
-		 */
-		output_apply_gamma(output);
+static int
+handle_render_delay_timer(void *data)
+{
+	struct output *output = data;
+	if (output_can_render(output)) {
+		output_render(output);
+	}
+	return 0;
+}
+
+static int
+output_max_render_time(struct output *output)
+{
+	int max_render_time = LAB_MAX_RENDER_TIME_OFF;
+	struct render_delay_config *config;
+	wl_list_for_each(config, &rc.render_delay_configs, link) {
+		if (!config->output) {
+			max_render_time = config->max_render_time;
+		} else if (!strcasecmp(config->output, output->wlr_output->name)) {
+			/* An entry for this specific output always wins */
+			return config->max_render_time;
+		}
+	}
+	return max_render_time;
+}
+
+/*
+ * Margin added to the measured commit time in automatic mode, and the
+ * minimum delay for which arming a timer is worthwhile at all.
+ */
+#define RENDER_DELAY_SLACK_NSEC (1000000ULL)
+/* Number of recent commits considered when estimating the render time */
+#define RENDER_DELAY_HISTORY (32)
+
+/*
+ * Returns the number of milliseconds rendering should be deferred by,
+ * or 0 to render immediately.
+ */
+static int
+output_get_render_delay(struct output *output)
+{
+	int max_render_time = output_max_render_time(output);
+	if (max_render_time == LAB_MAX_RENDER_TIME_OFF) {
+		return 0;
+	}
+
+	/* Deferring only adds latency when tearing is allowed */
+	if (output_get_tearing_allowance(output)) {
+		return 0;
+	}
+
+	struct output_stats *stats = &output->stats;
+	if (!stats->refresh_ns || !stats->last_present_ns) {
+		return 0;
+	}
+
+	uint64_t budget;
+	if (max_render_time == LAB_MAX_RENDER_TIME_AUTO) {
+		budget = output_stats_predict_commit_ns(stats,
+			RENDER_DELAY_HISTORY);
+		if (!budget) {
+			/* Nothing measured yet */
+			return 0;
+		}
+		budget += RENDER_DELAY_SLACK_NSEC;
 	} else {
-		struct wlr_scene_output *scene_output = output->scene_output;
-		struct wlr_output_state *pending = &output->pending;
+		budget = (uint64_t)max_render_time * 1000000;
+	}
 
-		pending->tearing_page_flip = output_get_tearing_allowance(output);
+	uint64_t now = time_now_nsec();
+	uint64_t next_vblank = stats->last_present_ns + stats->refresh_ns;
+	if (next_vblank <= now) {
+		uint64_t behind = now - stats->last_present_ns;
+		next_vblank = stats->last_present_ns
+			+ (behind / stats->refresh_ns + 1) * stats->refresh_ns;
+	}
 
-		lab_wlr_scene_output_commit(scene_output, pending);
+	if (next_vblank < now + budget + RENDER_DELAY_SLACK_NSEC) {
+		return 0;
 	}
+	return (next_vblank - now - budget) / 1000000;
+}
 
-	struct timespec now = { 0 };
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	wlr_scene_output_send_frame_done(output->scene_output, &now);
+/*
+ * Returns the number of milliseconds until a virtual output may commit
+ * again, see <core><virtualOutputMaxFrameRate>.
+ */
+static int
+output_get_frame_limit_delay(struct output *output)
+{
+	if (!rc.virtual_output_max_frame_rate
+			|| !wlr_output_is_headless(output->wlr_output)
+			|| !output->last_commit_nsec) {
+		return 0;
+	}
+	uint64_t interval = 1000000000ULL / rc.virtual_output_max_frame_rate;
+	uint64_t next = output->last_commit_nsec + interval;
+	uint64_t now = time_now_nsec();
+	if (next <= now) {
+		return 0;
+	}
+	/* Round up, so that the timer never fires early */
+	return (next - now + 999999) / 1000000;
+}
+
+static void
+handle_output_frame(struct wl_listener *listener, void *data)
+{
+	/*
+	 * This function is called every time an output is ready to display a
+	 * frame - which is typically at 60 Hz.
+	 */
+	struct output *output = wl_container_of(listener, output, frame);
+	trace_begin("handle_output_frame");
+
+	/* Process pointer motion merged by <mouse><motionCoalescing> */
+	cursor_flush_motion(&output->server->seat);
+	tablet_flush_motion(&output->server->seat);
+	cursor_flush_move(output->server);
+	workspace_swipe_frame(output->server);
+
+	if (!output_can_render(output)) {
+		trace_end("handle_output_frame");
+		return;
+	}
+
+	/*
+	 * Optionally defer compositing to shortly before the next vblank to
+	 * reduce input-to-photon latency. See <renderDelay> in labwc-config(5).
+	 */
+	int delay = MAX(output_get_render_delay(output),
+		output_get_frame_limit_delay(output));
+	if (delay > 0) {
+		if (!output->render_delay_timer) {
+			output->render_delay_timer = wl_event_loop_add_timer(
+				output->server->wl_event_loop,
+				handle_render_delay_timer, output);
+		}
+		if (output->render_delay_timer) {
+			wl_event_source_timer_update(output->render_delay_timer,
+				delay);
+			trace_end("handle_output_frame");
+			return;
+		}
+	}
+
+	output_render(output);
+	trace_end("handle_output_frame");
+}
+
+static void
+handle_output_present(struct wl_listener *listener, void *data)
+{
+	struct output *output = wl_container_of(listener, output, present);
+	output_stats_record_present(output, data);
+	if (input_latency_enabled) {
+		input_latency_record_present(output, data);
+	}
 }
 
 static void
@@ -167,14 +442,20 @@ handle_output_destroy(struct wl_listener *listener, void *data)
 {
 	struct output *output = wl_container_of(listener, output, destroy);
 	struct seat *seat = &output->server->seat;
+	input_latency_forget_output(output);
+	metrics_remove(output);
 	regions_evacuate_output(output);
 	regions_destroy(seat, &output->regions);
+	regions_index_finish(output);
 	if (seat->overlay.active.output == output) {
 		overlay_finish(seat);
 	}
 	wl_list_remove(&output->link);
 	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->present.link);
 	wl_list_remove(&output->destroy.link);
+	magnifier_output_destroyed(output);
+	tiling_output_destroyed(output);
 	wl_list_remove(&output->request_state.link);
 	seat_output_layout_changed(seat);
 
@@ -182,6 +463,7 @@ handle_output_destroy(struct wl_listener *listener, void *data)
 		wlr_scene_node_destroy(&output->layer_tree[i]->node);
 	}
 	wlr_scene_node_destroy(&output->layer_popup_tree->node);
+	cycle_osd_drop_cached_items(output);
 	wlr_scene_node_destroy(&output->cycle_osd_tree->node);
 	wlr_scene_node_destroy(&output->session_lock_tree->node);
 	if (output->workspace_osd) {
@@ -197,7 +479,16 @@ handle_output_destroy(struct wl_listener *listener, void *data)
 		}
 	}
 
+	if (output->render_delay_timer) {
+		wl_event_source_remove(output->render_delay_timer);
+	}
+	if (output->release_timer) {
+		wl_event_source_remove(output->release_timer);
+	}
+	lab_timer_destroy(output->gamma_timer);
+
 	wlr_output_state_finish(&output->pending);
+	wl_array_release(&output->visible_views);
 
 	/*
 	 * Ensure that we don't accidentally try to dereference
@@ -289,10 +580,21 @@ add_output_to_layout(struct server *server, struct output *output)
 	/* (Re-)create regions from config */
 	regions_reconfigure_output(output);
 
-	/* Create lock surface if needed */
-	if (server->session_lock_manager->locked) {
-		session_lock_output_create(server->session_lock_manager, output);
-	}
+	/* Pre-build the lock tree, which is shown right away if locked */
+	session_lock_output_create(server->session_lock_manager, output);
+}
+
+/*
+ * Here we interpret a custom_mode of all zeroes as "none/any"; this is
+ * seen e.g. with kanshi configs containing no "mode" field. In theory,
+ * (state->committed & WLR_OUTPUT_STATE_MODE) should be zero in this
+ * case, but this is not seen in practice.
+ */
+static bool
+output_state_has_mode(const struct wlr_output_state *state)
+{
+	return state->mode || state->custom_mode.width
+		|| state->custom_mode.height || state->custom_mode.refresh;
 }
 
 static bool
@@ -301,19 +603,12 @@ output_test_auto(struct wlr_output *wlr_output, struct wlr_output_state *state,
 {
 	wlr_log(WLR_DEBUG, "testing modes for %s", wlr_output->name);
 	/*
-	 * When a client requests a specific mode, test only that mode. Here
-	 * we interpret a custom_mode of all zeroes as "none/any"; this is
-	 * seen e.g. with kanshi configs containing no "mode" field. In
-	 * theory, (state->committed & WLR_OUTPUT_STATE_MODE) should be zero
-	 * in this case, but this is not seen in practice.
+	 * When a client requests a specific mode, test only that mode.
 	 *
 	 * If the wlr_output_state did not come from a client request, then
 	 * ignore the mode/custom_mode fields which are not meaningful.
 	 */
-	if (is_client_request && (state->mode
-			|| state->custom_mode.width
-			|| state->custom_mode.height
-			|| state->custom_mode.refresh)) {
+	if (is_client_request && output_state_has_mode(state)) {
 		if (state->mode) {
 			wlr_log(WLR_DEBUG, "testing requested mode %dx%d@%d",
 				state->mode->width, state->mode->height,
@@ -343,12 +638,31 @@ output_test_auto(struct wlr_output *wlr_output, struct wlr_output_state *state,
 
 	struct wlr_output_mode *preferred_mode =
 		wlr_output_preferred_mode(wlr_output);
+
+	/*
+	 * If the preferred mode failed last time on this connector, start
+	 * with the fallback mode which passed instead of testing them all
+	 * again. Each test is a modeset test commit taking milliseconds.
+	 */
+	struct wlr_output_mode *cached_mode =
+		output_mode_cache_lookup(wlr_output);
+	if (cached_mode && cached_mode != preferred_mode) {
+		wlr_log(WLR_DEBUG, "testing cached mode %dx%d@%d",
+			cached_mode->width, cached_mode->height,
+			cached_mode->refresh);
+		wlr_output_state_set_mode(state, cached_mode);
+		if (wlr_output_test_state(wlr_output, state)) {
+			return true;
+		}
+	}
+
 	if (preferred_mode) {
 		wlr_log(WLR_DEBUG, "testing preferred mode %dx%d@%d",
 			preferred_mode->width, preferred_mode->height,
 			preferred_mode->refresh);
 		wlr_output_state_set_mode(state, preferred_mode);
 		if (wlr_output_test_state(wlr_output, state)) {
+			output_mode_cache_store(wlr_output, preferred_mode);
 			return true;
 		}
 	}
@@ -361,13 +675,14 @@ output_test_auto(struct wlr_output *wlr_output, struct wlr_output_state *state,
 	 */
 	struct wlr_output_mode *mode;
 	wl_list_for_each(mode, &wlr_output->modes, link) {
-		if (mode == preferred_mode) {
+		if (mode == preferred_mode || mode == cached_mode) {
 			continue;
 		}
 		wlr_log(WLR_DEBUG, "testing fallback mode %dx%d@%d",
 			mode->width, mode->height, mode->refresh);
 		wlr_output_state_set_mode(state, mode);
 		if (wlr_output_test_state(wlr_output, state)) {
+			output_mode_cache_store(wlr_output, mode);
 			return true;
 		}
 	}
@@ -449,6 +764,28 @@ get_unused_output_id_bit(struct server *server)
 	return id_bit;
 }
 
+/*
+ * wlroots composites every output with the renderer of the primary GPU.
+ * For a DRM output driven by another GPU, its backend copies each frame
+ * over to that GPU before scanning it out, which costs a blit per frame
+ * and rules out direct scanout of client buffers.
+ */
+static bool
+output_is_cross_gpu(struct wlr_output *wlr_output, struct wlr_renderer *renderer)
+{
+	if (!wlr_output_is_drm(wlr_output)) {
+		return false;
+	}
+	int output_fd = wlr_backend_get_drm_fd(wlr_output->backend);
+	int renderer_fd = wlr_renderer_get_drm_fd(renderer);
+	struct stat output_st, renderer_st;
+	if (output_fd < 0 || renderer_fd < 0 || fstat(output_fd, &output_st)
+			|| fstat(renderer_fd, &renderer_st)) {
+		return false;
+	}
+	return output_st.st_rdev != renderer_st.st_rdev;
+}
+
 static void
 handle_new_output(struct wl_listener *listener, void *data)
 {
@@ -529,7 +866,14 @@ handle_new_output(struct wl_listener *listener, void *data)
 	wlr_output->data = output;
 	output->server = server;
 	output->id_bit = id_bit;
+	output->cross_gpu = output_is_cross_gpu(wlr_output, server->renderer);
+	if (output->cross_gpu) {
+		wlr_log(WLR_INFO, "output %s is on a secondary GPU, "
+			"frames are copied over from the primary GPU",
+			wlr_output->name);
+	}
 	output_state_init(output);
+	output_stats_add_metrics(output);
 
 	wl_list_insert(&server->outputs, &output->link);
 
@@ -537,12 +881,17 @@ handle_new_output(struct wl_listener *listener, void *data)
 	wl_signal_add(&wlr_output->events.destroy, &output->destroy);
 	output->frame.notify = handle_output_frame;
 	wl_signal_add(&wlr_output->events.frame, &output->frame);
+	output->present.notify = handle_output_present;
+	wl_signal_add(&wlr_output->events.present, &output->present);
 
 	output->request_state.notify = handle_output_request_state;
 	wl_signal_add(&wlr_output->events.request_state, &output->request_state);
 
 	wl_list_init(&output->regions);
 	wl_list_init(&output->cycle_osd.items);
+	wl_list_init(&output->cycle_osd.cached_items);
+	wl_array_init(&output->visible_views);
+	output->visibility_dirty = true;
 
 	/*
 	 * Create layer-trees (background, bottom, top and overlay) and
@@ -639,21 +988,71 @@ output_finish(struct server *server)
 	output_manager_finish(server);
 }
 
+static void
+update_prerender_scales(struct server *server)
+{
+	double scales[8];
+	int nr_scales = 0;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output_is_usable(output)
+				&& nr_scales < (int)ARRAY_SIZE(scales)) {
+			scales[nr_scales++] = output->wlr_output->scale;
+		}
+	}
+	scaled_buffer_set_output_scales(scales, nr_scales);
+}
+
 static void
 output_update_for_layout_change(struct server *server)
 {
 	output_update_all_usable_areas(server, /*layout_changed*/ true);
+	update_prerender_scales(server);
 	session_lock_update_for_layout_change(server);
+	edges_visibility_invalidate(server, NULL);
+	input_method_relay_invalidate(server->seat.input_method_relay);
 
 	/*
 	 * "Move" each wlr_output_cursor (in per-output coordinates) to
 	 * align with the seat cursor. Re-set the cursor image so that
 	 * the cursor isn't invisible on new outputs.
 	 */
+	cursor_preload_scales(&server->seat);
 	wlr_cursor_move(server->seat.cursor, NULL, 0, 0);
 	cursor_update_image(&server->seat);
 }
 
+/* Commit the pending states of all @config heads in a single backend commit */
+static bool
+commit_heads(struct server *server, struct wlr_output_configuration_v1 *config,
+		int nr_heads)
+{
+	struct wlr_backend_output_state *states =
+		znew_n(struct wlr_backend_output_state, nr_heads);
+	int i = 0;
+	struct wlr_output_configuration_head_v1 *head;
+	wl_list_for_each(head, &config->heads, link) {
+		struct output *output =
+			output_from_wlr_output(server, head->state.output);
+		states[i].output = head->state.output;
+		/* Shallow copy, the backend does not take ownership */
+		states[i].base = output->pending;
+		i++;
+	}
+
+	bool ok = wlr_backend_commit(server->backend, states, nr_heads);
+	free(states);
+	if (ok) {
+		wl_list_for_each(head, &config->heads, link) {
+			struct output *output =
+				output_from_wlr_output(server, head->state.output);
+			wlr_output_state_finish(&output->pending);
+			wlr_output_state_init(&output->pending);
+		}
+	}
+	return ok;
+}
+
 static bool
 output_config_apply(struct server *server,
 		struct wlr_output_configuration_v1 *config)
@@ -680,27 +1079,66 @@ output_config_apply(struct server *server,
 					head->state.custom_mode.refresh);
 			}
 			/*
-			 * Try to ensure a valid mode. Ignore failures
-			 * here and just check the commit below.
+			 * Pick a mode if none was requested. A requested
+			 * mode has already been tested together with the
+			 * other heads by verify_output_config_v1().
+			 * Ignore failures here and just check the commit
+			 * below.
 			 */
-			(void)output_test_auto(o, os,
-				/* is_client_request */ true);
+			if (!output_state_has_mode(os)) {
+				(void)output_test_auto(o, os,
+					/* is_client_request */ true);
+			}
 			wlr_output_state_set_scale(os, head->state.scale);
 			wlr_output_state_set_transform(os, head->state.transform);
 			output_enable_adaptive_sync(output,
 				head->state.adaptive_sync_enabled);
 		}
-		if (!output_state_commit(output)) {
-			/*
-			 * FIXME: This is only part of the story, we should revert
-			 *        all previously committed outputs as well here.
-			 *
-			 *        See https://github.com/labwc/labwc/pull/1528
-			 */
-			wlr_log(WLR_INFO, "Output config commit failed: %s", o->name);
-			success = false;
+	}
+
+	/*
+	 * Commit all outputs at once so that the backend can apply the
+	 * new configuration in a single (atomic, with DRM) step instead of
+	 * one modeset per output.
+	 */
+	int nr_heads = wl_list_length(&config->heads);
+	bool *committed = znew_n(bool, nr_heads);
+	if (commit_heads(server, config, nr_heads)) {
+		for (int i = 0; i < nr_heads; i++) {
+			committed[i] = true;
+		}
+	} else {
+		wlr_log(WLR_INFO, "Atomic output config commit failed, "
+			"committing outputs one by one");
+		int i = 0;
+		wl_list_for_each(head, &config->heads, link) {
+			struct output *output =
+				output_from_wlr_output(server, head->state.output);
+			if (!output_state_commit(output)) {
+				/*
+				 * FIXME: This is only part of the story, we should
+				 *        revert all previously committed outputs
+				 *        as well here.
+				 *
+				 *        See https://github.com/labwc/labwc/pull/1528
+				 */
+				wlr_log(WLR_INFO, "Output config commit failed: %s",
+					head->state.output->name);
+				success = false;
+				break;
+			}
+			committed[i++] = true;
+		}
+	}
+
+	int i = 0;
+	wl_list_for_each(head, &config->heads, link) {
+		if (!committed[i++]) {
 			break;
 		}
+		struct wlr_output *o = head->state.output;
+		struct output *output = output_from_wlr_output(server, o);
+		bool output_enabled = head->state.enabled;
 
 		/*
 		 * Add or remove output from layout only if the commit went
@@ -748,58 +1186,76 @@ output_config_apply(struct server *server,
 		}
 	}
 
+	free(committed);
+
 	server->pending_output_layout_change--;
 	do_output_layout_change(server);
 	return success;
 }
 
 static bool
-verify_output_config_v1(const struct wlr_output_configuration_v1 *config)
+verify_output_config_v1(struct server *server,
+		const struct wlr_output_configuration_v1 *config)
 {
 	const char *err_msg = NULL;
+	int nr_heads = wl_list_length(&config->heads);
+	struct wlr_backend_output_state *states =
+		znew_n(struct wlr_backend_output_state, nr_heads);
+	int nr_states = 0;
+	bool ok = true;
+
 	struct wlr_output_configuration_head_v1 *head;
 	wl_list_for_each(head, &config->heads, link) {
-		if (!head->state.enabled) {
-			continue;
-		}
-
-		/* Handle custom modes */
-		if (!head->state.mode) {
+		if (head->state.enabled) {
+			/* Handle custom modes */
 			int32_t refresh = head->state.custom_mode.refresh;
-			if (wlr_output_is_wl(head->state.output) && refresh != 0) {
+			if (!head->state.mode && wlr_output_is_wl(head->state.output)
+					&& refresh != 0) {
 				/* Wayland backend does not support refresh rates */
 				err_msg = "Wayland backend refresh rates unsupported";
 				goto custom_mode_failed;
 			}
-		}
 
-		if (wlr_output_is_wl(head->state.output)
-				&& !head->state.adaptive_sync_enabled) {
-			err_msg = "Wayland backend requires adaptive sync";
-			goto custom_mode_failed;
+			if (wlr_output_is_wl(head->state.output)
+					&& !head->state.adaptive_sync_enabled) {
+				err_msg = "Wayland backend requires adaptive sync";
+				goto custom_mode_failed;
+			}
 		}
 
-		/*
-		 * Ensure the new output state can be applied on
-		 * its own and inform the client when it can not.
-		 *
-		 * Applying the changes may still fail later when
-		 * getting mixed with wlr_output->pending which
-		 * may contain further unrelated changes.
-		 */
-		struct wlr_output_state output_state;
-		wlr_output_state_init(&output_state);
-		wlr_output_head_v1_state_apply(&head->state, &output_state);
+		struct wlr_backend_output_state *state = &states[nr_states++];
+		state->output = head->state.output;
+		wlr_output_state_init(&state->base);
+		wlr_output_head_v1_state_apply(&head->state, &state->base);
 
-		if (!output_test_auto(head->state.output, &output_state,
-				/* is_client_request */ true)) {
-			wlr_output_state_finish(&output_state);
-			return false;
+		/* Pick a mode for heads which don't ask for one */
+		if (head->state.enabled && !output_state_has_mode(&state->base)
+				&& !output_test_auto(state->output, &state->base,
+					/* is_client_request */ true)) {
+			ok = false;
+			break;
 		}
-		wlr_output_state_finish(&output_state);
 	}
 
-	return true;
+	/*
+	 * Ensure the new output states can be applied together, in the
+	 * single backend commit done by output_config_apply(), and inform
+	 * the client when they can not.
+	 *
+	 * Applying the changes may still fail later when getting mixed
+	 * with wlr_output->pending which may contain further unrelated
+	 * changes.
+	 */
+	if (ok) {
+		ok = wlr_backend_test(server->backend, states, nr_states);
+	}
+
+out:
+	for (int i = 0; i < nr_states; i++) {
+		wlr_output_state_finish(&states[i].base);
+	}
+	free(states);
+	return ok;
 
 custom_mode_failed:
 	assert(err_msg);
@@ -809,15 +1265,18 @@ custom_mode_failed:
 		head->state.custom_mode.width,
 		head->state.custom_mode.height,
 		head->state.custom_mode.refresh);
-	return false;
+	ok = false;
+	goto out;
 }
 
 static void
 handle_output_manager_test(struct wl_listener *listener, void *data)
 {
+	struct server *server =
+		wl_container_of(listener, server, output_manager_test);
 	struct wlr_output_configuration_v1 *config = data;
 
-	if (verify_output_config_v1(config)) {
+	if (verify_output_config_v1(server, config)) {
 		wlr_output_configuration_v1_send_succeeded(config);
 	} else {
 		wlr_output_configuration_v1_send_failed(config);
@@ -832,7 +1291,7 @@ handle_output_manager_apply(struct wl_listener *listener, void *data)
 		wl_container_of(listener, server, output_manager_apply);
 	struct wlr_output_configuration_v1 *config = data;
 
-	bool config_is_good = verify_output_config_v1(config);
+	bool config_is_good = verify_output_config_v1(server, config);
 
 	if (config_is_good && output_config_apply(server, config)) {
 		wlr_output_configuration_v1_send_succeeded(config);
@@ -840,11 +1299,6 @@ handle_output_manager_apply(struct wl_listener *listener, void *data)
 		wlr_output_configuration_v1_send_failed(config);
 	}
 	wlr_output_configuration_v1_destroy(config);
-	struct output *output;
-	wl_list_for_each(output, &server->outputs, link) {
-		wlr_xcursor_manager_load(server->seat.xcursor_manager,
-			output->wlr_output->scale);
-	}
 
 	/* Re-set cursor image in case scale changed */
 	cursor_update_focus(server);
@@ -905,6 +1359,7 @@ do_output_layout_change(struct server *server)
 		}
 		output_update_for_layout_change(server);
 		seat_output_layout_changed(&server->seat);
+		ipc_emit(IPC_EVENT_OUTPUT);
 	}
 }
 
@@ -1072,13 +1527,10 @@ output_is_usable(struct output *output)
 	return output && output->wlr_output->enabled;
 }
 
-/* returns true if usable area changed */
-static bool
-update_usable_area(struct output *output)
+static void
+apply_struts(struct output *output)
 {
-	struct wlr_box old = output->usable_area;
-	layers_arrange(output);
-
+	output->usable_area = output->layers_usable_area;
 #if HAVE_XWAYLAND
 	struct view *view;
 	wl_list_for_each(view, &output->server->views, link) {
@@ -1089,7 +1541,31 @@ update_usable_area(struct output *output)
 		}
 	}
 #endif
-	return !wlr_box_equal(&old, &output->usable_area);
+}
+
+/* returns true if usable area changed */
+static bool
+update_usable_area(struct output *output)
+{
+	struct wlr_box old = output->usable_area;
+	layers_arrange(output);
+	output->layers_usable_area = output->usable_area;
+	apply_struts(output);
+	if (wlr_box_equal(&old, &output->usable_area)) {
+		return false;
+	}
+	output->server->usable_area_generation++;
+	return true;
+}
+
+/* Re-arrange views for a changed usable area */
+static void
+arrange_all_views(struct server *server)
+{
+	/* A pending arrangement for a layout change will pick it up */
+	if (!server->arrange_all_views_timer) {
+		desktop_arrange_all_views(server);
+	}
 }
 
 void
@@ -1100,7 +1576,7 @@ output_update_usable_area(struct output *output)
 #if HAVE_XWAYLAND
 		xwayland_update_workarea(output->server);
 #endif
-		desktop_arrange_all_views(output->server);
+		arrange_all_views(output->server);
 	}
 }
 
@@ -1110,6 +1586,9 @@ output_update_all_usable_areas(struct server *server, bool layout_changed)
 	bool usable_area_changed = false;
 	struct output *output;
 
+	if (layout_changed) {
+		server->usable_area_generation++;
+	}
 	wl_list_for_each(output, &server->outputs, link) {
 		if (update_usable_area(output)) {
 			usable_area_changed = true;
@@ -1122,7 +1601,34 @@ output_update_all_usable_areas(struct server *server, bool layout_changed)
 #if HAVE_XWAYLAND
 		xwayland_update_workarea(server);
 #endif
-		desktop_arrange_all_views(server);
+		if (layout_changed) {
+			desktop_schedule_arrange_all_views(server);
+		} else {
+			arrange_all_views(server);
+		}
+	}
+}
+
+void
+output_update_struts(struct server *server)
+{
+	/* Struts don't affect layer-shell surfaces, so skip layers_arrange() */
+	bool usable_area_changed = false;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		struct wlr_box old = output->usable_area;
+		apply_struts(output);
+		if (!wlr_box_equal(&old, &output->usable_area)) {
+			usable_area_changed = true;
+			server->usable_area_generation++;
+			regions_update_geometry(output);
+		}
+	}
+	if (usable_area_changed) {
+#if HAVE_XWAYLAND
+		xwayland_update_workarea(server);
+#endif
+		arrange_all_views(server);
 	}
 }
 
@@ -1141,6 +1647,117 @@ output_usable_area_in_layout_coords(struct output *output)
 	return box;
 }
 
+static struct wlr_box
+compute_edge_snap_box(struct wlr_box usable, enum lab_edge edge)
+{
+	int x1 = rc.gap;
+	int y1 = rc.gap;
+	int x2 = usable.width - rc.gap;
+	int y2 = usable.height - rc.gap;
+
+	if (edge & LAB_EDGE_RIGHT) {
+		x1 = (usable.width + rc.gap) / 2;
+	}
+	if (edge & LAB_EDGE_LEFT) {
+		x2 = (usable.width - rc.gap) / 2;
+	}
+	if (edge & LAB_EDGE_BOTTOM) {
+		y1 = (usable.height + rc.gap) / 2;
+	}
+	if (edge & LAB_EDGE_TOP) {
+		y2 = (usable.height - rc.gap) / 2;
+	}
+
+	return (struct wlr_box){
+		.x = x1 + usable.x,
+		.y = y1 + usable.y,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
+}
+
+void
+output_update_edge_snap_boxes(struct output *output)
+{
+	if (output->edge_snap.valid
+			&& output->edge_snap.generation
+				== output->server->usable_area_generation
+			&& output->edge_snap.gap == rc.gap) {
+		return;
+	}
+	struct wlr_box usable = output_usable_area_in_layout_coords(output);
+	for (int edge = 0; edge <= LAB_EDGES_ALL; edge++) {
+		output->edge_snap.boxes[edge] =
+			compute_edge_snap_box(usable, edge);
+	}
+	output->edge_snap.generation = output->server->usable_area_generation;
+	output->edge_snap.gap = rc.gap;
+	output->edge_snap.valid = true;
+}
+
+struct wlr_box
+output_edge_snap_box(struct output *output, enum lab_edge edge)
+{
+	if (!output || (edge & ~LAB_EDGES_ALL)) {
+		return compute_edge_snap_box(
+			output_usable_area_in_layout_coords(output), edge);
+	}
+	output_update_edge_snap_boxes(output);
+	return output->edge_snap.boxes[edge];
+}
+
+/*
+ * Free the buffers of an output that has been powered off for
+ * <core><outputReleaseDelay> seconds. The scene output and the swapchain
+ * are recreated once it is powered on again, without touching the layout.
+ */
+static int
+handle_release_timeout(void *data)
+{
+	struct output *output = data;
+	if (output->wlr_output->enabled || output->released) {
+		return 0;
+	}
+	wlr_log(WLR_INFO, "releasing buffers of powered off output %s",
+		output->wlr_output->name);
+
+	magnifier_output_released(output);
+	if (output->scene_output) {
+		wlr_scene_output_destroy(output->scene_output);
+		output->scene_output = NULL;
+	}
+	if (output->wlr_output->swapchain) {
+		wlr_swapchain_destroy(output->wlr_output->swapchain);
+		output->wlr_output->swapchain = NULL;
+	}
+	output->released = true;
+	return 0;
+}
+
+static void
+output_reacquire(struct output *output)
+{
+	struct server *server = output->server;
+	output->released = false;
+	if (output->scene_output) {
+		return;
+	}
+	struct wlr_output_layout_output *layout_output =
+		wlr_output_layout_get(server->output_layout, output->wlr_output);
+	if (!layout_output) {
+		/* Left the layout meanwhile, add_output_to_layout() takes over */
+		return;
+	}
+	output->scene_output =
+		wlr_scene_output_create(server->scene, output->wlr_output);
+	if (!output->scene_output) {
+		wlr_log(WLR_ERROR, "unable to create scene output");
+		return;
+	}
+	wlr_scene_output_layout_add_output(server->scene_layout,
+		layout_output, output->scene_output);
+}
+
 void
 handle_output_power_manager_set_mode(struct wl_listener *listener, void *data)
 {
@@ -1157,11 +1774,28 @@ handle_output_power_manager_set_mode(struct wl_listener *listener, void *data)
 		}
 		wlr_output_state_set_enabled(&output->pending, false);
 		output_state_commit(output);
+		if (rc.output_release_delay) {
+			if (!output->release_timer) {
+				output->release_timer = wl_event_loop_add_timer(
+					server->wl_event_loop,
+					handle_release_timeout, output);
+			}
+			if (output->release_timer) {
+				wl_event_source_timer_update(output->release_timer,
+					rc.output_release_delay * 1000);
+			}
+		}
 		break;
 	case ZWLR_OUTPUT_POWER_V1_MODE_ON:
 		if (event->output->enabled) {
 			return;
 		}
+		if (output->release_timer) {
+			wl_event_source_timer_update(output->release_timer, 0);
+		}
+		if (output->released) {
+			output_reacquire(output);
+		}
 		wlr_output_state_set_enabled(&output->pending, true);
 		output_state_commit(output);
 		/*
@@ -1189,13 +1823,165 @@ output_enable_adaptive_sync(struct output *output, bool enabled)
 }
 
 void
-output_set_has_fullscreen_view(struct output *output, bool has_fullscreen_view)
+output_update_adaptive_sync(struct output *output)
 {
-	if (rc.adaptive_sync != LAB_ADAPTIVE_SYNC_FULLSCREEN
-			|| !output_is_usable(output)) {
+	if (!output_is_usable(output)) {
+		return;
+	}
+
+	struct view *view = output->server->active_view;
+	enum property rule = LAB_PROP_UNSPECIFIED;
+	if (view && view->output == output) {
+		rule = window_rules_get_property(view,
+			WINDOW_RULE_PROP_ADAPTIVE_SYNC);
+	}
+
+	bool enabled;
+	if (rule == LAB_PROP_TRUE || rule == LAB_PROP_FALSE) {
+		enabled = rule == LAB_PROP_TRUE;
+		output->adaptive_sync_by_rule = true;
+	} else if (rc.adaptive_sync == LAB_ADAPTIVE_SYNC_FULLSCREEN) {
+		/* Enable adaptive sync if view is fullscreen */
+		enabled = output->has_fullscreen_view;
+		output->adaptive_sync_by_rule = false;
+	} else if (output->adaptive_sync_by_rule) {
+		/* Return to the configured mode when the window loses focus */
+		enabled = rc.adaptive_sync == LAB_ADAPTIVE_SYNC_ENABLED;
+		output->adaptive_sync_by_rule = false;
+	} else {
 		return;
 	}
-	/* Enable adaptive sync if view is fullscreen */
-	output_enable_adaptive_sync(output, has_fullscreen_view);
+
+	struct wlr_output *wlr_output = output->wlr_output;
+	bool was_enabled = wlr_output->adaptive_sync_status
+		== WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+	if (enabled == was_enabled) {
+		return;
+	}
+	output_enable_adaptive_sync(output, enabled);
 	output_state_commit(output);
+	if (was_enabled != (wlr_output->adaptive_sync_status
+			== WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)) {
+		output->stats.adaptive_sync_switches++;
+	}
+}
+
+void
+output_set_has_fullscreen_view(struct output *output, bool has_fullscreen_view)
+{
+	if (!output) {
+		return;
+	}
+	output->has_fullscreen_view = has_fullscreen_view;
+	output_update_adaptive_sync(output);
+}
+
+/* Topmost view on @output if it is fullscreen there, otherwise NULL */
+static struct view *
+get_fullscreen_view(struct output *output)
+{
+	struct view *view;
+	for_each_view(view, &output->server->views,
+			LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
+		if (view->minimized || !(view->outputs & output->id_bit)) {
+			continue;
+		}
+		return view->fullscreen && view->output == output ? view : NULL;
+	}
+	return NULL;
+}
+
+static bool
+node_is_shown(struct wlr_scene_node *node)
+{
+	int lx, ly;
+	return node && wlr_scene_node_coords(node, &lx, &ly);
+}
+
+static bool
+tree_has_shown_child(struct wlr_scene_tree *tree)
+{
+	if (!node_is_shown(&tree->node)) {
+		return false;
+	}
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->children, link) {
+		if (child->enabled) {
+			return true;
+		}
+	}
+	return false;
+}
+
+enum output_scanout
+output_get_scanout(struct output *output, struct wlr_buffer *buffer)
+{
+	struct server *server = output->server;
+	struct view *view = get_fullscreen_view(output);
+	if (!view) {
+		return OUTPUT_SCANOUT_NO_FULLSCREEN;
+	}
+	/* The scene hands client buffers to the output only for scanout */
+	if (buffer && wlr_client_buffer_get(buffer)) {
+		return OUTPUT_SCANOUT_DIRECT;
+	}
+
+	if (magnifier_is_enabled()) {
+		return OUTPUT_SCANOUT_BLOCKED_MAGNIFIER;
+	}
+	if (view->ssd) {
+		return OUTPUT_SCANOUT_BLOCKED_SSD;
+	}
+	if ((output->workspace_osd
+				&& node_is_shown(&output->workspace_osd->node))
+			|| (output->cycle_osd.tree
+				&& node_is_shown(&output->cycle_osd.tree->node))
+			|| server->menu_current
+			|| (server->seat.overlay.rect
+				&& node_is_shown(&server->seat.overlay.rect->tree->node))) {
+		return OUTPUT_SCANOUT_BLOCKED_OVERLAY;
+	}
+	if (tree_has_shown_child(
+				output->layer_tree[ZWLR_LAYER_SHELL_V1_LAYER_TOP])
+			|| tree_has_shown_child(
+				output->layer_tree[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY])
+			|| tree_has_shown_child(output->layer_popup_tree)) {
+		return OUTPUT_SCANOUT_BLOCKED_LAYER_SURFACE;
+	}
+
+	struct wlr_box output_box;
+	wlr_output_layout_get_box(server->output_layout, output->wlr_output,
+		&output_box);
+	struct wlr_box view_box = view->current;
+	if (view_box.x > output_box.x || view_box.y > output_box.y
+			|| view_box.x + view_box.width
+				< output_box.x + output_box.width
+			|| view_box.y + view_box.height
+				< output_box.y + output_box.height) {
+		return OUTPUT_SCANOUT_BLOCKED_LETTERBOX;
+	}
+	return OUTPUT_SCANOUT_BLOCKED_BUFFER;
+}
+
+bool
+output_hides_overlays(struct output *output)
+{
+	struct view *view = output->server->active_view;
+	return rc.hide_overlays_on_fullscreen && view && view->fullscreen
+		&& view->output == output;
+}
+
+void
+output_update_overlays(struct server *server)
+{
+	if (!rc.hide_overlays_on_fullscreen) {
+		return;
+	}
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output->workspace_osd && output_hides_overlays(output)) {
+			wlr_scene_node_set_enabled(&output->workspace_osd->node,
+				false);
+		}
+	}
 }
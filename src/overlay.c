@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include "common/lab-scene-rect.h"
+#include "common/macros.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "output.h"
@@ -13,14 +14,21 @@
 #include "view.h"
 
 static void
-show_overlay(struct seat *seat, struct theme_snapping_overlay *overlay_theme,
-		struct wlr_box *box)
+handle_rect_destroy(struct wl_listener *listener, void *data)
 {
-	struct server *server = seat->server;
-	struct view *view = server->grabbed_view;
-	assert(view);
-	assert(!seat->overlay.rect);
+	struct overlay_rect *cached = wl_container_of(listener, cached, destroy);
+	if (cached->overlay->rect == cached->rect) {
+		cached->overlay->rect = NULL;
+	}
+	cached->rect = NULL;
+	wl_list_remove(&cached->destroy.link);
+}
 
+static void
+create_rect(struct overlay_rect *cached, struct overlay *overlay,
+		struct theme_snapping_overlay *overlay_theme,
+		struct wlr_scene_tree *parent, struct wlr_box *box)
+{
 	struct lab_scene_rect_options opts = {
 		.width = box->width,
 		.height = box->height,
@@ -41,8 +49,32 @@ show_overlay(struct seat *seat, struct theme_snapping_overlay *overlay_theme,
 		opts.border_width = overlay_theme->border_width;
 	}
 
-	seat->overlay.rect =
-		lab_scene_rect_create(view->scene_tree->node.parent, &opts);
+	cached->rect = lab_scene_rect_create(parent, &opts);
+	cached->overlay = overlay;
+	cached->destroy.notify = handle_rect_destroy;
+	wl_signal_add(&cached->rect->tree->node.events.destroy,
+		&cached->destroy);
+}
+
+static void
+show_overlay(struct seat *seat, struct theme_snapping_overlay *overlay_theme,
+		struct overlay_rect *cached, struct wlr_box *box)
+{
+	struct server *server = seat->server;
+	struct view *view = server->grabbed_view;
+	assert(view);
+	assert(!seat->overlay.rect);
+
+	struct wlr_scene_tree *parent = view->scene_tree->node.parent;
+	if (!cached->rect) {
+		create_rect(cached, &seat->overlay, overlay_theme, parent, box);
+	} else {
+		/* Only a node update when moving between snap targets */
+		wlr_scene_node_reparent(&cached->rect->tree->node, parent);
+		lab_scene_rect_set_size(cached->rect, box->width, box->height);
+		wlr_scene_node_set_enabled(&cached->rect->tree->node, true);
+	}
+	seat->overlay.rect = cached->rect;
 
 	struct wlr_scene_node *node = &seat->overlay.rect->tree->node;
 	wlr_scene_node_place_below(node, &view->scene_tree->node);
@@ -59,7 +91,8 @@ show_region_overlay(struct seat *seat, struct region *region)
 	seat->overlay.active.region = region;
 
 	struct wlr_box geo = view_get_region_snap_box(NULL, region);
-	show_overlay(seat, &rc.theme->snapping_overlay_region, &geo);
+	show_overlay(seat, &rc.theme->snapping_overlay_region,
+		&seat->overlay.region_rect, &geo);
 }
 
 static struct wlr_box
@@ -80,7 +113,8 @@ handle_edge_overlay_timeout(void *data)
 		&& seat->overlay.active.output);
 	struct wlr_box box = get_edge_snap_box(seat->overlay.active.edge,
 		seat->overlay.active.output);
-	show_overlay(seat, &rc.theme->snapping_overlay_edge, &box);
+	show_overlay(seat, &rc.theme->snapping_overlay_edge,
+		&seat->overlay.edge_rect, &box);
 	return 0;
 }
 
@@ -163,11 +197,32 @@ overlay_update(struct seat *seat)
 void
 overlay_finish(struct seat *seat)
 {
-	if (seat->overlay.rect) {
-		wlr_scene_node_destroy(&seat->overlay.rect->tree->node);
+	struct overlay *overlay = &seat->overlay;
+	if (overlay->rect) {
+		wlr_scene_node_set_enabled(&overlay->rect->tree->node, false);
+		overlay->rect = NULL;
+	}
+	if (overlay->timer) {
+		wl_event_source_remove(overlay->timer);
+		overlay->timer = NULL;
 	}
-	if (seat->overlay.timer) {
-		wl_event_source_remove(seat->overlay.timer);
+	overlay->active.region = NULL;
+	overlay->active.edge = LAB_EDGE_NONE;
+	overlay->active.output = NULL;
+}
+
+void
+overlay_reset(struct seat *seat)
+{
+	overlay_finish(seat);
+	struct overlay_rect *rects[] = {
+		&seat->overlay.region_rect,
+		&seat->overlay.edge_rect,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(rects); i++) {
+		if (rects[i]->rect) {
+			/* Clears rects[i]->rect, see handle_rect_destroy() */
+			wlr_scene_node_destroy(&rects[i]->rect->tree->node);
+		}
 	}
-	seat->overlay = (struct overlay){0};
 }
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <assert.h>
+#include <string.h>
 #include <wlr/util/log.h>
 #include "common/array.h"
 #include "common/mem.h"
@@ -13,8 +14,6 @@
  *	.--------------------.
  *	|        TODO        |
  *	|--------------------|
- *	| - prevent empty    |
- *	|   done events      |
  *	| - go through xml   |
  *	|   and verify impl  |
  *	| - assert pub API   |
@@ -37,6 +36,8 @@
 #define ZCOSMIC_CAP_WS_REMOVE \
 	ZCOSMIC_WORKSPACE_HANDLE_V1_ZCOSMIC_WORKSPACE_CAPABILITIES_V1_REMOVE
 
+static void manager_schedule_idle(struct lab_cosmic_workspace_manager *manager);
+
 enum workspace_state {
 	CW_WS_STATE_ACTIVE  = 1 << 0,
 	CW_WS_STATE_URGENT  = 1 << 1,
@@ -218,7 +219,7 @@ workspace_set_state(struct lab_cosmic_workspace *workspace,
 	} else {
 		workspace->state_pending &= ~state;
 	}
-	cosmic_manager_schedule_done_event(workspace->group->manager);
+	manager_schedule_idle(workspace->group->manager);
 }
 
 /* Group */
@@ -442,6 +443,7 @@ static void
 manager_idle_send_done(void *data)
 {
 	struct lab_cosmic_workspace_manager *manager = data;
+	bool changed = manager->dirty;
 
 	struct lab_cosmic_workspace *workspace;
 	struct lab_cosmic_workspace_group *group;
@@ -450,20 +452,25 @@ manager_idle_send_done(void *data)
 			if (workspace->state != workspace->state_pending) {
 				workspace->state = workspace->state_pending;
 				workspace_send_state(workspace, /*target*/ NULL);
+				changed = true;
 			}
 		}
 	}
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &manager->resources) {
-		zcosmic_workspace_manager_v1_send_done(resource);
+	/* States toggled back and forth need no done event */
+	if (changed) {
+		struct wl_resource *resource;
+		wl_resource_for_each(resource, &manager->resources) {
+			zcosmic_workspace_manager_v1_send_done(resource);
+		}
 	}
+	manager->dirty = false;
 	manager->idle_source = NULL;
 }
 
-/* Internal API */
-void
-cosmic_manager_schedule_done_event(struct lab_cosmic_workspace_manager *manager)
+/* Flush pending workspace states and send done once the event loop is idle */
+static void
+manager_schedule_idle(struct lab_cosmic_workspace_manager *manager)
 {
 	if (manager->idle_source) {
 		return;
@@ -475,6 +482,14 @@ cosmic_manager_schedule_done_event(struct lab_cosmic_workspace_manager *manager)
 		manager->event_loop, manager_idle_send_done, manager);
 }
 
+/* Internal API */
+void
+cosmic_manager_schedule_done_event(struct lab_cosmic_workspace_manager *manager)
+{
+	manager->dirty = true;
+	manager_schedule_idle(manager);
+}
+
 /* Public API */
 struct lab_cosmic_workspace_manager *
 lab_cosmic_workspace_manager_create(struct wl_display *display, uint32_t caps, uint32_t version)
@@ -637,8 +652,8 @@ lab_cosmic_workspace_set_name(struct lab_cosmic_workspace *workspace, const char
 		wl_resource_for_each(resource, &workspace->resources) {
 			zcosmic_workspace_handle_v1_send_name(resource, workspace->name);
 		}
+		cosmic_manager_schedule_done_event(workspace->group->manager);
 	}
-	cosmic_manager_schedule_done_event(workspace->group->manager);
 }
 
 void
@@ -663,6 +678,12 @@ void
 lab_cosmic_workspace_set_coordinates(struct lab_cosmic_workspace *workspace,
 		struct wl_array *coordinates)
 {
+	if (workspace->coordinates.size == coordinates->size
+			&& !memcmp(workspace->coordinates.data, coordinates->data,
+				coordinates->size)) {
+		return;
+	}
+
 	wl_array_release(&workspace->coordinates);
 	wl_array_init(&workspace->coordinates);
 	wl_array_copy(&workspace->coordinates, coordinates);
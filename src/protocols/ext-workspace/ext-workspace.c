@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <assert.h>
+#include <string.h>
 #include <wlr/util/log.h>
 #include "common/mem.h"
 #include "common/list.h"
@@ -30,6 +31,8 @@
  */
 #define WS_STATE_INVALID 0xffffffff
 
+static void manager_schedule_idle(struct lab_ext_workspace_manager *manager);
+
 struct ws_create_workspace_event {
 	char *name;
 	struct {
@@ -189,7 +192,7 @@ workspace_set_state(struct lab_ext_workspace *workspace,
 	} else {
 		workspace->state_pending &= ~state;
 	}
-	ext_manager_schedule_done_event(workspace->manager);
+	manager_schedule_idle(workspace->manager);
 }
 
 /* Group */
@@ -436,25 +439,35 @@ static void
 manager_idle_send_done(void *data)
 {
 	struct lab_ext_workspace_manager *manager = data;
+	bool changed = manager->dirty;
 
 	struct lab_ext_workspace *workspace;
 	wl_list_for_each(workspace, &manager->workspaces, link) {
 		if (workspace->state != workspace->state_pending) {
 			workspace->state = workspace->state_pending;
 			workspace_send_state(workspace, /*target*/ NULL);
+			changed = true;
 		}
 	}
 
-	struct wl_resource *resource;
-	wl_resource_for_each(resource, &manager->resources) {
-		ext_workspace_manager_v1_send_done(resource);
+	/*
+	 * States toggled back and forth within one event loop iteration,
+	 * e.g. when switching away from a workspace and back again, end
+	 * up unchanged and need no done event.
+	 */
+	if (changed) {
+		struct wl_resource *resource;
+		wl_resource_for_each(resource, &manager->resources) {
+			ext_workspace_manager_v1_send_done(resource);
+		}
 	}
+	manager->dirty = false;
 	manager->idle_source = NULL;
 }
 
-/* Internal API */
-void
-ext_manager_schedule_done_event(struct lab_ext_workspace_manager *manager)
+/* Flush pending workspace states and send done once the event loop is idle */
+static void
+manager_schedule_idle(struct lab_ext_workspace_manager *manager)
 {
 	if (manager->idle_source) {
 		return;
@@ -466,6 +479,14 @@ ext_manager_schedule_done_event(struct lab_ext_workspace_manager *manager)
 		manager->event_loop, manager_idle_send_done, manager);
 }
 
+/* Internal API */
+void
+ext_manager_schedule_done_event(struct lab_ext_workspace_manager *manager)
+{
+	manager->dirty = true;
+	manager_schedule_idle(manager);
+}
+
 static void
 send_group_workspace_event(struct lab_ext_workspace_group *group,
 		struct lab_ext_workspace *workspace,
@@ -676,8 +697,8 @@ lab_ext_workspace_set_name(struct lab_ext_workspace *workspace, const char *name
 		wl_resource_for_each(resource, &workspace->resources) {
 			ext_workspace_handle_v1_send_name(resource, workspace->name);
 		}
+		ext_manager_schedule_done_event(workspace->manager);
 	}
-	ext_manager_schedule_done_event(workspace->manager);
 }
 
 void
@@ -708,6 +729,12 @@ lab_ext_workspace_set_coordinates(struct lab_ext_workspace *workspace,
 	assert(workspace);
 	assert(coordinates);
 
+	if (workspace->coordinates.size == coordinates->size
+			&& !memcmp(workspace->coordinates.data, coordinates->data,
+				coordinates->size)) {
+		return;
+	}
+
 	wl_array_release(&workspace->coordinates);
 	wl_array_init(&workspace->coordinates);
 	wl_array_copy(&workspace->coordinates, coordinates);
@@ -5,9 +5,11 @@
 #include <assert.h>
 #include <float.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/util/box.h>
+#include "common/array.h"
 #include "common/list.h"
 #include "common/mem.h"
 #include "config/rcxml.h"
@@ -43,6 +45,113 @@ regions_from_name(const char *region_name, struct output *output)
 	return NULL;
 }
 
+/* Index of the interval [edges[i], edges[i + 1]) containing @val, or -1 */
+static int
+find_interval(const int *edges, int nr_edges, double val)
+{
+	if (nr_edges < 2 || val < edges[0] || val >= edges[nr_edges - 1]) {
+		return -1;
+	}
+	int l = 0;
+	int r = nr_edges - 1;
+	while (r - l > 1) {
+		int m = (l + r) / 2;
+		if (edges[m] > val) {
+			r = m;
+		} else {
+			l = m;
+		}
+	}
+	return l;
+}
+
+static int
+compare_ints(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* Sort and de-duplicate @edges, returning the number of unique ones */
+static int
+order_edges(int *edges, int nr_edges)
+{
+	qsort(edges, nr_edges, sizeof(int), compare_ints);
+	int n = 0;
+	for (int i = 0; i < nr_edges; i++) {
+		if (!n || edges[i] != edges[n - 1]) {
+			edges[n++] = edges[i];
+		}
+	}
+	return n;
+}
+
+void
+regions_index_finish(struct output *output)
+{
+	struct region_index *index = &output->region_index;
+	zfree(index->cols);
+	zfree(index->rows);
+	zfree(index->starts);
+	zfree(index->candidates);
+	index->nr_cols = 0;
+	index->nr_rows = 0;
+}
+
+static void
+build_index(struct output *output)
+{
+	regions_index_finish(output);
+	int nr_regions = wl_list_length(&output->regions);
+	if (!nr_regions) {
+		return;
+	}
+
+	struct region_index *index = &output->region_index;
+	index->cols = xzalloc(2 * nr_regions * sizeof(int));
+	index->rows = xzalloc(2 * nr_regions * sizeof(int));
+	struct region *region;
+	int n = 0;
+	wl_list_for_each(region, &output->regions, link) {
+		index->cols[n] = region->geo.x;
+		index->rows[n++] = region->geo.y;
+		index->cols[n] = region->geo.x + region->geo.width;
+		index->rows[n++] = region->geo.y + region->geo.height;
+	}
+	index->nr_cols = order_edges(index->cols, n);
+	index->nr_rows = order_edges(index->rows, n);
+
+	/*
+	 * Regions usually don't overlap, so each of them covers a separate
+	 * set of cells and the candidates add up to about the number of cells
+	 */
+	int nr_cells = (index->nr_cols - 1) * (index->nr_rows - 1);
+	index->starts = xzalloc((nr_cells + 1) * sizeof(int));
+	struct wl_array candidates;
+	wl_array_init(&candidates);
+	for (int i = 0; i < index->nr_rows - 1; i++) {
+		for (int j = 0; j < index->nr_cols - 1; j++) {
+			index->starts[i * (index->nr_cols - 1) + j] =
+				candidates.size / sizeof(struct region *);
+			struct wlr_box cell = {
+				.x = index->cols[j],
+				.y = index->rows[i],
+				.width = index->cols[j + 1] - index->cols[j],
+				.height = index->rows[i + 1] - index->rows[i],
+			};
+			wl_list_for_each(region, &output->regions, link) {
+				struct wlr_box intersection;
+				if (wlr_box_intersection(&intersection,
+						&region->geo, &cell)) {
+					array_add(&candidates, region);
+				}
+			}
+		}
+	}
+	index->starts[nr_cells] = candidates.size / sizeof(struct region *);
+	/* Owned by the index from now on */
+	index->candidates = candidates.data;
+}
+
 struct region *
 regions_from_cursor(struct server *server)
 {
@@ -57,18 +166,25 @@ regions_from_cursor(struct server *server)
 		return NULL;
 	}
 
+	const struct region_index *index = &output->region_index;
+	int col = find_interval(index->cols, index->nr_cols, lx);
+	int row = find_interval(index->rows, index->nr_rows, ly);
+	if (col < 0 || row < 0) {
+		return NULL;
+	}
+	int cell = row * (index->nr_cols - 1) + col;
+
+	/* Of overlapping regions, choose the one with the closest center */
 	double dist;
 	double dist_min = DBL_MAX;
 	struct region *closest_region = NULL;
-	struct region *region;
-	wl_list_for_each(region, &output->regions, link) {
-		if (wlr_box_contains_point(&region->geo, lx, ly)) {
-			/* No need for sqrt((x1 - x2)^2 + (y1 - y2)^2) as we just compare */
-			dist = pow(region->center.x - lx, 2) + pow(region->center.y - ly, 2);
-			if (dist < dist_min) {
-				closest_region = region;
-				dist_min = dist;
-			}
+	for (int i = index->starts[cell]; i < index->starts[cell + 1]; i++) {
+		struct region *region = index->candidates[i];
+		/* No need for sqrt((x1 - x2)^2 + (y1 - y2)^2) as we just compare */
+		dist = pow(region->center.x - lx, 2) + pow(region->center.y - ly, 2);
+		if (dist < dist_min) {
+			closest_region = region;
+			dist_min = dist;
 		}
 	}
 	return closest_region;
@@ -114,6 +230,42 @@ regions_reconfigure(struct server *server)
 	desktop_arrange_all_views(server);
 }
 
+static void
+update_snap_box(struct region *region, const struct wlr_box *usable)
+{
+	struct wlr_box *geo = &region->snap_box;
+	*geo = region->geo;
+	if (!rc.gap) {
+		return;
+	}
+
+	double half_gap = rc.gap / 2.0;
+	struct wlr_fbox offset = {
+		.x = half_gap,
+		.y = half_gap,
+		.width = -rc.gap,
+		.height = -rc.gap
+	};
+	if (geo->x == usable->x) {
+		offset.x += half_gap;
+		offset.width -= half_gap;
+	}
+	if (geo->y == usable->y) {
+		offset.y += half_gap;
+		offset.height -= half_gap;
+	}
+	if (geo->x + geo->width == usable->x + usable->width) {
+		offset.width -= half_gap;
+	}
+	if (geo->y + geo->height == usable->y + usable->height) {
+		offset.height -= half_gap;
+	}
+	geo->x += offset.x;
+	geo->y += offset.y;
+	geo->width += offset.width;
+	geo->height += offset.height;
+}
+
 void
 regions_update_geometry(struct output *output)
 {
@@ -142,7 +294,9 @@ regions_update_geometry(struct output *output)
 		geo->height = bottom - top;
 		region->center.x = geo->x + geo->width / 2;
 		region->center.y = geo->y + geo->height / 2;
+		update_snap_box(region, &usable);
 	}
+	build_index(output);
 }
 
 void
@@ -143,8 +143,8 @@ resistance_move_apply(struct view *view, int *x, int *y)
 
 	if (rc.window_edge_strength != 0) {
 		/* Find any relevant window edges encountered by this move */
-		edges_find_neighbors(&next_edges, view, view->current, target,
-			NULL, check_edge_window, /* ignore_hidden */ true);
+		edges_find_neighbors_near(&next_edges, view, view->current,
+			target, abs(rc.window_edge_strength), check_edge_window);
 	}
 
 	/* If any "best" edges were encountered during this move, snap motion */
@@ -177,8 +177,8 @@ resistance_resize_apply(struct view *view, struct wlr_box *new_geom)
 
 	if (rc.window_edge_strength != 0) {
 		/* Find any relevant window edges encountered by this move */
-		edges_find_neighbors(&next_edges, view, origin, *new_geom,
-			NULL, check_edge_window, /* ignore_hidden */ true);
+		edges_find_neighbors_near(&next_edges, view, origin, *new_geom,
+			abs(rc.window_edge_strength), check_edge_window);
 	}
 
 	/* If any "best" edges were encountered during this move, snap motion */
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "resize-snapshot.h"
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_scene.h>
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "view.h"
+
+struct snapshot_context {
+	struct wlr_scene_tree *tree;
+	double scale_x, scale_y;
+};
+
+static void
+copy_buffer(struct wlr_scene_buffer *buffer, int sx, int sy, void *data)
+{
+	struct snapshot_context *ctx = data;
+	if (!buffer->buffer) {
+		return;
+	}
+
+	/* Surface buffers always have a destination size set by the scene */
+	int width = buffer->dst_width ? buffer->dst_width : buffer->buffer->width;
+	int height = buffer->dst_height ? buffer->dst_height : buffer->buffer->height;
+
+	int x = lround(sx * ctx->scale_x);
+	int y = lround(sy * ctx->scale_y);
+	int dst_width = lround((sx + width) * ctx->scale_x) - x;
+	int dst_height = lround((sy + height) * ctx->scale_y) - y;
+	if (dst_width <= 0 || dst_height <= 0) {
+		return;
+	}
+
+	struct wlr_scene_buffer *copy =
+		wlr_scene_buffer_create(ctx->tree, buffer->buffer);
+	if (!copy) {
+		return;
+	}
+	wlr_scene_buffer_set_source_box(copy, &buffer->src_box);
+	wlr_scene_buffer_set_dest_size(copy, dst_width, dst_height);
+	wlr_scene_buffer_set_transform(copy, buffer->transform);
+	wlr_scene_buffer_set_opacity(copy, buffer->opacity);
+	wlr_scene_buffer_set_filter_mode(copy, buffer->filter_mode);
+	wlr_scene_node_set_position(&copy->node, x, y);
+}
+
+static void
+send_frame_done(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	wlr_surface_send_frame_done(surface, data);
+}
+
+void
+resize_snapshot_update(struct view *view)
+{
+	if (!rc.resize_snapshot || !view->mapped || !view->content_tree
+			|| !view->surface || view->shaded) {
+		return;
+	}
+	struct wlr_box *current = &view->current;
+	struct wlr_box *pending = &view->pending;
+	if (wlr_box_empty(current) || wlr_box_empty(pending)) {
+		return;
+	}
+
+	/*
+	 * Always copy from the surfaces rather than from an earlier
+	 * snapshot, so that commits for intermediate sizes are picked up.
+	 * The scene does not iterate disabled nodes.
+	 */
+	if (view->resize_snapshot) {
+		wlr_scene_node_destroy(&view->resize_snapshot->node);
+		view->resize_snapshot = NULL;
+		wlr_scene_node_set_enabled(&view->content_tree->node, true);
+	}
+
+	struct snapshot_context ctx = {
+		.tree = wlr_scene_tree_create(view->scene_tree),
+		.scale_x = (double)pending->width / current->width,
+		.scale_y = (double)pending->height / current->height,
+	};
+	if (!ctx.tree) {
+		return;
+	}
+	wlr_scene_node_for_each_buffer(&view->content_tree->node,
+		copy_buffer, &ctx);
+	wlr_scene_node_place_above(&ctx.tree->node, &view->content_tree->node);
+	/* The scene tree of the view follows the committed geometry */
+	wlr_scene_node_set_position(&ctx.tree->node,
+		pending->x - current->x, pending->y - current->y);
+	wlr_scene_node_set_enabled(&view->content_tree->node, false);
+	view->resize_snapshot = ctx.tree;
+
+	/*
+	 * Hidden surfaces get no frame callbacks from the scene. Send one
+	 * now so that clients waiting for it render the new size.
+	 */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wlr_surface_for_each_surface(view->surface, send_frame_done, &now);
+}
+
+void
+resize_snapshot_finish(struct view *view)
+{
+	if (!view->resize_snapshot) {
+		return;
+	}
+	wlr_scene_node_destroy(&view->resize_snapshot->node);
+	view->resize_snapshot = NULL;
+	if (view->content_tree) {
+		wlr_scene_node_set_enabled(&view->content_tree->node,
+			!view->shaded);
+	}
+}
@@ -2,17 +2,25 @@
 #define _POSIX_C_SOURCE 200809L
 #include "scaled-buffer/scaled-buffer.h"
 #include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
 #include "buffer.h"
+#include "common/hash.h"
 #include "common/list.h"
 #include "common/macros.h"
 #include "common/mem.h"
+#include "common/scene-helpers.h"
+#include "config/rcxml.h"
+#include "metrics.h"
 #include "node.h"
+#include "timer.h"
 
 /*
  * This holds all the scaled_buffers from all the implementers.
@@ -20,10 +28,124 @@
  */
 static struct wl_list all_scaled_buffers = WL_LIST_INIT(&all_scaled_buffers);
 
+/*
+ * Hash table of the cache entries of all scaled_buffers whose impl provides
+ * hash(), keyed by (impl, hash, scale). The number of buckets is a power of
+ * two and doubles whenever there are more than two entries per bucket.
+ */
+static struct {
+	struct wl_list *buckets; /* struct scaled_buffer_cache_entry.shared_link */
+	size_t nr_buckets;
+	size_t nr_entries;
+} shared;
+
+#define SHARED_MIN_BUCKETS 64
+
+/*
+ * All cache entries of all scaled_buffers, recently used in front. Entries
+ * are evicted from the back while the buffers they rendered exceed
+ * rc.scaled_buffer_cache_size, except for those currently shown.
+ */
+static struct wl_list lru = WL_LIST_INIT(&lru);
+static struct scaled_buffer_stats stats;
+
+/*
+ * With <core><prerenderScales>, scaled_buffers that got a new active scale
+ * are queued to also render buffers for the other output scales, a few at
+ * a time, so that moving a window to another output hits the cache.
+ */
+#define PRERENDER_MAX_SCALES 8
+#define PRERENDER_BATCH 8
+#define PRERENDER_DELAY_MS 1
+
+static struct {
+	double scales[PRERENDER_MAX_SCALES];
+	int nr_scales;
+	struct wl_list queue; /* struct scaled_buffer.prerender_link */
+	struct lab_timer *timer;
+} prerender = { .queue = WL_LIST_INIT(&prerender.queue) };
+
+static struct wl_list *
+shared_bucket(struct wl_list *buckets, size_t nr_buckets,
+		const struct scaled_buffer_impl *impl, uint64_t hash, double scale)
+{
+	uint64_t key = hash_add(hash, &impl, sizeof(impl));
+	key = hash_add(key, &scale, sizeof(scale));
+	return &buckets[key & (nr_buckets - 1)];
+}
+
+static void
+shared_resize(size_t nr_buckets)
+{
+	struct wl_list *buckets = znew_n(struct wl_list, nr_buckets);
+	for (size_t i = 0; i < nr_buckets; i++) {
+		wl_list_init(&buckets[i]);
+	}
+	for (size_t i = 0; i < shared.nr_buckets; i++) {
+		struct scaled_buffer_cache_entry *entry, *tmp;
+		wl_list_for_each_safe(entry, tmp, &shared.buckets[i], shared_link) {
+			wl_list_remove(&entry->shared_link);
+			wl_list_insert(shared_bucket(buckets, nr_buckets,
+					entry->owner->impl, entry->hash,
+					entry->scale),
+				&entry->shared_link);
+		}
+	}
+	free(shared.buckets);
+	shared.buckets = buckets;
+	shared.nr_buckets = nr_buckets;
+}
+
+static void
+shared_insert(struct scaled_buffer_cache_entry *entry)
+{
+	if (shared.nr_entries >= shared.nr_buckets * 2) {
+		shared_resize(MAX(shared.nr_buckets * 2, SHARED_MIN_BUCKETS));
+	}
+	wl_list_insert(shared_bucket(shared.buckets, shared.nr_buckets,
+			entry->owner->impl, entry->hash, entry->scale),
+		&entry->shared_link);
+	shared.nr_entries++;
+}
+
+static void
+shared_remove(struct scaled_buffer_cache_entry *entry)
+{
+	if (wl_list_empty(&entry->shared_link)) {
+		return;
+	}
+	wl_list_remove(&entry->shared_link);
+	wl_list_init(&entry->shared_link);
+	shared.nr_entries--;
+}
+
+static struct scaled_buffer_cache_entry *
+shared_find(struct scaled_buffer *self, uint64_t hash, double scale)
+{
+	if (!shared.nr_entries) {
+		return NULL;
+	}
+	struct wl_list *bucket = shared_bucket(shared.buckets,
+		shared.nr_buckets, self->impl, hash, scale);
+	struct scaled_buffer_cache_entry *entry;
+	wl_list_for_each(entry, bucket, shared_link) {
+		if (entry->owner != self && entry->owner->impl == self->impl
+				&& entry->hash == hash && entry->scale == scale
+				&& (!self->impl->equal
+					|| self->impl->equal(self, entry->owner))) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
 /* Internal API */
 static void
 _cache_entry_destroy(struct scaled_buffer_cache_entry *cache_entry, bool drop_buffer)
 {
+	shared_remove(cache_entry);
+	wl_list_remove(&cache_entry->lru_link);
+	stats.bytes -= cache_entry->bytes;
 	wl_list_remove(&cache_entry->link);
 	if (cache_entry->buffer) {
 		/* Allow the buffer to get dropped if there are no further consumers */
@@ -48,29 +170,100 @@ find_cache_for_scale(struct scaled_buffer *scene_buffer, double scale)
 }
 
 static void
-_update_buffer(struct scaled_buffer *self, double scale)
+cache_trim(void)
 {
-	self->active_scale = scale;
+	size_t budget = (size_t)rc.scaled_buffer_cache_size << 20;
+	struct scaled_buffer_cache_entry *entry, *tmp;
+	wl_list_for_each_reverse_safe(entry, tmp, &lru, lru_link) {
+		if (stats.bytes <= budget) {
+			break;
+		}
+		if (!entry->bytes || entry->scale == entry->owner->active_scale) {
+			continue;
+		}
+		_cache_entry_destroy(entry, entry->owner->drop_buffer);
+		stats.evictions++;
+	}
+}
 
-	/* Search for cached buffer of specified scale */
-	struct scaled_buffer_cache_entry *cache_entry =
-		find_cache_for_scale(self, scale);
-	if (cache_entry) {
-		/* LRU cache, recently used in front */
-		wl_list_remove(&cache_entry->link);
-		wl_list_insert(&self->cache, &cache_entry->link);
-		wlr_scene_buffer_set_buffer(self->scene_buffer, cache_entry->buffer);
-		/*
-		 * If found in our local cache,
-		 * - self->width and self->height are already set
-		 * - wlr_scene_buffer_set_dest_size() has already been called
-		 */
-		return;
+void
+scaled_buffer_cache_shrink(void)
+{
+	struct scaled_buffer_cache_entry *entry, *tmp;
+	wl_list_for_each_reverse_safe(entry, tmp, &lru, lru_link) {
+		if (!entry->bytes || entry->scale == entry->owner->active_scale) {
+			continue;
+		}
+		_cache_entry_destroy(entry, entry->owner->drop_buffer);
+		stats.evictions++;
+	}
+}
+
+/*
+ * The impl is rendering the buffer asynchronously and hands it over via
+ * scaled_buffer_set_pending_buffer(). Until then, the scene buffer keeps
+ * showing its previous buffer, if any.
+ */
+static struct scaled_buffer_cache_entry *
+add_pending_entry(struct scaled_buffer *self, double scale)
+{
+	self->pending = false;
+	struct scaled_buffer_cache_entry *cache_entry = znew(*cache_entry);
+	cache_entry->owner = self;
+	cache_entry->scale = scale;
+	cache_entry->pending = true;
+	wl_list_init(&cache_entry->shared_link);
+	wl_list_insert(&self->cache, &cache_entry->link);
+	wl_list_insert(&lru, &cache_entry->lru_link);
+	return cache_entry;
+}
+
+/* Show the buffer at its logical size, or only the left crop_width of it */
+static void
+set_dest_size(struct scaled_buffer *self)
+{
+	struct wlr_buffer *buffer = self->scene_buffer->buffer;
+	if (buffer && self->crop_width > 0 && self->crop_width < self->width) {
+		struct wlr_fbox src_box = {
+			.width = (double)buffer->width * self->crop_width
+				/ self->width,
+			.height = buffer->height,
+		};
+		wlr_scene_buffer_set_source_box(self->scene_buffer, &src_box);
+		wlr_scene_buffer_set_dest_size(self->scene_buffer,
+			self->crop_width, self->height);
+	} else {
+		wlr_scene_buffer_set_source_box(self->scene_buffer, NULL);
+		wlr_scene_buffer_set_dest_size(self->scene_buffer,
+			self->width, self->height);
 	}
+	lab_wlr_scene_buffer_update_opaque_region(self->scene_buffer);
+}
 
+/*
+ * Render a new cache entry or share the buffer of another scaled_buffer.
+ * The entry is pending if the impl renders it asynchronously.
+ */
+static struct scaled_buffer_cache_entry *
+render_entry(struct scaled_buffer *self, double scale)
+{
+	struct scaled_buffer_cache_entry *cache_entry = NULL;
 	struct wlr_buffer *wlr_buffer = NULL;
 
-	if (self->impl->equal) {
+	/* Buffers of invalidated scaled_buffers are not shared with others */
+	bool sharing = !wl_list_empty(&self->link);
+	uint64_t hash = 0;
+
+	if (self->impl->hash) {
+		hash = self->impl->hash(self);
+		cache_entry = shared_find(self, hash, scale);
+		if (cache_entry) {
+			/* Ensure self->width and self->height are set correctly */
+			self->width = cache_entry->owner->width;
+			self->height = cache_entry->owner->height;
+			wlr_buffer = cache_entry->buffer;
+		}
+	} else if (self->impl->equal) {
 		/* Search from other cached scaled-buffers */
 		struct scaled_buffer *scene_buffer;
 		wl_list_for_each(scene_buffer, &all_scaled_buffers, link) {
@@ -96,17 +289,27 @@ _update_buffer(struct scaled_buffer *self, double scale)
 		}
 	}
 
-	if (!wlr_buffer) {
+	size_t bytes = 0;
+	if (wlr_buffer) {
+		stats.hits++;
+	} else {
 		/*
 		 * Create new buffer, will get destroyed along the backing
 		 * wlr_buffer
 		 */
+		stats.misses++;
 		struct lab_data_buffer *buffer =
 			self->impl->create_buffer(self, scale);
+		if (self->pending) {
+			assert(!buffer);
+			return add_pending_entry(self, scale);
+		}
 		if (buffer) {
+			buffer_set_category(buffer, self->category);
 			self->width = buffer->logical_width;
 			self->height = buffer->logical_height;
 			wlr_buffer = &buffer->base;
+			bytes = (size_t)buffer->base.width * buffer->base.height * 4;
 		} else {
 			self->width = 0;
 			self->height = 0;
@@ -117,29 +320,125 @@ _update_buffer(struct scaled_buffer *self, double scale)
 		wlr_buffer_lock(wlr_buffer);
 	}
 
-	/* Create or reuse cache entry */
-	if (wl_list_length(&self->cache) < LAB_SCALED_BUFFER_MAX_CACHE) {
-		cache_entry = znew(*cache_entry);
-	} else {
-		cache_entry = wl_container_of(self->cache.prev, cache_entry, link);
-		if (cache_entry->buffer) {
-			/* Allow the old buffer to get dropped if there are no further consumers */
-			if (self->drop_buffer && !cache_entry->buffer->dropped) {
-				wlr_buffer_drop(cache_entry->buffer);
+	/* Create the cache entry */
+	cache_entry = znew(*cache_entry);
+	cache_entry->owner = self;
+	cache_entry->scale = scale;
+	cache_entry->buffer = wlr_buffer;
+	cache_entry->bytes = bytes;
+	cache_entry->hash = hash;
+	wl_list_init(&cache_entry->shared_link);
+	wl_list_insert(&self->cache, &cache_entry->link);
+	wl_list_insert(&lru, &cache_entry->lru_link);
+	stats.bytes += bytes;
+	if (self->impl->hash && sharing && wlr_buffer) {
+		shared_insert(cache_entry);
+	}
+	return cache_entry;
+}
+
+static void
+prerender_dequeue(struct scaled_buffer *self)
+{
+	wl_list_remove(&self->prerender_link);
+	wl_list_init(&self->prerender_link);
+}
+
+static int
+handle_prerender_timer(void *data)
+{
+	size_t budget = (size_t)rc.scaled_buffer_cache_size << 20;
+	for (int i = 0; i < PRERENDER_BATCH; i++) {
+		if (wl_list_empty(&prerender.queue)) {
+			break;
+		}
+		struct scaled_buffer *self = wl_container_of(
+			prerender.queue.prev, self, prerender_link);
+		prerender_dequeue(self);
+
+		for (int j = 0; j < prerender.nr_scales; j++) {
+			/* Don't push out buffers that have actually been shown */
+			if (stats.bytes >= budget) {
+				struct scaled_buffer *tmp;
+				wl_list_for_each_safe(self, tmp, &prerender.queue,
+						prerender_link) {
+					prerender_dequeue(self);
+				}
+				return 0;
 			}
-			wlr_buffer_unlock(cache_entry->buffer);
+			double scale = prerender.scales[j];
+			if (scale == self->active_scale
+					|| find_cache_for_scale(self, scale)) {
+				continue;
+			}
+			/* Evicted first, unless shown before that */
+			struct scaled_buffer_cache_entry *cache_entry =
+				render_entry(self, scale);
+			wl_list_remove(&cache_entry->lru_link);
+			wl_list_insert(lru.prev, &cache_entry->lru_link);
+			stats.prerendered++;
 		}
+	}
+	if (!wl_list_empty(&prerender.queue)) {
+		lab_timer_update(prerender.timer, PRERENDER_DELAY_MS);
+	}
+	return 0;
+}
+
+static void
+prerender_schedule(struct scaled_buffer *self)
+{
+	if (!rc.prerender_scales || prerender.nr_scales < 2
+			|| !wl_list_empty(&self->prerender_link)) {
+		return;
+	}
+	if (!prerender.timer) {
+		prerender.timer = lab_timer_create(handle_prerender_timer,
+			NULL, /*slack_ms*/ 10);
+	}
+	wl_list_insert(&prerender.queue, &self->prerender_link);
+	lab_timer_update(prerender.timer, PRERENDER_DELAY_MS);
+}
+
+static void
+_update_buffer(struct scaled_buffer *self, double scale)
+{
+	self->active_scale = scale;
+	prerender_schedule(self);
+
+	/* Search for cached buffer of specified scale */
+	struct scaled_buffer_cache_entry *cache_entry =
+		find_cache_for_scale(self, scale);
+	if (cache_entry) {
+		/* LRU cache, recently used in front */
 		wl_list_remove(&cache_entry->link);
+		wl_list_insert(&self->cache, &cache_entry->link);
+		wl_list_remove(&cache_entry->lru_link);
+		wl_list_insert(&lru, &cache_entry->lru_link);
+		if (cache_entry->pending) {
+			/* Keep showing what we have until the buffer is ready */
+			return;
+		}
+		stats.hits++;
+		wlr_scene_buffer_set_buffer(self->scene_buffer, cache_entry->buffer);
+		/*
+		 * If found in our local cache, self->width and self->height
+		 * are already set, but the source box of a crop depends on
+		 * the scale.
+		 */
+		set_dest_size(self);
+		return;
 	}
 
-	/* Update the cache entry */
-	cache_entry->scale = scale;
-	cache_entry->buffer = wlr_buffer;
-	wl_list_insert(&self->cache, &cache_entry->link);
+	cache_entry = render_entry(self, scale);
+	if (cache_entry->pending) {
+		return;
+	}
+	cache_trim();
 
 	/* And finally update the wlr_scene_buffer itself */
 	wlr_scene_buffer_set_buffer(self->scene_buffer, cache_entry->buffer);
-	wlr_scene_buffer_set_dest_size(self->scene_buffer, self->width, self->height);
+	set_dest_size(self);
 }
 
 /* Internal event handlers */
@@ -151,6 +450,7 @@ _handle_node_destroy(struct wl_listener *listener, void *data)
 
 	wl_list_remove(&self->destroy.link);
 	wl_list_remove(&self->outputs_update.link);
+	wl_list_remove(&self->prerender_link);
 
 	wl_list_for_each_safe(cache_entry, cache_entry_tmp, &self->cache, link) {
 		_cache_entry_destroy(cache_entry, self->drop_buffer);
@@ -206,6 +506,7 @@ scaled_buffer_create(struct wlr_scene_tree *parent,
 	self->active_scale = 0;
 	self->drop_buffer = drop_buffer;
 	wl_list_init(&self->cache);
+	wl_list_init(&self->prerender_link);
 
 	wl_list_insert(&all_scaled_buffers, &self->link);
 
@@ -240,9 +541,10 @@ scaled_buffer_request_update(struct scaled_buffer *self,
 	 * The buffer size set here is updated when the backing buffer is
 	 * created in _update_buffer().
 	 */
-	wlr_scene_buffer_set_dest_size(self->scene_buffer, width, height);
 	self->width = width;
 	self->height = height;
+	self->crop_width = 0;
+	set_dest_size(self);
 
 	/*
 	 * Skip re-rendering if the buffer is not shown yet
@@ -253,6 +555,60 @@ scaled_buffer_request_update(struct scaled_buffer *self,
 	}
 }
 
+void
+scaled_buffer_mark_pending(struct scaled_buffer *self)
+{
+	self->pending = true;
+}
+
+void
+scaled_buffer_set_pending_buffer(struct scaled_buffer *self, double scale,
+		struct lab_data_buffer *buffer)
+{
+	struct scaled_buffer_cache_entry *cache_entry =
+		find_cache_for_scale(self, scale);
+	if (!cache_entry || !cache_entry->pending) {
+		/* Evicted or invalidated by scaled_buffer_request_update() */
+		if (buffer) {
+			wlr_buffer_drop(&buffer->base);
+		}
+		return;
+	}
+
+	cache_entry->pending = false;
+	if (buffer) {
+		buffer_set_category(buffer, self->category);
+		wlr_buffer_lock(&buffer->base);
+		cache_entry->buffer = &buffer->base;
+		cache_entry->bytes =
+			(size_t)buffer->base.width * buffer->base.height * 4;
+		cache_entry->hash = self->impl->hash ? self->impl->hash(self) : 0;
+		stats.bytes += cache_entry->bytes;
+		if (self->impl->hash && !wl_list_empty(&self->link)) {
+			shared_insert(cache_entry);
+		}
+	}
+
+	if (self->active_scale == scale) {
+		self->width = buffer ? (int)buffer->logical_width : 0;
+		self->height = buffer ? (int)buffer->logical_height : 0;
+		wlr_scene_buffer_set_buffer(self->scene_buffer, cache_entry->buffer);
+		set_dest_size(self);
+	}
+	cache_trim();
+}
+
+void
+scaled_buffer_set_crop_width(struct scaled_buffer *self, int width)
+{
+	assert(self);
+	if (width == self->crop_width) {
+		return;
+	}
+	self->crop_width = width;
+	set_dest_size(self);
+}
+
 void
 scaled_buffer_invalidate_sharing(void)
 {
@@ -261,4 +617,88 @@ scaled_buffer_invalidate_sharing(void)
 		wl_list_remove(&scene_buffer->link);
 		wl_list_init(&scene_buffer->link);
 	}
+	for (size_t i = 0; i < shared.nr_buckets; i++) {
+		struct scaled_buffer_cache_entry *entry, *entry_tmp;
+		wl_list_for_each_safe(entry, entry_tmp, &shared.buckets[i],
+				shared_link) {
+			shared_remove(entry);
+		}
+	}
+	assert(!shared.nr_entries);
+}
+
+void
+scaled_buffer_set_output_scales(const double *scales, int nr_scales)
+{
+	double unique[PRERENDER_MAX_SCALES];
+	int nr_unique = 0;
+	for (int i = 0; i < nr_scales && nr_unique < PRERENDER_MAX_SCALES; i++) {
+		bool found = false;
+		for (int j = 0; j < nr_unique; j++) {
+			found |= unique[j] == scales[i];
+		}
+		if (!found) {
+			unique[nr_unique++] = scales[i];
+		}
+	}
+	if (nr_unique == prerender.nr_scales && !memcmp(unique,
+			prerender.scales, nr_unique * sizeof(unique[0]))) {
+		return;
+	}
+	memcpy(prerender.scales, unique, nr_unique * sizeof(unique[0]));
+	prerender.nr_scales = nr_unique;
+
+	/* Queue everything that is shown for the new scales */
+	struct scaled_buffer_cache_entry *entry;
+	wl_list_for_each(entry, &lru, lru_link) {
+		if (entry->scale == entry->owner->active_scale) {
+			prerender_schedule(entry->owner);
+		}
+	}
+}
+
+void
+scaled_buffer_finish(void)
+{
+	lab_timer_destroy(prerender.timer);
+	prerender.timer = NULL;
+}
+
+void
+scaled_buffer_add_metrics(void)
+{
+	metrics_add_u64("scaled_buffer_cache_hits", NULL,
+		"Buffers reused from the scaled buffer cache", METRIC_COUNTER,
+		&stats.hits, NULL);
+	metrics_add_u64("scaled_buffer_cache_misses", NULL,
+		"Buffers rendered for the scaled buffer cache", METRIC_COUNTER,
+		&stats.misses, NULL);
+	metrics_add_u64("scaled_buffer_cache_evictions", NULL,
+		"Entries evicted to stay within the budget", METRIC_COUNTER,
+		&stats.evictions, NULL);
+	metrics_add_u64("scaled_buffer_cache_prerendered", NULL,
+		"Buffers rendered for scales not shown yet", METRIC_COUNTER,
+		&stats.prerendered, NULL);
+	metrics_add_size("scaled_buffer_cache_bytes", NULL,
+		"Bytes resident in the scaled buffer cache", METRIC_GAUGE,
+		&stats.bytes, NULL);
+}
+
+void
+scaled_buffer_stats_reset(void)
+{
+	/* Bytes resident are a state, not a counter */
+	stats = (struct scaled_buffer_stats){ .bytes = stats.bytes };
+}
+
+void
+scaled_buffer_stats_print(FILE *stream)
+{
+	fprintf(stream, "budget %u MiB\n", rc.scaled_buffer_cache_size);
+	fprintf(stream, "resident %zu bytes in %d entries\n", stats.bytes,
+		wl_list_length(&lru));
+	fprintf(stream, "hits %" PRIu64 "\n", stats.hits);
+	fprintf(stream, "misses %" PRIu64 "\n", stats.misses);
+	fprintf(stream, "evictions %" PRIu64 "\n", stats.evictions);
+	fprintf(stream, "prerendered %" PRIu64 "\n", stats.prerendered);
 }
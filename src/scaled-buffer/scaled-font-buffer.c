@@ -4,18 +4,131 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/util/log.h>
+#include "buffer.h"
 #include "common/font.h"
 #include "common/graphic-helpers.h"
+#include "common/hash.h"
+#include "common/list.h"
 #include "common/mem.h"
 #include "common/string-helpers.h"
+#include "config/rcxml.h"
 #include "scaled-buffer/scaled-buffer.h"
+#include "worker-pool.h"
+
+/*
+ * A text rasterization request for a worker thread. Workers only read the
+ * copied inputs and write @buffer; @self and @link are only touched on the
+ * main thread.
+ */
+struct render_job {
+	struct scaled_font_buffer *self; /* NULL if destroyed meanwhile */
+	struct worker_job *job;
+	uint64_t generation;
+	double scale;
+	char *text;
+	struct font font;
+	float color[4];
+	float bg_color[4];
+	cairo_pattern_t *bg_pattern;
+	int width;
+	int height;
+	int text_height;
+	struct lab_data_buffer *buffer;
+	struct wl_list link; /* jobs */
+};
+
+/* struct render_job.link, submitted jobs */
+static struct wl_list jobs = WL_LIST_INIT(&jobs);
+
+static void
+render_job_destroy(struct render_job *job)
+{
+	if (job->buffer) {
+		wlr_buffer_drop(&job->buffer->base);
+	}
+	zfree_pattern(job->bg_pattern);
+	free(job->font.name);
+	free(job->text);
+	free(job);
+}
+
+static void
+render_job_run(struct worker_job *worker_job, void *data)
+{
+	struct render_job *job = data;
+	cairo_pattern_t *bg_pattern = job->bg_pattern;
+	cairo_pattern_t *solid_bg_pattern = NULL;
+	if (!bg_pattern) {
+		solid_bg_pattern = color_to_pattern(job->bg_color);
+		bg_pattern = solid_bg_pattern;
+	}
+	font_buffer_draw(&job->buffer, job->width, job->height,
+		job->text_height, job->text, &job->font, job->color,
+		bg_pattern, job->scale);
+	zfree_pattern(solid_bg_pattern);
+}
+
+static void
+render_job_done(void *data, bool cancelled)
+{
+	struct render_job *job = data;
+	wl_list_remove(&job->link);
+	struct scaled_font_buffer *self = job->self;
+	/* Discard results for text that has changed again since */
+	if (!cancelled && self && job->generation == self->generation) {
+		if (!job->buffer) {
+			wlr_log(WLR_ERROR, "font_buffer_draw() failed");
+		}
+		scaled_buffer_set_pending_buffer(self->scaled_buffer,
+			job->scale, job->buffer);
+		job->buffer = NULL;
+	}
+	render_job_destroy(job);
+}
+
+static bool
+submit_job(struct scaled_font_buffer *self, double scale)
+{
+	struct render_job *job = znew(*job);
+	job->self = self;
+	job->generation = self->generation;
+	job->scale = scale;
+	job->text = xstrdup(self->text);
+	job->font = self->font;
+	job->font.name = self->font.name ? xstrdup(self->font.name) : NULL;
+	memcpy(job->color, self->color, sizeof(job->color));
+	memcpy(job->bg_color, self->bg_color, sizeof(job->bg_color));
+	if (self->bg_pattern) {
+		job->bg_pattern = cairo_pattern_reference(self->bg_pattern);
+	}
+	job->width = self->width;
+	job->height = self->height;
+	job->text_height = self->text_height;
+
+	job->job = worker_pool_submit(render_job_run, render_job_done, job);
+	if (!job->job) {
+		render_job_destroy(job);
+		return false;
+	}
+	wl_list_insert(&jobs, &job->link);
+	return true;
+}
 
 static struct lab_data_buffer *
 _create_buffer(struct scaled_buffer *scaled_buffer, double scale)
 {
 	struct lab_data_buffer *buffer = NULL;
 	struct scaled_font_buffer *self = scaled_buffer->data;
+
+	if (rc.async_text_rendering && !string_null_or_empty(self->text)
+			&& self->width > 0 && submit_job(self, scale)) {
+		scaled_buffer_mark_pending(scaled_buffer);
+		return NULL;
+	}
+
 	cairo_pattern_t *bg_pattern = self->bg_pattern;
 	cairo_pattern_t *solid_bg_pattern = NULL;
 
@@ -42,6 +155,14 @@ _destroy(struct scaled_buffer *scaled_buffer)
 	struct scaled_font_buffer *self = scaled_buffer->data;
 	scaled_buffer->data = NULL;
 
+	struct render_job *job;
+	wl_list_for_each(job, &jobs, link) {
+		if (job->self == self) {
+			job->self = NULL;
+			worker_job_cancel(job->job);
+		}
+	}
+
 	zfree(self->text);
 	zfree(self->font.name);
 	zfree_pattern(self->bg_pattern);
@@ -67,10 +188,28 @@ _equal(struct scaled_buffer *scaled_buffer_a,
 		&& a->bg_pattern == b->bg_pattern;
 }
 
+static uint64_t
+_hash(struct scaled_buffer *scaled_buffer)
+{
+	struct scaled_font_buffer *self = scaled_buffer->data;
+
+	uint64_t hash = hash_add_str(HASH_INIT, self->text);
+	hash = hash_add(hash, &self->max_width, sizeof(self->max_width));
+	hash = hash_add_str(hash, self->font.name);
+	hash = hash_add(hash, &self->font.size, sizeof(self->font.size));
+	hash = hash_add(hash, &self->font.slant, sizeof(self->font.slant));
+	hash = hash_add(hash, &self->font.weight, sizeof(self->font.weight));
+	hash = hash_add(hash, self->color, sizeof(self->color));
+	hash = hash_add(hash, self->bg_color, sizeof(self->bg_color));
+	hash = hash_add(hash, &self->fixed_height, sizeof(self->fixed_height));
+	return hash_add(hash, &self->bg_pattern, sizeof(self->bg_pattern));
+}
+
 static const struct scaled_buffer_impl impl = {
 	.create_buffer = _create_buffer,
 	.destroy = _destroy,
 	.equal = _equal,
+	.hash = _hash,
 };
 
 /* Public API */
@@ -119,6 +258,7 @@ scaled_font_buffer_update(struct scaled_font_buffer *self, const char *text,
 	zfree(self->font.name);
 
 	/* Update internal state */
+	self->generation++;
 	self->text = xstrdup(text);
 	self->max_width = max_width;
 	if (font->name) {
@@ -136,6 +276,26 @@ scaled_font_buffer_update(struct scaled_font_buffer *self, const char *text,
 		&self->width, &computed_height);
 	self->height = (self->fixed_height > 0) ?
 		self->fixed_height : computed_height;
+	self->text_height = computed_height;
 	scaled_buffer_request_update(self->scaled_buffer,
 		self->width, self->height);
 }
+
+void
+scaled_font_buffer_crop(struct scaled_font_buffer *self, int width)
+{
+	assert(self);
+	scaled_buffer_set_crop_width(self->scaled_buffer,
+		width < self->width ? width : 0);
+}
+
+void
+scaled_font_buffer_finish(void)
+{
+	/* The jobs are freed once worker_pool_finish() has waited for them */
+	struct render_job *job;
+	wl_list_for_each(job, &jobs, link) {
+		job->self = NULL;
+		worker_job_cancel(job->job);
+	}
+}
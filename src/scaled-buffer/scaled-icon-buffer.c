@@ -5,6 +5,7 @@
 #include <string.h>
 #include <wlr/util/log.h>
 #include "buffer.h"
+#include "common/hash.h"
 #include "common/mem.h"
 #include "common/string-helpers.h"
 #include "config.h"
@@ -15,6 +16,15 @@
 #include "scaled-buffer/scaled-buffer.h"
 #include "view.h"
 #include "window-rules.h"
+#include "worker-pool.h"
+
+static struct wl_list all_icon_buffers = WL_LIST_INIT(&all_icon_buffers);
+
+/*
+ * Bumped by scaled_icon_buffer_reload_all() so that buffers rendered
+ * before don't compare equal to updated ones and aren't shared.
+ */
+static unsigned int icon_generation;
 
 #if HAVE_LIBSFDO
 
@@ -93,6 +103,139 @@ load_server_icon(struct scaled_icon_buffer *self, int icon_size, double scale)
 	return NULL;
 }
 
+/*
+ * Resolve the icon file that _create_buffer() would load, in the same
+ * order. Returns false if that is a buffer supplied by the client or there
+ * is no icon at all.
+ */
+static bool
+find_icon_file(struct scaled_icon_buffer *self, int icon_size, double scale,
+		char **path, enum lab_img_type *type)
+{
+	struct server *server = self->server;
+	if (self->icon_name) {
+		return desktop_entry_find_icon(server, self->icon_name,
+			icon_size, scale, path, type);
+	}
+
+	if (self->view_icon_prefer_client) {
+		if (desktop_entry_find_icon(server, self->view_icon_name,
+				icon_size, scale, path, type)) {
+			return true;
+		}
+		if (self->view_icon_buffers.size) {
+			return false;
+		}
+		if (desktop_entry_find_icon_from_app_id(server,
+				self->view_app_id, icon_size, scale, path, type)) {
+			return true;
+		}
+	} else {
+		if (desktop_entry_find_icon_from_app_id(server,
+				self->view_app_id, icon_size, scale, path, type)) {
+			return true;
+		}
+		if (desktop_entry_find_icon(server, self->view_icon_name,
+				icon_size, scale, path, type)) {
+			return true;
+		}
+		if (self->view_icon_buffers.size) {
+			return false;
+		}
+	}
+	return desktop_entry_find_icon(server, rc.fallback_app_icon_name,
+		icon_size, scale, path, type);
+}
+
+/*
+ * An icon file to load and render on a worker thread. Workers only read
+ * @path and write @buffer; @self and @link are only touched on the main
+ * thread.
+ */
+struct icon_job {
+	struct scaled_icon_buffer *self; /* NULL if destroyed meanwhile */
+	struct worker_job *job;
+	uint64_t updates;
+	double scale;
+	char *path;
+	enum lab_img_type type;
+	int width;
+	int height;
+	struct lab_data_buffer *buffer;
+	struct wl_list link; /* jobs */
+};
+
+/* struct icon_job.link, submitted jobs */
+static struct wl_list jobs = WL_LIST_INIT(&jobs);
+
+static void
+icon_job_destroy(struct icon_job *job)
+{
+	if (job->buffer) {
+		wlr_buffer_drop(&job->buffer->base);
+	}
+	free(job->path);
+	free(job);
+}
+
+static void
+icon_job_run(struct worker_job *worker_job, void *data)
+{
+	struct icon_job *job = data;
+	struct lab_img *img = lab_img_load(job->type, job->path, NULL);
+	if (img) {
+		job->buffer = img_to_buffer(img, job->width, job->height,
+			job->scale);
+	}
+}
+
+static void
+icon_job_done(void *data, bool cancelled)
+{
+	struct icon_job *job = data;
+	wl_list_remove(&job->link);
+	struct scaled_icon_buffer *self = job->self;
+	/* Discard icons that have changed again since */
+	if (!cancelled && self && job->updates == self->updates) {
+		if (!job->buffer) {
+			wlr_log(WLR_INFO, "failed to load icon file %s",
+				job->path);
+		}
+		scaled_buffer_set_pending_buffer(self->scaled_buffer,
+			job->scale, job->buffer);
+		job->buffer = NULL;
+	}
+	icon_job_destroy(job);
+}
+
+static bool
+submit_job(struct scaled_icon_buffer *self, double scale)
+{
+	char *path;
+	enum lab_img_type type;
+	if (!find_icon_file(self, MIN(self->width, self->height), scale,
+			&path, &type)) {
+		return false;
+	}
+
+	struct icon_job *job = znew(*job);
+	job->self = self;
+	job->updates = self->updates;
+	job->scale = scale;
+	job->path = path;
+	job->type = type;
+	job->width = self->width;
+	job->height = self->height;
+
+	job->job = worker_pool_submit(icon_job_run, icon_job_done, job);
+	if (!job->job) {
+		icon_job_destroy(job);
+		return false;
+	}
+	wl_list_insert(&jobs, &job->link);
+	return true;
+}
+
 #endif /* HAVE_LIBSFDO */
 
 static struct lab_data_buffer *
@@ -104,6 +247,12 @@ _create_buffer(struct scaled_buffer *scaled_buffer, double scale)
 	struct lab_img *img = NULL;
 	struct lab_data_buffer *buffer = NULL;
 
+	if (rc.async_icon_loading && self->width > 0 && self->height > 0
+			&& submit_job(self, scale)) {
+		scaled_buffer_mark_pending(scaled_buffer);
+		return NULL;
+	}
+
 	if (self->icon_name) {
 		/* generic icon (e.g. menu icons) */
 		img = desktop_entry_load_icon(self->server, self->icon_name,
@@ -170,6 +319,16 @@ static void
 _destroy(struct scaled_buffer *scaled_buffer)
 {
 	struct scaled_icon_buffer *self = scaled_buffer->data;
+#if HAVE_LIBSFDO
+	struct icon_job *job;
+	wl_list_for_each(job, &jobs, link) {
+		if (job->self == self) {
+			job->self = NULL;
+			worker_job_cancel(job->job);
+		}
+	}
+#endif
+	wl_list_remove(&self->link);
 	if (self->view) {
 		wl_list_remove(&self->on_view.set_icon.link);
 		wl_list_remove(&self->on_view.new_title.link);
@@ -205,13 +364,40 @@ _equal(struct scaled_buffer *scaled_buffer_a,
 		&& icon_buffers_equal(&a->view_icon_buffers, &b->view_icon_buffers)
 		&& str_equal(a->icon_name, b->icon_name)
 		&& a->width == b->width
-		&& a->height == b->height;
+		&& a->height == b->height
+		&& a->generation == b->generation;
+}
+
+static uint64_t
+_hash(struct scaled_buffer *scaled_buffer)
+{
+	struct scaled_icon_buffer *self = scaled_buffer->data;
+
+	uint64_t hash = hash_add_str(HASH_INIT, self->view_app_id);
+	hash = hash_add(hash, &self->view_icon_prefer_client,
+		sizeof(self->view_icon_prefer_client));
+	hash = hash_add_str(hash, self->view_icon_name);
+	hash = hash_add(hash, self->view_icon_buffers.data,
+		self->view_icon_buffers.size);
+	hash = hash_add_str(hash, self->icon_name);
+	hash = hash_add(hash, &self->width, sizeof(self->width));
+	hash = hash_add(hash, &self->height, sizeof(self->height));
+	return hash_add(hash, &self->generation, sizeof(self->generation));
+}
+
+static void
+request_update(struct scaled_icon_buffer *self)
+{
+	self->updates++;
+	scaled_buffer_request_update(self->scaled_buffer,
+		self->width, self->height);
 }
 
 static struct scaled_buffer_impl impl = {
 	.create_buffer = _create_buffer,
 	.destroy = _destroy,
 	.equal = _equal,
+	.hash = _hash,
 };
 
 struct scaled_icon_buffer *
@@ -229,8 +415,11 @@ scaled_icon_buffer_create(struct wlr_scene_tree *parent, struct server *server,
 	self->server = server;
 	self->width = width;
 	self->height = height;
+	self->generation = icon_generation;
+	wl_list_insert(&all_icon_buffers, &self->link);
 
 	scaled_buffer->data = self;
+	scaled_buffer->category = BUFFER_ICON;
 
 	return self;
 }
@@ -255,8 +444,7 @@ handle_view_set_icon(struct wl_listener *listener, void *data)
 	}
 
 	set_icon_buffers(self, &self->view->icon.buffers);
-	scaled_buffer_request_update(self->scaled_buffer,
-		self->width, self->height);
+	request_update(self);
 }
 
 static void
@@ -266,13 +454,12 @@ handle_view_new_title(struct wl_listener *listener, void *data)
 		wl_container_of(listener, self, on_view.new_title);
 
 	bool prefer_client = window_rules_get_property(
-		self->view, "iconPreferClient") == LAB_PROP_TRUE;
+		self->view, WINDOW_RULE_PROP_ICON_PREFER_CLIENT) == LAB_PROP_TRUE;
 	if (prefer_client == self->view_icon_prefer_client) {
 		return;
 	}
 	self->view_icon_prefer_client = prefer_client;
-	scaled_buffer_request_update(self->scaled_buffer,
-		self->width, self->height);
+	request_update(self);
 }
 
 static void
@@ -288,9 +475,8 @@ handle_view_new_app_id(struct wl_listener *listener, void *data)
 
 	xstrdup_replace(self->view_app_id, app_id);
 	self->view_icon_prefer_client = window_rules_get_property(
-		self->view, "iconPreferClient") == LAB_PROP_TRUE;
-	scaled_buffer_request_update(self->scaled_buffer,
-		self->width, self->height);
+		self->view, WINDOW_RULE_PROP_ICON_PREFER_CLIENT) == LAB_PROP_TRUE;
+	request_update(self);
 }
 
 static void
@@ -347,5 +533,29 @@ scaled_icon_buffer_set_icon_name(struct scaled_icon_buffer *self,
 		return;
 	}
 	xstrdup_replace(self->icon_name, icon_name);
-	scaled_buffer_request_update(self->scaled_buffer, self->width, self->height);
+	request_update(self);
+}
+
+void
+scaled_icon_buffer_finish(void)
+{
+#if HAVE_LIBSFDO
+	/* The jobs are freed once worker_pool_finish() has waited for them */
+	struct icon_job *job;
+	wl_list_for_each(job, &jobs, link) {
+		job->self = NULL;
+		worker_job_cancel(job->job);
+	}
+#endif
+}
+
+void
+scaled_icon_buffer_reload_all(void)
+{
+	icon_generation++;
+	struct scaled_icon_buffer *self;
+	wl_list_for_each(self, &all_icon_buffers, link) {
+		self->generation = icon_generation;
+		request_update(self);
+	}
 }
@@ -0,0 +1,481 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "scene-index.h"
+#include <math.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "common/box.h"
+#include "common/macros.h"
+#include "common/mem.h"
+#include "labwc.h"
+#include "node.h"
+#include "ssd.h"
+#include "view.h"
+
+#define SCENE_INDEX_CELL_SIZE 256
+#define SCENE_INDEX_MAX_CELLS_PER_AXIS 64
+
+struct scene_index_entry {
+	struct wlr_scene_node *node;
+	/* One of the server->view_tree* trees */
+	struct wlr_scene_tree *root;
+	/* Node position relative to its parent, to detect moves */
+	int x, y;
+	/* Union of all enabled descendants in layout coordinates */
+	struct wlr_box bounds;
+};
+
+typedef bool (*toplevel_iter_func_t)(struct wlr_scene_node *node,
+	struct wlr_scene_tree *root, void *data);
+
+static bool
+for_each_toplevel_in(struct wlr_scene_tree *tree, struct wlr_scene_tree *root,
+		toplevel_iter_func_t iter, void *data)
+{
+	struct wlr_scene_node *node;
+	wl_list_for_each_reverse(node, &tree->children, link) {
+		if (node->enabled && !iter(node, root, data)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Iterates over the enabled top-level nodes of the view tree @root from
+ * top to bottom. The normal view_tree contains the workspace trees, so we
+ * descend one more level there.
+ */
+static bool
+for_each_toplevel_of(struct server *server, struct wlr_scene_tree *root,
+		toplevel_iter_func_t iter, void *data)
+{
+	if (!root->node.enabled) {
+		return true;
+	}
+	if (root != server->view_tree) {
+		return for_each_toplevel_in(root, root, iter, data);
+	}
+
+	struct wlr_scene_node *node;
+	wl_list_for_each_reverse(node, &root->children, link) {
+		if (!node->enabled) {
+			continue;
+		}
+		bool ret;
+		if (node->type == WLR_SCENE_NODE_TREE) {
+			ret = for_each_toplevel_in(wlr_scene_tree_from_node(node),
+				root, iter, data);
+		} else {
+			ret = iter(node, root, data);
+		}
+		if (!ret) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Same as above for all view trees */
+static bool
+for_each_toplevel(struct server *server, toplevel_iter_func_t iter, void *data)
+{
+	return for_each_toplevel_of(server, server->view_tree_always_on_top,
+			iter, data)
+		&& for_each_toplevel_of(server, server->view_tree, iter, data)
+		&& for_each_toplevel_of(server,
+			server->view_tree_always_on_bottom, iter, data);
+}
+
+static struct view *
+toplevel_get_view(struct wlr_scene_node *node)
+{
+	struct node_descriptor *desc = node->data;
+	return desc && desc->type == LAB_NODE_VIEW ? desc->view : NULL;
+}
+
+/*
+ * wlr_scene_node_at() for a top-level node, including the invisible
+ * resize area of its decoration which has no scene nodes
+ */
+static struct wlr_scene_node *
+toplevel_node_at(struct wlr_scene_node *node, double lx, double ly,
+		double *sx, double *sy)
+{
+	struct wlr_scene_node *found = wlr_scene_node_at(node, lx, ly, sx, sy);
+	if (found) {
+		return found;
+	}
+	struct view *view = toplevel_get_view(node);
+	return view ? ssd_extents_node_at(view->ssd, lx, ly, sx, sy) : NULL;
+}
+
+static void
+node_get_bounds(struct wlr_scene_node *node, int lx, int ly,
+		struct wlr_box *bounds)
+{
+	if (!node->enabled) {
+		return;
+	}
+	lx += node->x;
+	ly += node->y;
+
+	struct wlr_box box = { .x = lx, .y = ly };
+	switch (node->type) {
+	case WLR_SCENE_NODE_TREE: {
+		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &tree->children, link) {
+			node_get_bounds(child, lx, ly, bounds);
+		}
+		return;
+	}
+	case WLR_SCENE_NODE_RECT: {
+		struct wlr_scene_rect *rect = wlr_scene_rect_from_node(node);
+		box.width = rect->width;
+		box.height = rect->height;
+		break;
+	}
+	case WLR_SCENE_NODE_BUFFER: {
+		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+		if (buffer->dst_width > 0 && buffer->dst_height > 0) {
+			box.width = buffer->dst_width;
+			box.height = buffer->dst_height;
+		} else if (buffer->buffer) {
+			box.width = buffer->buffer->width;
+			box.height = buffer->buffer->height;
+			wlr_output_transform_coords(buffer->transform,
+				&box.width, &box.height);
+		}
+		break;
+	}
+	}
+	box_union(bounds, bounds, &box);
+}
+
+static bool
+add_entry(struct wlr_scene_node *node, struct wlr_scene_tree *root, void *data)
+{
+	struct scene_index *index = data;
+	struct scene_index_entry *entry =
+		wl_array_add(&index->entries, sizeof(*entry));
+	if (!entry) {
+		wlr_log(WLR_ERROR, "wl_array_add(): out of memory");
+		return false;
+	}
+
+	int lx, ly;
+	wlr_scene_node_coords(node, &lx, &ly);
+	*entry = (struct scene_index_entry){
+		.node = node,
+		.root = root,
+		.x = node->x,
+		.y = node->y,
+	};
+	node_get_bounds(node, lx - node->x, ly - node->y, &entry->bounds);
+
+	struct view *view = toplevel_get_view(node);
+	struct wlr_box extents;
+	if (view && ssd_get_extents_box(view->ssd, &extents)) {
+		box_union(&entry->bounds, &entry->bounds, &extents);
+	}
+	return true;
+}
+
+struct validate_data {
+	struct scene_index *index;
+	size_t pos;
+	size_t nr_entries;
+};
+
+static bool
+validate_entry(struct wlr_scene_node *node, struct wlr_scene_tree *root,
+		void *data)
+{
+	struct validate_data *validate = data;
+	if (validate->pos >= validate->nr_entries) {
+		return false;
+	}
+	struct scene_index_entry *entry =
+		(struct scene_index_entry *)validate->index->entries.data
+			+ validate->pos++;
+	return entry->node == node && entry->root == root
+		&& entry->x == node->x && entry->y == node->y;
+}
+
+/* Check that the stacking order and positions haven't changed */
+static bool
+index_is_valid(struct server *server)
+{
+	struct scene_index *index = &server->scene_index;
+	if (index->dirty) {
+		return false;
+	}
+	struct validate_data validate = {
+		.index = index,
+		.nr_entries = index->entries.size
+			/ sizeof(struct scene_index_entry),
+	};
+	return for_each_toplevel(server, validate_entry, &validate)
+		&& validate.pos == validate.nr_entries;
+}
+
+static void
+free_cells(struct scene_index *index)
+{
+	for (int i = 0; i < index->cols * index->rows; i++) {
+		wl_array_release(&index->cells[i]);
+	}
+	zfree(index->cells);
+	index->cols = 0;
+	index->rows = 0;
+}
+
+static bool
+rebuild(struct server *server)
+{
+	struct scene_index *index = &server->scene_index;
+
+	free_cells(index);
+	index->entries.size = 0;
+	index->extent = (struct wlr_box){0};
+
+	if (!for_each_toplevel(server, add_entry, index)) {
+		goto fail;
+	}
+
+	struct scene_index_entry *entry;
+	wl_array_for_each(entry, &index->entries) {
+		box_union(&index->extent, &index->extent, &entry->bounds);
+	}
+	if (wlr_box_empty(&index->extent)) {
+		index->dirty = false;
+		return true;
+	}
+
+	/* Grow the cells for huge (e.g. far off-screen) extents */
+	int max = SCENE_INDEX_MAX_CELLS_PER_AXIS;
+	index->cell_size = MAX(SCENE_INDEX_CELL_SIZE,
+		MAX((index->extent.width + max - 1) / max,
+			(index->extent.height + max - 1) / max));
+	index->cols = (index->extent.width + index->cell_size - 1)
+		/ index->cell_size;
+	index->rows = (index->extent.height + index->cell_size - 1)
+		/ index->cell_size;
+	index->cells = znew_n(*index->cells, index->cols * index->rows);
+	for (int i = 0; i < index->cols * index->rows; i++) {
+		wl_array_init(&index->cells[i]);
+	}
+
+	/* Entries are sorted top to bottom, and so are the cells */
+	uint32_t idx = 0;
+	wl_array_for_each(entry, &index->entries) {
+		if (wlr_box_empty(&entry->bounds)) {
+			idx++;
+			continue;
+		}
+		struct wlr_box *b = &entry->bounds;
+		int col1 = (b->x - index->extent.x) / index->cell_size;
+		int row1 = (b->y - index->extent.y) / index->cell_size;
+		int col2 = (b->x + b->width - 1 - index->extent.x) / index->cell_size;
+		int row2 = (b->y + b->height - 1 - index->extent.y) / index->cell_size;
+		for (int row = row1; row <= row2; row++) {
+			for (int col = col1; col <= col2; col++) {
+				struct wl_array *cell =
+					&index->cells[row * index->cols + col];
+				uint32_t *slot = wl_array_add(cell, sizeof(*slot));
+				if (!slot) {
+					wlr_log(WLR_ERROR, "wl_array_add(): out of memory");
+					goto fail;
+				}
+				*slot = idx;
+			}
+		}
+		idx++;
+	}
+
+	index->dirty = false;
+	return true;
+
+fail:
+	free_cells(index);
+	index->entries.size = 0;
+	index->dirty = true;
+	return false;
+}
+
+static struct wl_array *
+cell_at(struct scene_index *index, double lx, double ly)
+{
+	if (!index->cells || !wlr_box_contains_point(&index->extent, lx, ly)) {
+		return NULL;
+	}
+	int col = ((int)floor(lx) - index->extent.x) / index->cell_size;
+	int row = ((int)floor(ly) - index->extent.y) / index->cell_size;
+	if (col < 0 || row < 0 || col >= index->cols || row >= index->rows) {
+		return NULL;
+	}
+	return &index->cells[row * index->cols + col];
+}
+
+static struct wlr_scene_node *
+view_tree_node_at(struct server *server, struct wlr_scene_tree *root,
+		double lx, double ly, double *sx, double *sy)
+{
+	struct scene_index *index = &server->scene_index;
+	struct wl_array *cell = cell_at(index, lx, ly);
+	if (!cell) {
+		return NULL;
+	}
+
+	struct scene_index_entry *entries = index->entries.data;
+	uint32_t *idx;
+	wl_array_for_each(idx, cell) {
+		struct scene_index_entry *entry = &entries[*idx];
+		if (entry->root != root
+				|| !wlr_box_contains_point(&entry->bounds, lx, ly)) {
+			continue;
+		}
+		struct wlr_scene_node *node =
+			toplevel_node_at(entry->node, lx, ly, sx, sy);
+		if (node) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+struct node_at_data {
+	double lx, ly;
+	double *sx, *sy;
+	struct wlr_scene_node *node;
+};
+
+static bool
+find_node_at(struct wlr_scene_node *node, struct wlr_scene_tree *root,
+		void *data)
+{
+	struct node_at_data *node_at = data;
+	node_at->node = toplevel_node_at(node, node_at->lx, node_at->ly,
+		node_at->sx, node_at->sy);
+	return !node_at->node;
+}
+
+/* Fallback without index, if it could not be built */
+static struct wlr_scene_node *
+view_tree_node_at_unindexed(struct server *server, struct wlr_scene_tree *root,
+		double lx, double ly, double *sx, double *sy)
+{
+	struct node_at_data node_at = {
+		.lx = lx, .ly = ly,
+		.sx = sx, .sy = sy,
+	};
+	for_each_toplevel_of(server, root, find_node_at, &node_at);
+	return node_at.node;
+}
+
+static bool
+is_view_tree(struct server *server, struct wlr_scene_node *node)
+{
+	return node == &server->view_tree_always_on_top->node
+		|| node == &server->view_tree->node
+		|| node == &server->view_tree_always_on_bottom->node;
+}
+
+struct wlr_scene_node *
+scene_index_node_at(struct server *server, double lx, double ly,
+		double *sx, double *sy)
+{
+	bool use_index = index_is_valid(server);
+	if (!use_index) {
+		if (!server->scene_index.dirty) {
+			/* Something was restacked, moved or (un)mapped */
+			server->scene_index.generation++;
+		}
+		use_index = rebuild(server);
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each_reverse(child, &server->scene->tree.children, link) {
+		if (!child->enabled || child == &server->seat.drag.icons->node) {
+			continue;
+		}
+		struct wlr_scene_node *node;
+		if (use_index && is_view_tree(server, child)) {
+			node = view_tree_node_at(server,
+				wlr_scene_tree_from_node(child), lx, ly, sx, sy);
+		} else if (is_view_tree(server, child)) {
+			node = view_tree_node_at_unindexed(server,
+				wlr_scene_tree_from_node(child), lx, ly, sx, sy);
+		} else {
+			node = wlr_scene_node_at(child, lx, ly, sx, sy);
+		}
+		if (node) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+void
+scene_index_invalidate(struct server *server)
+{
+	server->scene_index.dirty = true;
+	server->scene_index.generation++;
+}
+
+uint64_t
+scene_index_get_generation(struct server *server)
+{
+	struct scene_index *index = &server->scene_index;
+	if (!index->dirty && !index_is_valid(server)) {
+		scene_index_invalidate(server);
+	}
+	return index->generation;
+}
+
+bool
+scene_index_node_exposed_at(struct server *server,
+		struct wlr_scene_node *node, double lx, double ly)
+{
+	/* Find the child of the scene root containing the node */
+	struct wlr_scene_node *root_child = node;
+	while (root_child->parent && root_child->parent != &server->scene->tree) {
+		root_child = &root_child->parent->node;
+	}
+	if (!is_view_tree(server, root_child)) {
+		return false;
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each_reverse(child, &server->scene->tree.children, link) {
+		if (child == root_child) {
+			return true;
+		}
+		if (!child->enabled || child == &server->seat.drag.icons->node
+				|| is_view_tree(server, child)) {
+			continue;
+		}
+		double sx, sy;
+		if (wlr_scene_node_at(child, lx, ly, &sx, &sy)) {
+			return false;
+		}
+	}
+	return false;
+}
+
+void
+scene_index_init(struct server *server)
+{
+	struct scene_index *index = &server->scene_index;
+	*index = (struct scene_index){ .dirty = true };
+	wl_array_init(&index->entries);
+}
+
+void
+scene_index_finish(struct server *server)
+{
+	struct scene_index *index = &server->scene_index;
+	free_cells(index);
+	wl_array_release(&index->entries);
+}
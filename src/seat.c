@@ -17,6 +17,7 @@
 #include <wlr/util/log.h>
 #include "common/macros.h"
 #include "common/mem.h"
+#include "config/keybind.h"
 #include "config/libinput.h"
 #include "config/rcxml.h"
 #include "config/touch.h"
@@ -26,9 +27,12 @@
 #include "input/input.h"
 #include "input/keyboard.h"
 #include "input/key-state.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "menu/menu.h"
 #include "output.h"
 #include "session-lock.h"
+#include "timer.h"
 #include "view.h"
 
 static void
@@ -151,6 +155,16 @@ configure_libinput(struct wlr_input_device *wlr_input_device)
 	 */
 	assert(dc);
 
+	/* Leave devices alone on reconfigure if nothing has changed for them */
+	if (input->has_applied_config && libinput_category_settings_equal(
+			&input->applied_config, dc)) {
+		wlr_log(WLR_DEBUG, "input device %s unchanged",
+			libinput_device_get_name(libinput_dev));
+		return;
+	}
+	input->applied_config = *dc;
+	input->has_applied_config = true;
+
 	wlr_log(WLR_INFO, "configuring input device %s (%s)",
 		libinput_device_get_name(libinput_dev),
 		libinput_device_get_sysname(libinput_dev));
@@ -615,17 +629,38 @@ handle_focus_change(struct wl_listener *listener, void *data)
 	}
 
 	if (view != server->active_view) {
+		struct view *prev = server->active_view;
 		if (server->active_view) {
 			view_set_activated(server->active_view, false);
 		}
 		if (view) {
 			view_set_activated(view, true);
+			view_note_focus(view);
 			tablet_pad_enter_surface(seat, surface);
 		}
 		server->active_view = view;
+		output_update_overlays(server);
+		if (prev) {
+			output_update_adaptive_sync(prev->output);
+		}
+		if (view && (!prev || view->output != prev->output)) {
+			output_update_adaptive_sync(view->output);
+		}
+		ipc_emit(IPC_EVENT_FOCUS);
+		menu_on_window_list_changed(server);
 	}
 }
 
+static void
+handle_pointer_focus_change(struct wl_listener *listener, void *data)
+{
+	struct seat *seat = wl_container_of(listener, seat, pointer_focus_change);
+	struct wlr_seat_pointer_focus_change_event *event = data;
+
+	/* Modifiers are only broadcast to the pointer-focused client */
+	keyboard_send_modifiers_on_pointer_enter(seat, event->new_surface);
+}
+
 void
 seat_init(struct server *server)
 {
@@ -644,6 +679,9 @@ seat_init(struct server *server)
 
 	CONNECT_SIGNAL(server->backend, seat, new_input);
 	CONNECT_SIGNAL(&seat->seat->keyboard_state, seat, focus_change);
+	seat->pointer_focus_change.notify = handle_pointer_focus_change;
+	wl_signal_add(&seat->seat->pointer_state.events.focus_change,
+		&seat->pointer_focus_change);
 
 	seat->virtual_pointer = wlr_virtual_pointer_manager_v1_create(
 		server->wl_display);
@@ -677,6 +715,7 @@ seat_finish(struct server *server)
 	struct seat *seat = &server->seat;
 	wl_list_remove(&seat->new_input.link);
 	wl_list_remove(&seat->focus_change.link);
+	wl_list_remove(&seat->pointer_focus_change.link);
 	wl_list_remove(&seat->new_virtual_pointer.link);
 	wl_list_remove(&seat->new_virtual_keyboard.link);
 
@@ -686,13 +725,15 @@ seat_finish(struct server *server)
 	}
 
 	if (seat->workspace_osd_timer) {
-		wl_event_source_remove(seat->workspace_osd_timer);
+		lab_timer_destroy(seat->workspace_osd_timer);
 		seat->workspace_osd_timer = NULL;
 	}
 	overlay_finish(seat);
 
 	input_handlers_finish(seat);
 	input_method_relay_finish(seat->input_method_relay);
+	/* Outputs are destroyed later, see input_method_relay_invalidate() */
+	seat->input_method_relay = NULL;
 }
 
 static void
@@ -757,6 +798,8 @@ seat_reconfigure(struct server *server)
 			break;
 		}
 	}
+	/* Once for all keyboards, which share the keymap of the group */
+	keybind_update_keycodes(server);
 }
 
 static void
@@ -780,6 +823,10 @@ seat_focus(struct seat *seat, struct wlr_surface *surface,
 		return;
 	}
 
+	if (surface != seat->seat->keyboard_state.focused_surface) {
+		keybind_condition_cache_notify(KEYBIND_CONDITION_EVENT_FOCUS);
+	}
+
 	if (!surface) {
 		wlr_seat_keyboard_notify_clear_focus(seat->seat);
 		input_method_relay_set_focus(seat->input_method_relay, NULL);
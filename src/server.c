@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #define _POSIX_C_SOURCE 200809L
 #include "config.h"
+#include <glib.h>
 #include <stdio.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -48,27 +49,55 @@
 #endif
 
 #include "action.h"
+#include "buffer.h"
+#include "child-watch.h"
+#include "common/buf.h"
+#include "common/dir.h"
+#include "common/font.h"
+#include "common/log.h"
 #include "common/macros.h"
+#include "common/mem.h"
+#include "common/xml.h"
 #include "config/keybind.h"
 #include "config/rcxml.h"
 #include "config/session.h"
+#include "configure-stats.h"
+#include "cycle.h"
+#include "debug.h"
 #include "decorations.h"
+#include "deferred-startup.h"
 #include "desktop-entry.h"
+#include "foreign-toplevel/foreign.h"
+#include "hidden-frames.h"
 #include "idle.h"
+#include "input-latency.h"
+#include "input/condition-helper.h"
 #include "input/keyboard.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "launcher.h"
 #include "layers.h"
 #include "magnifier.h"
+#include "memory-pressure.h"
+#include "metrics.h"
 #include "menu/menu.h"
 #include "output.h"
+#include "output-stats.h"
 #include "output-virtual.h"
 #include "regions.h"
 #include "resize-indicator.h"
 #include "scaled-buffer/scaled-buffer.h"
+#include "scaled-buffer/scaled-font-buffer.h"
+#include "scaled-buffer/scaled-icon-buffer.h"
 #include "session-lock.h"
 #include "ssd.h"
+#include "startup-profile.h"
 #include "theme.h"
+#include "tiling.h"
+#include "timer.h"
+#include "trace.h"
 #include "view.h"
+#include "worker-pool.h"
 #include "workspaces.h"
 #include "xwayland.h"
 
@@ -79,46 +108,185 @@
 #define LAB_WLR_LINUX_DMABUF_VERSION 4
 #define LAB_WLR_PRESENTATION_TIME_VERSION 2
 
+/*
+ * On SIGHUP, the config and menu files are read and parsed on a worker
+ * thread, so that frames keep flowing meanwhile. Only applying them runs
+ * on the main thread, once the job is done.
+ */
+static struct {
+	struct server *server;
+	struct worker_job *job;
+	/* SIGHUP received while loading */
+	bool again;
+	struct wl_list rc_paths;
+	struct wl_list menu_paths;
+	struct wl_array rc_docs;   /* xmlDoc * */
+	struct wl_array menu_docs; /* xmlDoc * */
+} reload;
+
+/*
+ * Applies @rc_docs and @menu_docs from rcxml_load() and menu_load(), or
+ * reads the files synchronously if they are NULL.
+ */
 static void
-reload_config_and_theme(struct server *server)
+reload_config_and_theme(struct server *server, struct wl_array *rc_docs,
+		struct wl_array *menu_docs)
 {
+	/* Reconfiguring would init the deferred subsystems twice */
+	deferred_startup_flush();
 	/* Avoid UAF when dialog client is used during reconfigure */
 	action_prompts_destroy();
+	/* Pending condition queries reference the old keybinds */
+	condition_helper_stop();
 
-	scaled_buffer_invalidate_sharing();
+	uint64_t old_hashes[RC_SECTION_COUNT];
+	memcpy(old_hashes, rc.section_hashes, sizeof(old_hashes));
 	rcxml_finish();
-	rcxml_read(rc.config_file);
-	theme_finish(server->theme);
-	theme_init(server->theme, server, rc.theme_name);
+	if (rc_docs) {
+		rcxml_read_docs(rc_docs);
+	} else {
+		rcxml_read(rc.config_file);
+	}
+	/* Window switcher items are made from the config and the theme */
+	cycle_osd_reset_cache(server);
+#define SECTION_CHANGED(section) \
+	(old_hashes[RC_SECTION_##section] != rc.section_hashes[RC_SECTION_##section])
+
+	/*
+	 * Only rebuild the theme and the decorations of all views if
+	 * anything they are made from has changed. Input devices are always
+	 * reconfigured because they also depend on environment variables.
+	 */
+	bool theme_changed = SECTION_CHANGED(THEME) || SECTION_CHANGED(CORE)
+		|| SECTION_CHANGED(RESIZE)
+		|| theme_files_hash(rc.theme_name) != server->theme->files_hash;
+	bool menu_changed = theme_changed || SECTION_CHANGED(MENU)
+		|| menu_files_hash() != server->menu_files_hash;
+	wlr_log(WLR_INFO, "reconfigure: theme %s, menu %s",
+		theme_changed ? "changed" : "unchanged",
+		menu_changed ? "changed" : "unchanged");
+
+	if (theme_changed) {
+		scaled_buffer_invalidate_sharing();
+		ssd_pool_flush();
+		/* Drop cached font metrics, which may be outdated by font changes */
+		font_finish();
+		theme_finish(server->theme);
+		theme_init(server->theme, server, rc.theme_name);
 
 #if HAVE_LIBSFDO
-	desktop_entry_finish(server);
-	desktop_entry_init(server);
+		desktop_entry_finish(server);
+		desktop_entry_init(server);
 #endif
 
-	struct view *view;
-	wl_list_for_each(view, &server->views, link) {
-		view_reload_ssd(view);
+		struct view *view;
+		wl_list_for_each(view, &server->views, link) {
+			view_reload_ssd(view);
+		}
+		resize_indicator_reconfigure(server);
+		workspaces_osd_reconfigure(server);
+		/* The snapping overlay rects are kept with the old colors */
+		overlay_reset(&server->seat);
 	}
 
-	menu_reconfigure(server);
+	if (menu_changed) {
+		menu_reconfigure(server, menu_docs);
+	} else if (menu_docs) {
+		lab_xml_docs_release(menu_docs);
+	}
 	seat_reconfigure(server);
-	regions_reconfigure(server);
-	resize_indicator_reconfigure(server);
+	if (SECTION_CHANGED(REGIONS)) {
+		regions_reconfigure(server);
+	} else if (SECTION_CHANGED(CORE)) {
+		/* The region snap boxes depend on <core><gap> */
+		struct output *output;
+		wl_list_for_each(output, &server->outputs, link) {
+			regions_update_geometry(output);
+		}
+	}
+	if (SECTION_CHANGED(CORE)) {
+		memory_pressure_finish();
+		memory_pressure_init(server);
+		metrics_reconfigure();
+	}
+	hidden_frames_reconfigure();
 	kde_server_decoration_update_default();
-	workspaces_reconfigure(server);
+	if (SECTION_CHANGED(DESKTOPS)) {
+		workspaces_reconfigure(server);
+	}
+#undef SECTION_CHANGED
+	tiling_set_layout(server, rc.tiling_layout);
+	/* Keybinds have been re-created */
+	ipc_emit(IPC_EVENT_KEYBIND);
+	desktop_schedule_arrange_tiled(server);
 }
 
-static int
-handle_sighup(int signal, void *data)
+static void
+load_config_files(struct worker_job *job, void *data)
 {
-	struct server *server = data;
+	rcxml_load(&reload.rc_paths, &reload.rc_docs);
+	menu_load(&reload.menu_paths, &reload.menu_docs);
+}
+
+static void start_loading_config(struct server *server);
+
+static void
+apply_config_files(void *data, bool cancelled)
+{
+	struct server *server = reload.server;
+	reload.job = NULL;
+	paths_destroy(&reload.rc_paths);
+	paths_destroy(&reload.menu_paths);
+	if (cancelled) {
+		lab_xml_docs_release(&reload.rc_docs);
+		lab_xml_docs_release(&reload.menu_docs);
+		return;
+	}
 
 	keyboard_cancel_all_keybind_repeats(&server->seat);
-	session_environment_init();
-	reload_config_and_theme(server);
+	reload_config_and_theme(server, &reload.rc_docs, &reload.menu_docs);
 	output_virtual_update_fallback(server);
 	session_run_script("reconfigure");
+
+	if (reload.again) {
+		reload.again = false;
+		start_loading_config(server);
+	}
+}
+
+static void
+start_loading_config(struct server *server)
+{
+	/* The environment decides about the paths, so set it up first */
+	session_environment_init();
+	session_update_activation_env(server);
+
+	reload.server = server;
+	rcxml_get_paths(&reload.rc_paths, rc.config_file);
+	paths_config_create(&reload.menu_paths, "menu.xml");
+	wl_array_init(&reload.rc_docs);
+	wl_array_init(&reload.menu_docs);
+
+	reload.job = worker_pool_submit(load_config_files,
+		apply_config_files, NULL);
+	if (!reload.job) {
+		/* No worker threads, load synchronously */
+		load_config_files(NULL, NULL);
+		apply_config_files(NULL, /*cancelled*/ false);
+	}
+}
+
+static int
+handle_sighup(int signal, void *data)
+{
+	struct server *server = data;
+
+	if (reload.job) {
+		/* Start over once the running load is applied */
+		reload.again = true;
+	} else {
+		start_loading_config(server);
+	}
 	return 0;
 }
 
@@ -131,17 +299,29 @@ handle_sigterm(int signal, void *data)
 	return 0;
 }
 
-static void
-process_keybind_command(struct server *server, const char *command, const char *id)
+static int
+handle_sigusr1(int signal, void *data)
+{
+	trace_dump(NULL);
+	return 0;
+}
+
+static bool
+process_keybind_command(struct server *server, const char *command,
+		const char *id, struct buf *reply)
 {
+	if (!id) {
+		buf_add_fmt(reply, "keybind %s requires an id", command);
+		return false;
+	}
 	struct keybind *keybind = keybind_find_by_id(id);
 	if (!keybind) {
-		wlr_log(WLR_ERROR, "Keybind with id '%s' not found", id);
-		return;
+		buf_add_fmt(reply, "Keybind with id '%s' not found", id);
+		return false;
 	}
 	if (!keybind->toggleable) {
-		wlr_log(WLR_ERROR, "Keybind with id '%s' is not toggleable", id);
-		return;
+		buf_add_fmt(reply, "Keybind with id '%s' is not toggleable", id);
+		return false;
 	}
 
 	if (!strcmp(command, "enable")) {
@@ -155,8 +335,11 @@ process_keybind_command(struct server *server, const char *command, const char *
 		wlr_log(WLR_INFO, "%s keybind with id '%s'",
 			keybind->enabled ? "Enabled" : "Disabled", id);
 	} else {
-		wlr_log(WLR_ERROR, "Unknown keybind command: %s", command);
+		buf_add_fmt(reply, "Unknown keybind command: %s", command);
+		return false;
 	}
+	ipc_emit(IPC_EVENT_KEYBIND);
+	return true;
 }
 
 static void
@@ -196,57 +379,137 @@ update_tiling_status_file(struct server *server)
 	if (!f) {
 		return;
 	}
+	fprintf(f, "%s\n", tiling_status(server));
+	fclose(f);
+}
 
-	if (!server->tiling_mode) {
-		fprintf(f, "stacking\n");
-	} else if (server->tiling_grid_mode) {
-		fprintf(f, "grid\n");
+static bool
+process_tiling_command(struct server *server, const char *command,
+		const char *arg, struct buf *reply)
+{
+	if (!strcmp(command, "enable")) {
+		server->tiling_mode = true;
+		wlr_log(WLR_INFO, "Tiling mode enabled");
+		desktop_arrange_tiled(server);
+	} else if (!strcmp(command, "disable")) {
+		server->tiling_mode = false;
+		/* Clear resized view tracking when disabling tiling */
+		server->resized_view = NULL;
+		wlr_log(WLR_INFO, "Tiling mode disabled");
+	} else if (!strcmp(command, "toggle")) {
+		server->tiling_mode = !server->tiling_mode;
+		/* Clear resized view tracking when disabling tiling */
+		if (!server->tiling_mode) {
+			server->resized_view = NULL;
+		}
+		wlr_log(WLR_INFO, "Tiling mode %s",
+			server->tiling_mode ? "enabled" : "disabled");
+		if (server->tiling_mode) {
+			desktop_arrange_tiled(server);
+		}
+	} else if (!strcmp(command, "grid-mode")) {
+		if (!arg) {
+			buf_add(reply, "grid-mode requires on, off or toggle");
+			return false;
+		}
+		if (!strcmp(arg, "on") || !strcmp(arg, "true") || !strcmp(arg, "1")) {
+			server->tiling_grid_mode = true;
+			/* Clear resized view tracking when enabling grid mode */
+			server->resized_view = NULL;
+			wlr_log(WLR_INFO, "Tiling grid mode enabled (simple grid snapping)");
+		} else if (!strcmp(arg, "off") || !strcmp(arg, "false") || !strcmp(arg, "0")) {
+			server->tiling_grid_mode = false;
+			wlr_log(WLR_INFO, "Tiling grid mode disabled (smart resize preservation)");
+		} else if (!strcmp(arg, "toggle")) {
+			server->tiling_grid_mode = !server->tiling_grid_mode;
+			/* Clear resized view tracking when enabling grid mode */
+			if (server->tiling_grid_mode) {
+				server->resized_view = NULL;
+			}
+			wlr_log(WLR_INFO, "Tiling grid mode %s",
+				server->tiling_grid_mode ? "enabled" : "disabled");
+		} else {
+			buf_add_fmt(reply, "Invalid grid-mode '%s'", arg);
+			return false;
+		}
+		if (server->tiling_mode) {
+			desktop_arrange_tiled(server);
+		}
+	} else if (!strcmp(command, "layout")) {
+		enum lab_tiling_layout layout = arg
+			? tiling_layout_parse(arg) : LAB_TILING_LAYOUT_INVALID;
+		if (layout == LAB_TILING_LAYOUT_INVALID) {
+			buf_add_fmt(reply, "Unknown tiling layout '%s'", arg ? arg : "");
+			return false;
+		}
+		tiling_set_layout(server, layout);
+	} else if (!strcmp(command, "recalculate")) {
+		if (!server->tiling_mode) {
+			buf_add(reply, "Tiling mode is disabled, cannot recalculate");
+			return false;
+		}
+		wlr_log(WLR_INFO, "Recalculating tiling layout");
+		desktop_arrange_tiled(server);
+	} else if (!strcmp(command, "status")) {
+		buf_add(reply, tiling_status(server));
+		update_tiling_status_file(server);
+		return true;
 	} else {
-		fprintf(f, "smart\n");
+		buf_add_fmt(reply, "Unknown tiling command: %s", command);
+		return false;
 	}
-	fclose(f);
+	update_tiling_status_file(server);
+	ipc_emit(IPC_EVENT_TILING);
+	return true;
 }
 
-static void
-process_workspace_command(struct server *server, const char *command, const char *arg)
+static bool
+process_workspace_command(struct server *server, const char *command,
+		const char *arg, struct buf *reply)
 {
 	struct workspace *target = NULL;
 
 	if (!strcmp(command, "switch")) {
 		if (!arg) {
-			wlr_log(WLR_ERROR, "workspace switch command requires an argument");
-			return;
+			buf_add(reply, "workspace switch command requires an argument");
+			return false;
 		}
 		target = workspaces_find(server->workspaces.current, arg, false);
-		if (target) {
-			workspaces_switch_to(target, true);
-			wlr_log(WLR_INFO, "Switched to workspace '%s'", target->name);
-		} else {
-			wlr_log(WLR_ERROR, "Workspace '%s' not found", arg);
+		if (!target) {
+			buf_add_fmt(reply, "Workspace '%s' not found", arg);
+			return false;
 		}
+		workspaces_switch_to(target, true);
+		wlr_log(WLR_INFO, "Switched to workspace '%s'", target->name);
 	} else if (!strcmp(command, "next")) {
 		target = workspaces_find(server->workspaces.current, "right", false);
-		if (target) {
-			workspaces_switch_to(target, true);
-			wlr_log(WLR_INFO, "Switched to next workspace '%s'", target->name);
-		} else {
-			wlr_log(WLR_ERROR, "No next workspace available");
+		if (!target) {
+			buf_add(reply, "No next workspace available");
+			return false;
 		}
+		workspaces_switch_to(target, true);
+		wlr_log(WLR_INFO, "Switched to next workspace '%s'", target->name);
 	} else if (!strcmp(command, "prev")) {
 		target = workspaces_find(server->workspaces.current, "left", false);
-		if (target) {
-			workspaces_switch_to(target, true);
-			wlr_log(WLR_INFO, "Switched to previous workspace '%s'", target->name);
-		} else {
-			wlr_log(WLR_ERROR, "No previous workspace available");
+		if (!target) {
+			buf_add(reply, "No previous workspace available");
+			return false;
 		}
+		workspaces_switch_to(target, true);
+		wlr_log(WLR_INFO, "Switched to previous workspace '%s'", target->name);
+	} else if (!strcmp(command, "current")) {
+		if (server->workspaces.current) {
+			buf_add(reply, server->workspaces.current->name);
+		}
+		return true;
 	} else {
-		wlr_log(WLR_ERROR, "Unknown workspace command: %s", command);
-		return;
+		buf_add_fmt(reply, "Unknown workspace command: %s", command);
+		return false;
 	}
 
 	/* Update status file after workspace change */
 	update_workspace_status_file(server);
+	return true;
 }
 
 static void
@@ -274,22 +537,18 @@ parse_resolution(const char *str, int *width, int *height, int32_t *refresh)
 	}
 }
 
-static void
-process_virtual_output_command(struct server *server, const char *command, const char *arg)
+static bool
+process_virtual_output_command(struct server *server, const char *command,
+		const char *arg, struct buf *reply)
 {
 	if (!strcmp(command, "add")) {
 		if (!arg) {
-			wlr_log(WLR_ERROR, "virtual-output-add command requires arguments");
-			return;
+			buf_add(reply, "virtual-output-add command requires arguments");
+			return false;
 		}
 
 		/* Parse: "name:WIDTHxHEIGHT@REFRESH" or "name:WIDTHxHEIGHT" or just "name" */
-		char *arg_copy = strdup(arg);
-		if (!arg_copy) {
-			wlr_log(WLR_ERROR, "Failed to allocate memory");
-			return;
-		}
-
+		char *arg_copy = xstrdup(arg);
 		char *name = arg_copy;
 		char *resolution_str = NULL;
 		char *colon = strchr(arg_copy, ':');
@@ -324,302 +583,484 @@ process_virtual_output_command(struct server *server, const char *command, const
 			wlr_log(WLR_INFO, "Removed last virtual output");
 		}
 	} else {
-		wlr_log(WLR_ERROR, "Unknown virtual output command: %s", command);
-		return;
+		buf_add_fmt(reply, "Unknown virtual output command: %s", command);
+		return false;
 	}
+	return true;
 }
 
-/* Forward declaration */
-void tiling_timer_update(struct server *server);
+static bool
+process_output_command(struct server *server, const char *command,
+		struct buf *reply)
+{
+	if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect output statistics");
+			return false;
+		}
+		output_stats_print(server, stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		struct output *output;
+		wl_list_for_each(output, &server->outputs, link) {
+			output_stats_reset(&output->stats);
+		}
+		wlr_log(WLR_INFO, "Output statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown output command: %s", command);
+		return false;
+	}
+	return true;
+}
 
-static int
-handle_sigusr1(int signal, void *data)
+/*
+ * Run the action given as "<name> [<argument>=<value>]...", where values
+ * cannot contain spaces. Used by scripts and lab-bench to drive actions
+ * without synthesizing input events.
+ */
+static bool
+run_action_command(struct server *server, const char *arg, struct buf *reply)
 {
-	struct server *server = data;
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (!runtime_dir) {
-		return 0;
+	if (!arg) {
+		buf_add(reply, "run requires an action name");
+		return false;
+	}
+	gchar **tokens = g_strsplit(arg, " ", -1);
+	struct action *action = action_create(tokens[0]);
+	if (!action) {
+		buf_add_fmt(reply, "Invalid action: %s", tokens[0]);
+		g_strfreev(tokens);
+		return false;
+	}
+	for (gchar **token = tokens + 1; *token; token++) {
+		char *value = strchr(*token, '=');
+		if (!value) {
+			continue;
+		}
+		*value++ = '\0';
+		action_arg_from_xml_node(action, *token, value);
+	}
+	g_strfreev(tokens);
+	if (!action_is_valid(action)) {
+		buf_add(reply, "Missing or invalid action arguments");
+		action_free(action);
+		return false;
 	}
 
-	/* Check for keybind command */
-	char cmd_file[256];
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-keybind-cmd", runtime_dir);
+	struct wl_list actions;
+	wl_list_init(&actions);
+	wl_list_insert(&actions, &action->link);
+	actions_run(NULL, server, &actions, NULL);
+	action_list_free(&actions);
+	return true;
+}
 
-	FILE *f = fopen(cmd_file, "r");
-	if (f) {
-		char command[32];
-		char id[256];
-		if (fscanf(f, "%31s %255s", command, id) == 2) {
-			process_keybind_command(server, command, id);
+static bool
+process_action_command(struct server *server, const char *command,
+		const char *arg, struct buf *reply)
+{
+	if (!strcmp(command, "run")) {
+		return run_action_command(server, arg, reply);
+	} else if (!strcmp(command, "finish-cycle")) {
+		/* Like releasing the modifiers of the window switcher keybind */
+		if (server->input_mode == LAB_INPUT_STATE_CYCLE) {
+			cycle_finish(server, /*switch_focus*/ true);
 		}
-		fclose(f);
-		unlink(cmd_file);
-		return 0;
-	}
-
-	/* Check for workspace command */
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-workspace-cmd", runtime_dir);
-
-	f = fopen(cmd_file, "r");
-	if (f) {
-		char line[288]; /* 32 + 1 + 255 for command + space + arg */
-		if (fgets(line, sizeof(line), f)) {
-			char command[32];
-			char arg[256];
-			/* Try to read command with optional argument */
-			if (sscanf(line, "%31s %255s", command, arg) == 2) {
-				process_workspace_command(server, command, arg);
-			} else if (sscanf(line, "%31s", command) == 1) {
-				process_workspace_command(server, command, NULL);
-			}
+	} else if (!strcmp(command, "profile")) {
+		if (!arg) {
+			buf_add(reply, "profile requires on, off or toggle");
+			return false;
 		}
-		fclose(f);
-		unlink(cmd_file);
-		return 0;
-	}
-
-	/* Check for tiling command */
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-tiling-cmd", runtime_dir);
-
-	f = fopen(cmd_file, "r");
-	if (f) {
-		char line[288];
-		if (fgets(line, sizeof(line), f)) {
-			char command[32];
-			char arg[256];
-			if (sscanf(line, "%31s %255s", command, arg) == 2) {
-				if (!strcmp(command, "enable")) {
-					server->tiling_mode = true;
-					wlr_log(WLR_INFO, "Tiling mode enabled");
-					desktop_arrange_tiled(server);
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "disable")) {
-					server->tiling_mode = false;
-					/* Clear resized view tracking when disabling tiling */
-					server->resized_view = NULL;
-					wlr_log(WLR_INFO, "Tiling mode disabled");
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "toggle")) {
-					server->tiling_mode = !server->tiling_mode;
-					/* Clear resized view tracking when disabling tiling */
-					if (!server->tiling_mode) {
-						server->resized_view = NULL;
-					}
-					wlr_log(WLR_INFO, "Tiling mode %s",
-						server->tiling_mode ? "enabled" : "disabled");
-					if (server->tiling_mode) {
-						desktop_arrange_tiled(server);
-					}
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "grid-mode")) {
-					if (!strcmp(arg, "on") || !strcmp(arg, "true") || !strcmp(arg, "1")) {
-						server->tiling_grid_mode = true;
-						/* Clear resized view tracking when enabling grid mode */
-						server->resized_view = NULL;
-						wlr_log(WLR_INFO, "Tiling grid mode enabled (simple grid snapping)");
-					} else if (!strcmp(arg, "off") || !strcmp(arg, "false") || !strcmp(arg, "0")) {
-						server->tiling_grid_mode = false;
-						wlr_log(WLR_INFO, "Tiling grid mode disabled (smart resize preservation)");
-					} else if (!strcmp(arg, "toggle")) {
-						server->tiling_grid_mode = !server->tiling_grid_mode;
-						/* Clear resized view tracking when enabling grid mode */
-						if (server->tiling_grid_mode) {
-							server->resized_view = NULL;
-						}
-						wlr_log(WLR_INFO, "Tiling grid mode %s",
-							server->tiling_grid_mode ? "enabled" : "disabled");
-					}
-					if (server->tiling_mode) {
-						desktop_arrange_tiled(server);
-					}
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "recalculate")) {
-					if (server->tiling_mode) {
-						wlr_log(WLR_INFO, "Recalculating tiling layout");
-						desktop_arrange_tiled(server);
-					} else {
-						wlr_log(WLR_INFO, "Tiling mode is disabled, cannot recalculate");
-					}
-				} else if (!strcmp(command, "status")) {
-					update_tiling_status_file(server);
-					wlr_log(WLR_INFO, "Tiling status updated");
-				}
-			} else if (sscanf(line, "%31s", command) == 1) {
-				if (!strcmp(command, "enable")) {
-					server->tiling_mode = true;
-					wlr_log(WLR_INFO, "Tiling mode enabled");
-					desktop_arrange_tiled(server);
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "disable")) {
-					server->tiling_mode = false;
-					/* Clear resized view tracking when disabling tiling */
-					server->resized_view = NULL;
-					wlr_log(WLR_INFO, "Tiling mode disabled");
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "toggle")) {
-					server->tiling_mode = !server->tiling_mode;
-					wlr_log(WLR_INFO, "Tiling mode %s",
-						server->tiling_mode ? "enabled" : "disabled");
-					if (server->tiling_mode) {
-						desktop_arrange_tiled(server);
-					}
-					tiling_timer_update(server);
-					update_tiling_status_file(server);
-				} else if (!strcmp(command, "recalculate")) {
-					if (server->tiling_mode) {
-						wlr_log(WLR_INFO, "Recalculating tiling layout");
-						desktop_arrange_tiled(server);
-					} else {
-						wlr_log(WLR_INFO, "Tiling mode is disabled, cannot recalculate");
-					}
-				} else if (!strcmp(command, "status")) {
-					update_tiling_status_file(server);
-					wlr_log(WLR_INFO, "Tiling status updated");
-				}
-			}
+		if (!strcmp(arg, "on")) {
+			action_stats_enable(true);
+		} else if (!strcmp(arg, "off")) {
+			action_stats_enable(false);
+		} else if (!strcmp(arg, "toggle")) {
+			action_stats_enable(!action_stats_enabled());
+		} else {
+			buf_add_fmt(reply, "Invalid profile argument: %s", arg);
+			return false;
 		}
-		fclose(f);
-		unlink(cmd_file);
-		return 0;
-	}
-
-	/* Check for virtual output command */
-	snprintf(cmd_file, sizeof(cmd_file), "%s/labwc-virtual-output-cmd", runtime_dir);
-
-	f = fopen(cmd_file, "r");
-	if (f) {
-		char line[288];
-		if (fgets(line, sizeof(line), f)) {
-			char command[32];
-			char arg[256];
-			/* Try to read command with optional argument */
-			if (sscanf(line, "%31s %255s", command, arg) == 2) {
-				process_virtual_output_command(server, command, arg);
-			} else if (sscanf(line, "%31s", command) == 1) {
-				process_virtual_output_command(server, command, NULL);
-			}
+	} else if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect action statistics");
+			return false;
 		}
-		fclose(f);
-		unlink(cmd_file);
-		return 0;
+		action_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		action_stats_reset();
+		wlr_log(WLR_INFO, "Action statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown action command: %s", command);
+		return false;
 	}
+	return true;
+}
 
-	return 0;
+static bool
+process_configure_command(const char *command, struct buf *reply)
+{
+	if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect configure statistics");
+			return false;
+		}
+		configure_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		configure_stats_reset();
+		wlr_log(WLR_INFO, "Configure statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown configure command: %s", command);
+		return false;
+	}
+	return true;
 }
 
-/* Timer callback for proactive tiling recalculation in smart resize mode */
-static int
-tiling_recalculate_timer_handler(void *data)
+static bool
+process_worker_command(const char *command, struct buf *reply)
 {
-	struct server *server = data;
-	if (server->tiling_mode && !server->tiling_grid_mode) {
-		desktop_arrange_tiled(server);
-		/* Reschedule timer for next check (200ms) */
-		if (server->tiling_recalculate_timer) {
-			wl_event_source_timer_update(server->tiling_recalculate_timer, 200);
+	if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect worker statistics");
+			return false;
+		}
+		worker_pool_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		worker_pool_stats_reset();
+		wlr_log(WLR_INFO, "Worker statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown worker command: %s", command);
+		return false;
+	}
+	return true;
+}
+
+static bool
+process_timer_command(const char *command, struct buf *reply)
+{
+	if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect timer statistics");
+			return false;
 		}
-		return 0;
+		lab_timer_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		lab_timer_stats_reset();
+		wlr_log(WLR_INFO, "Timer statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown timer command: %s", command);
+		return false;
 	}
-	/* Stop timer if conditions aren't met */
-	return 0;
+	return true;
 }
 
-void
-tiling_timer_update(struct server *server)
+static bool
+process_latency_command(const char *command, const char *arg,
+		struct buf *reply)
 {
-	/* Start timer if smart resize mode is enabled and no resize is in progress */
-	if (server->tiling_mode && !server->tiling_grid_mode &&
-	    server->input_mode != LAB_INPUT_STATE_RESIZE) {
-		if (!server->tiling_recalculate_timer) {
-			/* Create timer with 200ms interval */
-			server->tiling_recalculate_timer = wl_event_loop_add_timer(
-				server->wl_event_loop, tiling_recalculate_timer_handler, server);
-			if (server->tiling_recalculate_timer) {
-				wl_event_source_timer_update(server->tiling_recalculate_timer, 200);
-			}
+	if (!strcmp(command, "tracing")) {
+		if (arg && !strcmp(arg, "on")) {
+			input_latency_enable(true);
+		} else if (arg && !strcmp(arg, "off")) {
+			input_latency_enable(false);
 		} else {
-			/* Timer exists, just update it to keep it running */
-			wl_event_source_timer_update(server->tiling_recalculate_timer, 200);
+			buf_add(reply, "tracing requires on or off");
+			return false;
 		}
-	} else {
-		/* Stop timer if smart resize mode is disabled or resize is in progress */
-		if (server->tiling_recalculate_timer) {
-			wl_event_source_remove(server->tiling_recalculate_timer);
-			server->tiling_recalculate_timer = NULL;
+		wlr_log(WLR_INFO, "Input latency tracing %s", arg);
+	} else if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect latency statistics");
+			return false;
 		}
+		input_latency_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		input_latency_reset();
+		wlr_log(WLR_INFO, "Input latency statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown latency command: %s", command);
+		return false;
 	}
+	return true;
 }
 
-static int
-handle_sigchld(int signal, void *data)
+static bool
+process_debug_command(const char *command, const char *arg,
+		struct buf *reply)
 {
-	siginfo_t info;
-	info.si_pid = 0;
-	struct server *server = data;
+	if (strcmp(command, "categories")) {
+		buf_add_fmt(reply, "Unknown debug command: %s", command);
+		return false;
+	}
+	if (arg && !lab_log_parse_categories(arg, &lab_log_categories)) {
+		buf_add_fmt(reply, "Invalid debug categories: %s", arg);
+		return false;
+	}
+	lab_log_print_categories(reply, lab_log_categories);
+	return true;
+}
 
-	/* First call waitid() with NOWAIT which doesn't consume the zombie */
-	if (waitid(P_ALL, /*id*/ 0, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
-		return 0;
+static bool
+process_scene_command(struct server *server, const char *command,
+		struct buf *reply)
+{
+	if (strcmp(command, "stats")) {
+		buf_add_fmt(reply, "Unknown scene command: %s", command);
+		return false;
+	}
+	char *stats = NULL;
+	size_t size = 0;
+	FILE *stream = open_memstream(&stats, &size);
+	if (!stream) {
+		buf_add(reply, "Failed to collect scene statistics");
+		return false;
 	}
+	debug_scene_stats(server, stream);
+	fclose(stream);
+	buf_add(reply, stats);
+	free(stats);
+	return true;
+}
 
-	if (info.si_pid == 0) {
-		/* No children in waitable state */
-		return 0;
+static bool
+process_trace_command(const char *command, const char *arg,
+		struct buf *reply)
+{
+	if (!strcmp(command, "mode")) {
+		if (!arg || !trace_set_mode(arg)) {
+			buf_add_fmt(reply, "Invalid trace mode: %s", arg ? arg : "");
+			return false;
+		}
+	} else if (!strcmp(command, "dump")) {
+		if (!trace_dump(arg)) {
+			buf_add(reply, "Failed to write the trace, see the log");
+			return false;
+		}
+	} else {
+		buf_add_fmt(reply, "Unknown trace command: %s", command);
+		return false;
 	}
+	return true;
+}
 
-#if HAVE_XWAYLAND
-	/* Ensure that we do not break xwayland lazy initialization */
-	if (server->xwayland && server->xwayland->server
-			&& info.si_pid == server->xwayland->server->pid) {
-		return 0;
+static bool
+process_buffer_cache_command(const char *command, struct buf *reply)
+{
+	if (!strcmp(command, "stats")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect buffer cache statistics");
+			return false;
+		}
+		scaled_buffer_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "memory")) {
+		char *stats = NULL;
+		size_t size = 0;
+		FILE *stream = open_memstream(&stats, &size);
+		if (!stream) {
+			buf_add(reply, "Failed to collect buffer memory statistics");
+			return false;
+		}
+		buffer_stats_print(stream);
+		fclose(stream);
+		buf_add(reply, stats);
+		free(stats);
+	} else if (!strcmp(command, "reset-stats")) {
+		scaled_buffer_stats_reset();
+		buffer_stats_reset_peaks();
+		wlr_log(WLR_INFO, "Buffer cache statistics reset");
+	} else {
+		buf_add_fmt(reply, "Unknown buffer-cache command: %s", command);
+		return false;
 	}
-#endif
+	return true;
+}
 
-	/* And then do the actual (consuming) lookup again */
-	int ret = waitid(P_PID, info.si_pid, &info, WEXITED);
-	if (ret == -1) {
-		wlr_log(WLR_ERROR, "blocking waitid() for %ld failed: %d",
-			(long)info.si_pid, ret);
-		return 0;
+static bool
+process_metrics_command(const char *command, struct buf *reply)
+{
+	if (strcmp(command, "dump")) {
+		buf_add_fmt(reply, "Unknown metrics command: %s", command);
+		return false;
+	}
+	char *metrics = NULL;
+	size_t size = 0;
+	FILE *stream = open_memstream(&metrics, &size);
+	if (!stream) {
+		buf_add(reply, "Failed to collect metrics");
+		return false;
 	}
+	metrics_print(stream);
+	fclose(stream);
+	buf_add(reply, metrics);
+	free(metrics);
+	return true;
+}
+
+bool
+server_run_command(struct server *server, const char *domain,
+		const char *command, const char *arg, struct buf *reply)
+{
+	if (!strcmp(domain, "keybind")) {
+		return process_keybind_command(server, command, arg, reply);
+	} else if (!strcmp(domain, "workspace")) {
+		return process_workspace_command(server, command, arg, reply);
+	} else if (!strcmp(domain, "tiling")) {
+		return process_tiling_command(server, command, arg, reply);
+	} else if (!strcmp(domain, "virtual-output")) {
+		return process_virtual_output_command(server, command, arg, reply);
+	} else if (!strcmp(domain, "output")) {
+		return process_output_command(server, command, reply);
+	} else if (!strcmp(domain, "action")) {
+		return process_action_command(server, command, arg, reply);
+	} else if (!strcmp(domain, "buffer-cache")) {
+		return process_buffer_cache_command(command, reply);
+	} else if (!strcmp(domain, "configure")) {
+		return process_configure_command(command, reply);
+	} else if (!strcmp(domain, "trace")) {
+		return process_trace_command(command, arg, reply);
+	} else if (!strcmp(domain, "scene")) {
+		return process_scene_command(server, command, reply);
+	} else if (!strcmp(domain, "worker")) {
+		return process_worker_command(command, reply);
+	} else if (!strcmp(domain, "timer")) {
+		return process_timer_command(command, reply);
+	} else if (!strcmp(domain, "latency")) {
+		return process_latency_command(command, arg, reply);
+	} else if (!strcmp(domain, "debug")) {
+		return process_debug_command(command, arg, reply);
+	} else if (!strcmp(domain, "metrics")) {
+		return process_metrics_command(command, reply);
+	}
+	buf_add_fmt(reply, "Unknown command domain: %s", domain);
+	return false;
+}
 
+static void
+handle_child_exited(pid_t pid, int code, int status, void *data)
+{
+	struct server *server = data;
 	const char *signame;
-	switch (info.si_code) {
+	switch (code) {
 	case CLD_EXITED:
-		if (!action_check_prompt_result(info.si_pid, info.si_status)) {
-			wlr_log(info.si_status == 0 ? WLR_DEBUG : WLR_ERROR,
+		if (!action_check_prompt_result(pid, status)
+				&& !session_check_activation_result(pid, status)
+				&& !session_check_script_result(pid, status)) {
+			wlr_log(status == 0 ? WLR_DEBUG : WLR_ERROR,
 				"spawned child %ld exited with %d",
-				(long)info.si_pid, info.si_status);
+				(long)pid, status);
 		}
 		break;
 	case CLD_KILLED:
 	case CLD_DUMPED:
-		signame = strsignal(info.si_status);
+		signame = strsignal(status);
 		wlr_log(WLR_ERROR,
 			"spawned child %ld terminated with signal %d (%s)",
-				(long)info.si_pid, info.si_status,
+				(long)pid, status,
 				signame ? signame : "unknown");
 		/* Allow cleanup of killed prompt */
-		action_check_prompt_result(info.si_pid, -info.si_status);
+		action_check_prompt_result(pid, -status);
+		session_check_activation_result(pid, -status);
+		session_check_script_result(pid, -status);
 		break;
 	default:
 		wlr_log(WLR_ERROR,
 			"spawned child %ld terminated unexpectedly: %d"
-			" please report", (long)info.si_pid, info.si_code);
+			" please report", (long)pid, code);
 	}
 
-	if (info.si_pid == server->primary_client_pid) {
-		wlr_log(WLR_INFO, "primary client %ld exited", (long)info.si_pid);
+	if (pid == server->primary_client_pid) {
+		wlr_log(WLR_INFO, "primary client %ld exited", (long)pid);
 		wl_display_terminate(server->wl_display);
 	}
+}
 
-	return 0;
+/*
+ * Signals coalesce, so reap every waitable child rather than one per
+ * SIGCHLD. Children with a pidfd are usually gone by now.
+ */
+static int
+handle_sigchld(int signal, void *data)
+{
+	struct server *server = data;
+	for (;;) {
+		siginfo_t info;
+		info.si_pid = 0;
+
+		/* First call waitid() with NOWAIT which doesn't consume the zombie */
+		if (waitid(P_ALL, /*id*/ 0, &info,
+				WEXITED | WNOHANG | WNOWAIT) == -1) {
+			return 0;
+		}
+
+		if (info.si_pid == 0) {
+			/* No children in waitable state */
+			return 0;
+		}
+
+#if HAVE_XWAYLAND
+		/* Ensure that we do not break xwayland lazy initialization */
+		if (server->xwayland && server->xwayland->server
+				&& info.si_pid == server->xwayland->server->pid) {
+			return 0;
+		}
+#endif
+
+		if (child_watch_reap(info.si_pid)) {
+			continue;
+		}
+
+		/* And then do the actual (consuming) lookup again */
+		int ret = waitid(P_PID, info.si_pid, &info, WEXITED);
+		if (ret == -1) {
+			wlr_log(WLR_ERROR, "blocking waitid() for %ld failed: %d",
+				(long)info.si_pid, ret);
+			return 0;
+		}
+
+		handle_child_exited(info.si_pid, info.si_code, info.si_status,
+			server);
+	}
 }
 
 static void
@@ -843,14 +1284,22 @@ handle_renderer_lost(struct wl_listener *listener, void *data)
 			server->allocator, server->renderer);
 	}
 
-	reload_config_and_theme(server);
+	reload_config_and_theme(server, NULL, NULL);
 
 	magnifier_reset();
+	cycle_osd_thumbnail_reset();
 
 	wlr_allocator_destroy(old_allocator);
 	wlr_renderer_destroy(old_renderer);
 }
 
+static uint64_t
+read_nr_views(void *data)
+{
+	struct server *server = data;
+	return wl_list_length(&server->views);
+}
+
 void
 server_init(struct server *server)
 {
@@ -858,7 +1307,9 @@ server_init(struct server *server)
 	server->tiling_mode = false;
 	server->tiling_grid_mode = true; /* Default to grid mode (original behavior) */
 	server->resized_view = NULL;
-	server->tiling_recalculate_timer = NULL;
+	server->tiling_arrange_idle = NULL;
+	server->tiling_layout = rc.tiling_layout;
+	wl_list_init(&server->tiling_trees);
 	memset(&server->resized_view_geometry, 0, sizeof(server->resized_view_geometry));
 	/* Initialize tiling status file */
 	update_tiling_status_file(server);
@@ -871,6 +1322,7 @@ server_init(struct server *server)
 	wl_display_set_global_filter(server->wl_display, server_global_filter, server);
 
 	server->wl_event_loop = wl_display_get_event_loop(server->wl_display);
+	lab_timers_init(server->wl_event_loop);
 
 	/* Catch signals */
 	server->sighup_source = wl_event_loop_add_signal(
@@ -882,7 +1334,17 @@ server_init(struct server *server)
 	server->sigchld_source = wl_event_loop_add_signal(
 		server->wl_event_loop, SIGCHLD, handle_sigchld, server);
 	server->sigusr1_source = wl_event_loop_add_signal(
-		server->wl_event_loop, SIGUSR1, handle_sigusr1, server);
+		server->wl_event_loop, SIGUSR1, handle_sigusr1, NULL);
+	child_watch_init(server->wl_event_loop, handle_child_exited, server);
+	launcher_attach(server->wl_event_loop, handle_child_exited, server);
+
+	/* For <core><asyncTextRendering> and reconfigure */
+	worker_pool_init(server->wl_event_loop);
+	memory_pressure_init(server);
+	buffer_add_metrics();
+	scaled_buffer_add_metrics();
+	metrics_add_fn("views", NULL, "Windows, mapped or not", METRIC_GAUGE,
+		read_nr_views, server, NULL);
 
 	/*
 	 * Prevent wayland clients that request the X11 clipboard but closing
@@ -900,8 +1362,10 @@ server_init(struct server *server)
 	 * backend based on the current environment, such as opening an x11
 	 * window if an x11 server is running.
 	 */
+	startup_profile_begin("backend");
 	server->backend = wlr_backend_autocreate(
 		server->wl_event_loop, &server->session);
+	startup_profile_end();
 	if (!server->backend) {
 		wlr_log(WLR_ERROR, "unable to create backend");
 		fprintf(stderr, helpful_seat_error_message);
@@ -940,7 +1404,9 @@ server_init(struct server *server)
 	 * The renderer is responsible for defining the various pixel formats it
 	 * supports for shared memory, this configures that for clients.
 	 */
+	startup_profile_begin("renderer");
 	server->renderer = wlr_renderer_autocreate(server->backend);
+	startup_profile_end();
 	if (!server->renderer) {
 		wlr_log(WLR_ERROR, "unable to create renderer");
 		exit(EXIT_FAILURE);
@@ -979,14 +1445,20 @@ server_init(struct server *server)
 	 * the renderer and the backend. It handles the buffer creation,
 	 * allowing wlroots to render onto the screen
 	 */
+	startup_profile_begin("allocator");
 	server->allocator = wlr_allocator_autocreate(
 		server->backend, server->renderer);
+	startup_profile_end();
 	if (!server->allocator) {
 		wlr_log(WLR_ERROR, "unable to create allocator");
 		exit(EXIT_FAILURE);
 	}
 
 	wl_list_init(&server->views);
+	/* Filled by menu_init(), which may be deferred */
+	wl_list_init(&server->menus);
+	wl_list_init(&server->views_by_age);
+	wl_list_init(&server->always_on_top_views);
 	wl_list_init(&server->unmanaged_surfaces);
 	wl_list_init(&server->cycle.views);
 
@@ -1027,10 +1499,13 @@ server_init(struct server *server)
 	server->unmanaged_tree = wlr_scene_tree_create(&server->scene->tree);
 #endif
 	server->menu_tree = wlr_scene_tree_create(&server->scene->tree);
+	scene_index_init(server);
 
 	workspaces_init(server);
 
+	startup_profile_begin("output_init");
 	output_init(server);
+	startup_profile_end();
 
 	/*
 	 * Create some hands-off wlroots interfaces. The compositor is
@@ -1072,7 +1547,9 @@ server_init(struct server *server)
 		server->wl_display);
 	server->text_input_manager = wlr_text_input_manager_v3_create(
 		server->wl_display);
+	startup_profile_begin("seat_init");
 	seat_init(server);
+	startup_profile_end();
 	xdg_shell_init(server);
 	kde_server_decoration_init(server);
 	xdg_server_decoration_init(server);
@@ -1088,13 +1565,20 @@ server_init(struct server *server)
 		wlr_scene_set_linux_dmabuf_v1(server->scene, server->linux_dmabuf);
 	}
 
-	wlr_export_dmabuf_manager_v1_create(server->wl_display);
-	wlr_screencopy_manager_v1_create(server->wl_display);
-	wlr_ext_image_copy_capture_manager_v1_create(server->wl_display, 1);
-	wlr_ext_output_image_capture_source_manager_v1_create(server->wl_display, 1);
-	wlr_data_control_manager_v1_create(server->wl_display);
-	wlr_ext_data_control_manager_v1_create(server->wl_display,
-		LAB_EXT_DATA_CONTROL_VERSION);
+	/* Optional protocols, see <protocols> in labwc-config(5) */
+	if (rc.protocol_screencopy) {
+		wlr_export_dmabuf_manager_v1_create(server->wl_display);
+		server->screencopy_manager =
+			wlr_screencopy_manager_v1_create(server->wl_display);
+		wlr_ext_image_copy_capture_manager_v1_create(server->wl_display, 1);
+		wlr_ext_output_image_capture_source_manager_v1_create(
+			server->wl_display, 1);
+	}
+	if (rc.protocol_data_control) {
+		wlr_data_control_manager_v1_create(server->wl_display);
+		wlr_ext_data_control_manager_v1_create(server->wl_display,
+			LAB_EXT_DATA_CONTROL_VERSION);
+	}
 	server->security_context_manager_v1 =
 		wlr_security_context_manager_v1_create(server->wl_display);
 	wlr_viewporter_create(server->wl_display);
@@ -1103,6 +1587,7 @@ server_init(struct server *server)
 		LAB_WLR_FRACTIONAL_SCALE_V1_VERSION);
 
 	idle_manager_create(server->wl_display);
+	hidden_frames_init(server);
 
 	server->relative_pointer_manager = wlr_relative_pointer_manager_v1_create(
 		server->wl_display);
@@ -1113,24 +1598,23 @@ server_init(struct server *server)
 	wl_signal_add(&server->constraints->events.new_constraint,
 		&server->new_constraint);
 
-	server->foreign_toplevel_manager =
-		wlr_foreign_toplevel_manager_v1_create(server->wl_display);
-
-	server->foreign_toplevel_list =
-		wlr_ext_foreign_toplevel_list_v1_create(
-			server->wl_display, LAB_EXT_FOREIGN_TOPLEVEL_LIST_VERSION);
+	if (!rc.deferred_startup) {
+		server_init_foreign_toplevel(server);
+	}
 
 	wlr_alpha_modifier_v1_create(server->wl_display);
 
 	session_lock_init(server);
 
-	server->drm_lease_manager = wlr_drm_lease_v1_manager_create(
-		server->wl_display, server->backend);
+	if (rc.protocol_drm_lease) {
+		server->drm_lease_manager = wlr_drm_lease_v1_manager_create(
+			server->wl_display, server->backend);
+	}
 	if (server->drm_lease_manager) {
 		server->drm_lease_request.notify = handle_drm_lease_request;
 		wl_signal_add(&server->drm_lease_manager->events.request,
 				&server->drm_lease_request);
-	} else {
+	} else if (rc.protocol_drm_lease) {
 		wlr_log(WLR_DEBUG, "Failed to create wlr_drm_lease_device_v1");
 		wlr_log(WLR_INFO, "VR will not be available");
 	}
@@ -1142,9 +1626,13 @@ server_init(struct server *server)
 	wl_signal_add(&server->output_power_manager_v1->events.set_mode,
 		&server->output_power_manager_set_mode);
 
-	server->tearing_control = wlr_tearing_control_manager_v1_create(server->wl_display, 1);
-	server->tearing_new_object.notify = handle_tearing_new_object;
-	wl_signal_add(&server->tearing_control->events.new_object, &server->tearing_new_object);
+	if (rc.protocol_tearing_control) {
+		server->tearing_control = wlr_tearing_control_manager_v1_create(
+			server->wl_display, 1);
+		server->tearing_new_object.notify = handle_tearing_new_object;
+		wl_signal_add(&server->tearing_control->events.new_object,
+			&server->tearing_new_object);
+	}
 
 	server->tablet_manager = wlr_tablet_v2_create(server->wl_display);
 
@@ -1157,14 +1645,35 @@ server_init(struct server *server)
 	wlr_xdg_foreign_v2_create(server->wl_display, registry);
 
 #if HAVE_LIBSFDO
-	desktop_entry_init(server);
+	if (!rc.deferred_startup) {
+		startup_profile_begin("desktop_entry_init");
+		desktop_entry_init(server);
+		startup_profile_end();
+	}
 #endif
 
 #if HAVE_XWAYLAND
+	startup_profile_begin("xwayland");
 	xwayland_server_init(server, server->compositor);
+	startup_profile_end();
 #endif
 }
 
+void
+server_init_foreign_toplevel(struct server *server)
+{
+	if (!rc.protocol_foreign_toplevel) {
+		return;
+	}
+	server->foreign_toplevel_manager =
+		wlr_foreign_toplevel_manager_v1_create(server->wl_display);
+	server->foreign_toplevel_list =
+		wlr_ext_foreign_toplevel_list_v1_create(server->wl_display,
+			LAB_EXT_FOREIGN_TOPLEVEL_LIST_VERSION);
+	/* Also creates the handles of views mapped before */
+	foreign_toplevel_watch_binds(server);
+}
+
 void
 server_start(struct server *server)
 {
@@ -1179,7 +1688,10 @@ server_start(struct server *server)
 	 * Start the backend. This will enumerate outputs and inputs, become
 	 * the DRM master, etc
 	 */
-	if (!wlr_backend_start(server->backend)) {
+	startup_profile_begin("backend_start");
+	bool started = wlr_backend_start(server->backend);
+	startup_profile_end();
+	if (!started) {
 		wlr_log(WLR_ERROR, "unable to start the wlroots backend");
 		exit(EXIT_FAILURE);
 	}
@@ -1192,6 +1704,10 @@ server_start(struct server *server)
 	} else {
 		wlr_log(WLR_DEBUG, "WAYLAND_DISPLAY=%s", socket);
 	}
+
+	/* External control, see ipc.h */
+	ipc_init(server, socket);
+	metrics_init(server, socket);
 }
 
 void
@@ -1204,17 +1720,35 @@ server_finish(struct server *server)
 	desktop_entry_finish(server);
 #endif
 	wl_event_source_remove(server->sighup_source);
+	if (reload.job) {
+		worker_job_cancel(reload.job);
+	}
 	wl_event_source_remove(server->sigint_source);
 	wl_event_source_remove(server->sigterm_source);
 	wl_event_source_remove(server->sigchld_source);
 	wl_event_source_remove(server->sigusr1_source);
-	if (server->tiling_recalculate_timer) {
-		wl_event_source_remove(server->tiling_recalculate_timer);
-		server->tiling_recalculate_timer = NULL;
+	launcher_finish();
+	child_watch_finish();
+	ipc_finish();
+	metrics_finish();
+	hidden_frames_finish();
+	configure_stats_finish();
+	input_latency_finish();
+	trace_finish();
+	if (server->tiling_arrange_idle) {
+		wl_event_source_remove(server->tiling_arrange_idle);
+		server->tiling_arrange_idle = NULL;
 	}
+	if (server->arrange_all_views_timer) {
+		lab_timer_destroy(server->arrange_all_views_timer);
+		server->arrange_all_views_timer = NULL;
+	}
+	tiling_finish(server);
 
 	wl_display_destroy_clients(server->wl_display);
+	ssd_pool_finish();
 
+	condition_helper_stop();
 	seat_finish(server);
 	output_finish(server);
 	xdg_shell_finish(server);
@@ -1223,12 +1757,16 @@ server_finish(struct server *server)
 	xdg_server_decoration_finish(server);
 	wl_list_remove(&server->new_constraint.link);
 	wl_list_remove(&server->output_power_manager_set_mode.link);
-	wl_list_remove(&server->tearing_new_object.link);
+	if (server->tearing_control) {
+		wl_list_remove(&server->tearing_new_object.link);
+	}
 	if (server->drm_lease_request.notify) {
 		wl_list_remove(&server->drm_lease_request.link);
 		server->drm_lease_request.notify = NULL;
 	}
 
+	/* Cached textures must go before the renderer */
+	cycle_osd_thumbnail_reset();
 	wlr_backend_destroy(server->backend);
 	wlr_allocator_destroy(server->allocator);
 
@@ -1236,7 +1774,14 @@ server_finish(struct server *server)
 	wlr_renderer_destroy(server->renderer);
 
 	workspaces_destroy(server);
+	scene_index_finish(server);
 	wlr_scene_node_destroy(&server->scene->tree.node);
+	scaled_font_buffer_finish();
+	scaled_icon_buffer_finish();
+	scaled_buffer_finish();
+	worker_pool_finish();
+	memory_pressure_finish();
+	lab_timers_finish();
 
 	wl_display_destroy(server->wl_display);
 }
@@ -6,9 +6,11 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_session_lock_v1.h>
 #include "common/mem.h"
+#include "common/time-helpers.h"
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
+#include "timer.h"
 
 struct session_lock_output {
 	struct wlr_scene_tree *tree;
@@ -16,7 +18,7 @@ struct session_lock_output {
 	struct session_lock_manager *manager;
 	struct output *output;
 	struct wlr_session_lock_surface_v1 *surface;
-	struct wl_event_source *blank_timer;
+	struct lab_timer *blank_timer;
 
 	struct wl_list link; /* session_lock_manager.lock_outputs */
 
@@ -160,7 +162,7 @@ session_lock_output_destroy(struct session_lock_output *output)
 	wl_list_remove(&output->commit.link);
 	wl_list_remove(&output->destroy.link);
 	wl_list_remove(&output->link);
-	wl_event_source_remove(output->blank_timer);
+	lab_timer_destroy(output->blank_timer);
 	free(output);
 }
 
@@ -192,14 +194,75 @@ align_session_lock_tree(struct output *output)
 	wlr_scene_node_set_position(&output->session_lock_tree->node, box.x, box.y);
 }
 
+static void
+report_blanked(struct session_lock_manager *manager)
+{
+	if (!manager->lock_start_nsec) {
+		return;
+	}
+	struct session_lock_output *lock_output;
+	wl_list_for_each(lock_output, &manager->lock_outputs, link) {
+		if (!lock_output->background->node.enabled) {
+			return;
+		}
+	}
+	wlr_log(WLR_INFO, "session-lock: all outputs blanked after %.1f ms",
+		(time_now_nsec() - manager->lock_start_nsec) / 1e6);
+	manager->lock_start_nsec = 0;
+}
+
 static int
 handle_output_blank_timeout(void *data)
 {
 	struct session_lock_output *lock_output = data;
 	wlr_scene_node_set_enabled(&lock_output->background->node, true);
+	report_blanked(lock_output->manager);
 	return 0;
 }
 
+/* Show the pre-built lock tree of an output */
+static void
+lock_output_activate(struct session_lock_output *lock_output)
+{
+	wlr_scene_node_set_enabled(&lock_output->tree->node, true);
+
+	/*
+	 * Delay blanking output by 100ms to prevent flicker. If the session is
+	 * already locked, blank immediately.
+	 */
+	if (lock_output->manager->locked) {
+		handle_output_blank_timeout(lock_output);
+	} else {
+		lab_timer_update(lock_output->blank_timer, 100);
+	}
+}
+
+/* Hide the lock tree of an output, keeping it for the next lock */
+static void
+lock_output_deactivate(struct session_lock_output *lock_output)
+{
+	if (lock_output->surface) {
+		refocus_output(lock_output);
+		lock_output->surface = NULL;
+		wl_list_remove(&lock_output->surface_destroy.link);
+		wl_list_remove(&lock_output->surface_map.link);
+	}
+	/* Everything but the background belongs to the lock surface */
+	struct wlr_scene_node *node, *tmp;
+	wl_list_for_each_safe(node, tmp, &lock_output->tree->children, link) {
+		if (node != &lock_output->background->node) {
+			wlr_scene_node_destroy(node);
+		}
+	}
+	lab_timer_update(lock_output->blank_timer, 0);
+	wlr_scene_node_set_enabled(&lock_output->background->node, false);
+	wlr_scene_node_set_enabled(&lock_output->tree->node, false);
+}
+
+/*
+ * The lock tree of every output is built in advance and kept hidden
+ * while unlocked, so that locking only needs to enable it
+ */
 void
 session_lock_output_create(struct session_lock_manager *manager, struct output *output)
 {
@@ -230,17 +293,10 @@ session_lock_output_create(struct session_lock_manager *manager, struct output *
 		goto exit_session;
 	}
 
-	/*
-	 * Delay blanking output by 100ms to prevent flicker. If the session is
-	 * already locked, blank immediately.
-	 */
-	lock_output->blank_timer =
-		wl_event_loop_add_timer(manager->server->wl_event_loop,
-			handle_output_blank_timeout, lock_output);
-	if (!manager->locked) {
-		wlr_scene_node_set_enabled(&background->node, false);
-		wl_event_source_timer_update(lock_output->blank_timer, 100);
-	}
+	wlr_scene_node_set_enabled(&background->node, false);
+	wlr_scene_node_set_enabled(&tree->node, false);
+	lock_output->blank_timer = lab_timer_create(
+		handle_output_blank_timeout, lock_output, /*slack_ms*/ 50);
 
 	align_session_lock_tree(output);
 
@@ -258,6 +314,11 @@ session_lock_output_create(struct session_lock_manager *manager, struct output *
 	lock_output_reconfigure(lock_output);
 
 	wl_list_insert(&manager->lock_outputs, &lock_output->link);
+
+	/* An output added while locked */
+	if (manager->locked) {
+		lock_output_activate(lock_output);
+	}
 	return;
 
 exit_session:
@@ -269,10 +330,11 @@ exit_session:
 static void
 session_lock_destroy(struct session_lock_manager *manager)
 {
-	struct session_lock_output *lock_output, *next;
-	wl_list_for_each_safe(lock_output, next, &manager->lock_outputs, link) {
-		wlr_scene_node_destroy(&lock_output->tree->node);
+	struct session_lock_output *lock_output;
+	wl_list_for_each(lock_output, &manager->lock_outputs, link) {
+		lock_output_deactivate(lock_output);
 	}
+	manager->lock_start_nsec = 0;
 	if (manager->lock) {
 		wl_list_remove(&manager->lock_destroy.link);
 		wl_list_remove(&manager->lock_unlock.link);
@@ -330,18 +392,18 @@ handle_new_session_lock(struct wl_listener *listener, void *data)
 	}
 	if (manager->locked) {
 		wlr_log(WLR_INFO, "replacing abandoned lock");
-		/* clear manager->lock_outputs */
+		/* reset manager->lock_outputs */
 		session_lock_destroy(manager);
 	}
-	assert(wl_list_empty(&manager->lock_outputs));
 
 	/* Remember the focused view to restore it on unlock */
 	manager->last_active_view = manager->server->active_view;
 	seat_focus_surface(&manager->server->seat, NULL);
 
-	struct output *output;
-	wl_list_for_each(output, &manager->server->outputs, link) {
-		session_lock_output_create(manager, output);
+	manager->lock_start_nsec = time_now_nsec();
+	struct session_lock_output *lock_output;
+	wl_list_for_each(lock_output, &manager->lock_outputs, link) {
+		lock_output_activate(lock_output);
 	}
 
 	manager->lock_new_surface.notify = handle_new_surface;
@@ -364,6 +426,10 @@ handle_manager_destroy(struct wl_listener *listener, void *data)
 	struct session_lock_manager *manager =
 		wl_container_of(listener, manager, destroy);
 	session_lock_destroy(manager);
+	struct session_lock_output *lock_output, *next;
+	wl_list_for_each_safe(lock_output, next, &manager->lock_outputs, link) {
+		wlr_scene_node_destroy(&lock_output->tree->node);
+	}
 	wl_list_remove(&manager->new_lock.link);
 	wl_list_remove(&manager->destroy.link);
 	manager->server->session_lock_manager = NULL;
@@ -389,10 +455,7 @@ session_lock_init(struct server *server)
 void
 session_lock_update_for_layout_change(struct server *server)
 {
-	if (!server->session_lock_manager->locked) {
-		return;
-	}
-
+	/* Also while unlocked, to keep the pre-built lock trees ready */
 	struct output *output;
 	wl_list_for_each(output, &server->outputs, link) {
 		align_session_lock_tree(output);
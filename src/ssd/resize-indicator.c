@@ -1,19 +1,243 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <assert.h>
+#include <string.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/box.h>
 #include <wlr/util/log.h>
+#include "buffer.h"
+#include "common/font.h"
+#include "common/graphic-helpers.h"
+#include "common/hash.h"
+#include "common/mem.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "resize-indicator.h"
 #include "resize-outlines.h"
-#include "scaled-buffer/scaled-font-buffer.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "ssd.h"
 #include "theme.h"
 #include "view.h"
 
 #define PADDING rc.theme->osd_window_switcher_classic.padding
 
+/*
+ * The indicator text changes with every motion event, so rather than
+ * laying out and rasterizing the whole string each time, it is composed
+ * of one buffer per character. The glyphs are measured once per
+ * configuration, and the buffers of each glyph are shared through the
+ * scaled_buffer cache, so every glyph is rasterized once per scale. An
+ * update then only enables and positions nodes.
+ *
+ * Characters other than glyph_chars are shown as spaces.
+ */
+static const char glyph_chars[] = "0123456789-x,";
+#define NR_GLYPHS ((int)sizeof(glyph_chars) - 1)
+#define MAX_CHARS 32
+
+static struct {
+	int widths[NR_GLYPHS];
+	int space_width;
+	int height;
+	/* Bumped on reconfigure, so that old buffers are not shared */
+	unsigned int generation;
+} atlas;
+
+struct glyph_buffer {
+	struct scaled_buffer *scaled_buffer;
+	int glyph;
+	unsigned int generation;
+};
+
+struct resize_indicator_text {
+	struct wlr_scene_tree *tree;
+	/* Lazily created buffers, indexed by character position and glyph */
+	struct glyph_buffer *glyphs[MAX_CHARS][NR_GLYPHS];
+	/* Glyph shown at each position, or -1 */
+	int shown[MAX_CHARS];
+	unsigned int generation;
+	struct wl_listener destroy;
+};
+
+static void
+atlas_update(void)
+{
+	char text[2] = {0};
+	for (int i = 0; i < NR_GLYPHS; i++) {
+		text[0] = glyph_chars[i];
+		atlas.widths[i] = font_width(&rc.font_osd, text);
+	}
+	atlas.space_width = font_width(&rc.font_osd, " ");
+	atlas.height = font_height(&rc.font_osd);
+	atlas.generation++;
+}
+
+static struct lab_data_buffer *
+glyph_buffer_create_buffer(struct scaled_buffer *scaled_buffer, double scale)
+{
+	struct glyph_buffer *self = scaled_buffer->data;
+	char text[2] = { glyph_chars[self->glyph], '\0' };
+	struct lab_data_buffer *buffer = NULL;
+
+	cairo_pattern_t *bg_pattern = color_to_pattern(rc.theme->osd_bg_color);
+	font_buffer_draw(&buffer, atlas.widths[self->glyph], atlas.height,
+		atlas.height, text, &rc.font_osd,
+		rc.theme->osd_label_text_color, bg_pattern, scale);
+	zfree_pattern(bg_pattern);
+
+	if (!buffer) {
+		wlr_log(WLR_ERROR, "failed to render resize indicator glyph");
+	}
+	return buffer;
+}
+
+static void
+glyph_buffer_destroy(struct scaled_buffer *scaled_buffer)
+{
+	free(scaled_buffer->data);
+	scaled_buffer->data = NULL;
+}
+
+static bool
+glyph_buffer_equal(struct scaled_buffer *scaled_buffer_a,
+		struct scaled_buffer *scaled_buffer_b)
+{
+	struct glyph_buffer *a = scaled_buffer_a->data;
+	struct glyph_buffer *b = scaled_buffer_b->data;
+	return a->glyph == b->glyph && a->generation == b->generation;
+}
+
+static uint64_t
+glyph_buffer_hash(struct scaled_buffer *scaled_buffer)
+{
+	struct glyph_buffer *self = scaled_buffer->data;
+	uint64_t hash = hash_add(HASH_INIT, &self->glyph, sizeof(self->glyph));
+	return hash_add(hash, &self->generation, sizeof(self->generation));
+}
+
+static const struct scaled_buffer_impl glyph_buffer_impl = {
+	.create_buffer = glyph_buffer_create_buffer,
+	.destroy = glyph_buffer_destroy,
+	.equal = glyph_buffer_equal,
+	.hash = glyph_buffer_hash,
+};
+
+static struct glyph_buffer *
+glyph_buffer_create(struct wlr_scene_tree *parent, int glyph)
+{
+	struct scaled_buffer *scaled_buffer = scaled_buffer_create(parent,
+		&glyph_buffer_impl, /* drop_buffer */ true);
+	if (!scaled_buffer) {
+		return NULL;
+	}
+	scaled_buffer->category = BUFFER_OSD;
+	struct glyph_buffer *self = znew(*self);
+	self->scaled_buffer = scaled_buffer;
+	self->glyph = glyph;
+	self->generation = atlas.generation;
+	scaled_buffer->data = self;
+	scaled_buffer_request_update(scaled_buffer, atlas.widths[glyph],
+		atlas.height);
+	return self;
+}
+
+static struct wlr_scene_node *
+glyph_node(struct glyph_buffer *glyph)
+{
+	return &glyph->scaled_buffer->scene_buffer->node;
+}
+
+static void
+handle_text_destroy(struct wl_listener *listener, void *data)
+{
+	struct resize_indicator_text *text =
+		wl_container_of(listener, text, destroy);
+	/* The glyph buffers are destroyed along with their parent */
+	wl_list_remove(&text->destroy.link);
+	free(text);
+}
+
+static struct resize_indicator_text *
+text_create(struct wlr_scene_tree *parent)
+{
+	struct resize_indicator_text *text = znew(*text);
+	text->tree = wlr_scene_tree_create(parent);
+	for (int pos = 0; pos < MAX_CHARS; pos++) {
+		text->shown[pos] = -1;
+	}
+	text->generation = atlas.generation;
+	text->destroy.notify = handle_text_destroy;
+	wl_signal_add(&text->tree->node.events.destroy, &text->destroy);
+	return text;
+}
+
+/* Drop the glyph buffers of a previous configuration */
+static void
+text_reset(struct resize_indicator_text *text)
+{
+	for (int pos = 0; pos < MAX_CHARS; pos++) {
+		for (int glyph = 0; glyph < NR_GLYPHS; glyph++) {
+			if (text->glyphs[pos][glyph]) {
+				wlr_scene_node_destroy(
+					glyph_node(text->glyphs[pos][glyph]));
+				text->glyphs[pos][glyph] = NULL;
+			}
+		}
+		text->shown[pos] = -1;
+	}
+	text->generation = atlas.generation;
+}
+
+static void
+text_show_glyph(struct resize_indicator_text *text, int pos, int glyph, int x)
+{
+	int old = text->shown[pos];
+	if (old != glyph) {
+		if (old >= 0) {
+			wlr_scene_node_set_enabled(
+				glyph_node(text->glyphs[pos][old]), false);
+		}
+		text->shown[pos] = -1;
+		if (glyph < 0) {
+			return;
+		}
+		if (!text->glyphs[pos][glyph]) {
+			text->glyphs[pos][glyph] =
+				glyph_buffer_create(text->tree, glyph);
+			if (!text->glyphs[pos][glyph]) {
+				return;
+			}
+		}
+		wlr_scene_node_set_enabled(glyph_node(text->glyphs[pos][glyph]), true);
+		text->shown[pos] = glyph;
+	}
+	if (glyph >= 0) {
+		wlr_scene_node_set_position(glyph_node(text->glyphs[pos][glyph]),
+			x, 0);
+	}
+}
+
+/* Returns the width of @str */
+static int
+text_update(struct resize_indicator_text *text, const char *str)
+{
+	if (text->generation != atlas.generation) {
+		text_reset(text);
+	}
+
+	int x = 0;
+	int pos = 0;
+	for (; str[pos] && pos < MAX_CHARS; pos++) {
+		const char *c = strchr(glyph_chars, str[pos]);
+		int glyph = c ? c - glyph_chars : -1;
+		text_show_glyph(text, pos, glyph, x);
+		x += glyph >= 0 ? atlas.widths[glyph] : atlas.space_width;
+	}
+	for (; pos < MAX_CHARS; pos++) {
+		text_show_glyph(text, pos, -1, 0);
+	}
+	return x;
+}
+
 static void
 resize_indicator_reconfigure_view(struct resize_indicator *indicator)
 {
@@ -28,7 +252,7 @@ resize_indicator_reconfigure_view(struct resize_indicator *indicator)
 	wlr_scene_node_set_position(&indicator->background->node,
 		theme->osd_border_width, theme->osd_border_width);
 
-	wlr_scene_node_set_position(&indicator->text->scene_buffer->node,
+	wlr_scene_node_set_position(&indicator->text->tree->node,
 		theme->osd_border_width + PADDING,
 		theme->osd_border_width + PADDING);
 
@@ -49,7 +273,10 @@ resize_indicator_init(struct view *view)
 		indicator->tree, 0, 0, rc.theme->osd_border_color);
 	indicator->background = wlr_scene_rect_create(
 		indicator->tree, 0, 0, rc.theme->osd_bg_color);
-	indicator->text = scaled_font_buffer_create(indicator->tree);
+	if (!atlas.height) {
+		atlas_update();
+	}
+	indicator->text = text_create(indicator->tree);
 
 	wlr_scene_node_set_enabled(&indicator->tree->node, false);
 	resize_indicator_reconfigure_view(indicator);
@@ -75,6 +302,9 @@ wants_indicator(struct view *view)
 void
 resize_indicator_reconfigure(struct server *server)
 {
+	/* Glyphs of existing indicators are replaced on their next update */
+	atlas_update();
+
 	struct view *view;
 	wl_list_for_each(view, &server->views, link) {
 		struct resize_indicator *indicator = &view->resize_indicator;
@@ -191,7 +421,7 @@ resize_indicator_update(struct view *view)
 	}
 
 	/* Let the indicator change width as required by the content */
-	int width = font_width(&rc.font_osd, text);
+	int width = text_update(indicator->text, text);
 
 	resize_indicator_set_size(indicator, width);
 
@@ -199,9 +429,6 @@ resize_indicator_update(struct view *view)
 	int x = view_box.x - view->current.x + (view_box.width - indicator->width) / 2;
 	int y = view_box.y - view->current.y + (view_box.height - indicator->height) / 2;
 	wlr_scene_node_set_position(&indicator->tree->node, x, y);
-
-	scaled_font_buffer_update(indicator->text, text, width, &rc.font_osd,
-		rc.theme->osd_label_text_color, rc.theme->osd_bg_color);
 }
 
 void
@@ -153,7 +153,7 @@ set_shadow_geometry(struct ssd *ssd)
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_shadow_subtree *subtree = &ssd->shadow.subtrees[active];
 		if (!subtree->tree) {
-			/* Looks like this type of shadow is disabled */
+			/* This type of shadow is disabled or not built yet */
 			continue;
 		}
 
@@ -194,58 +194,86 @@ make_shadow(struct view *view,
 	return scene_buf;
 }
 
+/*
+ * The shadow of the state a window is not in is only built once the window
+ * first switches to that state. The parts only reference the buffers of
+ * the theme, so unlike the titlebar they are kept once built.
+ */
+static void
+create_subtree(struct ssd *ssd, enum ssd_active_state active)
+{
+	struct theme *theme = ssd->view->server->theme;
+	struct view *view = ssd->view;
+	struct ssd_shadow_subtree *subtree = &ssd->shadow.subtrees[active];
+
+	if (!rc.shadows_enabled) {
+		/* Shadows are globally disabled */
+		return;
+	}
+	if (theme->window[active].shadow_size == 0) {
+		/* Window shadows are disabled */
+		return;
+	}
+
+	subtree->tree = wlr_scene_tree_create(ssd->shadow.tree);
+	struct wlr_scene_tree *parent = subtree->tree;
+	struct wlr_buffer *corner_top_buffer =
+		&theme->window[active].shadow_corner_top->base;
+	struct wlr_buffer *corner_bottom_buffer =
+		&theme->window[active].shadow_corner_bottom->base;
+	struct wlr_buffer *edge_buffer =
+		&theme->window[active].shadow_edge->base;
+
+	subtree->bottom_right = make_shadow(view, parent,
+		corner_bottom_buffer, WL_OUTPUT_TRANSFORM_NORMAL);
+	subtree->bottom_left = make_shadow(view, parent,
+		corner_bottom_buffer, WL_OUTPUT_TRANSFORM_FLIPPED);
+	subtree->top_left = make_shadow(view, parent,
+		corner_top_buffer, WL_OUTPUT_TRANSFORM_180);
+	subtree->top_right = make_shadow(view, parent,
+		corner_top_buffer, WL_OUTPUT_TRANSFORM_FLIPPED_180);
+	subtree->right = make_shadow(view, parent,
+		edge_buffer, WL_OUTPUT_TRANSFORM_NORMAL);
+	subtree->bottom = make_shadow(view, parent,
+		edge_buffer, WL_OUTPUT_TRANSFORM_90);
+	subtree->left = make_shadow(view, parent,
+		edge_buffer, WL_OUTPUT_TRANSFORM_180);
+	subtree->top = make_shadow(view, parent,
+		edge_buffer, WL_OUTPUT_TRANSFORM_270);
+}
+
 void
-ssd_shadow_create(struct ssd *ssd)
+ssd_shadow_create(struct ssd *ssd, bool active)
 {
 	assert(ssd);
 	assert(!ssd->shadow.tree);
 
 	ssd->shadow.tree = wlr_scene_tree_create(ssd->tree);
+	create_subtree(ssd, active);
+	ssd_shadow_update(ssd);
+}
 
-	struct theme *theme = ssd->view->server->theme;
-	struct view *view = ssd->view;
-
-	enum ssd_active_state active;
-	FOR_EACH_ACTIVE_STATE(active) {
-		struct ssd_shadow_subtree *subtree = &ssd->shadow.subtrees[active];
+void
+ssd_shadow_set_active(struct ssd *ssd, bool active)
+{
+	assert(ssd);
+	assert(ssd->shadow.tree);
 
-		if (!rc.shadows_enabled) {
-			/* Shadows are globally disabled */
-			continue;
-		}
-		if (theme->window[active].shadow_size == 0) {
-			/* Window shadows are disabled */
-			continue;
+	if (!ssd->shadow.subtrees[active].tree) {
+		create_subtree(ssd, active);
+		if (ssd->shadow.tree->node.enabled) {
+			set_shadow_geometry(ssd);
 		}
-
-		subtree->tree = wlr_scene_tree_create(ssd->shadow.tree);
-		struct wlr_scene_tree *parent = subtree->tree;
-		struct wlr_buffer *corner_top_buffer =
-			&theme->window[active].shadow_corner_top->base;
-		struct wlr_buffer *corner_bottom_buffer =
-			&theme->window[active].shadow_corner_bottom->base;
-		struct wlr_buffer *edge_buffer =
-			&theme->window[active].shadow_edge->base;
-
-		subtree->bottom_right = make_shadow(view, parent,
-			corner_bottom_buffer, WL_OUTPUT_TRANSFORM_NORMAL);
-		subtree->bottom_left = make_shadow(view, parent,
-			corner_bottom_buffer, WL_OUTPUT_TRANSFORM_FLIPPED);
-		subtree->top_left = make_shadow(view, parent,
-			corner_top_buffer, WL_OUTPUT_TRANSFORM_180);
-		subtree->top_right = make_shadow(view, parent,
-			corner_top_buffer, WL_OUTPUT_TRANSFORM_FLIPPED_180);
-		subtree->right = make_shadow(view, parent,
-			edge_buffer, WL_OUTPUT_TRANSFORM_NORMAL);
-		subtree->bottom = make_shadow(view, parent,
-			edge_buffer, WL_OUTPUT_TRANSFORM_90);
-		subtree->left = make_shadow(view, parent,
-			edge_buffer, WL_OUTPUT_TRANSFORM_180);
-		subtree->top = make_shadow(view, parent,
-			edge_buffer, WL_OUTPUT_TRANSFORM_270);
 	}
 
-	ssd_shadow_update(ssd);
+	enum ssd_active_state active_state;
+	FOR_EACH_ACTIVE_STATE(active_state) {
+		struct ssd_shadow_subtree *subtree = &ssd->shadow.subtrees[active_state];
+		if (subtree->tree) {
+			wlr_scene_node_set_enabled(&subtree->tree->node,
+				active == active_state);
+		}
+	}
 }
 
 void
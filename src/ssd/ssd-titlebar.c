@@ -7,10 +7,12 @@
 #include <wlr/types/wlr_scene.h>
 #include "buffer.h"
 #include "common/mem.h"
+#include "common/scene-helpers.h"
 #include "common/string-helpers.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "node.h"
+#include "scaled-buffer/scaled-buffer.h"
 #include "scaled-buffer/scaled-font-buffer.h"
 #include "scaled-buffer/scaled-icon-buffer.h"
 #include "scaled-buffer/scaled-img-buffer.h"
@@ -23,91 +25,170 @@ static void set_squared_corners(struct ssd *ssd, bool enable);
 static void set_alt_button_icon(struct ssd *ssd, enum lab_node_type type, bool enable);
 static void update_visible_buttons(struct ssd *ssd);
 
-void
-ssd_titlebar_create(struct ssd *ssd)
+/*
+ * The subtree of the state a window is not in is only created once the
+ * window first switches to that state, and freed again after it has been
+ * hidden for this long. Most windows never change their state, or only a
+ * few times, so this mostly halves the number of title rasterizations.
+ */
+#define SUBTREE_RELEASE_DELAY_MS (30 * 1000)
+
+static void
+create_subtree(struct ssd *ssd, enum ssd_active_state active)
 {
 	struct view *view = ssd->view;
 	struct theme *theme = view->server->theme;
 	int width = view->current.width;
 	int corner_width = ssd_get_corner_width();
 
-	ssd->titlebar.tree = wlr_scene_tree_create(ssd->tree);
-	node_descriptor_create(&ssd->titlebar.tree->node,
-		LAB_NODE_TITLEBAR, view, /*data*/ NULL);
+	struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+	subtree->tree = wlr_scene_tree_create(ssd->titlebar.tree);
+	struct wlr_scene_tree *parent = subtree->tree;
+	wlr_scene_node_set_position(&parent->node, 0, -theme->titlebar_height);
+
+	struct wlr_buffer *titlebar_fill =
+		&theme->window[active].titlebar_fill->base;
+	struct wlr_buffer *corner_top_left =
+		&theme->window[active].corner_top_left_normal->base;
+	struct wlr_buffer *corner_top_right =
+		&theme->window[active].corner_top_right_normal->base;
+
+	/* Background */
+	subtree->bar = wlr_scene_buffer_create(parent, titlebar_fill);
+	/*
+	 * Work around the wlroots/pixman bug that widened 1px buffer
+	 * becomes translucent when bilinear filtering is used.
+	 * TODO: remove once https://gitlab.freedesktop.org/wlroots/wlroots/-/issues/3990
+	 * is solved
+	 */
+	if (wlr_renderer_is_pixman(view->server->renderer)) {
+		wlr_scene_buffer_set_filter_mode(
+			subtree->bar, WLR_SCALE_FILTER_NEAREST);
+	}
+	wlr_scene_node_set_position(&subtree->bar->node, corner_width, 0);
+	lab_wlr_scene_buffer_update_opaque_region(subtree->bar);
+
+	subtree->corner_left = wlr_scene_buffer_create(parent, corner_top_left);
+	wlr_scene_node_set_position(&subtree->corner_left->node,
+		-rc.theme->border_width, -rc.theme->border_width);
+
+	subtree->corner_right = wlr_scene_buffer_create(parent, corner_top_right);
+	wlr_scene_node_set_position(&subtree->corner_right->node,
+		width - corner_width, -rc.theme->border_width);
+
+	/* Title */
+	subtree->title = scaled_font_buffer_create_for_titlebar(
+		subtree->tree, theme->titlebar_height,
+		theme->window[active].titlebar_pattern);
+	assert(subtree->title);
+	subtree->title->scaled_buffer->category = BUFFER_TITLE;
+	node_descriptor_create(&subtree->title->scene_buffer->node,
+		LAB_NODE_TITLE, view, /*data*/ NULL);
+
+	/* Buttons */
+	int x = theme->window_titlebar_padding_width;
+
+	/* Center vertically within titlebar */
+	int y = (theme->titlebar_height - theme->window_button_height) / 2;
+
+	wl_list_init(&subtree->buttons_left);
+	wl_list_init(&subtree->buttons_right);
+
+	for (int b = 0; b < rc.nr_title_buttons_left; b++) {
+		enum lab_node_type type = rc.title_buttons_left[b];
+		struct lab_img **imgs =
+			theme->window[active].button_imgs[type];
+		attach_ssd_button(&subtree->buttons_left, type, parent,
+			imgs, x, y, view);
+		x += theme->window_button_width + theme->window_button_spacing;
+	}
+
+	x = width - theme->window_titlebar_padding_width + theme->window_button_spacing;
+	for (int b = rc.nr_title_buttons_right - 1; b >= 0; b--) {
+		x -= theme->window_button_width + theme->window_button_spacing;
+		enum lab_node_type type = rc.title_buttons_right[b];
+		struct lab_img **imgs =
+			theme->window[active].button_imgs[type];
+		attach_ssd_button(&subtree->buttons_right, type, parent,
+			imgs, x, y, view);
+	}
+}
+
+/* Bring a newly created subtree in line with the current view state */
+static void
+sync_subtree_state(struct ssd *ssd, enum ssd_active_state active)
+{
+	struct view *view = ssd->view;
+
+	/* Force the title to be rendered into the new buffer */
+	ssd->state.title.dstates[active] = (struct ssd_state_title_width){
+		.truncated = true,
+	};
+
+	update_visible_buttons(ssd);
+	ssd_update_title(ssd);
 
+	bool maximized = view->maximized == VIEW_AXIS_BOTH;
+	set_squared_corners(ssd, maximized || ssd_should_be_squared(ssd));
+	set_alt_button_icon(ssd, LAB_NODE_BUTTON_MAXIMIZE, maximized);
+	set_alt_button_icon(ssd, LAB_NODE_BUTTON_SHADE, view->shaded);
+	set_alt_button_icon(ssd, LAB_NODE_BUTTON_OMNIPRESENT,
+		view->visible_on_all_workspaces);
+}
+
+static void
+release_subtree(struct ssd *ssd, enum ssd_active_state active)
+{
+	struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+	struct server *server = ssd->view->server;
+
+	/* Hidden buttons may still be marked as hovered */
+	struct ssd_button *button;
+	wl_list_for_each(button, &subtree->buttons_left, link) {
+		if (button == server->hovered_button) {
+			server->hovered_button = NULL;
+		}
+	}
+	wl_list_for_each(button, &subtree->buttons_right, link) {
+		if (button == server->hovered_button) {
+			server->hovered_button = NULL;
+		}
+	}
+
+	wlr_scene_node_destroy(&subtree->tree->node);
+	*subtree = (struct ssd_titlebar_subtree){0};
+	scene_index_invalidate(server);
+}
+
+void
+ssd_titlebar_release_hidden(struct ssd *ssd)
+{
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
-		subtree->tree = wlr_scene_tree_create(ssd->titlebar.tree);
-		struct wlr_scene_tree *parent = subtree->tree;
-		wlr_scene_node_set_enabled(&parent->node, active);
-		wlr_scene_node_set_position(&parent->node, 0, -theme->titlebar_height);
-
-		struct wlr_buffer *titlebar_fill =
-			&theme->window[active].titlebar_fill->base;
-		struct wlr_buffer *corner_top_left =
-			&theme->window[active].corner_top_left_normal->base;
-		struct wlr_buffer *corner_top_right =
-			&theme->window[active].corner_top_right_normal->base;
-
-		/* Background */
-		subtree->bar = wlr_scene_buffer_create(parent, titlebar_fill);
-		/*
-		 * Work around the wlroots/pixman bug that widened 1px buffer
-		 * becomes translucent when bilinear filtering is used.
-		 * TODO: remove once https://gitlab.freedesktop.org/wlroots/wlroots/-/issues/3990
-		 * is solved
-		 */
-		if (wlr_renderer_is_pixman(view->server->renderer)) {
-			wlr_scene_buffer_set_filter_mode(
-				subtree->bar, WLR_SCALE_FILTER_NEAREST);
+		if (subtree->tree && !subtree->tree->node.enabled) {
+			release_subtree(ssd, active);
 		}
-		wlr_scene_node_set_position(&subtree->bar->node, corner_width, 0);
+	}
+}
 
-		subtree->corner_left = wlr_scene_buffer_create(parent, corner_top_left);
-		wlr_scene_node_set_position(&subtree->corner_left->node,
-			-rc.theme->border_width, -rc.theme->border_width);
+static int
+handle_release_timeout(void *data)
+{
+	ssd_titlebar_release_hidden(data);
+	return 0;
+}
 
-		subtree->corner_right = wlr_scene_buffer_create(parent, corner_top_right);
-		wlr_scene_node_set_position(&subtree->corner_right->node,
-			width - corner_width, -rc.theme->border_width);
-
-		/* Title */
-		subtree->title = scaled_font_buffer_create_for_titlebar(
-			subtree->tree, theme->titlebar_height,
-			theme->window[active].titlebar_pattern);
-		assert(subtree->title);
-		node_descriptor_create(&subtree->title->scene_buffer->node,
-			LAB_NODE_TITLE, view, /*data*/ NULL);
-
-		/* Buttons */
-		int x = theme->window_titlebar_padding_width;
-
-		/* Center vertically within titlebar */
-		int y = (theme->titlebar_height - theme->window_button_height) / 2;
-
-		wl_list_init(&subtree->buttons_left);
-		wl_list_init(&subtree->buttons_right);
-
-		for (int b = 0; b < rc.nr_title_buttons_left; b++) {
-			enum lab_node_type type = rc.title_buttons_left[b];
-			struct lab_img **imgs =
-				theme->window[active].button_imgs[type];
-			attach_ssd_button(&subtree->buttons_left, type, parent,
-				imgs, x, y, view);
-			x += theme->window_button_width + theme->window_button_spacing;
-		}
+void
+ssd_titlebar_create(struct ssd *ssd, bool active)
+{
+	struct view *view = ssd->view;
 
-		x = width - theme->window_titlebar_padding_width + theme->window_button_spacing;
-		for (int b = rc.nr_title_buttons_right - 1; b >= 0; b--) {
-			x -= theme->window_button_width + theme->window_button_spacing;
-			enum lab_node_type type = rc.title_buttons_right[b];
-			struct lab_img **imgs =
-				theme->window[active].button_imgs[type];
-			attach_ssd_button(&subtree->buttons_right, type, parent,
-				imgs, x, y, view);
-		}
-	}
+	ssd->titlebar.tree = wlr_scene_tree_create(ssd->tree);
+	node_descriptor_create(&ssd->titlebar.tree->node,
+		LAB_NODE_TITLEBAR, view, /*data*/ NULL);
+
+	create_subtree(ssd, active);
 
 	update_visible_buttons(ssd);
 
@@ -133,6 +214,37 @@ ssd_titlebar_create(struct ssd *ssd)
 	}
 }
 
+void
+ssd_titlebar_set_active(struct ssd *ssd, bool active)
+{
+	struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+	if (!subtree->tree) {
+		create_subtree(ssd, active);
+		sync_subtree_state(ssd, active);
+		scene_index_invalidate(ssd->view->server);
+	}
+
+	enum ssd_active_state active_state;
+	FOR_EACH_ACTIVE_STATE(active_state) {
+		subtree = &ssd->titlebar.subtrees[active_state];
+		if (subtree->tree) {
+			wlr_scene_node_set_enabled(&subtree->tree->node,
+				active == active_state);
+		}
+	}
+
+	if (!ssd->titlebar.subtrees[!active].tree) {
+		return;
+	}
+	if (!ssd->titlebar.release_timer) {
+		ssd->titlebar.release_timer = wl_event_loop_add_timer(
+			ssd->view->server->wl_event_loop,
+			handle_release_timeout, ssd);
+	}
+	wl_event_source_timer_update(ssd->titlebar.release_timer,
+		SUBTREE_RELEASE_DELAY_MS);
+}
+
 static void
 update_button_state(struct ssd_button *button, enum lab_button_state state,
 		bool enable)
@@ -167,10 +279,14 @@ set_squared_corners(struct ssd *ssd, bool enable)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 
 		wlr_scene_node_set_position(&subtree->bar->node, x, 0);
 		wlr_scene_buffer_set_dest_size(subtree->bar,
 			MAX(width - 2 * x, 0), theme->titlebar_height);
+		lab_wlr_scene_buffer_update_opaque_region(subtree->bar);
 
 		wlr_scene_node_set_enabled(&subtree->corner_left->node, !enable);
 
@@ -195,6 +311,9 @@ set_alt_button_icon(struct ssd *ssd, enum lab_node_type type, bool enable)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 
 		struct ssd_button *button;
 		wl_list_for_each(button, &subtree->buttons_left, link) {
@@ -249,6 +368,9 @@ update_visible_buttons(struct ssd *ssd)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 		int button_count = 0;
 
 		struct ssd_button *button;
@@ -268,7 +390,7 @@ update_visible_buttons(struct ssd *ssd)
 }
 
 void
-ssd_titlebar_update(struct ssd *ssd)
+ssd_titlebar_update(struct ssd *ssd, enum ssd_dirty dirty)
 {
 	struct view *view = ssd->view;
 	int width = view->current.width;
@@ -278,28 +400,32 @@ ssd_titlebar_update(struct ssd *ssd)
 	bool maximized = view->maximized == VIEW_AXIS_BOTH;
 	bool squared = ssd_should_be_squared(ssd);
 
-	if (ssd->state.was_maximized != maximized
-			|| ssd->state.was_squared != squared) {
+	if ((dirty & SSD_DIRTY_CORNERS) && (ssd->state.was_maximized != maximized
+			|| ssd->state.was_squared != squared)) {
 		set_squared_corners(ssd, maximized || squared);
-		if (ssd->state.was_maximized != maximized) {
-			set_alt_button_icon(ssd, LAB_NODE_BUTTON_MAXIMIZE, maximized);
-		}
-		ssd->state.was_maximized = maximized;
 		ssd->state.was_squared = squared;
 	}
 
-	if (ssd->state.was_shaded != view->shaded) {
-		set_alt_button_icon(ssd, LAB_NODE_BUTTON_SHADE, view->shaded);
-		ssd->state.was_shaded = view->shaded;
+	/* Only the buttons whose icon changes are touched */
+	if (dirty & SSD_DIRTY_BUTTON_STATE) {
+		if (ssd->state.was_maximized != maximized) {
+			set_alt_button_icon(ssd, LAB_NODE_BUTTON_MAXIMIZE, maximized);
+		}
+		if (ssd->state.was_shaded != view->shaded) {
+			set_alt_button_icon(ssd, LAB_NODE_BUTTON_SHADE, view->shaded);
+			ssd->state.was_shaded = view->shaded;
+		}
+		if (ssd->state.was_omnipresent != view->visible_on_all_workspaces) {
+			set_alt_button_icon(ssd, LAB_NODE_BUTTON_OMNIPRESENT,
+				view->visible_on_all_workspaces);
+			ssd->state.was_omnipresent = view->visible_on_all_workspaces;
+		}
 	}
-
-	if (ssd->state.was_omnipresent != view->visible_on_all_workspaces) {
-		set_alt_button_icon(ssd, LAB_NODE_BUTTON_OMNIPRESENT,
-			view->visible_on_all_workspaces);
-		ssd->state.was_omnipresent = view->visible_on_all_workspaces;
+	if (dirty & (SSD_DIRTY_CORNERS | SSD_DIRTY_BUTTON_STATE)) {
+		ssd->state.was_maximized = maximized;
 	}
 
-	if (width == ssd->state.geometry.width) {
+	if (!(dirty & SSD_DIRTY_GEOMETRY) || width == ssd->state.geometry.width) {
 		return;
 	}
 
@@ -313,8 +439,12 @@ ssd_titlebar_update(struct ssd *ssd)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 		wlr_scene_buffer_set_dest_size(subtree->bar,
 			MAX(width - bg_offset * 2, 0), theme->titlebar_height);
+		lab_wlr_scene_buffer_update_opaque_region(subtree->bar);
 
 		x = theme->window_titlebar_padding_width;
 		struct ssd_button *button;
@@ -344,6 +474,9 @@ ssd_titlebar_destroy(struct ssd *ssd)
 		return;
 	}
 
+	if (ssd->titlebar.release_timer) {
+		wl_event_source_remove(ssd->titlebar.release_timer);
+	}
 	zfree(ssd->state.title.text);
 	wlr_scene_node_destroy(&ssd->titlebar.tree->node);
 	ssd->titlebar = (struct ssd_titlebar_scene){0};
@@ -372,6 +505,9 @@ ssd_update_title_positions(struct ssd *ssd, int offset_left, int offset_right)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 		struct scaled_font_buffer *title = subtree->title;
 		int x, y;
 
@@ -384,20 +520,22 @@ ssd_update_title_positions(struct ssd *ssd, int offset_left, int offset_right)
 		}
 		wlr_scene_node_set_enabled(&title->scene_buffer->node, true);
 
+		/* A cropped title is shown at most title_bg_width wide */
+		int title_width = MIN(title->width, title_bg_width);
 		if (theme->window_label_text_justify == LAB_JUSTIFY_CENTER) {
-			if (title->width + MAX(offset_left, offset_right) * 2 <= width) {
+			if (title_width + MAX(offset_left, offset_right) * 2 <= width) {
 				/* Center based on the full width */
-				x = (width - title->width) / 2;
+				x = (width - title_width) / 2;
 			} else {
 				/*
 				 * Center based on the width between the buttons.
 				 * Title jumps around once this is hit but its still
 				 * better than to hide behind the buttons on the right.
 				 */
-				x += (title_bg_width - title->width) / 2;
+				x += (title_bg_width - title_width) / 2;
 			}
 		} else if (theme->window_label_text_justify == LAB_JUSTIFY_RIGHT) {
-			x += title_bg_width - title->width;
+			x += title_bg_width - title_width;
 		} else if (theme->window_label_text_justify == LAB_JUSTIFY_LEFT) {
 			/* TODO: maybe add some theme x padding here? */
 		}
@@ -412,7 +550,11 @@ ssd_update_title_positions(struct ssd *ssd, int offset_left, int offset_right)
 static void
 get_title_offsets(struct ssd *ssd, int *offset_left, int *offset_right)
 {
+	/* Both subtrees show the same buttons, but only one might exist */
 	struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[SSD_ACTIVE];
+	if (!subtree->tree) {
+		subtree = &ssd->titlebar.subtrees[SSD_INACTIVE];
+	}
 	int button_width = ssd->view->server->theme->window_button_width;
 	int button_spacing = ssd->view->server->theme->window_button_spacing;
 	int padding_width = ssd->view->server->theme->window_titlebar_padding_width;
@@ -447,6 +589,8 @@ ssd_update_title(struct ssd *ssd)
 	struct theme *theme = view->server->theme;
 	struct ssd_state_title *state = &ssd->state.title;
 	bool title_unchanged = state->text && !strcmp(view->title, state->text);
+	bool resizing = view->server->grabbed_view == view
+		&& view->server->input_mode == LAB_INPUT_STATE_RESIZE;
 
 	int offset_left, offset_right;
 	get_title_offsets(ssd, &offset_left, &offset_right);
@@ -455,6 +599,9 @@ ssd_update_title(struct ssd *ssd)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		struct ssd_titlebar_subtree *subtree = &ssd->titlebar.subtrees[active];
+		if (!subtree->tree) {
+			continue;
+		}
 		struct ssd_state_title_width *dstate = &state->dstates[active];
 		const float *text_color = theme->window[active].label_text_color;
 		struct font *font = active ?
@@ -465,20 +612,44 @@ ssd_update_title(struct ssd *ssd)
 			continue;
 		}
 
-		if (title_unchanged
+		if (title_unchanged && dstate->cropped) {
+			if (resizing) {
+				/* Crop instead of shaping the text again */
+				scaled_font_buffer_crop(subtree->title,
+					title_bg_width);
+				dstate->truncated = title_bg_width <= dstate->width;
+				continue;
+			}
+			/* The resize is over, ellipsize the title if needed */
+			dstate->cropped = false;
+			if (dstate->width < title_bg_width) {
+				scaled_font_buffer_crop(subtree->title, 0);
+				dstate->truncated = false;
+				continue;
+			}
+		} else if (title_unchanged
 				&& !dstate->truncated && dstate->width < title_bg_width) {
 			/* title the same + we don't need to resize title */
 			continue;
 		}
 
+		/*
+		 * While resizing, render the title once at its natural width
+		 * and crop it on the following steps.
+		 */
+		dstate->cropped = resizing && title_unchanged;
+
 		const float bg_color[4] = {0, 0, 0, 0}; /* ignored */
 		scaled_font_buffer_update(subtree->title, view->title,
-			title_bg_width, font,
+			dstate->cropped ? 0 : title_bg_width, font,
 			text_color, bg_color);
 
 		/* And finally update the cache */
 		dstate->width = subtree->title->width;
 		dstate->truncated = title_bg_width <= dstate->width;
+		if (dstate->cropped) {
+			scaled_font_buffer_crop(subtree->title, title_bg_width);
+		}
 	}
 
 	if (!title_unchanged) {
@@ -15,10 +15,28 @@
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "node.h"
+#include "output.h"
+#include "scaled-buffer/scaled-icon-buffer.h"
 #include "ssd-internal.h"
 #include "theme.h"
 #include "view.h"
 
+/*
+ * Decorations of destroyed views are kept around for reuse, so that
+ * short-lived windows like dialogs don't rebuild the whole tree each time.
+ * The pool only holds decorations built from the current theme, which is
+ * tracked by a generation counter bumped in ssd_pool_flush().
+ */
+#define SSD_POOL_SIZE 4
+
+static struct {
+	/* Disabled parent of the pooled trees */
+	struct wlr_scene_tree *tree;
+	struct ssd *ssds[SSD_POOL_SIZE];
+	int count;
+	unsigned int generation;
+} pool;
+
 struct border
 ssd_thickness(struct view *view)
 {
@@ -78,6 +96,75 @@ ssd_max_extents(struct view *view)
 	};
 }
 
+/*
+ * The invisible resize area around the borders, which makes thin borders
+ * easier to grab, is not backed by scene nodes. It extends the outline of
+ * the decoration to rc.resize_minimum_area and is hit-tested here instead.
+ */
+static int
+get_extents_width(const struct ssd *ssd)
+{
+	struct view *view = ssd->view;
+	if (view->fullscreen || view->maximized == VIEW_AXIS_BOTH
+			|| view->shaded || !view->output) {
+		return 0;
+	}
+	return MAX(0, rc.resize_minimum_area - view->server->theme->border_width);
+}
+
+bool
+ssd_get_extents_box(const struct ssd *ssd, struct wlr_box *box)
+{
+	int width = ssd ? get_extents_width(ssd) : 0;
+	if (!width) {
+		return false;
+	}
+	*box = ssd_max_extents(ssd->view);
+	box->x -= width;
+	box->y -= width;
+	box->width += 2 * width;
+	box->height += 2 * width;
+	return true;
+}
+
+struct wlr_scene_node *
+ssd_extents_node_at(const struct ssd *ssd, double lx, double ly,
+		double *sx, double *sy)
+{
+	struct wlr_box outer;
+	if (!ssd_get_extents_box(ssd, &outer)
+			|| !wlr_box_contains_point(&outer, lx, ly)) {
+		return NULL;
+	}
+	struct view *view = ssd->view;
+	struct wlr_box frame = ssd_max_extents(view);
+	if (wlr_box_contains_point(&frame, lx, ly)) {
+		return NULL;
+	}
+
+	/* Don't cover layer-shell clients such as panels */
+	bool usable = false;
+	struct output *output;
+	wl_list_for_each(output, &view->server->outputs, link) {
+		if (!view_on_output(view, output)) {
+			continue;
+		}
+		struct wlr_box usable_area =
+			output_usable_area_in_layout_coords(output);
+		if (wlr_box_contains_point(&usable_area, lx, ly)) {
+			usable = true;
+			break;
+		}
+	}
+	if (!usable) {
+		return NULL;
+	}
+
+	*sx = lx - view->current.x;
+	*sy = ly - view->current.y;
+	return &ssd->tree->node;
+}
+
 /*
  * Resizing and mouse contexts like 'Left', 'TLCorner', etc. in the vicinity of
  * SSD borders, titlebars and extents can have effective "corner regions" that
@@ -138,33 +225,98 @@ ssd_get_resizing_type(const struct ssd *ssd, struct wlr_cursor *cursor)
 	return LAB_NODE_NONE;
 }
 
+static void
+set_node_view(struct wlr_scene_node *node, struct view *view)
+{
+	if (node->data) {
+		struct node_descriptor *desc = node->data;
+		desc->view = view;
+	}
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		return;
+	}
+	struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->children, link) {
+		set_node_view(child, view);
+	}
+}
+
+static void
+set_window_icon_view(struct wl_list *buttons, struct view *view)
+{
+	struct ssd_button *button;
+	wl_list_for_each(button, buttons, link) {
+		if (button->window_icon) {
+			scaled_icon_buffer_set_view(button->window_icon, view);
+		}
+	}
+}
+
+/* Hand a pooled decoration over to @view and bring it up to date */
+static struct ssd *
+reuse_ssd(struct view *view, bool active)
+{
+	struct ssd *ssd = pool.ssds[--pool.count];
+	ssd->view = view;
+	wlr_scene_node_reparent(&ssd->tree->node, view->scene_tree);
+	wlr_scene_node_lower_to_bottom(&ssd->tree->node);
+	set_node_view(&ssd->tree->node, view);
+
+	enum ssd_active_state active_state;
+	FOR_EACH_ACTIVE_STATE(active_state) {
+		struct ssd_titlebar_subtree *subtree =
+			&ssd->titlebar.subtrees[active_state];
+		if (subtree->tree) {
+			set_window_icon_view(&subtree->buttons_left, view);
+			set_window_icon_view(&subtree->buttons_right, view);
+		}
+	}
+
+	/*
+	 * The cached state still describes what the nodes show, so a
+	 * geometry update with a cleared geometry applies all differences.
+	 */
+	ssd->state.geometry = (struct wlr_box){0};
+	ssd_set_titlebar(ssd, view_titlebar_visible(view));
+	ssd_update_geometry(ssd);
+	ssd->margin = ssd_thickness(view);
+	ssd_set_active(ssd, active);
+	ssd_enable_keybind_inhibit_indicator(ssd, view->inhibits_keybinds);
+	return ssd;
+}
+
 struct ssd *
 ssd_create(struct view *view, bool active)
 {
 	assert(view);
+	if (pool.count > 0) {
+		return reuse_ssd(view, active);
+	}
 	struct ssd *ssd = znew(*ssd);
+	ssd->generation = pool.generation;
 
 	ssd->view = view;
 	ssd->tree = wlr_scene_tree_create(view->scene_tree);
 
 	/*
 	 * Attach node_descriptor to the root node so that get_cursor_context()
-	 * detect cursor hovering on borders and extents.
+	 * detect cursor hovering on borders and extents. The latter are
+	 * reported with the root node, see ssd_extents_node_at().
 	 */
 	node_descriptor_create(&ssd->tree->node,
 		LAB_NODE_SSD_ROOT, view, /*data*/ NULL);
 
 	wlr_scene_node_lower_to_bottom(&ssd->tree->node);
 	ssd->titlebar.height = view->server->theme->titlebar_height;
-	ssd_shadow_create(ssd);
-	ssd_extents_create(ssd);
+	ssd_shadow_create(ssd, active);
 	/*
 	 * We need to create the borders after the titlebar because it sets
 	 * ssd->state.squared which ssd_border_create() reacts to.
 	 * TODO: Set the state here instead so the order does not matter
 	 * anymore.
 	 */
-	ssd_titlebar_create(ssd);
+	ssd_titlebar_create(ssd, active);
 	ssd_border_create(ssd);
 	if (!view_titlebar_visible(view)) {
 		/* Ensure we keep the old state on Reconfigure or when exiting fullscreen */
@@ -174,6 +326,7 @@ ssd_create(struct view *view, bool active)
 	ssd_set_active(ssd, active);
 	ssd_enable_keybind_inhibit_indicator(ssd, view->inhibits_keybinds);
 	ssd->state.geometry = view->current;
+	scene_index_invalidate(view->server);
 
 	return ssd;
 }
@@ -209,6 +362,7 @@ ssd_update_geometry(struct ssd *ssd)
 
 	struct view *view = ssd->view;
 	assert(view);
+	scene_index_invalidate(view->server);
 
 	struct wlr_box cached = ssd->state.geometry;
 	struct wlr_box current = view->current;
@@ -217,16 +371,25 @@ ssd_update_geometry(struct ssd *ssd)
 	int eff_height = view_effective_height(view, /* use_pending */ false);
 
 	bool update_area = eff_width != cached.width || eff_height != cached.height;
-	bool update_extents = update_area
+	bool update_cache = update_area
 		|| current.x != cached.x || current.y != cached.y;
 
 	bool maximized = view->maximized == VIEW_AXIS_BOTH;
 	bool squared = ssd_should_be_squared(ssd);
 
-	bool state_changed = ssd->state.was_maximized != maximized
-		|| ssd->state.was_shaded != view->shaded
-		|| ssd->state.was_squared != squared
-		|| ssd->state.was_omnipresent != view->visible_on_all_workspaces;
+	enum ssd_dirty dirty = 0;
+	if (update_area) {
+		dirty |= SSD_DIRTY_GEOMETRY;
+	}
+	if (ssd->state.was_maximized != maximized
+			|| ssd->state.was_squared != squared) {
+		dirty |= SSD_DIRTY_CORNERS;
+	}
+	if (ssd->state.was_maximized != maximized
+			|| ssd->state.was_shaded != view->shaded
+			|| ssd->state.was_omnipresent != view->visible_on_all_workspaces) {
+		dirty |= SSD_DIRTY_BUTTON_STATE;
+	}
 
 	/*
 	 * (Un)maximization updates titlebar visibility with
@@ -234,17 +397,16 @@ ssd_update_geometry(struct ssd *ssd)
 	 */
 	ssd_set_titlebar(ssd, view_titlebar_visible(view));
 
-	if (update_extents) {
-		ssd_extents_update(ssd);
+	if (dirty) {
+		ssd_titlebar_update(ssd, dirty);
 	}
-
-	if (update_area || state_changed) {
-		ssd_titlebar_update(ssd);
+	/* Toggled button icons don't affect the borders and shadows */
+	if (dirty & (SSD_DIRTY_GEOMETRY | SSD_DIRTY_CORNERS)) {
 		ssd_border_update(ssd);
 		ssd_shadow_update(ssd);
 	}
 
-	if (update_extents) {
+	if (update_cache) {
 		ssd->state.geometry = current;
 	}
 }
@@ -256,13 +418,23 @@ ssd_set_titlebar(struct ssd *ssd, bool enabled)
 		return;
 	}
 	wlr_scene_node_set_enabled(&ssd->titlebar.tree->node, enabled);
+	scene_index_invalidate(ssd->view->server);
 	ssd->titlebar.height = enabled ? ssd->view->server->theme->titlebar_height : 0;
 	ssd_border_update(ssd);
-	ssd_extents_update(ssd);
 	ssd_shadow_update(ssd);
 	ssd->margin = ssd_thickness(ssd->view);
 }
 
+static void
+free_ssd(struct ssd *ssd)
+{
+	ssd_titlebar_destroy(ssd);
+	ssd_border_destroy(ssd);
+	ssd_shadow_destroy(ssd);
+	wlr_scene_node_destroy(&ssd->tree->node);
+	free(ssd);
+}
+
 void
 ssd_destroy(struct ssd *ssd)
 {
@@ -275,17 +447,54 @@ ssd_destroy(struct ssd *ssd)
 	struct server *server = view->server;
 	if (server->hovered_button && node_view_from_node(
 			server->hovered_button->node) == view) {
-		server->hovered_button = NULL;
+		/* Clears the hover state of a button that may be reused */
+		ssd_update_hovered_button(server, NULL);
 	}
 
-	/* Destroy subcomponents */
-	ssd_titlebar_destroy(ssd);
-	ssd_border_destroy(ssd);
-	ssd_extents_destroy(ssd);
-	ssd_shadow_destroy(ssd);
-	wlr_scene_node_destroy(&ssd->tree->node);
+	if (ssd->generation != pool.generation || pool.count == SSD_POOL_SIZE) {
+		free_ssd(ssd);
+		scene_index_invalidate(server);
+		return;
+	}
 
-	free(ssd);
+	if (!pool.tree) {
+		pool.tree = wlr_scene_tree_create(&server->scene->tree);
+		wlr_scene_node_set_enabled(&pool.tree->node, false);
+	}
+	wlr_scene_node_reparent(&ssd->tree->node, pool.tree);
+	/* The release timer would reference the destroyed view */
+	if (ssd->titlebar.release_timer) {
+		wl_event_source_timer_update(ssd->titlebar.release_timer, 0);
+	}
+	pool.ssds[pool.count++] = ssd;
+	scene_index_invalidate(server);
+}
+
+void
+ssd_pool_flush(void)
+{
+	while (pool.count > 0) {
+		free_ssd(pool.ssds[--pool.count]);
+	}
+	pool.generation++;
+}
+
+void
+ssd_pool_finish(void)
+{
+	ssd_pool_flush();
+	if (pool.tree) {
+		wlr_scene_node_destroy(&pool.tree->node);
+		pool.tree = NULL;
+	}
+}
+
+void
+ssd_release_hidden(struct ssd *ssd)
+{
+	if (ssd) {
+		ssd_titlebar_release_hidden(ssd);
+	}
 }
 
 enum lab_ssd_mode
@@ -316,15 +525,9 @@ ssd_set_active(struct ssd *ssd, bool active)
 		wlr_scene_node_set_enabled(
 			&ssd->border.subtrees[active_state].tree->node,
 			active == active_state);
-		wlr_scene_node_set_enabled(
-			&ssd->titlebar.subtrees[active_state].tree->node,
-			active == active_state);
-		if (ssd->shadow.subtrees[active_state].tree) {
-			wlr_scene_node_set_enabled(
-				&ssd->shadow.subtrees[active_state].tree->node,
-				active == active_state);
-		}
 	}
+	ssd_shadow_set_active(ssd, active);
+	ssd_titlebar_set_active(ssd, active);
 }
 
 void
@@ -333,10 +536,10 @@ ssd_enable_shade(struct ssd *ssd, bool enable)
 	if (!ssd) {
 		return;
 	}
-	ssd_titlebar_update(ssd);
+	ssd_titlebar_update(ssd, SSD_DIRTY_ALL);
 	ssd_border_update(ssd);
-	wlr_scene_node_set_enabled(&ssd->extents.tree->node, !enable);
 	ssd_shadow_update(ssd);
+	scene_index_invalidate(ssd->view->server);
 }
 
 void
@@ -361,6 +564,15 @@ ssd_debug_is_root_node(const struct ssd *ssd, struct wlr_scene_node *node)
 	return node == &ssd->tree->node;
 }
 
+bool
+ssd_debug_is_shadow_node(const struct ssd *ssd, struct wlr_scene_node *node)
+{
+	if (!ssd || !node || !ssd->shadow.tree) {
+		return false;
+	}
+	return node == &ssd->shadow.tree->node;
+}
+
 const char *
 ssd_debug_get_node_name(const struct ssd *ssd, struct wlr_scene_node *node)
 {
@@ -370,10 +582,12 @@ ssd_debug_get_node_name(const struct ssd *ssd, struct wlr_scene_node *node)
 	if (node == &ssd->tree->node) {
 		return "view->ssd";
 	}
-	if (node == &ssd->titlebar.subtrees[SSD_ACTIVE].tree->node) {
+	struct wlr_scene_tree *titlebar_active = ssd->titlebar.subtrees[SSD_ACTIVE].tree;
+	if (titlebar_active && node == &titlebar_active->node) {
 		return "titlebar.active";
 	}
-	if (node == &ssd->titlebar.subtrees[SSD_INACTIVE].tree->node) {
+	struct wlr_scene_tree *titlebar_inactive = ssd->titlebar.subtrees[SSD_INACTIVE].tree;
+	if (titlebar_inactive && node == &titlebar_inactive->node) {
 		return "titlebar.inactive";
 	}
 	if (node == &ssd->border.subtrees[SSD_ACTIVE].tree->node) {
@@ -382,8 +596,8 @@ ssd_debug_get_node_name(const struct ssd *ssd, struct wlr_scene_node *node)
 	if (node == &ssd->border.subtrees[SSD_INACTIVE].tree->node) {
 		return "border.inactive";
 	}
-	if (node == &ssd->extents.tree->node) {
-		return "extents";
+	if (ssd->shadow.tree && node == &ssd->shadow.tree->node) {
+		return "shadow";
 	}
 	return NULL;
 }
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "startup-profile.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "common/buf.h"
+#include "common/time-helpers.h"
+
+#define MAX_PHASES 64
+#define MAX_DEPTH 8
+
+struct phase {
+	const char *name;
+	uint64_t start_nsec;
+	uint64_t end_nsec;
+	int depth;
+};
+
+static struct {
+	struct phase phases[MAX_PHASES];
+	int nr_phases;
+	/* Indices into phases[] of the phases which have not ended yet */
+	int open[MAX_DEPTH];
+	int depth;
+	/* Nesting level of phases which did not fit */
+	int dropped;
+	uint64_t start_nsec;
+	bool finished;
+} profile;
+
+void
+startup_profile_begin(const char *name)
+{
+	if (profile.finished) {
+		return;
+	}
+	uint64_t now = time_now_nsec();
+	if (!profile.start_nsec) {
+		profile.start_nsec = now;
+	}
+	if (profile.dropped || profile.nr_phases == MAX_PHASES
+			|| profile.depth == MAX_DEPTH) {
+		profile.dropped++;
+		return;
+	}
+	struct phase *phase = &profile.phases[profile.nr_phases];
+	*phase = (struct phase){
+		.name = name,
+		.start_nsec = now,
+		.depth = profile.depth,
+	};
+	profile.open[profile.depth++] = profile.nr_phases++;
+}
+
+void
+startup_profile_end(void)
+{
+	if (profile.finished) {
+		return;
+	}
+	if (profile.dropped) {
+		profile.dropped--;
+		return;
+	}
+	if (!profile.depth) {
+		wlr_log(WLR_ERROR, "unbalanced startup_profile_end()");
+		return;
+	}
+	int index = profile.open[--profile.depth];
+	profile.phases[index].end_nsec = time_now_nsec();
+}
+
+static double
+to_msec(uint64_t nsec)
+{
+	return nsec / 1e6;
+}
+
+static void
+write_trace(const char *path, uint64_t end_nsec)
+{
+	FILE *stream = fopen(path, "w");
+	if (!stream) {
+		wlr_log_errno(WLR_ERROR, "cannot write startup trace %s", path);
+		return;
+	}
+	long pid = getpid();
+	fprintf(stream, "{\"traceEvents\":[\n");
+	fprintf(stream, "{\"name\":\"startup\",\"ph\":\"X\",\"ts\":0,"
+		"\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+		(end_nsec - profile.start_nsec) / 1e3, pid, pid);
+	for (int i = 0; i < profile.nr_phases; i++) {
+		struct phase *phase = &profile.phases[i];
+		/* Phase names are identifiers, so they need no escaping */
+		fprintf(stream, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+			"\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld}", phase->name,
+			(phase->start_nsec - profile.start_nsec) / 1e3,
+			(phase->end_nsec - phase->start_nsec) / 1e3, pid, pid);
+	}
+	fprintf(stream, "\n]}\n");
+	if (fclose(stream)) {
+		wlr_log_errno(WLR_ERROR, "cannot write startup trace %s", path);
+	} else {
+		wlr_log(WLR_INFO, "wrote startup trace %s", path);
+	}
+}
+
+void
+startup_profile_finish(void)
+{
+	if (profile.finished || !profile.start_nsec) {
+		return;
+	}
+	uint64_t now = time_now_nsec();
+	/* Close phases left open, most likely by an early return */
+	while (profile.depth) {
+		profile.phases[profile.open[--profile.depth]].end_nsec = now;
+	}
+	profile.finished = true;
+
+	/* For example "startup took 1.2 ms: a 0.1, b 1.0 [c 0.4, d 0.5]" */
+	struct buf summary = BUF_INIT;
+	buf_add_fmt(&summary, "startup took %.1f ms:",
+		to_msec(now - profile.start_nsec));
+	int depth = 0;
+	for (int i = 0; i < profile.nr_phases; i++) {
+		struct phase *phase = &profile.phases[i];
+		for (; depth > phase->depth; depth--) {
+			buf_add_char(&summary, ']');
+		}
+		if (phase->depth > depth) {
+			buf_add(&summary, " [");
+			depth = phase->depth;
+		} else if (i) {
+			buf_add(&summary, ", ");
+		} else {
+			buf_add_char(&summary, ' ');
+		}
+		buf_add_fmt(&summary, "%s %.1f", phase->name,
+			to_msec(phase->end_nsec - phase->start_nsec));
+	}
+	for (; depth > 0; depth--) {
+		buf_add_char(&summary, ']');
+	}
+	wlr_log(WLR_INFO, "%s", summary.data);
+	buf_reset(&summary);
+
+	const char *path = getenv("LABWC_STARTUP_TRACE");
+	if (path && *path) {
+		write_trace(path, now);
+	}
+}
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "theme-cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-util.h>
+#include <wlr/util/log.h>
+#include "buffer.h"
+#include "common/dir.h"
+#include "common/hash.h"
+#include "common/list.h"
+#include "common/mem.h"
+
+static const char magic[8] = "labwcTC";
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint64_t key;
+};
+
+struct mem_entry {
+	char *name;
+	uint64_t key;
+	struct lab_data_buffer *buffer;
+	struct wl_list link;
+};
+
+static struct wl_list mem_entries = WL_LIST_INIT(&mem_entries);
+
+static struct mem_entry *
+mem_entry_get(const char *name)
+{
+	struct mem_entry *entry;
+	wl_list_for_each(entry, &mem_entries, link) {
+		if (!strcmp(entry->name, name)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/* Takes over the reference of the caller and locks @buffer instead */
+static void
+mem_store(const char *name, uint64_t key, struct lab_data_buffer *buffer)
+{
+	struct mem_entry *entry = mem_entry_get(name);
+	if (!entry) {
+		entry = znew(*entry);
+		entry->name = xstrdup(name);
+		wl_list_insert(&mem_entries, &entry->link);
+	} else if (entry->buffer) {
+		/* Destroyed once the previous theme released it */
+		wlr_buffer_drop(&entry->buffer->base);
+	}
+	entry->key = key;
+	entry->buffer = buffer;
+	wlr_buffer_lock(&buffer->base);
+}
+
+uint64_t
+theme_cache_key_add(uint64_t key, const void *data, size_t size)
+{
+	return hash_add(key, data, size);
+}
+
+static bool
+get_cache_path(char *path, size_t len, const char *name, bool create)
+{
+	if (!cache_dir_get(path, len, "theme", create)) {
+		return false;
+	}
+	size_t dir_len = strlen(path);
+	int ret = snprintf(path + dir_len, len - dir_len, "/%s", name);
+	return ret >= 0 && (size_t)ret < len - dir_len;
+}
+
+struct lab_data_buffer *
+theme_cache_load(const char *name, uint64_t key)
+{
+	struct mem_entry *entry = mem_entry_get(name);
+	if (entry && entry->key == key) {
+		wlr_buffer_lock(&entry->buffer->base);
+		return entry->buffer;
+	}
+
+	char path[PATH_MAX];
+	if (!get_cache_path(path, sizeof(path), name, /*create*/ false)) {
+		return NULL;
+	}
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct lab_data_buffer *buffer = NULL;
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct cache_header)) {
+		goto out;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		goto out;
+	}
+
+	const struct cache_header *header = data;
+	size_t pixels_size = (size_t)header->stride * header->height;
+	if (memcmp(header->magic, magic, sizeof(magic))
+			|| header->version != THEME_CACHE_VERSION
+			|| header->key != key
+			|| header->stride < header->width * 4
+			|| (size_t)st.st_size != sizeof(*header) + pixels_size) {
+		wlr_log(WLR_DEBUG, "theme cache %s is outdated", name);
+		goto unmap;
+	}
+
+	buffer = buffer_create_cairo(header->width, header->height, 1);
+	if (!buffer) {
+		goto unmap;
+	}
+	const uint8_t *src = (const uint8_t *)(header + 1);
+	uint8_t *dst = buffer->data;
+	cairo_surface_flush(buffer->surface);
+	for (uint32_t y = 0; y < header->height; y++) {
+		memcpy(dst + y * buffer->stride, src + y * header->stride,
+			header->width * 4);
+	}
+	cairo_surface_mark_dirty(buffer->surface);
+
+unmap:
+	munmap(data, st.st_size);
+out:
+	close(fd);
+	if (buffer) {
+		mem_store(name, key, buffer);
+	}
+	return buffer;
+}
+
+void
+theme_cache_store(const char *name, uint64_t key, struct lab_data_buffer *buffer)
+{
+	if (!buffer) {
+		return;
+	}
+	mem_store(name, key, buffer);
+	if (buffer->base.width != (int)buffer->logical_width
+			|| buffer->base.height != (int)buffer->logical_height) {
+		return;
+	}
+
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	if (!get_cache_path(path, sizeof(path), name, /*create*/ true)
+			|| snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+				>= (int)sizeof(tmp_path)) {
+		return;
+	}
+	FILE *f = fopen(tmp_path, "w");
+	if (!f) {
+		wlr_log_errno(WLR_DEBUG, "cannot write %s", tmp_path);
+		return;
+	}
+
+	struct cache_header header = {
+		.version = THEME_CACHE_VERSION,
+		.width = buffer->base.width,
+		.height = buffer->base.height,
+		.stride = buffer->stride,
+		.key = key,
+	};
+	memcpy(header.magic, magic, sizeof(magic));
+
+	cairo_surface_flush(buffer->surface);
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(buffer->data, buffer->stride, header.height, f)
+			== header.height;
+	ok = !fclose(f) && ok;
+	if (!ok || rename(tmp_path, path)) {
+		wlr_log(WLR_DEBUG, "cannot store theme cache %s", name);
+		unlink(tmp_path);
+	}
+}
+
+void
+theme_cache_finish(void)
+{
+	struct mem_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &mem_entries, link) {
+		wlr_buffer_drop(&entry->buffer->base);
+		free(entry->name);
+		wl_list_remove(&entry->link);
+		free(entry);
+	}
+}
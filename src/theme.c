@@ -33,6 +33,8 @@
 #include "labwc.h"
 #include "buffer.h"
 #include "ssd.h"
+#include "theme-cache.h"
+#include "trace.h"
 
 struct button {
 	const char *name;
@@ -58,6 +60,9 @@ struct rounded_corner_ctx {
 
 #define zero_array(arr) memset(arr, 0, sizeof(arr))
 
+/* Maximum number of threads used to load button images */
+#define BUTTON_LOADER_THREADS 4
+
 static struct lab_data_buffer *rounded_rect(struct rounded_corner_ctx *ctx);
 
 /* 1 degree in radians (=2π/360) */
@@ -72,6 +77,16 @@ zdrop(struct lab_data_buffer **buffer)
 	}
 }
 
+/* Release a buffer shared with the theme cache */
+static void
+zunlock(struct lab_data_buffer **buffer)
+{
+	if (*buffer) {
+		wlr_buffer_unlock(&(*buffer)->base);
+		*buffer = NULL;
+	}
+}
+
 /* Draw rounded-rectangular hover overlay on the button buffer */
 static void
 draw_hover_overlay_on_button(cairo_t *cairo, int w, int h)
@@ -161,46 +176,69 @@ get_button_filename(char *buf, size_t len, const char *name, const char *postfix
 	paths_destroy(&paths);
 }
 
+struct button_job {
+	struct button *button;
+	enum ssd_active_state active;
+	float *rgba;
+	struct lab_img *img;
+};
+
+/*
+ * Look up and decode the image file of a button. This runs on a worker thread
+ * and must therefore neither touch the theme nor call into wlroots, except for
+ * logging.
+ */
 static void
-load_button(struct theme *theme, struct button *b, enum ssd_active_state active)
+load_button_file(gpointer data, gpointer user_data)
 {
-	struct lab_img *(*button_imgs)[LAB_BS_ALL + 1] =
-		theme->window[active].button_imgs;
-	struct lab_img **img = &button_imgs[b->type][b->state_set];
-	float *rgba = theme->window[active].button_colors[b->type];
+	struct button_job *job = data;
+	struct button *b = job->button;
+	bool active = job->active == SSD_ACTIVE;
 	char filename[4096];
 
-	assert(!*img);
-
 	/* PNG */
 	get_button_filename(filename, sizeof(filename), b->name,
 		active ? "-active.png" : "-inactive.png");
-	*img = lab_img_load(LAB_IMG_PNG, filename, rgba);
+	job->img = lab_img_load(LAB_IMG_PNG, filename, job->rgba);
 
 #if HAVE_RSVG
 	/* SVG */
-	if (!*img) {
+	if (!job->img) {
 		get_button_filename(filename, sizeof(filename), b->name,
 			active ? "-active.svg" : "-inactive.svg");
-		*img = lab_img_load(LAB_IMG_SVG, filename, rgba);
+		job->img = lab_img_load(LAB_IMG_SVG, filename, job->rgba);
 	}
 #endif
 
 	/* XBM */
-	if (!*img) {
+	if (!job->img) {
 		get_button_filename(filename, sizeof(filename), b->name, ".xbm");
-		*img = lab_img_load(LAB_IMG_XBM, filename, rgba);
+		job->img = lab_img_load(LAB_IMG_XBM, filename, job->rgba);
 	}
 
 	/*
 	 * XBM (alternative name)
 	 * For example max_hover_toggled instead of max_toggled_hover
 	 */
-	if (!*img && b->alt_name) {
+	if (!job->img && b->alt_name) {
 		get_button_filename(filename, sizeof(filename),
 			b->alt_name, ".xbm");
-		*img = lab_img_load(LAB_IMG_XBM, filename, rgba);
+		job->img = lab_img_load(LAB_IMG_XBM, filename, job->rgba);
 	}
+}
+
+static void
+load_button(struct theme *theme, struct button_job *job)
+{
+	struct button *b = job->button;
+	enum ssd_active_state active = job->active;
+	struct lab_img *(*button_imgs)[LAB_BS_ALL + 1] =
+		theme->window[active].button_imgs;
+	struct lab_img **img = &button_imgs[b->type][b->state_set];
+	float *rgba = job->rgba;
+
+	assert(!*img);
+	*img = job->img;
 
 	/*
 	 * Builtin bitmap
@@ -372,10 +410,45 @@ load_buttons(struct theme *theme)
 		/* no fallback (non-hover variant is used instead) */
 	}, };
 
-	for (size_t i = 0; i < ARRAY_SIZE(buttons); ++i) {
-		struct button *b = &buttons[i];
-		load_button(theme, b, SSD_INACTIVE);
-		load_button(theme, b, SSD_ACTIVE);
+	struct button_job jobs[ARRAY_SIZE(buttons) * 2] = { 0 };
+	for (size_t i = 0; i < ARRAY_SIZE(jobs); ++i) {
+		struct button_job *job = &jobs[i];
+		job->button = &buttons[i / 2];
+		job->active = i % 2 ? SSD_ACTIVE : SSD_INACTIVE;
+		job->rgba = theme->window[job->active]
+			.button_colors[job->button->type];
+	}
+
+	/*
+	 * Finding and decoding the image files is mostly disk I/O and PNG/SVG
+	 * parsing, which is independent for each button, so spread it over a
+	 * few threads. Everything else, including the fallbacks which depend
+	 * on other buttons, is done afterwards in the original order.
+	 */
+	int nr_threads = MIN((int)g_get_num_processors(), BUTTON_LOADER_THREADS);
+	GError *err = NULL;
+	GThreadPool *pool = NULL;
+	if (nr_threads > 1) {
+		pool = g_thread_pool_new(load_button_file, NULL, nr_threads,
+			/*exclusive*/ FALSE, &err);
+		if (!pool) {
+			wlr_log(WLR_ERROR, "cannot create thread pool: %s",
+				err->message);
+			g_error_free(err);
+		}
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(jobs); ++i) {
+		if (!pool || !g_thread_pool_push(pool, &jobs[i], NULL)) {
+			load_button_file(&jobs[i], NULL);
+		}
+	}
+	if (pool) {
+		/* Wait for all jobs to finish */
+		g_thread_pool_free(pool, /*immediate*/ FALSE, /*wait*/ TRUE);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(jobs); ++i) {
+		load_button(theme, &jobs[i]);
 	}
 }
 
@@ -675,13 +748,43 @@ get_int_if_positive(const char *content, const char *field)
 	return value;
 }
 
-static void
-entry(struct theme *theme, const char *key, const char *value)
+/*
+ * A themerc key is matched against each name known by entry(), which are
+ * more than a hundred. Instead of calling fnmatch() for each of them,
+ * keys without wildcards (nearly all of them) are looked up once in a
+ * table of those names, and entry() then compares names by pointer.
+ * The table is built by running entry() once in a collecting mode.
+ */
+struct theme_key {
+	const char *key;
+	bool is_glob;
+	/* The name in entry() equal to a literal key, NULL if none */
+	const char *name;
+};
+
+/* Lower-case name -> the string literal in entry() */
+static GHashTable *known_names;
+static bool collecting_names;
+
+static bool
+key_matches(struct theme_key *key, const char *name)
 {
-	if (!key || !value) {
-		return;
+	if (collecting_names) {
+		/* Names are compared by pointer, so each must occur once */
+		char *lower = g_ascii_strdown(name, -1);
+		assert(!g_hash_table_contains(known_names, lower));
+		g_hash_table_insert(known_names, lower, (gpointer)name);
+		return false;
+	}
+	if (key->is_glob) {
+		return match_glob(key->key, name);
 	}
+	return name == key->name;
+}
 
+static void
+entry(struct theme *theme, struct theme_key *key, const char *value)
+{
 	struct window_switcher_classic_theme *switcher_classic_theme =
 		&theme->osd_window_switcher_classic;
 	struct window_switcher_thumbnail_theme *switcher_thumb_theme =
@@ -691,83 +794,83 @@ entry(struct theme *theme, const char *key, const char *value)
 	 * Note that in order for the pattern match to apply to more than just
 	 * the first instance, "else if" cannot be used throughout this function
 	 */
-	if (match_glob(key, "border.width")) {
+	if (key_matches(key, "border.width")) {
 		theme->border_width = get_int_if_positive(
 			value, "border.width");
 	}
-	if (match_glob(key, "window.titlebar.padding.width")) {
+	if (key_matches(key, "window.titlebar.padding.width")) {
 		theme->window_titlebar_padding_width = get_int_if_positive(
 			value, "window.titlebar.padding.width");
 	}
-	if (match_glob(key, "window.titlebar.padding.height")) {
+	if (key_matches(key, "window.titlebar.padding.height")) {
 		theme->window_titlebar_padding_height = get_int_if_positive(
 			value, "window.titlebar.padding.height");
 	}
-	if (match_glob(key, "titlebar.height")) {
+	if (key_matches(key, "titlebar.height")) {
 		wlr_log(WLR_ERROR, "titlebar.height is no longer supported");
 	}
-	if (match_glob(key, "padding.height")) {
+	if (key_matches(key, "padding.height")) {
 		wlr_log(WLR_INFO, "padding.height is no longer supported");
 	}
 
-	if (match_glob(key, "window.active.border.color")) {
+	if (key_matches(key, "window.active.border.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE].border_color);
 	}
-	if (match_glob(key, "window.inactive.border.color")) {
+	if (key_matches(key, "window.inactive.border.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE].border_color);
 	}
 	/* border.color is obsolete, but handled for backward compatibility */
-	if (match_glob(key, "border.color")) {
+	if (key_matches(key, "border.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE].border_color);
 		parse_color(value, theme->window[SSD_INACTIVE].border_color);
 	}
 
-	if (match_glob(key, "window.active.indicator.toggled-keybind.color")) {
+	if (key_matches(key, "window.active.indicator.toggled-keybind.color")) {
 		parse_color(value, theme->window_toggled_keybinds_color);
 	}
 
-	if (match_glob(key, "window.active.title.bg")) {
+	if (key_matches(key, "window.active.title.bg")) {
 		theme->window[SSD_ACTIVE].title_bg.gradient = parse_gradient(value);
 	}
-	if (match_glob(key, "window.inactive.title.bg")) {
+	if (key_matches(key, "window.inactive.title.bg")) {
 		theme->window[SSD_INACTIVE].title_bg.gradient = parse_gradient(value);
 	}
-	if (match_glob(key, "window.active.title.bg.color")) {
+	if (key_matches(key, "window.active.title.bg.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE].title_bg.color);
 	}
-	if (match_glob(key, "window.inactive.title.bg.color")) {
+	if (key_matches(key, "window.inactive.title.bg.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE].title_bg.color);
 	}
-	if (match_glob(key, "window.active.title.bg.color.splitTo")) {
+	if (key_matches(key, "window.active.title.bg.color.splitTo")) {
 		parse_color(value, theme->window[SSD_ACTIVE].title_bg.color_split_to);
 	}
-	if (match_glob(key, "window.inactive.title.bg.color.splitTo")) {
+	if (key_matches(key, "window.inactive.title.bg.color.splitTo")) {
 		parse_color(value, theme->window[SSD_INACTIVE].title_bg.color_split_to);
 	}
-	if (match_glob(key, "window.active.title.bg.colorTo")) {
+	if (key_matches(key, "window.active.title.bg.colorTo")) {
 		parse_color(value, theme->window[SSD_ACTIVE].title_bg.color_to);
 	}
-	if (match_glob(key, "window.inactive.title.bg.colorTo")) {
+	if (key_matches(key, "window.inactive.title.bg.colorTo")) {
 		parse_color(value, theme->window[SSD_INACTIVE].title_bg.color_to);
 	}
-	if (match_glob(key, "window.active.title.bg.colorTo.splitTo")) {
+	if (key_matches(key, "window.active.title.bg.colorTo.splitTo")) {
 		parse_color(value, theme->window[SSD_ACTIVE].title_bg.color_to_split_to);
 	}
-	if (match_glob(key, "window.inactive.title.bg.colorTo.splitTo")) {
+	if (key_matches(key, "window.inactive.title.bg.colorTo.splitTo")) {
 		parse_color(value, theme->window[SSD_INACTIVE].title_bg.color_to_split_to);
 	}
 
-	if (match_glob(key, "window.active.label.text.color")) {
+	if (key_matches(key, "window.active.label.text.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE].label_text_color);
 	}
-	if (match_glob(key, "window.inactive.label.text.color")) {
+	if (key_matches(key, "window.inactive.label.text.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE].label_text_color);
 	}
-	if (match_glob(key, "window.label.text.justify")) {
+	if (key_matches(key, "window.label.text.justify")) {
 		theme->window_label_text_justify = parse_justification(value);
 	}
 
-	if (match_glob(key, "window.button.width")) {
+	if (key_matches(key, "window.button.width")) {
 		theme->window_button_width = atoi(value);
 		if (theme->window_button_width < 1) {
 			wlr_log(WLR_ERROR, "window.button.width cannot "
@@ -775,7 +878,7 @@ entry(struct theme *theme, const char *key, const char *value)
 			theme->window_button_width = 1;
 		}
 	}
-	if (match_glob(key, "window.button.height")) {
+	if (key_matches(key, "window.button.height")) {
 		theme->window_button_height = atoi(value);
 		if (theme->window_button_height < 1) {
 			wlr_log(WLR_ERROR, "window.button.height cannot "
@@ -783,24 +886,24 @@ entry(struct theme *theme, const char *key, const char *value)
 			theme->window_button_height = 1;
 		}
 	}
-	if (match_glob(key, "window.button.spacing")) {
+	if (key_matches(key, "window.button.spacing")) {
 		theme->window_button_spacing = get_int_if_positive(
 			value, "window.button.spacing");
 	}
-	if (match_glob(key, "window.button.hover.bg.corner-radius")) {
+	if (key_matches(key, "window.button.hover.bg.corner-radius")) {
 		theme->window_button_hover_bg_corner_radius = get_int_if_positive(
 			value, "window.button.hover.bg.corner-radius");
 	}
 
 	/* universal button */
-	if (match_glob(key, "window.active.button.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.unpressed.image.color")) {
 		for (enum lab_node_type type = LAB_NODE_BUTTON_FIRST;
 				type <= LAB_NODE_BUTTON_LAST; type++) {
 			parse_color(value,
 				theme->window[SSD_ACTIVE].button_colors[type]);
 		}
 	}
-	if (match_glob(key, "window.inactive.button.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.unpressed.image.color")) {
 		for (enum lab_node_type type = LAB_NODE_BUTTON_FIRST;
 				type <= LAB_NODE_BUTTON_LAST; type++) {
 			parse_color(value,
@@ -809,157 +912,157 @@ entry(struct theme *theme, const char *key, const char *value)
 	}
 
 	/* individual buttons */
-	if (match_glob(key, "window.active.button.menu.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.menu.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_WINDOW_MENU]);
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_WINDOW_ICON]);
 	}
-	if (match_glob(key, "window.active.button.iconify.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.iconify.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_ICONIFY]);
 	}
-	if (match_glob(key, "window.active.button.max.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.max.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_MAXIMIZE]);
 	}
-	if (match_glob(key, "window.active.button.shade.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.shade.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_SHADE]);
 	}
-	if (match_glob(key, "window.active.button.desk.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.desk.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_OMNIPRESENT]);
 	}
-	if (match_glob(key, "window.active.button.close.unpressed.image.color")) {
+	if (key_matches(key, "window.active.button.close.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE]
 			.button_colors[LAB_NODE_BUTTON_CLOSE]);
 	}
-	if (match_glob(key, "window.inactive.button.menu.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.menu.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_WINDOW_MENU]);
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_WINDOW_ICON]);
 	}
-	if (match_glob(key, "window.inactive.button.iconify.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.iconify.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_ICONIFY]);
 	}
-	if (match_glob(key, "window.inactive.button.max.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.max.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_MAXIMIZE]);
 	}
-	if (match_glob(key, "window.inactive.button.shade.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.shade.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_SHADE]);
 	}
-	if (match_glob(key, "window.inactive.button.desk.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.desk.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_OMNIPRESENT]);
 	}
-	if (match_glob(key, "window.inactive.button.close.unpressed.image.color")) {
+	if (key_matches(key, "window.inactive.button.close.unpressed.image.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE]
 			.button_colors[LAB_NODE_BUTTON_CLOSE]);
 	}
 
 	/* window drop-shadows */
-	if (match_glob(key, "window.active.shadow.size")) {
+	if (key_matches(key, "window.active.shadow.size")) {
 		theme->window[SSD_ACTIVE].shadow_size = get_int_if_positive(
 			value, "window.active.shadow.size");
 	}
-	if (match_glob(key, "window.inactive.shadow.size")) {
+	if (key_matches(key, "window.inactive.shadow.size")) {
 		theme->window[SSD_INACTIVE].shadow_size = get_int_if_positive(
 			value, "window.inactive.shadow.size");
 	}
-	if (match_glob(key, "window.active.shadow.color")) {
+	if (key_matches(key, "window.active.shadow.color")) {
 		parse_color(value, theme->window[SSD_ACTIVE].shadow_color);
 	}
-	if (match_glob(key, "window.inactive.shadow.color")) {
+	if (key_matches(key, "window.inactive.shadow.color")) {
 		parse_color(value, theme->window[SSD_INACTIVE].shadow_color);
 	}
 
-	if (match_glob(key, "menu.overlap.x")) {
+	if (key_matches(key, "menu.overlap.x")) {
 		theme->menu_overlap_x = atoi(value);
 	}
-	if (match_glob(key, "menu.overlap.y")) {
+	if (key_matches(key, "menu.overlap.y")) {
 		theme->menu_overlap_y = atoi(value);
 	}
-	if (match_glob(key, "menu.width.min")) {
+	if (key_matches(key, "menu.width.min")) {
 		theme->menu_min_width = get_int_if_positive(
 			value, "menu.width.min");
 	}
-	if (match_glob(key, "menu.width.max")) {
+	if (key_matches(key, "menu.width.max")) {
 		theme->menu_max_width = get_int_if_positive(
 			value, "menu.width.max");
 	}
-	if (match_glob(key, "menu.border.width")) {
+	if (key_matches(key, "menu.border.width")) {
 		theme->menu_border_width = get_int_if_positive(
 			value, "menu.border.width");
 	}
-	if (match_glob(key, "menu.border.color")) {
+	if (key_matches(key, "menu.border.color")) {
 		parse_color(value, theme->menu_border_color);
 	}
 
-	if (match_glob(key, "menu.items.padding.x")) {
+	if (key_matches(key, "menu.items.padding.x")) {
 		theme->menu_items_padding_x = get_int_if_positive(
 			value, "menu.items.padding.x");
 	}
-	if (match_glob(key, "menu.items.padding.y")) {
+	if (key_matches(key, "menu.items.padding.y")) {
 		theme->menu_items_padding_y = get_int_if_positive(
 			value, "menu.items.padding.y");
 	}
-	if (match_glob(key, "menu.items.bg.color")) {
+	if (key_matches(key, "menu.items.bg.color")) {
 		parse_color(value, theme->menu_items_bg_color);
 	}
-	if (match_glob(key, "menu.items.text.color")) {
+	if (key_matches(key, "menu.items.text.color")) {
 		parse_color(value, theme->menu_items_text_color);
 	}
-	if (match_glob(key, "menu.items.active.bg.color")) {
+	if (key_matches(key, "menu.items.active.bg.color")) {
 		parse_color(value, theme->menu_items_active_bg_color);
 	}
-	if (match_glob(key, "menu.items.active.text.color")) {
+	if (key_matches(key, "menu.items.active.text.color")) {
 		parse_color(value, theme->menu_items_active_text_color);
 	}
 
-	if (match_glob(key, "menu.separator.width")) {
+	if (key_matches(key, "menu.separator.width")) {
 		theme->menu_separator_line_thickness = get_int_if_positive(
 			value, "menu.separator.width");
 	}
-	if (match_glob(key, "menu.separator.padding.width")) {
+	if (key_matches(key, "menu.separator.padding.width")) {
 		theme->menu_separator_padding_width = get_int_if_positive(
 			value, "menu.separator.padding.width");
 	}
-	if (match_glob(key, "menu.separator.padding.height")) {
+	if (key_matches(key, "menu.separator.padding.height")) {
 		theme->menu_separator_padding_height = get_int_if_positive(
 			value, "menu.separator.padding.height");
 	}
-	if (match_glob(key, "menu.separator.color")) {
+	if (key_matches(key, "menu.separator.color")) {
 		parse_color(value, theme->menu_separator_color);
 	}
 
-	if (match_glob(key, "menu.title.bg.color")) {
+	if (key_matches(key, "menu.title.bg.color")) {
 		parse_color(value, theme->menu_title_bg_color);
 	}
-	if (match_glob(key, "menu.title.text.justify")) {
+	if (key_matches(key, "menu.title.text.justify")) {
 		theme->menu_title_text_justify = parse_justification(value);
 	}
-	if (match_glob(key, "menu.title.text.color")) {
+	if (key_matches(key, "menu.title.text.color")) {
 		parse_color(value, theme->menu_title_text_color);
 	}
 
-	if (match_glob(key, "osd.bg.color")) {
+	if (key_matches(key, "osd.bg.color")) {
 		parse_color(value, theme->osd_bg_color);
 	}
-	if (match_glob(key, "osd.border.width")) {
+	if (key_matches(key, "osd.border.width")) {
 		theme->osd_border_width = get_int_if_positive(
 			value, "osd.border.width");
 	}
-	if (match_glob(key, "osd.border.color")) {
+	if (key_matches(key, "osd.border.color")) {
 		parse_color(value, theme->osd_border_color);
 	}
 	/* classic window switcher */
-	if (match_glob(key, "osd.window-switcher.style-classic.width")
-			|| match_glob(key, "osd.window-switcher.width")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.width")
+			|| key_matches(key, "osd.window-switcher.width")) {
 		if (strrchr(value, '%')) {
 			switcher_classic_theme->width_is_percent = true;
 		} else {
@@ -968,43 +1071,43 @@ entry(struct theme *theme, const char *key, const char *value)
 		switcher_classic_theme->width = get_int_if_positive(value,
 			"osd.window-switcher.style-classic.width");
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.padding")
-			|| match_glob(key, "osd.window-switcher.padding")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.padding")
+			|| key_matches(key, "osd.window-switcher.padding")) {
 		switcher_classic_theme->padding = get_int_if_positive(value,
 			"osd.window-switcher.style-classic.padding");
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.padding.x")
-			|| match_glob(key, "osd.window-switcher.item.padding.x")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.padding.x")
+			|| key_matches(key, "osd.window-switcher.item.padding.x")) {
 		switcher_classic_theme->item_padding_x =
 			get_int_if_positive(value,
 				"osd.window-switcher.style-classic.item.padding.x");
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.padding.y")
-			|| match_glob(key, "osd.window-switcher.item.padding.y")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.padding.y")
+			|| key_matches(key, "osd.window-switcher.item.padding.y")) {
 		switcher_classic_theme->item_padding_y =
 			get_int_if_positive(value,
 				"osd.window-switcher.style-classic.item.padding.y");
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.active.border.width")
-			|| match_glob(key, "osd.window-switcher.item.active.border.width")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.active.border.width")
+			|| key_matches(key, "osd.window-switcher.item.active.border.width")) {
 		switcher_classic_theme->item_active_border_width =
 			get_int_if_positive(value,
 				"osd.window-switcher.style-classic.item.active.border.width");
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.active.border.color")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.active.border.color")) {
 		parse_color(value, switcher_classic_theme->item_active_border_color);
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.active.bg.color")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.active.bg.color")) {
 		parse_color(value, switcher_classic_theme->item_active_bg_color);
 	}
-	if (match_glob(key, "osd.window-switcher.style-classic.item.icon.size")
-			|| match_glob(key, "osd.window-switcher.item.icon.size")) {
+	if (key_matches(key, "osd.window-switcher.style-classic.item.icon.size")
+			|| key_matches(key, "osd.window-switcher.item.icon.size")) {
 		switcher_classic_theme->item_icon_size =
 			get_int_if_positive(value,
 				"osd.window-switcher.style-classic.item.icon.size");
 	}
 	/* thumbnail window switcher */
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.width.max")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.width.max")) {
 		if (strrchr(value, '%')) {
 			switcher_thumb_theme->max_width_is_percent = true;
 		} else {
@@ -1013,101 +1116,101 @@ entry(struct theme *theme, const char *key, const char *value)
 		switcher_thumb_theme->max_width = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.width.max");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.padding")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.padding")) {
 		switcher_thumb_theme->padding = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.padding");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.width")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.width")) {
 		switcher_thumb_theme->item_width = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.item.width");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.height")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.height")) {
 		switcher_thumb_theme->item_height = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.item.height");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.padding")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.padding")) {
 		switcher_thumb_theme->item_padding = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.item.padding");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.active.border.width")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.active.border.width")) {
 		switcher_thumb_theme->item_active_border_width = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.item.active.border.width");
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.active.border.color")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.active.border.color")) {
 		parse_color(value, switcher_thumb_theme->item_active_border_color);
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.active.bg.color")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.active.bg.color")) {
 		parse_color(value, switcher_thumb_theme->item_active_bg_color);
 	}
-	if (match_glob(key, "osd.window-switcher.style-thumbnail.item.icon.size")) {
+	if (key_matches(key, "osd.window-switcher.style-thumbnail.item.icon.size")) {
 		switcher_thumb_theme->item_icon_size = get_int_if_positive(
 			value, "osd.window-switcher.style-thumbnail.item.icon.size");
 	}
 
-	if (match_glob(key, "osd.window-switcher.preview.border.width")) {
+	if (key_matches(key, "osd.window-switcher.preview.border.width")) {
 		theme->osd_window_switcher_preview_border_width =
 			get_int_if_positive(
 				value, "osd.window-switcher.preview.border.width");
 	}
-	if (match_glob(key, "osd.window-switcher.preview.border.color")) {
+	if (key_matches(key, "osd.window-switcher.preview.border.color")) {
 		parse_hexstrs(value, theme->osd_window_switcher_preview_border_color);
 	}
-	if (match_glob(key, "osd.workspace-switcher.boxes.width")) {
+	if (key_matches(key, "osd.workspace-switcher.boxes.width")) {
 		theme->osd_workspace_switcher_boxes_width =
 			get_int_if_positive(
 				value, "osd.workspace-switcher.boxes.width");
 	}
-	if (match_glob(key, "osd.workspace-switcher.boxes.height")) {
+	if (key_matches(key, "osd.workspace-switcher.boxes.height")) {
 		theme->osd_workspace_switcher_boxes_height =
 			get_int_if_positive(
 				value, "osd.workspace-switcher.boxes.height");
 	}
-	if (match_glob(key, "osd.workspace-switcher.boxes.border.width")) {
+	if (key_matches(key, "osd.workspace-switcher.boxes.border.width")) {
 		theme->osd_workspace_switcher_boxes_border_width =
 			get_int_if_positive(
 				value, "osd.workspace-switcher.boxes.border.width");
 	}
-	if (match_glob(key, "osd.label.text.color")) {
+	if (key_matches(key, "osd.label.text.color")) {
 		parse_color(value, theme->osd_label_text_color);
 	}
-	if (match_glob(key, "snapping.overlay.region.bg.enabled")) {
+	if (key_matches(key, "snapping.overlay.region.bg.enabled")) {
 		set_bool(value, &theme->snapping_overlay_region.bg_enabled);
 	}
-	if (match_glob(key, "snapping.overlay.edge.bg.enabled")) {
+	if (key_matches(key, "snapping.overlay.edge.bg.enabled")) {
 		set_bool(value, &theme->snapping_overlay_edge.bg_enabled);
 	}
-	if (match_glob(key, "snapping.overlay.region.border.enabled")) {
+	if (key_matches(key, "snapping.overlay.region.border.enabled")) {
 		set_bool(value, &theme->snapping_overlay_region.border_enabled);
 	}
-	if (match_glob(key, "snapping.overlay.edge.border.enabled")) {
+	if (key_matches(key, "snapping.overlay.edge.border.enabled")) {
 		set_bool(value, &theme->snapping_overlay_edge.border_enabled);
 	}
-	if (match_glob(key, "snapping.overlay.region.bg.color")) {
+	if (key_matches(key, "snapping.overlay.region.bg.color")) {
 		parse_color(value, theme->snapping_overlay_region.bg_color);
 	}
-	if (match_glob(key, "snapping.overlay.edge.bg.color")) {
+	if (key_matches(key, "snapping.overlay.edge.bg.color")) {
 		parse_color(value, theme->snapping_overlay_edge.bg_color);
 	}
-	if (match_glob(key, "snapping.overlay.region.border.width")) {
+	if (key_matches(key, "snapping.overlay.region.border.width")) {
 		theme->snapping_overlay_region.border_width = get_int_if_positive(
 			value, "snapping.overlay.region.border.width");
 	}
-	if (match_glob(key, "snapping.overlay.edge.border.width")) {
+	if (key_matches(key, "snapping.overlay.edge.border.width")) {
 		theme->snapping_overlay_edge.border_width = get_int_if_positive(
 			value, "snapping.overlay.edge.border.width");
 	}
-	if (match_glob(key, "snapping.overlay.region.border.color")) {
+	if (key_matches(key, "snapping.overlay.region.border.color")) {
 		parse_hexstrs(value, theme->snapping_overlay_region.border_color);
 	}
-	if (match_glob(key, "snapping.overlay.edge.border.color")) {
+	if (key_matches(key, "snapping.overlay.edge.border.color")) {
 		parse_hexstrs(value, theme->snapping_overlay_edge.border_color);
 	}
 
-	if (match_glob(key, "magnifier.border.width")) {
+	if (key_matches(key, "magnifier.border.width")) {
 		theme->mag_border_width = get_int_if_positive(
 			value, "magnifier.border.width");
 	}
-	if (match_glob(key, "magnifier.border.color")) {
+	if (key_matches(key, "magnifier.border.color")) {
 		parse_color(value, theme->mag_border_color);
 	}
 }
@@ -1132,7 +1235,36 @@ process_line(struct theme *theme, char *line)
 	}
 	char *key = NULL, *value = NULL;
 	parse_config_line(line, &key, &value);
-	entry(theme, key, value);
+	if (!key || !value) {
+		return;
+	}
+
+	if (!known_names) {
+		known_names = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+		collecting_names = true;
+		entry(theme, &(struct theme_key){0}, value);
+		collecting_names = false;
+	}
+
+	/* Non-ASCII keys are left to fnmatch() as well, for case folding */
+	struct theme_key theme_key = { .key = key };
+	for (const char *p = key; *p; p++) {
+		if ((unsigned char)*p >= 0x80 || strchr("*?[\\", *p)) {
+			theme_key.is_glob = true;
+			break;
+		}
+	}
+	if (!theme_key.is_glob) {
+		char *lower = g_ascii_strdown(key, -1);
+		theme_key.name = g_hash_table_lookup(known_names, lower);
+		g_free(lower);
+		if (!theme_key.name) {
+			/* Not a key we know */
+			return;
+		}
+	}
+	entry(theme, &theme_key, value);
 }
 
 static void
@@ -1389,24 +1521,78 @@ create_titlebar_fill(cairo_pattern_t *pattern, int height)
 	cairo_paint(cairo);
 	cairo_surface_flush(fill->surface);
 	cairo_destroy(cairo);
+	fill->opaque = is_pattern_opaque(pattern);
 
 	return fill;
 }
 
+static void
+get_cache_name(char *name, size_t len, const char *what,
+		enum ssd_active_state active)
+{
+	snprintf(name, len, "%s-%s", what,
+		active == SSD_ACTIVE ? "active" : "inactive");
+}
+
+static struct lab_data_buffer *
+load_cached(const char *what, enum ssd_active_state active, uint64_t key)
+{
+	char name[64];
+	get_cache_name(name, sizeof(name), what, active);
+	return theme_cache_load(name, key);
+}
+
+static void
+store_cached(const char *what, enum ssd_active_state active, uint64_t key,
+		struct lab_data_buffer *buffer)
+{
+	char name[64];
+	get_cache_name(name, sizeof(name), what, active);
+	theme_cache_store(name, key, buffer);
+}
+
 static void
 create_backgrounds(struct theme *theme)
 {
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
-		theme->window[active].titlebar_pattern = create_titlebar_pattern(
+		cairo_pattern_t *pattern = create_titlebar_pattern(
 			&theme->window[active].title_bg,
 			theme->titlebar_height);
-		theme->window[active].titlebar_fill = create_titlebar_fill(
-			theme->window[active].titlebar_pattern,
-			theme->titlebar_height);
+		theme->window[active].titlebar_pattern = pattern;
+
+		/* Everything the fill is rendered from */
+		uint64_t key = THEME_CACHE_KEY_INIT;
+		key = theme_cache_key_add(key, &theme->window[active].title_bg,
+			sizeof(theme->window[active].title_bg));
+		key = theme_cache_key_add(key, &theme->titlebar_height,
+			sizeof(theme->titlebar_height));
+		struct lab_data_buffer *fill =
+			load_cached("titlebar-fill", active, key);
+		if (!fill) {
+			fill = create_titlebar_fill(pattern,
+				theme->titlebar_height);
+			store_cached("titlebar-fill", active, key, fill);
+		}
+		/* Not stored in the cache file */
+		fill->opaque = is_pattern_opaque(pattern);
+		theme->window[active].titlebar_fill = fill;
 	}
 }
 
+static struct lab_data_buffer *
+cached_rounded_rect(struct rounded_corner_ctx *ctx, const char *what,
+		enum ssd_active_state active, uint64_t key)
+{
+	key = theme_cache_key_add(key, &ctx->corner, sizeof(ctx->corner));
+	struct lab_data_buffer *buffer = load_cached(what, active, key);
+	if (!buffer) {
+		buffer = rounded_rect(ctx);
+		store_cached(what, active, key, buffer);
+	}
+	return buffer;
+}
+
 static void
 create_corners(struct theme *theme)
 {
@@ -1429,9 +1615,23 @@ create_corners(struct theme *theme)
 			.border_color = theme->window[active].border_color,
 			.corner = ROUNDED_CORNER_TOP_LEFT,
 		};
-		theme->window[active].corner_top_left_normal = rounded_rect(&ctx);
+
+		/* Everything the corners are rendered from, see rounded_rect() */
+		uint64_t key = THEME_CACHE_KEY_INIT;
+		key = theme_cache_key_add(key, &box, sizeof(box));
+		key = theme_cache_key_add(key, &ctx.radius, sizeof(ctx.radius));
+		key = theme_cache_key_add(key, &ctx.line_width,
+			sizeof(ctx.line_width));
+		key = theme_cache_key_add(key, &theme->window[active].title_bg,
+			sizeof(theme->window[active].title_bg));
+		key = theme_cache_key_add(key, theme->window[active].border_color,
+			sizeof(theme->window[active].border_color));
+
+		theme->window[active].corner_top_left_normal =
+			cached_rounded_rect(&ctx, "corner-top-left", active, key);
 		ctx.corner = ROUNDED_CORNER_TOP_RIGHT;
-		theme->window[active].corner_top_right_normal = rounded_rect(&ctx);
+		theme->window[active].corner_top_right_normal =
+			cached_rounded_rect(&ctx, "corner-top-right", active, key);
 	}
 }
 
@@ -1559,34 +1759,71 @@ create_shadow(struct theme *theme, enum ssd_active_state active)
 	/* Total width including visible and obscured portion */
 	int total_size = visible_size + inset;
 
+	if (visible_size <= 0) {
+		/* Shadows are disabled */
+		return;
+	}
+
+	uint64_t key = THEME_CACHE_KEY_INIT;
+	key = theme_cache_key_add(key, &visible_size, sizeof(visible_size));
+	key = theme_cache_key_add(key, &total_size, sizeof(total_size));
+	key = theme_cache_key_add(key, theme->window[active].shadow_color,
+		sizeof(theme->window[active].shadow_color));
+	uint64_t top_key = theme_cache_key_add(key, &theme->titlebar_height,
+		sizeof(theme->titlebar_height));
+
 	/*
 	 * Edge shadows don't need to be inset so the buffers are sized just for
 	 * the visible width.  Corners are inset so the buffers are larger for
 	 * this.
 	 */
-	if (visible_size > 0) {
+	theme->window[active].shadow_edge =
+		load_cached("shadow-edge", active, key);
+	if (!theme->window[active].shadow_edge) {
 		theme->window[active].shadow_edge = buffer_create_cairo(
 			visible_size, 1, 1.0);
+		shadow_edge_gradient(theme->window[active].shadow_edge,
+			visible_size, total_size,
+			theme->window[active].shadow_color);
+		store_cached("shadow-edge", active, key,
+			theme->window[active].shadow_edge);
+	}
+
+	theme->window[active].shadow_corner_top =
+		load_cached("shadow-corner-top", active, top_key);
+	if (!theme->window[active].shadow_corner_top) {
 		theme->window[active].shadow_corner_top = buffer_create_cairo(
 			total_size, total_size, 1.0);
+		shadow_corner_gradient(theme->window[active].shadow_corner_top,
+			visible_size, total_size, theme->titlebar_height,
+			theme->window[active].shadow_color);
+		store_cached("shadow-corner-top", active, top_key,
+			theme->window[active].shadow_corner_top);
+	}
+
+	theme->window[active].shadow_corner_bottom =
+		load_cached("shadow-corner-bottom", active, key);
+	if (!theme->window[active].shadow_corner_bottom) {
 		theme->window[active].shadow_corner_bottom = buffer_create_cairo(
 			total_size, total_size, 1.0);
-		if (!theme->window[active].shadow_corner_top
-				|| !theme->window[active].shadow_corner_bottom
-				|| !theme->window[active].shadow_edge) {
-			wlr_log(WLR_ERROR, "Failed to allocate shadow buffer");
-			return;
-		}
+		shadow_corner_gradient(theme->window[active].shadow_corner_bottom,
+			visible_size, total_size, 0,
+			theme->window[active].shadow_color);
+		store_cached("shadow-corner-bottom", active, key,
+			theme->window[active].shadow_corner_bottom);
 	}
 
-	shadow_edge_gradient(theme->window[active].shadow_edge, visible_size,
-		total_size, theme->window[active].shadow_color);
-	shadow_corner_gradient(theme->window[active].shadow_corner_top,
-		visible_size, total_size,
-		theme->titlebar_height, theme->window[active].shadow_color);
-	shadow_corner_gradient(theme->window[active].shadow_corner_bottom,
-		visible_size, total_size, 0,
-		theme->window[active].shadow_color);
+	buffer_set_category(theme->window[active].shadow_edge, BUFFER_SHADOW);
+	buffer_set_category(theme->window[active].shadow_corner_top,
+		BUFFER_SHADOW);
+	buffer_set_category(theme->window[active].shadow_corner_bottom,
+		BUFFER_SHADOW);
+
+	if (!theme->window[active].shadow_corner_top
+			|| !theme->window[active].shadow_corner_bottom
+			|| !theme->window[active].shadow_edge) {
+		wlr_log(WLR_ERROR, "Failed to allocate shadow buffer");
+	}
 }
 
 static void
@@ -1816,6 +2053,7 @@ theme_init(struct theme *theme, struct server *server, const char *theme_name)
 	 * Set some default values. This is particularly important on
 	 * reconfigure as not all themes set all options
 	 */
+	trace_begin("theme_init");
 	theme_builtin(theme, server);
 
 	struct wl_list paths;
@@ -1841,6 +2079,29 @@ theme_init(struct theme *theme, struct server *server, const char *theme_name)
 	create_corners(theme);
 	load_buttons(theme);
 	create_shadows(theme);
+
+	theme->files_hash = theme_files_hash(theme_name);
+	trace_end("theme_init");
+}
+
+uint64_t
+theme_files_hash(const char *theme_name)
+{
+	struct wl_list paths;
+	uint64_t hash = HASH_INIT;
+	uint64_t files;
+	if (theme_name) {
+		/* The directories also hold the button images */
+		paths_theme_create(&paths, theme_name, "themerc");
+		files = paths_hash(&paths, /*with_dirs*/ true);
+		hash = hash_add(hash, &files, sizeof(files));
+		paths_destroy(&paths);
+	}
+	paths_config_create(&paths, "themerc-override");
+	files = paths_hash(&paths, /*with_dirs*/ false);
+	hash = hash_add(hash, &files, sizeof(files));
+	paths_destroy(&paths);
+	return hash;
 }
 
 static void destroy_img(struct lab_img **img)
@@ -1866,11 +2127,11 @@ theme_finish(struct theme *theme)
 	enum ssd_active_state active;
 	FOR_EACH_ACTIVE_STATE(active) {
 		zfree_pattern(theme->window[active].titlebar_pattern);
-		zdrop(&theme->window[active].titlebar_fill);
-		zdrop(&theme->window[active].corner_top_left_normal);
-		zdrop(&theme->window[active].corner_top_right_normal);
-		zdrop(&theme->window[active].shadow_corner_top);
-		zdrop(&theme->window[active].shadow_corner_bottom);
-		zdrop(&theme->window[active].shadow_edge);
+		zunlock(&theme->window[active].titlebar_fill);
+		zunlock(&theme->window[active].corner_top_left_normal);
+		zunlock(&theme->window[active].corner_top_right_normal);
+		zunlock(&theme->window[active].shadow_corner_top);
+		zunlock(&theme->window[active].shadow_corner_bottom);
+		zunlock(&theme->window[active].shadow_edge);
 	}
 }
@@ -0,0 +1,587 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "tiling.h"
+#include <assert.h>
+#include <strings.h>
+#include <wlr/util/log.h>
+#include "common/edge.h"
+#include "common/log.h"
+#include "common/macros.h"
+#include "common/mem.h"
+#include "config/rcxml.h"
+#include "ipc.h"
+#include "labwc.h"
+#include "output.h"
+#include "ssd.h"
+#include "view.h"
+#include "window-rules.h"
+
+#define TILING_MIN_RATIO 0.05
+#define TILING_MAX_RATIO 0.95
+
+static bool
+node_is_leaf(struct tiling_node *node)
+{
+	return node->view;
+}
+
+static struct tiling_node *
+last_leaf(struct tiling_node *node)
+{
+	while (!node_is_leaf(node)) {
+		node = node->children[1];
+	}
+	return node;
+}
+
+static void
+replace_node(struct tiling_tree *tree, struct tiling_node *old,
+		struct tiling_node *new)
+{
+	struct tiling_node *parent = old->parent;
+	new->parent = parent;
+	if (!parent) {
+		tree->root = new;
+	} else if (parent->children[0] == old) {
+		parent->children[0] = new;
+	} else {
+		parent->children[1] = new;
+	}
+}
+
+/* Replace @target by a split of @target and @leaf */
+static void
+split_leaf(struct tiling_tree *tree, struct tiling_node *target,
+		struct tiling_node *leaf, enum tiling_split split, double ratio)
+{
+	struct tiling_node *node = znew(*node);
+	node->tree = tree;
+	node->split = split;
+	node->ratio = ratio;
+	node->box = target->box;
+	replace_node(tree, target, node);
+	node->children[0] = target;
+	node->children[1] = leaf;
+	target->parent = node;
+	leaf->parent = node;
+}
+
+static void
+free_leaf(struct tiling_node *leaf)
+{
+	leaf->view->tiling_node = NULL;
+	free(leaf);
+}
+
+static void
+free_subtree(struct tiling_node *node)
+{
+	if (!node) {
+		return;
+	}
+	if (node_is_leaf(node)) {
+		free_leaf(node);
+		return;
+	}
+	free_subtree(node->children[0]);
+	free_subtree(node->children[1]);
+	free(node);
+}
+
+/* Remove @leaf and let its sibling take the place of the parent split */
+static void
+unlink_leaf(struct tiling_tree *tree, struct tiling_node *leaf)
+{
+	struct tiling_node *parent = leaf->parent;
+	if (!parent) {
+		tree->root = NULL;
+		return;
+	}
+	struct tiling_node *sibling = parent->children[0] == leaf
+		? parent->children[1] : parent->children[0];
+	replace_node(tree, parent, sibling);
+	free(parent);
+}
+
+static enum tiling_split
+preferred_split(struct view *view, struct wlr_box *box)
+{
+	switch (window_rules_get_property(view, WINDOW_RULE_PROP_TILE_DIRECTION)) {
+	case LAB_PROP_TRUE:
+		return TILING_SPLIT_VERTICAL;
+	case LAB_PROP_FALSE:
+		return TILING_SPLIT_HORIZONTAL;
+	default:
+		return box->height > box->width
+			? TILING_SPLIT_VERTICAL : TILING_SPLIT_HORIZONTAL;
+	}
+}
+
+/*
+ * BSP: a new view splits the box of the focused view, or of the most
+ * recently inserted one.
+ */
+static void
+bsp_insert(struct tiling_tree *tree, struct tiling_node *leaf,
+		struct tiling_node *focus)
+{
+	if (!tree->root) {
+		tree->root = leaf;
+		return;
+	}
+	struct tiling_node *target = focus ? focus : last_leaf(tree->root);
+	split_leaf(tree, target, leaf,
+		preferred_split(leaf->view, &target->box), 0.5);
+}
+
+static void
+bsp_remove(struct tiling_tree *tree, struct tiling_node *leaf)
+{
+	unlink_leaf(tree, leaf);
+	free_leaf(leaf);
+}
+
+/*
+ * Master-stack: the root splits the master view from a chain of splits
+ * forming the stack. New views are appended to the stack, which is kept
+ * evenly distributed.
+ */
+static void
+master_stack_balance(struct tiling_tree *tree)
+{
+	if (!tree->root || node_is_leaf(tree->root)) {
+		return;
+	}
+	int count = 1;
+	struct tiling_node *node;
+	for (node = tree->root->children[1]; !node_is_leaf(node);
+			node = node->children[1]) {
+		count++;
+	}
+	for (node = tree->root->children[1]; !node_is_leaf(node);
+			node = node->children[1]) {
+		node->ratio = 1.0 / count--;
+	}
+}
+
+static void
+master_stack_insert(struct tiling_tree *tree, struct tiling_node *leaf,
+		struct tiling_node *focus)
+{
+	if (!tree->root) {
+		tree->root = leaf;
+		return;
+	}
+	if (node_is_leaf(tree->root)) {
+		split_leaf(tree, tree->root, leaf,
+			window_rules_get_property(tree->root->view,
+				WINDOW_RULE_PROP_TILE_DIRECTION) == LAB_PROP_TRUE
+				? TILING_SPLIT_VERTICAL : TILING_SPLIT_HORIZONTAL,
+			rc.tiling_master_ratio);
+		return;
+	}
+	enum tiling_split stack_split =
+		tree->root->split == TILING_SPLIT_HORIZONTAL
+			? TILING_SPLIT_VERTICAL : TILING_SPLIT_HORIZONTAL;
+	split_leaf(tree, last_leaf(tree->root), leaf, stack_split, 0.5);
+	master_stack_balance(tree);
+}
+
+static void
+master_stack_remove(struct tiling_tree *tree, struct tiling_node *leaf)
+{
+	struct tiling_node *root = tree->root;
+	if (root != leaf && leaf->parent == root) {
+		/*
+		 * The master (or the only stacked view) goes away. Promote
+		 * the first stacked view, keeping the master ratio.
+		 */
+		struct tiling_node *other = root->children[0] == leaf
+			? root->children[1] : root->children[0];
+		if (!node_is_leaf(other)) {
+			struct tiling_node *master = other->children[0];
+			struct tiling_node *stack = other->children[1];
+			root->children[0] = master;
+			root->children[1] = stack;
+			master->parent = root;
+			stack->parent = root;
+			free(other);
+			free_leaf(leaf);
+			master_stack_balance(tree);
+			return;
+		}
+	}
+	unlink_leaf(tree, leaf);
+	free_leaf(leaf);
+	master_stack_balance(tree);
+}
+
+static const struct tiling_layout_impl layouts[] = {
+	[LAB_TILING_LAYOUT_GRID] = {
+		.name = "grid",
+	},
+	[LAB_TILING_LAYOUT_MASTER_STACK] = {
+		.name = "master-stack",
+		.insert = master_stack_insert,
+		.remove = master_stack_remove,
+	},
+	[LAB_TILING_LAYOUT_BSP] = {
+		.name = "bsp",
+		.insert = bsp_insert,
+		.remove = bsp_remove,
+	},
+};
+
+enum lab_tiling_layout
+tiling_layout_parse(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(layouts); i++) {
+		if (!strcasecmp(name, layouts[i].name)) {
+			return i;
+		}
+	}
+	return LAB_TILING_LAYOUT_INVALID;
+}
+
+const char *
+tiling_layout_name(enum lab_tiling_layout layout)
+{
+	assert(layout >= 0 && layout < (int)ARRAY_SIZE(layouts));
+	return layouts[layout].name;
+}
+
+const char *
+tiling_status(struct server *server)
+{
+	if (!server->tiling_mode) {
+		return "stacking";
+	} else if (server->tiling_layout != LAB_TILING_LAYOUT_GRID) {
+		return tiling_layout_name(server->tiling_layout);
+	} else if (server->tiling_grid_mode) {
+		return "grid";
+	} else {
+		return "smart";
+	}
+}
+
+static const struct tiling_layout_impl *
+get_impl(struct server *server)
+{
+	return &layouts[server->tiling_layout];
+}
+
+bool
+view_is_tiling_candidate(struct view *view)
+{
+	if (view->minimized || view->fullscreen
+			|| view_is_always_on_top(view)
+			|| view_is_always_on_bottom(view)) {
+		return false;
+	}
+	/* Skip views with fixed position */
+	if (window_rules_get_property(view, WINDOW_RULE_PROP_FIXED_POSITION) == LAB_PROP_TRUE) {
+		return false;
+	}
+	/* Skip views that explicitly opt out of tiling */
+	return window_rules_get_property(view, WINDOW_RULE_PROP_TILE) != LAB_PROP_FALSE;
+}
+
+static struct tiling_tree *
+get_tree(struct server *server, struct workspace *workspace,
+		struct output *output)
+{
+	struct tiling_tree *tree;
+	wl_list_for_each(tree, &server->tiling_trees, link) {
+		if (tree->workspace == workspace && tree->output == output) {
+			return tree;
+		}
+	}
+	tree = znew(*tree);
+	tree->workspace = workspace;
+	tree->output = output;
+	wl_list_insert(&server->tiling_trees, &tree->link);
+	return tree;
+}
+
+static void
+destroy_tree(struct tiling_tree *tree)
+{
+	free_subtree(tree->root);
+	wl_list_remove(&tree->link);
+	free(tree);
+}
+
+static void
+remove_leaf(struct tiling_node *leaf)
+{
+	struct server *server = leaf->view->server;
+	struct tiling_tree *tree = leaf->tree;
+	get_impl(server)->remove(tree, leaf);
+	if (!tree->root) {
+		destroy_tree(tree);
+	}
+}
+
+static void
+arrange_node(struct tiling_node *node, struct wlr_box box)
+{
+	node->box = box;
+	if (node_is_leaf(node)) {
+		return;
+	}
+
+	struct wlr_box box0 = box;
+	struct wlr_box box1 = box;
+	if (node->split == TILING_SPLIT_HORIZONTAL) {
+		box0.width = (box.width - rc.gap) * node->ratio;
+		box1.x = box.x + box0.width + rc.gap;
+		box1.width = box.width - box0.width - rc.gap;
+	} else {
+		box0.height = (box.height - rc.gap) * node->ratio;
+		box1.y = box.y + box0.height + rc.gap;
+		box1.height = box.height - box0.height - rc.gap;
+	}
+	arrange_node(node->children[0], box0);
+	arrange_node(node->children[1], box1);
+}
+
+static void
+apply_node(struct tiling_node *node)
+{
+	if (!node_is_leaf(node)) {
+		apply_node(node->children[0]);
+		apply_node(node->children[1]);
+		return;
+	}
+
+	struct view *view = node->view;
+	if (view->maximized != VIEW_AXIS_NONE) {
+		view_maximize(view, VIEW_AXIS_NONE,
+			/*store_natural_geometry*/ false);
+	}
+	if (view_is_tiled(view)) {
+		view_set_untiled(view);
+	}
+
+	struct border margin = ssd_thickness(view);
+	struct wlr_box geo = {
+		.x = node->box.x + margin.left,
+		.y = node->box.y + margin.top,
+		.width = node->box.width - margin.left - margin.right,
+		.height = node->box.height - margin.top - margin.bottom,
+	};
+	/* Leave views alone whose box did not change */
+	if (!wlr_box_equal(&geo, &view->pending)) {
+		view_move_resize(view, geo);
+	}
+}
+
+static void
+collect_stale_leaves(struct tiling_node *node, uint64_t generation,
+		struct wl_array *stale)
+{
+	if (!node_is_leaf(node)) {
+		collect_stale_leaves(node->children[0], generation, stale);
+		collect_stale_leaves(node->children[1], generation, stale);
+	} else if (node->seen != generation) {
+		struct tiling_node **slot = wl_array_add(stale, sizeof(*slot));
+		if (slot) {
+			*slot = node;
+		}
+	}
+}
+
+void
+tiling_arrange(struct server *server)
+{
+	const struct tiling_layout_impl *impl = get_impl(server);
+	assert(impl->insert);
+
+	uint64_t generation = ++server->tiling_generation;
+	struct workspace *workspace = server->workspaces.current;
+	struct view *active = server->active_view;
+
+	/* Insert new candidates, move views which changed output */
+	struct view *view;
+	for_each_view_reverse(view, &server->views,
+			LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
+		if (!output_is_usable(view->output)
+				|| !view_is_tiling_candidate(view)) {
+			continue;
+		}
+		struct tiling_tree *tree =
+			get_tree(server, workspace, view->output);
+		struct tiling_node *leaf = view->tiling_node;
+		if (leaf && leaf->tree != tree) {
+			remove_leaf(leaf);
+			leaf = NULL;
+		}
+		if (!leaf) {
+			leaf = znew(*leaf);
+			leaf->tree = tree;
+			leaf->view = view;
+			view->tiling_node = leaf;
+			struct tiling_node *focus = NULL;
+			if (active && active != view && active->tiling_node
+					&& active->tiling_node->tree == tree) {
+				focus = active->tiling_node;
+			}
+			impl->insert(tree, leaf, focus);
+		}
+		leaf->seen = generation;
+	}
+
+	struct tiling_tree *tree, *tmp;
+	wl_list_for_each_safe(tree, tmp, &server->tiling_trees, link) {
+		if (tree->workspace != workspace) {
+			continue;
+		}
+
+		/* Remove views which are no longer tiling candidates */
+		if (tree->root) {
+			struct wl_array stale;
+			wl_array_init(&stale);
+			collect_stale_leaves(tree->root, generation, &stale);
+			struct tiling_node **leaf;
+			wl_array_for_each(leaf, &stale) {
+				impl->remove(tree, *leaf);
+			}
+			wl_array_release(&stale);
+		}
+		if (!tree->root) {
+			destroy_tree(tree);
+			continue;
+		}
+		if (!output_is_usable(tree->output)) {
+			continue;
+		}
+
+		struct wlr_box area =
+			output_usable_area_in_layout_coords(tree->output);
+		area.x += rc.gap;
+		area.y += rc.gap;
+		area.width -= 2 * rc.gap;
+		area.height -= 2 * rc.gap;
+		lab_log(LAB_LOG_TILING, "tiling: arranging %s on %s in %dx%d",
+			tiling_layout_name(server->tiling_layout),
+			tree->output->wlr_output->name, area.width, area.height);
+		arrange_node(tree->root, area);
+		apply_node(tree->root);
+	}
+}
+
+void
+tiling_set_layout(struct server *server, enum lab_tiling_layout layout)
+{
+	if (layout == server->tiling_layout) {
+		return;
+	}
+	tiling_finish(server);
+	server->tiling_layout = layout;
+	wlr_log(WLR_INFO, "tiling layout: %s", tiling_layout_name(layout));
+	desktop_schedule_arrange_tiled(server);
+	ipc_emit(IPC_EVENT_TILING);
+}
+
+/*
+ * Find the nearest split of orientation @split which has the subtree
+ * containing @node on the given side (0 = first child)
+ */
+static struct tiling_node *
+find_split(struct tiling_node *node, enum tiling_split split, int side)
+{
+	for (struct tiling_node *parent = node->parent; parent;
+			node = parent, parent = parent->parent) {
+		if (parent->split == split && parent->children[side] == node) {
+			return parent;
+		}
+	}
+	return NULL;
+}
+
+static void
+set_ratio(struct tiling_node *split, int size)
+{
+	int total = (split->split == TILING_SPLIT_HORIZONTAL
+		? split->box.width : split->box.height) - rc.gap;
+	if (total <= 0) {
+		return;
+	}
+	double ratio = (double)size / total;
+	split->ratio = MIN(MAX(ratio, TILING_MIN_RATIO), TILING_MAX_RATIO);
+}
+
+void
+tiling_view_resized(struct view *view)
+{
+	struct tiling_node *leaf = view->tiling_node;
+	if (!leaf) {
+		return;
+	}
+
+	/* The requested geometry, the client may not have caught up yet */
+	struct border margin = ssd_thickness(view);
+	struct wlr_box box = {
+		.x = view->pending.x - margin.left,
+		.y = view->pending.y - margin.top,
+		.width = view->pending.width + margin.left + margin.right,
+		.height = view->pending.height + margin.top + margin.bottom,
+	};
+
+	enum lab_edge edges = view->server->resize_edges;
+	struct tiling_node *split;
+	if ((edges & LAB_EDGE_RIGHT)
+			&& (split = find_split(leaf, TILING_SPLIT_HORIZONTAL, 0))) {
+		set_ratio(split, box.x + box.width - split->box.x);
+	}
+	if ((edges & LAB_EDGE_LEFT)
+			&& (split = find_split(leaf, TILING_SPLIT_HORIZONTAL, 1))) {
+		set_ratio(split, box.x - rc.gap - split->box.x);
+	}
+	if ((edges & LAB_EDGE_BOTTOM)
+			&& (split = find_split(leaf, TILING_SPLIT_VERTICAL, 0))) {
+		set_ratio(split, box.y + box.height - split->box.y);
+	}
+	if ((edges & LAB_EDGE_TOP)
+			&& (split = find_split(leaf, TILING_SPLIT_VERTICAL, 1))) {
+		set_ratio(split, box.y - rc.gap - split->box.y);
+	}
+}
+
+void
+tiling_view_destroyed(struct view *view)
+{
+	if (view->tiling_node) {
+		remove_leaf(view->tiling_node);
+	}
+}
+
+void
+tiling_output_destroyed(struct output *output)
+{
+	struct tiling_tree *tree, *tmp;
+	wl_list_for_each_safe(tree, tmp, &output->server->tiling_trees, link) {
+		if (tree->output == output) {
+			destroy_tree(tree);
+		}
+	}
+}
+
+void
+tiling_workspace_destroyed(struct workspace *workspace)
+{
+	struct tiling_tree *tree, *tmp;
+	wl_list_for_each_safe(tree, tmp, &workspace->server->tiling_trees, link) {
+		if (tree->workspace == workspace) {
+			destroy_tree(tree);
+		}
+	}
+}
+
+void
+tiling_finish(struct server *server)
+{
+	struct tiling_tree *tree, *tmp;
+	wl_list_for_each_safe(tree, tmp, &server->tiling_trees, link) {
+		destroy_tree(tree);
+	}
+}
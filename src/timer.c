@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "timer.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/util/log.h>
+#include "common/mem.h"
+#include "common/time-helpers.h"
+#include "metrics.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+
+struct lab_timer {
+	wl_event_loop_timer_func_t func;
+	void *data;
+	uint64_t slack_nsec;
+	uint64_t deadline_nsec; /* 0 if disarmed */
+	struct wl_list link; /* timers.armed */
+};
+
+static struct {
+	struct wl_event_source *source;
+	struct wl_list armed; /* struct lab_timer.link */
+	/* Time the shared timer is armed for, 0 if disarmed */
+	uint64_t wakeup_nsec;
+	bool dispatching;
+} timers;
+
+static struct {
+	uint64_t since_nsec;
+	uint64_t wakeups;
+	uint64_t fired;
+	/* Timers that fired on a wakeup that was due to another timer */
+	uint64_t coalesced;
+} stats;
+
+static void
+arm_shared_timer(void)
+{
+	if (!timers.source || timers.dispatching) {
+		return;
+	}
+
+	uint64_t wakeup_nsec = 0;
+	struct lab_timer *timer;
+	wl_list_for_each(timer, &timers.armed, link) {
+		uint64_t latest_nsec = timer->deadline_nsec + timer->slack_nsec;
+		if (!wakeup_nsec || latest_nsec < wakeup_nsec) {
+			wakeup_nsec = latest_nsec;
+		}
+	}
+	if (wakeup_nsec == timers.wakeup_nsec) {
+		return;
+	}
+	timers.wakeup_nsec = wakeup_nsec;
+
+	int ms = 0;
+	if (wakeup_nsec) {
+		uint64_t now = time_now_nsec();
+		ms = 1;
+		if (wakeup_nsec > now) {
+			ms = (wakeup_nsec - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC;
+		}
+	}
+	wl_event_source_timer_update(timers.source, ms);
+}
+
+static void
+disarm(struct lab_timer *timer)
+{
+	if (timer->deadline_nsec) {
+		wl_list_remove(&timer->link);
+		wl_list_init(&timer->link);
+		timer->deadline_nsec = 0;
+	}
+}
+
+static struct lab_timer *
+first_due_timer(uint64_t now)
+{
+	struct lab_timer *timer;
+	wl_list_for_each(timer, &timers.armed, link) {
+		if (timer->deadline_nsec <= now) {
+			return timer;
+		}
+	}
+	return NULL;
+}
+
+static int
+handle_wakeup(void *data)
+{
+	uint64_t now = time_now_nsec();
+	timers.wakeup_nsec = 0;
+	timers.dispatching = true;
+	stats.wakeups++;
+
+	/*
+	 * Look for the next due timer from scratch after each callback, which
+	 * may have destroyed or re-armed other timers. Re-armed timers are due
+	 * in the future and therefore don't fire again here.
+	 */
+	struct lab_timer *timer;
+	int nr_fired = 0;
+	while ((timer = first_due_timer(now))) {
+		disarm(timer);
+		nr_fired++;
+		timer->func(timer->data);
+	}
+	stats.fired += nr_fired;
+	if (nr_fired > 1) {
+		stats.coalesced += nr_fired - 1;
+	}
+
+	timers.dispatching = false;
+	arm_shared_timer();
+	return 0;
+}
+
+void
+lab_timers_init(struct wl_event_loop *loop)
+{
+	wl_list_init(&timers.armed);
+	timers.source = wl_event_loop_add_timer(loop, handle_wakeup, NULL);
+	if (!timers.source) {
+		wlr_log(WLR_ERROR, "cannot add timer");
+		exit(EXIT_FAILURE);
+	}
+	stats.since_nsec = time_now_nsec();
+
+	metrics_add_u64("timer_wakeups", NULL, "Wakeups of the shared timer",
+		METRIC_COUNTER, &stats.wakeups, NULL);
+	metrics_add_u64("timer_fired", NULL, "Timers fired", METRIC_COUNTER,
+		&stats.fired, NULL);
+	metrics_add_u64("timer_coalesced", NULL,
+		"Timers fired on a wakeup due to another timer", METRIC_COUNTER,
+		&stats.coalesced, NULL);
+}
+
+void
+lab_timers_finish(void)
+{
+	if (timers.source) {
+		wl_event_source_remove(timers.source);
+		timers.source = NULL;
+	}
+}
+
+struct lab_timer *
+lab_timer_create(wl_event_loop_timer_func_t func, void *data, int slack_ms)
+{
+	assert(func && slack_ms >= 0);
+	struct lab_timer *timer = znew(*timer);
+	timer->func = func;
+	timer->data = data;
+	timer->slack_nsec = slack_ms * NSEC_PER_MSEC;
+	wl_list_init(&timer->link);
+	return timer;
+}
+
+void
+lab_timer_destroy(struct lab_timer *timer)
+{
+	if (!timer) {
+		return;
+	}
+	bool was_armed = timer->deadline_nsec;
+	disarm(timer);
+	free(timer);
+	if (was_armed) {
+		arm_shared_timer();
+	}
+}
+
+void
+lab_timer_update(struct lab_timer *timer, int ms)
+{
+	disarm(timer);
+	if (ms > 0) {
+		timer->deadline_nsec = time_now_nsec() + ms * NSEC_PER_MSEC;
+		wl_list_insert(&timers.armed, &timer->link);
+	}
+	arm_shared_timer();
+}
+
+void
+lab_timer_stats_print(FILE *stream)
+{
+	int nr_armed = timers.source ? wl_list_length(&timers.armed) : 0;
+	uint64_t elapsed_nsec = time_now_nsec() - stats.since_nsec;
+	double seconds = elapsed_nsec ? elapsed_nsec / 1e9 : 1;
+	fprintf(stream, "armed: %d\n", nr_armed);
+	fprintf(stream, "seconds: %.1f\n", seconds);
+	fprintf(stream, "wakeups: %lu\n", (unsigned long)stats.wakeups);
+	fprintf(stream, "wakeups_per_second: %.2f\n", stats.wakeups / seconds);
+	fprintf(stream, "fired: %lu\n", (unsigned long)stats.fired);
+	fprintf(stream, "fired_per_second: %.2f\n", stats.fired / seconds);
+	fprintf(stream, "coalesced: %lu\n", (unsigned long)stats.coalesced);
+}
+
+void
+lab_timer_stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.since_nsec = time_now_nsec();
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "common/macros.h"
+#include "common/mem.h"
+#include "common/time-helpers.h"
+
+struct trace_event {
+	const char *name;
+	uint64_t nsec;
+	bool begin;
+};
+
+enum trace_mode trace_mode;
+
+static struct {
+	int marker_fd;
+	struct trace_event *ring;
+	/* Total number of events recorded, the ring holds the last ones */
+	uint64_t nr_events;
+	long pid;
+} trace = {
+	.marker_fd = -1,
+};
+
+static const char *const marker_paths[] = {
+	"/sys/kernel/tracing/trace_marker",
+	"/sys/kernel/debug/tracing/trace_marker",
+};
+
+void
+trace_record(const char *name, bool begin)
+{
+	if (trace_mode == TRACE_MARKER) {
+		char line[128];
+		int len = begin
+			? snprintf(line, sizeof(line), "B|%ld|%s", trace.pid, name)
+			: snprintf(line, sizeof(line), "E|%ld", trace.pid);
+		if (len > 0 && write(trace.marker_fd, line,
+				MIN((size_t)len, sizeof(line) - 1)) < 0) {
+			/* Nothing sensible to do in a hot path */
+		}
+		return;
+	}
+
+	struct trace_event *event =
+		&trace.ring[trace.nr_events++ % TRACE_RING_SIZE];
+	event->name = name;
+	event->nsec = time_now_nsec();
+	event->begin = begin;
+}
+
+static bool
+open_marker(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(marker_paths); i++) {
+		trace.marker_fd = open(marker_paths[i], O_WRONLY | O_CLOEXEC);
+		if (trace.marker_fd >= 0) {
+			return true;
+		}
+	}
+	wlr_log_errno(WLR_ERROR, "cannot open trace_marker, is tracefs "
+		"mounted and writable?");
+	return false;
+}
+
+static void
+close_marker(void)
+{
+	if (trace.marker_fd >= 0) {
+		close(trace.marker_fd);
+		trace.marker_fd = -1;
+	}
+}
+
+bool
+trace_set_mode(const char *mode)
+{
+	enum trace_mode new_mode;
+	if (!strcmp(mode, "off")) {
+		new_mode = TRACE_OFF;
+	} else if (!strcmp(mode, "marker")) {
+		new_mode = TRACE_MARKER;
+	} else if (!strcmp(mode, "ring")) {
+		new_mode = TRACE_RING;
+	} else {
+		wlr_log(WLR_ERROR, "invalid trace mode '%s'", mode);
+		return false;
+	}
+
+	trace.pid = getpid();
+	if (new_mode == TRACE_MARKER && trace.marker_fd < 0 && !open_marker()) {
+		return false;
+	}
+	if (new_mode != TRACE_MARKER) {
+		close_marker();
+	}
+	/* The ring is kept when tracing stops, so that it can be dumped */
+	if (new_mode == TRACE_RING && !trace.ring) {
+		trace.ring = xzalloc(TRACE_RING_SIZE * sizeof(*trace.ring));
+		trace.nr_events = 0;
+	}
+	trace_mode = new_mode;
+	wlr_log(WLR_INFO, "tracing %s", mode);
+	return true;
+}
+
+bool
+trace_dump(const char *path)
+{
+	if (!trace.ring) {
+		wlr_log(WLR_ERROR, "no ring buffer trace has been recorded");
+		return false;
+	}
+
+	char default_path[PATH_MAX];
+	if (!path || !*path) {
+		snprintf(default_path, sizeof(default_path),
+			"%s/labwc-trace-%ld.json", getenv("XDG_RUNTIME_DIR"),
+			(long)getpid());
+		path = default_path;
+	}
+	FILE *stream = fopen(path, "w");
+	if (!stream) {
+		wlr_log_errno(WLR_ERROR, "cannot write trace %s", path);
+		return false;
+	}
+
+	uint64_t count = MIN(trace.nr_events, TRACE_RING_SIZE);
+	uint64_t first = trace.nr_events - count;
+	fprintf(stream, "{\"traceEvents\":[");
+	for (uint64_t i = first; i < trace.nr_events; i++) {
+		struct trace_event *event = &trace.ring[i % TRACE_RING_SIZE];
+		/* Span names are identifiers, so they need no escaping */
+		fprintf(stream, "%s\n{\"name\":\"%s\",\"ph\":\"%c\","
+			"\"ts\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+			i > first ? "," : "", event->name,
+			event->begin ? 'B' : 'E', event->nsec / 1e3,
+			trace.pid, trace.pid);
+	}
+	fprintf(stream, "\n]}\n");
+	if (fclose(stream)) {
+		wlr_log_errno(WLR_ERROR, "cannot write trace %s", path);
+		return false;
+	}
+	wlr_log(WLR_INFO, "wrote %lu trace events to %s",
+		(unsigned long)count, path);
+	return true;
+}
+
+void
+trace_finish(void)
+{
+	trace_mode = TRACE_OFF;
+	close_marker();
+	zfree(trace.ring);
+}
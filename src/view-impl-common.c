@@ -2,7 +2,10 @@
 /* view-impl-common.c: common code for shell view->impl functions */
 #include "view-impl-common.h"
 #include "foreign-toplevel/foreign.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "menu/menu.h"
+#include "resize-snapshot.h"
 #include "view.h"
 #include "window-rules.h"
 
@@ -10,6 +13,8 @@ void
 view_impl_map(struct view *view)
 {
 	view_update_visibility(view);
+	view_update_occupancy(view);
+	window_rules_views_changed();
 
 	if (!view->been_mapped) {
 		window_rules_apply(view, LAB_WINDOW_RULE_EVENT_ON_FIRST_MAP);
@@ -21,7 +26,7 @@ view_impl_map(struct view *view)
 	 * etc.) as these should not be shown in taskbars/docks/etc.
 	 */
 	if (!view->foreign_toplevel && view_is_focusable(view)
-			&& window_rules_get_property(view, "skipTaskbar")
+			&& window_rules_get_property(view, WINDOW_RULE_PROP_SKIP_TASKBAR)
 				!= LAB_PROP_TRUE) {
 		view->foreign_toplevel = foreign_toplevel_create(view);
 
@@ -32,6 +37,11 @@ view_impl_map(struct view *view)
 		}
 	}
 
+	/* Rearrange tiled windows to make room for the new view */
+	desktop_schedule_arrange_tiled(view->server);
+	menu_on_window_list_changed(view->server);
+	ipc_emit(IPC_EVENT_WINDOWS);
+
 	wlr_log(WLR_DEBUG, "[map] identifier=%s, title=%s",
 		view->app_id, view->title);
 }
@@ -39,7 +49,10 @@ view_impl_map(struct view *view)
 void
 view_impl_unmap(struct view *view)
 {
+	resize_snapshot_finish(view);
 	view_update_visibility(view);
+	view_update_occupancy(view);
+	window_rules_views_changed();
 
 	/*
 	 * Destroy the foreign toplevel handle so the unmapped view
@@ -49,6 +62,10 @@ view_impl_unmap(struct view *view)
 		foreign_toplevel_destroy(view->foreign_toplevel);
 		view->foreign_toplevel = NULL;
 	}
+
+	desktop_schedule_arrange_tiled(view->server);
+	menu_on_window_list_changed(view->server);
+	ipc_emit(IPC_EVENT_WINDOWS);
 }
 
 static bool
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include "view.h"
 #include <assert.h>
+#include <string.h>
 #include <strings.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_keyboard_group.h>
@@ -11,24 +12,34 @@
 #include "action.h"
 #include "buffer.h"
 #include "common/box.h"
+#include "common/intern.h"
 #include "common/list.h"
+#include "common/macros.h"
 #include "common/match.h"
 #include "common/mem.h"
+#include "common/time-helpers.h"
 #include "config/rcxml.h"
 #include "cycle.h"
+#include "edges.h"
 #include "foreign-toplevel/foreign.h"
+#include "input/ime.h"
 #include "input/keyboard.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "layout-transaction.h"
 #include "menu/menu.h"
 #include "output.h"
 #include "placement.h"
 #include "regions.h"
 #include "resize-indicator.h"
+#include "resize-snapshot.h"
 #include "session-lock.h"
 #include "snap-constraints.h"
 #include "snap.h"
 #include "ssd.h"
 #include "theme.h"
+#include "tiling.h"
+#include "trace.h"
 #include "window-rules.h"
 #include "wlr/util/log.h"
 #include "workspaces.h"
@@ -88,11 +99,11 @@ void
 view_query_free(struct view_query *query)
 {
 	wl_list_remove(&query->link);
-	zfree(query->identifier);
-	zfree(query->title);
-	zfree(query->sandbox_engine);
-	zfree(query->sandbox_app_id);
-	zfree(query->tiled_region);
+	match_pattern_finish(&query->identifier);
+	match_pattern_finish(&query->title);
+	match_pattern_finish(&query->sandbox_engine);
+	match_pattern_finish(&query->sandbox_app_id);
+	match_pattern_finish(&query->tiled_region);
 	zfree(query->desktop);
 	zfree(query->monitor);
 	zfree(query);
@@ -112,12 +123,9 @@ query_tristate_match(enum lab_tristate desired, bool actual)
 }
 
 static bool
-query_str_match(const char *condition, const char *value)
+query_str_match(const struct match_pattern *condition, const char *value)
 {
-	if (!condition) {
-		return true;
-	}
-	return value && match_glob(condition, value);
+	return match_pattern_matches(condition, value);
 }
 
 static bool
@@ -133,11 +141,11 @@ view_contains_window_type(struct view *view, enum lab_window_type window_type)
 bool
 view_matches_query(struct view *view, struct view_query *query)
 {
-	if (!query_str_match(query->identifier, view->app_id)) {
+	if (!match_pattern_matches_interned(&query->identifier, view->app_id)) {
 		return false;
 	}
 
-	if (!query_str_match(query->title, view->title)) {
+	if (!query_str_match(&query->title, view->title)) {
 		return false;
 	}
 
@@ -146,7 +154,7 @@ view_matches_query(struct view *view, struct view_query *query)
 		return false;
 	}
 
-	if (query->sandbox_engine || query->sandbox_app_id) {
+	if (query->sandbox_engine.pattern || query->sandbox_app_id.pattern) {
 		const struct wlr_security_context_v1_state *ctx =
 			security_context_from_view(view);
 
@@ -154,11 +162,11 @@ view_matches_query(struct view *view, struct view_query *query)
 			return false;
 		}
 
-		if (!query_str_match(query->sandbox_engine, ctx->sandbox_engine)) {
+		if (!query_str_match(&query->sandbox_engine, ctx->sandbox_engine)) {
 			return false;
 		}
 
-		if (!query_str_match(query->sandbox_app_id, ctx->app_id)) {
+		if (!query_str_match(&query->sandbox_app_id, ctx->app_id)) {
 			return false;
 		}
 	}
@@ -195,7 +203,7 @@ view_matches_query(struct view *view, struct view_query *query)
 
 	const char *tiled_region =
 		view->tiled_region ? view->tiled_region->name : NULL;
-	if (!query_str_match(query->tiled_region, tiled_region)) {
+	if (!query_str_match(&query->tiled_region, tiled_region)) {
 		return false;
 	}
 
@@ -260,8 +268,8 @@ view_get_root(struct view *view)
 	return view;
 }
 
-static bool
-matches_criteria(struct view *view, enum lab_view_criteria criteria)
+bool
+view_matches_view_criteria(struct view *view, enum lab_view_criteria criteria)
 {
 	if (!view_is_focusable(view)) {
 		return false;
@@ -298,7 +306,8 @@ matches_criteria(struct view *view, enum lab_view_criteria criteria)
 		}
 	}
 	if (criteria & LAB_VIEW_CRITERIA_NO_SKIP_WINDOW_SWITCHER) {
-		if (window_rules_get_property(view, "skipWindowSwitcher") == LAB_PROP_TRUE) {
+		if (window_rules_get_property(view,
+				WINDOW_RULE_PROP_SKIP_WINDOW_SWITCHER) == LAB_PROP_TRUE) {
 			return false;
 		}
 	}
@@ -314,16 +323,226 @@ matches_criteria(struct view *view, enum lab_view_criteria criteria)
 	return true;
 }
 
+/* The per-workspace or always-on-top list @view belongs in, if any */
+static struct wl_list *
+get_workspace_list(struct view *view)
+{
+	struct wlr_scene_tree *parent = view->scene_tree->node.parent;
+	if (parent == view->server->view_tree_always_on_top) {
+		return &view->server->always_on_top_views;
+	}
+	if (parent == view->workspace->tree) {
+		return &view->workspace->views;
+	}
+	return NULL;
+}
+
+/* Insert @view into @list (may be NULL) by stack_seq */
+static void
+relink_view(struct view *view, struct wl_list *list)
+{
+	wl_list_remove(&view->workspace_link);
+	wl_list_init(&view->workspace_link);
+	view->workspace_list = list;
+	if (!list) {
+		return;
+	}
+	struct wl_list *pos = list;
+	struct view *other;
+	wl_list_for_each(other, list, workspace_link) {
+		if (other->stack_seq < view->stack_seq) {
+			pos = &other->workspace_link;
+			break;
+		}
+	}
+	wl_list_insert(pos->prev, &view->workspace_link);
+}
+
+/* Call when the scene tree of @view has been reparented */
+static void
+update_workspace_link(struct view *view)
+{
+	relink_view(view, get_workspace_list(view));
+}
+
+static int64_t front_stack_seq;
+static int64_t back_stack_seq;
+static int64_t last_focus_seq;
+
+/* Insert @view into the focus order of its workspace, if it belongs there */
+static void
+update_focus_link(struct view *view)
+{
+	wl_list_remove(&view->focus_link);
+	wl_list_init(&view->focus_link);
+	if (!view->focus_seq || !view->mapped || view->minimized
+			|| !view->workspace) {
+		return;
+	}
+	struct wl_list *list = &view->workspace->focus_views;
+	struct wl_list *pos = list;
+	struct view *other;
+	wl_list_for_each(other, list, focus_link) {
+		if (other->focus_seq < view->focus_seq) {
+			pos = &other->focus_link;
+			break;
+		}
+	}
+	wl_list_insert(pos->prev, &view->focus_link);
+}
+
+void
+view_note_focus(struct view *view)
+{
+	assert(view);
+	view->focus_seq = ++last_focus_seq;
+	update_focus_link(view);
+}
+
+void
+view_update_occupancy(struct view *view)
+{
+	struct workspace *workspace = NULL;
+	if (view->mapped && !view->visible_on_all_workspaces
+			&& !view_is_always_on_top(view)) {
+		workspace = view->workspace;
+	}
+	if (workspace == view->occupied_workspace) {
+		return;
+	}
+	if (view->occupied_workspace) {
+		view->occupied_workspace->nr_views--;
+	}
+	if (workspace) {
+		workspace->nr_views++;
+	}
+	view->occupied_workspace = workspace;
+	ipc_emit(IPC_EVENT_OCCUPANCY);
+}
+
+void
+view_add_to_views(struct view *view)
+{
+	wl_list_insert(&view->server->views, &view->link);
+	view->stack_seq = ++front_stack_seq;
+	view->creation_id = view->server->next_view_creation_id++;
+	wl_list_append(&view->server->views_by_age, &view->age_link);
+	wl_list_init(&view->workspace_link);
+	update_workspace_link(view);
+	wl_list_init(&view->focus_link);
+	window_rules_views_changed();
+}
+
+/*
+ * Get the view after @view (or the first view if NULL) in the order of
+ * server->views among the views in @lists. Lists other than the one @view
+ * is in are searched by stack_seq, so iterations continue correctly if
+ * the current view is moved to another workspace.
+ */
+static struct view *
+next_in_lists(struct wl_list **lists, size_t nr_lists, struct view *view)
+{
+	int64_t seq = view ? view->stack_seq : INT64_MAX;
+	struct wl_list *own_list = view ? view->workspace_list : NULL;
+	struct view *best = NULL;
+	for (size_t i = 0; i < nr_lists; i++) {
+		struct view *found = NULL;
+		if (own_list == lists[i]) {
+			if (view->workspace_link.next != lists[i]) {
+				found = wl_container_of(view->workspace_link.next,
+					found, workspace_link);
+			}
+		} else {
+			struct view *other;
+			wl_list_for_each(other, lists[i], workspace_link) {
+				if (other->stack_seq < seq) {
+					found = other;
+					break;
+				}
+			}
+		}
+		if (found && (!best || found->stack_seq > best->stack_seq)) {
+			best = found;
+		}
+	}
+	return best;
+}
+
+/* Same as next_in_lists() in the opposite direction */
+static struct view *
+prev_in_lists(struct wl_list **lists, size_t nr_lists, struct view *view)
+{
+	int64_t seq = view ? view->stack_seq : INT64_MIN;
+	struct wl_list *own_list = view ? view->workspace_list : NULL;
+	struct view *best = NULL;
+	for (size_t i = 0; i < nr_lists; i++) {
+		struct view *found = NULL;
+		if (own_list == lists[i]) {
+			if (view->workspace_link.prev != lists[i]) {
+				found = wl_container_of(view->workspace_link.prev,
+					found, workspace_link);
+			}
+		} else {
+			struct view *other;
+			wl_list_for_each_reverse(other, lists[i], workspace_link) {
+				if (other->stack_seq > seq) {
+					found = other;
+					break;
+				}
+			}
+		}
+		if (found && (!best || found->stack_seq < best->stack_seq)) {
+			best = found;
+		}
+	}
+	return best;
+}
+
+/*
+ * Select the lists holding all views which can match @criteria. Returns
+ * the number of lists, or 0 if all of server->views needs to be searched.
+ */
+static size_t
+get_criteria_lists(struct server *server, enum lab_view_criteria criteria,
+		struct wl_list **lists)
+{
+	if (criteria & LAB_VIEW_CRITERIA_ALWAYS_ON_TOP) {
+		lists[0] = &server->always_on_top_views;
+		return 1;
+	}
+	if (criteria & LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
+		size_t nr_lists = 0;
+		lists[nr_lists++] = &server->workspaces.current->views;
+		if (!(criteria & LAB_VIEW_CRITERIA_NO_ALWAYS_ON_TOP)) {
+			lists[nr_lists++] = &server->always_on_top_views;
+		}
+		return nr_lists;
+	}
+	return 0;
+}
+
 struct view *
 view_next(struct wl_list *head, struct view *view, enum lab_view_criteria criteria)
 {
 	assert(head);
 
+	struct wl_list *lists[2];
+	struct server *server = wl_container_of(head, server, views);
+	size_t nr_lists = get_criteria_lists(server, criteria, lists);
+	if (nr_lists) {
+		while ((view = next_in_lists(lists, nr_lists, view))) {
+			if (view_matches_view_criteria(view, criteria)) {
+				return view;
+			}
+		}
+		return NULL;
+	}
+
 	struct wl_list *elm = view ? &view->link : head;
 
 	for (elm = elm->next; elm != head; elm = elm->next) {
 		view = wl_container_of(elm, view, link);
-		if (matches_criteria(view, criteria)) {
+		if (view_matches_view_criteria(view, criteria)) {
 			return view;
 		}
 	}
@@ -335,11 +554,23 @@ view_prev(struct wl_list *head, struct view *view, enum lab_view_criteria criter
 {
 	assert(head);
 
+	struct wl_list *lists[2];
+	struct server *server = wl_container_of(head, server, views);
+	size_t nr_lists = get_criteria_lists(server, criteria, lists);
+	if (nr_lists) {
+		while ((view = prev_in_lists(lists, nr_lists, view))) {
+			if (view_matches_view_criteria(view, criteria)) {
+				return view;
+			}
+		}
+		return NULL;
+	}
+
 	struct wl_list *elm = view ? &view->link : head;
 
 	for (elm = elm->prev; elm != head; elm = elm->prev) {
 		view = wl_container_of(elm, view, link);
-		if (matches_criteria(view, criteria)) {
+		if (view_matches_view_criteria(view, criteria)) {
 			return view;
 		}
 	}
@@ -408,31 +639,7 @@ struct wlr_box
 view_get_edge_snap_box(struct view *view, struct output *output,
 		enum lab_edge edge)
 {
-	struct wlr_box usable = output_usable_area_in_layout_coords(output);
-	int x1 = rc.gap;
-	int y1 = rc.gap;
-	int x2 = usable.width - rc.gap;
-	int y2 = usable.height - rc.gap;
-
-	if (edge & LAB_EDGE_RIGHT) {
-		x1 = (usable.width + rc.gap) / 2;
-	}
-	if (edge & LAB_EDGE_LEFT) {
-		x2 = (usable.width - rc.gap) / 2;
-	}
-	if (edge & LAB_EDGE_BOTTOM) {
-		y1 = (usable.height + rc.gap) / 2;
-	}
-	if (edge & LAB_EDGE_TOP) {
-		y2 = (usable.height - rc.gap) / 2;
-	}
-
-	struct wlr_box dst = {
-		.x = x1 + usable.x,
-		.y = y1 + usable.y,
-		.width = x2 - x1,
-		.height = y2 - y1,
-	};
+	struct wlr_box dst = output_edge_snap_box(output, edge);
 
 	if (view) {
 		struct border margin = ssd_get_margin(view->ssd);
@@ -460,7 +667,9 @@ view_discover_output(struct view *view, struct wlr_box *geometry)
 			geometry->y + geometry->height / 2);
 
 	if (output && output != view->output) {
+		count_fullscreen(view, -1);
 		view->output = output;
+		count_fullscreen(view, 1);
 		/* Show fullscreen views above top-layer */
 		if (view->fullscreen) {
 			desktop_update_top_layer_visibility(view->server);
@@ -475,21 +684,24 @@ void
 view_set_activated(struct view *view, bool activated)
 {
 	assert(view);
+	flush_title(view);
 	ssd_set_active(view->ssd, activated);
 	if (view->impl->set_activated) {
 		view->impl->set_activated(view, activated);
 	}
 
 	wl_signal_emit_mutable(&view->events.activated, &activated);
+	ipc_emit(IPC_EVENT_WINDOWS);
 
 	if (rc.kb_layout_per_window) {
 		if (!activated) {
 			/* Store configured keyboard layout per view */
-			view->keyboard_layout =
-				view->server->seat.keyboard_group->keyboard.modifiers.group;
+			keyboard_store_view_layout(view,
+				view->server->seat.keyboard_group->keyboard.modifiers.group);
 		} else {
 			/* Switch to previously stored keyboard layout */
-			keyboard_update_layout(&view->server->seat, view->keyboard_layout);
+			keyboard_update_layout(&view->server->seat,
+				keyboard_get_view_layout(view));
 		}
 	}
 	output_set_has_fullscreen_view(view->output, view->fullscreen);
@@ -503,13 +715,25 @@ view_set_output(struct view *view, struct output *output)
 		wlr_log(WLR_ERROR, "invalid output set for view");
 		return;
 	}
+	count_fullscreen(view, -1);
 	view->output = output;
+	count_fullscreen(view, 1);
 	/* Show fullscreen views above top-layer */
 	if (view->fullscreen) {
 		desktop_update_top_layer_visibility(view->server);
 	}
 }
 
+/* Call with -1 before and +1 after changing view->fullscreen or ->output */
+static void
+count_fullscreen(struct view *view, int delta)
+{
+	if (view->fullscreen && view->output) {
+		view->output->nr_fullscreen_views += delta;
+		assert(view->output->nr_fullscreen_views >= 0);
+	}
+}
+
 void
 view_close(struct view *view)
 {
@@ -519,24 +743,75 @@ view_close(struct view *view)
 	}
 }
 
+/* Returns true if the outputs of @view changed */
+static bool
+set_outputs(struct view *view, uint64_t new_outputs)
+{
+	if (new_outputs == view->outputs) {
+		return false;
+	}
+	view->outputs = new_outputs;
+	wl_signal_emit_mutable(&view->events.new_outputs, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
+	return true;
+}
+
 static void
 view_update_outputs(struct view *view)
 {
-	struct output *output;
-	struct wlr_output_layout *layout = view->server->output_layout;
+	struct server *server = view->server;
+	if (server->arranging_views) {
+		/* view_update_all_outputs() follows */
+		return;
+	}
 
+	struct output *output;
 	uint64_t new_outputs = 0;
-	wl_list_for_each(output, &view->server->outputs, link) {
+	wl_list_for_each(output, &server->outputs, link) {
 		if (output_is_usable(output) && wlr_output_layout_intersects(
-				layout, output->wlr_output, &view->current)) {
+				server->output_layout, output->wlr_output,
+				&view->current)) {
 			new_outputs |= output->id_bit;
 		}
 	}
 
-	if (new_outputs != view->outputs) {
-		view->outputs = new_outputs;
-		wl_signal_emit_mutable(&view->events.new_outputs, NULL);
-		desktop_update_top_layer_visibility(view->server);
+	if (set_outputs(view, new_outputs)) {
+		desktop_update_top_layer_visibility(server);
+	}
+}
+
+void
+view_update_all_outputs(struct server *server)
+{
+	/* Look up the layout box of each output once, not once per view */
+	struct {
+		uint64_t id_bit;
+		struct wlr_box box;
+	} boxes[64];
+	int nr_boxes = 0;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output_is_usable(output) && nr_boxes < (int)ARRAY_SIZE(boxes)) {
+			boxes[nr_boxes].id_bit = output->id_bit;
+			wlr_output_layout_get_box(server->output_layout,
+				output->wlr_output, &boxes[nr_boxes].box);
+			nr_boxes++;
+		}
+	}
+
+	bool changed = false;
+	struct view *view;
+	wl_list_for_each(view, &server->views, link) {
+		uint64_t new_outputs = 0;
+		for (int i = 0; i < nr_boxes; i++) {
+			if (box_intersects(&boxes[i].box, &view->current)) {
+				new_outputs |= boxes[i].id_bit;
+			}
+		}
+		changed |= set_outputs(view, new_outputs);
+	}
+	if (changed) {
+		desktop_update_top_layer_visibility(server);
 	}
 }
 
@@ -565,6 +840,9 @@ view_moved(struct view *view)
 	assert(view);
 	wlr_scene_node_set_position(&view->scene_tree->node,
 		view->current.x, view->current.y);
+	if (view != view->server->grabbed_view) {
+		edges_visibility_invalidate(view->server, view);
+	}
 	/*
 	 * Only floating views change output when moved. Non-floating
 	 * views (maximized/tiled/fullscreen) are tied to a particular
@@ -575,19 +853,23 @@ view_moved(struct view *view)
 	}
 	view_update_outputs(view);
 	ssd_update_geometry(view->ssd);
+	input_method_relay_invalidate(view->server->seat.input_method_relay);
 	cursor_update_focus(view->server);
 	if (rc.resize_indicator && view->server->grabbed_view == view) {
 		resize_indicator_update(view);
 	}
+	ipc_emit(IPC_EVENT_WINDOWS);
 }
 
 void
 view_move_resize(struct view *view, struct wlr_box geo)
 {
 	assert(view);
+	trace_begin("view_move_resize");
 	if (view->impl->configure) {
 		view->impl->configure(view, geo);
 	}
+	trace_end("view_move_resize");
 }
 
 void
@@ -743,6 +1025,8 @@ _minimize(struct view *view, bool minimized)
 
 	view->minimized = minimized;
 	wl_signal_emit_mutable(&view->events.minimized, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
+	menu_on_window_list_changed(view->server);
 
 	view_update_visibility(view);
 }
@@ -794,12 +1078,14 @@ view_minimize(struct view *view, bool minimized)
 	 */
 	struct view *root = view_get_root(view);
 	bool was_minimized = root->minimized;
+	view_visibility_batch_begin();
 	_minimize(root, minimized);
 	minimize_sub_views(root, minimized);
+	view_visibility_batch_end(view->server);
 
 	/* Rearrange tiled windows when minimize state changes */
-	if (view->server->tiling_mode && was_minimized != minimized) {
-		desktop_arrange_tiled(view->server);
+	if (was_minimized != minimized) {
+		desktop_schedule_arrange_tiled(view->server);
 	}
 }
 
@@ -843,7 +1129,7 @@ adjust_floating_geometry(struct view *view, struct wlr_box *geometry,
 	}
 
 	/* Avoid moving panels out of their own reserved area ("strut") */
-	if (window_rules_get_property(view, "fixedPosition") == LAB_PROP_TRUE
+	if (window_rules_get_property(view, WINDOW_RULE_PROP_FIXED_POSITION) == LAB_PROP_TRUE
 			|| view_has_strut_partial(view)) {
 		return false;
 	}
@@ -998,6 +1284,22 @@ view_cascade(struct view *view)
 		offset_y = default_offset;
 	}
 
+	/* Collect the geometry of the other views from top to bottom once */
+	struct wl_array boxes;
+	wl_array_init(&boxes);
+	struct view *other_view;
+	for_each_view(other_view, &view->server->views,
+			LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
+		if (other_view != view && !other_view->minimized) {
+			struct wlr_box *box = wl_array_add(&boxes, sizeof(*box));
+			if (box) {
+				*box = ssd_max_extents(other_view);
+			}
+		}
+	}
+	struct wlr_box *others = boxes.data;
+	size_t nr_others = boxes.size / sizeof(*others);
+
 	/*
 	 * Keep updating the candidate until it doesn't cover any existing views
 	 * or doesn't fit within the usable area.
@@ -1006,15 +1308,22 @@ view_cascade(struct view *view)
 	while (candidate_updated) {
 		candidate_updated = false;
 		struct wlr_box covered = {0};
+		size_t nr_kept = 0;
+		size_t i;
 
-		/* Iterate over views from top to bottom */
-		struct view *other_view;
-		for_each_view(other_view, &view->server->views,
-				LAB_VIEW_CRITERIA_CURRENT_WORKSPACE) {
-			struct wlr_box other = ssd_max_extents(other_view);
-			if (other_view == view
-					|| view->minimized
-					|| !box_intersects(&candidate, &other)) {
+		for (i = 0; i < nr_others; i++) {
+			struct wlr_box other = others[i];
+			/*
+			 * The candidate only moves to the bottom-right, so
+			 * views left of or above it are out of the way for good
+			 * and are dropped from the list.
+			 */
+			if (other.x + other.width <= candidate.x
+					|| other.y + other.height <= candidate.y) {
+				continue;
+			}
+			others[nr_kept++] = other;
+			if (!box_intersects(&candidate, &other)) {
 				continue;
 			}
 			/*
@@ -1034,12 +1343,12 @@ view_cascade(struct view *view)
 					 * and finish updating the candidate.
 					 */
 					candidate = center;
-					break;
 				} else {
 					/* Repeat with the new candidate */
 					candidate_updated = true;
-					break;
 				}
+				i++;
+				break;
 			}
 			/*
 			 * We use just a bounding box to represent the covered
@@ -1047,7 +1356,15 @@ view_cascade(struct view *view)
 			 */
 			box_union(&covered, &covered, &other);
 		}
+
+		/* Keep the views not visited yet */
+		if (i < nr_others) {
+			memmove(&others[nr_kept], &others[i],
+				(nr_others - i) * sizeof(*others));
+		}
+		nr_others = nr_kept + nr_others - i;
 	}
+	wl_array_release(&boxes);
 
 	view_move(view, candidate.x + margin.left, candidate.y + margin.top);
 }
@@ -1137,38 +1454,8 @@ view_apply_natural_geometry(struct view *view)
 struct wlr_box
 view_get_region_snap_box(struct view *view, struct region *region)
 {
-	struct wlr_box geo = region->geo;
-
-	/* Adjust for rc.gap */
-	if (rc.gap) {
-		double half_gap = rc.gap / 2.0;
-		struct wlr_fbox offset = {
-			.x = half_gap,
-			.y = half_gap,
-			.width = -rc.gap,
-			.height = -rc.gap
-		};
-		struct wlr_box usable =
-			output_usable_area_in_layout_coords(region->output);
-		if (geo.x == usable.x) {
-			offset.x += half_gap;
-			offset.width -= half_gap;
-		}
-		if (geo.y == usable.y) {
-			offset.y += half_gap;
-			offset.height -= half_gap;
-		}
-		if (geo.x + geo.width == usable.x + usable.width) {
-			offset.width -= half_gap;
-		}
-		if (geo.y + geo.height == usable.y + usable.height) {
-			offset.height -= half_gap;
-		}
-		geo.x += offset.x;
-		geo.y += offset.y;
-		geo.width += offset.width;
-		geo.height += offset.height;
-	}
+	/* Already adjusted for rc.gap, see regions_update_geometry() */
+	struct wlr_box geo = region->snap_box;
 
 	/* And adjust for current view */
 	if (view) {
@@ -1319,6 +1606,7 @@ view_set_maximized(struct view *view, enum view_axis maximized)
 
 	view->maximized = maximized;
 	wl_signal_emit_mutable(&view->events.maximized, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
 
 	/*
 	 * Ensure that follow-up actions like SnapToEdge / SnapToRegion
@@ -1467,7 +1755,7 @@ bool
 view_wants_decorations(struct view *view)
 {
 	/* Window-rules take priority if they exist for this view */
-	switch (window_rules_get_property(view, "serverDecoration")) {
+	switch (window_rules_get_property(view, WINDOW_RULE_PROP_SERVER_DECORATION)) {
 	case LAB_PROP_TRUE:
 		return true;
 	case LAB_PROP_FALSE:
@@ -1539,6 +1827,9 @@ view_toggle_always_on_top(struct view *view)
 		wlr_scene_node_reparent(&view->scene_tree->node,
 			view->server->view_tree_always_on_top);
 	}
+	update_workspace_link(view);
+	update_focus_link(view);
+	view_update_occupancy(view);
 }
 
 bool
@@ -1561,6 +1852,9 @@ view_toggle_always_on_bottom(struct view *view)
 		wlr_scene_node_reparent(&view->scene_tree->node,
 			view->server->view_tree_always_on_bottom);
 	}
+	update_workspace_link(view);
+	update_focus_link(view);
+	view_update_occupancy(view);
 }
 
 void
@@ -1568,6 +1862,9 @@ view_toggle_visible_on_all_workspaces(struct view *view)
 {
 	assert(view);
 	view->visible_on_all_workspaces = !view->visible_on_all_workspaces;
+	view->server->workspaces.nr_omnipresent_views +=
+		view->visible_on_all_workspaces ? 1 : -1;
+	view_update_occupancy(view);
 	ssd_update_geometry(view->ssd);
 }
 
@@ -1580,6 +1877,14 @@ view_move_to_workspace(struct view *view, struct workspace *workspace)
 		view->workspace = workspace;
 		wlr_scene_node_reparent(&view->scene_tree->node,
 			workspace->tree);
+		update_workspace_link(view);
+		update_focus_link(view);
+		view_update_occupancy(view);
+		window_rules_invalidate(view);
+		desktop_schedule_arrange_tiled(view->server);
+		menu_on_window_list_changed(view->server);
+		ipc_emit(IPC_EVENT_WINDOWS);
+		edges_visibility_invalidate(view->server, view);
 	}
 }
 
@@ -1631,6 +1936,7 @@ view_set_ssd_mode(struct view *view, enum lab_ssd_mode mode)
 	} else {
 		undecorate(view);
 	}
+	edges_visibility_invalidate(view->server, view);
 
 	if (!view_is_floating(view)) {
 		view_apply_special_geometry(view);
@@ -1663,8 +1969,11 @@ set_fullscreen(struct view *view, bool fullscreen)
 		view->impl->set_fullscreen(view, fullscreen);
 	}
 
+	count_fullscreen(view, -1);
 	view->fullscreen = fullscreen;
+	count_fullscreen(view, 1);
 	wl_signal_emit_mutable(&view->events.fullscreened, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
 
 	/* Re-show decorations when no longer fullscreen */
 	if (!fullscreen && view->ssd_mode) {
@@ -1706,6 +2015,7 @@ view_set_fullscreen(struct view *view, bool fullscreen)
 		view_apply_special_geometry(view);
 	}
 	output_set_has_fullscreen_view(view->output, view->fullscreen);
+	desktop_schedule_arrange_tiled(view->server);
 	/*
 	 * Entering/leaving fullscreen might result in a different
 	 * scene node ending up under the cursor even if view_moved()
@@ -1864,6 +2174,7 @@ void
 view_on_output_destroy(struct view *view)
 {
 	assert(view);
+	count_fullscreen(view, -1);
 	view->output = NULL;
 }
 
@@ -2068,11 +2379,10 @@ view_placement_parse(const char *policy)
 	return LAB_PLACE_INVALID;
 }
 
-void
-view_snap_to_edge(struct view *view, enum lab_edge edge,
+static void
+snap_to_edge(struct view *view, enum lab_edge edge,
 		bool across_outputs, bool combine, bool store_natural_geometry)
 {
-	assert(view);
 
 	if (view->fullscreen) {
 		return;
@@ -2145,11 +2455,21 @@ view_snap_to_edge(struct view *view, enum lab_edge edge,
 }
 
 void
-view_snap_to_region(struct view *view, struct region *region,
-		bool store_natural_geometry)
+view_snap_to_edge(struct view *view, enum lab_edge edge,
+		bool across_outputs, bool combine, bool store_natural_geometry)
 {
 	assert(view);
-	assert(region);
+
+	layout_transaction_begin(view->server);
+	snap_to_edge(view, edge, across_outputs, combine,
+		store_natural_geometry);
+	layout_transaction_commit(view->server);
+}
+
+static void
+snap_to_region(struct view *view, struct region *region,
+		bool store_natural_geometry)
+{
 
 	if (view->fullscreen) {
 		return;
@@ -2178,6 +2498,18 @@ view_snap_to_region(struct view *view, struct region *region,
 	view_apply_region_geometry(view);
 }
 
+void
+view_snap_to_region(struct view *view, struct region *region,
+		bool store_natural_geometry)
+{
+	assert(view);
+	assert(region);
+
+	layout_transaction_begin(view->server);
+	snap_to_region(view, region, store_natural_geometry);
+	layout_transaction_commit(view->server);
+}
+
 void
 view_move_to_output(struct view *view, struct output *output)
 {
@@ -2222,7 +2554,11 @@ move_to_front(struct view *view)
 {
 	wl_list_remove(&view->link);
 	wl_list_insert(&view->server->views, &view->link);
+	view->stack_seq = ++front_stack_seq;
+	relink_view(view, view->workspace_list);
 	wlr_scene_node_raise_to_top(&view->scene_tree->node);
+	menu_on_window_list_changed(view->server);
+	ipc_emit(IPC_EVENT_WINDOWS);
 }
 
 static void
@@ -2230,7 +2566,11 @@ move_to_back(struct view *view)
 {
 	wl_list_remove(&view->link);
 	wl_list_append(&view->server->views, &view->link);
+	view->stack_seq = --back_stack_seq;
+	relink_view(view, view->workspace_list);
 	wlr_scene_node_lower_to_bottom(&view->scene_tree->node);
+	menu_on_window_list_changed(view->server);
+	ipc_emit(IPC_EVENT_WINDOWS);
 }
 
 /*
@@ -2253,6 +2593,7 @@ view_move_to_front(struct view *view)
 	if (view != root) {
 		move_to_front(view);
 	}
+	edges_visibility_invalidate(view->server, NULL);
 
 #if HAVE_XWAYLAND
 	/*
@@ -2261,7 +2602,9 @@ view_move_to_front(struct view *view)
 	 * about at the same time we send the mouse press input to the
 	 * X server, and creates a race where the mouse press could go
 	 * to an incorrect X window depending on timing. To mitigate the
-	 * race, perform an explicit flush after restacking.
+	 * race, flush the XWM connection once this event loop iteration
+	 * is done, which is before the mouse press is flushed to
+	 * Xwayland, and only once for any number of restacked views.
 	 */
 	xwayland_flush(view->server);
 #endif
@@ -2278,6 +2621,7 @@ view_move_to_back(struct view *view)
 
 	for_each_subview(root, move_to_back);
 	move_to_back(root);
+	edges_visibility_invalidate(view->server, NULL);
 
 	cursor_update_focus(view->server);
 	desktop_update_top_layer_visibility(view->server);
@@ -2321,6 +2665,47 @@ view_has_strut_partial(struct view *view)
 		view->impl->has_strut_partial(view);
 }
 
+static void
+apply_title(struct view *view, const char *title)
+{
+	if (!strcmp(view->title, title)) {
+		return;
+	}
+	view->title_applied_nsec = time_now_nsec();
+	xstrdup_replace(view->title, title);
+	window_rules_invalidate(view);
+	menu_on_window_list_changed(view->server);
+
+	ssd_update_title(view->ssd);
+	wl_signal_emit_mutable(&view->events.new_title, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
+	if (view == view->server->active_view) {
+		ipc_emit(IPC_EVENT_FOCUS);
+	}
+}
+
+/* Apply a coalesced title right away */
+static void
+flush_title(struct view *view)
+{
+	if (view->title_timer) {
+		wl_event_source_timer_update(view->title_timer, 0);
+	}
+	if (view->pending_title) {
+		char *title = view->pending_title;
+		view->pending_title = NULL;
+		apply_title(view, title);
+		free(title);
+	}
+}
+
+static int
+handle_title_timer(void *data)
+{
+	flush_title(data);
+	return 0;
+}
+
 void
 view_set_title(struct view *view, const char *title)
 {
@@ -2329,13 +2714,30 @@ view_set_title(struct view *view, const char *title)
 		title = "";
 	}
 
-	if (!strcmp(view->title, title)) {
+	uint64_t interval_nsec = (uint64_t)rc.title_update_interval * 1000000;
+	uint64_t elapsed = time_now_nsec() - view->title_applied_nsec;
+	if (!interval_nsec || elapsed >= interval_nsec) {
+		zfree(view->pending_title);
+		apply_title(view, title);
 		return;
 	}
-	xstrdup_replace(view->title, title);
 
-	ssd_update_title(view->ssd);
-	wl_signal_emit_mutable(&view->events.new_title, NULL);
+	if (!strcmp(view->title, title)) {
+		/* Changed back before the pending title was applied */
+		zfree(view->pending_title);
+		return;
+	}
+	if (!view->pending_title) {
+		if (!view->title_timer) {
+			view->title_timer = wl_event_loop_add_timer(
+				view->server->wl_event_loop,
+				handle_title_timer, view);
+		}
+		/* Round up so that the timer never fires too early */
+		int delay_ms = (interval_nsec - elapsed + 999999) / 1000000;
+		wl_event_source_timer_update(view->title_timer, delay_ms);
+	}
+	xstrdup_replace(view->pending_title, title);
 }
 
 void
@@ -2349,9 +2751,12 @@ view_set_app_id(struct view *view, const char *app_id)
 	if (!strcmp(view->app_id, app_id)) {
 		return;
 	}
-	xstrdup_replace(view->app_id, app_id);
+	lab_intern_unref(view->app_id);
+	view->app_id = lab_intern(app_id);
+	window_rules_invalidate(view);
 
 	wl_signal_emit_mutable(&view->events.new_app_id, NULL);
+	ipc_emit(IPC_EVENT_WINDOWS);
 }
 
 void
@@ -2405,6 +2810,44 @@ mappable_disconnect(struct mappable *mappable)
 	mappable->connected = false;
 }
 
+static struct visibility_batch {
+	int depth;
+	/* Most recently shown view, focused at the end */
+	struct view *focus_view;
+	bool refocus;
+	bool update_top_layer;
+	bool update_struts;
+} visibility_batch;
+
+void
+view_visibility_batch_begin(void)
+{
+	visibility_batch.depth++;
+}
+
+void
+view_visibility_batch_end(struct server *server)
+{
+	assert(visibility_batch.depth > 0);
+	if (--visibility_batch.depth) {
+		return;
+	}
+
+	if (visibility_batch.update_struts) {
+		output_update_struts(server);
+	}
+	struct view *focus_view = visibility_batch.focus_view;
+	if (focus_view && focus_view->scene_tree->node.enabled) {
+		desktop_focus_view(focus_view, /*raise*/ true);
+	} else if (visibility_batch.refocus) {
+		desktop_focus_topmost_view(server);
+	}
+	if (visibility_batch.update_top_layer) {
+		desktop_update_top_layer_visibility(server);
+	}
+	visibility_batch = (struct visibility_batch){0};
+}
+
 /* Used in both (un)map and (un)minimize */
 void
 view_update_visibility(struct view *view)
@@ -2415,11 +2858,20 @@ view_update_visibility(struct view *view)
 	}
 
 	wlr_scene_node_set_enabled(&view->scene_tree->node, visible);
+	edges_visibility_invalidate(view->server, view);
+	/* Before desktop_focus_topmost_view() looks at the focus order */
+	update_focus_link(view);
 	struct server *server = view->server;
+	bool batched = visibility_batch.depth > 0;
 
-	if (visible) {
+	if (visible && batched) {
+		visibility_batch.focus_view = view;
+	} else if (visible) {
 		desktop_focus_view(view, /*raise*/ true);
 	} else {
+		if (view == visibility_batch.focus_view) {
+			visibility_batch.focus_view = NULL;
+		}
 		/*
 		 * When exiting an xwayland application with multiple
 		 * views mapped, a race condition can occur: after the
@@ -2429,7 +2881,11 @@ view_update_visibility(struct view *view)
 		 * being left with no active view at all, check for that
 		 * case also.
 		 */
-		if (view == server->active_view || !server->active_view) {
+		bool lost_focus =
+			view == server->active_view || !server->active_view;
+		if (lost_focus && batched) {
+			visibility_batch.refocus = true;
+		} else if (lost_focus) {
 			desktop_focus_topmost_view(server);
 		}
 	}
@@ -2438,7 +2894,11 @@ view_update_visibility(struct view *view)
 	 * Show top layer when a fullscreen view is hidden.
 	 * Hide it if a fullscreen view is shown (or uncovered).
 	 */
-	desktop_update_top_layer_visibility(server);
+	if (batched) {
+		visibility_batch.update_top_layer = true;
+	} else {
+		desktop_update_top_layer_visibility(server);
+	}
 
 	/*
 	 * We may need to disable adaptive sync if view was fullscreen.
@@ -2453,7 +2913,11 @@ view_update_visibility(struct view *view)
 
 	/* Update usable area to account for XWayland "struts" (panels) */
 	if (view_has_strut_partial(view)) {
-		output_update_all_usable_areas(server, false);
+		if (batched) {
+			visibility_batch.update_struts = true;
+		} else {
+			output_update_struts(server);
+		}
 	}
 }
 
@@ -2477,7 +2941,10 @@ view_set_shade(struct view *view, bool shaded)
 	}
 
 	view->shaded = shaded;
+	resize_snapshot_finish(view);
 	ssd_enable_shade(view->ssd, view->shaded);
+	ipc_emit(IPC_EVENT_WINDOWS);
+	edges_visibility_invalidate(view->server, view);
 	/*
 	 * An unmapped view may not have a content tree. When the view
 	 * is mapped again, the new content tree will be hidden by the
@@ -2528,7 +2995,7 @@ view_init(struct view *view)
 	wl_signal_init(&view->events.destroy);
 
 	view->title = xstrdup("");
-	view->app_id = xstrdup("");
+	view->app_id = lab_intern("");
 }
 
 void
@@ -2539,6 +3006,7 @@ view_destroy(struct view *view)
 
 	wl_signal_emit_mutable(&view->events.destroy, NULL);
 	snap_constraints_invalidate(view);
+	edges_visibility_invalidate(server, view);
 
 	if (view->mappable.connected) {
 		mappable_disconnect(&view->mappable);
@@ -2553,7 +3021,13 @@ view_destroy(struct view *view)
 	wl_list_remove(&view->destroy.link);
 
 	zfree(view->title);
-	zfree(view->app_id);
+	lab_intern_unref(view->app_id);
+	view->app_id = NULL;
+	zfree(view->pending_title);
+	if (view->title_timer) {
+		wl_event_source_remove(view->title_timer);
+		view->title_timer = NULL;
+	}
 
 	if (view->foreign_toplevel) {
 		foreign_toplevel_destroy(view->foreign_toplevel);
@@ -2567,6 +3041,11 @@ view_destroy(struct view *view)
 
 	if (server->active_view == view) {
 		server->active_view = NULL;
+		ipc_emit(IPC_EVENT_FOCUS);
+	}
+
+	if (visibility_batch.focus_view == view) {
+		visibility_batch.focus_view = NULL;
 	}
 
 	if (server->session_lock_manager->last_active_view == view) {
@@ -2579,6 +3058,7 @@ view_destroy(struct view *view)
 
 	/* TODO: call this on map/unmap instead */
 	cycle_reinitialize(server);
+	cycle_osd_forget_view(view);
 
 	undecorate(view);
 
@@ -2593,6 +3073,7 @@ view_destroy(struct view *view)
 	if (view->scene_tree) {
 		wlr_scene_node_destroy(&view->scene_tree->node);
 		view->scene_tree = NULL;
+		view->resize_snapshot = NULL;
 	}
 
 	assert(wl_list_empty(&view->events.new_app_id.listener_list));
@@ -2607,16 +3088,27 @@ view_destroy(struct view *view)
 
 	/* Remove view from server->views */
 	wl_list_remove(&view->link);
+	wl_list_remove(&view->age_link);
+	wl_list_remove(&view->workspace_link);
+	wl_list_remove(&view->focus_link);
+	count_fullscreen(view, -1);
+	if (view->visible_on_all_workspaces) {
+		server->workspaces.nr_omnipresent_views--;
+	}
+	if (view->occupied_workspace) {
+		view->occupied_workspace->nr_views--;
+		ipc_emit(IPC_EVENT_OCCUPANCY);
+	}
+	window_rules_views_changed();
 
 	/* Clear resized_view if this was the resized window */
 	if (server->resized_view == view) {
 		server->resized_view = NULL;
 	}
+	tiling_view_destroyed(view);
 
 	/* Rearrange tiled windows when one is destroyed */
-	if (server->tiling_mode) {
-		desktop_arrange_tiled(server);
-	}
+	desktop_schedule_arrange_tiled(server);
 
 	free(view);
 
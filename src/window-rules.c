@@ -3,24 +3,65 @@
 #include "window-rules.h"
 #include <assert.h>
 #include <stdbool.h>
-#include <strings.h>
 #include "action.h"
+#include "common/hash.h"
+#include "common/intern.h"
+#include "common/mem.h"
 #include "config/rcxml.h"
 #include "labwc.h"
 #include "view.h"
 
-static bool
-other_instances_exist(struct view *self, struct view_query *query)
-{
-	struct wl_list *views = &self->server->views;
-	struct view *view;
+/*
+ * Rules setting at least one property, highest priority first. We store
+ * them in reverse order because later items in the list have higher
+ * priority. For example, in the config below we want the value of foot's
+ * "serverDecoration" property to be "default".
+ *
+ *     <windowRules>
+ *       <windowRule identifier="*" serverDecoration="no"/>
+ *       <windowRule identifier="foot" serverDecoration="default"/>
+ *     </windowRules>
+ *
+ * Rules with actions are kept per event, in config order.
+ */
+static struct {
+	struct window_rule **rules;
+	int nr_rules;
+	struct window_rule **event_rules[LAB_WINDOW_RULE_EVENT_COUNT];
+	int nr_event_rules[LAB_WINDOW_RULE_EVENT_COUNT];
+	bool has_match_once;
+	/* Bit i is set if any rule sets property i */
+	uint32_t set_properties;
+	uint32_t generation;
 
-	wl_list_for_each(view, views, link) {
-		if (view != self && view_matches_query(view, query)) {
-			return true;
+	/*
+	 * Rules with a literal identifier are indexed by it, so that they
+	 * can be skipped after a single lookup of the app_id of a view.
+	 * See struct window_rule.id_slot. The identifiers are interned and
+	 * lower case, and so are looked up by pointer.
+	 */
+	const char **ids;
+	uint32_t ids_mask;
+} compiled;
+
+/*
+ * Returns the number of views matching @query, which is counted once
+ * for each generation of the compiled rules rather than for each view
+ * looking up a matchOnce rule.
+ */
+static int
+count_instances(struct window_rule *rule, struct view *self,
+		struct view_query *query)
+{
+	if (rule->instances_generation != compiled.generation) {
+		rule->nr_instances = 0;
+		struct view *view;
+		wl_list_for_each(view, &self->server->views, link) {
+			rule->nr_instances += view_matches_query(view, query);
 		}
+		rule->instances_generation = compiled.generation;
 	}
-	return false;
+	return rule->nr_instances;
 }
 
 static bool
@@ -37,88 +78,223 @@ view_matches_criteria(struct window_rule *rule, struct view *view)
 		.decoration = LAB_SSD_MODE_INVALID,
 	};
 
-	if (rule->match_once && other_instances_exist(view, &query)) {
+	if (!view_matches_query(view, &query)) {
 		return false;
 	}
 
-	return view_matches_query(view, &query);
+	/* Only match if @view is the one and only instance */
+	return !rule->match_once || count_instances(rule, view, &query) == 1;
 }
 
-void
-window_rules_apply(struct view *view, enum window_rule_event event)
+/* @identifier is the folded version of an interned string */
+static int
+lookup_identifier_slot(const char *identifier, bool insert)
+{
+	if (!compiled.ids || !identifier) {
+		return -1;
+	}
+	uint32_t i = hash_add(HASH_INIT, &identifier, sizeof(identifier))
+		& compiled.ids_mask;
+	while (compiled.ids[i]) {
+		if (compiled.ids[i] == identifier) {
+			return i;
+		}
+		i = (i + 1) & compiled.ids_mask;
+	}
+	if (!insert) {
+		return -1;
+	}
+	compiled.ids[i] = identifier;
+	return i;
+}
+
+static void
+index_identifiers(int nr_rules)
 {
+	/* Keep the table at most half full */
+	uint32_t size = 4;
+	while (size < 2 * (uint32_t)nr_rules) {
+		size *= 2;
+	}
+	compiled.ids = znew_n(*compiled.ids, size);
+	compiled.ids_mask = size - 1;
+
 	struct window_rule *rule;
 	wl_list_for_each(rule, &rc.window_rules, link) {
-		if (rule->event != event) {
-			continue;
-		}
-		if (view_matches_criteria(rule, view)) {
+		struct match_pattern *identifier = &rule->identifier;
+		rule->id_slot = identifier->pattern
+			&& identifier->kind == MATCH_EXACT
+			? lookup_identifier_slot(identifier->literal,
+				/* insert */ true)
+			: -1;
+	}
+}
+
+/* Cheap check whether @rule can match a view with identifier slot @id_slot */
+static bool
+identifier_may_match(struct window_rule *rule, int id_slot)
+{
+	return rule->id_slot < 0 || rule->id_slot == id_slot;
+}
+
+void
+window_rules_apply(struct view *view, enum window_rule_event event)
+{
+	assert(event >= 0 && event < LAB_WINDOW_RULE_EVENT_COUNT);
+
+	int id_slot = lookup_identifier_slot(lab_intern_folded(view->app_id),
+		/* insert */ false);
+	for (int r = 0; r < compiled.nr_event_rules[event]; r++) {
+		struct window_rule *rule = compiled.event_rules[event][r];
+		if (identifier_may_match(rule, id_slot)
+				&& view_matches_criteria(rule, view)) {
 			actions_run(view, view->server, &rule->actions, NULL);
 		}
 	}
 }
 
-enum property
-window_rules_get_property(struct view *view, const char *property)
+/* Drop all cached properties */
+static void
+bump_generation(void)
 {
-	assert(property);
+	/* Never use 0, which marks a cache as invalid */
+	if (++compiled.generation == 0) {
+		compiled.generation = 1;
+	}
+}
+
+static bool
+sets_property(struct window_rule *rule)
+{
+	for (int i = 0; i < WINDOW_RULE_PROP_COUNT; i++) {
+		if (rule->properties[i] != LAB_PROP_UNSPECIFIED) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+window_rules_compile(void)
+{
+	zfree(compiled.rules);
+	compiled.nr_rules = 0;
+	for (int e = 0; e < LAB_WINDOW_RULE_EVENT_COUNT; e++) {
+		zfree(compiled.event_rules[e]);
+		compiled.nr_event_rules[e] = 0;
+	}
+	zfree(compiled.ids);
+	compiled.has_match_once = false;
+	compiled.set_properties = 0;
+	bump_generation();
+
+	int nr_rules = wl_list_length(&rc.window_rules);
+	if (!nr_rules) {
+		return;
+	}
+	index_identifiers(nr_rules);
 
-	/*
-	 * We iterate in reverse here because later items in list have higher
-	 * priority. For example, in the config below we want the return value
-	 * for foot's "serverDecoration" property to be "default".
-	 *
-	 *     <windowRules>
-	 *       <windowRule identifier="*" serverDecoration="no"/>
-	 *       <windowRule identifier="foot" serverDecoration="default"/>
-	 *     </windowRules>
-	 */
 	struct window_rule *rule;
+	wl_list_for_each(rule, &rc.window_rules, link) {
+		if (wl_list_empty(&rule->actions)) {
+			continue;
+		}
+		int e = rule->event;
+		if (!compiled.event_rules[e]) {
+			compiled.event_rules[e] =
+				znew_n(*compiled.event_rules[e], nr_rules);
+		}
+		compiled.event_rules[e][compiled.nr_event_rules[e]++] = rule;
+		if (rule->match_once) {
+			compiled.has_match_once = true;
+		}
+	}
+
+	compiled.rules = znew_n(*compiled.rules, nr_rules);
 	wl_list_for_each_reverse(rule, &rc.window_rules, link) {
 		/*
-		 * Only return if property != LAB_PROP_UNSPECIFIED otherwise a
-		 * <windowRule> which does not set a particular property
-		 * attribute would still return here if that property was asked
-		 * for.
+		 * A property is only taken from a rule which sets it,
+		 * otherwise a <windowRule> which does not set a particular
+		 * property attribute would still win for that property.
 		 */
-		if (view_matches_criteria(rule, view)) {
-			if (rule->server_decoration
-					&& !strcasecmp(property, "serverDecoration")) {
-				return rule->server_decoration;
-			}
-			if (rule->skip_taskbar
-					&& !strcasecmp(property, "skipTaskbar")) {
-				return rule->skip_taskbar;
-			}
-			if (rule->skip_window_switcher
-					&& !strcasecmp(property, "skipWindowSwitcher")) {
-				return rule->skip_window_switcher;
-			}
-			if (rule->ignore_focus_request
-					&& !strcasecmp(property, "ignoreFocusRequest")) {
-				return rule->ignore_focus_request;
-			}
-			if (rule->ignore_configure_request
-					&& !strcasecmp(property, "ignoreConfigureRequest")) {
-				return rule->ignore_configure_request;
-			}
-			if (rule->fixed_position
-					&& !strcasecmp(property, "fixedPosition")) {
-				return rule->fixed_position;
-			}
-			if (rule->icon_prefer_client
-					&& !strcasecmp(property, "iconPreferClient")) {
-				return rule->icon_prefer_client;
-			}
-			if (rule->tile
-					&& !strcasecmp(property, "tile")) {
-				return rule->tile;
+		if (!sets_property(rule)) {
+			continue;
+		}
+		compiled.rules[compiled.nr_rules++] = rule;
+		for (int i = 0; i < WINDOW_RULE_PROP_COUNT; i++) {
+			if (rule->properties[i] != LAB_PROP_UNSPECIFIED) {
+				compiled.set_properties |= 1u << i;
 			}
-			if (rule->tile_direction
-					&& !strcasecmp(property, "tileDirection")) {
-				return rule->tile_direction;
+		}
+		if (rule->match_once) {
+			compiled.has_match_once = true;
+		}
+	}
+}
+
+bool
+window_rules_sets_property(enum window_rule_prop property)
+{
+	assert(property >= 0 && property < WINDOW_RULE_PROP_COUNT);
+	return compiled.set_properties & (1u << property);
+}
+
+void
+window_rules_invalidate(struct view *view)
+{
+	if (compiled.has_match_once) {
+		/* matchOnce rules of other views may depend on this one */
+		bump_generation();
+	} else {
+		view->window_rules_cache.generation = 0;
+	}
+}
+
+void
+window_rules_views_changed(void)
+{
+	/* matchOnce rules depend on the other views */
+	if (compiled.has_match_once) {
+		bump_generation();
+	}
+}
+
+static void
+resolve_properties(struct view *view)
+{
+	struct window_rules_cache *cache = &view->window_rules_cache;
+	int nr_unresolved = WINDOW_RULE_PROP_COUNT;
+	for (int i = 0; i < WINDOW_RULE_PROP_COUNT; i++) {
+		cache->properties[i] = LAB_PROP_UNSPECIFIED;
+	}
+
+	int id_slot = lookup_identifier_slot(lab_intern_folded(view->app_id),
+		/* insert */ false);
+	for (int r = 0; r < compiled.nr_rules && nr_unresolved; r++) {
+		struct window_rule *rule = compiled.rules[r];
+		if (!identifier_may_match(rule, id_slot)
+				|| !view_matches_criteria(rule, view)) {
+			continue;
+		}
+		for (int i = 0; i < WINDOW_RULE_PROP_COUNT; i++) {
+			if (cache->properties[i] == LAB_PROP_UNSPECIFIED
+					&& rule->properties[i] != LAB_PROP_UNSPECIFIED) {
+				cache->properties[i] = rule->properties[i];
+				nr_unresolved--;
 			}
 		}
 	}
-	return LAB_PROP_UNSPECIFIED;
+	cache->generation = compiled.generation;
+}
+
+enum property
+window_rules_get_property(struct view *view, enum window_rule_prop property)
+{
+	assert(property >= 0 && property < WINDOW_RULE_PROP_COUNT);
+
+	struct window_rules_cache *cache = &view->window_rules_cache;
+	if (!cache->generation || cache->generation != compiled.generation) {
+		resolve_properties(view);
+	}
+	return cache->properties[property];
 }
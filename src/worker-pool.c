@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "worker-pool.h"
+#include <assert.h>
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "common/macros.h"
+#include "common/mem.h"
+#include "common/time-helpers.h"
+#include "metrics.h"
+
+#define MAX_THREADS 4
+
+struct worker_job {
+	worker_run_fn run;
+	worker_done_fn done;
+	void *data;
+	gint cancelled;
+	/* Written by the worker before the job is queued as done */
+	uint64_t submit_nsec;
+	uint64_t start_nsec;
+	uint64_t end_nsec;
+};
+
+static struct {
+	GThreadPool *pool;
+	GAsyncQueue *done; /* struct worker_job */
+	int eventfd;
+	struct wl_event_source *source;
+	/* Submitted jobs whose done() hasn't been called yet */
+	int nr_pending;
+} workers = { .eventfd = -1 };
+
+static struct {
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t cancelled;
+	int max_pending;
+	uint64_t wait_nsec_total;
+	uint64_t wait_nsec_max;
+	uint64_t run_nsec_total;
+	uint64_t run_nsec_max;
+} stats;
+
+static void
+run_job(gpointer data, gpointer user_data)
+{
+	struct worker_job *job = data;
+	job->start_nsec = time_now_nsec();
+	if (!g_atomic_int_get(&job->cancelled)) {
+		job->run(job, job->data);
+	}
+	job->end_nsec = time_now_nsec();
+
+	g_async_queue_push(workers.done, job);
+	uint64_t one = 1;
+	if (write(workers.eventfd, &one, sizeof(one)) != sizeof(one)) {
+		wlr_log_errno(WLR_ERROR, "cannot signal finished job");
+	}
+}
+
+static void
+complete_job(struct worker_job *job)
+{
+	bool cancelled = g_atomic_int_get(&job->cancelled);
+	uint64_t wait_nsec = job->start_nsec - job->submit_nsec;
+	uint64_t run_nsec = job->end_nsec - job->start_nsec;
+	stats.completed++;
+	stats.cancelled += cancelled;
+	stats.wait_nsec_total += wait_nsec;
+	stats.wait_nsec_max = MAX(stats.wait_nsec_max, wait_nsec);
+	stats.run_nsec_total += run_nsec;
+	stats.run_nsec_max = MAX(stats.run_nsec_max, run_nsec);
+
+	workers.nr_pending--;
+	job->done(job->data, cancelled);
+	free(job);
+}
+
+static void
+complete_jobs(void)
+{
+	struct worker_job *job;
+	while ((job = g_async_queue_try_pop(workers.done))) {
+		complete_job(job);
+	}
+}
+
+static int
+handle_jobs_done(int fd, uint32_t mask, void *data)
+{
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0) {
+		return 0;
+	}
+	complete_jobs();
+	return 0;
+}
+
+void
+worker_pool_init(struct wl_event_loop *loop)
+{
+	workers.eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (workers.eventfd < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot create eventfd");
+		return;
+	}
+	workers.source = wl_event_loop_add_fd(loop, workers.eventfd,
+		WL_EVENT_READABLE, handle_jobs_done, NULL);
+	if (!workers.source) {
+		goto err_eventfd;
+	}
+
+	/* Leave one core to the main thread */
+	int nr_threads = CLAMP((int)g_get_num_processors() - 1, 1, MAX_THREADS);
+	GError *err = NULL;
+	workers.pool = g_thread_pool_new(run_job, NULL, nr_threads,
+		/*exclusive*/ TRUE, &err);
+	if (!workers.pool) {
+		wlr_log(WLR_ERROR, "cannot create thread pool: %s",
+			err->message);
+		g_error_free(err);
+		goto err_source;
+	}
+	workers.done = g_async_queue_new();
+
+	metrics_add_u64("worker_jobs_submitted", NULL, "Jobs submitted",
+		METRIC_COUNTER, &stats.submitted, NULL);
+	metrics_add_u64("worker_jobs_completed", NULL, "Jobs completed",
+		METRIC_COUNTER, &stats.completed, NULL);
+	metrics_add_u64("worker_jobs_cancelled", NULL, "Jobs cancelled",
+		METRIC_COUNTER, &stats.cancelled, NULL);
+	metrics_add_int("worker_jobs_pending", NULL,
+		"Jobs submitted but not done yet", METRIC_GAUGE,
+		&workers.nr_pending, NULL);
+	return;
+
+err_source:
+	wl_event_source_remove(workers.source);
+	workers.source = NULL;
+err_eventfd:
+	close(workers.eventfd);
+	workers.eventfd = -1;
+}
+
+void
+worker_pool_finish(void)
+{
+	if (!workers.pool) {
+		return;
+	}
+	/* Wait for running and queued jobs */
+	g_thread_pool_free(workers.pool, /*immediate*/ FALSE, /*wait*/ TRUE);
+	workers.pool = NULL;
+	complete_jobs();
+	assert(!workers.nr_pending);
+
+	g_async_queue_unref(workers.done);
+	workers.done = NULL;
+	wl_event_source_remove(workers.source);
+	workers.source = NULL;
+	close(workers.eventfd);
+	workers.eventfd = -1;
+}
+
+struct worker_job *
+worker_pool_submit(worker_run_fn run, worker_done_fn done, void *data)
+{
+	assert(run && done);
+	if (!workers.pool) {
+		return NULL;
+	}
+
+	struct worker_job *job = znew(*job);
+	job->run = run;
+	job->done = done;
+	job->data = data;
+	job->submit_nsec = time_now_nsec();
+	if (!g_thread_pool_push(workers.pool, job, NULL)) {
+		free(job);
+		return NULL;
+	}
+	stats.submitted++;
+	workers.nr_pending++;
+	stats.max_pending = MAX(stats.max_pending, workers.nr_pending);
+	return job;
+}
+
+void
+worker_job_cancel(struct worker_job *job)
+{
+	g_atomic_int_set(&job->cancelled, 1);
+}
+
+bool
+worker_job_is_cancelled(struct worker_job *job)
+{
+	return g_atomic_int_get(&job->cancelled);
+}
+
+void
+worker_pool_stats_print(FILE *stream)
+{
+	uint64_t completed = MAX(stats.completed, 1);
+	fprintf(stream, "threads: %d\n", workers.pool
+		? (int)g_thread_pool_get_max_threads(workers.pool) : 0);
+	fprintf(stream, "pending: %d\n", workers.nr_pending);
+	fprintf(stream, "pending_max: %d\n", stats.max_pending);
+	fprintf(stream, "submitted: %lu\n", (unsigned long)stats.submitted);
+	fprintf(stream, "completed: %lu\n", (unsigned long)stats.completed);
+	fprintf(stream, "cancelled: %lu\n", (unsigned long)stats.cancelled);
+	fprintf(stream, "wait_avg_us: %lu\n",
+		(unsigned long)(stats.wait_nsec_total / completed / 1000));
+	fprintf(stream, "wait_max_us: %lu\n",
+		(unsigned long)(stats.wait_nsec_max / 1000));
+	fprintf(stream, "run_avg_us: %lu\n",
+		(unsigned long)(stats.run_nsec_total / completed / 1000));
+	fprintf(stream, "run_max_us: %lu\n",
+		(unsigned long)(stats.run_nsec_max / 1000));
+}
+
+void
+worker_pool_stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.max_pending = workers.nr_pending;
+}
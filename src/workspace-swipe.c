@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include "workspace-swipe.h"
+#include <math.h>
+#include <stdlib.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "common/macros.h"
+#include "common/mem.h"
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "labwc.h"
+#include "output.h"
+#include "workspaces.h"
+
+/* Angular frequency of the critically damped spring, in 1/s */
+#define SPRING_OMEGA 25.0
+/* How far the release velocity carries the workspaces, in seconds */
+#define PROJECTION_TIME 0.15
+/* Movement beyond the first or last workspace is damped by this factor */
+#define EDGE_RESISTANCE 0.3
+/* Longest time step, so that a stalled frame doesn't make the spring jump */
+#define MAX_STEP_NSEC (50 * 1000 * 1000)
+
+struct workspace_swipe {
+	struct workspace *from;
+	struct workspace *prev, *next;
+	/* Width of the output under the cursor in layout coordinates */
+	double distance;
+	/* Displacement of the current workspace, positive to the right */
+	double offset;
+	/* In pixels per second */
+	double velocity;
+	uint32_t last_update_msec;
+
+	/* Set once the fingers are lifted */
+	bool animating;
+	double target;
+	uint64_t last_frame_nsec;
+};
+
+static void
+set_tree_offset(struct workspace *workspace, int x, bool enabled)
+{
+	if (!workspace) {
+		return;
+	}
+	wlr_scene_node_set_position(&workspace->tree->node, x, 0);
+	wlr_scene_node_set_enabled(&workspace->tree->node, enabled);
+}
+
+static void
+update_trees(struct workspace_swipe *swipe)
+{
+	int offset = lround(swipe->offset);
+	int distance = lround(swipe->distance);
+	set_tree_offset(swipe->from, offset, true);
+	set_tree_offset(swipe->prev, offset - distance, offset > 0);
+	set_tree_offset(swipe->next, offset + distance, offset < 0);
+}
+
+static void
+restore_trees(struct workspace_swipe *swipe)
+{
+	set_tree_offset(swipe->from, 0, true);
+	set_tree_offset(swipe->prev, 0, false);
+	set_tree_offset(swipe->next, 0, false);
+}
+
+static void
+schedule_frames(struct server *server)
+{
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output_is_usable(output)) {
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+}
+
+void
+workspace_swipe_cancel(struct server *server)
+{
+	struct workspace_swipe *swipe = server->workspaces.swipe;
+	if (!swipe) {
+		return;
+	}
+	server->workspaces.swipe = NULL;
+	restore_trees(swipe);
+	free(swipe);
+}
+
+bool
+workspace_swipe_begin(struct server *server, uint32_t fingers)
+{
+	if (!rc.workspace_config.swipe_fingers
+			|| fingers != (uint32_t)rc.workspace_config.swipe_fingers
+			|| server->input_mode != LAB_INPUT_STATE_PASSTHROUGH
+			|| wl_list_length(&server->workspaces.all) < 2) {
+		return false;
+	}
+	struct output *output = output_nearest_to_cursor(server);
+	if (!output_is_usable(output)) {
+		return false;
+	}
+	struct wlr_box box;
+	wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+	if (wlr_box_empty(&box)) {
+		return false;
+	}
+
+	/* A new swipe catches the workspaces in the middle of an animation */
+	double offset = 0;
+	if (server->workspaces.swipe) {
+		offset = server->workspaces.swipe->offset;
+		workspace_swipe_cancel(server);
+	}
+
+	struct workspace_swipe *swipe = znew(*swipe);
+	swipe->from = server->workspaces.current;
+	swipe->prev = workspaces_find(swipe->from, "left", /*wrap*/ false);
+	swipe->next = workspaces_find(swipe->from, "right", /*wrap*/ false);
+	swipe->distance = box.width;
+	swipe->offset = offset;
+	server->workspaces.swipe = swipe;
+	return true;
+}
+
+bool
+workspace_swipe_update(struct server *server, uint32_t time_msec, double dx)
+{
+	struct workspace_swipe *swipe = server->workspaces.swipe;
+	if (!swipe || swipe->animating) {
+		return false;
+	}
+
+	/* Follow the fingers 1:1, with resistance where there is nothing */
+	bool at_edge = (swipe->offset > 0 && !swipe->prev)
+		|| (swipe->offset < 0 && !swipe->next);
+	if (at_edge) {
+		dx *= EDGE_RESISTANCE;
+	}
+	swipe->offset = MAX(-swipe->distance,
+		MIN(swipe->offset + dx, swipe->distance));
+
+	if (swipe->last_update_msec && time_msec > swipe->last_update_msec) {
+		double velocity = dx * 1000.0 / (time_msec - swipe->last_update_msec);
+		/* Smooth out the jitter of individual touchpad samples */
+		swipe->velocity = 0.5 * swipe->velocity + 0.5 * velocity;
+	}
+	swipe->last_update_msec = time_msec;
+
+	update_trees(swipe);
+	return true;
+}
+
+bool
+workspace_swipe_end(struct server *server, bool cancelled)
+{
+	struct workspace_swipe *swipe = server->workspaces.swipe;
+	if (!swipe || swipe->animating) {
+		return false;
+	}
+
+	double projected = swipe->offset + swipe->velocity * PROJECTION_TIME;
+	swipe->target = 0;
+	if (!cancelled) {
+		if (projected <= -swipe->distance / 2 && swipe->next) {
+			swipe->target = -swipe->distance;
+		} else if (projected >= swipe->distance / 2 && swipe->prev) {
+			swipe->target = swipe->distance;
+		}
+	}
+
+	swipe->animating = true;
+	swipe->last_frame_nsec = time_now_nsec();
+	schedule_frames(server);
+	return true;
+}
+
+static void
+finish_animation(struct server *server, struct workspace_swipe *swipe)
+{
+	struct workspace *target = NULL;
+	if (swipe->target < 0) {
+		target = swipe->next;
+	} else if (swipe->target > 0) {
+		target = swipe->prev;
+	}
+
+	/* The trees are back in place before the switch re-enables them */
+	workspace_swipe_cancel(server);
+	if (target) {
+		workspaces_switch_to(target, /* update_focus */ true);
+	}
+}
+
+void
+workspace_swipe_frame(struct server *server)
+{
+	struct workspace_swipe *swipe = server->workspaces.swipe;
+	if (!swipe || !swipe->animating) {
+		return;
+	}
+
+	/* Several outputs call this per refresh cycle, so advance by time */
+	uint64_t now = time_now_nsec();
+	uint64_t step = MIN(now - swipe->last_frame_nsec, MAX_STEP_NSEC);
+	swipe->last_frame_nsec = now;
+	if (!step) {
+		return;
+	}
+	double dt = step / 1e9;
+
+	/* Semi-implicit Euler step of x'' = -w^2 * x - 2w * x' */
+	double displacement = swipe->offset - swipe->target;
+	double acceleration = -SPRING_OMEGA * SPRING_OMEGA * displacement
+		- 2 * SPRING_OMEGA * swipe->velocity;
+	swipe->velocity += acceleration * dt;
+	swipe->offset += swipe->velocity * dt;
+
+	if (fabs(swipe->offset - swipe->target) < 0.5
+			&& fabs(swipe->velocity) < 20) {
+		finish_animation(server, swipe);
+		return;
+	}
+
+	update_trees(swipe);
+	schedule_frames(server);
+}
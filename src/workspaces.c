@@ -16,14 +16,22 @@
 #include "common/graphic-helpers.h"
 #include "common/list.h"
 #include "common/mem.h"
+#include "common/scene-helpers.h"
+#include "config/keybind.h"
 #include "config/rcxml.h"
+#include "edges.h"
 #include "input/keyboard.h"
+#include "ipc.h"
 #include "labwc.h"
+#include "menu/menu.h"
 #include "output.h"
 #include "protocols/cosmic-workspaces.h"
 #include "protocols/ext-workspace.h"
 #include "theme.h"
+#include "tiling.h"
+#include "timer.h"
 #include "view.h"
+#include "workspace-swipe.h"
 
 #define COSMIC_WORKSPACES_VERSION 1
 #define EXT_WORKSPACES_VERSION 1
@@ -61,8 +69,32 @@ parse_workspace_index(const char *name)
 	return index;
 }
 
+/*
+ * Rendered workspace OSDs, one per workspace shown as the current one and
+ * output scale. They only depend on the theme and the list of workspaces,
+ * so switching workspaces just swaps the buffer shown.
+ */
+struct osd_buffer {
+	struct workspace *workspace;
+	float scale;
+	struct lab_data_buffer *buffer;
+};
+
+static struct wl_array osd_buffers;
+
 static void
-_osd_update(struct server *server)
+osd_buffers_reset(void)
+{
+	struct osd_buffer *osd_buffer;
+	wl_array_for_each(osd_buffer, &osd_buffers) {
+		wlr_buffer_drop(&osd_buffer->buffer->base);
+	}
+	wl_array_release(&osd_buffers);
+	wl_array_init(&osd_buffers);
+}
+
+static struct lab_data_buffer *
+render_osd(struct server *server, struct workspace *current, float scale)
 {
 	struct theme *theme = server->theme;
 
@@ -84,85 +116,126 @@ _osd_update(struct server *server)
 	cairo_surface_t *surface;
 	struct workspace *workspace;
 
+	struct lab_data_buffer *buffer = buffer_create_cairo(width, height, scale);
+	if (!buffer) {
+		wlr_log(WLR_ERROR, "Failed to allocate buffer for workspace OSD");
+		return NULL;
+	}
+	buffer_set_category(buffer, BUFFER_OSD);
+
+	cairo = cairo_create(buffer->surface);
+
+	/* Background */
+	set_cairo_color(cairo, theme->osd_bg_color);
+	cairo_rectangle(cairo, 0, 0, width, height);
+	cairo_fill(cairo);
+	buffer->opaque = theme->osd_bg_color[3] >= 0.999f;
+
+	/* Border */
+	set_cairo_color(cairo, theme->osd_border_color);
+	struct wlr_fbox border_fbox = {
+		.width = width,
+		.height = height,
+	};
+	draw_cairo_border(cairo, border_fbox, theme->osd_border_width);
+
+	/* Boxes */
+	uint16_t x;
+	if (!hide_boxes) {
+		x = (width - marker_width) / 2;
+		wl_list_for_each(workspace, &server->workspaces.all, link) {
+			bool active = workspace == current;
+			set_cairo_color(cairo, server->theme->osd_label_text_color);
+			struct wlr_fbox fbox = {
+				.x = x,
+				.y = margin,
+				.width = rect_width,
+				.height = rect_height,
+			};
+			draw_cairo_border(cairo, fbox,
+				theme->osd_workspace_switcher_boxes_border_width);
+			if (active) {
+				cairo_rectangle(cairo, x, margin,
+					rect_width, rect_height);
+				cairo_fill(cairo);
+			}
+			x += rect_width + padding;
+		}
+	}
+
+	/* Text */
+	set_cairo_color(cairo, server->theme->osd_label_text_color);
+	PangoLayout *layout = pango_cairo_create_layout(cairo);
+	pango_context_set_round_glyph_positions(pango_layout_get_context(layout), false);
+	pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+
+	/* Center workspace indicator on the x axis */
+	int req_width = font_width(&rc.font_osd, current->name);
+	req_width = MIN(req_width, width - 2 * margin);
+	x = (width - req_width) / 2;
+	if (!hide_boxes) {
+		cairo_move_to(cairo, x, margin * 2 + rect_height);
+	} else {
+		cairo_move_to(cairo, x, (height - font_height(&rc.font_osd)) / 2.0);
+	}
+	PangoFontDescription *desc = font_to_pango_desc(&rc.font_osd);
+	//pango_font_description_set_weight(desc, PANGO_WEIGHT_BOLD);
+	pango_layout_set_font_description(layout, desc);
+	pango_layout_set_width(layout, req_width * PANGO_SCALE);
+	pango_font_description_free(desc);
+	pango_layout_set_text(layout, current->name, -1);
+	pango_cairo_show_layout(cairo, layout);
+
+	g_object_unref(layout);
+	surface = cairo_get_target(cairo);
+	cairo_surface_flush(surface);
+	cairo_destroy(cairo);
+
+	return buffer;
+}
+
+static struct lab_data_buffer *
+get_osd_buffer(struct server *server, struct workspace *workspace, float scale)
+{
+	struct osd_buffer *osd_buffer;
+	wl_array_for_each(osd_buffer, &osd_buffers) {
+		if (osd_buffer->workspace == workspace
+				&& osd_buffer->scale == scale) {
+			return osd_buffer->buffer;
+		}
+	}
+
+	struct lab_data_buffer *buffer = render_osd(server, workspace, scale);
+	if (!buffer) {
+		return NULL;
+	}
+	osd_buffer = wl_array_add(&osd_buffers, sizeof(*osd_buffer));
+	if (!osd_buffer) {
+		wlr_buffer_drop(&buffer->base);
+		return NULL;
+	}
+	*osd_buffer = (struct osd_buffer){
+		.workspace = workspace,
+		.scale = scale,
+		.buffer = buffer,
+	};
+	return buffer;
+}
+
+static void
+_osd_update(struct server *server)
+{
 	struct output *output;
 	wl_list_for_each(output, &server->outputs, link) {
 		if (!output_is_usable(output)) {
 			continue;
 		}
-		struct lab_data_buffer *buffer = buffer_create_cairo(width, height,
-			output->wlr_output->scale);
+		struct lab_data_buffer *buffer = get_osd_buffer(server,
+			server->workspaces.current, output->wlr_output->scale);
 		if (!buffer) {
-			wlr_log(WLR_ERROR, "Failed to allocate buffer for workspace OSD");
 			continue;
 		}
 
-		cairo = cairo_create(buffer->surface);
-
-		/* Background */
-		set_cairo_color(cairo, theme->osd_bg_color);
-		cairo_rectangle(cairo, 0, 0, width, height);
-		cairo_fill(cairo);
-
-		/* Border */
-		set_cairo_color(cairo, theme->osd_border_color);
-		struct wlr_fbox border_fbox = {
-			.width = width,
-			.height = height,
-		};
-		draw_cairo_border(cairo, border_fbox, theme->osd_border_width);
-
-		/* Boxes */
-		uint16_t x;
-		if (!hide_boxes) {
-			x = (width - marker_width) / 2;
-			wl_list_for_each(workspace, &server->workspaces.all, link) {
-				bool active =  workspace == server->workspaces.current;
-				set_cairo_color(cairo, server->theme->osd_label_text_color);
-				struct wlr_fbox fbox = {
-					.x = x,
-					.y = margin,
-					.width = rect_width,
-					.height = rect_height,
-				};
-				draw_cairo_border(cairo, fbox,
-					theme->osd_workspace_switcher_boxes_border_width);
-				if (active) {
-					cairo_rectangle(cairo, x, margin,
-						rect_width, rect_height);
-					cairo_fill(cairo);
-				}
-				x += rect_width + padding;
-			}
-		}
-
-		/* Text */
-		set_cairo_color(cairo, server->theme->osd_label_text_color);
-		PangoLayout *layout = pango_cairo_create_layout(cairo);
-		pango_context_set_round_glyph_positions(pango_layout_get_context(layout), false);
-		pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
-
-		/* Center workspace indicator on the x axis */
-		int req_width = font_width(&rc.font_osd, server->workspaces.current->name);
-		req_width = MIN(req_width, width - 2 * margin);
-		x = (width - req_width) / 2;
-		if (!hide_boxes) {
-			cairo_move_to(cairo, x, margin * 2 + rect_height);
-		} else {
-			cairo_move_to(cairo, x, (height - font_height(&rc.font_osd)) / 2.0);
-		}
-		PangoFontDescription *desc = font_to_pango_desc(&rc.font_osd);
-		//pango_font_description_set_weight(desc, PANGO_WEIGHT_BOLD);
-		pango_layout_set_font_description(layout, desc);
-		pango_layout_set_width(layout, req_width * PANGO_SCALE);
-		pango_font_description_free(desc);
-		pango_layout_set_text(layout, server->workspaces.current->name, -1);
-		pango_cairo_show_layout(cairo, layout);
-
-		g_object_unref(layout);
-		surface = cairo_get_target(cairo);
-		cairo_surface_flush(surface);
-		cairo_destroy(cairo);
-
 		if (!output->workspace_osd) {
 			output->workspace_osd = wlr_scene_buffer_create(
 				&server->scene->tree, NULL);
@@ -171,18 +244,25 @@ _osd_update(struct server *server)
 		struct wlr_box output_box;
 		wlr_output_layout_get_box(output->server->output_layout,
 			output->wlr_output, &output_box);
-		int lx = output_box.x + (output_box.width - width) / 2;
-		int ly = output_box.y + (output_box.height - height) / 2;
+		int lx = output_box.x + (output_box.width
+			- (int)buffer->logical_width) / 2;
+		int ly = output_box.y + (output_box.height
+			- (int)buffer->logical_height) / 2;
 		wlr_scene_node_set_position(&output->workspace_osd->node, lx, ly);
 		wlr_scene_buffer_set_buffer(output->workspace_osd, &buffer->base);
 		wlr_scene_buffer_set_dest_size(output->workspace_osd,
 			buffer->logical_width, buffer->logical_height);
-
-		/* And finally drop the buffer so it will get destroyed on OSD hide */
-		wlr_buffer_drop(&buffer->base);
+		lab_wlr_scene_buffer_update_opaque_region(output->workspace_osd);
 	}
 }
 
+void
+workspaces_osd_reconfigure(struct server *server)
+{
+	workspaces_osd_hide(&server->seat);
+	osd_buffers_reset();
+}
+
 /* cosmic workspace handlers */
 static void
 handle_cosmic_workspace_activate(struct wl_listener *listener, void *data)
@@ -209,6 +289,8 @@ add_workspace(struct server *server, const char *name)
 	workspace->server = server;
 	workspace->name = xstrdup(name);
 	workspace->tree = wlr_scene_tree_create(server->view_tree);
+	wl_list_init(&workspace->views);
+	wl_list_init(&workspace->focus_views);
 	wl_list_append(&server->workspaces.all, &workspace->link);
 	if (!server->workspaces.current) {
 		server->workspaces.current = workspace;
@@ -270,23 +352,15 @@ get_next(struct workspace *current, struct wl_list *workspaces, bool wrap)
 }
 
 static bool
-workspace_has_views(struct workspace *workspace, struct server *server)
+workspace_has_views(struct workspace *workspace)
 {
-	struct view *view;
-
-	for_each_view(view, &server->views, LAB_VIEW_CRITERIA_NO_OMNIPRESENT) {
-		if (view->workspace == workspace) {
-			return true;
-		}
-	}
-	return false;
+	return workspace->nr_views > 0;
 }
 
 static struct workspace *
 get_adjacent_occupied(struct workspace *current, struct wl_list *workspaces,
 		bool wrap, bool reverse)
 {
-	struct server *server = current->server;
 	struct wl_list *start = &current->link;
 	struct wl_list *link = reverse ? start->prev : start->next;
 	bool has_wrapped = false;
@@ -315,7 +389,7 @@ get_adjacent_occupied(struct workspace *current, struct wl_list *workspaces,
 		}
 
 		/* Check if it's occupied (and not current) */
-		if (target != current && workspace_has_views(target, server)) {
+		if (target != current && workspace_has_views(target)) {
 			return target;
 		}
 
@@ -358,7 +432,8 @@ _osd_show(struct server *server)
 	struct output *output;
 	wl_list_for_each(output, &server->outputs, link) {
 		if (output_is_usable(output) && output->workspace_osd) {
-			wlr_scene_node_set_enabled(&output->workspace_osd->node, true);
+			wlr_scene_node_set_enabled(&output->workspace_osd->node,
+				!output_hides_overlays(output));
 		}
 	}
 	if (keyboard_get_all_modifiers(&server->seat)) {
@@ -367,14 +442,39 @@ _osd_show(struct server *server)
 	} else {
 		/* Hidden by timer */
 		if (!server->seat.workspace_osd_timer) {
-			server->seat.workspace_osd_timer = wl_event_loop_add_timer(
-				server->wl_event_loop, _osd_handle_timeout, &server->seat);
+			server->seat.workspace_osd_timer = lab_timer_create(
+				_osd_handle_timeout, &server->seat,
+				/*slack_ms*/ 100);
 		}
-		wl_event_source_timer_update(server->seat.workspace_osd_timer,
+		lab_timer_update(server->seat.workspace_osd_timer,
 			rc.workspace_config.popuptime);
 	}
 }
 
+static void
+write_status_file(struct server *server)
+{
+	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (!runtime_dir) {
+		return;
+	}
+	char status_file[256];
+	snprintf(status_file, sizeof(status_file), "%s/labwc-workspace-current", runtime_dir);
+	FILE *f = fopen(status_file, "w");
+	if (f) {
+		fprintf(f, "%s\n", server->workspaces.current->name);
+		fclose(f);
+	}
+}
+
+static void
+handle_status_file_idle(void *data)
+{
+	struct server *server = data;
+	server->workspaces.status_file_idle = NULL;
+	write_status_file(server);
+}
+
 /* Public API */
 void
 workspaces_init(struct server *server)
@@ -402,16 +502,7 @@ workspaces_init(struct server *server)
 
 	/* Initialize workspace status file */
 	if (server->workspaces.current) {
-		char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-		if (runtime_dir) {
-			char status_file[256];
-			snprintf(status_file, sizeof(status_file), "%s/labwc-workspace-current", runtime_dir);
-			FILE *f = fopen(status_file, "w");
-			if (f) {
-				fprintf(f, "%s\n", server->workspaces.current->name);
-				fclose(f);
-			}
-		}
+		write_status_file(server);
 	}
 }
 
@@ -425,10 +516,17 @@ workspaces_switch_to(struct workspace *target, bool update_focus)
 {
 	assert(target);
 	struct server *server = target->server;
+	workspace_swipe_cancel(server);
 	if (target == server->workspaces.current) {
 		return;
 	}
 
+	keybind_condition_cache_notify(KEYBIND_CONDITION_EVENT_WORKSPACE);
+	desktop_schedule_arrange_tiled(server);
+	edges_visibility_invalidate(server, NULL);
+	ipc_emit(IPC_EVENT_WORKSPACE);
+	menu_on_workspaces_changed(server);
+
 	/* Disable the old workspace */
 	wlr_scene_node_set_enabled(
 		&server->workspaces.current->tree->node, false);
@@ -439,12 +537,14 @@ workspaces_switch_to(struct workspace *target, bool update_focus)
 		server->workspaces.current->ext_workspace, false);
 
 	/* Move Omnipresent views to new workspace */
-	struct view *view;
-	enum lab_view_criteria criteria =
-		LAB_VIEW_CRITERIA_CURRENT_WORKSPACE;
-	for_each_view_reverse(view, &server->views, criteria) {
-		if (view->visible_on_all_workspaces) {
-			view_move_to_workspace(view, target);
+	if (server->workspaces.nr_omnipresent_views) {
+		struct view *view;
+		enum lab_view_criteria criteria =
+			LAB_VIEW_CRITERIA_CURRENT_WORKSPACE;
+		for_each_view_reverse(view, &server->views, criteria) {
+			if (view->visible_on_all_workspaces) {
+				view_move_to_workspace(view, target);
+			}
 		}
 	}
 
@@ -495,16 +595,13 @@ workspaces_switch_to(struct workspace *target, bool update_focus)
 	lab_cosmic_workspace_set_active(target->cosmic_workspace, true);
 	lab_ext_workspace_set_active(target->ext_workspace, true);
 
-	/* Update workspace status file for querying */
-	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
-	if (runtime_dir) {
-		char status_file[256];
-		snprintf(status_file, sizeof(status_file), "%s/labwc-workspace-current", runtime_dir);
-		FILE *f = fopen(status_file, "w");
-		if (f) {
-			fprintf(f, "%s\n", target->name);
-			fclose(f);
-		}
+	/*
+	 * Update workspace status file for querying. This is deferred so
+	 * that rapid switches, e.g. by scrolling, only write the file once.
+	 */
+	if (!server->workspaces.status_file_idle) {
+		server->workspaces.status_file_idle = wl_event_loop_add_idle(
+			server->wl_event_loop, handle_status_file_idle, server);
 	}
 }
 
@@ -571,6 +668,8 @@ workspaces_find(struct workspace *anchor, const char *name, bool wrap)
 static void
 destroy_workspace(struct workspace *workspace)
 {
+	workspace_swipe_cancel(workspace->server);
+	tiling_workspace_destroyed(workspace);
 	wlr_scene_node_destroy(&workspace->tree->node);
 	zfree(workspace->name);
 	wl_list_remove(&workspace->link);
@@ -591,6 +690,11 @@ workspaces_reconfigure(struct server *server)
 	 *   - Add workspaces if more workspaces are desired
 	 *   - Destroy workspaces if fewer workspace are desired
 	 */
+	ipc_emit(IPC_EVENT_WORKSPACE);
+	ipc_emit(IPC_EVENT_OCCUPANCY);
+	menu_on_workspaces_changed(server);
+	/* The OSDs show all workspaces */
+	osd_buffers_reset();
 
 	struct wl_list *actual_workspace_link = server->workspaces.all.next;
 
@@ -660,6 +764,11 @@ workspaces_reconfigure(struct server *server)
 void
 workspaces_destroy(struct server *server)
 {
+	if (server->workspaces.status_file_idle) {
+		wl_event_source_remove(server->workspaces.status_file_idle);
+		server->workspaces.status_file_idle = NULL;
+	}
+	osd_buffers_reset();
 	struct workspace *workspace, *tmp;
 	wl_list_for_each_safe(workspace, tmp, &server->workspaces.all, link) {
 		destroy_workspace(workspace);
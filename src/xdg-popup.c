@@ -7,6 +7,7 @@
  *	- keeping non-layer-shell xdg-popups outside the layers.c code
  */
 
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include "common/macros.h"
@@ -26,11 +27,39 @@ struct xdg_popup {
 	struct wl_listener reposition;
 };
 
+/*
+ * Return the usable area of the output nearest to (lx, ly). Popups are
+ * usually repositioned on the same output over and over, so the last one
+ * is remembered per view until the usable areas or the layout change.
+ */
+static struct wlr_box
+popup_usable_area(struct view *view, int lx, int ly)
+{
+	struct server *server = view->server;
+	if (view->popup_constraint.output
+			&& view->popup_constraint.generation
+				== server->usable_area_generation
+			&& wlr_box_contains_point(
+				&view->popup_constraint.output_box, lx, ly)) {
+		return view->popup_constraint.usable;
+	}
+
+	struct output *output = output_nearest_to(server, lx, ly);
+	struct wlr_box usable = output_usable_area_in_layout_coords(output);
+	if (output_is_usable(output)) {
+		view->popup_constraint.output = output;
+		wlr_output_layout_get_box(server->output_layout,
+			output->wlr_output, &view->popup_constraint.output_box);
+		view->popup_constraint.usable = usable;
+		view->popup_constraint.generation = server->usable_area_generation;
+	}
+	return usable;
+}
+
 static void
 popup_unconstrain(struct xdg_popup *popup)
 {
 	struct view *view = popup->parent_view;
-	struct server *server = view->server;
 
 	/* Get position of parent toplevel/popup */
 	int parent_lx, parent_ly;
@@ -46,10 +75,9 @@ popup_unconstrain(struct xdg_popup *popup)
 	 * output.
 	 */
 	struct wlr_box *popup_box = &popup->wlr_popup->scheduled.geometry;
-	struct output *output = output_nearest_to(server,
+	struct wlr_box usable = popup_usable_area(view,
 		parent_lx + MAX(popup_box->x, 0),
 		parent_ly + MAX(popup_box->y, 0));
-	struct wlr_box usable = output_usable_area_in_layout_coords(output);
 
 	/* Get offset of toplevel window from its surface */
 	int toplevel_dx = 0;
@@ -14,20 +14,26 @@
 #include "common/macros.h"
 #include "common/mem.h"
 #include "config/rcxml.h"
+#include "configure-stats.h"
 #include "decorations.h"
 #include "foreign-toplevel/foreign.h"
+#include "input-latency.h"
+#include "input/cursor.h"
 #include "labwc.h"
+#include "layout-transaction.h"
 #include "menu/menu.h"
 #include "node.h"
+#include "resize-snapshot.h"
 #include "output.h"
 #include "snap-constraints.h"
+#include "timer.h"
+#include "trace.h"
 #include "view.h"
 #include "view-impl-common.h"
 #include "window-rules.h"
 #include "workspaces.h"
 
 #define LAB_XDG_SHELL_VERSION 6
-#define CONFIGURE_TIMEOUT_MS 100
 
 static struct xdg_toplevel_view *
 xdg_toplevel_view_from_view(struct view *view)
@@ -70,23 +76,28 @@ xdg_toplevel_view_get_size_hints(struct view *view)
 }
 
 static bool
-xdg_toplevel_view_contains_window_type(struct view *view,
-		enum lab_window_type window_type)
+is_dialog(struct wlr_xdg_toplevel *toplevel)
 {
-	assert(view);
-
-	struct wlr_xdg_toplevel *toplevel = xdg_toplevel_from_view(view);
 	struct wlr_xdg_toplevel_state *state = &toplevel->current;
-	bool is_dialog = (state->min_width != 0 && state->min_height != 0
+	return (state->min_width != 0 && state->min_height != 0
 		&& (state->min_width == state->max_width
 		|| state->min_height == state->max_height))
 		|| toplevel->parent;
+}
+
+static bool
+xdg_toplevel_view_contains_window_type(struct view *view,
+		enum lab_window_type window_type)
+{
+	assert(view);
+
+	bool dialog = is_dialog(xdg_toplevel_from_view(view));
 
 	switch (window_type) {
 	case LAB_WINDOW_TYPE_NORMAL:
-		return !is_dialog;
+		return !dialog;
 	case LAB_WINDOW_TYPE_DIALOG:
-		return is_dialog;
+		return dialog;
 	default:
 		return false;
 	}
@@ -190,8 +201,23 @@ handle_commit(struct wl_listener *listener, void *data)
 {
 	struct view *view = wl_container_of(listener, view, commit);
 	struct wlr_xdg_surface *xdg_surface = xdg_surface_from_view(view);
+	trace_begin("xdg_commit");
 	struct wlr_xdg_toplevel *toplevel = xdg_toplevel_from_view(view);
 	assert(view->surface);
+	view->content_serial++;
+	input_latency_commit(view);
+
+	/* The surface (or its subsurfaces) may have changed size */
+	scene_index_invalidate(view->server);
+
+	/* Size constraints and parent determine the window type */
+	struct xdg_toplevel_view *xdg_view =
+		wl_container_of(view, xdg_view, base);
+	bool dialog = is_dialog(toplevel);
+	if (dialog != xdg_view->is_dialog) {
+		xdg_view->is_dialog = dialog;
+		window_rules_invalidate(view);
+	}
 
 	if (xdg_surface->initial_commit) {
 		uint32_t serial =
@@ -228,6 +254,7 @@ handle_commit(struct wl_listener *listener, void *data)
 			view_maximize(view, VIEW_AXIS_BOTH,
 				/*store_natural_geometry*/ true);
 		}
+		trace_end("xdg_commit");
 		return;
 	}
 
@@ -281,12 +308,14 @@ handle_commit(struct wl_listener *listener, void *data)
 	}
 
 	uint32_t serial = view->pending_configure_serial;
+	bool acked = false;
 	if (serial > 0 && serial == xdg_surface->current.configure_serial) {
 		assert(view->pending_configure_timeout);
-		wl_event_source_remove(view->pending_configure_timeout);
+		lab_timer_destroy(view->pending_configure_timeout);
 		view->pending_configure_serial = 0;
 		view->pending_configure_timeout = NULL;
 		update_required = true;
+		acked = true;
 	}
 
 	if (update_required) {
@@ -330,6 +359,18 @@ handle_commit(struct wl_listener *listener, void *data)
 			toplevel->scheduled.height = view->current.height;
 		}
 	}
+
+	/* Only now the new geometry is in the scene */
+	if (acked && !view->pending_configure_serial) {
+		configure_stats_done(view, /*timed_out*/ false);
+		resize_snapshot_finish(view);
+		layout_transaction_view_done(view);
+		cursor_flush_resize(view, /*force*/ false);
+	} else if (update_required && view->resize_snapshot) {
+		/* Stretch the latest buffers while still catching up */
+		resize_snapshot_update(view);
+	}
+	trace_end("xdg_commit");
 }
 
 static int
@@ -342,15 +383,17 @@ handle_configure_timeout(void *data)
 	wlr_log(WLR_INFO, "client (%s) did not respond to configure request "
 		"in %d ms", view->app_id, CONFIGURE_TIMEOUT_MS);
 
-	wl_event_source_remove(view->pending_configure_timeout);
+	lab_timer_destroy(view->pending_configure_timeout);
 	view->pending_configure_serial = 0;
 	view->pending_configure_timeout = NULL;
+	configure_stats_done(view, /*timed_out*/ true);
 
 	/*
 	 * No need to do anything else if the view is just being slow to
 	 * map - the map handler will take care of the positioning.
 	 */
 	if (!view->mapped) {
+		layout_transaction_view_done(view);
 		return 0; /* ignored per wl_event_loop docs */
 	}
 
@@ -399,6 +442,10 @@ handle_configure_timeout(void *data)
 	snap_constraints_update(view);
 	view->pending = view->current;
 
+	resize_snapshot_finish(view);
+	layout_transaction_view_done(view);
+	cursor_flush_resize(view, /*force*/ false);
+
 	return 0; /* ignored per wl_event_loop docs */
 }
 
@@ -407,12 +454,14 @@ set_pending_configure_serial(struct view *view, uint32_t serial)
 {
 	view->pending_configure_serial = serial;
 	if (!view->pending_configure_timeout) {
-		view->pending_configure_timeout =
-			wl_event_loop_add_timer(view->server->wl_event_loop,
-				handle_configure_timeout, view);
+		/* Only unresponsive clients ever hit the timeout */
+		view->pending_configure_timeout = lab_timer_create(
+			handle_configure_timeout, view, /*slack_ms*/ 100);
 	}
-	wl_event_source_timer_update(view->pending_configure_timeout,
+	lab_timer_update(view->pending_configure_timeout,
 		CONFIGURE_TIMEOUT_MS);
+	configure_stats_sent(view);
+	layout_transaction_add_view(view);
 }
 
 static void
@@ -435,12 +484,14 @@ handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&xdg_toplevel_view->set_app_id.link);
 	wl_list_remove(&xdg_toplevel_view->request_show_window_menu.link);
 	wl_list_remove(&xdg_toplevel_view->new_popup.link);
+	wl_list_remove(&xdg_toplevel_view->ack_configure.link);
 	wl_list_remove(&view->commit.link);
 
 	if (view->pending_configure_timeout) {
-		wl_event_source_remove(view->pending_configure_timeout);
+		lab_timer_destroy(view->pending_configure_timeout);
 		view->pending_configure_timeout = NULL;
 	}
+	layout_transaction_view_done(view);
 
 	view_destroy(view);
 }
@@ -554,6 +605,19 @@ handle_set_title(struct wl_listener *listener, void *data)
 	view_set_title(view, toplevel->title);
 }
 
+static void
+handle_ack_configure(struct wl_listener *listener, void *data)
+{
+	struct xdg_toplevel_view *xdg_toplevel_view =
+		wl_container_of(listener, xdg_toplevel_view, ack_configure);
+	struct wlr_xdg_surface_configure *configure = data;
+
+	struct view *view = &xdg_toplevel_view->base;
+	if (configure->serial == view->pending_configure_serial) {
+		configure_stats_acked(view);
+	}
+}
+
 static void
 handle_set_app_id(struct wl_listener *listener, void *data)
 {
@@ -599,6 +663,7 @@ xdg_toplevel_view_configure(struct view *view, struct wlr_box geo)
 	view->pending = geo;
 	if (serial > 0) {
 		set_pending_configure_serial(view, serial);
+		resize_snapshot_update(view);
 	} else if (view->pending_configure_serial == 0) {
 		view->current.x = geo.x;
 		view->current.y = geo.y;
@@ -867,18 +932,6 @@ handle_map(struct wl_listener *listener, void *data)
 
 	view_impl_map(view);
 	view->been_mapped = true;
-
-	/* Arrange windows in tiling mode after view is mapped */
-	if (view->server->tiling_mode && view_is_floating(view) &&
-	    !view->minimized && !view->fullscreen &&
-	    !view_is_always_on_top(view) && !view_is_always_on_bottom(view) &&
-	    window_rules_get_property(view, "fixedPosition") != LAB_PROP_TRUE) {
-		/* Check if this view should be tiled */
-		enum property tile_prop = window_rules_get_property(view, "tile");
-		if (tile_prop != LAB_PROP_FALSE) {
-			desktop_arrange_tiled(view->server);
-		}
-	}
 }
 
 static void
@@ -888,10 +941,6 @@ handle_unmap(struct wl_listener *listener, void *data)
 	if (view->mapped) {
 		view->mapped = false;
 		view_impl_unmap(view);
-		/* Rearrange tiled windows when one is unmapped */
-		if (view->server->tiling_mode) {
-			desktop_arrange_tiled(view->server);
-		}
 	}
 }
 
@@ -989,7 +1038,8 @@ handle_xdg_activation_request(struct wl_listener *listener, void *data)
 	 * }
 	 */
 
-	if (window_rules_get_property(view, "ignoreFocusRequest") == LAB_PROP_TRUE) {
+	if (window_rules_get_property(view,
+			WINDOW_RULE_PROP_IGNORE_FOCUS_REQUEST) == LAB_PROP_TRUE) {
 		wlr_log(WLR_INFO, "Ignoring focus request due to window rule configuration");
 		return;
 	}
@@ -1099,9 +1149,9 @@ handle_new_xdg_toplevel(struct wl_listener *listener, void *data)
 	CONNECT_SIGNAL(toplevel, xdg_toplevel_view, set_app_id);
 	CONNECT_SIGNAL(toplevel, xdg_toplevel_view, request_show_window_menu);
 	CONNECT_SIGNAL(xdg_surface, xdg_toplevel_view, new_popup);
+	CONNECT_SIGNAL(xdg_surface, xdg_toplevel_view, ack_configure);
 
-	wl_list_insert(&server->views, &view->link);
-	view->creation_id = server->next_view_creation_id++;
+	view_add_to_views(view);
 }
 
 static void
@@ -1124,6 +1174,7 @@ handle_xdg_toplevel_icon_set_icon(struct wl_listener *listener, void *data)
 			struct lab_data_buffer *buffer =
 				buffer_create_from_wlr_buffer(icon_buffer->buffer);
 			if (buffer) {
+				buffer_set_category(buffer, BUFFER_ICON);
 				array_add(&buffers, buffer);
 			}
 		}
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include <wlr/xwayland.h>
+#include "common/time-helpers.h"
+#include "config/rcxml.h"
+#include "idle.h"
+#include "labwc.h"
+#include "xwayland.h"
+
+/* Below this much available memory, Xwayland is left to start on demand */
+#define MIN_AVAILABLE_KIB (512 * 1024)
+
+/*
+ * Xwayland is started lazily by wlroots, when the first client connects
+ * to the X11 socket, and exits some seconds after the last one is gone.
+ * To start it in advance, we connect a minimal client of our own, which
+ * also keeps Xwayland running as long as its connection is open.
+ */
+static struct {
+	struct server *server;
+	struct wl_event_source *timer;
+	/* Our own connection which keeps Xwayland running, or -1 */
+	int fd;
+	struct wl_event_source *fd_source;
+	bool done;
+	/* X11 views and unmanaged surfaces */
+	int nr_surfaces;
+} prestart = { .fd = -1 };
+
+static long
+get_available_kib(void)
+{
+	FILE *f = fopen("/proc/meminfo", "r");
+	if (!f) {
+		return -1;
+	}
+	char line[256];
+	long kib = -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "MemAvailable: %ld kB", &kib) == 1) {
+			break;
+		}
+	}
+	fclose(f);
+	return kib;
+}
+
+static void
+close_connection(void)
+{
+	if (prestart.fd_source) {
+		wl_event_source_remove(prestart.fd_source);
+		prestart.fd_source = NULL;
+	}
+	if (prestart.fd >= 0) {
+		close(prestart.fd);
+		prestart.fd = -1;
+	}
+}
+
+/* Discard the connection setup reply, and notice when Xwayland exits */
+static int
+handle_connection(int fd, uint32_t mask, void *data)
+{
+	char buf[4096];
+	ssize_t ret = 0;
+	if (mask & WL_EVENT_READABLE) {
+		do {
+			ret = read(fd, buf, sizeof(buf));
+		} while (ret > 0);
+	}
+	bool closed = ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR);
+	if (closed || (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))) {
+		wlr_log(WLR_DEBUG, "xwayland pre-start connection closed");
+		close_connection();
+	}
+	return 0;
+}
+
+static bool
+open_connection(struct server *server)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/.X11-unix/X%d",
+		server->xwayland->server->display);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot create socket");
+		return false;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		wlr_log_errno(WLR_ERROR, "cannot connect to %s", addr.sun_path);
+		close(fd);
+		return false;
+	}
+
+	/*
+	 * The connection setup request without authorization. It fits in
+	 * the socket buffer, so the write completes without waiting, and
+	 * the X server doesn't drop us as a stalled connection.
+	 */
+	uint16_t one = 1;
+	struct {
+		uint8_t byte_order;
+		uint8_t pad;
+		/* In the byte order given above, so in ours */
+		uint16_t major, minor;
+		uint16_t auth_name_len, auth_data_len;
+		uint16_t pad2;
+	} setup = {
+		.byte_order = *(uint8_t *)&one ? 'l' : 'B',
+		.major = 11,
+	};
+	if (write(fd, &setup, sizeof(setup)) != sizeof(setup)) {
+		wlr_log_errno(WLR_ERROR, "cannot start xwayland");
+		close(fd);
+		return false;
+	}
+
+	prestart.fd = fd;
+	prestart.fd_source = wl_event_loop_add_fd(server->wl_event_loop, fd,
+		WL_EVENT_READABLE, handle_connection, NULL);
+	return true;
+}
+
+static int
+handle_timer(void *data)
+{
+	struct server *server = prestart.server;
+	if (!server->xwayland) {
+		return 0;
+	}
+
+	if (!prestart.done) {
+		/* Wait until there has been no input for the whole delay */
+		uint64_t delay_nsec = rc.xwayland_prestart * 1000000000ULL;
+		uint64_t idle_nsec =
+			time_now_nsec() - idle_manager_get_last_activity();
+		if (idle_nsec < delay_nsec) {
+			wl_event_source_timer_update(prestart.timer,
+				(delay_nsec - idle_nsec) / 1000000 + 1);
+			return 0;
+		}
+
+		prestart.done = true;
+		long kib = get_available_kib();
+		if (kib >= 0 && kib < MIN_AVAILABLE_KIB) {
+			wlr_log(WLR_INFO, "only %ld MiB available, not pre-starting "
+				"xwayland", kib / 1024);
+			return 0;
+		}
+		if (prestart.nr_surfaces || !open_connection(server)) {
+			return 0;
+		}
+		wlr_log(WLR_INFO, "pre-starting xwayland");
+		xwayland_prestart_surfaces_changed(0);
+		return 0;
+	}
+
+	/* No X11 surfaces for the whole <xwaylandIdleShutdown> */
+	if (!prestart.nr_surfaces && prestart.fd >= 0) {
+		wlr_log(WLR_INFO, "letting xwayland exit after %d s without "
+			"clients", rc.xwayland_idle_shutdown);
+		close_connection();
+	}
+	return 0;
+}
+
+void
+xwayland_prestart_init(struct server *server)
+{
+	if (rc.xwayland_persistence || rc.xwayland_prestart <= 0) {
+		return;
+	}
+	prestart.server = server;
+	prestart.timer = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_timer, NULL);
+	wl_event_source_timer_update(prestart.timer,
+		rc.xwayland_prestart * 1000);
+}
+
+void
+xwayland_prestart_surfaces_changed(int delta)
+{
+	prestart.nr_surfaces += delta;
+	if (!prestart.timer || !prestart.done || prestart.fd < 0
+			|| rc.xwayland_idle_shutdown <= 0) {
+		return;
+	}
+	wl_event_source_timer_update(prestart.timer, prestart.nr_surfaces
+		? 0 : rc.xwayland_idle_shutdown * 1000);
+}
+
+void
+xwayland_prestart_finish(void)
+{
+	close_connection();
+	if (prestart.timer) {
+		wl_event_source_remove(prestart.timer);
+		prestart.timer = NULL;
+	}
+}
@@ -183,6 +183,7 @@ handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&unmanaged->set_override_redirect.link);
 	wl_list_remove(&unmanaged->destroy.link);
 	free(unmanaged);
+	xwayland_prestart_surfaces_changed(-1);
 }
 
 static void
@@ -241,6 +242,7 @@ xwayland_unmanaged_create(struct server *server,
 {
 	struct xwayland_unmanaged *unmanaged = znew(*unmanaged);
 	unmanaged->server = server;
+	xwayland_prestart_surfaces_changed(1);
 	unmanaged->xwayland_surface = xsurface;
 	/*
 	 * xsurface->data is presumed to be a (struct view *) if set,
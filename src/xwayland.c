@@ -2,7 +2,10 @@
 #define _POSIX_C_SOURCE 200809L
 #include "xwayland.h"
 #include <assert.h>
+#include <glib.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
@@ -11,14 +14,19 @@
 #include <wlr/xwayland.h>
 #include "buffer.h"
 #include "common/array.h"
+#include "common/hash.h"
+#include "common/list.h"
 #include "common/macros.h"
 #include "common/mem.h"
+#include "common/pixel-convert.h"
 #include "config/rcxml.h"
 #include "config/session.h"
 #include "foreign-toplevel/foreign.h"
+#include "input-latency.h"
 #include "labwc.h"
 #include "node.h"
 #include "output.h"
+#include "trace.h"
 #include "view.h"
 #include "view-impl-common.h"
 #include "window-rules.h"
@@ -38,6 +46,25 @@ static_assert(ARRAY_SIZE(atom_names) == ATOM_COUNT, "atom names out of sync");
 
 static xcb_atom_t atoms[ATOM_COUNT] = {0};
 
+/* xcb_window_t -> struct xwayland_view, for handling X11 events */
+static GHashTable *views_by_window_id;
+
+/* Views waiting for a _NET_WM_ICON reply, see update_icon() */
+static struct wl_list pending_icon_requests =
+	WL_LIST_INIT(&pending_icon_requests);
+static struct wl_event_source *icon_poll_timer;
+#define ICON_POLL_INTERVAL_MS 5
+
+/* Views with a pending configure and the flush for them, see xwayland_flush() */
+static struct wl_list pending_configures = WL_LIST_INIT(&pending_configures);
+static struct wl_event_source *flush_idle;
+
+/* The _NET_WORKAREA last sent to the XWM */
+static struct wlr_box last_workarea;
+static bool have_workarea;
+
+static void cancel_icon_request(struct xwayland_view *xwayland_view);
+
 static void set_surface(struct view *view, struct wlr_surface *surface);
 static void handle_map(struct wl_listener *listener, void *data);
 static void handle_unmap(struct wl_listener *listener, void *data);
@@ -93,11 +120,24 @@ xwayland_view_contains_window_type(struct view *view,
 		&& LAB_WINDOW_TYPE_LEN ==
 			(int)WLR_XWAYLAND_NET_WM_WINDOW_TYPE_NORMAL + 1,
 		"lab_window_type does not match wlr_xwayland_net_wm_window_type");
+	static_assert(LAB_WINDOW_TYPE_LEN <= 32,
+		"lab_window_type does not fit into xwayland_view.window_types");
 
 	assert(view);
-	struct wlr_xwayland_surface *surface = xwayland_surface_from_view(view);
-	return wlr_xwayland_surface_has_window_type(surface,
-		(enum wlr_xwayland_net_wm_window_type)window_type);
+	struct xwayland_view *xwayland_view = xwayland_view_from_view(view);
+	if (!xwayland_view->window_types_valid) {
+		struct wlr_xwayland_surface *surface =
+			xwayland_surface_from_view(view);
+		xwayland_view->window_types = 0;
+		for (int type = 0; type < LAB_WINDOW_TYPE_LEN; type++) {
+			if (wlr_xwayland_surface_has_window_type(surface,
+					(enum wlr_xwayland_net_wm_window_type)type)) {
+				xwayland_view->window_types |= 1u << type;
+			}
+		}
+		xwayland_view->window_types_valid = true;
+	}
+	return xwayland_view->window_types & (1u << window_type);
 }
 
 static struct view_size_hints
@@ -118,7 +158,7 @@ xwayland_view_get_size_hints(struct view *view)
 }
 
 static enum view_wants_focus
-xwayland_view_wants_focus(struct view *view)
+get_wants_focus(struct view *view)
 {
 	struct wlr_xwayland_surface *xsurface =
 		xwayland_surface_from_view(view);
@@ -159,10 +199,10 @@ xwayland_view_wants_focus(struct view *view)
 		 * Alt-Tab switcher and be automatically focused when
 		 * they become topmost.
 		 */
-		return (wlr_xwayland_surface_has_window_type(xsurface,
-				WLR_XWAYLAND_NET_WM_WINDOW_TYPE_NORMAL)
-			|| wlr_xwayland_surface_has_window_type(xsurface,
-				WLR_XWAYLAND_NET_WM_WINDOW_TYPE_DIALOG)) ?
+		return (xwayland_view_contains_window_type(view,
+				LAB_WINDOW_TYPE_NORMAL)
+			|| xwayland_view_contains_window_type(view,
+				LAB_WINDOW_TYPE_DIALOG)) ?
 			VIEW_WANTS_FOCUS_LIKELY : VIEW_WANTS_FOCUS_UNLIKELY;
 
 	/*
@@ -179,6 +219,17 @@ xwayland_view_wants_focus(struct view *view)
 	return VIEW_WANTS_FOCUS_NEVER;
 }
 
+static enum view_wants_focus
+xwayland_view_wants_focus(struct view *view)
+{
+	struct xwayland_view *xwayland_view = xwayland_view_from_view(view);
+	if (!xwayland_view->wants_focus_valid) {
+		xwayland_view->wants_focus = get_wants_focus(view);
+		xwayland_view->wants_focus_valid = true;
+	}
+	return xwayland_view->wants_focus;
+}
+
 static bool
 xwayland_view_has_strut_partial(struct view *view)
 {
@@ -243,7 +294,7 @@ want_deco(struct wlr_xwayland_surface *xwayland_surface)
 	struct view *view = (struct view *)xwayland_surface->data;
 
 	/* Window-rules take priority if they exist for this view */
-	switch (window_rules_get_property(view, "serverDecoration")) {
+	switch (window_rules_get_property(view, WINDOW_RULE_PROP_SERVER_DECORATION)) {
 	case LAB_PROP_TRUE:
 		return true;
 	case LAB_PROP_FALSE:
@@ -261,6 +312,12 @@ handle_commit(struct wl_listener *listener, void *data)
 {
 	struct view *view = wl_container_of(listener, view, commit);
 	assert(data && data == view->surface);
+	trace_begin("xwayland_commit");
+	view->content_serial++;
+	input_latency_commit(view);
+
+	/* The surface (or its subsurfaces) may have changed size */
+	scene_index_invalidate(view->server);
 
 	/* Must receive commit signal before accessing surface->current* */
 	struct wlr_surface_state *state = &view->surface->current;
@@ -276,6 +333,7 @@ handle_commit(struct wl_listener *listener, void *data)
 		view_impl_apply_geometry(view, state->width, state->height);
 		view_moved(view);
 	}
+	trace_end("xwayland_commit");
 }
 
 static void
@@ -349,6 +407,8 @@ handle_destroy(struct wl_listener *listener, void *data)
 	 * "unmanaged" surface instead (in that case it is important
 	 * that xsurface->data not point to the destroyed view).
 	 */
+	g_hash_table_remove(views_by_window_id,
+		GUINT_TO_POINTER(xwayland_view->xwayland_surface->window_id));
 	xwayland_view->xwayland_surface->data = NULL;
 	xwayland_view->xwayland_surface = NULL;
 
@@ -362,18 +422,78 @@ handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&xwayland_view->set_override_redirect.link);
 	wl_list_remove(&xwayland_view->set_strut_partial.link);
 	wl_list_remove(&xwayland_view->set_window_type.link);
+	wl_list_remove(&xwayland_view->set_hints.link);
 	wl_list_remove(&xwayland_view->focus_in.link);
 	wl_list_remove(&xwayland_view->map_request.link);
 
+	if (xwayland_view->configure_pending) {
+		wl_list_remove(&xwayland_view->configure_link);
+		xwayland_view->configure_pending = false;
+	}
+	cancel_icon_request(xwayland_view);
+	xwayland_prestart_surfaces_changed(-1);
+
 	view_destroy(view);
 }
 
+static void
+flush_configure(struct xwayland_view *xwayland_view)
+{
+	if (xwayland_view->configure_pending) {
+		wl_list_remove(&xwayland_view->configure_link);
+		xwayland_view->configure_pending = false;
+	}
+	struct wlr_box *geo = &xwayland_view->base.pending;
+	wlr_xwayland_surface_configure(xwayland_view->xwayland_surface,
+		geo->x, geo->y, geo->width, geo->height);
+}
+
+static void
+handle_flush_idle(void *data)
+{
+	struct server *server = data;
+	flush_idle = NULL;
+
+	struct xwayland_view *xwayland_view, *tmp;
+	wl_list_for_each_safe(xwayland_view, tmp, &pending_configures,
+			configure_link) {
+		flush_configure(xwayland_view);
+	}
+	if (server->xwayland && server->xwayland->xwm) {
+		xcb_flush(wlr_xwayland_get_xwm_connection(server->xwayland));
+	}
+}
+
+static void
+schedule_flush(struct server *server)
+{
+	if (!flush_idle) {
+		flush_idle = wl_event_loop_add_idle(server->wl_event_loop,
+			handle_flush_idle, server);
+	}
+	if (!flush_idle) {
+		handle_flush_idle(server);
+	}
+}
+
 static void
 xwayland_view_configure(struct view *view, struct wlr_box geo)
 {
 	view->pending = geo;
-	wlr_xwayland_surface_configure(xwayland_surface_from_view(view),
-		geo.x, geo.y, geo.width, geo.height);
+
+	/*
+	 * A single user action may re-configure the view several times,
+	 * e.g. setting fullscreen, decorations and maximized state when
+	 * mapping. Only send the final geometry once the event loop is
+	 * idle, so that the client renders once.
+	 */
+	struct xwayland_view *xwayland_view = xwayland_view_from_view(view);
+	if (!xwayland_view->configure_pending) {
+		xwayland_view->configure_pending = true;
+		wl_list_append(&pending_configures,
+			&xwayland_view->configure_link);
+		schedule_flush(view->server);
+	}
 
 	/*
 	 * For unknown reasons, XWayland surfaces that are completely
@@ -403,7 +523,7 @@ handle_request_configure(struct wl_listener *listener, void *data)
 	struct view *view = &xwayland_view->base;
 	struct wlr_xwayland_surface_configure_event *event = data;
 	bool ignore_configure_requests = window_rules_get_property(
-		view, "ignoreConfigureRequest") == LAB_PROP_TRUE;
+		view, WINDOW_RULE_PROP_IGNORE_CONFIGURE_REQUEST) == LAB_PROP_TRUE;
 
 	if (view_is_floating(view) && !ignore_configure_requests) {
 		/* Honor client configure requests for floating views */
@@ -429,7 +549,8 @@ handle_request_activate(struct wl_listener *listener, void *data)
 		wl_container_of(listener, xwayland_view, request_activate);
 	struct view *view = &xwayland_view->base;
 
-	if (window_rules_get_property(view, "ignoreFocusRequest") == LAB_PROP_TRUE) {
+	if (window_rules_get_property(view,
+			WINDOW_RULE_PROP_IGNORE_FOCUS_REQUEST) == LAB_PROP_TRUE) {
 		wlr_log(WLR_INFO, "Ignoring focus request due to window rule configuration");
 		return;
 	}
@@ -534,7 +655,21 @@ handle_set_decorations(struct wl_listener *listener, void *data)
 static void
 handle_set_window_type(struct wl_listener *listener, void *data)
 {
-	/* Intentionally left blank */
+	struct xwayland_view *xwayland_view =
+		wl_container_of(listener, xwayland_view, set_window_type);
+	xwayland_view->window_types_valid = false;
+	/* The focus model of Globally Active windows depends on the type */
+	xwayland_view->wants_focus_valid = false;
+	window_rules_invalidate(&xwayland_view->base);
+}
+
+static void
+handle_set_hints(struct wl_listener *listener, void *data)
+{
+	struct xwayland_view *xwayland_view =
+		wl_container_of(listener, xwayland_view, set_hints);
+	/* The input field of WM_HINTS selects the focus model */
+	xwayland_view->wants_focus_valid = false;
 }
 
 static void
@@ -561,67 +696,191 @@ handle_set_strut_partial(struct wl_listener *listener, void *data)
 	struct xwayland_view *xwayland_view =
 		wl_container_of(listener, xwayland_view, set_strut_partial);
 	struct view *view = &xwayland_view->base;
+	xcb_ewmh_wm_strut_partial_t *strut =
+		xwayland_view->xwayland_surface->strut_partial;
+
+	/* Panels tend to set the same strut again, e.g. on every resize */
+	bool unchanged = strut ? xwayland_view->has_strut
+			&& !memcmp(strut, &xwayland_view->strut, sizeof(*strut))
+		: !xwayland_view->has_strut;
+	if (unchanged) {
+		return;
+	}
+	xwayland_view->has_strut = (bool)strut;
+	if (strut) {
+		xwayland_view->strut = *strut;
+	}
 
 	if (view->mapped) {
-		output_update_all_usable_areas(view->server, false);
+		output_update_struts(view->server);
 	}
 }
 
-static void
-update_icon(struct xwayland_view *xwayland_view)
+/*
+ * Icons are drawn at most this size in pixels: the largest of the titlebar,
+ * window switcher and menu icons at the highest output scale
+ */
+static int
+get_max_icon_size(struct server *server)
 {
-	if (!xwayland_view->xwayland_surface) {
-		return;
-	}
+	struct theme *theme = rc.theme;
+	int size = MAX(theme->window_button_width,
+		theme->menu_item_height - 2 * theme->menu_items_padding_y);
+	size = MAX(size, theme->osd_window_switcher_classic.item_icon_size);
+	size = MAX(size, theme->osd_window_switcher_thumbnail.item_icon_size);
 
-	xcb_window_t window_id = xwayland_view->xwayland_surface->window_id;
+	double scale = 1;
+	struct output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (output_is_usable(output)) {
+			scale = MAX(scale, output->wlr_output->scale);
+		}
+	}
+	return ceil(size * scale);
+}
 
-	xcb_connection_t *xcb_conn = wlr_xwayland_get_xwm_connection(
-		xwayland_view->base.server->xwayland);
-	xcb_get_property_cookie_t cookie = xcb_get_property(xcb_conn, 0,
-		window_id, atoms[ATOM_NET_WM_ICON], XCB_ATOM_CARDINAL, 0, 0x10000);
-	xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb_conn, cookie, NULL);
-	if (!reply) {
+static void
+set_icon_from_reply(struct xwayland_view *xwayland_view,
+		xcb_get_property_reply_t *reply)
+{
+	/* Some clients set the same icon again on every title change */
+	uint64_t hash = hash_add(HASH_INIT, xcb_get_property_value(reply),
+		xcb_get_property_value_length(reply));
+	if (hash == xwayland_view->icon_hash) {
 		return;
 	}
+	xwayland_view->icon_hash = hash;
+
 	xcb_ewmh_get_wm_icon_reply_t icon;
 	if (!xcb_ewmh_get_wm_icon_from_reply(&icon, reply)) {
 		wlr_log(WLR_INFO, "Invalid x11 icon");
 		view_set_icon(&xwayland_view->base, NULL, NULL);
-		goto out;
+		return;
 	}
 
+	/*
+	 * Skip sizes which are never shown: keep the smallest icon that is
+	 * at least as large as needed, and all smaller ones.
+	 */
+	int needed = get_max_icon_size(xwayland_view->base.server);
+	int limit = INT_MAX;
 	xcb_ewmh_wm_icon_iterator_t iter = xcb_ewmh_get_wm_icon_iterator(&icon);
+	for (; iter.rem; xcb_ewmh_get_wm_icon_next(&iter)) {
+		int size = MAX(iter.width, iter.height);
+		if (size >= needed && size < limit) {
+			limit = size;
+		}
+	}
+
 	struct wl_array buffers;
 	wl_array_init(&buffers);
+	iter = xcb_ewmh_get_wm_icon_iterator(&icon);
 	for (; iter.rem; xcb_ewmh_get_wm_icon_next(&iter)) {
+		if ((int)MAX(iter.width, iter.height) > limit) {
+			continue;
+		}
 		size_t stride = iter.width * 4;
 		uint32_t *buf = xzalloc(iter.height * stride);
 
-		/* Pre-multiply alpha */
-		for (uint32_t y = 0; y < iter.height; y++) {
-			for (uint32_t x = 0; x < iter.width; x++) {
-				uint32_t i = x + y * iter.width;
-				uint8_t *src_pixel = (uint8_t *)&iter.data[i];
-				uint8_t *dst_pixel = (uint8_t *)&buf[i];
-				dst_pixel[0] = src_pixel[0] * src_pixel[3] / 255;
-				dst_pixel[1] = src_pixel[1] * src_pixel[3] / 255;
-				dst_pixel[2] = src_pixel[2] * src_pixel[3] / 255;
-				dst_pixel[3] = src_pixel[3];
-			}
-		}
+		pixel_premultiply(buf, iter.data, (size_t)iter.width * iter.height);
 
 		struct lab_data_buffer *buffer = buffer_create_from_data(
 			buf, iter.width, iter.height, stride);
+		buffer_set_category(buffer, BUFFER_ICON);
 		array_add(&buffers, buffer);
 	}
 
 	/* view takes ownership of the buffers */
 	view_set_icon(&xwayland_view->base, NULL, &buffers);
 	wl_array_release(&buffers);
+}
+
+static void
+cancel_icon_request(struct xwayland_view *xwayland_view)
+{
+	if (!xwayland_view->icon_request) {
+		return;
+	}
+	/* NULL while the compositor shuts down */
+	struct wlr_xwayland *xwayland = xwayland_view->base.server->xwayland;
+	xcb_connection_t *xcb_conn =
+		xwayland ? wlr_xwayland_get_xwm_connection(xwayland) : NULL;
+	if (xcb_conn) {
+		xcb_discard_reply(xcb_conn, xwayland_view->icon_request);
+	}
+	xwayland_view->icon_request = 0;
+	wl_list_remove(&xwayland_view->icon_request_link);
+}
+
+/*
+ * Collect the _NET_WM_ICON replies which have arrived, without blocking.
+ * Returns true if requests are still in flight.
+ */
+static bool
+poll_icon_replies(xcb_connection_t *xcb_conn)
+{
+	struct xwayland_view *xwayland_view, *tmp;
+	wl_list_for_each_safe(xwayland_view, tmp, &pending_icon_requests,
+			icon_request_link) {
+		void *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xcb_conn, xwayland_view->icon_request,
+				&reply, &error)) {
+			continue;
+		}
+		xwayland_view->icon_request = 0;
+		wl_list_remove(&xwayland_view->icon_request_link);
+		if (reply) {
+			set_icon_from_reply(xwayland_view, reply);
+		}
+		free(reply);
+		free(error);
+	}
+	return !wl_list_empty(&pending_icon_requests);
+}
+
+static int
+handle_icon_poll_timer(void *data)
+{
+	struct server *server = data;
+	if (server->xwayland && poll_icon_replies(
+			wlr_xwayland_get_xwm_connection(server->xwayland))) {
+		wl_event_source_timer_update(icon_poll_timer,
+			ICON_POLL_INTERVAL_MS);
+	}
+	return 0;
+}
 
-out:
-	free(reply);
+/*
+ * Request _NET_WM_ICON without waiting for the reply. Large icon sets
+ * take a while to arrive, so blocking on them would stall the compositor.
+ * Replies are collected while X11 events are handled, and by a timer in
+ * case no further events arrive.
+ */
+static void
+update_icon(struct xwayland_view *xwayland_view)
+{
+	if (!xwayland_view->xwayland_surface) {
+		return;
+	}
+
+	xcb_window_t window_id = xwayland_view->xwayland_surface->window_id;
+
+	xcb_connection_t *xcb_conn = wlr_xwayland_get_xwm_connection(
+		xwayland_view->base.server->xwayland);
+	/* Only the latest value matters */
+	cancel_icon_request(xwayland_view);
+	xcb_get_property_cookie_t cookie = xcb_get_property(xcb_conn, 0,
+		window_id, atoms[ATOM_NET_WM_ICON], XCB_ATOM_CARDINAL, 0, 0x10000);
+	schedule_flush(xwayland_view->base.server);
+
+	xwayland_view->icon_request = cookie.sequence;
+	if (wl_list_empty(&pending_icon_requests)) {
+		wl_event_source_timer_update(icon_poll_timer,
+			ICON_POLL_INTERVAL_MS);
+	}
+	wl_list_insert(&pending_icon_requests,
+		&xwayland_view->icon_request_link);
 }
 
 static void
@@ -710,6 +969,11 @@ handle_map_request(struct wl_listener *listener, void *data)
 	 * really necessary until the view is actually mapped (and at
 	 * that point the output layout is known for sure).
 	 */
+
+	/* The window is mapped right after, so it must have its geometry */
+	if (xwayland_view->configure_pending) {
+		flush_configure(xwayland_view);
+	}
 }
 
 static void
@@ -797,6 +1061,12 @@ handle_map(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/*
+	 * WM_PROTOCOLS, which also selects the focus model, comes without
+	 * a signal, so decode it again for each map.
+	 */
+	xwayland_view->wants_focus_valid = false;
+
 	/*
 	 * The map_request event may not be received when an unmanaged
 	 * (override-redirect) surface becomes managed. To make sure we
@@ -993,6 +1263,7 @@ xwayland_view_create(struct server *server,
 {
 	struct xwayland_view *xwayland_view = znew(*xwayland_view);
 	struct view *view = &xwayland_view->base;
+	xwayland_prestart_surfaces_changed(1);
 
 	view->server = server;
 	view->type = LAB_XWAYLAND_VIEW;
@@ -1008,6 +1279,8 @@ xwayland_view_create(struct server *server,
 	 */
 	xwayland_view->xwayland_surface = xsurface;
 	xsurface->data = view;
+	g_hash_table_insert(views_by_window_id,
+		GUINT_TO_POINTER(xsurface->window_id), xwayland_view);
 
 	view->workspace = server->workspaces.current;
 	view->scene_tree = wlr_scene_tree_create(view->workspace->tree);
@@ -1032,11 +1305,11 @@ xwayland_view_create(struct server *server,
 	CONNECT_SIGNAL(xsurface, xwayland_view, set_override_redirect);
 	CONNECT_SIGNAL(xsurface, xwayland_view, set_strut_partial);
 	CONNECT_SIGNAL(xsurface, xwayland_view, set_window_type);
+	CONNECT_SIGNAL(xsurface, xwayland_view, set_hints);
 	CONNECT_SIGNAL(xsurface, xwayland_view, focus_in);
 	CONNECT_SIGNAL(xsurface, xwayland_view, map_request);
 
-	wl_list_insert(&view->server->views, &view->link);
-	view->creation_id = view->server->next_view_creation_id++;
+	view_add_to_views(view);
 
 	if (xsurface->surface) {
 		handle_associate(&xwayland_view->associate, NULL);
@@ -1065,33 +1338,25 @@ handle_new_surface(struct wl_listener *listener, void *data)
 }
 
 static struct xwayland_view *
-xwayland_view_from_window_id(struct server *server, xcb_window_t id)
+xwayland_view_from_window_id(xcb_window_t id)
 {
-	struct view *view;
-	wl_list_for_each(view, &server->views, link) {
-		if (view->type != LAB_XWAYLAND_VIEW) {
-			continue;
-		}
-		struct xwayland_view *xwayland_view = xwayland_view_from_view(view);
-		if (xwayland_view->xwayland_surface
-				&& xwayland_view->xwayland_surface->window_id == id) {
-			return xwayland_view;
-		}
-	}
-	return NULL;
+	return g_hash_table_lookup(views_by_window_id, GUINT_TO_POINTER(id));
 }
 
 #define XCB_EVENT_RESPONSE_TYPE_MASK 0x7f
 static bool
 handle_x11_event(struct wlr_xwayland *wlr_xwayland, xcb_generic_event_t *event)
 {
+	if (!wl_list_empty(&pending_icon_requests)) {
+		poll_icon_replies(wlr_xwayland_get_xwm_connection(wlr_xwayland));
+	}
+
 	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
 	case XCB_PROPERTY_NOTIFY: {
 		xcb_property_notify_event_t *ev = (void *)event;
 		if (ev->atom == atoms[ATOM_NET_WM_ICON]) {
-			struct server *server = wlr_xwayland->data;
 			struct xwayland_view *xwayland_view =
-				xwayland_view_from_window_id(server, ev->window);
+				xwayland_view_from_window_id(ev->window);
 			if (xwayland_view) {
 				update_icon(xwayland_view);
 			} else {
@@ -1160,12 +1425,18 @@ handle_xwm_ready(struct wl_listener *listener, void *data)
 	struct server *server =
 		wl_container_of(listener, server, xwayland_xwm_ready);
 	wlr_xwayland_set_seat(server->xwayland, server->seat.seat);
+	/* A new XWM has no _NET_WORKAREA yet */
+	have_workarea = false;
 	xwayland_update_workarea(server);
 }
 
 void
 xwayland_server_init(struct server *server, struct wlr_compositor *compositor)
 {
+	views_by_window_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+	icon_poll_timer = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_icon_poll_timer, server);
+
 	server->xwayland =
 		wlr_xwayland_create(server->wl_display,
 			compositor, /* lazy */ !rc.xwayland_persistence);
@@ -1205,6 +1476,8 @@ xwayland_server_init(struct server *server, struct wlr_compositor *compositor)
 			image->height, image->hotspot_x,
 			image->hotspot_y);
 	}
+
+	xwayland_prestart_init(server);
 }
 
 void
@@ -1261,6 +1534,7 @@ void
 xwayland_server_finish(struct server *server)
 {
 	struct wlr_xwayland *xwayland = server->xwayland;
+	xwayland_prestart_finish();
 	wl_list_remove(&server->xwayland_new_surface.link);
 	wl_list_remove(&server->xwayland_server_ready.link);
 	wl_list_remove(&server->xwayland_xwm_ready.link);
@@ -1271,6 +1545,15 @@ xwayland_server_finish(struct server *server)
 	 */
 	server->xwayland = NULL;
 	wlr_xwayland_destroy(xwayland);
+
+	g_hash_table_destroy(views_by_window_id);
+	views_by_window_id = NULL;
+	wl_event_source_remove(icon_poll_timer);
+	icon_poll_timer = NULL;
+	if (flush_idle) {
+		wl_event_source_remove(flush_idle);
+		flush_idle = NULL;
+	}
 }
 
 static bool
@@ -1437,6 +1720,12 @@ xwayland_update_workarea(struct server *server)
 		.width = workarea_right - workarea_left,
 		.height = workarea_bottom - workarea_top,
 	};
+	/* Each write wakes up every X11 client watching the root window */
+	if (have_workarea && wlr_box_equal(&workarea, &last_workarea)) {
+		return;
+	}
+	last_workarea = workarea;
+	have_workarea = true;
 	wlr_xwayland_set_workareas(server->xwayland, &workarea, 1);
 }
 
@@ -1446,6 +1735,5 @@ xwayland_flush(struct server *server)
 	if (!server->xwayland || !server->xwayland->xwm) {
 		return;
 	}
-
-	xcb_flush(wlr_xwayland_get_xwm_connection(server->xwayland));
+	schedule_flush(server);
 }
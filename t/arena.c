@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <setjmp.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <cmocka.h>
+#include "common/arena.h"
+
+static void
+test_arena_alloc_zeroed_and_aligned(void **state)
+{
+	struct arena arena = {0};
+	assert_null(arena_alloc(&arena, 0));
+
+	for (size_t size = 1; size < 200; size++) {
+		unsigned char *ptr = arena_alloc(&arena, size);
+		assert_non_null(ptr);
+		assert_int_equal((uintptr_t)ptr % alignof(max_align_t), 0);
+		for (size_t i = 0; i < size; i++) {
+			assert_int_equal(ptr[i], 0);
+		}
+		memset(ptr, 0xff, size);
+	}
+	arena_finish(&arena);
+	assert_null(arena.chunks);
+}
+
+static void
+test_arena_large_objects(void **state)
+{
+	struct arena arena = {0};
+	char *small = arena_strdup(&arena, "small");
+	/* Larger than a chunk */
+	size_t size = 100 * 1024;
+	unsigned char *large = arena_alloc(&arena, size);
+	memset(large, 0xaa, size);
+	char *after = arena_strdup(&arena, "after");
+
+	assert_string_equal(small, "small");
+	assert_string_equal(after, "after");
+	assert_int_equal(large[0], 0xaa);
+	assert_int_equal(large[size - 1], 0xaa);
+	arena_finish(&arena);
+}
+
+static void
+test_arena_reuse_after_finish(void **state)
+{
+	struct arena arena = {0};
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < 10000; i++) {
+			int *value = arena_new(&arena, *value);
+			assert_int_equal(*value, 0);
+			*value = i;
+		}
+		arena_finish(&arena);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_arena_alloc_zeroed_and_aligned),
+		cmocka_unit_test(test_arena_large_objects),
+		cmocka_unit_test(test_arena_reuse_after_finish),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time building a 4 KiB string with the buf_add*() functions, starting
+ * from an empty buffer each time.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include "bench.h"
+#include "common/buf.h"
+
+#define TOTAL_LEN 4096
+
+static void
+run_add(void *data)
+{
+	struct buf b = BUF_INIT;
+	for (int i = 0; i < TOTAL_LEN / 16; i++) {
+		buf_add(&b, "0123456789abcdef");
+	}
+	bench_sink += b.len;
+	buf_reset(&b);
+}
+
+static void
+run_add_char(void *data)
+{
+	struct buf b = BUF_INIT;
+	for (int i = 0; i < TOTAL_LEN; i++) {
+		buf_add_char(&b, 'a' + i % 26);
+	}
+	bench_sink += b.len;
+	buf_reset(&b);
+}
+
+static void
+run_add_fmt(void *data)
+{
+	struct buf b = BUF_INIT;
+	for (int i = 0; i < TOTAL_LEN / 16; i++) {
+		buf_add_fmt(&b, "item %4d: %s\n", i, "abc");
+	}
+	bench_sink += b.len;
+	buf_reset(&b);
+}
+
+static void
+run_expand_variables(void *data)
+{
+	struct buf b = BUF_INIT;
+	for (int i = 0; i < TOTAL_LEN / 32; i++) {
+		buf_add(&b, "~/path/$HOME/${HOME}/and/more/");
+	}
+	buf_expand_tilde(&b);
+	buf_expand_shell_variables(&b);
+	bench_sink += b.len;
+	buf_reset(&b);
+}
+
+int main(int argc, char **argv)
+{
+	bench_init();
+	bench_print_header();
+	bench_run("buf_add 16 bytes x256", run_add, NULL);
+	bench_run("buf_add_char x4096", run_add_char, NULL);
+	bench_run("buf_add_fmt x256", run_add_fmt, NULL);
+	bench_run("buf_expand_* 4 KiB", run_expand_variables, NULL);
+	return 0;
+}
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time glob matching, as used by window rules and queries, for the kinds
+ * of patterns found in configs. Also time a lookup in a large set of
+ * rules, which is what window_rules_get_property() does on a cache miss.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "common/macros.h"
+#include "common/match.h"
+#include "common/mem.h"
+
+#define NR_RULES 300
+
+struct match_case {
+	const char *name;
+	const char *pattern;
+	const char *string;
+	struct match_pattern match;
+};
+
+static struct match_case cases[] = {
+	{ "exact", "org.mozilla.firefox", "Org.Mozilla.Firefox" },
+	{ "prefix", "org.mozilla.*", "org.mozilla.firefox" },
+	{ "suffix", "*.firefox", "org.mozilla.firefox" },
+	{ "contains", "*term*", "org.gnome.terminal" },
+	{ "glob", "[Ff]ire?ox*", "firefox-esr" },
+	{ "glob mismatch", "*[0-9]*@*", "a rather long window title here" },
+};
+
+struct rules {
+	char *patterns[NR_RULES];
+	struct match_pattern matches[NR_RULES];
+	const char *string;
+};
+
+static void
+run_glob(void *data)
+{
+	struct match_case *c = data;
+	bench_sink += match_glob(c->pattern, c->string);
+}
+
+static void
+run_pattern(void *data)
+{
+	struct match_case *c = data;
+	bench_sink += match_pattern_matches(&c->match, c->string);
+}
+
+static void
+run_rules_glob(void *data)
+{
+	struct rules *rules = data;
+	for (int i = 0; i < NR_RULES; i++) {
+		bench_sink += match_glob(rules->patterns[i], rules->string);
+	}
+}
+
+static void
+run_rules_pattern(void *data)
+{
+	struct rules *rules = data;
+	for (int i = 0; i < NR_RULES; i++) {
+		bench_sink += match_pattern_matches(&rules->matches[i],
+			rules->string);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bench_init();
+	bench_print_header();
+
+	char name[64];
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct match_case *c = &cases[i];
+		match_pattern_set(&c->match, c->pattern);
+		snprintf(name, sizeof(name), "match_glob %s", c->name);
+		bench_run(name, run_glob, c);
+		snprintf(name, sizeof(name), "match_pattern_matches %s", c->name);
+		bench_run(name, run_pattern, c);
+		match_pattern_finish(&c->match);
+	}
+
+	/* A mix of literal and glob rules of which none matches */
+	struct rules rules = { .string = "org.example.application-9999" };
+	for (int i = 0; i < NR_RULES; i++) {
+		const char *formats[] = { "org.example.app%d", "app%d*",
+			"*-%d", "*tool%d*", "[a-z]%d?" };
+		char pattern[64];
+		snprintf(pattern, sizeof(pattern), formats[i % 5], i);
+		rules.patterns[i] = xstrdup(pattern);
+		match_pattern_set(&rules.matches[i], pattern);
+	}
+	bench_run("match_glob 300 rules", run_rules_glob, &rules);
+	bench_run("match_pattern_matches 300 rules", run_rules_pattern,
+		&rules);
+	for (int i = 0; i < NR_RULES; i++) {
+		free(rules.patterns[i]);
+		match_pattern_finish(&rules.matches[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time smart placement, as done by placement_find_best(), against the
+ * number of windows on the output. Run with "meson test --benchmark -v".
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "common/macros.h"
+#include "common/overlap-grid.h"
+
+struct placement {
+	struct wlr_box usable;
+	struct wlr_box *boxes;
+	int nr_boxes;
+};
+
+static void
+run_place(void *data)
+{
+	struct placement *p = data;
+	struct overlap_grid grid;
+	int x, y;
+	overlap_grid_build(&grid, p->usable, p->boxes, p->nr_boxes);
+	overlap_grid_find_best(&grid, 800, 600, &x, &y);
+	overlap_grid_finish(&grid);
+	bench_sink += x + y;
+}
+
+int main(int argc, char **argv)
+{
+	const int counts[] = { 10, 20, 40, 80, 160, 320 };
+	struct placement p = {
+		.usable = { .width = 3840, .height = 2160 },
+	};
+
+	bench_init();
+	bench_print_header();
+	srand(1);
+	for (size_t c = 0; c < ARRAY_SIZE(counts); c++) {
+		p.nr_boxes = counts[c];
+		p.boxes = calloc(p.nr_boxes, sizeof(*p.boxes));
+		for (int n = 0; n < p.nr_boxes; n++) {
+			p.boxes[n] = (struct wlr_box){
+				.x = rand() % p.usable.width,
+				.y = rand() % p.usable.height,
+				.width = 200 + rand() % 1000,
+				.height = 150 + rand() % 700,
+			};
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "placement %d windows", p.nr_boxes);
+		bench_run(name, run_place, &p);
+		free(p.boxes);
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time the parsing and preprocessing that rcxml_read() does on a large
+ * generated config with hundreds of keybinds and window rules written
+ * with dotted attributes.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <libxml/parser.h>
+#include <stdio.h>
+#include "bench.h"
+#include "common/buf.h"
+#include "common/xml.h"
+
+#define NR_KEYBINDS 500
+#define NR_WINDOW_RULES 300
+
+static void
+generate_config(struct buf *b)
+{
+	buf_add(b, "<?xml version=\"1.0\"?>\n<labwc_config>\n<keyboard>\n");
+	for (int i = 0; i < NR_KEYBINDS; i++) {
+		buf_add_fmt(b, "<keybind key=\"W-C-A-%d\" "
+			"name.action=\"GoToDesktop\" to.action=\"%d\">\n"
+			"  <action name=\"Execute\" command=\"app-%d\"/>\n"
+			"</keybind>\n", i, i % 4 + 1, i);
+	}
+	buf_add(b, "</keyboard>\n<windowRules>\n");
+	for (int i = 0; i < NR_WINDOW_RULES; i++) {
+		buf_add_fmt(b, "<windowRule identifier=\"app-%d*\" "
+			"serverDecoration=\"no\" skipTaskbar=\"yes\">\n"
+			"  <action name=\"MoveTo\" x=\"%d\" y=\"%d\"/>\n"
+			"</windowRule>\n", i, i, i * 2);
+	}
+	buf_add(b, "</windowRules>\n</labwc_config>\n");
+}
+
+static xmlDoc *
+parse(struct buf *b)
+{
+	return xmlReadMemory(b->data, b->len, NULL, NULL, XML_PARSE_XINCLUDE);
+}
+
+static void
+run_parse(void *data)
+{
+	xmlDoc *doc = parse(data);
+	bench_sink += (uintptr_t)doc;
+	xmlFreeDoc(doc);
+}
+
+static void
+run_parse_expand(void *data)
+{
+	xmlDoc *doc = parse(data);
+	lab_xml_expand_dotted_attributes(xmlDocGetRootElement(doc));
+	bench_sink += (uintptr_t)doc;
+	xmlFreeDoc(doc);
+}
+
+int main(int argc, char **argv)
+{
+	bench_init();
+	struct buf b = BUF_INIT;
+	generate_config(&b);
+	printf("config of %zu bytes\n", b.len);
+
+	bench_print_header();
+	bench_run("xmlReadMemory", run_parse, &b);
+	bench_run("xmlReadMemory + expand_dotted_attributes",
+		run_parse_expand, &b);
+	buf_reset(&b);
+	xmlCleanupParser();
+	return 0;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include <libxml/xmlmemory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Time batches until one takes at least this long */
+#define MIN_BATCH_NSEC (100 * 1000 * 1000)
+
+volatile uintptr_t bench_sink;
+
+static uint64_t nr_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+char *__real_strndup(const char *s, size_t n);
+
+void *
+__wrap_malloc(size_t size)
+{
+	nr_allocs++;
+	return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+	nr_allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+	nr_allocs++;
+	return __real_realloc(ptr, size);
+}
+
+char *
+__wrap_strdup(const char *s)
+{
+	nr_allocs++;
+	return __real_strdup(s);
+}
+
+char *
+__wrap_strndup(const char *s, size_t n)
+{
+	nr_allocs++;
+	return __real_strndup(s, n);
+}
+
+static uint64_t
+now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+bench_init(void)
+{
+	/*
+	 * Route libxml2 through the wrapped functions too: in this file,
+	 * malloc, realloc and strdup resolve to the __wrap_ variants.
+	 */
+	xmlMemSetup(free, malloc, realloc, strdup);
+}
+
+void
+bench_print_header(void)
+{
+	printf("%-44s %12s %10s\n", "benchmark", "ns/op", "allocs/op");
+}
+
+void
+bench_run(const char *name, void (*func)(void *data), void *data)
+{
+	/* Warm up caches and anything initialized lazily */
+	func(data);
+
+	uint64_t batch = 1;
+	for (;;) {
+		uint64_t allocs = nr_allocs;
+		uint64_t start = now_nsec();
+		for (uint64_t i = 0; i < batch; i++) {
+			func(data);
+		}
+		uint64_t elapsed = now_nsec() - start;
+		if (elapsed >= MIN_BATCH_NSEC) {
+			printf("%-44s %12.1f %10.2f\n", name,
+				(double)elapsed / batch,
+				(double)(nr_allocs - allocs) / batch);
+			return;
+		}
+		batch *= 2;
+	}
+}
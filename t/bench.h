@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LABWC_T_BENCH_H
+#define LABWC_T_BENCH_H
+
+#include <stdint.h>
+
+/*
+ * Helpers for the micro-benchmarks in t/, run with
+ * "meson test --benchmark -v".
+ *
+ * bench_run() calls @func in batches of doubling size until one batch
+ * takes long enough to time reliably, and prints the time and the number
+ * of heap allocations per call. Allocations are counted by wrapping
+ * malloc() and friends at link time (see t/meson.build), which covers
+ * labwc's own code and libxml2, but not allocations made inside other
+ * shared libraries such as GLib.
+ */
+
+/* Results may be stored here to keep the compiler from removing work */
+extern volatile uintptr_t bench_sink;
+
+void bench_init(void);
+void bench_print_header(void);
+void bench_run(const char *name, void (*func)(void *data), void *data);
+
+#endif /* LABWC_T_BENCH_H */
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include "common/bitset.h"
+
+static void
+test_add_remove(void **state)
+{
+	struct lab_bitset set = {0};
+
+	/* More than the 16 keys struct lab_set could hold */
+	for (uint32_t i = 0; i < 40; i++) {
+		lab_bitset_add(&set, 30 + i * 7);
+	}
+	assert_int_equal(lab_bitset_count(&set), 40);
+	assert_true(lab_bitset_contains(&set, 30));
+	assert_true(lab_bitset_contains(&set, 30 + 39 * 7));
+	assert_false(lab_bitset_contains(&set, 31));
+
+	/* Adding twice doesn't count twice */
+	lab_bitset_add(&set, 30);
+	assert_int_equal(lab_bitset_count(&set), 40);
+
+	lab_bitset_remove(&set, 30);
+	lab_bitset_remove(&set, 31);
+	assert_false(lab_bitset_contains(&set, 30));
+	assert_int_equal(lab_bitset_count(&set), 39);
+
+	/* Out of range values are ignored */
+	lab_bitset_add(&set, LAB_BITSET_MAX_VALUE + 1);
+	assert_false(lab_bitset_contains(&set, LAB_BITSET_MAX_VALUE + 1));
+	lab_bitset_add(&set, LAB_BITSET_MAX_VALUE);
+	assert_true(lab_bitset_contains(&set, LAB_BITSET_MAX_VALUE));
+	assert_int_equal(lab_bitset_count(&set), 40);
+}
+
+static void
+test_subtract_to_array(void **state)
+{
+	struct lab_bitset pressed = {0};
+	struct lab_bitset bound = {0};
+	lab_bitset_add(&pressed, 130);
+	lab_bitset_add(&pressed, 2);
+	lab_bitset_add(&pressed, 64);
+	lab_bitset_add(&pressed, 63);
+	lab_bitset_add(&bound, 64);
+	lab_bitset_add(&bound, 5);
+
+	struct lab_bitset sent;
+	lab_bitset_subtract(&sent, &pressed, &bound);
+
+	uint32_t values[8];
+	int n = lab_bitset_to_array(&sent, values, 8);
+	assert_int_equal(n, 3);
+	assert_int_equal(values[0], 2);
+	assert_int_equal(values[1], 63);
+	assert_int_equal(values[2], 130);
+
+	/* Limited to the room given */
+	n = lab_bitset_to_array(&sent, values, 2);
+	assert_int_equal(n, 2);
+	assert_int_equal(values[1], 63);
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_add_remove),
+		cmocka_unit_test(test_subtract_to_array),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -49,7 +49,21 @@ test_expand_title(void **state)
 	assert_string_equal(s.data, "foo $(bar) baz");
 	assert_int_equal(s.len, 14);
 
+	// Several variables and $ without a name
+	s.len = 0;
+	buf_add(&s, "$bar-${bar}$ $bar");
+	buf_expand_shell_variables(&s);
+	assert_string_equal(s.data, "BAR-BAR$ BAR");
+	assert_int_equal(s.len, 12);
+
 	unsetenv("bar");
+
+	// Unset variables expand to nothing
+	s.len = 0;
+	buf_add(&s, "a$bar b");
+	buf_expand_shell_variables(&s);
+	assert_string_equal(s.data, "a b");
+
 	free(s.data);
 }
 
@@ -62,6 +76,33 @@ test_buf_add_fmt(void **state)
 	buf_add_fmt(&s, " %s baz %d", "bar", 10);
 	assert_string_equal(s.data, "foo bar baz 10");
 
+	/* Longer than the spare room, so formatted again after growing */
+	char long_string[1000];
+	memset(long_string, 'x', sizeof(long_string) - 1);
+	long_string[sizeof(long_string) - 1] = '\0';
+	buf_add_fmt(&s, "%s!", long_string);
+	assert_int_equal(s.len, 14 + sizeof(long_string));
+	assert_string_equal(s.data + s.len - 2, "x!");
+
+	buf_reset(&s);
+}
+
+static void
+test_buf_add_n(void **state)
+{
+	struct buf s = BUF_INIT;
+
+	buf_add_n(&s, "foobar", 3);
+	assert_string_equal(s.data, "foo");
+	assert_int_equal(s.len, 3);
+
+	buf_add_n(&s, "bar", 0);
+	assert_string_equal(s.data, "foo");
+
+	buf_add_n(&s, "barbaz", 3);
+	assert_string_equal(s.data, "foobar");
+	assert_int_equal(s.len, 6);
+
 	buf_reset(&s);
 }
 
@@ -86,7 +127,7 @@ test_buf_add_char(void **state)
 
 	/* Check that buf_add_char() allocates space for the new character */
 	buf_add_char(&s, '+');
-	assert_true(s.alloc >= (int)len + 2);
+	assert_true(s.alloc >= len + 2);
 	assert_string_equal(s.data + s.len - 1, "+");
 
 	buf_reset(&s);
@@ -97,6 +138,7 @@ int main(int argc, char **argv)
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_expand_title),
 		cmocka_unit_test(test_buf_add_fmt),
+		cmocka_unit_test(test_buf_add_n),
 		cmocka_unit_test(test_buf_add_char),
 	};
 
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <cmocka.h>
+#include "common/intern.h"
+
+static void
+test_intern_shared(void **state)
+{
+	char buf[] = "foot";
+	const char *a = lab_intern("foot");
+	const char *b = lab_intern(buf);
+	assert_ptr_equal(a, b);
+	assert_ptr_not_equal(a, buf);
+	assert_string_equal(a, "foot");
+
+	/* Still there after dropping one of two references */
+	lab_intern_unref(b);
+	assert_ptr_equal(lab_intern("foot"), a);
+	lab_intern_unref(a);
+	lab_intern_unref(a);
+
+	assert_null(lab_intern(NULL));
+	lab_intern_unref(NULL);
+}
+
+static void
+test_intern_folded(void **state)
+{
+	const char *upper = lab_intern("Org.Foot");
+	const char *lower = lab_intern("org.foot");
+	const char *other = lab_intern("footclient");
+
+	/* The original case is kept */
+	assert_string_equal(upper, "Org.Foot");
+	assert_ptr_equal(lab_intern_folded(upper), lower);
+	assert_ptr_equal(lab_intern_folded(lower), lower);
+	assert_true(lab_intern_equal_nocase(upper, lower));
+	assert_false(lab_intern_equal_nocase(upper, other));
+
+	/* The folded version outlives the explicit reference */
+	lab_intern_unref(lower);
+	assert_string_equal(lab_intern_folded(upper), "org.foot");
+
+	lab_intern_unref(upper);
+	lab_intern_unref(other);
+	assert_null(lab_intern_folded(NULL));
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_intern_shared),
+		cmocka_unit_test(test_intern_folded),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
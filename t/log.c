@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <cmocka.h>
+#include "common/buf.h"
+#include "common/log.h"
+
+static void
+test_parse_categories(void **state)
+{
+	uint32_t mask = 0;
+	assert_true(lab_log_parse_categories("keyboard", &mask));
+	assert_int_equal(mask, LAB_LOG_KEYBOARD);
+	assert_true(lab_log_parse_categories("cursor, ipc,menu", &mask));
+	assert_int_equal(mask, LAB_LOG_CURSOR | LAB_LOG_IPC | LAB_LOG_MENU);
+	assert_true(lab_log_parse_categories("all", &mask));
+	assert_int_equal(mask, LAB_LOG_ALL);
+	assert_true(lab_log_parse_categories("none", &mask));
+	assert_int_equal(mask, 0);
+	assert_true(lab_log_parse_categories("", &mask));
+	assert_int_equal(mask, 0);
+}
+
+static void
+test_parse_unknown_category(void **state)
+{
+	uint32_t mask = LAB_LOG_TILING;
+	assert_false(lab_log_parse_categories("keyboard,foo", &mask));
+	/* Left alone on failure */
+	assert_int_equal(mask, LAB_LOG_TILING);
+}
+
+static void
+test_print_categories(void **state)
+{
+	struct buf buf = BUF_INIT;
+	lab_log_print_categories(&buf, LAB_LOG_KEYBOARD | LAB_LOG_TILING);
+	assert_string_equal(buf.data, "keyboard,tiling");
+	buf_clear(&buf);
+	lab_log_print_categories(&buf, 0);
+	assert_string_equal(buf.data, "none");
+	buf_reset(&buf);
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_parse_categories),
+		cmocka_unit_test(test_parse_unknown_category),
+		cmocka_unit_test(test_print_categories),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
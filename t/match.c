@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+#include "common/intern.h"
+#include "common/match.h"
+
+static void
+check(const char *pattern, enum match_kind kind, const char *string)
+{
+	struct match_pattern match = {0};
+	match_pattern_set(&match, pattern);
+	assert_int_equal(match.kind, kind);
+	assert_int_equal(match_pattern_matches(&match, string),
+		match_glob(pattern, string));
+
+	const char *interned = lab_intern(string);
+	assert_int_equal(match_pattern_matches_interned(&match, interned),
+		match_glob(pattern, string));
+	lab_intern_unref(interned);
+	match_pattern_finish(&match);
+}
+
+static void
+test_match_pattern_kinds(void **state)
+{
+	const char *strings[] = {
+		"", "foot", "FOOT", "footclient", "org.foot", "xfoot-1", "foo",
+	};
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		const char *s = strings[i];
+		check("*", MATCH_ANY, s);
+		check("***", MATCH_ANY, s);
+		check("", MATCH_EXACT, s);
+		check("Foot", MATCH_EXACT, s);
+		check("foot*", MATCH_PREFIX, s);
+		check("*foot", MATCH_SUFFIX, s);
+		check("**foot**", MATCH_CONTAINS, s);
+		check("f?ot", MATCH_GLOB, s);
+		check("*[Ff]oot", MATCH_GLOB, s);
+		check("foo*t", MATCH_GLOB, s);
+	}
+}
+
+static void
+test_match_pattern_unset(void **state)
+{
+	struct match_pattern match = {0};
+	assert_true(match_pattern_matches(&match, "foot"));
+	assert_true(match_pattern_matches(&match, NULL));
+
+	match_pattern_set(&match, "*");
+	assert_false(match_pattern_matches(&match, NULL));
+
+	match_pattern_set(&match, NULL);
+	assert_null(match.pattern);
+	assert_true(match_pattern_matches(&match, NULL));
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_match_pattern_kinds),
+		cmocka_unit_test(test_match_pattern_unset),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
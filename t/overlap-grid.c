@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include "common/macros.h"
+#include "common/overlap-grid.h"
+
+static const struct wlr_box usable = { .x = 10, .y = 20, .width = 800, .height = 600 };
+
+/* Sum of the areas of the intersections with each box, clipped to usable */
+static int64_t
+naive_overlap(const struct wlr_box *boxes, int nr_boxes,
+		const struct wlr_box *region)
+{
+	int64_t overlap = 0;
+	for (int n = 0; n < nr_boxes; n++) {
+		const struct wlr_box *box = &boxes[n];
+		int x0 = MAX(MAX(box->x, region->x), usable.x);
+		int y0 = MAX(MAX(box->y, region->y), usable.y);
+		int x1 = MIN(MIN(box->x + box->width, region->x + region->width),
+			usable.x + usable.width);
+		int y1 = MIN(MIN(box->y + box->height, region->y + region->height),
+			usable.y + usable.height);
+		if (x1 > x0 && y1 > y0) {
+			overlap += (int64_t)(x1 - x0) * (y1 - y0);
+		}
+	}
+	return overlap;
+}
+
+static void
+random_boxes(struct wlr_box *boxes, int nr_boxes)
+{
+	for (int n = 0; n < nr_boxes; n++) {
+		/* Some boxes extend beyond the usable area */
+		boxes[n] = (struct wlr_box){
+			.x = usable.x - 50 + rand() % (usable.width + 50),
+			.y = usable.y - 50 + rand() % (usable.height + 50),
+			.width = 1 + rand() % 400,
+			.height = 1 + rand() % 300,
+		};
+	}
+}
+
+static void
+test_overlap_grid_matches_naive(void **state)
+{
+	srand(1);
+	struct wlr_box boxes[30];
+	for (int round = 0; round < 20; round++) {
+		int nr_boxes = 1 + rand() % (int)ARRAY_SIZE(boxes);
+		random_boxes(boxes, nr_boxes);
+
+		struct overlap_grid grid;
+		overlap_grid_build(&grid, usable, boxes, nr_boxes);
+		for (int k = 0; k < 200; k++) {
+			struct wlr_box region = {
+				.x = usable.x + rand() % usable.width,
+				.y = usable.y + rand() % usable.height,
+			};
+			region.width = 1 + rand() % (usable.x + usable.width - region.x);
+			region.height = 1 + rand() % (usable.y + usable.height - region.y);
+			assert_int_equal(overlap_grid_get_overlap(&grid, &region),
+				naive_overlap(boxes, nr_boxes, &region));
+		}
+		overlap_grid_finish(&grid);
+	}
+}
+
+static void
+test_overlap_grid_out_of_bounds(void **state)
+{
+	struct wlr_box box = { .x = 100, .y = 100, .width = 100, .height = 100 };
+	struct overlap_grid grid;
+	overlap_grid_build(&grid, usable, &box, 1);
+
+	struct wlr_box region = { .x = usable.x - 1, .y = usable.y,
+		.width = 10, .height = 10 };
+	assert_true(overlap_grid_get_overlap(&grid, &region) == INT64_MAX);
+	region = (struct wlr_box){ .x = usable.x, .y = usable.y,
+		.width = usable.width, .height = usable.height + 1 };
+	assert_true(overlap_grid_get_overlap(&grid, &region) == INT64_MAX);
+
+	int x = -1, y = -1;
+	assert_false(overlap_grid_find_best(&grid, usable.width + 1, 10, &x, &y));
+	assert_int_equal(x, -1);
+	assert_int_equal(y, -1);
+	overlap_grid_finish(&grid);
+}
+
+static void
+test_overlap_grid_find_best(void **state)
+{
+	/* The top-left corner is taken, so go right of it */
+	struct wlr_box box = { .x = usable.x, .y = usable.y,
+		.width = 300, .height = 200 };
+	struct overlap_grid grid;
+	overlap_grid_build(&grid, usable, &box, 1);
+	int x, y;
+	assert_true(overlap_grid_find_best(&grid, 400, 400, &x, &y));
+	assert_int_equal(x, usable.x + 300);
+	assert_int_equal(y, usable.y);
+	overlap_grid_finish(&grid);
+
+	/* Too large to avoid overlap, so overlap the least possible */
+	struct wlr_box boxes[] = {
+		{ .x = usable.x, .y = usable.y, .width = 800, .height = 300 },
+		{ .x = usable.x, .y = usable.y + 300, .width = 600, .height = 300 },
+	};
+	overlap_grid_build(&grid, usable, boxes, ARRAY_SIZE(boxes));
+	assert_true(overlap_grid_find_best(&grid, 300, 300, &x, &y));
+	assert_int_equal(x, usable.x + 500);
+	assert_int_equal(y, usable.y + 300);
+	overlap_grid_finish(&grid);
+
+	/* An empty grid leaves the position to the caller */
+	overlap_grid_build(&grid, usable, NULL, 0);
+	assert_false(overlap_grid_find_best(&grid, 100, 100, &x, &y));
+	overlap_grid_finish(&grid);
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_overlap_grid_matches_naive),
+		cmocka_unit_test(test_overlap_grid_out_of_bounds),
+		cmocka_unit_test(test_overlap_grid_find_best),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include "common/pixel-convert.h"
+
+static uint32_t
+reference_premultiply(uint32_t pixel)
+{
+	uint32_t a = pixel >> 24;
+	uint32_t r = ((pixel >> 16) & 0xff) * a / 255;
+	uint32_t g = ((pixel >> 8) & 0xff) * a / 255;
+	uint32_t b = (pixel & 0xff) * a / 255;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* Every combination of alpha and channel value, in all three channels */
+static void
+test_premultiply_exhaustive(void **state)
+{
+	size_t count = 256 * 256;
+	uint32_t *src = calloc(count, sizeof(*src));
+	uint32_t *dst = calloc(count, sizeof(*dst));
+	for (uint32_t a = 0; a < 256; a++) {
+		for (uint32_t x = 0; x < 256; x++) {
+			uint32_t y = 255 - x;
+			src[a * 256 + x] = (a << 24) | (x << 16) | (y << 8) | x;
+		}
+	}
+
+	pixel_premultiply(dst, src, count);
+	for (size_t i = 0; i < count; i++) {
+		assert_int_equal(dst[i], reference_premultiply(src[i]));
+	}
+
+	/* In place */
+	pixel_premultiply(src, src, count);
+	for (size_t i = 0; i < count; i++) {
+		assert_int_equal(src[i], dst[i]);
+	}
+	free(src);
+	free(dst);
+}
+
+/* Lengths that are not a multiple of the vector width use the fallback */
+static void
+test_odd_lengths(void **state)
+{
+	uint32_t src[19], dst[19];
+	for (size_t len = 0; len <= 19; len++) {
+		for (size_t i = 0; i < 19; i++) {
+			src[i] = 0x80402010 + i * 0x01030507;
+			dst[i] = 0xdeadbeef;
+		}
+		pixel_premultiply(dst, src, len);
+		for (size_t i = 0; i < 19; i++) {
+			assert_int_equal(dst[i], i < len
+				? reference_premultiply(src[i]) : 0xdeadbeef);
+		}
+
+		pixel_swap_red_blue(dst, src, len);
+		for (size_t i = 0; i < len; i++) {
+			uint32_t p = src[i];
+			assert_int_equal(dst[i], (p & 0xff00ff00)
+				| ((p >> 16) & 0xff) | ((p & 0xff) << 16));
+		}
+
+		pixel_set_opaque(dst, src, len);
+		for (size_t i = 0; i < len; i++) {
+			assert_int_equal(dst[i], src[i] | 0xff000000);
+		}
+	}
+}
+
+static void
+test_downscale_half(void **state)
+{
+	/* 5x3 with padded rows; the last column and row are dropped */
+	uint32_t src[3][6] = {
+		{ 0xff000000, 0xff0000ff, 0x80808080, 0x80808080, 0x11111111, 0 },
+		{ 0xff00ff00, 0xffff0000, 0x80808080, 0x00000000, 0x11111111, 0 },
+		{ 0x22222222, 0x22222222, 0x22222222, 0x22222222, 0x22222222, 0 },
+	};
+	uint32_t dst[2] = { 0xdeadbeef, 0xdeadbeef };
+	pixel_downscale_half(dst, sizeof(dst), &src[0][0], sizeof(src[0]), 5, 3);
+	/* Each of r, g and b is 0xff in one of the four pixels */
+	assert_int_equal(dst[0], 0xff404040);
+	assert_int_equal(dst[1], 0x60606060);
+
+	/* A single column is averaged vertically only */
+	uint32_t column[2] = { 0x10203040, 0x30405060 };
+	pixel_downscale_half(dst, sizeof(dst), column, sizeof(column[0]), 1, 2);
+	assert_int_equal(dst[0], 0x20304050);
+}
+
+int main(int argc, char **argv)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_premultiply_exhaustive),
+		cmocka_unit_test(test_odd_lengths),
+		cmocka_unit_test(test_downscale_half),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}